@@ -0,0 +1,67 @@
+document.addEventListener('DOMContentLoaded', function() {
+    const nodes = {};
+    let lastFrameAt = 0;
+    let lastUptime = 0;
+    
+    function connect() {
+        const socket = new WebSocket('ws://' + location.host + '/live');
+        
+        socket.onopen = function() {
+            showStatus('Connected', true);
+        };
+        
+        socket.onmessage = function(event) {
+            const frame = JSON.parse(event.data);
+            // A full frame replaces everything, deltas only carry changed nodes
+            if (frame.full) {
+                for (const id in nodes) delete nodes[id];
+            }
+            frame.nodes.forEach(node => nodes[node.id] = node);
+            lastFrameAt = Date.now();
+            lastUptime = frame.uptime_ms;
+            if (frame.metrics) renderMetrics(frame.metrics);
+            renderNodes();
+        };
+        
+        socket.onclose = function() {
+            showStatus('Disconnected, retrying...', false);
+            setTimeout(connect, 2000);
+        };
+    }
+    
+    function renderMetrics(metrics) {
+        const table = document.getElementById('metrics');
+        table.innerHTML = '';
+        for (const key in metrics) {
+            const row = table.insertRow();
+            row.insertCell().textContent = key;
+            row.insertCell().textContent = metrics[key];
+        }
+    }
+    
+    function renderNodes() {
+        const body = document.getElementById('nodes');
+        body.innerHTML = '';
+        // Ages are relative to the frame, keep them ticking between frames
+        const sinceFrame = Date.now() - lastFrameAt;
+        Object.keys(nodes).sort().forEach(id => {
+            const node = nodes[id];
+            const row = body.insertRow();
+            row.insertCell().textContent = id;
+            row.insertCell().textContent = node.temp === null ? '-' : node.temp.toFixed(1);
+            row.insertCell().textContent = node.humidity === null ? '-' : node.humidity.toFixed(1);
+            row.insertCell().textContent = node.moisture;
+            row.insertCell().textContent = node.count;
+            row.insertCell().textContent = Math.round((node.age_ms + sinceFrame) / 1000) + ' s';
+        });
+    }
+    
+    function showStatus(message, isSuccess) {
+        const status = document.getElementById('status');
+        status.textContent = message;
+        status.className = isSuccess ? 'success' : 'error';
+    }
+    
+    setInterval(function() { if (lastFrameAt) renderNodes(); }, 1000);
+    connect();
+});
@@ -0,0 +1,13 @@
+// Reports bytes transferred and load time of this page to the hub
+window.addEventListener('load', function() {
+    // loadEventEnd is only set once the load handlers have returned
+    setTimeout(function() {
+        const nav = performance.getEntriesByType('navigation')[0];
+        if (!nav || !navigator.sendBeacon) return;
+        let bytes = nav.transferSize;
+        performance.getEntriesByType('resource').forEach(r => bytes += r.transferSize);
+        const ms = Math.round(nav.loadEventEnd - nav.startTime);
+        navigator.sendBeacon('/pageload?page=' + encodeURIComponent(location.pathname) +
+                             '&bytes=' + bytes + '&ms=' + ms);
+    }, 0);
+});
@@ -7,8 +7,6 @@ document.addEventListener('DOMContentLoaded', function() {
             document.getElementById('wifi_ssid').value = data.wifi_ssid || '';
             document.getElementById('mqtt_server').value = data.mqtt_server || '';
             document.getElementById('mqtt_port').value = data.mqtt_port || 1883;
-            document.getElementById('mqtt_username').value = data.mqtt_username || '';
-            document.getElementById('mqtt_password').value = data.mqtt_password || '';
         })
         .catch(error => {
             console.error('Error loading config:', error);
@@ -24,10 +22,17 @@ document.addEventListener('DOMContentLoaded', function() {
             wifi_ssid: document.getElementById('wifi_ssid').value,
             wifi_password: document.getElementById('wifi_password').value,
             mqtt_server: document.getElementById('mqtt_server').value,
-            mqtt_port: parseInt(document.getElementById('mqtt_port').value),
-            mqtt_username: document.getElementById('mqtt_username').value,
-            mqtt_password: document.getElementById('mqtt_password').value
+            mqtt_port: parseInt(document.getElementById('mqtt_port').value)
         };
+        // /config doesn't send the MQTT credentials back, blank keeps them
+        const mqttUsername = document.getElementById('mqtt_username').value;
+        const mqttPassword = document.getElementById('mqtt_password').value;
+        if (mqttUsername) {
+            config.mqtt_username = mqttUsername;
+        }
+        if (mqttPassword) {
+            config.mqtt_password = mqttPassword;
+        }
         
         fetch('/save', {
             method: 'POST',
@@ -38,11 +43,8 @@ document.addEventListener('DOMContentLoaded', function() {
         })
         .then(response => response.text())
         .then(data => {
+            // Applied live, the hub no longer restarts after a save
             showStatus(data, true);
-            // Restart automatically after successful save
-            setTimeout(() => {
-                window.location.reload();
-            }, 3000);
         })
         .catch(error => {
             console.error('Error saving config:', error);
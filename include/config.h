@@ -10,9 +10,23 @@
 // UART pins for ESP-NOW hub communication
 #define RX_HUB 19  // Define your actual RX pin here
 #define TX_HUB 20  // Define your actual TX pin here
+#define SERIAL_RX_CHUNK 64         // Bytes pulled from the UART per read
+#define SERIAL_LEGACY_FRAMES 0     // 1: hub still sends the raw 20-byte struct (climate nodes only)
+
+// Downlink to the ESP-NOW hub and its nodes (lib/Downlink), written by serialTask
+#define DOWNLINK_QUEUE_SIZE 8          // Commands waiting or in flight
+#define DOWNLINK_IN_FLIGHT 2           // Sent and not acked yet, at once
+#define DOWNLINK_ACK_TIMEOUT_MS 500    // Before the first resend, doubled per attempt
+#define DOWNLINK_ATTEMPTS 5            // Sends before a command gives up
+#define DOWNLINK_RESULTS 8             // Finished commands kept until the loop task reports them
+#define DOWNLINK_TIME_SYNC_MS 21600000 // Time sync to the nodes this often once NTP has synced
+#define DOWNLINK_REPORT_SIZE 768
 
 // MQTT topics
-#define TOPIC_SENSOR "topic/sensor"  // Define your actual topic here
+#define TOPIC_SENSOR "topic/sensor"
+#define TOPIC_FAULT "topic/fault"      // Sensor fault raised/cleared events (lib/SensorQuality)
+#define TOPIC_COMMAND "hub/%s/cmd/"    // + command name, %s is hub_id
+#define TOPIC_REPLY "hub/%s/reply/"  // Define your actual topic here
 #define NTP_OFFSET 6  // Define your actual time zone offset here
 
 // RTC settings
@@ -20,27 +34,248 @@
 #define I2C_SCL 9  // Default I2C SCL pin on ESP32-S3
 #define RTC_UPDATE_INTERVAL 86400000  // Update RTC from NTP once a day (in ms)
 
+// Latency tracing: build with -DENABLE_LATENCY_TRACE=1 to stamp every reading
+// from UART receive to MQTT publish. Dump with the "latency" serial command
+// or GET /latency on the portal.
+#define LATENCY_REPORT_SIZE 1024
+
+// Deferred logging (lib/EventLog): log calls queue binary entries, logTask prints them
+#define LOG_RING_SIZE 128            // Entries waiting for logTask, a power of two
+#define LOG_MAX_ARGS 6               // Arguments per log call, up to 8
+#define LOG_TEXT_SIZE 24             // Room for the %s arguments of one call, terminators included
+#define LOG_HISTORY_SIZE 32          // Last entries kept in RTC memory across resets
+#define LOG_LEVEL_DEFAULT 3          // Every module at boot: 1 error, 2 warn, 3 info, 4 debug
+#define LOG_DRAIN_MS 50              // logTask period
+#define LOG_LINE_SIZE 160            // One formatted entry
+#define LOG_REPORT_SIZE 4096         // The whole history, for the console and GET /log
+
+// Memory pools (lib/MemoryPools), all carved out once at boot
+#define READING_POOL_SIZE 32      // Readings in flight between serialTask and mqttTask
+#define PAYLOAD_POOL_SIZE 4       // Encoded payload buffers (PSRAM)
+#define JSON_ARENA_SIZE 4096      // Scratch for the payload JsonDocument
+#define MQTT_BATCH_MAX 8          // Readings mqttTask drains per wake-up
+#define MEMORY_REPORT_SIZE 1024
+
+// Boot (lib/BootOrchestrator): ingest starts first, the rest comes up concurrently
+#define BOOT_CONFIG_TIMEOUT 10000   // ms setup() waits for the config stage
+#define NTP_SYNC_TIMEOUT 10000      // ms the ntp stage waits for the first sync
+#define BOOT_REPORT_SIZE 768
+
+// WiFi (lib/WiFiManager), event driven with a cached BSSID/channel
+#define WIFI_CONNECT_TIMEOUT 15000   // ms for an attempt that has to scan
+#define WIFI_FAST_TIMEOUT 3000       // ms for an attempt using the cached AP
+#define WIFI_BACKOFF_MIN 500         // ms, doubled per consecutive failure
+#define WIFI_BACKOFF_MAX 60000
+#define WIFI_MAX_FAILURES 5          // Consecutive failures before the portal opens
+#define WIFI_REUSE_LEASE 0           // 1: reuse the last DHCP lease as static IP on fast reconnects
+#define WIFI_REPORT_SIZE 512
+
+// Tasks (lib/TaskTable), see TASKS in main.cpp
+#define TASK_WDT_TIMEOUT 10          // s without a check-in before the task watchdog panics
+#define TASK_STACK_WARN 512          // Warn once when a task's free stack drops below this (bytes)
+#define TASK_SAMPLE_INTERVAL 5000    // ms between stack and CPU samples
+#define TASK_REPORT_SIZE 768
+#define INGEST_WAIT_MAX_MS 100       // serialTask wakes at least this often without hub traffic
+
+// Maintenance console (lib/Console), see COMMANDS in main.cpp
+#define CONSOLE_POLL_MS 50           // consoleTask period while nothing is typed
+#define CONSOLE_LINE_MAX 128         // Longest command line, terminator included
+#define CONSOLE_ECHO 1               // Echo typed characters; off for terminals that echo locally
+#define MQTT_REPLY_LINE_MAX 192      // Longest output line sent as one MQTT reply
+#define MQTT_COMMAND_QUEUE 2         // MQTT commands received and not run yet; more are answered "busy"
+// Largest MQTT command payload kept for running: the calibration table or config body
+#define MQTT_COMMAND_BODY_MAX (CALIBRATION_BODY_MAX > CONFIG_BODY_MAX ? CALIBRATION_BODY_MAX : CONFIG_BODY_MAX)
+#define MQTT_COMMAND_PACKET_SIZE (MQTT_COMMAND_BODY_MAX + 128)  // Body plus topic, header and properties
+
+// MQTT over TLS 1.2 (lib/TlsClient): build with -DMQTT_TLS=1, the broker port is
+// then usually 8883. Without a CA certificate the hub does not connect at all.
+#ifndef MQTT_TLS
+#define MQTT_TLS 0
+#endif
+#define MQTT_CA_FILE "/mqtt_ca.pem"  // Broker CA, PEM or DER, on SD or LittleFS
+#define TLS_CA_MAX 8192              // Largest CA file accepted
+// Offered in this order; names the mbedTLS build lacks are skipped. ECDSA
+// first: a P-256 signature is far cheaper to verify than RSA-2048.
+#define TLS_CIPHERSUITES "TLS-ECDHE-ECDSA-WITH-AES-128-GCM-SHA256:" \
+                         "TLS-ECDHE-ECDSA-WITH-CHACHA20-POLY1305-SHA256:" \
+                         "TLS-ECDHE-ECDSA-WITH-AES-256-GCM-SHA384:" \
+                         "TLS-ECDHE-RSA-WITH-AES-128-GCM-SHA256"
+#define TLS_MAX_CIPHERSUITES 8
+#define TLS_HANDSHAKE_TIMEOUT 10000  // ms for a handshake, and for a write to get through
+#define TLS_PSRAM_MIN 1024           // mbedTLS allocations this large and up go to PSRAM
+#define TLS_SESSION_PERSIST 1        // Keep the session in NVS for a resumed connect after reboot
+#define TLS_SESSION_SLOT 2           // Config slot it is kept in, after the CONFIG_SLOT_COUNT config slots
+#define TLS_SESSION_MAX 2048         // Serialized session, the ticket included
+#define TLS_REPORT_SIZE 512
+
+// MQTT 5 (lib/Mqtt5Client): build with -DMQTT_V5=1. A broker that turns it
+// down gets 3.1.1 through PubSubClient for MQTT5_REPROBE_MS, or until the
+// broker settings change.
+#ifndef MQTT_V5
+#define MQTT_V5 0
+#endif
+#ifndef MQTT5_REPROBE_MS
+#define MQTT5_REPROBE_MS 3600000UL     // ms before a broker that turned MQTT 5 down is asked again
+#endif
+#define MQTT5_SESSION_EXPIRY 3600      // s the broker keeps subscriptions and queued messages after a drop
+#define MQTT5_MESSAGE_EXPIRY 600       // s a publish stays deliverable, so nobody gets stale telemetry; 0 = forever
+#define MQTT5_PUBLISH_QOS 1            // Telemetry QoS; 1 puts the broker's Receive Maximum in charge of the pace
+#define MQTT5_INFLIGHT_MAX 4           // QoS 1 publishes awaiting PUBACK, also capped by the broker's Receive Maximum
+#define MQTT5_RECEIVE_MAX 4            // QoS 1 messages the broker may have in flight to us
+#define MQTT5_WINDOW_WAIT_MS 200       // A publish waits this long for a PUBACK to free a slot
+#define MQTT5_TOPIC_ALIASES 8          // Topics sent by alias, also capped by the broker's Topic Alias Maximum
+#define MQTT5_TOPIC_SIZE 64
+#define MQTT5_PACKET_SIZE MQTT_COMMAND_PACKET_SIZE    // Packets in and out, properties included
+#define MQTT5_KEEPALIVE 15             // s, unless the broker sets its own
+#define MQTT5_SOCKET_TIMEOUT 2000      // ms for CONNACK, and for the rest of a packet once it started
+#define MQTT_REPORT_SIZE 512
+
+// Payload compression (lib/PayloadCompressor) for per-byte uplinks: build
+// with -DPAYLOAD_COMPRESS=1 and the readings of one mqttTask wake-up go out
+// as one LZSS frame on TOPIC_SENSOR TOPIC_COMPRESSED_SUFFIX instead of one
+// JSON message each
+#ifndef PAYLOAD_COMPRESS
+#define PAYLOAD_COMPRESS 0
+#endif
+#define TOPIC_COMPRESSED_SUFFIX "/lzss"
+#define COMPRESS_WINDOW_BITS 10        // 1 KB back; covers the dictionary and the frame's messages
+#define COMPRESS_LENGTH_BITS 5         // Matches of 2..33 bytes
+#define COMPRESS_INPUT_MAX 1536        // Dictionary plus the frame's messages before compression
+#define COMPRESS_FRAME_MAX (MQTT_MAX_PACKET_SIZE - 32)  // Leaves room for the topic and MQTT header
+#define COMPRESS_MESSAGES_MAX (MQTT_BATCH_MAX * 2)      // Each reading can release two samples
+#define COMPRESS_REPORT_SIZE 192
+
+// Embedded MQTT 3.1.1 broker (lib/MqttBroker) for clients on the hub's LAN:
+// build with -DMQTT_BROKER=1. Readings and fault events are published to it
+// whether or not the upstream broker is reachable; what local clients
+// publish on BROKER_BRIDGE_TOPICS goes upstream under TOPIC_BRIDGE.
+#ifndef MQTT_BROKER
+#define MQTT_BROKER 0
+#endif
+#define BROKER_PORT 1883
+#define BROKER_CLIENTS 8               // Connections at once, at most 32
+#define BROKER_PACKET_SIZE 512         // Largest packet a client may send or be sent
+#define BROKER_TOPIC_SIZE 128          // Longest topic or filter, terminator included
+#define BROKER_TRIE_NODES 64           // Topic levels across every client's filters
+#define BROKER_LEVEL_SIZE 16           // Longest level in a filter, terminator included
+#define BROKER_RETAINED 16             // Retained messages kept
+#define BROKER_RETAINED_SIZE 256       // Topic plus payload of one retained message
+#define BROKER_WILL_SIZE 128           // Topic plus payload of a client's will
+#define BROKER_INFLIGHT 4              // QoS 1 copies kept per client until their PUBACK; more are dropped
+#define BROKER_RESEND_MS 5000          // A QoS 1 copy without a PUBACK this long goes out again, DUP set
+#define BROKER_WRITE_TIMEOUT 200       // ms a stalled client may hold up a write before it is dropped
+#define BROKER_CONNECT_TIMEOUT 5000    // ms from accepting a connection to its CONNECT
+#define BROKER_POLL_MS 5               // brokerTask period; local publishes wait at most this long
+#define BROKER_PUBLISH_QOS 1           // Readings and faults; a client subscribed at QoS 0 gets them at 0
+#define BROKER_BRIDGE_TOPICS "site/#"  // Filters forwarded upstream, space separated, "" for none
+#define BROKER_BRIDGE_QUEUE 8          // Bridged messages waiting for mqttTask; the oldest is dropped
+#define TOPIC_BRIDGE "hub/%s/local/"   // + the local topic, %s is hub_id
+#define BROKER_REPORT_SIZE 640
+
+// Power management (lib/PowerManager)
+#define POWER_LIGHT_SLEEP 0            // 1: light sleep when idle, woken by UART RX (drops the waking bytes)
+#define POWER_FREQ_BURST 240           // MHz while draining a backlog
+#define POWER_FREQ_ACTIVE 160          // MHz while readings arrive or someone is looking
+#define POWER_FREQ_IDLE 80             // MHz otherwise; keeps APB at 80 MHz for the UART
+#define POWER_BURST_DEPTH 4            // Queued or unpublished readings that call for full speed
+#define POWER_IDLE_AFTER 10000         // ms without readings before dropping to idle
+#define POWER_HOLD_MS 2000             // ms a level is held after its load went away
+#define POWER_UPDATE_INTERVAL 250      // ms between policy updates
+#define POWER_IDLE_LOOP_MS 100         // loop() period while idle (10 ms otherwise)
+#define POWER_DISPLAY_DIM_AFTER 60000  // ms without readings before the OLED dims
+#define POWER_DISPLAY_OFF_AFTER 600000 // ms without readings before the OLED turns off
+#define POWER_DISPLAY_DIM_REFRESH 1000 // ms between OLED refreshes while dimmed
+#define POWER_UART_WAKE_EDGES 3        // RX edges that wake from light sleep
+#define POWER_REPORT_SIZE 512
+// Rough board currents per level with WiFi associated, for the average current estimate
+#define POWER_MA_BURST 95
+#define POWER_MA_ACTIVE 70
+#define POWER_MA_IDLE 45
+#define POWER_MA_SLEEP 8
+
+// Report by exception (lib/ReportFilter) in front of the MQTT path
+#define REPORT_MODE 1                  // 0: every frame, 1: deadband, 2: swinging door
+#define REPORT_HEARTBEAT_MS 900000     // Publish each node at least every 15 min
+#define REPORT_TEMP_ABS 0.2f           // degC; also the swinging-door error bound
+#define REPORT_TEMP_REL 0.0f           // Fraction of the last published value
+#define REPORT_HUMIDITY_ABS 1.0f       // %RH
+#define REPORT_HUMIDITY_REL 0.0f
+#define REPORT_MOISTURE_ABS 5.0f       // Raw ADC counts
+#define REPORT_MOISTURE_REL 0.01f
+#define REPORT_RAIN_ABS 0.1f           // mm, under one bucket tip so every tip goes out
+#define REPORT_SOLAR_ABS 10.0f         // W/m2
+#define REPORT_SOLAR_REL 0.02f
+#define REPORT_WIND_ABS 0.5f           // m/s, mean and gust
+#define REPORT_WIND_DIR_ABS 22.5f      // Degrees, one compass sector
+#define REPORT_REPORT_SIZE 256
+
+// Sensor fault detection (lib/SensorQuality), run by mqttTask after calibration.
+// Ranges are in calibrated units; a rate, stuck run or z limit of 0 turns
+// that check off for the quantity.
+#define QUALITY_TEMP_MIN -40.0f        // degC
+#define QUALITY_TEMP_MAX 60.0f
+#define QUALITY_TEMP_RATE 3.0f         // degC per minute
+#define QUALITY_HUMIDITY_MIN 1.0f      // %RH; a dead DHT reads 0
+#define QUALITY_HUMIDITY_MAX 100.0f
+#define QUALITY_HUMIDITY_RATE 20.0f    // %RH per minute
+#define QUALITY_MOISTURE_MIN 0.0f      // Raw counts or calibrated, whichever is published
+#define QUALITY_MOISTURE_MAX 4095.0f
+#define QUALITY_RAIN_RATE 10.0f        // mm per minute, far above any real downpour
+#define QUALITY_SOLAR_MAX 1500.0f      // W/m2, above the solar constant at the surface
+#define QUALITY_WIND_MAX 75.0f         // m/s, mean and gust
+#define QUALITY_STUCK_RUN 60           // Identical values in a row (temp, humidity, moisture)
+#define QUALITY_Z_LIMIT 6.0f           // Robust z-score |x - median| / (1.4826 * MAD)
+#define QUALITY_WARMUP 16              // Readings per quantity before the z-score applies
+#define QUALITY_ADAPT 0.05f            // Median/MAD tracker step, as a fraction of the MAD
+#define QUALITY_ACCEPT_RUN 3           // Rate/outlier faults in a row before a new level is accepted
+#define QUALITY_RATE_MIN_DT_MS 10000   // Rate limits apply over at least this long
+#define QUALITY_DROPOUT_MS 300000      // A node silent this long raises a dropout event
+#define QUALITY_MAX_EVENTS 8           // Fault events one reading can raise
+#define QUALITY_REPORT_SIZE 1024
+#define QUALITY_EVENT_SIZE 256         // One TOPIC_FAULT payload
+
+// Per-node sensor calibration (lib/Calibration), applied by mqttTask
+#define CALIBRATION_FILE "/calibration.json"   // On SD, else SPIFFS; replaced by the MQTT calibration command
+#define CALIBRATION_MAX_CURVES 16      // Node/quantity curves, "*" curves count too
+#define CALIBRATION_BODY_MAX 4096      // Largest calibration file or MQTT payload
+#define CALIBRATION_REPORT_SIZE 2048
+
+// Live dashboard (lib/LiveFeed), WebSocket /live on the portal server
+#define LIVE_FEED_INTERVAL 500       // ms between frames, updates in between are coalesced
+#define LIVE_METRICS_INTERVAL 2000   // ms between hub metrics in delta frames
+#define LIVE_MAX_CLIENTS 4
+#define LIVE_MAX_QUEUED 2            // Frames queued for a client before it is skipped
+#define LIVE_FRAME_SIZE 12288        // Per frame buffer (PSRAM), fits a full 64-node frame
+
 // SD Card settings
 #define SD_CS 10  // SD card chip select pin
-#define CONFIG_FILE "/mqtt_config.json"
+#define CONFIG_FILE "/mqtt_config.json"                // JSON import, read when no binary image exists
+#define CONFIG_IMPORTED_FILE "/mqtt_config.imported.json" // CONFIG_FILE is renamed to this once imported
+#define CONFIG_EXPORT_FILE "/mqtt_config.export.json"     // Written on every save, for backup
+#define CONFIG_SLOT_FILE "/config.%u.bin"                 // Image slots of FileSlotStore
+#define CONFIG_SNAPSHOT_COUNT 3   // Live config snapshots: current + spares for readers still on an old one
 #define DEFAULT_AP_SSID "MQTT-Hub-Config"
 #define DEFAULT_AP_PASSWORD "admin@123"
+#define PORTAL_CLOSE_DELAY 3000   // ms the AP stays up after a save so the reply gets through
+#define CONFIG_BODY_MAX 2048      // Largest config body accepted by /save and the MQTT config command
 
 // Configuration structure
+// Fixed-size fields so the struct can be stored and loaded as a binary image
+// (lib/ConfigManager/src/config_image.h). Only ever append fields: images
+// written by older firmware then load with defaults for the new tail.
 struct HubConfig {
-    String mqtt_server = "";
+    char mqtt_server[64] = "";
     int mqtt_port = 1883;
-    String mqtt_username = "";
-    String mqtt_password = "";
-    String wifi_ssid = "";
-    String wifi_password = "";
-    String hub_id = "H-0";
+    char mqtt_username[32] = "";
+    char mqtt_password[64] = "";
+    char wifi_ssid[33] = "";
+    char wifi_password[65] = "";
+    char hub_id[16] = "H-0";
 };
 
-// Sensor data structure
-typedef struct dhtData {
-    char nodeID[8];
-    float temp;
-    float humidity;
-    long moisture;
-} dhtData;
\ No newline at end of file
+// Truncating copy into a HubConfig string field
+template <size_t N>
+inline void setConfigString(char (&field)[N], const char* value) {
+    strncpy(field, value ? value : "", N - 1);
+    field[N - 1] = '\0';
+}
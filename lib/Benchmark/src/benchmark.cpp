@@ -0,0 +1,748 @@
+#include "benchmark.h"
+#include <ArduinoJson.h>
+#include <atomic>
+#include <new>
+#include "calibration.h"
+#include "event_log.h"
+#include "hal.h"
+#include "mqtt_manager.h"
+#include "mqtt5_client.h"
+#include "node_table.h"
+#include "payload_compressor.h"
+#include "payload_encoder.h"
+#include "sensor_quality.h"
+#include "sensor_frame.h"
+#include "serial_manager.h"
+#include "topic_trie.h"
+
+#ifdef ARDUINO
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#else
+#include <chrono>
+#include <mutex>
+#endif
+
+// ---------------------------------------------------------------------------
+// Allocation counting
+// ---------------------------------------------------------------------------
+
+static std::atomic<uint32_t> allocCount(0);
+static std::atomic<uint32_t> allocBytes(0);
+
+void AllocCounter::reset() {
+    allocCount.store(0, std::memory_order_relaxed);
+    allocBytes.store(0, std::memory_order_relaxed);
+}
+
+void AllocCounter::note(size_t size) {
+    allocCount.fetch_add(1, std::memory_order_relaxed);
+    allocBytes.fetch_add((uint32_t)size, std::memory_order_relaxed);
+}
+
+uint32_t AllocCounter::count() {
+    return allocCount.load(std::memory_order_relaxed);
+}
+
+uint32_t AllocCounter::bytes() {
+    return allocBytes.load(std::memory_order_relaxed);
+}
+
+#if BENCH_COUNT_ALLOCATIONS
+void* operator new(size_t size) {
+    AllocCounter::note(size);
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr) {
+#if __cpp_exceptions
+        throw std::bad_alloc();
+#else
+        abort();
+#endif
+    }
+    return ptr;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    AllocCounter::note(size);
+    return malloc(size ? size : 1);
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t size) noexcept {
+    (void)size;
+    free(ptr);
+}
+#endif
+
+namespace {
+
+// Routes ArduinoJson's pool allocations through the counter
+class CountingJsonAllocator : public ArduinoJson::Allocator {
+public:
+    void* allocate(size_t size) override {
+        AllocCounter::note(size);
+        return malloc(size);
+    }
+    void deallocate(void* ptr) override {
+        free(ptr);
+    }
+    void* reallocate(void* ptr, size_t newSize) override {
+        AllocCounter::note(newSize);
+        return realloc(ptr, newSize);
+    }
+};
+
+CountingJsonAllocator jsonAllocator;
+
+// ---------------------------------------------------------------------------
+// Harness
+// ---------------------------------------------------------------------------
+
+int64_t nowNs() {
+#ifdef ARDUINO
+    return esp_timer_get_time() * 1000;
+#else
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Doubles the batch size until one batch runs for at least minTimeMs, so
+// timer overhead stays negligible even for sub-microsecond operations.
+template <typename Fn>
+BenchResult measure(const char* name, uint32_t minTimeMs, Fn&& op) {
+    op();  // Warm caches and any lazy allocation
+
+    BenchResult result = { name, 0, 0, 0, 0 };
+    uint32_t batch = 1;
+    const int64_t minTimeNs = (int64_t)minTimeMs * 1000000;
+
+    while (true) {
+        AllocCounter::reset();
+        int64_t start = nowNs();
+        for (uint32_t i = 0; i < batch; i++) {
+            op();
+        }
+        int64_t elapsed = nowNs() - start;
+        uint32_t allocs = AllocCounter::count();
+        uint32_t bytes = AllocCounter::bytes();
+
+        if (elapsed >= minTimeNs || batch >= (1u << 30)) {
+            result.iterations = batch;
+            result.nsPerOp = (double)elapsed / batch;
+            result.allocsPerOp = (double)allocs / batch;
+            result.bytesPerOp = (double)bytes / batch;
+            return result;
+        }
+        batch *= 2;
+#ifdef ARDUINO
+        vTaskDelay(1);  // Let the idle task feed the watchdog between batches
+#endif
+    }
+}
+
+// Endless in-memory UART feeding pre-encoded frames
+class MemorySerialPort : public HalSerialPort {
+public:
+    MemorySerialPort(const uint8_t* data, size_t len) : data(data), len(len), pos(0) {}
+    bool begin(long baud, int8_t rxPin, int8_t txPin) override { return true; }
+    int available() override { return (int)len; }  // Always some, wraps around
+    int read() override {
+        uint8_t byte = data[pos];
+        pos = (pos + 1) % len;
+        return byte;
+    }
+    size_t readBytes(uint8_t* buffer, size_t count) override {
+        for (size_t i = 0; i < count; i++) {
+            buffer[i] = data[pos];
+            pos = (pos + 1) % len;
+        }
+        return count;
+    }
+    bool waitForData(uint32_t timeoutMs) override { return true; }
+    size_t write(const uint8_t* buffer, size_t count) override { return count; }
+    void flush() override {}
+    void setTimeout(uint32_t timeoutMs) override {}
+
+private:
+    const uint8_t* data;
+    size_t len;
+    size_t pos;
+};
+
+// Swallows what the log drain prints
+class NullPrint : public Print {
+public:
+    size_t write(uint8_t byte) override { return 1; }
+    size_t write(const uint8_t* buffer, size_t size) override { return size; }
+};
+
+const uint8_t BENCH_NODES = 32;
+
+void makeReadings(SensorReading* readings, uint8_t count) {
+    for (uint8_t i = 0; i < count; i++) {
+        char nodeID[SENSOR_NODE_ID_SIZE];
+        snprintf(nodeID, sizeof(nodeID), "N%03u", i);
+        initReading(readings[i], SCHEMA_CLIMATE, nodeID);
+        ClimateSample& climate = readings[i].as<ClimateSample>();
+        climate.temp = 20.0f + i * 0.37f;
+        climate.humidity = 55.0f + i * 0.21f;
+        climate.moisture = 30 + i;
+        readings[i].present = 0x7;
+    }
+}
+
+void writeResult(Print& out, BenchFormat format, const BenchResult& r, bool first) {
+    if (format == BENCH_CSV) {
+        out.printf("%s,%u,%.1f,%.3f,%.1f\n", r.name, (unsigned)r.iterations,
+                   r.nsPerOp, r.allocsPerOp, r.bytesPerOp);
+    } else {
+        out.printf("%s\n    {\"name\":\"%s\",\"iterations\":%u,\"ns_per_op\":%.1f,"
+                   "\"allocs_per_op\":%.3f,\"bytes_per_op\":%.1f}",
+                   first ? "" : ",", r.name, (unsigned)r.iterations,
+                   r.nsPerOp, r.allocsPerOp, r.bytesPerOp);
+    }
+}
+
+}  // namespace
+
+void runBenchmarks(Print& out, BenchFormat format, const BenchOptions& options) {
+    static SensorReading readings[BENCH_NODES];
+    makeReadings(readings, BENCH_NODES);
+
+    struct tm timeInfo;
+    memset(&timeInfo, 0, sizeof(timeInfo));
+    timeInfo.tm_year = 125;
+    timeInfo.tm_mday = 1;
+
+    char payload[MQTT_MAX_PACKET_SIZE];
+    uint32_t next = 0;
+    bool first = true;
+
+    if (format == BENCH_CSV) {
+        out.println("name,iterations,ns_per_op,allocs_per_op,bytes_per_op");
+    } else {
+#ifdef ARDUINO
+        out.print("{\n  \"platform\": \"esp32\",\n  \"results\": [");
+#else
+        out.print("{\n  \"platform\": \"native\",\n  \"results\": [");
+#endif
+    }
+
+    auto emit = [&](const BenchResult& r) {
+        writeResult(out, format, r, first);
+        first = false;
+    };
+
+    // UART frame decode through SerialManager: sync, CRC and the schema's
+    // TLV decoder, against the raw struct copy the hub link used to be
+    {
+        static uint8_t frames[BENCH_NODES * SENSOR_FRAME_MAX];
+        size_t length = 0;
+        for (uint8_t i = 0; i < BENCH_NODES; i++) {
+            length += encodeFrame(readings[i], frames + length, sizeof(frames) - length);
+        }
+        MemorySerialPort port(frames, length);
+        SerialManager serialManager(&port);
+        SensorReading reading;
+        emit(measure("decode", options.minTimeMs, [&]() {
+            serialManager.readData(&reading);
+        }));
+    }
+    {
+        static LegacyDhtFrame legacy[BENCH_NODES];
+        for (uint8_t i = 0; i < BENCH_NODES; i++) {
+            memcpy(legacy[i].nodeID, readings[i].nodeID, sizeof(legacy[i].nodeID));
+            legacy[i].temp = readings[i].value(Q_TEMP);
+            legacy[i].humidity = readings[i].value(Q_HUMIDITY);
+            legacy[i].moisture = (int32_t)readings[i].value(Q_MOISTURE);
+        }
+        MemorySerialPort port(reinterpret_cast<const uint8_t*>(legacy), sizeof(legacy));
+        LegacyDhtFrame frame;
+        emit(measure("decode_memcpy", options.minTimeMs, [&]() {
+            port.readBytes(reinterpret_cast<uint8_t*>(&frame), sizeof(frame));
+        }));
+    }
+
+    // Payload serialization: the current ArduinoJson path vs. direct snprintf
+    {
+        JsonDocument doc(&jsonAllocator);
+        emit(measure("encode_arduinojson", options.minTimeMs, [&]() {
+            encodeReading(doc, readings[next++ % BENCH_NODES], "H-0", &timeInfo, 0,
+                          payload, sizeof(payload));
+        }));
+    }
+    emit(measure("encode_direct", options.minTimeMs, [&]() {
+        encodeReadingDirect(readings[next++ % BENCH_NODES], "H-0", &timeInfo, 0,
+                            payload, sizeof(payload));
+    }));
+
+    // Task handoff primitives between serialTask and mqttTask
+    {
+#ifdef ARDUINO
+        SemaphoreHandle_t sem = xSemaphoreCreateBinary();
+        emit(measure("handoff_semaphore", options.minTimeMs, [&]() {
+            xSemaphoreGive(sem);
+            xSemaphoreTake(sem, 0);
+        }));
+        vSemaphoreDelete(sem);
+
+        QueueHandle_t queue = xQueueCreate(8, sizeof(SensorReading));
+        SensorReading received;
+        emit(measure("handoff_queue", options.minTimeMs, [&]() {
+            xQueueSend(queue, &readings[next++ % BENCH_NODES], 0);
+            xQueueReceive(queue, &received, 0);
+        }));
+        vQueueDelete(queue);
+#else
+        std::mutex lock;
+        SensorReading slots[8];
+        uint8_t head = 0, tail = 0;
+        SensorReading received;
+        emit(measure("handoff_queue", options.minTimeMs, [&]() {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                slots[head++ % 8] = readings[next++ % BENCH_NODES];
+            }
+            std::lock_guard<std::mutex> guard(lock);
+            received = slots[tail++ % 8];
+        }));
+        (void)received;
+#endif
+    }
+
+    // Calibration of one mqttTask batch: the array kernel against the
+    // per-value reference. Both include restoring the raw batch.
+    {
+        static const char CURVES[] =
+            "{\"curves\":["
+            "{\"quantity\":\"temp\",\"points\":[[-40,-39.6],[0,0.3],[50,50.2]]},"
+            "{\"quantity\":\"humidity\",\"poly\":[0.8,0.97,0.0002]},"
+            "{\"quantity\":\"moisture\",\"points\":[[0,48],[40,36],[80,21],[120,6]],"
+            "\"temp_coeff\":0.15,\"ref_temp\":20}]}";
+        static CalibrationTable table;
+        char error[96];
+        if (table.load(reinterpret_cast<const uint8_t*>(CURVES), sizeof(CURVES) - 1, error, sizeof(error))) {
+            static SensorReading batch[MQTT_BATCH_MAX];
+            SensorReading* batchData[MQTT_BATCH_MAX];
+            for (uint8_t i = 0; i < MQTT_BATCH_MAX; i++) {
+                batchData[i] = &batch[i];
+            }
+            emit(measure("calibrate_batch", options.minTimeMs, [&]() {
+                memcpy(batch, readings + next++ % (BENCH_NODES - MQTT_BATCH_MAX), sizeof(batch));
+                table.apply(batchData, MQTT_BATCH_MAX);
+            }));
+            emit(measure("calibrate_reference", options.minTimeMs, [&]() {
+                memcpy(batch, readings + next++ % (BENCH_NODES - MQTT_BATCH_MAX), sizeof(batch));
+                table.applyReference(batchData, MQTT_BATCH_MAX);
+            }));
+        }
+    }
+
+    // Fault checks on one reading, nodes in turn, a few hundredths of noise
+    // so the stuck detector stays quiet
+    {
+        static QualityMonitor monitor(QualityConfig::defaults());
+        QualityEvent events[QUALITY_MAX_EVENTS];
+        uint32_t nowMs = 0;
+        emit(measure("quality_check", options.minTimeMs, [&]() {
+            uint32_t i = next++;
+            SensorReading data = readings[i % BENCH_NODES];
+            data.schema()->setValue(data, Q_TEMP, data.value(Q_TEMP) + (float)(i % 7) * 0.01f);
+            nowMs += 10000 / BENCH_NODES;
+            monitor.check(data, nowMs, events, QUALITY_MAX_EVENTS);
+        }));
+    }
+
+    // One hot-path log line: queued in binary, filtered out by its module's
+    // level, queued and then formatted by the drain (logTask's share), and
+    // formatted on the spot as Serial.printf did before the UART wait
+    {
+        // Not the global log, so its ring and history stay untouched
+        static EventLog log;
+        NullPrint sink;
+        emit(measure("log_deferred", options.minTimeMs, [&]() {
+            uint32_t i = next++;
+            log.write(LOG_LEVEL_INFO, LOG_MQTT, "Published %s, %u bytes", readings[i % BENCH_NODES].nodeID, i);
+            if ((i & 0x3F) == 0x3F) {
+                log.discard();
+            }
+        }));
+        emit(measure("log_drain", options.minTimeMs, [&]() {
+            uint32_t i = next++;
+            log.write(LOG_LEVEL_INFO, LOG_MQTT, "Published %s, %u bytes", readings[i % BENCH_NODES].nodeID, i);
+            log.drain(sink);
+        }));
+        log.setLevel(LOG_MQTT, LOG_LEVEL_WARN);
+        emit(measure("log_filtered", options.minTimeMs, [&]() {
+            uint32_t i = next++;
+            if (log.enabled(LOG_MQTT, LOG_LEVEL_INFO)) {
+                log.write(LOG_LEVEL_INFO, LOG_MQTT, "Published %s, %u bytes", readings[i % BENCH_NODES].nodeID, i);
+            }
+        }));
+        char line[LOG_LINE_SIZE];
+        emit(measure("log_snprintf", options.minTimeMs, [&]() {
+            uint32_t i = next++;
+            snprintf(line, sizeof(line), "Published %s, %u bytes\n", readings[i % BENCH_NODES].nodeID, (unsigned)i);
+        }));
+    }
+
+    // Per-node aggregation
+    {
+        static NodeTable table;
+        table.clear();
+        emit(measure("aggregate", options.minTimeMs, [&]() {
+            uint32_t i = next++;
+            table.update(readings[i % BENCH_NODES], i);
+        }));
+    }
+
+    // One mqttTask batch of encoded readings into a compressed frame
+    {
+        static PayloadCompressor compressor;
+        static char batch[MQTT_BATCH_MAX][MQTT_MAX_PACKET_SIZE];
+        size_t lengths[MQTT_BATCH_MAX];
+        for (uint8_t i = 0; i < MQTT_BATCH_MAX; i++) {
+            lengths[i] = encodeReadingDirect(readings[i], "H-0", &timeInfo, 0, batch[i], sizeof(batch[i]));
+        }
+        emit(measure("compress_batch", options.minTimeMs, [&]() {
+            compressor.reset();
+            for (uint8_t i = 0; i < MQTT_BATCH_MAX; i++) {
+                compressor.add(batch[i], lengths[i]);
+            }
+        }));
+    }
+
+    // Matching a publish to the local broker's subscribers, one filter per
+    // client: the trie walk against testing every filter in turn
+    {
+        static const char* const FILTERS[] = {
+            "topic/sensor", "topic/#", "+/sensor", "#", "topic/fault",
+            "site/+/temp", "site/#", "hub/+/local/#",
+        };
+        static const char* const TOPICS[] = {"topic/sensor", "topic/fault", "site/n1/temp", "other/level"};
+        const uint8_t filterCount = sizeof(FILTERS) / sizeof(FILTERS[0]);
+        static TopicTrie trie;
+        for (uint8_t i = 0; i < BROKER_CLIENTS; i++) {
+            trie.subscribe(FILTERS[i % filterCount], i, i & 1);
+        }
+        uint32_t qos1;
+        emit(measure("broker_match", options.minTimeMs, [&]() {
+            trie.match(TOPICS[next++ % 4], qos1);
+        }));
+        volatile uint32_t clients = 0;
+        emit(measure("broker_match_linear", options.minTimeMs, [&]() {
+            const char* topic = TOPICS[next++ % 4];
+            uint32_t matched = 0;
+            for (uint8_t i = 0; i < BROKER_CLIENTS; i++) {
+                if (TopicTrie::matches(FILTERS[i % filterCount], topic)) {
+                    matched |= (uint32_t)1 << i;
+                }
+            }
+            clients = matched;
+        }));
+        (void)clients;
+    }
+
+    // Publish against whatever broker MQTTManager is connected to
+    if (options.mqtt && options.mqtt->isConnected()) {
+        encodeReadingDirect(readings[0], "H-0", &timeInfo, 0, payload, sizeof(payload));
+        uint32_t sent = 0;
+        emit(measure("publish", options.minTimeMs, [&]() {
+            options.mqtt->publish(options.publishTopic, payload);
+            if ((++sent & 0x3F) == 0) {
+                options.mqtt->loop();  // Drain PINGRESP/acks now and then
+            }
+        }));
+    }
+
+    if (format == BENCH_JSON) {
+        out.print("\n  ]\n}\n");
+    }
+}
+
+#if MQTT_V5
+
+namespace {
+
+// Counts what goes through to the broker and back
+class CountingClient : public Client {
+public:
+    explicit CountingClient(Client* inner) : inner(inner) {}
+    int connect(IPAddress ip, uint16_t port) override { return inner->connect(ip, port); }
+    int connect(const char* host, uint16_t port) override { return inner->connect(host, port); }
+    size_t write(uint8_t byte) override { return count(bytesOut, inner->write(byte)); }
+    size_t write(const uint8_t* buffer, size_t size) override { return count(bytesOut, inner->write(buffer, size)); }
+    int available() override { return inner->available(); }
+    int read() override {
+        int byte = inner->read();
+        bytesIn += byte >= 0;
+        return byte;
+    }
+    int read(uint8_t* buffer, size_t size) override {
+        int n = inner->read(buffer, size);
+        bytesIn += n > 0 ? n : 0;
+        return n;
+    }
+    int peek() override { return inner->peek(); }
+    void flush() override { inner->flush(); }
+    void stop() override { inner->stop(); }
+    uint8_t connected() override { return inner->connected(); }
+    operator bool() override { return connected(); }
+
+    uint32_t bytesOut = 0;
+    uint32_t bytesIn = 0;
+
+private:
+    Client* inner;
+
+    static size_t count(uint32_t& total, size_t n) {
+        total += n;
+        return n;
+    }
+};
+
+struct WireResult {
+    const char* name;
+    uint32_t messages;
+    uint32_t connectOut;        // CONNECT out, CONNACK in
+    uint32_t connectIn;
+    double outPerMsg;
+    double inPerMsg;
+    double usPerMsg;
+};
+
+void writeWireResult(Print& out, BenchFormat format, const WireResult& r, bool first) {
+    if (format == BENCH_CSV) {
+        out.printf("%s,%u,%u,%u,%.1f,%.1f,%.1f\n", r.name, (unsigned)r.messages, (unsigned)r.connectOut,
+                   (unsigned)r.connectIn, r.outPerMsg, r.inPerMsg, r.usPerMsg);
+    } else {
+        out.printf("%s\n    {\"name\":\"%s\",\"messages\":%u,\"connect_bytes_out\":%u,"
+                   "\"connect_bytes_in\":%u,\"bytes_out_per_msg\":%.1f,\"bytes_in_per_msg\":%.1f,"
+                   "\"us_per_msg\":%.1f}",
+                   first ? "" : ",", r.name, (unsigned)r.messages, (unsigned)r.connectOut,
+                   (unsigned)r.connectIn, r.outPerMsg, r.inPerMsg, r.usPerMsg);
+    }
+}
+
+}  // namespace
+
+void runWireBenchmark(Print& out, BenchFormat format, Client* transport, const char* host, uint16_t port,
+                      uint32_t messages) {
+    static SensorReading readings[BENCH_NODES];
+    makeReadings(readings, BENCH_NODES);
+
+    struct tm timeInfo;
+    memset(&timeInfo, 0, sizeof(timeInfo));
+    timeInfo.tm_year = 125;
+    timeInfo.tm_mday = 1;
+
+    // Encoded up front so the timings are the clients' alone
+    static char payloads[BENCH_NODES][MQTT_MAX_PACKET_SIZE];
+    for (uint8_t i = 0; i < BENCH_NODES; i++) {
+        encodeReadingDirect(readings[i], "H-0", &timeInfo, 0, payloads[i], sizeof(payloads[i]));
+    }
+
+    CountingClient counting(transport);
+    bool first = true;
+    if (format == BENCH_CSV) {
+        out.println("name,messages,connect_bytes_out,connect_bytes_in,bytes_out_per_msg,bytes_in_per_msg,us_per_msg");
+    } else {
+        out.print("{\n  \"wire\": [");
+    }
+
+    // connectFn true when up; publishFn(i) sends message i; settleFn waits
+    // for what is still owed (PUBACKs) and closes
+    auto run = [&](const char* name, auto&& connectFn, auto&& publishFn, auto&& settleFn) {
+        WireResult r = {name, 0, 0, 0, 0, 0, 0};
+        counting.bytesOut = counting.bytesIn = 0;
+        if (!connectFn()) {
+            if (format == BENCH_CSV) {
+                out.printf("# %s: no connection to %s:%u\n", name, host, (unsigned)port);
+            }
+            return;
+        }
+        r.connectOut = counting.bytesOut;
+        r.connectIn = counting.bytesIn;
+        uint32_t outBefore = counting.bytesOut;
+        uint32_t inBefore = counting.bytesIn;
+        int64_t start = nowNs();
+        for (uint32_t i = 0; i < messages; i++) {
+            if (!publishFn(i)) {
+                break;
+            }
+            r.messages++;
+        }
+        int64_t elapsed = nowNs() - start;
+        settleFn();
+        if (r.messages > 0) {
+            r.outPerMsg = (double)(counting.bytesOut - outBefore) / r.messages;
+            r.inPerMsg = (double)(counting.bytesIn - inBefore) / r.messages;
+            r.usPerMsg = elapsed / 1000.0 / r.messages;
+        }
+        writeWireResult(out, format, r, first);
+        first = false;
+    };
+
+    {
+        static PubSubClient client;
+        client.setClient(counting);
+        client.setServer(host, port);
+        run("mqtt311_qos0",
+            [&]() { return client.connect("bench-311"); },
+            [&](uint32_t i) {
+                bool sent = client.publish(TOPIC_SENSOR, payloads[i % BENCH_NODES]);
+                if ((i & 0x3F) == 0x3F) {
+                    client.loop();
+                }
+                return sent;
+            },
+            [&]() { client.disconnect(); });
+    }
+
+    static Mqtt5Client client5;
+    client5.setClient(&counting);
+    client5.setServer(host, port);
+    struct Variant {
+        const char* name;
+        uint8_t qos;
+        uint32_t expiry;
+    };
+    const Variant variants[] = {
+        {"mqtt5_qos0", 0, 0},
+        {"mqtt5_qos0_expiry", 0, MQTT5_MESSAGE_EXPIRY},
+        {"mqtt5_qos1_expiry", 1, MQTT5_MESSAGE_EXPIRY},
+    };
+    for (const Variant& variant : variants) {
+        run(variant.name,
+            [&]() { return client5.connect("bench-v5", nullptr, nullptr) == MQTT5_CONNECTED; },
+            [&](uint32_t i) {
+                bool sent = client5.publish(TOPIC_SENSOR, payloads[i % BENCH_NODES], variant.qos, variant.expiry);
+                if ((i & 0x3F) == 0x3F) {
+                    client5.loop();
+                }
+                return sent;
+            },
+            [&]() {
+                uint32_t start = millis();
+                while (client5.inFlight() > 0 && client5.loop() && millis() - start < MQTT5_SOCKET_TIMEOUT) {
+                    delay(1);
+                }
+                // Each row starts from a fresh session and alias table
+                client5.disconnect(true);
+            });
+    }
+
+    if (format == BENCH_JSON) {
+        out.print("\n  ]\n}\n");
+    }
+}
+
+#endif  // MQTT_V5
+
+void runCompressionBenchmark(Print& out, BenchFormat format, const SensorReading* readings, size_t count) {
+    struct Variant {
+        const char* name;
+        uint8_t batch;              // Readings per frame at most, as mqttTask drains them
+        bool dictionary;
+    };
+    const Variant variants[] = {
+        {"message", 1, true},
+        {"message_nodict", 1, false},
+        {"batch", MQTT_BATCH_MAX, true},
+        {"batch_nodict", MQTT_BATCH_MAX, false},
+    };
+    static PayloadCompressor compressor;
+    static char payload[MQTT_MAX_PACKET_SIZE];
+    static char expected[COMPRESS_INPUT_MAX + 1];
+    static char decoded[COMPRESS_INPUT_MAX + 1];
+
+    if (format == BENCH_CSV) {
+        out.println("name,messages,frames,raw_bytes,compressed_bytes,ratio,encode_us_per_kb,state_bytes,heap_bytes,errors");
+    } else {
+        out.print("{\n  \"compression\": [");
+    }
+    bool first = true;
+    for (const Variant& variant : variants) {
+        uint32_t messages = 0, frames = 0, errors = 0;
+        uint64_t raw = 0, compressed = 0;
+        int64_t encodeNs = 0;
+        size_t expectedLength = 0;
+        uint32_t heapBytes = 0;
+
+        // Checks the frame decodes back to what went in, then starts the next
+        auto flush = [&]() {
+            if (compressor.messages() == 0) {
+                return;
+            }
+            size_t n = PayloadCompressor::decompress(compressor.frame(), compressor.size(), decoded, sizeof(decoded));
+            errors += n != expectedLength || memcmp(decoded, expected, n) != 0;
+            frames++;
+            raw += compressor.rawSize();
+            compressed += compressor.size();
+            compressor.reset(variant.dictionary);
+            expectedLength = 0;
+        };
+
+        compressor.reset(variant.dictionary);
+        for (size_t i = 0; i < count; i++) {
+            // A reading a second from 2025-01-01
+            time_t at = 1735689600 + (time_t)i;
+            struct tm timeInfo;
+            gmtime_r(&at, &timeInfo);
+            size_t length = encodeReadingDirect(readings[i], "H-0", &timeInfo, 0, payload, sizeof(payload));
+            if (length == 0) {
+                continue;
+            }
+            if (compressor.messages() == variant.batch) {
+                flush();
+            }
+            AllocCounter::reset();
+            int64_t start = nowNs();
+            bool added = compressor.add(payload, length);
+            if (!added) {
+                encodeNs += nowNs() - start;
+                flush();
+                start = nowNs();
+                added = compressor.add(payload, length);
+            }
+            encodeNs += nowNs() - start;
+            heapBytes = AllocCounter::bytes() > heapBytes ? AllocCounter::bytes() : heapBytes;
+            if (!added) {
+                errors++;
+                continue;
+            }
+            if (expectedLength > 0) {
+                expected[expectedLength++] = '\n';
+            }
+            memcpy(expected + expectedLength, payload, length);
+            expectedLength += length;
+            messages++;
+        }
+        flush();
+
+        double ratio = raw ? (double)compressed / raw : 0;
+        double usPerKb = raw ? encodeNs / 1000.0 / (raw / 1024.0) : 0;
+        if (format == BENCH_CSV) {
+            out.printf("%s,%u,%u,%llu,%llu,%.3f,%.1f,%u,%u,%u\n", variant.name, (unsigned)messages,
+                       (unsigned)frames, (unsigned long long)raw, (unsigned long long)compressed, ratio, usPerKb,
+                       (unsigned)sizeof(PayloadCompressor), (unsigned)heapBytes, (unsigned)errors);
+        } else {
+            out.printf("%s\n    {\"name\":\"%s\",\"messages\":%u,\"frames\":%u,\"raw_bytes\":%llu,"
+                       "\"compressed_bytes\":%llu,\"ratio\":%.3f,\"encode_us_per_kb\":%.1f,"
+                       "\"state_bytes\":%u,\"heap_bytes\":%u,\"errors\":%u}",
+                       first ? "" : ",", variant.name, (unsigned)messages, (unsigned)frames,
+                       (unsigned long long)raw, (unsigned long long)compressed, ratio, usPerKb,
+                       (unsigned)sizeof(PayloadCompressor), (unsigned)heapBytes, (unsigned)errors);
+        }
+        first = false;
+    }
+    if (format == BENCH_JSON) {
+        out.print("\n  ]\n}\n");
+    }
+}
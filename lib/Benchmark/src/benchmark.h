@@ -0,0 +1,63 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Client.h>
+#include "config.h"
+#include "sensor_schema.h"
+
+// Count every operator new and JSON allocation so the report can show
+// allocations/op. The counter is a relaxed atomic increment.
+#ifndef BENCH_COUNT_ALLOCATIONS
+#define BENCH_COUNT_ALLOCATIONS 1
+#endif
+
+class MQTTManager;
+
+struct BenchResult {
+    const char* name;
+    uint32_t iterations;
+    double nsPerOp;
+    double allocsPerOp;
+    double bytesPerOp;      // Heap bytes requested per operation
+};
+
+enum BenchFormat {
+    BENCH_CSV,
+    BENCH_JSON
+};
+
+struct BenchOptions {
+    uint32_t minTimeMs = 500;           // Run each benchmark at least this long
+    MQTTManager* mqtt = nullptr;        // Publish bench is skipped when null or offline
+    const char* publishTopic = "bench/hub";
+};
+
+class AllocCounter {
+public:
+    static void reset();
+    static void note(size_t size);
+    static uint32_t count();
+    static uint32_t bytes();
+};
+
+// Runs decode, encode, calibration, quality, handoff, logging, aggregation
+// and publish microbenchmarks and writes one machine-readable report (CSV or
+// JSON) to out. Compare two JSON reports with tools/benchcmp.py.
+void runBenchmarks(Print& out, BenchFormat format, const BenchOptions& options);
+
+// Compression of the payloads of readings, in arrival order (e.g. decoded
+// from a tools/loadgen.py capture): ratio, encode us/KB and the memory the
+// compressor uses, one message per frame and one mqttTask batch per frame,
+// with and without the dictionary. Every frame is decompressed and checked
+// against its input.
+void runCompressionBenchmark(Print& out, BenchFormat format, const SensorReading* readings, size_t count);
+
+#if MQTT_V5
+// Bytes on the wire for sensor publishes on TOPIC_SENSOR: PubSubClient
+// (MQTT 3.1.1) against Mqtt5Client at QoS 0 and 1, with and without message
+// expiry, messages each, through transport to the broker at host:port. One
+// row per variant with the connect cost, bytes out/in per message and the
+// time per publish call.
+void runWireBenchmark(Print& out, BenchFormat format, Client* transport, const char* host, uint16_t port,
+                      uint32_t messages);
+#endif
@@ -0,0 +1,202 @@
+#include "boot_orchestrator.h"
+#include <stdio.h>
+
+#ifndef ARDUINO
+#include <chrono>
+#include <thread>
+#endif
+
+namespace {
+
+const char* stateName(BootStageState state) {
+    switch (state) {
+        case BOOT_PENDING: return "pending";
+        case BOOT_RUNNING: return "running";
+        case BOOT_OK: return "ok";
+        case BOOT_FAILED: return "failed";
+        case BOOT_SKIPPED: return "skipped";
+    }
+    return "?";
+}
+
+}  // namespace
+
+BootOrchestrator::BootOrchestrator() {
+    stageCount = 0;
+    milestoneCount = 0;
+    startedMs = 0;
+    finishedMs = 0;
+#ifdef ARDUINO
+    doneBits = NULL;
+#else
+    doneMask = 0;
+#endif
+}
+
+BootStageId BootOrchestrator::addStage(const char* name, std::function<bool()> run,
+                                       uint32_t dependsOn, uint32_t stackSize) {
+    if (stageCount >= BOOT_MAX_STAGES) {
+        Serial.printf("Boot: too many stages, '%s' dropped\n", name);
+        return BOOT_MAX_STAGES - 1;
+    }
+    Stage& stage = stages[stageCount];
+    stage.owner = this;
+    stage.name = name;
+    stage.run = run;
+    // Forward references would allow cycles, ignore them
+    stage.dependsOn = dependsOn & allMask();
+    stage.stackSize = stackSize;
+    stage.state = BOOT_PENDING;
+    stage.startMs = 0;
+    stage.endMs = 0;
+    return stageCount++;
+}
+
+void BootOrchestrator::start() {
+    startedMs = millis();
+#ifdef ARDUINO
+    doneBits = xEventGroupCreate();
+#endif
+    for (uint8_t i = 0; i < stageCount; i++) {
+#ifdef ARDUINO
+        xTaskCreate(stageTask, stages[i].name, stages[i].stackSize, &stages[i], 1, NULL);
+#else
+        std::thread(stageTask, &stages[i]).detach();
+#endif
+    }
+}
+
+void BootOrchestrator::stageTask(void* parameter) {
+    Stage* stage = static_cast<Stage*>(parameter);
+    stage->owner->runStage(stage);
+#ifdef ARDUINO
+    vTaskDelete(NULL);
+#endif
+}
+
+void BootOrchestrator::runStage(Stage* stage) {
+    waitBits(stage->dependsOn);
+
+    bool ready = true;
+    for (uint8_t i = 0; i < stageCount; i++) {
+        if ((stage->dependsOn & after(i)) && stages[i].state != BOOT_OK) {
+            ready = false;
+        }
+    }
+
+    stage->startMs = millis();
+    if (ready) {
+        stage->state = BOOT_RUNNING;
+        bool ok = stage->run();
+        stage->state = ok ? BOOT_OK : BOOT_FAILED;
+    } else {
+        stage->state = BOOT_SKIPPED;
+    }
+    stage->endMs = millis();
+
+    setDone(stage - stages);
+}
+
+void BootOrchestrator::waitBits(uint32_t mask) {
+    if (mask == 0) {
+        return;
+    }
+#ifdef ARDUINO
+    xEventGroupWaitBits(doneBits, mask, pdFALSE, pdTRUE, portMAX_DELAY);
+#else
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [&]() { return (doneMask & mask) == mask; });
+#endif
+}
+
+void BootOrchestrator::setDone(uint8_t index) {
+#ifdef ARDUINO
+    xEventGroupSetBits(doneBits, after(index));
+#else
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        doneMask |= after(index);
+    }
+    changed.notify_all();
+#endif
+    if (isFinished() && finishedMs == 0) {
+        finishedMs = millis();
+    }
+}
+
+bool BootOrchestrator::waitFor(BootStageId id, uint32_t timeoutMs) {
+    if (id >= stageCount) {
+        return false;
+    }
+#ifdef ARDUINO
+    if (doneBits == NULL) {
+        return false;
+    }
+    TickType_t ticks = timeoutMs == BOOT_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+    xEventGroupWaitBits(doneBits, after(id), pdFALSE, pdTRUE, ticks);
+#else
+    std::unique_lock<std::mutex> guard(lock);
+    auto done = [&]() { return (doneMask & after(id)) != 0; };
+    if (timeoutMs == BOOT_WAIT_FOREVER) {
+        changed.wait(guard, done);
+    } else {
+        changed.wait_for(guard, std::chrono::milliseconds(timeoutMs), done);
+    }
+#endif
+    return stages[id].state == BOOT_OK;
+}
+
+bool BootOrchestrator::isFinished() {
+#ifdef ARDUINO
+    if (doneBits == NULL) {
+        return false;
+    }
+    uint32_t mask = xEventGroupGetBits(doneBits);
+#else
+    std::lock_guard<std::mutex> guard(lock);
+    uint32_t mask = doneMask;
+#endif
+    return (mask & allMask()) == allMask();
+}
+
+void BootOrchestrator::mark(const char* name) {
+    if (milestoneCount < BOOT_MAX_MILESTONES) {
+        milestones[milestoneCount].name = name;
+        milestones[milestoneCount].atMs = millis();
+        milestoneCount++;
+    }
+}
+
+size_t BootOrchestrator::formatTimeline(char* out, size_t len) const {
+    if (len == 0) {
+        return 0;
+    }
+    size_t pos = 0;
+    auto append = [&](int n) {
+        if (n > 0) pos += (size_t)n;
+        if (pos >= len) pos = len - 1;
+    };
+
+    // All times are relative to reset, millis() starts counting there
+    append(snprintf(out, len, "%-14s %-8s %9s %9s\n", "stage", "state", "start_ms", "dur_ms"));
+    for (uint8_t i = 0; i < stageCount; i++) {
+        const Stage& stage = stages[i];
+        if (stage.state == BOOT_PENDING || stage.state == BOOT_RUNNING) {
+            append(snprintf(out + pos, len - pos, "%-14s %-8s %9s %9s\n",
+                            stage.name, stateName(stage.state), "-", "-"));
+        } else {
+            append(snprintf(out + pos, len - pos, "%-14s %-8s %9lu %9lu\n",
+                            stage.name, stateName(stage.state), stage.startMs,
+                            stage.endMs - stage.startMs));
+        }
+    }
+    for (uint8_t i = 0; i < milestoneCount; i++) {
+        append(snprintf(out + pos, len - pos, "%-14s %-8s %9lu\n",
+                        milestones[i].name, "mark", milestones[i].atMs));
+    }
+    if (finishedMs) {
+        append(snprintf(out + pos, len - pos, "boot complete at %lu ms (stages started at %lu ms)\n",
+                        finishedMs, startedMs));
+    }
+    return pos;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+
+#ifdef ARDUINO
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+#define BOOT_MAX_STAGES 16
+#define BOOT_MAX_MILESTONES 4
+#define BOOT_WAIT_FOREVER 0xFFFFFFFF
+
+enum BootStageState : uint8_t {
+    BOOT_PENDING = 0,
+    BOOT_RUNNING,
+    BOOT_OK,
+    BOOT_FAILED,
+    BOOT_SKIPPED    // A dependency failed, the stage never ran
+};
+
+typedef uint8_t BootStageId;
+
+// Runs boot stages concurrently, each in its own short-lived task, starting
+// every stage as soon as the stages it depends on have succeeded. Stages may
+// only depend on stages added before them, so the graph can't have cycles.
+class BootOrchestrator {
+public:
+    BootOrchestrator();
+
+    // dependsOn is a mask built from after(); stackSize only matters on the ESP32
+    BootStageId addStage(const char* name, std::function<bool()> run,
+                         uint32_t dependsOn = 0, uint32_t stackSize = 4096);
+    static uint32_t after(BootStageId id) { return 1UL << id; }
+
+    void start();
+    // True if the stage finished successfully within the timeout, which may
+    // be BOOT_WAIT_FOREVER
+    bool waitFor(BootStageId id, uint32_t timeoutMs);
+    bool isFinished();
+
+    BootStageState state(BootStageId id) const { return stages[id].state; }
+    // Records a point in time that isn't a stage, e.g. the first frame received
+    void mark(const char* name);
+    size_t formatTimeline(char* out, size_t len) const;
+
+private:
+    struct Stage {
+        BootOrchestrator* owner;
+        const char* name;
+        std::function<bool()> run;
+        uint32_t dependsOn;
+        uint32_t stackSize;
+        volatile BootStageState state;
+        unsigned long startMs;
+        unsigned long endMs;
+    };
+
+    struct Milestone {
+        const char* name;
+        unsigned long atMs;
+    };
+
+    Stage stages[BOOT_MAX_STAGES];
+    uint8_t stageCount;
+    Milestone milestones[BOOT_MAX_MILESTONES];
+    uint8_t milestoneCount;
+    unsigned long startedMs;
+    unsigned long finishedMs;
+
+#ifdef ARDUINO
+    EventGroupHandle_t doneBits;
+#else
+    std::mutex lock;
+    std::condition_variable changed;
+    uint32_t doneMask;
+#endif
+
+    static void stageTask(void* parameter);
+    void runStage(Stage* stage);
+    void waitBits(uint32_t mask);
+    void setDone(uint8_t index);
+    uint32_t allMask() const { return stageCount >= 32 ? 0xFFFFFFFF : (1UL << stageCount) - 1; }
+};
@@ -0,0 +1,418 @@
+#include "calibration.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "json_allocators.h"
+#include "memory_pools.h"
+
+namespace {
+
+// Segments below, between and above the breakpoints; NaN lands in the first
+inline uint8_t segment(const CalibrationCurve& curve, float x) {
+    uint8_t s = 0;
+    while (s < curve.count && x >= curve.x[s]) {
+        s++;
+    }
+    return s;
+}
+
+int quantityByKey(const char* key) {
+    for (int q = Q_TEMP; q < QUANTITY_COUNT; q++) {
+        if (strcmp(key, QUANTITY_KEYS[q]) == 0) {
+            return q;
+        }
+    }
+    return -1;
+}
+
+}  // namespace
+
+float CalibrationCurve::evaluate(float x) const {
+    if (!isfinite(x)) {
+        return NAN;
+    }
+    if (kind == CURVE_PIECEWISE) {
+        uint8_t s = segment(*this, x);
+        return slope[s] * x + intercept[s];
+    }
+    float y = coeffs[count - 1];
+    for (int i = count - 2; i >= 0; i--) {
+        y = y * x + coeffs[i];
+    }
+    return y;
+}
+
+CalibrationTable::CalibrationTable() {
+    for (uint8_t i = 0; i < 2; i++) {
+        memset(sets[i].curves, 0, sizeof(sets[i].curves));
+        sets[i].count = 0;
+        sets[i].version = 0;
+        sets[i].readers = 0;
+    }
+    current = &sets[0];
+    lanes.count = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+const CalibrationSet* CalibrationTable::acquire() {
+    // Same pin-and-recheck as ConfigManager::acquire()
+    while (true) {
+        CalibrationSet* set = current.load();
+        set->readers++;
+        if (set == current.load()) {
+            return set;
+        }
+        set->readers--;
+    }
+}
+
+void CalibrationTable::release(const CalibrationSet* set) {
+    set->readers--;
+}
+
+bool CalibrationTable::parseCurve(JsonVariantConst json, CalibrationCurve& curve, char* error, size_t errorSize) {
+    memset(&curve, 0, sizeof(curve));
+    const char* node = json["node"] | "*";
+    if (strlen(node) == 0 || strlen(node) >= SENSOR_NODE_ID_SIZE) {
+        snprintf(error, errorSize, "bad node \"%s\"", node);
+        return false;
+    }
+    strcpy(curve.nodeID, node);
+
+    const char* key = json["quantity"] | "";
+    int quantity = quantityByKey(key);
+    if (quantity < 0) {
+        snprintf(error, errorSize, "unknown quantity \"%s\"", key);
+        return false;
+    }
+    curve.quantity = (Quantity)quantity;
+    curve.tempCoeff = json["temp_coeff"] | 0.0f;
+    curve.refTemp = json["ref_temp"] | 25.0f;
+    if (!isfinite(curve.tempCoeff) || !isfinite(curve.refTemp)) {
+        snprintf(error, errorSize, "%s/%s: bad temperature compensation", node, key);
+        return false;
+    }
+
+    JsonVariantConst points = json["points"];
+    JsonVariantConst poly = json["poly"];
+    if (points.is<JsonArrayConst>() == poly.is<JsonArrayConst>()) {
+        snprintf(error, errorSize, "%s/%s: needs either points or poly", node, key);
+        return false;
+    }
+
+    if (poly.is<JsonArrayConst>()) {
+        if (poly.size() < 1 || poly.size() > CALIBRATION_POLY_TERMS) {
+            snprintf(error, errorSize, "%s/%s: 1 to %d poly terms", node, key, CALIBRATION_POLY_TERMS);
+            return false;
+        }
+        curve.kind = CURVE_POLYNOMIAL;
+        curve.count = poly.size();
+        for (uint8_t i = 0; i < curve.count; i++) {
+            curve.coeffs[i] = poly[i] | NAN;
+            if (!isfinite(curve.coeffs[i])) {
+                snprintf(error, errorSize, "%s/%s: bad poly term %u", node, key, i);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    if (points.size() < 2 || points.size() > CALIBRATION_MAX_POINTS) {
+        snprintf(error, errorSize, "%s/%s: 2 to %d points", node, key, CALIBRATION_MAX_POINTS);
+        return false;
+    }
+    curve.kind = CURVE_PIECEWISE;
+    curve.count = points.size();
+    float y[CALIBRATION_MAX_POINTS];
+    for (uint8_t i = 0; i < curve.count; i++) {
+        curve.x[i] = points[i][0] | NAN;
+        y[i] = points[i][1] | NAN;
+        if (!isfinite(curve.x[i]) || !isfinite(y[i]) || (i > 0 && curve.x[i] <= curve.x[i - 1])) {
+            snprintf(error, errorSize, "%s/%s: point %u is not [x,y] with x ascending", node, key, i);
+            return false;
+        }
+    }
+    // Flat beyond the ends, so a probe out of its calibrated range reads
+    // as the nearest calibrated value instead of extrapolating
+    curve.slope[0] = 0;
+    curve.intercept[0] = y[0];
+    for (uint8_t s = 1; s < curve.count; s++) {
+        curve.slope[s] = (y[s] - y[s - 1]) / (curve.x[s] - curve.x[s - 1]);
+        curve.intercept[s] = y[s - 1] - curve.slope[s] * curve.x[s - 1];
+    }
+    curve.slope[curve.count] = 0;
+    curve.intercept[curve.count] = y[curve.count - 1];
+    return true;
+}
+
+bool CalibrationTable::load(JsonVariantConst json, char* error, size_t errorSize) {
+    std::lock_guard<std::mutex> guard(writeLock);
+    JsonVariantConst curves = json["curves"];
+    if (!curves.is<JsonArrayConst>() || curves.size() > CALIBRATION_MAX_CURVES) {
+        snprintf(error, errorSize, !curves.is<JsonArrayConst>() ? "no curves array" : "more than %d curves",
+                 CALIBRATION_MAX_CURVES);
+        stats.rejected++;
+        return false;
+    }
+
+    // Both sets are small; the spare one is free once mqttTask lets go of it
+    CalibrationSet* old = current.load();
+    CalibrationSet* target = old == &sets[0] ? &sets[1] : &sets[0];
+    while (target->readers.load() != 0) {
+        delay(1);
+    }
+
+    uint8_t count = 0;
+    for (size_t c = 0; c < curves.size(); c++) {
+        if (!parseCurve(curves[c], target->curves[count], error, errorSize)) {
+            stats.rejected++;
+            return false;
+        }
+        for (uint8_t i = 0; i < count; i++) {
+            if (target->curves[i].quantity == target->curves[count].quantity &&
+                strcmp(target->curves[i].nodeID, target->curves[count].nodeID) == 0) {
+                snprintf(error, errorSize, "%s/%s: duplicate curve", target->curves[count].nodeID,
+                         QUANTITY_KEYS[target->curves[count].quantity]);
+                stats.rejected++;
+                return false;
+            }
+        }
+        count++;
+    }
+    target->count = count;
+    target->version = old->version + 1;
+    current.store(target);
+    stats.loads++;
+    return true;
+}
+
+bool CalibrationTable::load(const uint8_t* data, size_t length, char* error, size_t errorSize) {
+    // Transient document in PSRAM, like the config import
+    JsonDocument doc(psramJsonAllocator());
+    DeserializationError parseError = deserializeJson(doc, data, length);
+    if (parseError) {
+        snprintf(error, errorSize, "invalid JSON: %s", parseError.c_str());
+        stats.rejected++;
+        return false;
+    }
+    return load(doc.as<JsonVariantConst>(), error, errorSize);
+}
+
+bool CalibrationTable::loadFile(HalFileSystem* primary, HalFileSystem* fallback) {
+    HalFileSystem* storages[] = {primary, fallback};
+    for (HalFileSystem* storage : storages) {
+        if (storage == nullptr) {
+            continue;
+        }
+        long fileLength = storage->fileSize(CALIBRATION_FILE);
+        if (fileLength <= 0) {
+            continue;
+        }
+        if (fileLength > CALIBRATION_BODY_MAX) {
+            Serial.printf("Calibration file on %s too large\n", storage->name());
+            continue;
+        }
+        uint8_t* buf = (uint8_t*)regionAlloc(fileLength, MEM_PSRAM);
+        if (!buf) {
+            Serial.println("Out of memory reading calibration file");
+            return false;
+        }
+        size_t bytesRead = storage->readFile(CALIBRATION_FILE, buf, fileLength);
+        char error[96];
+        bool loaded = load(buf, bytesRead, error, sizeof(error));
+        regionFree(buf);
+        if (loaded) {
+            Serial.printf("Calibration: %u curves from %s\n", (unsigned)size(), storage->name());
+            return true;
+        }
+        Serial.printf("Calibration file on %s rejected: %s\n", storage->name(), error);
+    }
+    return false;
+}
+
+bool CalibrationTable::match(const CalibrationSet& set, const char* nodeID,
+                             const CalibrationCurve* curves[QUANTITY_COUNT]) {
+    bool any = false;
+    memset(curves, 0, sizeof(curves[0]) * QUANTITY_COUNT);
+    for (uint8_t i = 0; i < set.count; i++) {
+        const CalibrationCurve& curve = set.curves[i];
+        if (curve.nodeID[0] == '*' && curve.nodeID[1] == '\0') {
+            if (curves[curve.quantity] == nullptr) {
+                curves[curve.quantity] = &curve;
+                any = true;
+            }
+        } else if (strncmp(curve.nodeID, nodeID, SENSOR_NODE_ID_SIZE - 1) == 0) {
+            curves[curve.quantity] = &curve;
+            any = true;
+        }
+    }
+    return any;
+}
+
+float CalibrationTable::compensationTemp(const CalibrationCurve& curve, float temp) {
+    if (curve.tempCoeff == 0) {
+        return curve.refTemp;
+    }
+    if (isnan(temp)) {
+        // Better the uncompensated value than none
+        stats.uncompensated++;
+        return curve.refTemp;
+    }
+    return temp;
+}
+
+size_t CalibrationTable::apply(SensorReading* const* readings, size_t count) {
+    const CalibrationSet* set = acquire();
+    size_t changed = 0;
+    lanes.count = 0;
+    for (size_t r = 0; set->count > 0 && r < count; r++) {
+        SensorReading* reading = readings[r];
+        const SchemaInfo* schema = reading->schema();
+        const CalibrationCurve* curves[QUANTITY_COUNT];
+        if (schema == nullptr || !match(*set, reading->nodeID, curves)) {
+            continue;
+        }
+        // A reading's values go through the same pass, so every one of them
+        // is compensated with the temperature as received
+        if (lanes.count + QUANTITY_COUNT > CALIBRATION_LANES) {
+            changed += run();
+        }
+        float temp = schema->value(*reading, Q_TEMP);
+        for (uint8_t q = Q_TEMP; q < QUANTITY_COUNT; q++) {
+            if (curves[q] == nullptr) {
+                continue;
+            }
+            float raw = schema->value(*reading, (Quantity)q);
+            if (isnan(raw)) {
+                continue;   // Not in the frame
+            }
+            uint8_t i = lanes.count++;
+            lanes.raw[i] = raw;
+            lanes.temp[i] = compensationTemp(*curves[q], temp);
+            lanes.tempCoeff[i] = curves[q]->tempCoeff;
+            lanes.refTemp[i] = curves[q]->refTemp;
+            lanes.curve[i] = curves[q];
+            lanes.reading[i] = reading;
+            lanes.schema[i] = schema;
+            lanes.quantity[i] = (Quantity)q;
+        }
+    }
+    changed += run();
+    release(set);
+    stats.readings += count;
+    stats.values += changed;
+    return changed;
+}
+
+size_t CalibrationTable::run() {
+    const uint8_t n = lanes.count;
+    lanes.count = 0;
+
+    // Temperature compensation, straight-line float code the compiler can
+    // vectorise; uncompensated lanes have temp == refTemp
+    for (uint8_t i = 0; i < n; i++) {
+        lanes.x[i] = lanes.raw[i] - lanes.tempCoeff[i] * (lanes.temp[i] - lanes.refTemp[i]);
+    }
+
+    // Every curve as a cubic: a polynomial as is, a piecewise segment as
+    // slope and intercept
+    for (uint8_t i = 0; i < n; i++) {
+        const CalibrationCurve& curve = *lanes.curve[i];
+        if (!isfinite(lanes.x[i])) {
+            // x = 0 too: 0 * inf would give a NaN of another sign than
+            // evaluate()'s
+            lanes.x[i] = 0;
+            lanes.c0[i] = NAN;
+            lanes.c1[i] = lanes.c2[i] = lanes.c3[i] = 0;
+        } else if (curve.kind == CURVE_PIECEWISE) {
+            uint8_t s = segment(curve, lanes.x[i]);
+            lanes.c0[i] = curve.intercept[s];
+            lanes.c1[i] = curve.slope[s];
+            lanes.c2[i] = lanes.c3[i] = 0;
+        } else {
+            lanes.c0[i] = curve.coeffs[0];
+            lanes.c1[i] = curve.coeffs[1];
+            lanes.c2[i] = curve.coeffs[2];
+            lanes.c3[i] = curve.coeffs[3];
+        }
+    }
+
+    // Horner, same operation order as CalibrationCurve::evaluate() so the
+    // zero high terms drop out exactly
+    for (uint8_t i = 0; i < n; i++) {
+        float x = lanes.x[i];
+        lanes.raw[i] = ((lanes.c3[i] * x + lanes.c2[i]) * x + lanes.c1[i]) * x + lanes.c0[i];
+    }
+
+    size_t changed = 0;
+    for (uint8_t i = 0; i < n; i++) {
+        if (lanes.schema[i]->setValue(*lanes.reading[i], lanes.quantity[i], lanes.raw[i])) {
+            changed++;
+        }
+    }
+    return changed;
+}
+
+size_t CalibrationTable::applyReference(SensorReading* const* readings, size_t count) {
+    const CalibrationSet* set = acquire();
+    size_t changed = 0;
+    for (size_t r = 0; r < count; r++) {
+        SensorReading* reading = readings[r];
+        const SchemaInfo* schema = reading->schema();
+        const CalibrationCurve* curves[QUANTITY_COUNT];
+        if (schema == nullptr || !match(*set, reading->nodeID, curves)) {
+            continue;
+        }
+        float temp = reading->value(Q_TEMP);
+        float calibrated[QUANTITY_COUNT];
+        for (uint8_t q = Q_TEMP; q < QUANTITY_COUNT; q++) {
+            float raw = curves[q] ? reading->value((Quantity)q) : NAN;
+            if (isnan(raw)) {
+                curves[q] = nullptr;
+                continue;
+            }
+            const CalibrationCurve& curve = *curves[q];
+            float t = compensationTemp(curve, temp);
+            calibrated[q] = curve.evaluate(raw - curve.tempCoeff * (t - curve.refTemp));
+        }
+        for (uint8_t q = Q_TEMP; q < QUANTITY_COUNT; q++) {
+            if (curves[q] && schema->setValue(*reading, (Quantity)q, calibrated[q])) {
+                changed++;
+            }
+        }
+    }
+    release(set);
+    stats.readings += count;
+    stats.values += changed;
+    return changed;
+}
+
+size_t CalibrationTable::format(char* out, size_t len) {
+    size_t pos = 0;
+    auto append = [&](int n) {
+        if (n > 0) pos = pos + n < len ? pos + n : len - 1;
+    };
+    const CalibrationSet* set = acquire();
+    append(snprintf(out, len,
+        "Calibration v%lu: %u curves, %lu readings, %lu values calibrated, %lu uncompensated\n"
+        "  %lu loads, %lu rejected\n",
+        (unsigned long)set->version, (unsigned)set->count, (unsigned long)stats.readings,
+        (unsigned long)stats.values, (unsigned long)stats.uncompensated,
+        (unsigned long)stats.loads, (unsigned long)stats.rejected));
+    for (uint8_t i = 0; i < set->count && pos + 1 < len; i++) {
+        const CalibrationCurve& curve = set->curves[i];
+        append(snprintf(out + pos, len - pos, "  %-8s %-9s %s, %u %s", curve.nodeID,
+                        QUANTITY_KEYS[curve.quantity],
+                        curve.kind == CURVE_PIECEWISE ? "piecewise" : "poly", (unsigned)curve.count,
+                        curve.kind == CURVE_PIECEWISE ? "points" : "terms"));
+        if (curve.tempCoeff != 0 && pos + 1 < len) {
+            append(snprintf(out + pos, len - pos, ", %g/degC from %g degC",
+                            curve.tempCoeff, curve.refTemp));
+        }
+        if (pos + 1 < len) {
+            append(snprintf(out + pos, len - pos, "\n"));
+        }
+    }
+    release(set);
+    return pos;
+}
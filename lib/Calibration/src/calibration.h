@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <ArduinoJson.h>
+#include <atomic>
+#include <mutex>
+#include "config.h"
+#include "hal.h"
+#include "sensor_schema.h"
+
+#define CALIBRATION_MAX_POINTS 8    // Breakpoints of a piecewise curve
+#define CALIBRATION_POLY_TERMS 4    // Up to cubic
+#define CALIBRATION_LANES 32        // Values per kernel pass, any batch size works
+
+enum CurveKind : uint8_t {
+    CURVE_PIECEWISE,        // Linear between points, flat beyond the first and last
+    CURVE_POLYNOMIAL        // c0 + c1*x + c2*x^2 + c3*x^3
+};
+
+// Maps one quantity of one node (or of every node, "*") from what the probe
+// reports to what gets published. Temperature compensation is applied to
+// the raw value first: x = raw - tempCoeff * (T - refTemp), with T the
+// reading's own uncalibrated Q_TEMP.
+struct CalibrationCurve {
+    char nodeID[SENSOR_NODE_ID_SIZE];
+    Quantity quantity;
+    CurveKind kind;
+    uint8_t count;                              // Points or coefficients
+    float x[CALIBRATION_MAX_POINTS];            // Piecewise, strictly ascending
+    float slope[CALIBRATION_MAX_POINTS + 1];    // Per segment, [0] below x[0]
+    float intercept[CALIBRATION_MAX_POINTS + 1];
+    float coeffs[CALIBRATION_POLY_TERMS];       // Polynomial, c0 first, unused terms 0
+    float tempCoeff;                            // Raw units per degC, 0 = none
+    float refTemp;
+
+    // The curve alone, temperature compensation already applied to x
+    float evaluate(float x) const;
+};
+
+struct CalibrationStats {
+    uint32_t readings;          // Went through apply()
+    uint32_t values;            // Replaced by a calibrated value
+    uint32_t uncompensated;     // Curve wants temperature but the reading had none
+    uint32_t loads;
+    uint32_t rejected;          // Tables refused by load()
+};
+
+// Immutable once published, see ConfigSnapshot
+struct CalibrationSet {
+    CalibrationCurve curves[CALIBRATION_MAX_CURVES];
+    uint8_t count;
+    uint32_t version;
+    mutable std::atomic<uint16_t> readers;
+};
+
+// Per-node calibration curves, swapped RCU style like the live config: the
+// MQTT command replaces the table on the loop task while mqttTask keeps
+// applying the one it holds.
+//
+// apply() is the batch kernel. It works on the batch as arrays, one pass
+// per step, so the arithmetic runs over contiguous floats with no branches;
+// only the curve lookup and segment search stay per value. applyReference()
+// does the same arithmetic one value at a time through the reading accessors
+// and is what the kernel is checked against.
+class CalibrationTable {
+public:
+    CalibrationTable();
+
+    // Replaces every curve from {"curves":[{...}]}; see the README for the
+    // keys. Nothing changes unless the whole document is valid, the reason
+    // goes to error.
+    bool load(JsonVariantConst json, char* error, size_t errorSize);
+    // Raw JSON, e.g. a file or MQTT payload
+    bool load(const uint8_t* data, size_t length, char* error, size_t errorSize);
+    // Tries primary, then fallback; false if neither has the file
+    bool loadFile(HalFileSystem* primary, HalFileSystem* fallback);
+
+    // Calibrates the present values of every reading in place, returns how
+    // many changed. Not reentrant, the kernel's arrays are members.
+    size_t apply(SensorReading* const* readings, size_t count);
+    size_t applyReference(SensorReading* const* readings, size_t count);
+
+    uint8_t size() const { return current.load()->count; }
+    uint32_t getVersion() const { return current.load()->version; }
+    const CalibrationStats& getStats() const { return stats; }
+    size_t format(char* out, size_t len);
+
+private:
+    CalibrationSet sets[2];
+    std::atomic<CalibrationSet*> current;
+    std::mutex writeLock;
+    CalibrationStats stats;
+
+    // Structure of arrays for one kernel pass
+    struct Lanes {
+        float raw[CALIBRATION_LANES];
+        float temp[CALIBRATION_LANES];
+        float tempCoeff[CALIBRATION_LANES];
+        float refTemp[CALIBRATION_LANES];
+        float x[CALIBRATION_LANES];
+        float c0[CALIBRATION_LANES];
+        float c1[CALIBRATION_LANES];
+        float c2[CALIBRATION_LANES];
+        float c3[CALIBRATION_LANES];
+        const CalibrationCurve* curve[CALIBRATION_LANES];
+        SensorReading* reading[CALIBRATION_LANES];
+        const SchemaInfo* schema[CALIBRATION_LANES];
+        Quantity quantity[CALIBRATION_LANES];
+        uint8_t count;
+    };
+
+    Lanes lanes;                // Only mqttTask calls apply()
+
+    const CalibrationSet* acquire();
+    void release(const CalibrationSet* set);
+    // Curve per quantity for nodeID, a node's own curve over a "*" one
+    static bool match(const CalibrationSet& set, const char* nodeID,
+                      const CalibrationCurve* curves[QUANTITY_COUNT]);
+    static bool parseCurve(JsonVariantConst json, CalibrationCurve& curve, char* error, size_t errorSize);
+    float compensationTemp(const CalibrationCurve& curve, float temp);
+    size_t run();
+};
@@ -0,0 +1,287 @@
+#include "config_body.h"
+#include <stdlib.h>
+#include <string.h>
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static const char* const CONFIG_KEYS[] = {
+    "mqtt_server", "mqtt_port", "mqtt_username", "mqtt_password", "wifi_ssid", "wifi_password", "hub_id"
+};
+
+ConfigBodyParser::ConfigBodyParser(const HubConfig& base) {
+    staged = base;
+    received = 0;
+    state = EXPECT_OBJECT;
+    escaped = false;
+    firstKey = true;
+    unicodeDigits = 0;
+    unicode = 0;
+    depth = 0;
+    skipInString = false;
+    keyLength = 0;
+    keyOverflow = false;
+    valueLength = 0;
+}
+
+ConfigBodyStatus ConfigBodyParser::status() const {
+    switch (state) {
+        case DONE: return BODY_DONE;
+        case FAILED_INVALID: return BODY_INVALID;
+        case FAILED_TOO_LARGE: return BODY_TOO_LARGE;
+        default: return BODY_INCOMPLETE;
+    }
+}
+
+ConfigBodyStatus ConfigBodyParser::feed(const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len && state != FAILED_INVALID && state != FAILED_TOO_LARGE; i++) {
+        if (++received > CONFIG_BODY_MAX) {
+            state = FAILED_TOO_LARGE;
+        } else if (!step((char)data[i])) {
+            state = FAILED_INVALID;
+        }
+    }
+    return status();
+}
+
+ConfigBodyStatus ConfigBodyParser::finish() {
+    // Anything short of the closing brace is a truncated body
+    if (state != DONE && state != FAILED_TOO_LARGE) {
+        state = FAILED_INVALID;
+    }
+    return status();
+}
+
+ConfigBodyStatus ConfigBodyParser::parse(const uint8_t* data, size_t len, HubConfig* inout) {
+    ConfigBodyParser parser(*inout);
+    parser.feed(data, len);
+    if (parser.finish() == BODY_DONE) {
+        *inout = parser.result();
+    }
+    return parser.status();
+}
+
+bool ConfigBodyParser::step(char c) {
+    switch (state) {
+        case EXPECT_OBJECT:
+            if (isSpace(c)) return true;
+            if (c != '{') return false;
+            state = EXPECT_KEY;
+            return true;
+
+        case EXPECT_KEY:
+            if (isSpace(c)) return true;
+            if (c == '}' && firstKey) {
+                state = DONE;
+                return true;
+            }
+            if (c != '"') return false;
+            keyLength = 0;
+            keyOverflow = false;
+            state = IN_KEY;
+            return true;
+
+        case IN_KEY:
+        case IN_STRING:
+            return appendString(c);
+
+        case EXPECT_COLON:
+            if (isSpace(c)) return true;
+            if (c != ':') return false;
+            state = EXPECT_VALUE;
+            return true;
+
+        case EXPECT_VALUE:
+            if (isSpace(c)) return true;
+            valueLength = 0;
+            if (c == '"') {
+                state = IN_STRING;
+                return true;
+            }
+            if (c == '{' || c == '[') {
+                // Known keys are all scalars, only skip values we don't use
+                for (const char* known : CONFIG_KEYS) {
+                    if (!keyOverflow && strcmp(key, known) == 0) return false;
+                }
+                depth = 1;
+                skipInString = false;
+                state = SKIP_NESTED;
+                return true;
+            }
+            if (c == '-' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z')) {
+                appendValue(c);
+                state = IN_LITERAL;
+                return true;
+            }
+            return false;
+
+        case IN_LITERAL:
+            if (c == '-' || c == '+' || c == '.' || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+                (c >= 'A' && c <= 'Z')) {
+                appendValue(c);
+                return true;
+            }
+            if (!endLiteral()) return false;
+            state = EXPECT_COMMA_OR_END;
+            return step(c);
+
+        case SKIP_NESTED:
+            if (skipInString) {
+                if (escaped) {
+                    escaped = false;
+                } else if (c == '\\') {
+                    escaped = true;
+                } else if (c == '"') {
+                    skipInString = false;
+                }
+                return true;
+            }
+            if (c == '"') {
+                skipInString = true;
+            } else if (c == '{' || c == '[') {
+                if (++depth > 8) return false;
+            } else if (c == '}' || c == ']') {
+                if (--depth == 0) state = EXPECT_COMMA_OR_END;
+            }
+            return true;
+
+        case EXPECT_COMMA_OR_END:
+            if (isSpace(c)) return true;
+            if (c == ',') {
+                firstKey = false;
+                state = EXPECT_KEY;
+                return true;
+            }
+            if (c == '}') {
+                state = DONE;
+                return true;
+            }
+            return false;
+
+        case DONE:
+            return isSpace(c);
+
+        default:
+            return false;
+    }
+}
+
+bool ConfigBodyParser::appendString(char c) {
+    if (unicodeDigits > 0) {
+        uint8_t digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else return false;
+        unicode = (unicode << 4) | digit;
+        if (--unicodeDigits > 0) return true;
+        // UTF-8 encode; surrogate pairs don't occur in SSIDs and hostnames
+        if (unicode < 0x80) {
+            appendValue((char)unicode);
+        } else if (unicode < 0x800) {
+            appendValue((char)(0xC0 | (unicode >> 6)));
+            appendValue((char)(0x80 | (unicode & 0x3F)));
+        } else if (unicode < 0xD800 || unicode > 0xDFFF) {
+            appendValue((char)(0xE0 | (unicode >> 12)));
+            appendValue((char)(0x80 | ((unicode >> 6) & 0x3F)));
+            appendValue((char)(0x80 | (unicode & 0x3F)));
+        } else {
+            appendValue('?');
+        }
+        return true;
+    }
+    if (escaped) {
+        escaped = false;
+        switch (c) {
+            case '"': case '\\': case '/': appendValue(c); return true;
+            case 'b': appendValue('\b'); return true;
+            case 'f': appendValue('\f'); return true;
+            case 'n': appendValue('\n'); return true;
+            case 'r': appendValue('\r'); return true;
+            case 't': appendValue('\t'); return true;
+            case 'u': unicodeDigits = 4; unicode = 0; return true;
+            default: return false;
+        }
+    }
+    if (c == '\\') {
+        escaped = true;
+        return true;
+    }
+    if (c == '"') {
+        return endString();
+    }
+    if ((uint8_t)c < 0x20) {
+        return false;
+    }
+    appendValue(c);
+    return true;
+}
+
+// Keys and values share the character path; the state says where they go.
+// Values that don't fit are truncated like setConfigString would.
+void ConfigBodyParser::appendValue(char c) {
+    if (state == IN_KEY) {
+        if (keyLength < sizeof(key) - 1) {
+            key[keyLength++] = c;
+        } else {
+            keyOverflow = true;
+        }
+        return;
+    }
+    if (valueLength < sizeof(value) - 1) {
+        value[valueLength++] = c;
+    }
+}
+
+bool ConfigBodyParser::endString() {
+    if (state == IN_KEY) {
+        key[keyLength] = '\0';
+        state = EXPECT_COLON;
+        return true;
+    }
+    value[valueLength] = '\0';
+    apply();
+    state = EXPECT_COMMA_OR_END;
+    return true;
+}
+
+bool ConfigBodyParser::endLiteral() {
+    value[valueLength] = '\0';
+    if (strcmp(value, "null") == 0) {
+        return true;  // Same as an absent key
+    }
+    if (strcmp(value, "true") != 0 && strcmp(value, "false") != 0) {
+        char* end;
+        strtod(value, &end);
+        if (end == value || *end != '\0') {
+            return false;
+        }
+    }
+    apply();
+    return true;
+}
+
+void ConfigBodyParser::apply() {
+    if (keyOverflow) {
+        return;
+    }
+    if (strcmp(key, "mqtt_port") == 0) {
+        staged.mqtt_port = atoi(value);
+    } else if (strcmp(key, "mqtt_server") == 0) {
+        setConfigString(staged.mqtt_server, value);
+    } else if (strcmp(key, "mqtt_username") == 0) {
+        setConfigString(staged.mqtt_username, value);
+    } else if (strcmp(key, "mqtt_password") == 0) {
+        setConfigString(staged.mqtt_password, value);
+    } else if (strcmp(key, "wifi_ssid") == 0) {
+        setConfigString(staged.wifi_ssid, value);
+    } else if (strcmp(key, "wifi_password") == 0) {
+        // Only update password if provided (not empty)
+        if (value[0] != '\0') {
+            setConfigString(staged.wifi_password, value);
+        }
+    } else if (strcmp(key, "hub_id") == 0) {
+        setConfigString(staged.hub_id, value);
+    }
+}
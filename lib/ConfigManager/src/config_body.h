@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+enum ConfigBodyStatus {
+    BODY_INCOMPLETE,
+    BODY_DONE,
+    BODY_TOO_LARGE,
+    BODY_INVALID
+};
+
+// Streaming parser for the config JSON posted to /save and the MQTT config
+// command. Bytes may arrive in any number of chunks, split anywhere, and are
+// written straight into a staged HubConfig; nothing is buffered beyond one
+// key and one value. Same rules as ConfigManager::fromJson: only keys that
+// are present change, null and an empty wifi_password are ignored, unknown
+// keys (including nested ones) are skipped. Trivially destructible, so it
+// can live in memory that is released with free().
+class ConfigBodyParser {
+public:
+    explicit ConfigBodyParser(const HubConfig& base);
+    ConfigBodyStatus feed(const uint8_t* data, size_t len);
+    // Call once the whole body was fed
+    ConfigBodyStatus finish();
+    ConfigBodyStatus status() const;
+    const HubConfig& result() const { return staged; }
+
+    // One-shot parse of a complete body
+    static ConfigBodyStatus parse(const uint8_t* data, size_t len, HubConfig* inout);
+
+private:
+    enum State : uint8_t {
+        EXPECT_OBJECT,
+        EXPECT_KEY,             // After '{' or ','
+        IN_KEY,
+        EXPECT_COLON,
+        EXPECT_VALUE,
+        IN_STRING,
+        IN_LITERAL,             // Number, true, false, null
+        SKIP_NESTED,            // Object or array under an unknown key
+        EXPECT_COMMA_OR_END,
+        DONE,
+        FAILED_INVALID,
+        FAILED_TOO_LARGE
+    };
+
+    HubConfig staged;
+    size_t received;
+    State state;
+    bool escaped;
+    bool firstKey;
+    uint8_t unicodeDigits;      // Hex digits still expected after \u
+    uint16_t unicode;
+    uint8_t depth;              // Nesting while skipping
+    bool skipInString;
+    char key[24];
+    uint8_t keyLength;
+    bool keyOverflow;           // Longer than any known key
+    char value[80];             // Longest field plus room for a truncated tail
+    uint8_t valueLength;
+
+    bool step(char c);
+    bool appendString(char c);
+    void appendValue(char c);
+    bool endString();
+    bool endLiteral();
+    void apply();
+};
@@ -0,0 +1,163 @@
+#include "config_image.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <Preferences.h>
+#endif
+
+static const size_t IMAGE_MAX = sizeof(ConfigImageHeader) + sizeof(HubConfig);
+static const size_t HEADER_CRC_SPAN = offsetof(ConfigImageHeader, crc);
+
+uint32_t crc32(const uint8_t* data, size_t len, uint32_t crc) {
+    // Bitwise CRC-32 (IEEE, reflected); the image is a few hundred bytes
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+size_t FileSlotStore::read(uint8_t slot, uint8_t* buffer, size_t len) {
+    char path[32];
+    snprintf(path, sizeof(path), CONFIG_SLOT_FILE, slot);
+    if (!storage->exists(path)) {
+        return 0;
+    }
+    return storage->readFile(path, buffer, len);
+}
+
+bool FileSlotStore::write(uint8_t slot, const uint8_t* data, size_t len) {
+    char path[32];
+    snprintf(path, sizeof(path), CONFIG_SLOT_FILE, slot);
+    return storage->writeFile(path, data, len);
+}
+
+#ifdef ARDUINO
+size_t NvsSlotStore::read(uint8_t slot, uint8_t* buffer, size_t len) {
+    Preferences prefs;
+    if (!prefs.begin("config", true)) {
+        return 0;
+    }
+    char key[8];
+    snprintf(key, sizeof(key), "slot%u", slot);
+    size_t n = prefs.isKey(key) ? prefs.getBytes(key, buffer, len) : 0;
+    prefs.end();
+    return n;
+}
+
+bool NvsSlotStore::write(uint8_t slot, const uint8_t* data, size_t len) {
+    Preferences prefs;
+    if (!prefs.begin("config", false)) {
+        return false;
+    }
+    char key[8];
+    snprintf(key, sizeof(key), "slot%u", slot);
+    size_t n = prefs.putBytes(key, data, len);
+    prefs.end();
+    return n == len;
+}
+#endif
+
+ConfigImageStore::ConfigImageStore(ConfigSlotStore* slots) {
+    this->slots = slots;
+    activeSlot = -1;
+    sequence = 0;
+}
+
+bool ConfigImageStore::readSlot(uint8_t slot, ConfigImageHeader* header, HubConfig* out) {
+    uint8_t image[IMAGE_MAX];
+    size_t n = slots->read(slot, image, sizeof(image));
+    if (n < sizeof(ConfigImageHeader)) {
+        return false;
+    }
+    memcpy(header, image, sizeof(*header));
+    // An image from newer firmware may mean something else by the same
+    // bytes; the other slot, or the defaults, are safer
+    if (header->magic != CONFIG_IMAGE_MAGIC || header->version < 1 || header->version > CONFIG_IMAGE_VERSION ||
+        header->length > n - sizeof(ConfigImageHeader)) {
+        return false;
+    }
+    // Without the header in the CRC, a write torn between the sequence and
+    // the CRC leaves the old payload under the new sequence
+    uint32_t crc = header->version >= 2 ? crc32(image, HEADER_CRC_SPAN) : 0;
+    if (crc32(image + sizeof(ConfigImageHeader), header->length, crc) != header->crc) {
+        return false;
+    }
+    if (out) {
+        // Shorter images come from older firmware: defaults fill the tail
+        *out = HubConfig();
+        size_t len = header->length < sizeof(HubConfig) ? header->length : sizeof(HubConfig);
+        memcpy(out, image + sizeof(ConfigImageHeader), len);
+    }
+    return true;
+}
+
+void ConfigImageStore::scan(HubConfig* out) {
+    activeSlot = -1;
+    sequence = 0;
+    for (uint8_t slot = 0; slot < CONFIG_SLOT_COUNT; slot++) {
+        ConfigImageHeader header;
+        if (!readSlot(slot, &header, nullptr)) {
+            continue;
+        }
+        // Wrap-safe: newer if the sequence is ahead by less than half the range
+        if (activeSlot < 0 || (int32_t)(header.sequence - sequence) > 0) {
+            activeSlot = slot;
+            sequence = header.sequence;
+        }
+    }
+    if (out && activeSlot >= 0) {
+        ConfigImageHeader header;
+        readSlot(activeSlot, &header, out);
+    }
+}
+
+bool ConfigImageStore::load(HubConfig* out) {
+    scan(out);
+    if (activeSlot < 0) {
+        return false;
+    }
+    Serial.printf("Config image #%lu loaded from %s slot %d\n",
+                  (unsigned long)sequence, slots->name(), activeSlot);
+    return true;
+}
+
+bool ConfigImageStore::commit(const HubConfig& config) {
+    // Re-scan rather than trust cached state, another writer may have run
+    scan(nullptr);
+    uint8_t target = activeSlot < 0 ? 0 : (activeSlot + 1) % CONFIG_SLOT_COUNT;
+
+    uint8_t image[IMAGE_MAX];
+    ConfigImageHeader header;
+    header.magic = CONFIG_IMAGE_MAGIC;
+    header.version = CONFIG_IMAGE_VERSION;
+    header.length = sizeof(HubConfig);
+    header.sequence = sequence + 1;
+    memcpy(image, &header, sizeof(header));
+    header.crc = crc32(reinterpret_cast<const uint8_t*>(&config), sizeof(HubConfig),
+                       crc32(image, HEADER_CRC_SPAN));
+    memcpy(image, &header, sizeof(header));
+    memcpy(image + sizeof(header), &config, sizeof(HubConfig));
+
+    if (!slots->write(target, image, sizeof(image))) {
+        Serial.printf("Failed to write config image to %s slot %u\n", slots->name(), target);
+        return false;
+    }
+
+    // Read back: only a verified slot may become the active one
+    ConfigImageHeader check;
+    if (!readSlot(target, &check, nullptr) || check.sequence != header.sequence) {
+        Serial.printf("Config image in %s slot %u failed verification\n", slots->name(), target);
+        return false;
+    }
+    activeSlot = target;
+    sequence = header.sequence;
+    Serial.printf("Config image #%lu committed to %s slot %u\n",
+                  (unsigned long)sequence, slots->name(), target);
+    return true;
+}
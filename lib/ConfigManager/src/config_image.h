@@ -0,0 +1,75 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.h"
+#include "hal.h"
+
+#define CONFIG_IMAGE_MAGIC 0x47464348  // "HCFG"
+// 2: the CRC covers the header up to it as well as the payload. Version 1
+// images (payload only) still load.
+#define CONFIG_IMAGE_VERSION 2
+#define CONFIG_SLOT_COUNT 2
+
+// Header in front of the raw HubConfig bytes. Loading is a CRC check and a
+// memcpy; there is nothing to parse.
+struct ConfigImageHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length;     // Payload bytes following the header
+    uint32_t sequence;   // Bumped on every commit, the newest valid slot wins
+    uint32_t crc;        // CRC-32 of the fields above and the payload
+};
+
+uint32_t crc32(const uint8_t* data, size_t len, uint32_t crc = 0);
+
+// Raw storage for the image slots
+class ConfigSlotStore {
+public:
+    virtual ~ConfigSlotStore() {}
+    virtual const char* name() const = 0;
+    // Bytes read, 0 if the slot is empty
+    virtual size_t read(uint8_t slot, uint8_t* buffer, size_t len) = 0;
+    virtual bool write(uint8_t slot, const uint8_t* data, size_t len) = 0;
+};
+
+// Slots as files on a HalFileSystem (SPIFFS, or a host directory natively)
+class FileSlotStore : public ConfigSlotStore {
+public:
+    explicit FileSlotStore(HalFileSystem* storage) : storage(storage) {}
+    const char* name() const override { return storage->name(); }
+    size_t read(uint8_t slot, uint8_t* buffer, size_t len) override;
+    bool write(uint8_t slot, const uint8_t* data, size_t len) override;
+
+private:
+    HalFileSystem* storage;
+};
+
+#ifdef ARDUINO
+// Slots as NVS blobs, available before any filesystem is mounted
+class NvsSlotStore : public ConfigSlotStore {
+public:
+    const char* name() const override { return "NVS"; }
+    size_t read(uint8_t slot, uint8_t* buffer, size_t len) override;
+    bool write(uint8_t slot, const uint8_t* data, size_t len) override;
+};
+#endif
+
+// Double-buffered image: commit() always writes the slot that is not the
+// newest valid one, so a torn write leaves the previous config intact.
+class ConfigImageStore {
+public:
+    explicit ConfigImageStore(ConfigSlotStore* slots);
+    // False if neither slot holds a valid image
+    bool load(HubConfig* out);
+    bool commit(const HubConfig& config);
+    int8_t getActiveSlot() const { return activeSlot; }
+    uint32_t getSequence() const { return sequence; }
+
+private:
+    ConfigSlotStore* slots;
+    int8_t activeSlot;     // -1 if none is valid
+    uint32_t sequence;
+
+    bool readSlot(uint8_t slot, ConfigImageHeader* header, HubConfig* out);
+    void scan(HubConfig* out);
+};
@@ -1,188 +1,307 @@
 #include "config_manager.h"
 
-ConfigManager::ConfigManager() {
+ConfigManager::ConfigManager(HalFileSystem* primary, HalFileSystem* fallback, ConfigSlotStore* slots)
+    : images(slots) {
+    this->primary = primary;
+    this->fallback = fallback;
     configLoaded = false;
-    sdAvailable = false;
-    spiffsAvailable = false;
+    storageReady = false;
+    primaryAvailable = false;
+    fallbackAvailable = false;
+    
+    for (uint8_t i = 0; i < CONFIG_SNAPSHOT_COUNT; i++) {
+        snapshots[i].version = 0;
+        snapshots[i].readers = 0;
+    }
+    current = &snapshots[0];
+    appliedVersion = 0;
 }
 
 bool ConfigManager::initStorage() {
-    // Try SD card first
-    Serial.println("Initializing SD card...");
-    sdAvailable = SD.begin(SD_CS);
-    if (sdAvailable) {
-        Serial.println("SD card initialized.");
-    } else {
-        Serial.println("SD card initialization failed, falling back to internal storage.");
+    storageReady = true;
+    
+    // Try primary storage (SD card) first
+    if (primary) {
+        Serial.printf("Initializing %s...\n", primary->name());
+        primaryAvailable = primary->begin();
+        if (primaryAvailable) {
+            Serial.printf("%s initialized.\n", primary->name());
+        } else {
+            Serial.printf("%s initialization failed, falling back to internal storage.\n", primary->name());
+        }
     }
     
-    // Initialize SPIFFS as backup
-    spiffsAvailable = SPIFFS.begin(true);
-    if (spiffsAvailable) {
-        Serial.println("SPIFFS initialized as backup storage.");
-    } else {
-        Serial.println("SPIFFS initialization failed!");
+    // Initialize fallback storage (SPIFFS) as backup
+    if (fallback) {
+        fallbackAvailable = fallback->begin();
+        if (fallbackAvailable) {
+            Serial.printf("%s initialized as backup storage.\n", fallback->name());
+        } else {
+            Serial.printf("%s initialization failed!\n", fallback->name());
+        }
     }
     
-    return (sdAvailable || spiffsAvailable);
+    return (primaryAvailable || fallbackAvailable);
 }
 
-bool ConfigManager::loadConfig() {
-    bool loaded = false;
-    
-    // Try SD card first if available
-    if (sdAvailable) {
-        loaded = loadFromSD();
-    }
-    
-    // If SD failed or unavailable, try SPIFFS
-    if (!loaded && spiffsAvailable) {
-        loaded = loadFromSPIFFS();
+bool ConfigManager::mountStorage() {
+    if (!storageReady) {
+        return initStorage();
     }
+    return primaryAvailable || fallbackAvailable;
+}
+
+bool ConfigManager::loadConfig() {
+    // The binary image needs no filesystem, storage is only mounted to
+    // import JSON when there is no valid image yet
+    bool loaded = images.load(&config) || importJson();
     
     if (loaded) {
         Serial.println("Configuration loaded successfully");
-        Serial.printf("MQTT: %s:%d\n", config.mqtt_server.c_str(), config.mqtt_port);
-        Serial.printf("WiFi: %s\n", config.wifi_ssid.c_str());
-        Serial.printf("Hub ID: %s\n", config.hub_id.c_str());
+        Serial.printf("MQTT: %s:%d\n", config.mqtt_server, config.mqtt_port);
+        Serial.printf("WiFi: %s\n", config.wifi_ssid);
+        Serial.printf("Hub ID: %s\n", config.hub_id);
         configLoaded = true;
+        
+        std::lock_guard<std::mutex> guard(writeLock);
+        publish(config);
+        appliedVersion = current.load()->version;
     }
     
     return loaded;
 }
 
-bool ConfigManager::loadFromSD() {
-    if (!SD.exists(CONFIG_FILE)) {
-        Serial.println("Config file not found on SD card");
+bool ConfigManager::importJson() {
+    if (!storageReady && !initStorage()) {
+        Serial.println("WARNING: All storage systems failed. No config to import.");
         return false;
     }
-
-    File configFile = SD.open(CONFIG_FILE, FILE_READ);
-    if (!configFile) {
-        Serial.println("Failed to open config file for reading from SD");
-        return false;
+    
+    bool imported = false;
+    if (primaryAvailable) {
+        imported = importFrom(primary);
     }
-
-    return parseConfigFile(configFile);
+    if (!imported && fallbackAvailable) {
+        imported = importFrom(fallback);
+    }
+    return imported;
 }
 
-bool ConfigManager::loadFromSPIFFS() {
-    if (!SPIFFS.exists(CONFIG_FILE)) {
-        Serial.println("Config file not found in SPIFFS");
+bool ConfigManager::importFrom(HalFileSystem* storage) {
+    long size = storage->fileSize(CONFIG_FILE);
+    if (size <= 0) {
+        Serial.printf("Config file not found on %s\n", storage->name());
         return false;
     }
 
-    File configFile = SPIFFS.open(CONFIG_FILE, "r");
-    if (!configFile) {
-        Serial.println("Failed to open config file for reading from SPIFFS");
+    // Transient buffer and document in PSRAM, keeps the internal heap unfragmented
+    char* buf = (char*)regionAlloc(size, MEM_PSRAM);
+    if (!buf) {
+        Serial.println("Out of memory reading config file");
         return false;
     }
+    size_t bytesRead = storage->readFile(CONFIG_FILE, reinterpret_cast<uint8_t*>(buf), size);
 
-    bool result = parseConfigFile(configFile);
-    if (result) {
-        Serial.println("Configuration loaded from SPIFFS");
-    }
-    return result;
-}
-
-bool ConfigManager::parseConfigFile(File &configFile) {
-    size_t size = configFile.size();
-    std::unique_ptr<char[]> buf(new char[size]);
-    configFile.readBytes(buf.get(), size);
-    configFile.close();
-
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, buf.get());
+    JsonDocument doc(psramJsonAllocator());
+    DeserializationError error = deserializeJson(doc, buf, bytesRead);
+    regionFree(buf);
     
     if (error) {
         Serial.println("Failed to parse config file");
         return false;
     }
 
-    config.mqtt_server = doc["mqtt_server"].as<String>();
-    config.mqtt_port = doc["mqtt_port"];
-    config.mqtt_username = doc["mqtt_username"].as<String>();
-    config.mqtt_password = doc["mqtt_password"].as<String>();
-    config.wifi_ssid = doc["wifi_ssid"].as<String>();
-    config.wifi_password = doc["wifi_password"].as<String>();
-    config.hub_id = doc["hub_id"].as<String>();
-    
+    config = HubConfig();
+    fromJson(doc.as<JsonVariantConst>(), &config);
+    Serial.printf("Configuration imported from %s\n", storage->name());
+
+    // Once it is in the image the JSON file must not be imported again over
+    // later changes; keep it renamed for reference
+    if (images.commit(config)) {
+        storage->remove(CONFIG_IMPORTED_FILE);
+        storage->rename(CONFIG_FILE, CONFIG_IMPORTED_FILE);
+    } else {
+        Serial.println("WARNING: Imported config could not be stored, it will be imported again");
+    }
     return true;
 }
 
 bool ConfigManager::saveConfig() {
-    bool savedToSD = false;
-    bool savedToSPIFFS = false;
-    
-    // Try to save to SD if available
-    if (sdAvailable) {
-        savedToSD = saveToSD();
+    return persist(config);
+}
+
+bool ConfigManager::persist(const HubConfig& next) {
+    if (!images.commit(next)) {
+        return false;
     }
     
-    // Always try to save to SPIFFS as backup
-    if (spiffsAvailable) {
-        savedToSPIFFS = saveToSPIFFS();
+    // Best-effort JSON copy for backup, rename it to CONFIG_FILE to import
+    if (!storageReady) {
+        initStorage();
     }
-    
-    // Success if saved to at least one storage
-    return (savedToSD || savedToSPIFFS);
+    if (primaryAvailable) {
+        exportTo(primary, next);
+    } else if (fallbackAvailable) {
+        exportTo(fallback, next);
+    }
+    return true;
 }
 
-bool ConfigManager::saveToSD() {
-    File configFile = SD.open(CONFIG_FILE, FILE_WRITE);
-    if (!configFile) {
-        Serial.println("Failed to open config file for writing to SD");
-        return false;
+const ConfigSnapshot* ConfigManager::acquire() {
+    // Pin the snapshot, then make sure it is still current; otherwise the
+    // writer may already be recycling it, so let go and try again
+    while (true) {
+        ConfigSnapshot* snapshot = current.load();
+        snapshot->readers++;
+        if (snapshot == current.load()) {
+            return snapshot;
+        }
+        snapshot->readers--;
     }
+}
 
-    if (serializeJsonToFile(configFile) == false) {
-        return false;
-    }
+void ConfigManager::release(const ConfigSnapshot* snapshot) {
+    snapshot->readers--;
+}
 
-    Serial.println("Configuration saved successfully to SD card");
-    return true;
+// Caller holds writeLock
+void ConfigManager::publish(const HubConfig& next) {
+    ConfigSnapshot* old = current.load();
+    ConfigSnapshot* target = nullptr;
+    while (target == nullptr) {
+        for (uint8_t i = 0; i < CONFIG_SNAPSHOT_COUNT; i++) {
+            if (&snapshots[i] != old && snapshots[i].readers.load() == 0) {
+                target = &snapshots[i];
+                break;
+            }
+        }
+        if (target == nullptr) {
+            // Every spare snapshot is pinned; readers only hold one briefly
+            delay(1);
+        }
+    }
+    target->config = next;
+    target->version = old->version + 1;
+    current.store(target);
 }
 
-bool ConfigManager::saveToSPIFFS() {
-    File configFile = SPIFFS.open(CONFIG_FILE, "w");
-    if (!configFile) {
-        Serial.println("Failed to open config file for writing to SPIFFS");
+bool ConfigManager::apply(const HubConfig& next, const char* source, uint8_t* changed) {
+    std::lock_guard<std::mutex> guard(writeLock);
+    uint8_t mask = diff(current.load()->config, next);
+    if (changed) {
+        *changed = mask;
+    }
+    if (mask == 0) {
+        Serial.printf("Config from %s unchanged\n", source);
+        return true;
+    }
+    
+    // Persist first: a change that can't survive a reboot isn't published
+    if (!persist(next)) {
         return false;
     }
+    publish(next);
+    configLoaded = true;
+    Serial.printf("Config v%lu from %s:%s%s%s\n", (unsigned long)current.load()->version, source,
+                  (mask & CONFIG_CHANGED_WIFI) ? " wifi" : "",
+                  (mask & CONFIG_CHANGED_MQTT) ? " mqtt" : "",
+                  (mask & CONFIG_CHANGED_HUB_ID) ? " hub_id" : "");
+    return true;
+}
 
-    if (serializeJsonToFile(configFile) == false) {
-        return false;
+uint8_t ConfigManager::sync() {
+    const ConfigSnapshot* snapshot = acquire();
+    uint8_t changed = 0;
+    if (snapshot->version != appliedVersion) {
+        changed = diff(config, snapshot->config);
+        config = snapshot->config;
+        appliedVersion = snapshot->version;
     }
+    release(snapshot);
+    return changed;
+}
 
-    Serial.println("Configuration saved successfully to SPIFFS");
-    return true;
+uint8_t ConfigManager::diff(const HubConfig& a, const HubConfig& b) {
+    uint8_t changed = 0;
+    if (strcmp(a.wifi_ssid, b.wifi_ssid) != 0 || strcmp(a.wifi_password, b.wifi_password) != 0) {
+        changed |= CONFIG_CHANGED_WIFI;
+    }
+    if (strcmp(a.mqtt_server, b.mqtt_server) != 0 || a.mqtt_port != b.mqtt_port ||
+        strcmp(a.mqtt_username, b.mqtt_username) != 0 ||
+        strcmp(a.mqtt_password, b.mqtt_password) != 0) {
+        changed |= CONFIG_CHANGED_MQTT;
+    }
+    if (strcmp(a.hub_id, b.hub_id) != 0) {
+        changed |= CONFIG_CHANGED_HUB_ID;
+    }
+    return changed;
 }
 
-bool ConfigManager::serializeJsonToFile(File &configFile) {
-    JsonDocument doc;
+bool ConfigManager::exportTo(HalFileSystem* storage, const HubConfig& source) {
+    JsonDocument doc(psramJsonAllocator());
+    toJson(source, doc.to<JsonObject>(), true);
 
-    doc["mqtt_server"] = config.mqtt_server;
-    doc["mqtt_port"] = config.mqtt_port;
-    doc["mqtt_username"] = config.mqtt_username;
-    doc["mqtt_password"] = config.mqtt_password;
-    doc["wifi_ssid"] = config.wifi_ssid;
-    doc["wifi_password"] = config.wifi_password;
-    doc["hub_id"] = config.hub_id;
+    size_t len = measureJson(doc);
+    char* buf = (char*)regionAlloc(len + 1, MEM_PSRAM);
+    if (!buf) {
+        Serial.println("Out of memory writing config file");
+        return false;
+    }
+    serializeJson(doc, buf, len + 1);
 
-    if (serializeJson(doc, configFile) == 0) {
-        Serial.println("Failed to write config to file");
-        configFile.close();
+    bool written = storage->writeFile(CONFIG_EXPORT_FILE, reinterpret_cast<uint8_t*>(buf), len);
+    regionFree(buf);
+    if (!written) {
+        Serial.printf("Failed to write config export to %s\n", storage->name());
         return false;
     }
 
-    configFile.close();
+    Serial.printf("Configuration exported to %s\n", storage->name());
     return true;
 }
 
+void ConfigManager::fromJson(JsonVariantConst json, HubConfig* out) {
+    if (!json["mqtt_server"].isNull()) {
+        setConfigString(out->mqtt_server, json["mqtt_server"].as<const char*>());
+    }
+    if (!json["mqtt_port"].isNull()) {
+        out->mqtt_port = json["mqtt_port"];
+    }
+    if (!json["mqtt_username"].isNull()) {
+        setConfigString(out->mqtt_username, json["mqtt_username"].as<const char*>());
+    }
+    if (!json["mqtt_password"].isNull()) {
+        setConfigString(out->mqtt_password, json["mqtt_password"].as<const char*>());
+    }
+    if (!json["wifi_ssid"].isNull()) {
+        setConfigString(out->wifi_ssid, json["wifi_ssid"].as<const char*>());
+    }
+    
+    // Only update password if provided (not empty)
+    const char* wifiPassword = json["wifi_password"] | "";
+    if (wifiPassword[0] != '\0') {
+        setConfigString(out->wifi_password, wifiPassword);
+    }
+    
+    if (!json["hub_id"].isNull()) {
+        setConfigString(out->hub_id, json["hub_id"].as<const char*>());
+    }
+}
+
+void ConfigManager::toJson(const HubConfig& config, JsonObject out, bool includeSecrets) {
+    out["mqtt_server"] = config.mqtt_server;
+    out["mqtt_port"] = config.mqtt_port;
+    out["mqtt_username"] = includeSecrets ? config.mqtt_username : "";
+    out["mqtt_password"] = includeSecrets ? config.mqtt_password : "";
+    out["wifi_ssid"] = config.wifi_ssid;
+    out["wifi_password"] = includeSecrets ? config.wifi_password : "";
+    out["hub_id"] = config.hub_id;
+}
+
 HubConfig* ConfigManager::getConfig() {
     return &config;
 }
 
 bool ConfigManager::isConfigLoaded() {
     return configLoaded;
-}
\ No newline at end of file
+}
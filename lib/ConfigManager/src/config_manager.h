@@ -1,30 +1,94 @@
 #pragma once
 
 #include <Arduino.h>
-#include <SD.h>
-#include <SPIFFS.h>
 #include <ArduinoJson.h>
 #include "config.h"
+#include "hal.h"
+#include "config_image.h"
+#include "json_allocators.h"
+#include <atomic>
+#include <mutex>
+
+// Which subsystems a config change touches
+enum ConfigChange : uint8_t {
+    CONFIG_CHANGED_WIFI = 0x01,
+    CONFIG_CHANGED_MQTT = 0x02,     // Broker address or credentials
+    CONFIG_CHANGED_HUB_ID = 0x04
+};
+
+// Immutable once published. readers counts tasks currently holding it, so
+// the writer never recycles a snapshot that is still being read.
+struct ConfigSnapshot {
+    HubConfig config;
+    uint32_t version;
+    mutable std::atomic<uint16_t> readers;
+};
 
 class ConfigManager {
 public:
-    ConfigManager();
+    // The config lives as a binary image in slots (NVS on the device). primary
+    // (SD card) and fallback (SPIFFS) only carry the JSON import and export
+    // files; either may be nullptr.
+    ConfigManager(HalFileSystem* primary, HalFileSystem* fallback, ConfigSlotStore* slots);
     bool initStorage();
+    // Mounts SD/SPIFFS on first use, for other files that live beside the config
+    bool mountStorage();
     bool loadConfig();
     bool saveConfig();
+    // The config as applied by the task that owns WiFi and MQTT (main loop).
+    // Other tasks read through a ConfigReader instead.
     HubConfig* getConfig();
     bool isConfigLoaded();
 
+    // Live reload, RCU style: apply() persists next and publishes it as a new
+    // snapshot with one pointer swap. Readers keep the snapshot they hold and
+    // see the new one on their next iteration. Safe from any task.
+    bool apply(const HubConfig& next, const char* source, uint8_t* changed = nullptr);
+    // Owner task only: copies the newest snapshot into getConfig() and
+    // returns the ConfigChange bits since the last sync
+    uint8_t sync();
+    const ConfigSnapshot* acquire();
+    void release(const ConfigSnapshot* snapshot);
+    uint32_t getVersion() { return current.load()->version; }
+    static uint8_t diff(const HubConfig& a, const HubConfig& b);
+
+    // JSON <-> HubConfig. fromJson only touches keys that are present, and
+    // ignores an empty wifi_password so forms can leave it blank.
+    static void fromJson(JsonVariantConst json, HubConfig* out);
+    // Without includeSecrets the WiFi password and MQTT credentials are empty
+    static void toJson(const HubConfig& config, JsonObject out, bool includeSecrets);
+
 private:
     HubConfig config;
     bool configLoaded;
-    bool sdAvailable;
-    bool spiffsAvailable;
+    ConfigSnapshot snapshots[CONFIG_SNAPSHOT_COUNT];
+    std::atomic<ConfigSnapshot*> current;
+    uint32_t appliedVersion;
+    std::mutex writeLock;
+    ConfigImageStore images;
+    HalFileSystem* primary;
+    HalFileSystem* fallback;
+    bool storageReady;
+    bool primaryAvailable;
+    bool fallbackAvailable;
     
-    bool loadFromSD();
-    bool loadFromSPIFFS();
-    bool parseConfigFile(File &configFile);
-    bool saveToSD();
-    bool saveToSPIFFS();
-    bool serializeJsonToFile(File &configFile);
-};
\ No newline at end of file
+    void publish(const HubConfig& next);
+    bool persist(const HubConfig& next);
+    bool importJson();
+    bool importFrom(HalFileSystem* storage);
+    bool exportTo(HalFileSystem* storage, const HubConfig& source);
+};
+
+// Holds one snapshot for the lifetime of the reader, e.g. one loop iteration
+class ConfigReader {
+public:
+    explicit ConfigReader(ConfigManager& manager) : manager(manager), snapshot(manager.acquire()) {}
+    ~ConfigReader() { manager.release(snapshot); }
+    const HubConfig* operator->() const { return &snapshot->config; }
+    const HubConfig& operator*() const { return snapshot->config; }
+    uint32_t version() const { return snapshot->version; }
+
+private:
+    ConfigManager& manager;
+    const ConfigSnapshot* snapshot;
+};
@@ -0,0 +1,290 @@
+#include "console.h"
+
+#ifdef ARDUINO
+#include <esp_timer.h>
+#endif
+
+static int64_t consoleNowUs() {
+#ifdef ARDUINO
+    return esp_timer_get_time();
+#else
+    return (int64_t)micros();
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// CommandRegistry
+// ---------------------------------------------------------------------------
+
+CommandRegistry::CommandRegistry(const CommandSpec* specs, uint8_t count) : specs(specs), count(count) {}
+
+const CommandSpec* CommandRegistry::find(const char* name, size_t length) const {
+    for (uint8_t i = 0; i < count; i++) {
+        if (strlen(specs[i].name) == length && memcmp(specs[i].name, name, length) == 0) {
+            return &specs[i];
+        }
+    }
+    return nullptr;
+}
+
+bool CommandRegistry::runLine(const char* line, size_t length, CommandSource source, Print& out) const {
+    while (length > 0 && *line == ' ') {
+        line++;
+        length--;
+    }
+    size_t nameLength = 0;
+    while (nameLength < length && line[nameLength] != ' ') {
+        nameLength++;
+    }
+    const char* args = line + nameLength;
+    size_t argsLength = length - nameLength;
+    while (argsLength > 0 && *args == ' ') {
+        args++;
+        argsLength--;
+    }
+    while (argsLength > 0 && args[argsLength - 1] == ' ') {
+        argsLength--;
+    }
+    const CommandSpec* spec = find(line, nameLength);
+    if (spec == nullptr || !(spec->sources & source)) {
+        return false;
+    }
+    spec->handler(args, argsLength, out);
+    return true;
+}
+
+bool CommandRegistry::run(const char* name, const char* args, size_t length, CommandSource source,
+                          Print& out) const {
+    const CommandSpec* spec = find(name, strlen(name));
+    if (spec == nullptr || !(spec->sources & source)) {
+        return false;
+    }
+    spec->handler(args, length, out);
+    return true;
+}
+
+void CommandRegistry::printHelp(Print& out, CommandSource source) const {
+    for (uint8_t i = 0; i < count; i++) {
+        if (specs[i].sources & source) {
+            out.printf("  %-12s %s\n", specs[i].name, specs[i].help);
+        }
+    }
+}
+
+size_t CommandRegistry::nextWord(const char*& args, size_t& length, char* word, size_t size) {
+    while (length > 0 && *args == ' ') {
+        args++;
+        length--;
+    }
+    const char* start = args;
+    size_t wordLength = 0;
+    size_t used;
+    if (length > 0 && *args == '"') {
+        // Quoted, spaces and all; an unclosed quote runs to the end
+        start++;
+        while (wordLength < length - 1 && start[wordLength] != '"') {
+            wordLength++;
+        }
+        used = 1 + wordLength + (wordLength < length - 1 ? 1 : 0);
+    } else {
+        while (wordLength < length && args[wordLength] != ' ') {
+            wordLength++;
+        }
+        used = wordLength;
+    }
+    if (size > 0) {
+        size_t copied = wordLength < size - 1 ? wordLength : size - 1;
+        memcpy(word, start, copied);
+        word[copied] = '\0';
+    }
+    args += used;
+    length -= used;
+    return wordLength;
+}
+
+// ---------------------------------------------------------------------------
+// LineEditor
+// ---------------------------------------------------------------------------
+
+LineEditor::LineEditor(Print* echo) : echo(echo) {
+    buffer[0] = '\0';
+    last[0] = '\0';
+    used = 0;
+    complete = false;
+    cut = false;
+    afterCR = false;
+    escape = ESC_NONE;
+    overflows = 0;
+}
+
+bool LineEditor::feed(uint8_t byte) {
+    if (complete) {
+        // The caller had its line, start the next one
+        used = 0;
+        buffer[0] = '\0';
+        complete = false;
+        cut = false;
+    }
+
+    if (escape == ESC_START) {
+        escape = byte == '[' ? ESC_CSI : byte == 'O' ? ESC_SS3 : ESC_NONE;
+        return false;
+    }
+    if (escape == ESC_CSI || escape == ESC_SS3) {
+        // Parameters and intermediates until the final byte
+        if (escape == ESC_SS3 || (byte >= 0x40 && byte <= 0x7E)) {
+            escape = ESC_NONE;
+            if (byte == 'A' && last[0] != '\0') {
+                replaceLine(last);
+            }
+        }
+        return false;
+    }
+
+    bool wasCR = afterCR;
+    afterCR = false;
+    switch (byte) {
+        case '\n':
+            if (wasCR) {
+                return false;   // Second half of CRLF
+            }
+            // fall through
+        case '\r':
+            afterCR = byte == '\r';
+            echoBytes("\r\n");
+            buffer[used] = '\0';
+            if (used > 0 && !cut) {
+                memcpy(last, buffer, used + 1);
+            }
+            complete = true;
+            return true;
+        case 0x08:
+        case 0x7F:
+            if (used > 0 && !cut) {
+                buffer[--used] = '\0';
+                echoBytes("\b \b");
+            }
+            return false;
+        case 0x03:              // Ctrl-C
+        case 0x15:              // Ctrl-U
+            used = 0;
+            buffer[0] = '\0';
+            cut = false;
+            echoBytes("^C\r\n");
+            return false;
+        case 0x1B:
+            escape = ESC_START;
+            return false;
+        default:
+            break;
+    }
+    if (byte < 0x20) {
+        return false;           // Tabs and other controls
+    }
+    if (used + 1 >= sizeof(buffer)) {
+        if (!cut) {
+            overflows++;
+            cut = true;
+        }
+        return false;
+    }
+    buffer[used++] = (char)byte;
+    buffer[used] = '\0';
+    if (echo != nullptr) {
+        echo->write(byte);
+    }
+    return false;
+}
+
+void LineEditor::replaceLine(const char* text) {
+    while (used > 0) {
+        used--;
+        echoBytes("\b \b");
+    }
+    used = strnlen(text, sizeof(buffer) - 1);
+    memcpy(buffer, text, used);
+    buffer[used] = '\0';
+    echoBytes(buffer);
+}
+
+void LineEditor::echoBytes(const char* text) {
+    if (echo != nullptr) {
+        echo->print(text);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Console
+// ---------------------------------------------------------------------------
+
+size_t Console::Output::write(uint8_t byte) {
+    lastByte = byte;
+    return out->write(byte);
+}
+
+size_t Console::Output::write(const uint8_t* buffer, size_t size) {
+    if (size > 0) {
+        lastByte = buffer[size - 1];
+    }
+    return out->write(buffer, size);
+}
+
+// JSON answers have no line end of their own
+void Console::Output::endLine() {
+    if (lastByte != '\n') {
+        write((const uint8_t*)"\r\n", 2);
+    }
+}
+
+Console::Console(Stream* io, const CommandRegistry* registry, bool echo)
+    : io(io), registry(registry), output(io), editor(echo ? io : nullptr) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+uint8_t Console::poll() {
+    uint8_t ran = 0;
+    // Bounded, so a paste can't keep the task from checking in
+    for (uint16_t i = 0; i < CONSOLE_LINE_MAX && io->available() > 0; i++) {
+        int byte = io->read();
+        if (byte < 0) {
+            break;
+        }
+        ran += step((uint8_t)byte);
+    }
+    return ran;
+}
+
+uint8_t Console::feed(const uint8_t* data, size_t length) {
+    uint8_t ran = 0;
+    for (size_t i = 0; i < length; i++) {
+        ran += step(data[i]);
+    }
+    return ran;
+}
+
+bool Console::step(uint8_t byte) {
+    if (!editor.feed(byte)) {
+        return false;
+    }
+    size_t length = editor.length();
+    if (editor.wasCut()) {
+        output.print("Line too long, ignored\r\n");
+        return false;
+    }
+    if (length == 0) {
+        return false;
+    }
+    stats.lines++;
+    int64_t start = consoleNowUs();
+    if (!registry->runLine(editor.line(), length, CMD_CONSOLE, output)) {
+        stats.unknown++;
+        output.printf("Unknown command: %s (try help)\r\n", editor.line());
+        return false;
+    }
+    output.endLine();
+    uint32_t took = (uint32_t)(consoleNowUs() - start);
+    if (took > stats.maxRunUs) {
+        stats.maxRunUs = took;
+    }
+    return true;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.h"
+
+// Where a command came from. A command lists the sources it accepts.
+enum CommandSource : uint8_t {
+    CMD_CONSOLE = 0x01,         // USB serial console
+    CMD_MQTT = 0x02,            // TOPIC_COMMAND + <name>, output on TOPIC_REPLY + <name>
+    CMD_ANY = CMD_CONSOLE | CMD_MQTT
+};
+
+// The rest of the line after the name, or the MQTT payload; not terminated.
+// Whatever the command prints is its answer.
+typedef void (*CommandHandler)(const char* args, size_t length, Print& out);
+
+struct CommandSpec {
+    const char* name;
+    CommandHandler handler;
+    uint8_t sources;
+    const char* help;           // Arguments and what it does, for `help`
+};
+
+// Commands shared by the serial console and the MQTT command topic, see
+// COMMANDS in main.cpp. The table is const; keeping two commands from
+// running at once (console and MQTT are different tasks) is up to the caller.
+class CommandRegistry {
+public:
+    CommandRegistry(const CommandSpec* specs, uint8_t count);
+
+    const CommandSpec* find(const char* name, size_t length) const;
+    // "name args...", false if the name is unknown or not open to source
+    bool runLine(const char* line, size_t length, CommandSource source, Print& out) const;
+    bool run(const char* name, const char* args, size_t length, CommandSource source, Print& out) const;
+    void printHelp(Print& out, CommandSource source) const;
+
+    // Pops the next space-separated word off args into word (cut to size).
+    // A word in double quotes may hold spaces and comes out without the
+    // quotes. Returns its length, 0 when args has no more words (or "").
+    static size_t nextWord(const char*& args, size_t& length, char* word, size_t size);
+
+private:
+    const CommandSpec* specs;
+    uint8_t count;
+};
+
+// Line input from a serial terminal. Keeps the line being typed, echoes it
+// back and handles backspace, Ctrl-C/Ctrl-U (drop the line), CR, LF or
+// CRLF, and the up arrow (recall the last line). Other escape sequences
+// are swallowed.
+class LineEditor {
+public:
+    explicit LineEditor(Print* echo = nullptr);
+    // True when byte completed a line, which line() then holds until the
+    // next feed()
+    bool feed(uint8_t byte);
+    const char* line() const { return buffer; }
+    size_t length() const { return used; }
+    // The line ran past CONSOLE_LINE_MAX - 1 and lost its end
+    bool wasCut() const { return cut; }
+    uint32_t getOverflows() const { return overflows; }
+
+private:
+    enum EscapeState : uint8_t {
+        ESC_NONE,
+        ESC_START,              // ESC seen
+        ESC_CSI,                // ESC [ seen, waiting for the final byte
+        ESC_SS3                 // ESC O seen, one byte to go
+    };
+
+    Print* echo;
+    char buffer[CONSOLE_LINE_MAX];
+    char last[CONSOLE_LINE_MAX];
+    size_t used;
+    bool complete;
+    bool cut;
+    bool afterCR;
+    EscapeState escape;
+    uint32_t overflows;         // Lines cut
+
+    void replaceLine(const char* text);
+    void echoBytes(const char* text);
+};
+
+struct ConsoleStats {
+    uint32_t lines;
+    uint32_t unknown;           // Lines naming no command
+    uint32_t maxRunUs;          // Longest command, for deciding what needs its own task
+};
+
+// The maintenance console: reads whatever the terminal sent without
+// waiting, edits the line and runs it through the registry. Runs in its own
+// low-priority task so a half-typed line or a slow report never holds up
+// ingest.
+class Console {
+public:
+    // echo off for terminals that echo locally, e.g. a tty in cooked mode
+    Console(Stream* io, const CommandRegistry* registry, bool echo = CONSOLE_ECHO);
+    // Never blocks. Returns how many commands ran.
+    uint8_t poll();
+    // The same for bytes from elsewhere, e.g. a test feeding a capture
+    uint8_t feed(const uint8_t* data, size_t length);
+    const ConsoleStats& getStats() const { return stats; }
+    uint32_t getOverflows() const { return editor.getOverflows(); }
+
+private:
+    // Forwards to the terminal, remembering whether the output ended a line
+    class Output : public Print {
+    public:
+        explicit Output(Print* out) : out(out), lastByte('\n') {}
+        size_t write(uint8_t byte) override;
+        size_t write(const uint8_t* buffer, size_t size) override;
+        void endLine();
+    private:
+        Print* out;
+        uint8_t lastByte;
+    };
+
+    Stream* io;
+    const CommandRegistry* registry;
+    Output output;
+    LineEditor editor;
+    ConsoleStats stats;
+
+    bool step(uint8_t byte);
+};
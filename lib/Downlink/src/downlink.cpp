@@ -0,0 +1,359 @@
+#include "downlink.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+void putU32(uint8_t* out, uint32_t value) {
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    out[2] = (value >> 16) & 0xFF;
+    out[3] = value >> 24;
+}
+
+uint32_t getU32(const uint8_t* in) {
+    return in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+// Anything the peer answered other than done or held for the node
+bool isError(DownlinkStatus status) {
+    return status != DL_STATUS_OK && status != DL_STATUS_QUEUED && status < DL_STATUS_SENT;
+}
+
+}  // namespace
+
+DownlinkQueue::DownlinkQueue(HalSerialPort* port) {
+    this->port = port;
+    memset(slots, 0, sizeof(slots));
+    memset(results, 0, sizeof(results));
+    resultHead = 0;
+    resultCount = 0;
+    nextId = 1;
+    memset(&stats, 0, sizeof(stats));
+}
+
+uint16_t DownlinkQueue::send(DownlinkCommand command, const char* nodeID, const uint8_t* args, uint8_t length) {
+    if (length > DOWNLINK_MAX_ARGS) {
+        stats.rejected++;
+        return 0;
+    }
+    char target[SENSOR_NODE_ID_SIZE] = {0};
+    strncpy(target, nodeID ? nodeID : "", sizeof(target) - 1);
+    uint32_t nowMs = millis();
+
+    guard.lock();
+    Slot* slot = nullptr;
+    for (uint8_t i = 0; i < DOWNLINK_QUEUE_SIZE; i++) {
+        Slot& candidate = slots[i];
+        if (candidate.state != SLOT_FREE && candidate.command == command &&
+            strcmp(candidate.nodeID, target) == 0) {
+            finish(candidate, DL_STATUS_SUPERSEDED, nowMs);
+        }
+        if (candidate.state == SLOT_FREE && slot == nullptr) {
+            slot = &candidate;
+        }
+    }
+    if (slot == nullptr) {
+        stats.rejected++;
+        guard.unlock();
+        return 0;
+    }
+    uint16_t id = nextId++;
+    if (nextId == 0) {
+        nextId = 1;
+    }
+    slot->state = SLOT_WAITING;
+    slot->command = command;
+    slot->attempts = 0;
+    slot->argsLength = length;
+    slot->id = id;
+    memcpy(slot->nodeID, target, sizeof(slot->nodeID));
+    if (length > 0) {
+        memcpy(slot->args, args, length);
+    }
+    slot->queuedMs = nowMs;
+    slot->sentMs = 0;
+    slot->dueMs = nowMs;
+    stats.queued++;
+    guard.unlock();
+    return id;
+}
+
+uint16_t DownlinkQueue::sendWiFiCredentials(const char* ssid, const char* password) {
+    uint8_t args[DOWNLINK_MAX_ARGS];
+    uint8_t ssidLength = strnlen(ssid, 32);
+    uint8_t passLength = strnlen(password, 64);
+    args[0] = ssidLength;
+    memcpy(args + 1, ssid, ssidLength);
+    args[1 + ssidLength] = passLength;
+    memcpy(args + 2 + ssidLength, password, passLength);
+    return send(DL_WIFI_CREDENTIALS, "", args, 2 + ssidLength + passLength);
+}
+
+uint16_t DownlinkQueue::sendTimeSync(uint32_t utcSeconds, int16_t offsetMinutes) {
+    uint8_t args[6];
+    putU32(args, utcSeconds);
+    args[4] = (uint16_t)offsetMinutes & 0xFF;
+    args[5] = (uint16_t)offsetMinutes >> 8;
+    return send(DL_TIME_SYNC, "*", args, sizeof(args));
+}
+
+uint16_t DownlinkQueue::sendSampleInterval(const char* nodeID, uint32_t seconds) {
+    uint8_t args[4];
+    putU32(args, seconds);
+    return send(DL_SAMPLE_INTERVAL, nodeID, args, sizeof(args));
+}
+
+uint32_t DownlinkQueue::poll(uint32_t nowMs) {
+    uint8_t frame[SENSOR_FRAME_HEADER + DOWNLINK_MAX_BODY + 2];
+    while (true) {
+        size_t length = 0;
+        guard.lock();
+        Slot* slot = nextDue(nowMs);
+        if (slot == nullptr) {
+            guard.unlock();
+            break;
+        }
+        if (slot->state == SLOT_SENT && slot->attempts >= DOWNLINK_ATTEMPTS) {
+            finish(*slot, DL_STATUS_TIMEOUT, nowMs);
+        } else {
+#if SERIAL_LEGACY_FRAMES
+            if (slot->command == DL_WIFI_CREDENTIALS) {
+                length = encodeLegacy(*slot, frame, sizeof(frame));
+                slot->attempts = 1;
+                finish(*slot, DL_STATUS_SENT, nowMs);
+            } else {
+                finish(*slot, DL_STATUS_UNSUPPORTED, nowMs);
+            }
+#else
+            length = encode(*slot, nowMs, frame, sizeof(frame));
+            if (slot->attempts > 0) {
+                stats.resends++;
+            }
+            slot->attempts++;
+            slot->state = SLOT_SENT;
+            slot->sentMs = nowMs;
+            slot->dueMs = nowMs + ((uint32_t)DOWNLINK_ACK_TIMEOUT_MS << (slot->attempts - 1));
+#endif
+            if (length > 0) {
+                stats.frames++;
+            }
+        }
+        guard.unlock();
+
+        // The UART driver buffers the frame, a full TX FIFO is the only wait
+        if (length > 0) {
+            port->write(frame, length);
+        }
+    }
+
+    uint32_t wait = UINT32_MAX;
+    guard.lock();
+    for (uint8_t i = 0; i < DOWNLINK_QUEUE_SIZE; i++) {
+        if (slots[i].state == SLOT_SENT) {
+            int32_t left = (int32_t)(slots[i].dueMs - nowMs);
+            uint32_t due = left > 0 ? (uint32_t)left : 0;
+            if (due < wait) wait = due;
+        }
+    }
+    guard.unlock();
+    return wait;
+}
+
+// The oldest command that can go out now: a resend that is due, or a new
+// one while fewer than DOWNLINK_IN_FLIGHT wait for their ack
+DownlinkQueue::Slot* DownlinkQueue::nextDue(uint32_t nowMs) {
+    uint8_t inFlight = 0;
+    for (uint8_t i = 0; i < DOWNLINK_QUEUE_SIZE; i++) {
+        if (slots[i].state == SLOT_SENT) inFlight++;
+    }
+    Slot* oldest = nullptr;
+    for (uint8_t i = 0; i < DOWNLINK_QUEUE_SIZE; i++) {
+        Slot& slot = slots[i];
+        bool due = (slot.state == SLOT_SENT && (int32_t)(nowMs - slot.dueMs) >= 0) ||
+                   (slot.state == SLOT_WAITING && inFlight < DOWNLINK_IN_FLIGHT);
+        if (due && (oldest == nullptr || (int32_t)(slot.queuedMs - oldest->queuedMs) < 0)) {
+            oldest = &slot;
+        }
+    }
+    return oldest;
+}
+
+size_t DownlinkQueue::encode(const Slot& slot, uint32_t nowMs, uint8_t* out, size_t outSize) const {
+    uint8_t body[DOWNLINK_MAX_BODY];
+    uint8_t idLength = strnlen(slot.nodeID, SENSOR_NODE_ID_SIZE - 1);
+    body[0] = slot.id & 0xFF;
+    body[1] = slot.id >> 8;
+    body[2] = slot.command;
+    body[3] = idLength;
+    memcpy(body + 4, slot.nodeID, idLength);
+    size_t length = 4 + idLength;
+    memcpy(body + length, slot.args, slot.argsLength);
+    if (slot.command == DL_TIME_SYNC && slot.argsLength >= 4) {
+        // Still the right time however long it sat in the queue
+        putU32(body + length, getU32(slot.args) + (nowMs - slot.queuedMs) / 1000);
+    }
+    length += slot.argsLength;
+    return encodeControlFrame(DOWNLINK_FRAME_COMMAND, body, length, out, outSize);
+}
+
+// The old firmware's wifiCredentials struct behind a '`' marker
+size_t DownlinkQueue::encodeLegacy(const Slot& slot, uint8_t* out, size_t outSize) const {
+    const size_t SSID_SIZE = 32;
+    const size_t PASS_SIZE = 64;
+    if (outSize < 1 + SSID_SIZE + PASS_SIZE || slot.argsLength < 2) {
+        return 0;
+    }
+    memset(out, 0, 1 + SSID_SIZE + PASS_SIZE);
+    out[0] = '`';
+    uint8_t ssidLength = slot.args[0];
+    uint8_t passLength = slot.args[1 + ssidLength];
+    memcpy(out + 1, slot.args + 1, ssidLength < SSID_SIZE ? ssidLength : SSID_SIZE - 1);
+    memcpy(out + 1 + SSID_SIZE, slot.args + 2 + ssidLength, passLength < PASS_SIZE ? passLength : PASS_SIZE - 1);
+    return 1 + SSID_SIZE + PASS_SIZE;
+}
+
+void DownlinkQueue::onAck(const uint8_t* body, size_t length, uint32_t nowMs) {
+    if (length < 3) {
+        stats.strayAcks++;
+        return;
+    }
+    uint16_t id = body[0] | (uint16_t)body[1] << 8;
+    DownlinkStatus status = (DownlinkStatus)body[2];
+
+    guard.lock();
+    Slot* slot = nullptr;
+    for (uint8_t i = 0; i < DOWNLINK_QUEUE_SIZE; i++) {
+        if (slots[i].state == SLOT_SENT && slots[i].id == id) {
+            slot = &slots[i];
+            break;
+        }
+    }
+    if (slot == nullptr) {
+        stats.strayAcks++;
+        guard.unlock();
+        return;
+    }
+    stats.acked++;
+    uint32_t rtt = nowMs - slot->sentMs;
+    stats.rttTotalMs += rtt;
+    if (rtt > stats.rttMaxMs) {
+        stats.rttMaxMs = rtt;
+    }
+    if (status == DL_STATUS_BUSY) {
+        // The peer is alive but full, try again later like a lost frame
+        slot->dueMs = nowMs + ((uint32_t)DOWNLINK_ACK_TIMEOUT_MS << (slot->attempts - 1));
+    } else {
+        finish(*slot, status, nowMs);
+    }
+    guard.unlock();
+}
+
+void DownlinkQueue::controlHandler(uint8_t type, const uint8_t* body, size_t length, void* context) {
+    if (type == DOWNLINK_FRAME_ACK) {
+        static_cast<DownlinkQueue*>(context)->onAck(body, length, millis());
+    }
+}
+
+void DownlinkQueue::finish(Slot& slot, DownlinkStatus status, uint32_t nowMs) {
+    if (status == DL_STATUS_TIMEOUT) {
+        stats.timeouts++;
+    } else if (status == DL_STATUS_SUPERSEDED) {
+        stats.superseded++;
+    } else if (isError(status)) {
+        stats.errors++;
+    }
+
+    if (resultCount == DOWNLINK_RESULTS) {
+        resultHead = (resultHead + 1) % DOWNLINK_RESULTS;
+        resultCount--;
+        stats.resultsDropped++;
+    }
+    DownlinkResult& result = results[(resultHead + resultCount) % DOWNLINK_RESULTS];
+    resultCount++;
+    result.id = slot.id;
+    result.command = slot.command;
+    memcpy(result.nodeID, slot.nodeID, sizeof(result.nodeID));
+    result.status = status;
+    result.attempts = slot.attempts;
+    result.elapsedMs = nowMs - slot.queuedMs;
+    slot.state = SLOT_FREE;
+}
+
+bool DownlinkQueue::takeResult(DownlinkResult& result) {
+    guard.lock();
+    bool taken = resultCount > 0;
+    if (taken) {
+        result = results[resultHead];
+        resultHead = (resultHead + 1) % DOWNLINK_RESULTS;
+        resultCount--;
+    }
+    guard.unlock();
+    return taken;
+}
+
+uint8_t DownlinkQueue::pending() {
+    uint8_t count = 0;
+    guard.lock();
+    for (uint8_t i = 0; i < DOWNLINK_QUEUE_SIZE; i++) {
+        if (slots[i].state != SLOT_FREE) count++;
+    }
+    guard.unlock();
+    return count;
+}
+
+size_t DownlinkQueue::format(char* out, size_t len) {
+    size_t pos = 0;
+    auto append = [&](int n) {
+        if (n > 0) pos = pos + n < len ? pos + n : len - 1;
+    };
+    append(snprintf(out, len,
+        "Downlink: %lu queued, %lu frames (%lu resends), %lu acked (%lu errors), %lu timed out\n"
+        "  %lu superseded, %lu rejected, %lu stray acks, rtt mean %lu ms max %lu ms\n",
+        (unsigned long)stats.queued, (unsigned long)stats.frames, (unsigned long)stats.resends,
+        (unsigned long)stats.acked, (unsigned long)stats.errors, (unsigned long)stats.timeouts,
+        (unsigned long)stats.superseded, (unsigned long)stats.rejected, (unsigned long)stats.strayAcks,
+        (unsigned long)(stats.acked ? stats.rttTotalMs / stats.acked : 0), (unsigned long)stats.rttMaxMs));
+
+    for (uint8_t i = 0; i < DOWNLINK_QUEUE_SIZE && pos + 1 < len; i++) {
+        // Copy out so the guard isn't held across snprintf
+        guard.lock();
+        SlotState state = slots[i].state;
+        DownlinkCommand command = slots[i].command;
+        uint16_t id = slots[i].id;
+        uint8_t attempts = slots[i].attempts;
+        char nodeID[SENSOR_NODE_ID_SIZE];
+        memcpy(nodeID, slots[i].nodeID, sizeof(nodeID));
+        guard.unlock();
+        if (state == SLOT_FREE) continue;
+        append(snprintf(out + pos, len - pos, "  #%-5u %-8s %-8s %s, %u sends\n", (unsigned)id,
+                        commandName(command), nodeID[0] ? nodeID : "(hub)",
+                        state == SLOT_SENT ? "waiting for ack" : "queued", (unsigned)attempts));
+    }
+    return pos;
+}
+
+const char* DownlinkQueue::commandName(DownlinkCommand command) {
+    switch (command) {
+        case DL_WIFI_CREDENTIALS: return "wifi";
+        case DL_TIME_SYNC: return "time";
+        case DL_SAMPLE_INTERVAL: return "interval";
+        default: return "unknown";
+    }
+}
+
+const char* DownlinkQueue::statusName(DownlinkStatus status) {
+    switch (status) {
+        case DL_STATUS_OK: return "ok";
+        case DL_STATUS_QUEUED: return "queued";
+        case DL_STATUS_UNKNOWN: return "unknown_command";
+        case DL_STATUS_BAD_ARGS: return "bad_args";
+        case DL_STATUS_NO_NODE: return "no_node";
+        case DL_STATUS_BUSY: return "busy";
+        case DL_STATUS_SENT: return "sent";
+        case DL_STATUS_UNSUPPORTED: return "unsupported";
+        case DL_STATUS_SUPERSEDED: return "superseded";
+        case DL_STATUS_TIMEOUT: return "timeout";
+        default: return "error";
+    }
+}
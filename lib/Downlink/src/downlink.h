@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+#include "hal.h"
+#include "memory_pools.h"
+#include "sensor_frame.h"
+
+// Control frame types, in the schema id byte of a SENSOR_FRAME_CONTROL frame
+#define DOWNLINK_FRAME_COMMAND 0x80     // Hub -> ESP-NOW hub
+#define DOWNLINK_FRAME_ACK 0x81         // ESP-NOW hub -> hub
+#define DOWNLINK_MAX_ARGS 100           // Credentials are the longest
+#define DOWNLINK_MAX_BODY (4 + SENSOR_NODE_ID_SIZE + DOWNLINK_MAX_ARGS)
+
+// What a command asks for. Like quantities, a command keeps its number.
+enum DownlinkCommand : uint8_t {
+    DL_WIFI_CREDENTIALS = 1,    // ssid length | ssid | password length | password
+    DL_TIME_SYNC = 2,           // uint32 UTC seconds | int16 offset from UTC in minutes
+    DL_SAMPLE_INTERVAL = 3,     // uint32 seconds between readings
+    DL_COMMAND_LIMIT
+};
+
+enum DownlinkStatus : uint8_t {
+    DL_STATUS_OK = 0,           // Done; for a node, the node has it
+    DL_STATUS_QUEUED = 1,       // The ESP-NOW hub holds it until the node next reports
+    DL_STATUS_UNKNOWN = 2,      // The peer doesn't know the command
+    DL_STATUS_BAD_ARGS = 3,
+    DL_STATUS_NO_NODE = 4,      // The ESP-NOW hub never heard from the node
+    DL_STATUS_BUSY = 5,         // The peer's own queue is full, sent again later
+    // Decided on this side, never on the wire
+    DL_STATUS_SENT = 0xFC,      // Legacy hub, written without an ack
+    DL_STATUS_UNSUPPORTED = 0xFD,   // Legacy hub, only credentials go out
+    DL_STATUS_SUPERSEDED = 0xFE,    // A newer command of the same kind and target replaced it
+    DL_STATUS_TIMEOUT = 0xFF    // No ack after DOWNLINK_ATTEMPTS sends
+};
+
+// A command that finished one way or another
+struct DownlinkResult {
+    uint16_t id;
+    DownlinkCommand command;
+    char nodeID[SENSOR_NODE_ID_SIZE];   // "" for the ESP-NOW hub, "*" for every node
+    DownlinkStatus status;
+    uint8_t attempts;
+    uint32_t elapsedMs;         // From send() to the outcome
+};
+
+struct DownlinkStats {
+    uint32_t queued;
+    uint32_t rejected;          // Queue full or arguments too long
+    uint32_t superseded;
+    uint32_t frames;            // Written, resends included
+    uint32_t resends;
+    uint32_t acked;             // Any status from the peer, errors included
+    uint32_t errors;            // Peer answered with an error status
+    uint32_t timeouts;
+    uint32_t strayAcks;         // For nothing in flight: late, duplicate or garbled
+    uint32_t resultsDropped;    // Overwritten before the loop task took them
+    uint32_t rttTotalMs;        // Last send to ack, over acked
+    uint32_t rttMaxMs;
+};
+
+// Commands to the ESP-NOW hub and, through it, to the nodes. They share the
+// UART with ingest, so nothing here waits: send() only queues, serialTask
+// calls poll() between frames to write what is due, and the acks come back
+// through the frame decoder like any other frame.
+//
+// Each command carries an id. The peer acks it with a status and is expected
+// to ack a repeated id again without running it twice. Without an ack the
+// command is sent again after DOWNLINK_ACK_TIMEOUT_MS, doubling each time,
+// up to DOWNLINK_ATTEMPTS sends. The outcome ends up in a small ring that
+// the loop task drains with takeResult().
+//
+// With SERIAL_LEGACY_FRAMES the hub runs the old firmware, which takes the
+// credentials struct behind a '`' and nothing else. Credentials then go out
+// that way unacknowledged, and every other command is refused.
+class DownlinkQueue {
+public:
+    explicit DownlinkQueue(HalSerialPort* port);
+
+    // Any task. Returns the command's id, 0 if the queue is full or args
+    // don't fit. A command of the same kind for the same target that hasn't
+    // been acked yet is replaced, so the latest setting wins.
+    uint16_t send(DownlinkCommand command, const char* nodeID, const uint8_t* args, uint8_t length);
+    uint16_t sendWiFiCredentials(const char* ssid, const char* password);
+    // Every node. The time is moved on by how long the command waited, each
+    // time it is sent.
+    uint16_t sendTimeSync(uint32_t utcSeconds, int16_t offsetMinutes);
+    uint16_t sendSampleInterval(const char* nodeID, uint32_t seconds);
+
+    // serialTask only: writes what is due and gives up on what ran out of
+    // attempts. Returns ms until something is due again.
+    uint32_t poll(uint32_t nowMs);
+    void onAck(const uint8_t* body, size_t length, uint32_t nowMs);
+    // For SerialManager::setControlHandler, with the queue as context
+    static void controlHandler(uint8_t type, const uint8_t* body, size_t length, void* context);
+
+    // Finished commands, oldest first. Any task.
+    bool takeResult(DownlinkResult& result);
+    uint8_t pending();
+    const DownlinkStats& getStats() const { return stats; }
+    size_t format(char* out, size_t len);
+
+    static const char* commandName(DownlinkCommand command);
+    static const char* statusName(DownlinkStatus status);
+
+private:
+    enum SlotState : uint8_t {
+        SLOT_FREE,
+        SLOT_WAITING,           // Not sent yet
+        SLOT_SENT               // Waiting for its ack
+    };
+
+    struct Slot {
+        SlotState state;
+        DownlinkCommand command;
+        uint8_t attempts;
+        uint8_t argsLength;
+        uint16_t id;
+        char nodeID[SENSOR_NODE_ID_SIZE];
+        uint8_t args[DOWNLINK_MAX_ARGS];
+        uint32_t queuedMs;
+        uint32_t sentMs;
+        uint32_t dueMs;         // Resend if no ack by then
+    };
+
+    HalSerialPort* port;
+    Slot slots[DOWNLINK_QUEUE_SIZE];
+    DownlinkResult results[DOWNLINK_RESULTS];
+    uint8_t resultHead;
+    uint8_t resultCount;
+    uint16_t nextId;
+    PoolLock guard;
+    DownlinkStats stats;
+
+    // Under guard
+    Slot* nextDue(uint32_t nowMs);
+    void finish(Slot& slot, DownlinkStatus status, uint32_t nowMs);
+    size_t encode(const Slot& slot, uint32_t nowMs, uint8_t* out, size_t outSize) const;
+    size_t encodeLegacy(const Slot& slot, uint8_t* out, size_t outSize) const;
+};
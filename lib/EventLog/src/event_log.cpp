@@ -0,0 +1,355 @@
+#include "event_log.h"
+
+#ifdef ARDUINO
+#include <esp_attr.h>
+#include <esp_ota_ops.h>
+#endif
+
+#define LOG_HISTORY_MAGIC 0x4C4F4731  // "LOG1"
+
+static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0, "LOG_RING_SIZE must be a power of two");
+
+// Left alone by the bootloader on a software reset; begin() tells a
+// history apart from whatever a power-on left there
+#ifdef ARDUINO
+RTC_NOINIT_ATTR static LogHistory rtcHistory;
+#else
+static LogHistory rtcHistory;
+#endif
+
+EventLog eventLog(&rtcHistory);
+
+static const char* const LEVEL_NAMES[] = {"off", "error", "warn", "info", "debug"};
+static const char* const MODULE_NAMES[LOG_MODULE_COUNT] = {"hub", "ingest", "mqtt", "rtc", "downlink"};
+
+// Format strings are addresses, only meaningful in the image that wrote them
+static void imageId(char* out, size_t len) {
+#ifdef ARDUINO
+    esp_ota_get_app_elf_sha256(out, len);
+#else
+    snprintf(out, len, "native");
+#endif
+}
+
+EventLog::EventLog(LogHistory* history) : store(history) {
+    for (uint16_t i = 0; i < LOG_RING_SIZE; i++) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    enqueuePos.store(0, std::memory_order_relaxed);
+    dequeuePos = 0;
+    for (uint8_t i = 0; i < LOG_MODULE_COUNT; i++) {
+        levels[i].store(LOG_LEVEL_DEFAULT, std::memory_order_relaxed);
+    }
+    droppedCount.store(0, std::memory_order_relaxed);
+    droppedReported = 0;
+    this->history = nullptr;
+    carried = 0;
+}
+
+void EventLog::begin() {
+    if (store == nullptr || history != nullptr) {
+        return;
+    }
+    char image[sizeof(store->image)] = {0};
+    imageId(image, sizeof(image));
+    if (store->magic != LOG_HISTORY_MAGIC || memcmp(store->image, image, sizeof(image)) != 0 ||
+        store->head >= LOG_HISTORY_SIZE || store->count > LOG_HISTORY_SIZE) {
+        // Power-on, or another firmware's history
+        memset(store, 0, sizeof(*store));
+        store->magic = LOG_HISTORY_MAGIC;
+        memcpy(store->image, image, sizeof(image));
+    } else {
+        store->boot++;
+        carried = store->count;
+    }
+    guard.lock();
+    history = store;
+    guard.unlock();
+}
+
+// Claims the slot at enqueuePos. A slot is free for position pos when its
+// sequence equals pos; one lap behind means the ring is full.
+LogEntry* EventLog::claim(uint32_t& pos) {
+    pos = enqueuePos.load(std::memory_order_relaxed);
+    while (true) {
+        Cell& cell = cells[pos & (LOG_RING_SIZE - 1)];
+        uint32_t sequence = cell.sequence.load(std::memory_order_acquire);
+        int32_t diff = (int32_t)(sequence - pos);
+        if (diff == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                return &cell.entry;
+            }
+        } else if (diff < 0) {
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void EventLog::publish(uint32_t pos) {
+    cells[pos & (LOG_RING_SIZE - 1)].sequence.store(pos + 1, std::memory_order_release);
+}
+
+uint16_t EventLog::drain(Print& out, uint16_t maxEntries) {
+    uint32_t dropped = droppedCount.load(std::memory_order_relaxed);
+    if (dropped != droppedReported) {
+        out.printf("[log] %lu entries dropped, ring full\n", (unsigned long)(dropped - droppedReported));
+        droppedReported = dropped;
+    }
+
+    char line[LOG_LINE_SIZE];
+    LogEntry entry;
+    uint16_t drained = 0;
+    while (drained < maxEntries && take(entry)) {
+        remember(entry);
+        out.write(line, formatLine(entry, line, sizeof(line)));
+        drained++;
+    }
+    return drained;
+}
+
+uint16_t EventLog::discard(uint16_t maxEntries) {
+    LogEntry entry;
+    uint16_t dropped = 0;
+    while (dropped < maxEntries && take(entry)) {
+        dropped++;
+    }
+    return dropped;
+}
+
+bool EventLog::take(LogEntry& entry) {
+    Cell& cell = cells[dequeuePos & (LOG_RING_SIZE - 1)];
+    // A writer that claimed this slot and was preempted holds up the
+    // entries behind it until it publishes
+    if ((int32_t)(cell.sequence.load(std::memory_order_acquire) - (dequeuePos + 1)) < 0) {
+        return false;
+    }
+    entry = cell.entry;
+    cell.sequence.store(dequeuePos + LOG_RING_SIZE, std::memory_order_release);
+    dequeuePos++;
+    return true;
+}
+
+void EventLog::remember(const LogEntry& entry) {
+    guard.lock();
+    if (history != nullptr) {
+        LogRecord& record = history->records[history->head];
+        record.entry = entry;
+        record.boot = history->boot;
+        history->head = (history->head + 1) % LOG_HISTORY_SIZE;
+        if (history->count < LOG_HISTORY_SIZE) {
+            history->count++;
+        } else if (carried > 0) {
+            carried--;
+        }
+    }
+    guard.unlock();
+}
+
+uint16_t EventLog::historySize() {
+    guard.lock();
+    uint16_t count = history ? history->count : 0;
+    guard.unlock();
+    return count;
+}
+
+bool EventLog::historyRecord(uint16_t index, LogRecord& record) {
+    bool found = false;
+    guard.lock();
+    if (history != nullptr && index < history->count) {
+        uint16_t slot = (history->head + LOG_HISTORY_SIZE - history->count + index) % LOG_HISTORY_SIZE;
+        record = history->records[slot];
+        found = true;
+    }
+    guard.unlock();
+    return found;
+}
+
+LogStats EventLog::getStats() const {
+    LogStats stats;
+    stats.dropped = droppedCount.load(std::memory_order_relaxed);
+    stats.written = enqueuePos.load(std::memory_order_relaxed);
+    stats.drained = dequeuePos;
+    stats.carried = carried;
+    return stats;
+}
+
+size_t EventLog::formatHistory(char* out, size_t len) {
+    size_t pos = 0;
+    auto append = [&](int n) {
+        if (n > 0) pos = pos + n < len ? pos + n : len - 1;
+    };
+    LogStats stats = getStats();
+    uint16_t count = historySize();
+    append(snprintf(out, len, "Log: %lu written, %lu dropped, boot %lu, last %u entries (%u from before the reset)\n",
+                    (unsigned long)stats.written, (unsigned long)stats.dropped, (unsigned long)getBoot(),
+                    (unsigned)count, (unsigned)stats.carried));
+    append(snprintf(out + pos, len - pos, "  levels:"));
+    for (uint8_t i = 0; i < LOG_MODULE_COUNT; i++) {
+        append(snprintf(out + pos, len - pos, " %s=%s", moduleName((LogModule)i), levelName(getLevel((LogModule)i))));
+    }
+    append(snprintf(out + pos, len - pos, "\n"));
+
+    uint32_t lastBoot = UINT32_MAX;
+    LogRecord record;
+    for (uint16_t i = 0; i < count && pos + 1 < len && historyRecord(i, record); i++) {
+        if (record.boot != lastBoot) {
+            append(snprintf(out + pos, len - pos, "-- boot %lu%s\n", (unsigned long)record.boot,
+                            record.boot == getBoot() ? "" : ", before the reset"));
+            lastBoot = record.boot;
+        }
+        append((int)formatLine(record.entry, out + pos, len - pos));
+    }
+    return pos;
+}
+
+size_t EventLog::formatLine(const LogEntry& entry, char* out, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    int head = snprintf(out, len, "%6lu.%03lu %c %s: ", (unsigned long)(entry.timeMs / 1000),
+                        (unsigned long)(entry.timeMs % 1000),
+                        "-EWID"[entry.level <= LOG_LEVEL_DEBUG ? entry.level : 0],
+                        moduleName((LogModule)entry.module));
+    size_t pos = head > 0 ? ((size_t)head < len ? head : len - 1) : 0;
+    pos += formatMessage(entry, out + pos, len - pos);
+    if (pos + 1 < len) {
+        out[pos++] = '\n';
+        out[pos] = '\0';
+    }
+    return pos;
+}
+
+size_t EventLog::formatJson(const LogRecord& record, char* out, size_t len) {
+    char message[LOG_LINE_SIZE];
+    formatMessage(record.entry, message, sizeof(message));
+    int written = snprintf(out, len, "{\"boot\":%lu,\"ms\":%lu,\"level\":\"%s\",\"module\":\"%s\",\"msg\":\"",
+                           (unsigned long)record.boot, (unsigned long)record.entry.timeMs,
+                           levelName((LogLevel)record.entry.level), moduleName((LogModule)record.entry.module));
+    if (written < 0 || (size_t)written + 3 > len) {
+        if (len > 0) out[0] = '\0';
+        return 0;
+    }
+    size_t pos = written;
+    for (const char* c = message; *c && pos + 5 < len; c++) {
+        if (*c == '"' || *c == '\\') {
+            out[pos++] = '\\';
+            out[pos++] = *c;
+        } else if ((uint8_t)*c >= 0x20) {
+            out[pos++] = *c;
+        }
+    }
+    out[pos++] = '"';
+    out[pos++] = '}';
+    out[pos] = '\0';
+    return pos;
+}
+
+// printf over the packed arguments. Flags, width and precision are kept,
+// length modifiers dropped: every argument was packed as 32 bits.
+size_t EventLog::formatMessage(const LogEntry& entry, char* out, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    const char* format = entry.format ? entry.format : "";
+    size_t pos = 0;
+    uint8_t index = 0;
+    while (*format && pos + 1 < len) {
+        if (*format != '%') {
+            out[pos++] = *format++;
+            continue;
+        }
+        if (format[1] == '%') {
+            out[pos++] = '%';
+            format += 2;
+            continue;
+        }
+
+        char spec[16];
+        size_t k = 0;
+        spec[k++] = *format++;
+        while (*format && strchr("-+ #0123456789.", *format) && k < sizeof(spec) - 2) {
+            spec[k++] = *format++;
+        }
+        while (*format && strchr("hlzjtL", *format)) {
+            format++;
+        }
+        char conversion = *format;
+        if (conversion == '\0') {
+            break;
+        }
+        format++;
+
+        LogArgType type = LOG_ARG_NONE;
+        uint32_t raw = 0;
+        if (index < LOG_MAX_ARGS) {
+            type = (LogArgType)((entry.types >> (index * 4)) & 0xF);
+            raw = entry.args[index];
+        }
+        index++;
+        float asFloat;
+        memcpy(&asFloat, &raw, sizeof(asFloat));
+
+        int written;
+        if (type == LOG_ARG_NONE) {
+            written = snprintf(out + pos, len - pos, "?");
+        } else if (conversion == 's') {
+            spec[k++] = 's';
+            spec[k] = '\0';
+            bool text = type == LOG_ARG_TEXT && raw < LOG_TEXT_SIZE;
+            written = snprintf(out + pos, len - pos, spec, text ? entry.text + raw : "?");
+        } else if (strchr("fFeEgG", conversion)) {
+            double value = type == LOG_ARG_FLOAT ? asFloat : type == LOG_ARG_INT ? (double)(int32_t)raw : (double)raw;
+            spec[k++] = conversion;
+            spec[k] = '\0';
+            written = snprintf(out + pos, len - pos, spec, value);
+        } else if (conversion == 'd' || conversion == 'i') {
+            int value = type == LOG_ARG_FLOAT ? (int)asFloat : (int)(int32_t)raw;
+            spec[k++] = 'd';
+            spec[k] = '\0';
+            written = snprintf(out + pos, len - pos, spec, value);
+        } else if (strchr("uxXoc", conversion)) {
+            unsigned value = type == LOG_ARG_FLOAT ? (unsigned)asFloat : (unsigned)raw;
+            spec[k++] = conversion;
+            spec[k] = '\0';
+            written = snprintf(out + pos, len - pos, spec, value);
+        } else {
+            written = snprintf(out + pos, len - pos, "?");
+        }
+        if (written > 0) {
+            pos = pos + written < len ? pos + written : len - 1;
+        }
+    }
+    out[pos] = '\0';
+    return pos;
+}
+
+const char* EventLog::levelName(LogLevel level) {
+    return level <= LOG_LEVEL_DEBUG ? LEVEL_NAMES[level] : "?";
+}
+
+const char* EventLog::moduleName(LogModule module) {
+    return module < LOG_MODULE_COUNT ? MODULE_NAMES[module] : "?";
+}
+
+bool EventLog::parseLevel(const char* name, LogLevel& level) {
+    for (uint8_t i = 0; i <= LOG_LEVEL_DEBUG; i++) {
+        if (strcmp(name, LEVEL_NAMES[i]) == 0) {
+            level = (LogLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool EventLog::parseModule(const char* name, LogModule& module) {
+    for (uint8_t i = 0; i < LOG_MODULE_COUNT; i++) {
+        if (strcmp(name, MODULE_NAMES[i]) == 0) {
+            module = (LogModule)i;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include <type_traits>
+#include "config.h"
+#include "memory_pools.h"
+
+enum LogLevel : uint8_t {
+    LOG_LEVEL_OFF = 0,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_DEBUG
+};
+
+// Who logged. Each module has its own level, set at runtime.
+enum LogModule : uint8_t {
+    LOG_HUB = 0,
+    LOG_INGEST,
+    LOG_MQTT,
+    LOG_RTC,
+    LOG_DOWNLINK,
+    LOG_MODULE_COUNT
+};
+
+// How each argument was packed, 4 bits per argument in LogEntry::types
+enum LogArgType : uint8_t {
+    LOG_ARG_NONE = 0,
+    LOG_ARG_INT,
+    LOG_ARG_UINT,
+    LOG_ARG_FLOAT,
+    LOG_ARG_TEXT            // Copied into LogEntry::text, the argument is its offset
+};
+
+// One log call, nothing formatted yet. The format string has to be a
+// literal: its address is all that is stored, and it is only turned into
+// text when the entry is drained.
+struct LogEntry {
+    uint32_t timeMs;
+    const char* format;
+    uint32_t types;
+    uint32_t args[LOG_MAX_ARGS];    // Integers truncated to 32 bits, floats as their bits
+    uint8_t level;
+    uint8_t module;
+    char text[LOG_TEXT_SIZE];       // The %s arguments back to back, truncated to fit
+};
+
+// A drained entry as kept in the history, with the boot it came from
+struct LogRecord {
+    LogEntry entry;
+    uint32_t boot;
+};
+
+// The history, placed in RTC memory on the device. Nothing initializes it
+// there, begin() decides whether what it finds is a history.
+struct LogHistory {
+    uint32_t magic;
+    char image[17];             // Start of the firmware's ELF SHA-256 in hex
+    uint32_t boot;              // Counts resets the history survived
+    uint16_t head;              // Next record to write
+    uint16_t count;
+    LogRecord records[LOG_HISTORY_SIZE];
+};
+
+struct LogStats {
+    uint32_t written;
+    uint32_t dropped;           // Ring full, logTask behind
+    uint32_t drained;
+    uint16_t carried;           // History records from before this boot
+};
+
+// Deferred logging. A log call checks the module's level, copies its
+// arguments into a slot of a fixed ring and returns; nothing is formatted
+// and nothing waits on the UART. logTask drains the ring at low priority,
+// formats each entry and prints it.
+//
+// The ring is a bounded multi-producer queue with a sequence number per
+// slot (Vyukov), so any task on either core can log without a lock. When
+// it is full the entry is dropped and counted, a log call never blocks.
+//
+// Drained entries also go into a short history that lives in RTC memory
+// on the device. It survives a panic, watchdog or software reset and is
+// shown after the reboot, as long as the firmware is the same (format
+// strings are addresses into the image).
+class EventLog {
+public:
+    explicit EventLog(LogHistory* history = nullptr);
+
+    // Validates the history left over from before the reset, once at boot
+    void begin();
+
+    bool enabled(LogModule module, LogLevel level) const {
+        return level <= levels[module].load(std::memory_order_relaxed);
+    }
+    void setLevel(LogModule module, LogLevel level) { levels[module].store(level, std::memory_order_relaxed); }
+    LogLevel getLevel(LogModule module) const { return (LogLevel)levels[module].load(std::memory_order_relaxed); }
+
+    // Through the LOG_* macros, which check the level first
+    template <typename... Args>
+    bool write(LogLevel level, LogModule module, const char* format, Args... args) {
+        static_assert(sizeof...(Args) <= LOG_MAX_ARGS && LOG_MAX_ARGS <= 8, "too many log arguments, see LOG_MAX_ARGS");
+        uint32_t pos;
+        LogEntry* entry = claim(pos);
+        if (entry == nullptr) {
+            return false;
+        }
+        entry->timeMs = millis();
+        entry->format = format;
+        entry->level = level;
+        entry->module = module;
+        entry->types = 0;
+        uint8_t index = 0;
+        uint8_t textUsed = 0;
+        (pack(*entry, index, textUsed, args), ...);
+        publish(pos);
+        return true;
+    }
+
+    // logTask only: formats and prints up to maxEntries, returns how many
+    uint16_t drain(Print& out, uint16_t maxEntries = LOG_RING_SIZE);
+    // logTask only: drops what is pending unprinted and unremembered. The
+    // benchmark uses it to time a log call without the drain.
+    uint16_t discard(uint16_t maxEntries = LOG_RING_SIZE);
+
+    // History, oldest first. Any task.
+    uint16_t historySize();
+    bool historyRecord(uint16_t index, LogRecord& record);
+    size_t formatHistory(char* out, size_t len);
+    uint32_t getBoot() const { return history ? history->boot : 0; }
+    LogStats getStats() const;
+
+    // "  12.345 W mqtt: Failed to obtain time"
+    static size_t formatLine(const LogEntry& entry, char* out, size_t len);
+    // {"boot":3,"ms":12345,"level":"warn","module":"mqtt","msg":"..."}
+    static size_t formatJson(const LogRecord& record, char* out, size_t len);
+    // Message only, arguments filled in
+    static size_t formatMessage(const LogEntry& entry, char* out, size_t len);
+
+    static const char* levelName(LogLevel level);
+    static const char* moduleName(LogModule module);
+    // Name to value, false if unknown
+    static bool parseLevel(const char* name, LogLevel& level);
+    static bool parseModule(const char* name, LogModule& module);
+
+private:
+    struct Cell {
+        std::atomic<uint32_t> sequence;
+        LogEntry entry;
+    };
+
+    Cell cells[LOG_RING_SIZE];
+    std::atomic<uint32_t> enqueuePos;
+    uint32_t dequeuePos;            // logTask only
+    std::atomic<uint8_t> levels[LOG_MODULE_COUNT];
+    std::atomic<uint32_t> droppedCount;
+    uint32_t droppedReported;
+
+    LogHistory* store;              // nullptr for none
+    LogHistory* history;            // store, once begin() has checked it
+    PoolLock guard;                 // Over the history
+    uint16_t carried;               // Records from before this boot
+
+    LogEntry* claim(uint32_t& pos);
+    void publish(uint32_t pos);
+    bool take(LogEntry& entry);
+    void remember(const LogEntry& entry);
+
+    template <typename T>
+    static constexpr bool isText() {
+        return std::is_convertible<T, const char*>::value;
+    }
+
+    template <typename T>
+    static void pack(LogEntry& entry, uint8_t& index, uint8_t& textUsed, T value) {
+        LogArgType type;
+        if constexpr (isText<T>()) {
+            const char* text = value ? (const char*)value : "(null)";
+            if (textUsed < LOG_TEXT_SIZE) {
+                size_t length = strnlen(text, LOG_TEXT_SIZE - 1 - textUsed);
+                memcpy(entry.text + textUsed, text, length);
+                entry.text[textUsed + length] = '\0';
+                entry.args[index] = textUsed;
+                textUsed += length + 1;
+            } else {
+                entry.args[index] = LOG_TEXT_SIZE - 1;  // The last terminator, an empty string
+            }
+            type = LOG_ARG_TEXT;
+        } else if constexpr (std::is_floating_point<T>::value) {
+            float narrow = (float)value;
+            memcpy(&entry.args[index], &narrow, sizeof(narrow));
+            type = LOG_ARG_FLOAT;
+        } else {
+            static_assert(std::is_integral<T>::value || std::is_enum<T>::value,
+                          "log arguments are integers, floats or strings");
+            entry.args[index] = (uint32_t)value;
+            type = std::is_signed<T>::value ? LOG_ARG_INT : LOG_ARG_UINT;
+        }
+        entry.types |= (uint32_t)type << (index * 4);
+        index++;
+    }
+};
+
+extern EventLog eventLog;
+
+#define LOG_AT(level, module, format, ...)                                  \
+    do {                                                                    \
+        if (eventLog.enabled(module, level)) {                              \
+            eventLog.write(level, module, format, ##__VA_ARGS__);           \
+        }                                                                   \
+    } while (0)
+
+#define LOG_ERROR(module, format, ...) LOG_AT(LOG_LEVEL_ERROR, module, format, ##__VA_ARGS__)
+#define LOG_WARN(module, format, ...) LOG_AT(LOG_LEVEL_WARN, module, format, ##__VA_ARGS__)
+#define LOG_INFO(module, format, ...) LOG_AT(LOG_LEVEL_INFO, module, format, ##__VA_ARGS__)
+#define LOG_DEBUG(module, format, ...) LOG_AT(LOG_LEVEL_DEBUG, module, format, ##__VA_ARGS__)
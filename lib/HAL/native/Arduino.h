@@ -0,0 +1,59 @@
+#pragma once
+
+// Minimal Arduino core surface for the native (Linux) env. Only what the
+// managers, ArduinoJson and PubSubClient actually use is provided; the
+// function bodies live in ../src/hal_linux.cpp.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "IPAddress.h"
+#include "Client.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_byte_near(addr) pgm_read_byte(addr)
+
+#define HIGH 0x1
+#define LOW  0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+// stdout/stdin stand-in for the USB console
+class NativeConsole : public Stream {
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    void setRxBufferSize(size_t size) { (void)size; }
+    size_t write(uint8_t byte) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    int available() override;
+    int read() override;
+    int peek() override;
+    void flush() override;
+
+private:
+    int peeked = -1;
+};
+
+extern NativeConsole Serial;
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include "WString.h"
+
+class IPAddress {
+public:
+    IPAddress() : bytes{0, 0, 0, 0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{a, b, c, d} {}
+    IPAddress(uint32_t address) {
+        for (int i = 0; i < 4; i++) bytes[i] = (address >> (8 * i)) & 0xFF;
+    }
+
+    operator uint32_t() const {
+        return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+    }
+    bool operator==(const IPAddress& other) const { return (uint32_t)*this == (uint32_t)other; }
+    uint8_t operator[](int index) const { return bytes[index]; }
+    uint8_t& operator[](int index) { return bytes[index]; }
+
+    String toString() const {
+        char buffer[16];
+        snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+        return String(buffer);
+    }
+
+private:
+    uint8_t bytes[4];
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "WString.h"
+
+#define DEC 10
+#define HEX 16
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t byte) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+        size_t n = 0;
+        while (size--) {
+            if (!write(*buffer++)) break;
+            n++;
+        }
+        return n;
+    }
+    size_t write(const char* str) { return str ? write((const uint8_t*)str, strlen(str)) : 0; }
+    size_t write(const char* buffer, size_t size) { return write((const uint8_t*)buffer, size); }
+    virtual void flush() {}
+
+    size_t print(const char* str) { return write(str); }
+    size_t print(const String& str) { return write(str.c_str(), str.length()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int n, int base = DEC) { return print((long)n, base); }
+    size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(long n, int base = DEC) { return printf(base == HEX ? "%lx" : "%ld", n); }
+    size_t print(unsigned long n, int base = DEC) { return printf(base == HEX ? "%lx" : "%lu", n); }
+    size_t print(double n, int digits = 2) { return printf("%.*f", digits, n); }
+
+    size_t println() { return write("\r\n"); }
+    template <typename T>
+    size_t println(const T& value) { size_t n = print(value); return n + println(); }
+    template <typename T>
+    size_t println(const T& value, int format) { size_t n = print(value, format); return n + println(); }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        if (len < 0) return 0;
+        if ((size_t)len < sizeof(buffer)) return write((const uint8_t*)buffer, len);
+
+        // Rare long line, format again into a right-sized heap buffer
+        char* big = (char*)malloc(len + 1);
+        if (!big) return 0;
+        va_start(args, format);
+        vsnprintf(big, len + 1, format, args);
+        va_end(args);
+        size_t n = write((const uint8_t*)big, len);
+        free(big);
+        return n;
+    }
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Print.h"
+
+unsigned long millis();
+void yield();
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeoutMs) { timeout = timeoutMs; }
+    unsigned long getTimeout() const { return timeout; }
+
+    size_t readBytes(char* buffer, size_t length) {
+        size_t count = 0;
+        while (count < length) {
+            int c = timedRead();
+            if (c < 0) break;
+            *buffer++ = (char)c;
+            count++;
+        }
+        return count;
+    }
+    size_t readBytes(uint8_t* buffer, size_t length) { return readBytes((char*)buffer, length); }
+
+    String readStringUntil(char terminator) {
+        String result;
+        int c = timedRead();
+        while (c >= 0 && c != terminator) {
+            result += (char)c;
+            c = timedRead();
+        }
+        return result;
+    }
+
+protected:
+    unsigned long timeout = 1000;
+
+    int timedRead() {
+        unsigned long start = millis();
+        do {
+            int c = read();
+            if (c >= 0) return c;
+            yield();
+        } while (millis() - start < timeout);
+        return -1;
+    }
+};
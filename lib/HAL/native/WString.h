@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string>
+
+// std::string backed replacement for the Arduino String class
+class String {
+public:
+    String() {}
+    String(const char* str) : value(str ? str : "") {}
+    String(const std::string& str) : value(str) {}
+    explicit String(char c) : value(1, c) {}
+    explicit String(int number) : value(std::to_string(number)) {}
+    explicit String(unsigned int number) : value(std::to_string(number)) {}
+    explicit String(long number) : value(std::to_string(number)) {}
+    explicit String(unsigned long number) : value(std::to_string(number)) {}
+    explicit String(double number, unsigned int decimals = 2) {
+        char buffer[40];
+        snprintf(buffer, sizeof(buffer), "%.*f", (int)decimals, number);
+        value = buffer;
+    }
+
+    const char* c_str() const { return value.c_str(); }
+    unsigned int length() const { return (unsigned int)value.length(); }
+    bool isEmpty() const { return value.empty(); }
+    bool reserve(unsigned int size) { value.reserve(size); return true; }
+
+    bool concat(const char* str) { if (str) value += str; return true; }
+    bool concat(const char* str, unsigned int len) { if (str) value.append(str, len); return true; }
+    bool concat(const String& str) { value += str.value; return true; }
+    bool concat(char c) { value += c; return true; }
+
+    String& operator+=(const char* str) { concat(str); return *this; }
+    String& operator+=(const String& str) { concat(str); return *this; }
+    String& operator+=(char c) { concat(c); return *this; }
+
+    char operator[](unsigned int index) const { return index < value.size() ? value[index] : 0; }
+    char& operator[](unsigned int index) { return value[index]; }
+
+    bool equals(const String& other) const { return value == other.value; }
+    bool equals(const char* other) const { return value == (other ? other : ""); }
+    bool operator==(const String& other) const { return equals(other); }
+    bool operator==(const char* other) const { return equals(other); }
+    bool operator!=(const String& other) const { return !equals(other); }
+    bool operator!=(const char* other) const { return !equals(other); }
+    bool operator<(const String& other) const { return value < other.value; }
+
+    bool startsWith(const String& prefix) const { return value.compare(0, prefix.value.size(), prefix.value) == 0; }
+    bool endsWith(const String& suffix) const {
+        return value.size() >= suffix.value.size() &&
+               value.compare(value.size() - suffix.value.size(), suffix.value.size(), suffix.value) == 0;
+    }
+    int indexOf(char c, unsigned int from = 0) const {
+        size_t pos = value.find(c, from);
+        return pos == std::string::npos ? -1 : (int)pos;
+    }
+    int indexOf(const String& str, unsigned int from = 0) const {
+        size_t pos = value.find(str.value, from);
+        return pos == std::string::npos ? -1 : (int)pos;
+    }
+    String substring(unsigned int from) const { return from < value.size() ? String(value.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from >= value.size() || to <= from) return String();
+        return String(value.substr(from, to - from));
+    }
+    void trim() {
+        size_t start = value.find_first_not_of(" \t\r\n");
+        size_t end = value.find_last_not_of(" \t\r\n");
+        value = start == std::string::npos ? std::string() : value.substr(start, end - start + 1);
+    }
+    long toInt() const { return strtol(value.c_str(), nullptr, 10); }
+    float toFloat() const { return strtof(value.c_str(), nullptr); }
+
+    friend String operator+(const String& lhs, const String& rhs) { return String(lhs.value + rhs.value); }
+    friend String operator+(const String& lhs, const char* rhs) { return String(lhs.value + (rhs ? rhs : "")); }
+    friend String operator+(const char* lhs, const String& rhs) { return String((lhs ? lhs : "") + rhs.value); }
+
+private:
+    std::string value;
+};
@@ -0,0 +1,349 @@
+#pragma once
+
+// Thin hardware-abstraction layer. Managers talk to these interfaces instead
+// of HardwareSerial / SD / SPIFFS / Wire directly so the same code runs on
+// the ESP32-S3 (hal_esp32.cpp) and on Linux (hal_linux.cpp, native env).
+//
+// The network client is Arduino's own Client interface: WiFiClient on the
+// device, PosixTcpClient on Linux. PubSubClient already speaks it.
+
+#include <Arduino.h>
+#include <Client.h>
+
+class HalClock {
+public:
+    virtual ~HalClock() {}
+    virtual uint64_t micros64() = 0;
+    virtual void sleepMs(uint32_t ms) = 0;
+    uint32_t millis32() { return (uint32_t)(micros64() / 1000); }
+};
+
+class HalSerialPort {
+public:
+    virtual ~HalSerialPort() {}
+    virtual bool begin(long baud, int8_t rxPin, int8_t txPin) = 0;
+    virtual int available() = 0;
+    virtual int read() = 0;
+    // Blocks until len bytes arrived or the port timeout expired
+    virtual size_t readBytes(uint8_t* buffer, size_t len) = 0;
+    // Sleeps until bytes are available or timeoutMs passed, true if there are some
+    virtual bool waitForData(uint32_t timeoutMs) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t len) = 0;
+    size_t write(uint8_t byte) { return write(&byte, 1); }
+    virtual void flush() = 0;
+    virtual void setTimeout(uint32_t timeoutMs) = 0;
+};
+
+class HalFileSystem {
+public:
+    virtual ~HalFileSystem() {}
+    virtual bool begin() = 0;
+    virtual const char* name() const = 0;
+    virtual bool exists(const char* path) = 0;
+    // Size in bytes, -1 if the file is missing
+    virtual long fileSize(const char* path) = 0;
+    virtual size_t readFile(const char* path, uint8_t* buffer, size_t len) = 0;
+    virtual bool writeFile(const char* path, const uint8_t* data, size_t len) = 0;
+    virtual bool remove(const char* path) = 0;
+    virtual bool rename(const char* from, const char* to) = 0;
+};
+
+class HalI2CBus {
+public:
+    virtual ~HalI2CBus() {}
+    virtual bool begin(int sda, int scl) = 0;
+    // True if a device ACKs the given 7-bit address
+    virtual bool probe(uint8_t address) = 0;
+};
+
+// What a station needs to rejoin the same AP without a full scan
+struct WiFiApCache {
+    uint32_t ssidHash;      // Only valid for the SSID it was taken from
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint32_t ip;            // Last DHCP lease, 0 if none
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+};
+
+enum HalWiFiEvent : uint8_t {
+    WIFI_EVT_CONNECTED = 0,   // Associated, no IP yet
+    WIFI_EVT_GOT_IP,
+    WIFI_EVT_DISCONNECTED,    // reason is the 802.11 reason code
+    WIFI_EVT_LOST_IP
+};
+
+typedef void (*HalWiFiEventHandler)(void* context, HalWiFiEvent event, uint8_t reason);
+
+// Station side of the radio. Events are delivered from the driver's own
+// task, so handlers must only record them.
+class HalWiFiRadio {
+public:
+    virtual ~HalWiFiRadio() {}
+    virtual void setEventHandler(HalWiFiEventHandler handler, void* context) = 0;
+    // Starts an attempt and returns immediately. A null cache means a full
+    // scan; useLease applies the cached addresses instead of asking DHCP.
+    virtual void begin(const char* ssid, const char* password,
+                       const WiFiApCache* cache, bool useLease) = 0;
+    virtual void disconnect() = 0;
+    // BSSID/channel/lease of the current connection, valid after GOT_IP
+    virtual bool currentAp(WiFiApCache* out) = 0;
+    virtual bool loadCache(WiFiApCache* out) = 0;
+    virtual bool saveCache(const WiFiApCache& cache) = 0;
+};
+
+#define HAL_SERVER_SLOTS 32     // Connections a HalTcpServer hands out at once
+
+// Listening TCP socket. Connections come out of slots the server owns, so
+// nothing is allocated per connection; reads never block, a write blocks
+// for at most the timeout given to begin() and drops the connection then.
+class HalTcpServer {
+public:
+    virtual ~HalTcpServer() {}
+    virtual bool begin(uint16_t port, uint32_t writeTimeoutMs) = 0;
+    // A connection that was waiting, or null. A connection with every slot
+    // taken is closed straight away.
+    virtual Client* accept() = 0;
+    // Closes it and frees its slot
+    virtual void release(Client* client) = 0;
+};
+
+#ifdef ARDUINO
+#include <HardwareSerial.h>
+#include <FS.h>
+#include <Wire.h>
+#include <WiFi.h>
+
+class Esp32Clock : public HalClock {
+public:
+    uint64_t micros64() override;
+    void sleepMs(uint32_t ms) override;
+};
+
+class Esp32SerialPort : public HalSerialPort {
+public:
+    explicit Esp32SerialPort(HardwareSerial* serial) : serial(serial) {}
+    bool begin(long baud, int8_t rxPin, int8_t txPin) override;
+    int available() override { return serial->available(); }
+    int read() override { return serial->read(); }
+    size_t readBytes(uint8_t* buffer, size_t len) override { return serial->readBytes(buffer, len); }
+    bool waitForData(uint32_t timeoutMs) override;
+    size_t write(const uint8_t* buffer, size_t len) override { return serial->write(buffer, len); }
+    void flush() override { serial->flush(); }
+    void setTimeout(uint32_t timeoutMs) override { serial->setTimeout(timeoutMs); }
+    HardwareSerial* raw() { return serial; }
+
+private:
+    HardwareSerial* serial;
+    SemaphoreHandle_t rxReady = nullptr;
+};
+
+// Shared fs::FS plumbing for the SD and SPIFFS backends
+class Esp32FileSystem : public HalFileSystem {
+public:
+    explicit Esp32FileSystem(fs::FS& fs) : fs(fs) {}
+    bool exists(const char* path) override { return fs.exists(path); }
+    long fileSize(const char* path) override;
+    size_t readFile(const char* path, uint8_t* buffer, size_t len) override;
+    bool writeFile(const char* path, const uint8_t* data, size_t len) override;
+    bool remove(const char* path) override { return fs.remove(path); }
+    bool rename(const char* from, const char* to) override { return fs.rename(from, to); }
+
+protected:
+    fs::FS& fs;
+};
+
+class SdFileSystem : public Esp32FileSystem {
+public:
+    explicit SdFileSystem(uint8_t csPin);
+    bool begin() override;
+    const char* name() const override { return "SD card"; }
+
+private:
+    uint8_t csPin;
+};
+
+class SpiffsFileSystem : public Esp32FileSystem {
+public:
+    SpiffsFileSystem();
+    bool begin() override;
+    const char* name() const override { return "SPIFFS"; }
+};
+
+class WireI2CBus : public HalI2CBus {
+public:
+    explicit WireI2CBus(TwoWire* wire) : wire(wire) {}
+    bool begin(int sda, int scl) override { return wire->begin(sda, scl); }
+    bool probe(uint8_t address) override;
+
+private:
+    TwoWire* wire;
+};
+
+// WiFi.onEvent / WiFi.begin(ssid, pass, channel, bssid), cache kept in NVS
+class Esp32WiFiRadio : public HalWiFiRadio {
+public:
+    void setEventHandler(HalWiFiEventHandler handler, void* context) override;
+    void begin(const char* ssid, const char* password,
+               const WiFiApCache* cache, bool useLease) override;
+    void disconnect() override;
+    bool currentAp(WiFiApCache* out) override;
+    bool loadCache(WiFiApCache* out) override;
+    bool saveCache(const WiFiApCache& cache) override;
+};
+
+// WiFiServer on every interface, Nagle off
+class Esp32TcpServer : public HalTcpServer {
+public:
+    bool begin(uint16_t port, uint32_t writeTimeoutMs) override;
+    Client* accept() override;
+    void release(Client* client) override;
+
+private:
+    WiFiServer server;
+    WiFiClient clients[HAL_SERVER_SLOTS];
+    bool taken[HAL_SERVER_SLOTS] = {};
+    uint32_t writeTimeoutMs = 0;
+};
+
+#else  // Linux / native env
+
+#include <string>
+
+class ChronoClock : public HalClock {
+public:
+    uint64_t micros64() override;
+    void sleepMs(uint32_t ms) override;
+};
+
+// Opens the given tty/pty device, or creates a fresh pseudo-terminal when
+// no path is given and prints the slave name so a generator can attach.
+class PtySerialPort : public HalSerialPort {
+public:
+    explicit PtySerialPort(const char* devicePath = nullptr);
+    ~PtySerialPort() override;
+    bool begin(long baud, int8_t rxPin, int8_t txPin) override;
+    int available() override;
+    int read() override;
+    size_t readBytes(uint8_t* buffer, size_t len) override;
+    bool waitForData(uint32_t timeoutMs) override;
+    size_t write(const uint8_t* buffer, size_t len) override;
+    void flush() override;
+    void setTimeout(uint32_t timeoutMs) override { timeout = timeoutMs; }
+    const char* slaveName() const { return slave.c_str(); }
+
+private:
+    std::string device;
+    std::string slave;
+    int fd;
+    uint32_t timeout;
+};
+
+// Maps device paths onto a host directory
+class PosixFileSystem : public HalFileSystem {
+public:
+    explicit PosixFileSystem(const char* root, const char* label = "POSIX");
+    bool begin() override;
+    const char* name() const override { return label.c_str(); }
+    bool exists(const char* path) override;
+    long fileSize(const char* path) override;
+    size_t readFile(const char* path, uint8_t* buffer, size_t len) override;
+    bool writeFile(const char* path, const uint8_t* data, size_t len) override;
+    bool remove(const char* path) override;
+    bool rename(const char* from, const char* to) override;
+
+private:
+    std::string root;
+    std::string label;
+    std::string resolve(const char* path) const;
+};
+
+// Blocking-connect, non-blocking-read TCP client (e.g. to a local mosquitto)
+class PosixTcpClient : public Client {
+public:
+    PosixTcpClient();
+    ~PosixTcpClient() override;
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char* host, uint16_t port) override;
+    size_t write(uint8_t byte) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t* buffer, size_t size) override;
+    int peek() override;
+    void flush() override {}
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override { return fd >= 0; }
+    // Takes over a socket that is already connected, e.g. from accept()
+    void attach(int socket);
+
+private:
+    int fd;
+};
+
+// Non-blocking listener; accepted sockets get TCP_NODELAY and SO_SNDTIMEO
+class PosixTcpServer : public HalTcpServer {
+public:
+    PosixTcpServer() : fd(-1) {}
+    ~PosixTcpServer() override;
+    bool begin(uint16_t port, uint32_t writeTimeoutMs) override;
+    Client* accept() override;
+    void release(Client* client) override;
+
+private:
+    int fd;
+    uint32_t writeTimeoutMs = 0;
+    PosixTcpClient clients[HAL_SERVER_SLOTS];
+    bool taken[HAL_SERVER_SLOTS] = {};
+};
+
+// Time that only moves when a test moves it
+class FakeClock : public HalClock {
+public:
+    explicit FakeClock(uint64_t startUs = 1000) : nowUs(startUs) {}
+    uint64_t micros64() override { return nowUs; }
+    void sleepMs(uint32_t ms) override { nowUs += (uint64_t)ms * 1000; }
+    void advance(uint64_t us) { nowUs += us; }
+
+private:
+    uint64_t nowUs;
+};
+
+class NullI2CBus : public HalI2CBus {
+public:
+    bool begin(int sda, int scl) override { (void)sda; (void)scl; return true; }
+    bool probe(uint8_t address) override { (void)address; return false; }
+};
+
+// Records what the station asked for; inject() plays the driver's part
+class FakeWiFiRadio : public HalWiFiRadio {
+public:
+    void setEventHandler(HalWiFiEventHandler handler, void* context) override {
+        this->handler = handler;
+        this->context = context;
+    }
+    void begin(const char* ssid, const char* password,
+               const WiFiApCache* cache, bool useLease) override;
+    void disconnect() override { disconnects++; }
+    bool currentAp(WiFiApCache* out) override { *out = ap; return true; }
+    bool loadCache(WiFiApCache* out) override;
+    bool saveCache(const WiFiApCache& cache) override;
+    void inject(HalWiFiEvent event, uint8_t reason = 0);
+
+    WiFiApCache ap = {};        // Reported by currentAp()
+    WiFiApCache stored = {};    // Stands in for NVS
+    bool hasStored = false;
+    uint32_t attempts = 0;
+    uint32_t fastAttempts = 0;  // Attempts that used the cache
+    WiFiApCache lastCache = {}; // What the last of them was given
+    uint32_t disconnects = 0;
+    bool lastUsedLease = false;
+
+private:
+    HalWiFiEventHandler handler = nullptr;
+    void* context = nullptr;
+};
+
+#endif
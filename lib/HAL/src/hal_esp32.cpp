@@ -0,0 +1,221 @@
+#ifdef ARDUINO
+
+#include "hal.h"
+#include <esp_timer.h>
+#include <SD.h>
+#include <SPIFFS.h>
+#include <WiFi.h>
+#include <Preferences.h>
+
+uint64_t Esp32Clock::micros64() {
+    return (uint64_t)esp_timer_get_time();
+}
+
+void Esp32Clock::sleepMs(uint32_t ms) {
+    vTaskDelay(ms / portTICK_PERIOD_MS);
+}
+
+bool Esp32SerialPort::begin(long baud, int8_t rxPin, int8_t txPin) {
+    serial->begin(baud, SERIAL_8N1, rxPin, txPin);
+    return true;
+}
+
+bool Esp32SerialPort::waitForData(uint32_t timeoutMs) {
+    if (serial->available()) {
+        return true;
+    }
+    // The UART driver's event task signals RX, so the caller can block
+    // instead of polling and the CPU can idle (or light sleep) meanwhile
+    if (rxReady == nullptr) {
+        rxReady = xSemaphoreCreateBinary();
+        serial->onReceive([this]() { xSemaphoreGive(rxReady); });
+    }
+    xSemaphoreTake(rxReady, timeoutMs / portTICK_PERIOD_MS);
+    return serial->available() > 0;
+}
+
+long Esp32FileSystem::fileSize(const char* path) {
+    if (!fs.exists(path)) {
+        return -1;
+    }
+    File file = fs.open(path, FILE_READ);
+    if (!file) {
+        return -1;
+    }
+    long size = file.size();
+    file.close();
+    return size;
+}
+
+size_t Esp32FileSystem::readFile(const char* path, uint8_t* buffer, size_t len) {
+    File file = fs.open(path, FILE_READ);
+    if (!file) {
+        return 0;
+    }
+    size_t bytesRead = file.read(buffer, len);
+    file.close();
+    return bytesRead;
+}
+
+bool Esp32FileSystem::writeFile(const char* path, const uint8_t* data, size_t len) {
+    File file = fs.open(path, FILE_WRITE);
+    if (!file) {
+        return false;
+    }
+    size_t written = file.write(data, len);
+    file.close();
+    return written == len;
+}
+
+SdFileSystem::SdFileSystem(uint8_t csPin) : Esp32FileSystem(SD), csPin(csPin) {
+}
+
+bool SdFileSystem::begin() {
+    return SD.begin(csPin);
+}
+
+SpiffsFileSystem::SpiffsFileSystem() : Esp32FileSystem(SPIFFS) {
+}
+
+bool SpiffsFileSystem::begin() {
+    // Format on first mount so a blank flash still gives us a filesystem
+    return SPIFFS.begin(true);
+}
+
+bool WireI2CBus::probe(uint8_t address) {
+    wire->beginTransmission(address);
+    return wire->endTransmission() == 0;
+}
+
+static HalWiFiEventHandler wifiHandler = NULL;
+static void* wifiHandlerContext = NULL;
+
+void Esp32WiFiRadio::setEventHandler(HalWiFiEventHandler handler, void* context) {
+    wifiHandler = handler;
+    wifiHandlerContext = context;
+    WiFi.onEvent([](arduino_event_id_t event, arduino_event_info_t info) {
+        if (wifiHandler == NULL) {
+            return;
+        }
+        switch (event) {
+            case ARDUINO_EVENT_WIFI_STA_CONNECTED:
+                wifiHandler(wifiHandlerContext, WIFI_EVT_CONNECTED, 0);
+                break;
+            case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+                wifiHandler(wifiHandlerContext, WIFI_EVT_GOT_IP, 0);
+                break;
+            case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+                wifiHandler(wifiHandlerContext, WIFI_EVT_DISCONNECTED,
+                            info.wifi_sta_disconnected.reason);
+                break;
+            case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+                wifiHandler(wifiHandlerContext, WIFI_EVT_LOST_IP, 0);
+                break;
+            default:
+                break;
+        }
+    });
+}
+
+void Esp32WiFiRadio::begin(const char* ssid, const char* password,
+                           const WiFiApCache* cache, bool useLease) {
+    // Reconnects are driven by WiFiManager, keep the driver from racing it
+    WiFi.persistent(false);
+    WiFi.setAutoReconnect(false);
+    if (WiFi.getMode() == WIFI_OFF) {
+        WiFi.mode(WIFI_STA);
+    }
+
+    if (cache != NULL && useLease && cache->ip != 0) {
+        WiFi.config(IPAddress(cache->ip), IPAddress(cache->gateway),
+                    IPAddress(cache->subnet), IPAddress(cache->dns));
+    } else {
+        // All zeros switches back to DHCP
+        WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+    }
+
+    if (cache != NULL) {
+        // Known channel and BSSID skip the scan
+        WiFi.begin(ssid, password, cache->channel, cache->bssid, true);
+    } else {
+        WiFi.begin(ssid, password);
+    }
+}
+
+void Esp32WiFiRadio::disconnect() {
+    WiFi.disconnect(false, false);
+}
+
+bool Esp32WiFiRadio::currentAp(WiFiApCache* out) {
+    uint8_t* bssid = WiFi.BSSID();
+    if (bssid == NULL) {
+        return false;
+    }
+    memcpy(out->bssid, bssid, sizeof(out->bssid));
+    out->channel = WiFi.channel();
+    out->ip = (uint32_t)WiFi.localIP();
+    out->gateway = (uint32_t)WiFi.gatewayIP();
+    out->subnet = (uint32_t)WiFi.subnetMask();
+    out->dns = (uint32_t)WiFi.dnsIP();
+    return true;
+}
+
+bool Esp32WiFiRadio::loadCache(WiFiApCache* out) {
+    Preferences prefs;
+    if (!prefs.begin("wifi", true)) {
+        return false;
+    }
+    size_t n = prefs.getBytes("ap", out, sizeof(*out));
+    prefs.end();
+    return n == sizeof(*out);
+}
+
+bool Esp32WiFiRadio::saveCache(const WiFiApCache& cache) {
+    Preferences prefs;
+    if (!prefs.begin("wifi", false)) {
+        return false;
+    }
+    size_t n = prefs.putBytes("ap", &cache, sizeof(cache));
+    prefs.end();
+    return n == sizeof(cache);
+}
+
+
+bool Esp32TcpServer::begin(uint16_t port, uint32_t writeTimeoutMs) {
+    this->writeTimeoutMs = writeTimeoutMs;
+    server.begin(port);
+    server.setNoDelay(true);
+    return (bool)server;
+}
+
+Client* Esp32TcpServer::accept() {
+    WiFiClient client = server.accept();
+    if (!client) {
+        return NULL;
+    }
+    for (uint8_t i = 0; i < HAL_SERVER_SLOTS; i++) {
+        if (taken[i]) {
+            continue;
+        }
+        // lwIP honours SO_SNDTIMEO; WiFiClient::setTimeout's unit differs
+        // between core versions
+        struct timeval timeout = {(time_t)(writeTimeoutMs / 1000), (suseconds_t)(writeTimeoutMs % 1000 * 1000)};
+        setsockopt(client.fd(), SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        clients[i] = client;
+        taken[i] = true;
+        return &clients[i];
+    }
+    client.stop();
+    return NULL;
+}
+
+void Esp32TcpServer::release(Client* client) {
+    for (uint8_t i = 0; i < HAL_SERVER_SLOTS; i++) {
+        if (&clients[i] == client) {
+            clients[i].stop();
+            taken[i] = false;
+        }
+    }
+}
+
+#endif
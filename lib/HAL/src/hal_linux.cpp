@@ -0,0 +1,510 @@
+#ifndef ARDUINO
+
+#include "hal.h"
+
+#include <chrono>
+#include <thread>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+// ---------------------------------------------------------------------------
+// Arduino core stand-ins (declared in ../native/Arduino.h)
+// ---------------------------------------------------------------------------
+
+NativeConsole Serial;
+
+static const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+
+unsigned long micros() {
+    using namespace std::chrono;
+    return (unsigned long)duration_cast<microseconds>(steady_clock::now() - bootTime).count();
+}
+
+unsigned long millis() {
+    using namespace std::chrono;
+    return (unsigned long)duration_cast<milliseconds>(steady_clock::now() - bootTime).count();
+}
+
+void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield() {
+    std::this_thread::yield();
+}
+
+void pinMode(uint8_t pin, uint8_t mode) { (void)pin; (void)mode; }
+void digitalWrite(uint8_t pin, uint8_t value) { (void)pin; (void)value; }
+int digitalRead(uint8_t pin) { (void)pin; return HIGH; }
+
+size_t NativeConsole::write(uint8_t byte) {
+    return fwrite(&byte, 1, 1, stdout);
+}
+
+size_t NativeConsole::write(const uint8_t* buffer, size_t size) {
+    return fwrite(buffer, 1, size, stdout);
+}
+
+int NativeConsole::available() {
+    if (peeked >= 0) {
+        return 1;
+    }
+    struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+    return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN) ? 1 : 0;
+}
+
+int NativeConsole::read() {
+    if (peeked >= 0) {
+        int c = peeked;
+        peeked = -1;
+        return c;
+    }
+    if (!available()) {
+        return -1;
+    }
+    uint8_t c;
+    return ::read(STDIN_FILENO, &c, 1) == 1 ? c : -1;
+}
+
+int NativeConsole::peek() {
+    if (peeked < 0) {
+        peeked = read();
+    }
+    return peeked;
+}
+
+void NativeConsole::flush() {
+    fflush(stdout);
+}
+
+// ---------------------------------------------------------------------------
+// Clock
+// ---------------------------------------------------------------------------
+
+uint64_t ChronoClock::micros64() {
+    using namespace std::chrono;
+    return (uint64_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void ChronoClock::sleepMs(uint32_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// ---------------------------------------------------------------------------
+// Serial port on a pty or tty
+// ---------------------------------------------------------------------------
+
+static speed_t baudToSpeed(long baud) {
+    switch (baud) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        default: return B115200;
+    }
+}
+
+PtySerialPort::PtySerialPort(const char* devicePath) : device(devicePath ? devicePath : ""), fd(-1), timeout(1000) {
+}
+
+PtySerialPort::~PtySerialPort() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+bool PtySerialPort::begin(long baud, int8_t rxPin, int8_t txPin) {
+    (void)rxPin;
+    (void)txPin;
+
+    if (device.empty()) {
+        fd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) {
+            Serial.printf("Failed to create pty: %s\n", strerror(errno));
+            return false;
+        }
+        slave = ptsname(fd);
+        Serial.printf("Hub UART pty: %s\n", slave.c_str());
+    } else {
+        fd = open(device.c_str(), O_RDWR | O_NOCTTY);
+        if (fd < 0) {
+            Serial.printf("Failed to open %s: %s\n", device.c_str(), strerror(errno));
+            return false;
+        }
+        slave = device;
+    }
+
+    struct termios tty;
+    if (tcgetattr(fd, &tty) == 0) {
+        cfmakeraw(&tty);
+        cfsetispeed(&tty, baudToSpeed(baud));
+        cfsetospeed(&tty, baudToSpeed(baud));
+        tcsetattr(fd, TCSANOW, &tty);
+    }
+    return true;
+}
+
+int PtySerialPort::available() {
+    int count = 0;
+    if (fd < 0 || ioctl(fd, FIONREAD, &count) != 0) {
+        return 0;
+    }
+    return count;
+}
+
+int PtySerialPort::read() {
+    // Non-blocking like HardwareSerial::read()
+    uint8_t byte;
+    if (fd < 0 || available() == 0) {
+        return -1;
+    }
+    return ::read(fd, &byte, 1) == 1 ? byte : -1;
+}
+
+size_t PtySerialPort::readBytes(uint8_t* buffer, size_t len) {
+    if (fd < 0) {
+        return 0;
+    }
+    size_t total = 0;
+    unsigned long start = millis();
+    while (total < len) {
+        unsigned long elapsed = millis() - start;
+        if (elapsed >= timeout) {
+            break;
+        }
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, (int)(timeout - elapsed)) <= 0) {
+            break;
+        }
+        ssize_t n = ::read(fd, buffer + total, len - total);
+        if (n <= 0) {
+            break;
+        }
+        total += (size_t)n;
+    }
+    return total;
+}
+
+bool PtySerialPort::waitForData(uint32_t timeoutMs) {
+    if (fd < 0) {
+        return false;
+    }
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    return poll(&pfd, 1, (int)timeoutMs) > 0;
+}
+
+size_t PtySerialPort::write(const uint8_t* buffer, size_t len) {
+    if (fd < 0) {
+        return 0;
+    }
+    ssize_t n = ::write(fd, buffer, len);
+    return n < 0 ? 0 : (size_t)n;
+}
+
+void PtySerialPort::flush() {
+    if (fd >= 0) {
+        tcdrain(fd);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Filesystem rooted at a host directory
+// ---------------------------------------------------------------------------
+
+PosixFileSystem::PosixFileSystem(const char* root, const char* label) : root(root), label(label) {
+}
+
+std::string PosixFileSystem::resolve(const char* path) const {
+    return root + (path[0] == '/' ? "" : "/") + path;
+}
+
+bool PosixFileSystem::begin() {
+    struct stat st;
+    if (stat(root.c_str(), &st) == 0) {
+        return S_ISDIR(st.st_mode);
+    }
+    return mkdir(root.c_str(), 0755) == 0;
+}
+
+bool PosixFileSystem::exists(const char* path) {
+    struct stat st;
+    return stat(resolve(path).c_str(), &st) == 0;
+}
+
+long PosixFileSystem::fileSize(const char* path) {
+    struct stat st;
+    if (stat(resolve(path).c_str(), &st) != 0) {
+        return -1;
+    }
+    return (long)st.st_size;
+}
+
+size_t PosixFileSystem::readFile(const char* path, uint8_t* buffer, size_t len) {
+    FILE* file = fopen(resolve(path).c_str(), "rb");
+    if (!file) {
+        return 0;
+    }
+    size_t bytesRead = fread(buffer, 1, len, file);
+    fclose(file);
+    return bytesRead;
+}
+
+bool PosixFileSystem::writeFile(const char* path, const uint8_t* data, size_t len) {
+    FILE* file = fopen(resolve(path).c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    size_t written = fwrite(data, 1, len, file);
+    bool ok = fclose(file) == 0;
+    return ok && written == len;
+}
+
+bool PosixFileSystem::remove(const char* path) {
+    return ::remove(resolve(path).c_str()) == 0;
+}
+
+bool PosixFileSystem::rename(const char* from, const char* to) {
+    return ::rename(resolve(from).c_str(), resolve(to).c_str()) == 0;
+}
+
+// ---------------------------------------------------------------------------
+// TCP client
+// ---------------------------------------------------------------------------
+
+PosixTcpClient::PosixTcpClient() : fd(-1) {
+}
+
+PosixTcpClient::~PosixTcpClient() {
+    stop();
+}
+
+int PosixTcpClient::connect(IPAddress ip, uint16_t port) {
+    return connect(ip.toString().c_str(), port);
+}
+
+int PosixTcpClient::connect(const char* host, uint16_t port) {
+    stop();
+
+    char portStr[8];
+    snprintf(portStr, sizeof(portStr), "%u", port);
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* result = nullptr;
+    if (getaddrinfo(host, portStr, &hints, &result) != 0) {
+        return 0;
+    }
+
+    for (struct addrinfo* ai = result; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+
+    if (fd < 0) {
+        return 0;
+    }
+
+    // MQTT packets are small, don't let Nagle hold them back
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return 1;
+}
+
+size_t PosixTcpClient::write(uint8_t byte) {
+    return write(&byte, 1);
+}
+
+size_t PosixTcpClient::write(const uint8_t* buffer, size_t size) {
+    if (fd < 0) {
+        return 0;
+    }
+    size_t sent = 0;
+    while (sent < size) {
+        ssize_t n = send(fd, buffer + sent, size - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            stop();
+            break;
+        }
+        sent += (size_t)n;
+    }
+    return sent;
+}
+
+int PosixTcpClient::available() {
+    int count = 0;
+    if (fd < 0 || ioctl(fd, FIONREAD, &count) != 0) {
+        return 0;
+    }
+    return count;
+}
+
+int PosixTcpClient::read() {
+    uint8_t byte;
+    return read(&byte, 1) == 1 ? byte : -1;
+}
+
+int PosixTcpClient::read(uint8_t* buffer, size_t size) {
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t n = recv(fd, buffer, size, MSG_DONTWAIT);
+    if (n == 0) {
+        stop();
+        return -1;
+    }
+    return n < 0 ? -1 : (int)n;
+}
+
+int PosixTcpClient::peek() {
+    if (fd < 0) {
+        return -1;
+    }
+    uint8_t byte;
+    return recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 1 ? byte : -1;
+}
+
+void PosixTcpClient::stop() {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+uint8_t PosixTcpClient::connected() {
+    if (fd < 0) {
+        return 0;
+    }
+    uint8_t byte;
+    ssize_t n = recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        stop();
+        return 0;
+    }
+    return 1;
+}
+
+void PosixTcpClient::attach(int socket) {
+    stop();
+    fd = socket;
+}
+
+// ---------------------------------------------------------------------------
+// TCP server
+// ---------------------------------------------------------------------------
+
+PosixTcpServer::~PosixTcpServer() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+bool PosixTcpServer::begin(uint16_t port, uint32_t writeTimeoutMs) {
+    this->writeTimeoutMs = writeTimeoutMs;
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        return false;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, HAL_SERVER_SLOTS) != 0) {
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    return true;
+}
+
+Client* PosixTcpServer::accept() {
+    if (fd < 0) {
+        return nullptr;
+    }
+    int socket = ::accept(fd, nullptr, nullptr);
+    if (socket < 0) {
+        return nullptr;
+    }
+    for (uint8_t i = 0; i < HAL_SERVER_SLOTS; i++) {
+        if (taken[i]) {
+            continue;
+        }
+        int one = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        struct timeval timeout = {(time_t)(writeTimeoutMs / 1000), (suseconds_t)(writeTimeoutMs % 1000 * 1000)};
+        setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        clients[i].attach(socket);
+        taken[i] = true;
+        return &clients[i];
+    }
+    close(socket);
+    return nullptr;
+}
+
+void PosixTcpServer::release(Client* client) {
+    for (uint8_t i = 0; i < HAL_SERVER_SLOTS; i++) {
+        if (&clients[i] == client) {
+            clients[i].stop();
+            taken[i] = false;
+        }
+    }
+}
+
+void FakeWiFiRadio::begin(const char* ssid, const char* password,
+                          const WiFiApCache* cache, bool useLease) {
+    (void)ssid;
+    (void)password;
+    attempts++;
+    if (cache != nullptr) {
+        fastAttempts++;
+        lastCache = *cache;
+    }
+    lastUsedLease = useLease;
+}
+
+bool FakeWiFiRadio::loadCache(WiFiApCache* out) {
+    if (!hasStored) {
+        return false;
+    }
+    *out = stored;
+    return true;
+}
+
+bool FakeWiFiRadio::saveCache(const WiFiApCache& cache) {
+    stored = cache;
+    hasStored = true;
+    return true;
+}
+
+void FakeWiFiRadio::inject(HalWiFiEvent event, uint8_t reason) {
+    if (handler != nullptr) {
+        handler(context, event, reason);
+    }
+}
+
+#endif
@@ -0,0 +1,180 @@
+#include "latency_tracer.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include <esp_timer.h>
+#else
+#include <chrono>
+#endif
+
+LatencyTracer latencyTracer;
+
+namespace {
+
+int64_t platformClock() {
+#ifdef ESP_PLATFORM
+    return esp_timer_get_time();
+#else
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+const char* const STAGE_NAMES[TRACE_STAGE_COUNT] = {
+    "uart_rx",
+    "decoded",
+    "enqueued",
+    "dequeued",
+    "encoded",
+    "publish_call",
+    "publish_return"
+};
+
+}  // namespace
+
+void LatencyHistogram::reset() {
+    memset(buckets, 0, sizeof(buckets));
+    count = 0;
+    minValue = UINT32_MAX;
+    maxValue = 0;
+    sum = 0;
+}
+
+uint16_t LatencyHistogram::bucketFor(uint32_t value) {
+    if (value < 2 * SUB_COUNT) {
+        return value;
+    }
+    uint8_t msb = 31 - __builtin_clz(value);
+    uint8_t shift = msb - SUB_BITS;
+    uint16_t mantissa = value >> shift;  // Always in [SUB_COUNT, 2 * SUB_COUNT)
+    return (shift + 1) * SUB_COUNT + (mantissa - SUB_COUNT);
+}
+
+uint32_t LatencyHistogram::bucketUpper(uint16_t index) {
+    if (index < 2 * SUB_COUNT) {
+        return index;
+    }
+    uint8_t shift = index / SUB_COUNT - 1;
+    uint32_t mantissa = index % SUB_COUNT + SUB_COUNT;
+    uint64_t upper = ((uint64_t)(mantissa + 1) << shift) - 1;
+    return upper > UINT32_MAX ? UINT32_MAX : (uint32_t)upper;
+}
+
+void LatencyHistogram::record(uint32_t value) {
+    buckets[bucketFor(value)]++;
+    count++;
+    sum += value;
+    if (value < minValue) minValue = value;
+    if (value > maxValue) maxValue = value;
+}
+
+uint32_t LatencyHistogram::percentile(float quantile) const {
+    if (count == 0) {
+        return 0;
+    }
+    uint32_t target = (uint32_t)(quantile * count + 0.5f);
+    if (target == 0) target = 1;
+    if (target > count) target = count;
+
+    uint32_t seen = 0;
+    for (uint16_t i = 0; i < BUCKET_COUNT; i++) {
+        seen += buckets[i];
+        if (seen >= target) {
+            uint32_t upper = bucketUpper(i);
+            return upper < maxValue ? upper : maxValue;
+        }
+    }
+    return maxValue;
+}
+
+LatencyTracer::ClockFn LatencyTracer::clock = platformClock;
+
+LatencyTracer::LatencyTracer() {
+    dropped = 0;
+}
+
+void LatencyTracer::setClock(ClockFn newClock) {
+    clock = newClock ? newClock : platformClock;
+}
+
+int64_t LatencyTracer::now() {
+    return clock();
+}
+
+void LatencyTracer::clear(TraceRecord& record) {
+    memset(&record, 0, sizeof(record));
+}
+
+void LatencyTracer::stamp(TraceRecord& record, TraceStage stage) {
+    record.stamp[stage] = clock();
+}
+
+void LatencyTracer::commit(const TraceRecord& record) {
+    // A reading without a receive stamp was never traced (e.g. tracing was
+    // enabled mid-flight); count it rather than skewing the histograms.
+    if (record.stamp[TRACE_UART_RX] == 0) {
+        dropped++;
+        return;
+    }
+
+    int64_t previous = record.stamp[TRACE_UART_RX];
+    int64_t last = previous;
+    for (uint8_t i = 1; i < TRACE_STAGE_COUNT; i++) {
+        int64_t current = record.stamp[i];
+        if (current == 0) {
+            continue;  // Stage skipped, attribute its time to the next one
+        }
+        int64_t delta = current - previous;
+        stages[i].record(delta < 0 ? 0 : (delta > UINT32_MAX ? UINT32_MAX : (uint32_t)delta));
+        previous = current;
+        last = current;
+    }
+
+    int64_t total = last - record.stamp[TRACE_UART_RX];
+    endToEnd.record(total < 0 ? 0 : (total > UINT32_MAX ? UINT32_MAX : (uint32_t)total));
+}
+
+void LatencyTracer::reset() {
+    for (uint8_t i = 0; i < TRACE_STAGE_COUNT; i++) {
+        stages[i].reset();
+    }
+    endToEnd.reset();
+    dropped = 0;
+}
+
+const char* LatencyTracer::stageName(TraceStage stage) {
+    return stage < TRACE_STAGE_COUNT ? STAGE_NAMES[stage] : "?";
+}
+
+size_t LatencyTracer::format(char* out, size_t len) const {
+    if (len == 0) {
+        return 0;
+    }
+    out[0] = '\0';
+
+    size_t pos = 0;
+    auto append = [&](const char* name, const LatencyHistogram& h) {
+        if (pos >= len) return;
+        int n = snprintf(out + pos, len - pos, "%-16s %8u %8u %8u %8u %8u %8u\n",
+                         name, (unsigned)h.getCount(), (unsigned)h.getMin(),
+                         (unsigned)h.percentile(0.5f), (unsigned)h.percentile(0.9f),
+                         (unsigned)h.percentile(0.99f), (unsigned)h.getMax());
+        if (n > 0) pos += (size_t)n;
+    };
+
+    int n = snprintf(out, len, "%-16s %8s %8s %8s %8s %8s %8s  (us)\n",
+                     "stage", "count", "min", "p50", "p90", "p99", "max");
+    if (n > 0) pos = (size_t)n;
+
+    for (uint8_t i = 1; i < TRACE_STAGE_COUNT; i++) {
+        append(STAGE_NAMES[i], stages[i]);
+    }
+    append("end_to_end", endToEnd);
+
+    if (pos < len) {
+        n = snprintf(out + pos, len - pos, "untraced: %u\n", (unsigned)dropped);
+        if (n > 0) pos += (size_t)n;
+    }
+    return pos < len ? pos : len - 1;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Compile-time switch. When 0 the TRACE_* macros expand to nothing so the
+// hot paths carry no cost at all.
+#ifndef ENABLE_LATENCY_TRACE
+#define ENABLE_LATENCY_TRACE 0
+#endif
+
+// Points in the pipeline where a reading gets stamped, in the order a
+// reading passes through them.
+enum TraceStage : uint8_t {
+    TRACE_UART_RX = 0,      // First byte of a frame seen on the hub UART
+    TRACE_DECODED,          // Frame CRC-checked and decoded out of the UART buffer
+    TRACE_ENQUEUED,         // Handed over to the MQTT task
+    TRACE_DEQUEUED,         // Picked up by the MQTT task
+    TRACE_ENCODED,          // Timestamp read and JSON payload serialized
+    TRACE_PUBLISH_CALL,     // Just before MQTTManager::publish
+    TRACE_PUBLISH_RETURN,   // publish() returned (bytes handed to TCP)
+    TRACE_STAGE_COUNT
+};
+
+// Per-reading stamps in microseconds. A zero stamp means "not reached".
+struct TraceRecord {
+    int64_t stamp[TRACE_STAGE_COUNT];
+};
+
+// Log-linear histogram in the spirit of HdrHistogram: values below 16 are
+// counted exactly, above that every power of two is split into 8 sub-buckets,
+// which bounds the reported error to 12.5% over the whole uint32 range.
+class LatencyHistogram {
+public:
+    static const uint8_t SUB_BITS = 3;
+    static const uint16_t SUB_COUNT = 1 << SUB_BITS;
+    static const uint16_t BUCKET_COUNT = (32 - SUB_BITS + 1) * SUB_COUNT;
+
+    LatencyHistogram() { reset(); }
+    void reset();
+    void record(uint32_t value);
+    // Highest value equivalent to the bucket holding the given quantile (0..1)
+    uint32_t percentile(float quantile) const;
+
+    uint32_t getCount() const { return count; }
+    uint32_t getMin() const { return count ? minValue : 0; }
+    uint32_t getMax() const { return maxValue; }
+    uint32_t getMean() const { return count ? (uint32_t)(sum / count) : 0; }
+
+    static uint16_t bucketFor(uint32_t value);
+    static uint32_t bucketUpper(uint16_t index);
+
+private:
+    uint32_t buckets[BUCKET_COUNT];
+    uint32_t count;
+    uint32_t minValue;
+    uint32_t maxValue;
+    uint64_t sum;
+};
+
+class LatencyTracer {
+public:
+    typedef int64_t (*ClockFn)();
+
+    LatencyTracer();
+
+    // Replace the time source, e.g. with a fake clock in host builds.
+    // Passing nullptr restores the platform clock.
+    static void setClock(ClockFn clock);
+    static int64_t now();
+
+    static void clear(TraceRecord& record);
+    static void stamp(TraceRecord& record, TraceStage stage);
+
+    // Fold a finished record into the per-stage histograms
+    void commit(const TraceRecord& record);
+    void reset();
+
+    // Histogram of the interval ending at the given stage (stage > 0)
+    const LatencyHistogram& stageHistogram(TraceStage stage) const { return stages[stage]; }
+    const LatencyHistogram& endToEndHistogram() const { return endToEnd; }
+    uint32_t getDropped() const { return dropped; }
+
+    // Human readable table, returns the number of characters written
+    size_t format(char* out, size_t len) const;
+
+    static const char* stageName(TraceStage stage);
+
+private:
+    static ClockFn clock;
+    LatencyHistogram stages[TRACE_STAGE_COUNT];
+    LatencyHistogram endToEnd;
+    uint32_t dropped;
+};
+
+extern LatencyTracer latencyTracer;
+
+#if ENABLE_LATENCY_TRACE
+#define TRACE_CLEAR(rec)         LatencyTracer::clear(rec)
+#define TRACE_STAMP(rec, stage)  LatencyTracer::stamp((rec), (stage))
+#define TRACE_COMMIT(rec)        latencyTracer.commit(rec)
+#else
+#define TRACE_CLEAR(rec)         ((void)0)
+#define TRACE_STAMP(rec, stage)  ((void)0)
+#define TRACE_COMMIT(rec)        ((void)0)
+#endif
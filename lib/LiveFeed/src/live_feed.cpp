@@ -0,0 +1,208 @@
+#include "live_feed.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// Room kept free for metrics and closing brackets when adding nodes
+static const size_t FRAME_RESERVE = 512;
+
+LiveFeed::LiveFeed(const NodeTable* table, LiveSink* sink, LiveMetricsWriter metrics) {
+    this->table = table;
+    this->sink = sink;
+    this->metrics = metrics;
+    deltaFrame = nullptr;
+    fullFrame = nullptr;
+    count = 0;
+    for (uint8_t i = 0; i < DIRTY_WORDS; i++) {
+        dirty[i] = 0;
+    }
+    lastTickMs = 0;
+    lastMetricsMs = 0;
+    sequence = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool LiveFeed::begin() {
+    if (deltaFrame == nullptr) {
+        deltaFrame = (char*)regionAlloc(LIVE_FRAME_SIZE, MEM_PSRAM);
+        fullFrame = (char*)regionAlloc(LIVE_FRAME_SIZE, MEM_PSRAM);
+    }
+    return deltaFrame != nullptr && fullFrame != nullptr;
+}
+
+bool LiveFeed::addClient(uint32_t id) {
+    bool added = false;
+    guard.lock();
+    if (count < LIVE_MAX_CLIENTS) {
+        clients[count].id = id;
+        clients[count].needsFull = true;
+        count++;
+        added = true;
+    }
+    guard.unlock();
+    return added;
+}
+
+void LiveFeed::removeClient(uint32_t id) {
+    guard.lock();
+    for (uint8_t i = 0; i < count; i++) {
+        if (clients[i].id == id) {
+            clients[i] = clients[--count];
+            break;
+        }
+    }
+    guard.unlock();
+}
+
+uint8_t LiveFeed::clientCount() {
+    guard.lock();
+    uint8_t n = count;
+    guard.unlock();
+    return n;
+}
+
+void LiveFeed::markNode(const NodeStats* node) {
+    if (node == nullptr) {
+        return;
+    }
+    size_t index = node - &table->at(0);
+    dirty[index / 32].fetch_or(1UL << (index % 32));
+}
+
+void LiveFeed::setNeedsFull(const uint32_t* ids, uint8_t n, bool value) {
+    guard.lock();
+    for (uint8_t i = 0; i < n; i++) {
+        for (uint8_t c = 0; c < count; c++) {
+            if (clients[c].id == ids[i]) {
+                clients[c].needsFull = value;
+            }
+        }
+    }
+    guard.unlock();
+}
+
+void LiveFeed::tick(uint32_t nowMs) {
+    if (deltaFrame == nullptr || nowMs - lastTickMs < LIVE_FEED_INTERVAL) {
+        return;
+    }
+    lastTickMs = nowMs;
+
+    Client snapshot[LIVE_MAX_CLIENTS];
+    guard.lock();
+    uint8_t n = count;
+    memcpy(snapshot, clients, n * sizeof(Client));
+    guard.unlock();
+
+    // Take the dirty set even without clients, a newcomer gets a full frame
+    uint32_t bits[DIRTY_WORDS];
+    bool anyDirty = false;
+    for (uint8_t i = 0; i < DIRTY_WORDS; i++) {
+        bits[i] = dirty[i].exchange(0);
+        anyDirty |= bits[i] != 0;
+    }
+    if (n == 0) {
+        return;
+    }
+
+    bool metricsDue = nowMs - lastMetricsMs >= LIVE_METRICS_INTERVAL;
+    uint32_t deltaIds[LIVE_MAX_CLIENTS];
+    uint32_t fullIds[LIVE_MAX_CLIENTS];
+    uint32_t staleIds[LIVE_MAX_CLIENTS];
+    uint8_t deltaCount = 0;
+    uint8_t fullCount = 0;
+    uint8_t staleCount = 0;
+
+    for (uint8_t i = 0; i < n; i++) {
+        const Client& client = snapshot[i];
+        if (!client.needsFull && !anyDirty && !metricsDue) {
+            continue;  // Nothing new for this one
+        }
+        if (sink->isBusy(client.id)) {
+            // Drop the frame; a delta it misses means a full frame later
+            stats.dropped++;
+            if (!client.needsFull) {
+                staleIds[staleCount++] = client.id;
+            }
+            continue;
+        }
+        if (client.needsFull) {
+            fullIds[fullCount++] = client.id;
+        } else {
+            deltaIds[deltaCount++] = client.id;
+        }
+    }
+    setNeedsFull(staleIds, staleCount, true);
+
+    if (metricsDue && (deltaCount > 0 || fullCount > 0)) {
+        lastMetricsMs = nowMs;
+    }
+    if (deltaCount > 0) {
+        size_t len = buildFrame(deltaFrame, LIVE_FRAME_SIZE, bits, metricsDue, nowMs);
+        sink->sendShared(deltaFrame, len, deltaIds, deltaCount);
+        stats.deliveries += deltaCount;
+    }
+    if (fullCount > 0) {
+        size_t len = buildFrame(fullFrame, LIVE_FRAME_SIZE, nullptr, true, nowMs);
+        sink->sendShared(fullFrame, len, fullIds, fullCount);
+        stats.deliveries += fullCount;
+        stats.fullFrames++;
+        setNeedsFull(fullIds, fullCount, false);
+    }
+}
+
+// dirtyBits == nullptr builds a full frame with every node
+size_t LiveFeed::buildFrame(char* out, size_t len, const uint32_t* dirtyBits, bool withMetrics, uint32_t nowMs) {
+    size_t pos = 0;
+    auto append = [&](int written) {
+        if (written > 0) pos += (size_t)written;
+        if (pos >= len) pos = len - 1;
+    };
+
+    sequence++;
+    append(snprintf(out, len, "{\"seq\":%lu,\"uptime_ms\":%lu,\"full\":%s,\"nodes\":[",
+                    (unsigned long)sequence, (unsigned long)nowMs, dirtyBits ? "false" : "true"));
+
+    bool first = true;
+    bool truncated = false;
+    for (uint8_t i = 0; i < table->size(); i++) {
+        if (dirtyBits && !(dirtyBits[i / 32] & (1UL << (i % 32)))) {
+            continue;
+        }
+        if (pos + FRAME_RESERVE >= len) {
+            truncated = true;
+            break;
+        }
+        const NodeStats& node = table->at(i);
+        // Node IDs come off the wire, keep only characters safe in a JSON string
+        char id[sizeof(node.nodeID)];
+        size_t k = 0;
+        for (const char* c = node.nodeID; *c && k < sizeof(id) - 1; c++) {
+            if (*c >= 0x20 && *c != '"' && *c != '\\') {
+                id[k++] = *c;
+            }
+        }
+        id[k] = '\0';
+        append(snprintf(out + pos, len - pos,
+                        "%s{\"id\":\"%s\",\"count\":%lu,\"age_ms\":%lu,\"temp\":",
+                        first ? "" : ",", id, (unsigned long)node.count,
+                        (unsigned long)(nowMs - node.lastSeenMs)));
+        append(isnan(node.lastTemp) ? snprintf(out + pos, len - pos, "null")
+                                    : snprintf(out + pos, len - pos, "%.2f", node.lastTemp));
+        append(snprintf(out + pos, len - pos, ",\"humidity\":"));
+        append(isnan(node.lastHumidity) ? snprintf(out + pos, len - pos, "null")
+                                        : snprintf(out + pos, len - pos, "%.2f", node.lastHumidity));
+        append(snprintf(out + pos, len - pos, ",\"moisture\":%ld}", node.lastMoisture));
+        first = false;
+    }
+    append(snprintf(out + pos, len - pos, "]%s", truncated ? ",\"truncated\":true" : ""));
+
+    if (withMetrics && metrics) {
+        append(snprintf(out + pos, len - pos, ",\"metrics\":"));
+        append((int)metrics(out + pos, len - pos));
+    }
+    append(snprintf(out + pos, len - pos, "}"));
+
+    stats.frames++;
+    stats.bytes += pos;
+    return pos;
+}
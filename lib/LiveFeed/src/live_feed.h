@@ -0,0 +1,71 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include "config.h"
+#include "node_table.h"
+#include "memory_pools.h"
+
+// Transport for live frames: AsyncWebSocket on the device, a fake natively
+class LiveSink {
+public:
+    virtual ~LiveSink() {}
+    // True while the client still has too many frames queued
+    virtual bool isBusy(uint32_t clientId) = 0;
+    // One frame to several clients, serialized and buffered only once
+    virtual void sendShared(const char* frame, size_t len, const uint32_t* clientIds, uint8_t count) = 0;
+};
+
+// Appends one JSON object with hub metrics, returns bytes written
+typedef size_t (*LiveMetricsWriter)(char* out, size_t len);
+
+struct LiveFeedStats {
+    uint32_t frames;        // Frames built (delta and full)
+    uint32_t fullFrames;
+    uint32_t deliveries;    // Frame sends summed over clients
+    uint32_t dropped;       // Frames skipped for a busy client
+    uint32_t bytes;         // Bytes serialized, not multiplied by clients
+};
+
+// Coalesces per-node updates into bounded-rate frames for the dashboard.
+// Nodes are marked dirty as readings arrive and each tick sends only the
+// nodes that changed since the last one. A busy client is skipped, and
+// once it drains it gets a full frame instead of the deltas it missed.
+class LiveFeed {
+public:
+    LiveFeed(const NodeTable* table, LiveSink* sink, LiveMetricsWriter metrics);
+    bool begin();
+    bool addClient(uint32_t id);
+    void removeClient(uint32_t id);
+    // From the ingest task, right after nodeTable.update()
+    void markNode(const NodeStats* node);
+    // Sends at most one delta and one full frame, rate-limited to LIVE_FEED_INTERVAL
+    void tick(uint32_t nowMs);
+    uint8_t clientCount();
+    const LiveFeedStats& getStats() const { return stats; }
+
+private:
+    static const uint8_t DIRTY_WORDS = (NODE_TABLE_CAPACITY + 31) / 32;
+
+    struct Client {
+        uint32_t id;
+        bool needsFull;
+    };
+
+    const NodeTable* table;
+    LiveSink* sink;
+    LiveMetricsWriter metrics;
+    char* deltaFrame;
+    char* fullFrame;
+    Client clients[LIVE_MAX_CLIENTS];
+    uint8_t count;
+    PoolLock guard;
+    std::atomic<uint32_t> dirty[DIRTY_WORDS];
+    uint32_t lastTickMs;
+    uint32_t lastMetricsMs;
+    uint32_t sequence;
+    LiveFeedStats stats;
+
+    void setNeedsFull(const uint32_t* ids, uint8_t n, bool value);
+    size_t buildFrame(char* out, size_t len, const uint32_t* dirtyBits, bool withMetrics, uint32_t nowMs);
+};
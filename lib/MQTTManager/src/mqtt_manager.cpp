@@ -1,12 +1,32 @@
 #include "mqtt_manager.h"
+#include "event_log.h"
 
-MQTTManager::MQTTManager(HubConfig* config) {
+MQTTManager* MQTTManager::callbackOwner = nullptr;
+
+MQTTManager::MQTTManager(HubConfig* config, Client* netClient) {
     this->config = config;
+    this->netClient = netClient;
 }
 
 bool MQTTManager::begin() {
-    client.setClient(espClient);
-    client.setServer(config->mqtt_server.c_str(), config->mqtt_port);
+    {
+        std::lock_guard<std::recursive_mutex> guard(lock);
+        client.setClient(*netClient);
+        client.setServer(config->mqtt_server, config->mqtt_port);
+        callbackOwner = this;
+        client.setCallback(onMessage);
+        // The default 256 bytes would drop calibration and config bodies
+        if (!client.setBufferSize(MQTT_COMMAND_PACKET_SIZE)) {
+            LOG_WARN(LOG_MQTT, "No memory for a %u byte MQTT buffer, commands over %u bytes are dropped",
+                     (unsigned)MQTT_COMMAND_PACKET_SIZE, (unsigned)client.getBufferSize());
+        }
+#if MQTT_V5
+        client5.setClient(netClient);
+        client5.setServer(config->mqtt_server, config->mqtt_port);
+        client5.setCallback(onMessage);
+#endif
+        configured = true;
+    }
     return connect();
 }
 
@@ -14,48 +34,311 @@ bool MQTTManager::connect() {
     // Loop until MQTT is established
     int attempts = 0;
     const int MAX_ATTEMPTS = 2;
+#if MQTT_V5
+    int v5Closed = 0;
+    if (!isConnected()) {
+        useV5 = !refusedV5();
+    }
+#endif
     
-    while (!client.connected() && attempts < MAX_ATTEMPTS) {
+    while (!isConnected() && attempts < MAX_ATTEMPTS) {
         Serial.println("\nAttempting MQTT connection...");
-        // Attempt to connect using config values
-        if (client.connect(config->hub_id.c_str(), config->mqtt_username.c_str(), config->mqtt_password.c_str())) {
-            Serial.println("MQTT connection established.");
-            // Subscribe to your topics
-            client.subscribe("sensor/data");  // Replace with your actual topic
-            return true;
-        } else {
-            Serial.print("\nFailed, rc=");
-            Serial.print(client.state());
-            Serial.println(". Trying again...");
-            // Wait before retrying
-            vTaskDelay(2000 / portTICK_PERIOD_MS);
-            attempts++;
+        {
+            // Not held over the back-off below, so mqttTask isn't stalled
+            std::lock_guard<std::recursive_mutex> guard(lock);
+#if MQTT_V5
+            if (useV5) {
+                Mqtt5ConnectResult result = client5.connect(config->hub_id, config->mqtt_username,
+                                                            config->mqtt_password);
+                if (result == MQTT5_CONNECTED) {
+                    bool resumed = client5.sessionPresent();
+                    Serial.println(resumed ? "MQTT 5 connection established, session resumed."
+                                           : "MQTT 5 connection established.");
+                    // A resumed session kept its subscriptions
+                    if (!resumed || commandTopic[0] == '\0') {
+                        subscribeCommands();
+                    }
+                    return true;
+                }
+                if (result == MQTT5_CLOSED && ++v5Closed < 2) {
+                    // Could have been the network; once more before 3.1.1
+                    continue;
+                }
+                if (result == MQTT5_UNSUPPORTED || result == MQTT5_CLOSED) {
+                    // Straight on to 3.1.1, no attempt spent
+                    LOG_WARN(LOG_MQTT, "Broker turned MQTT 5 down, using 3.1.1");
+                    useV5 = false;
+                    snprintf(v5RefusedBy, sizeof(v5RefusedBy), "%s:%d", config->mqtt_server,
+                             config->mqtt_port);
+                    v5RefusedMs = millis();
+                    continue;
+                }
+                Serial.printf("\nFailed, MQTT 5 reason 0x%02x. Trying again...\n",
+                              (unsigned)client5.getStats().lastReason);
+            } else
+#endif
+            // Attempt to connect using config values
+            if (client.connect(config->hub_id, config->mqtt_username, config->mqtt_password)) {
+                Serial.println("MQTT connection established.");
+                // Subscribe to your topics
+                client.subscribe("sensor/data");  // Replace with your actual topic
+                subscribeCommands();
+                return true;
+            } else {
+                Serial.print("\nFailed, rc=");
+                Serial.print(client.state());
+                Serial.println(". Trying again...");
+            }
         }
+        // Wait before retrying
+        delay(2000);
+        attempts++;
     }
     
     if (attempts >= MAX_ATTEMPTS) {
         Serial.println("MQTT connection failed repeatedly. Consider reconfiguring.");
+#ifdef LED_BUILTIN
         // Indicate connection issue with LED
         digitalWrite(LED_BUILTIN, HIGH);  // Turn on built-in LED to indicate MQTT connection failure
-        vTaskDelay(2000 / portTICK_PERIOD_MS);
+        delay(2000);
         digitalWrite(LED_BUILTIN, LOW);   // Turn off LED after delay
+#endif
         return false;
     }
     
     return false;
 }
 
+#if MQTT_V5
+// This broker turned MQTT 5 down less than MQTT5_REPROBE_MS ago. After
+// that it is asked again, it may have been upgraded meanwhile.
+bool MQTTManager::refusedV5() {
+    if (v5RefusedBy[0] == '\0') {
+        return false;
+    }
+    char broker[sizeof(v5RefusedBy)];
+    snprintf(broker, sizeof(broker), "%s:%d", config->mqtt_server, config->mqtt_port);
+    if (strcmp(broker, v5RefusedBy) != 0 || millis() - v5RefusedMs >= MQTT5_REPROBE_MS) {
+        v5RefusedBy[0] = '\0';
+        return false;
+    }
+    return true;
+}
+#endif
+
 bool MQTTManager::publish(const char* topic, const char* payload) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+#if MQTT_V5
+    if (useV5) {
+        return client5.publish(topic, payload);
+    }
+#endif
     return client.publish(topic, payload);
 }
 
+bool MQTTManager::publish(const char* topic, const uint8_t* payload, size_t length) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+#if MQTT_V5
+    if (useV5) {
+        return client5.publish(topic, payload, length);
+    }
+#endif
+    return client.publish(topic, payload, length);
+}
+
 bool MQTTManager::isConnected() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+#if MQTT_V5
+    if (useV5) {
+        return client5.connected();
+    }
+#endif
     return client.connected();
 }
 
 void MQTTManager::loop() {
-    if (!client.connected()) {
+    if (!configured) {
+        // WiFi was down during boot, so begin() never ran
+        begin();
+    } else if (!isConnected()) {
         connect();
     }
-    client.loop();
-}
\ No newline at end of file
+    {
+        std::lock_guard<std::recursive_mutex> guard(lock);
+#if MQTT_V5
+        if (useV5) {
+            client5.loop();
+        } else
+#endif
+        client.loop();
+    }
+    runCommands();
+}
+
+// Oldest first. The slot stays taken while its command runs, so a command
+// arriving meanwhile can't overwrite it.
+void MQTTManager::runCommands() {
+    while (true) {
+        PendingCommand* next;
+        {
+            std::lock_guard<std::recursive_mutex> guard(lock);
+            if (commandCount == 0) {
+                return;
+            }
+            next = &pendingCommands[commandHead];
+        }
+        if (commandHandler != nullptr) {
+            commandHandler(next->name, next->payload, next->length);
+        }
+        std::lock_guard<std::recursive_mutex> guard(lock);
+        commandHead = (commandHead + 1) % MQTT_COMMAND_QUEUE;
+        commandCount--;
+    }
+}
+
+void MQTTManager::subscribeCommands() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    snprintf(commandTopic, sizeof(commandTopic), TOPIC_COMMAND "#", config->hub_id);
+#if MQTT_V5
+    if (useV5) {
+        client5.subscribe(commandTopic);
+        return;
+    }
+#endif
+    client.subscribe(commandTopic);
+}
+
+void MQTTManager::refreshSubscriptions() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if (!isConnected()) {
+        return;
+    }
+    if (commandTopic[0] != '\0') {
+#if MQTT_V5
+        if (useV5) {
+            client5.unsubscribe(commandTopic);
+        } else {
+            client.unsubscribe(commandTopic);
+        }
+#else
+        client.unsubscribe(commandTopic);
+#endif
+    }
+    subscribeCommands();
+}
+
+// Client callback, with the lock held: only copies the command out, see
+// runCommands()
+void MQTTManager::onMessage(char* topic, uint8_t* payload, unsigned int length) {
+    MQTTManager* self = callbackOwner;
+    if (self == nullptr || self->commandHandler == nullptr) {
+        return;
+    }
+    // Strip the wildcard off the subscription to get the command prefix
+    size_t prefixLength = strlen(self->commandTopic) - 1;
+    if (strncmp(topic, self->commandTopic, prefixLength) != 0) {
+        return;
+    }
+    // Both point into the client's buffer, which the reply would overwrite
+    char name[sizeof(PendingCommand::name)];
+    snprintf(name, sizeof(name), "%s", topic + prefixLength);
+    if (length > MQTT_COMMAND_BODY_MAX) {
+        LOG_WARN(LOG_MQTT, "MQTT command %s too large (%u bytes)", name, length);
+        self->reply(name, "{\"ok\":false,\"error\":\"too large\"}");
+        return;
+    }
+    if (self->commandCount == MQTT_COMMAND_QUEUE) {
+        LOG_WARN(LOG_MQTT, "MQTT command %s dropped, %u waiting", name, (unsigned)self->commandCount);
+        self->reply(name, "{\"ok\":false,\"error\":\"busy\"}");
+        return;
+    }
+    PendingCommand& slot = self->pendingCommands[(self->commandHead + self->commandCount) % MQTT_COMMAND_QUEUE];
+    memcpy(slot.name, name, sizeof(name));
+    memcpy(slot.payload, payload, length);
+    slot.length = length;
+    self->commandCount++;
+}
+
+bool MQTTManager::reply(const char* command, const char* payload) {
+    char topic[64];
+    snprintf(topic, sizeof(topic), TOPIC_REPLY "%s", config->hub_id, command);
+    std::lock_guard<std::recursive_mutex> guard(lock);
+#if MQTT_V5
+    if (useV5) {
+        // QoS 0 as on 3.1.1: replies go out from inside the message
+        // handler, where waiting for a PUBACK would read the next command
+        return client5.publish(topic, payload, 0);
+    }
+#endif
+    return client.publish(topic, payload);
+}
+
+size_t ReplyPrint::write(uint8_t byte) {
+    if (byte == '\n') {
+        // An empty line still goes out, so a blank report isn't mistaken for no answer
+        line[used] = '\0';
+        mqtt->reply(command, line);
+        sent++;
+        used = 0;
+        return 1;
+    }
+    if (byte == '\r') {
+        return 1;
+    }
+    if (used == MQTT_REPLY_LINE_MAX) {
+        line[used] = '\0';
+        mqtt->reply(command, line);
+        sent++;
+        used = 0;
+    }
+    line[used++] = (char)byte;
+    return 1;
+}
+
+void ReplyPrint::flush() {
+    if (used > 0) {
+        line[used] = '\0';
+        mqtt->reply(command, line);
+        sent++;
+        used = 0;
+    }
+}
+
+void MQTTManager::reconfigure() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+#if MQTT_V5
+    if (useV5) {
+        // Not coming back to this session, the broker can drop it now
+        client5.disconnect(true);
+    } else {
+        client.disconnect();
+    }
+    // The new broker may speak MQTT 5
+    useV5 = true;
+    v5RefusedBy[0] = '\0';
+#else
+    client.disconnect();
+#endif
+    configured = false;
+}
+
+size_t MQTTManager::formatStats(char* out, size_t len) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+#if MQTT_V5
+    if (useV5) {
+        return client5.formatStats(out, len);
+    }
+    uint32_t waitedMs = millis() - v5RefusedMs;
+    uint32_t leftMs = waitedMs < MQTT5_REPROBE_MS ? MQTT5_REPROBE_MS - waitedMs : 0;
+    int n = snprintf(out, len, "MQTT 3.1.1: %s, the broker turned MQTT 5 down; asked again on a reconnect "
+                     "after %lu min\n", client.connected() ? "connected" : "not connected",
+                     (unsigned long)(leftMs / 60000));
+#else
+    int n = snprintf(out, len, "MQTT 3.1.1: %s (MQTT_V5 off)\n",
+                     client.connected() ? "connected" : "not connected");
+#endif
+    if (n < 0) {
+        return 0;
+    }
+    return (size_t)n < len ? (size_t)n : len - 1;
+}
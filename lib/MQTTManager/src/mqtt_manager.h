@@ -1,21 +1,98 @@
 #pragma once
 
 #include <Arduino.h>
+#include <Client.h>
 #include <PubSubClient.h>
-#include <WiFi.h>
+#include <mutex>
 #include "config.h"
 
+#if MQTT_V5
+#include <atomic>
+#include "mqtt5_client.h"
+#endif
+
+// Receives messages on TOPIC_COMMAND + <command>, payload not terminated.
+// Called from loop() with the MQTT lock released.
+typedef void (*MQTTCommandHandler)(const char* command, const uint8_t* payload, size_t length);
+
 class MQTTManager {
 public:
-    MQTTManager(HubConfig* config);
+    // netClient is WiFiClient on the device, PosixTcpClient in the native env
+    MQTTManager(HubConfig* config, Client* netClient);
     bool begin();
     bool connect();
     bool publish(const char* topic, const char* payload);
+    bool publish(const char* topic, const uint8_t* payload, size_t length);
     bool isConnected();
     void loop();
+    void setCommandHandler(MQTTCommandHandler handler) { commandHandler = handler; }
+    // Publishes on TOPIC_REPLY + <command>
+    bool reply(const char* command, const char* payload);
+    // Broker or credentials changed: drop the session, loop() reconnects
+    void reconfigure();
+    // hub_id changed: move the command subscription, keep the session
+    void refreshSubscriptions();
+    // Protocol in use and, on MQTT 5, session, alias and flow-control figures
+    size_t formatStats(char* out, size_t len);
 
 private:
-    WiFiClient espClient;
+    Client* netClient;
     PubSubClient client;
     HubConfig* config;
-};
\ No newline at end of file
+    bool configured = false;
+    MQTTCommandHandler commandHandler = nullptr;
+    char commandTopic[64] = "";   // Currently subscribed TOPIC_COMMAND wildcard
+    // Held for every call into either client. mqttTask publishes while
+    // the loop task polls and reconnects, and both clients read and write
+    // the one socket. Recursive: commands reply from inside loop().
+    std::recursive_mutex lock;
+#if MQTT_V5
+    // Tried first on connect; a broker that turns it down gets PubSubClient
+    // (3.1.1) on every reconnect for MQTT5_REPROBE_MS, so each one doesn't
+    // cost the extra handshakes of being turned down again
+    Mqtt5Client client5;
+    std::atomic<bool> useV5{true};
+    char v5RefusedBy[sizeof(HubConfig::mqtt_server) + 16] = "";  // host:port, "" if none
+    uint32_t v5RefusedMs = 0;
+#endif
+
+    // Commands are copied here by the client callback, which runs with the
+    // lock held (from loop(), or from a publish reading acks), and run by
+    // loop() once it is released. A command that takes another lock, as
+    // commandLock in main.cpp, can then never wait on this one.
+    struct PendingCommand {
+        char name[24];
+        uint16_t length;
+        uint8_t payload[MQTT_COMMAND_BODY_MAX];
+    };
+    PendingCommand pendingCommands[MQTT_COMMAND_QUEUE];
+    uint8_t commandHead = 0;
+    uint8_t commandCount = 0;
+
+    static MQTTManager* callbackOwner;
+    static void onMessage(char* topic, uint8_t* payload, unsigned int length);
+    void subscribeCommands();
+    void runCommands();
+#if MQTT_V5
+    bool refusedV5();
+#endif
+};
+
+// Sends what a command prints as replies on TOPIC_REPLY + <command>, one
+// message per line (line end stripped). Longer lines are split at
+// MQTT_REPLY_LINE_MAX. flush() sends a last unfinished line.
+class ReplyPrint : public Print {
+public:
+    ReplyPrint(MQTTManager* mqtt, const char* command) : mqtt(mqtt), command(command) {}
+    ~ReplyPrint() { flush(); }
+    size_t write(uint8_t byte) override;
+    void flush() override;
+    uint16_t getSent() const { return sent; }
+
+private:
+    MQTTManager* mqtt;
+    const char* command;
+    char line[MQTT_REPLY_LINE_MAX + 1];
+    size_t used = 0;
+    uint16_t sent = 0;
+};
@@ -0,0 +1,6 @@
+#include "json_allocators.h"
+
+RegionJsonAllocator* psramJsonAllocator() {
+    static RegionJsonAllocator allocator(MEM_PSRAM);
+    return &allocator;
+}
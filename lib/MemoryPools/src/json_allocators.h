@@ -0,0 +1,33 @@
+#pragma once
+
+#include <ArduinoJson.h>
+#include "memory_pools.h"
+
+// Routes a JsonDocument's pools into a chosen memory region
+class RegionJsonAllocator : public ArduinoJson::Allocator {
+public:
+    explicit RegionJsonAllocator(MemoryRegion region) : region(region) {}
+    void* allocate(size_t size) override { return regionAlloc(size, region); }
+    void deallocate(void* ptr) override { regionFree(ptr); }
+    void* reallocate(void* ptr, size_t newSize) override { return regionRealloc(ptr, newSize, region); }
+
+private:
+    MemoryRegion region;
+};
+
+// Backs a JsonDocument with a BumpArena. Call doc.clear() before
+// arena.reset() so the document holds no pointers into reclaimed memory.
+class ArenaJsonAllocator : public ArduinoJson::Allocator {
+public:
+    explicit ArenaJsonAllocator(BumpArena* arena) : arena(arena) {}
+    void* allocate(size_t size) override { return arena->allocate(size); }
+    void deallocate(void* ptr) override { (void)ptr; }
+    void* reallocate(void* ptr, size_t newSize) override { return arena->reallocate(ptr, newSize); }
+
+private:
+    BumpArena* arena;
+};
+
+// Shared allocator for short-lived config/portal documents, kept in PSRAM
+// so they never punch holes in the internal heap.
+RegionJsonAllocator* psramJsonAllocator();
@@ -0,0 +1,282 @@
+#include "memory_pools.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <esp_heap_caps.h>
+#endif
+
+namespace {
+
+const uint8_t MAX_REGISTERED = 12;
+
+// Plain arrays so registration from global constructors is order-safe
+BlockPool* pools[MAX_REGISTERED];
+BumpArena* arenas[MAX_REGISTERED];
+uint8_t poolCount = 0;
+uint8_t arenaCount = 0;
+
+const size_t ARENA_ALIGN = sizeof(void*) > sizeof(double) ? sizeof(void*) : sizeof(double);
+const size_t ARENA_HEADER = ARENA_ALIGN;  // Holds the block size, keeps payload aligned
+
+size_t alignUp(size_t value) {
+    return (value + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+}  // namespace
+
+// ---------------------------------------------------------------------------
+// Region allocation
+// ---------------------------------------------------------------------------
+
+void* regionAlloc(size_t size, MemoryRegion region) {
+#ifdef ARDUINO
+    if (region == MEM_PSRAM) {
+        void* ptr = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (ptr) {
+            return ptr;
+        }
+    }
+    return heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+#else
+    (void)region;
+    return malloc(size);
+#endif
+}
+
+void* regionRealloc(void* ptr, size_t size, MemoryRegion region) {
+#ifdef ARDUINO
+    if (region == MEM_PSRAM) {
+        void* moved = heap_caps_realloc(ptr, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (moved) {
+            return moved;
+        }
+    }
+    return heap_caps_realloc(ptr, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+#else
+    (void)region;
+    return realloc(ptr, size);
+#endif
+}
+
+void regionFree(void* ptr) {
+#ifdef ARDUINO
+    heap_caps_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+bool regionIsPsram(const void* ptr) {
+#ifdef ARDUINO
+    return esp_ptr_external_ram(ptr);
+#else
+    (void)ptr;
+    return false;
+#endif
+}
+
+const char* regionName(MemoryRegion region) {
+    return region == MEM_PSRAM ? "psram" : "internal";
+}
+
+// ---------------------------------------------------------------------------
+// BlockPool
+// ---------------------------------------------------------------------------
+
+BlockPool::BlockPool(const char* name, size_t blockSize, uint16_t blockCount, MemoryRegion region) {
+    this->name = name;
+    // Keep every block aligned for any member type
+    this->blockSize = alignUp(blockSize);
+    this->blockCount = blockCount;
+    this->region = region;
+    storage = nullptr;
+    freeStack = nullptr;
+    freeTop = 0;
+    inUse = 0;
+    peak = 0;
+    failures = 0;
+
+    if (poolCount < MAX_REGISTERED) {
+        pools[poolCount++] = this;
+    }
+}
+
+BlockPool::~BlockPool() {
+    regionFree(storage);
+    regionFree(freeStack);
+}
+
+bool BlockPool::begin() {
+    if (storage) {
+        return true;
+    }
+    storage = (uint8_t*)regionAlloc(blockSize * blockCount, region);
+    // The index stack is touched on every acquire, keep it in internal RAM
+    freeStack = (uint16_t*)regionAlloc(sizeof(uint16_t) * blockCount, MEM_INTERNAL);
+    if (!storage || !freeStack) {
+        regionFree(storage);
+        regionFree(freeStack);
+        storage = nullptr;
+        freeStack = nullptr;
+        return false;
+    }
+    for (uint16_t i = 0; i < blockCount; i++) {
+        freeStack[i] = blockCount - 1 - i;
+    }
+    freeTop = blockCount;
+    return true;
+}
+
+void* BlockPool::acquire() {
+    guard.lock();
+    if (freeTop == 0) {
+        failures++;
+        guard.unlock();
+        return nullptr;
+    }
+    uint16_t index = freeStack[--freeTop];
+    inUse++;
+    if (inUse > peak) {
+        peak = inUse;
+    }
+    guard.unlock();
+    return storage + (size_t)index * blockSize;
+}
+
+void BlockPool::release(void* block) {
+    if (!owns(block)) {
+        return;
+    }
+    uint16_t index = ((uint8_t*)block - storage) / blockSize;
+    guard.lock();
+    freeStack[freeTop++] = index;
+    inUse--;
+    guard.unlock();
+}
+
+bool BlockPool::owns(const void* block) const {
+    const uint8_t* ptr = (const uint8_t*)block;
+    return storage && ptr >= storage && ptr < storage + blockSize * blockCount &&
+           (size_t)(ptr - storage) % blockSize == 0;
+}
+
+// ---------------------------------------------------------------------------
+// BumpArena
+// ---------------------------------------------------------------------------
+
+BumpArena::BumpArena(const char* name, size_t capacity, MemoryRegion region) {
+    this->name = name;
+    this->capacity = alignUp(capacity);
+    this->region = region;
+    storage = nullptr;
+    used = 0;
+    peak = 0;
+    lastOffset = SIZE_MAX;
+    failures = 0;
+
+    if (arenaCount < MAX_REGISTERED) {
+        arenas[arenaCount++] = this;
+    }
+}
+
+BumpArena::~BumpArena() {
+    regionFree(storage);
+}
+
+bool BumpArena::begin() {
+    if (!storage) {
+        storage = (uint8_t*)regionAlloc(capacity, region);
+    }
+    return storage != nullptr;
+}
+
+void* BumpArena::allocate(size_t size) {
+    size_t needed = ARENA_HEADER + alignUp(size);
+    if (!storage || needed > capacity - used) {
+        failures++;
+        return nullptr;
+    }
+    uint8_t* block = storage + used;
+    *(size_t*)block = size;
+    lastOffset = used;
+    used += needed;
+    if (used > peak) {
+        peak = used;
+    }
+    return block + ARENA_HEADER;
+}
+
+void* BumpArena::reallocate(void* ptr, size_t newSize) {
+    if (!ptr) {
+        return allocate(newSize);
+    }
+    uint8_t* header = (uint8_t*)ptr - ARENA_HEADER;
+    size_t oldSize = *(size_t*)header;
+
+    // The last block can simply grow or shrink in place
+    if ((size_t)(header - storage) == lastOffset) {
+        size_t end = lastOffset + ARENA_HEADER + alignUp(newSize);
+        if (end <= capacity) {
+            *(size_t*)header = newSize;
+            used = end;
+            if (used > peak) {
+                peak = used;
+            }
+            return ptr;
+        }
+        failures++;
+        return nullptr;
+    }
+
+    if (newSize <= oldSize) {
+        *(size_t*)header = newSize;
+        return ptr;
+    }
+    void* moved = allocate(newSize);
+    if (moved) {
+        memcpy(moved, ptr, oldSize);
+    }
+    return moved;
+}
+
+void BumpArena::reset() {
+    used = 0;
+    lastOffset = SIZE_MAX;
+}
+
+// ---------------------------------------------------------------------------
+// Stats
+// ---------------------------------------------------------------------------
+
+size_t formatMemoryStats(char* out, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    size_t pos = 0;
+    auto append = [&](int n) {
+        if (n > 0) pos += (size_t)n;
+        if (pos >= len) pos = len - 1;
+    };
+
+    append(snprintf(out, len, "%-12s %-8s %6s %5s %5s %5s %8s\n",
+                    "pool", "region", "block", "cap", "used", "peak", "failures"));
+    for (uint8_t i = 0; i < poolCount; i++) {
+        const BlockPool* p = pools[i];
+        append(snprintf(out + pos, len - pos, "%-12s %-8s %6u %5u %5u %5u %8u\n",
+                        p->getName(), p->inPsram() ? "psram" : "internal",
+                        (unsigned)p->getBlockSize(), p->getCapacity(), p->getInUse(),
+                        p->getPeak(), (unsigned)p->getFailures()));
+    }
+    append(snprintf(out + pos, len - pos, "%-12s %-8s %6s %5s %5s %5s %8s\n",
+                    "arena", "region", "size", "", "used", "peak", "failures"));
+    for (uint8_t i = 0; i < arenaCount; i++) {
+        const BumpArena* a = arenas[i];
+        append(snprintf(out + pos, len - pos, "%-12s %-8s %6u %5s %5u %5u %8u\n",
+                        a->getName(), a->inPsram() ? "psram" : "internal",
+                        (unsigned)a->getCapacity(), "", (unsigned)a->getUsed(),
+                        (unsigned)a->getPeak(), (unsigned)a->getFailures()));
+    }
+    return pos;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <new>
+
+#ifdef ARDUINO
+#include <freertos/FreeRTOS.h>
+#else
+#include <mutex>
+#endif
+
+// Where a pool's backing store lives. PSRAM is large but slower and not
+// DMA capable; internal RAM is scarce and is what fragments over weeks of
+// uptime, so long-lived buffers are carved out once at boot.
+enum MemoryRegion : uint8_t {
+    MEM_INTERNAL = 0,
+    MEM_PSRAM
+};
+
+// Falls back to internal RAM when PSRAM is missing or full
+void* regionAlloc(size_t size, MemoryRegion region);
+void* regionRealloc(void* ptr, size_t size, MemoryRegion region);
+void regionFree(void* ptr);
+bool regionIsPsram(const void* ptr);
+const char* regionName(MemoryRegion region);
+
+// Short critical section usable from both cores / host threads
+class PoolLock {
+public:
+#ifdef ARDUINO
+    void lock() { portENTER_CRITICAL(&mux); }
+    void unlock() { portEXIT_CRITICAL(&mux); }
+private:
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+#else
+    void lock() { mutex.lock(); }
+    void unlock() { mutex.unlock(); }
+private:
+    std::mutex mutex;
+#endif
+};
+
+// Fixed-size block pool. Backing store is allocated once in begin() so
+// construction is safe at static-init time; acquire/release are O(1) via a
+// free-index stack and never touch the heap.
+class BlockPool {
+public:
+    BlockPool(const char* name, size_t blockSize, uint16_t blockCount, MemoryRegion region);
+    ~BlockPool();
+    bool begin();
+    void* acquire();
+    void release(void* block);
+    bool owns(const void* block) const;
+
+    const char* getName() const { return name; }
+    size_t getBlockSize() const { return blockSize; }
+    uint16_t getCapacity() const { return blockCount; }
+    uint16_t getInUse() const { return inUse; }
+    uint16_t getPeak() const { return peak; }
+    uint32_t getFailures() const { return failures; }
+    bool inPsram() const { return storage && regionIsPsram(storage); }
+
+private:
+    const char* name;
+    size_t blockSize;
+    uint16_t blockCount;
+    MemoryRegion region;
+    uint8_t* storage;
+    uint16_t* freeStack;
+    uint16_t freeTop;
+    uint16_t inUse;
+    uint16_t peak;
+    uint32_t failures;
+    PoolLock guard;
+};
+
+template <typename T>
+class TypedPool : public BlockPool {
+public:
+    TypedPool(const char* name, uint16_t count, MemoryRegion region)
+        : BlockPool(name, sizeof(T), count, region) {}
+
+    T* acquire() {
+        void* block = BlockPool::acquire();
+        return block ? new (block) T() : nullptr;
+    }
+    void release(T* object) {
+        if (object) {
+            object->~T();
+            BlockPool::release(object);
+        }
+    }
+};
+
+// Bump allocator for per-batch scratch. Every allocation carries a small
+// size header so reallocate() can copy, which ArduinoJson needs. Freeing is
+// a no-op; reset() reclaims everything at the end of the batch.
+class BumpArena {
+public:
+    BumpArena(const char* name, size_t capacity, MemoryRegion region);
+    ~BumpArena();
+    bool begin();
+    void* allocate(size_t size);
+    void* reallocate(void* ptr, size_t newSize);
+    void reset();
+
+    const char* getName() const { return name; }
+    size_t getCapacity() const { return capacity; }
+    size_t getUsed() const { return used; }
+    size_t getPeak() const { return peak; }
+    uint32_t getFailures() const { return failures; }
+    bool inPsram() const { return storage && regionIsPsram(storage); }
+
+private:
+    const char* name;
+    size_t capacity;
+    MemoryRegion region;
+    uint8_t* storage;
+    size_t used;
+    size_t peak;
+    size_t lastOffset;  // Offset of the most recent block, grown in place
+    uint32_t failures;
+};
+
+// Occupancy and failure counters of every pool and arena, one per line
+size_t formatMemoryStats(char* out, size_t len);
@@ -0,0 +1,723 @@
+#include "mqtt5_client.h"
+#include "event_log.h"
+
+namespace {
+
+// Room in front of a packet body for the fixed header: the type and up to
+// four length bytes
+const size_t HEADER_MAX = 5;
+
+// Property identifiers we send or look at (MQTT 5.0, 2.2.2.2)
+enum : uint8_t {
+    PROP_MESSAGE_EXPIRY = 0x02,
+    PROP_SESSION_EXPIRY = 0x11,
+    PROP_SERVER_KEEP_ALIVE = 0x13,
+    PROP_RECEIVE_MAX = 0x21,
+    PROP_TOPIC_ALIAS_MAX = 0x22,
+    PROP_TOPIC_ALIAS = 0x23,
+    PROP_MAX_QOS = 0x24,
+    PROP_MAX_PACKET_SIZE = 0x27
+};
+
+// Appends big-endian fields to a fixed buffer; ok turns false once
+// something didn't fit
+struct PacketWriter {
+    uint8_t* data;
+    size_t size;
+    size_t pos;
+    bool ok;
+
+    PacketWriter(uint8_t* data, size_t size) : data(data), size(size), pos(0), ok(true) {}
+
+    void byte(uint8_t value) {
+        if (pos < size) {
+            data[pos++] = value;
+        } else {
+            ok = false;
+        }
+    }
+    void u16(uint16_t value) {
+        byte(value >> 8);
+        byte(value & 0xFF);
+    }
+    void u32(uint32_t value) {
+        u16(value >> 16);
+        u16(value & 0xFFFF);
+    }
+    void varInt(uint32_t value) {
+        do {
+            uint8_t low = value & 0x7F;
+            value >>= 7;
+            byte(value ? low | 0x80 : low);
+        } while (value);
+    }
+    void bytes(const void* src, size_t count) {
+        if (count > size - pos) {
+            ok = false;
+            return;
+        }
+        memcpy(data + pos, src, count);
+        pos += count;
+    }
+    void string(const char* text, size_t length) {
+        u16(length);
+        bytes(text, length);
+    }
+};
+
+uint16_t readU16(const uint8_t* data) {
+    return (uint16_t)(data[0] << 8 | data[1]);
+}
+
+// A Variable Byte Integer at data[pos], pos moved past it
+bool readVarInt(const uint8_t* data, size_t length, size_t& pos, uint32_t& value) {
+    value = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+        if (pos >= length) {
+            return false;
+        }
+        uint8_t byte = data[pos++];
+        value |= (uint32_t)(byte & 0x7F) << (7 * i);
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Size of a property's value: 1, 2 or 4 for integers, 0 for a variable byte
+// integer, -1 for length-prefixed data, -2 for a string pair, -3 unknown
+int propertyWidth(uint8_t id) {
+    switch (id) {
+        case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+            return 1;
+        case 0x13: case 0x21: case 0x22: case 0x23:
+            return 2;
+        case 0x02: case 0x11: case 0x18: case 0x27:
+            return 4;
+        case 0x0B:
+            return 0;
+        case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+            return -1;
+        case 0x26:
+            return -2;
+        default:
+            return -3;
+    }
+}
+
+// Calls fn(id, value) for every integer property in data[0..length) and
+// skips the rest. False if malformed.
+template <typename Fn>
+bool readProperties(const uint8_t* data, size_t length, Fn&& fn) {
+    size_t pos = 0;
+    while (pos < length) {
+        uint8_t id = data[pos++];
+        int width = propertyWidth(id);
+        uint32_t value = 0;
+        if (width > 0) {
+            if (length - pos < (size_t)width) {
+                return false;
+            }
+            for (int i = 0; i < width; i++) {
+                value = value << 8 | data[pos++];
+            }
+            fn(id, value);
+        } else if (width == 0) {
+            if (!readVarInt(data, length, pos, value)) {
+                return false;
+            }
+            fn(id, value);
+        } else if (width >= -2) {
+            for (int field = 0; field < -width; field++) {
+                if (length - pos < 2 || length - pos - 2 < readU16(data + pos)) {
+                    return false;
+                }
+                pos += 2 + readU16(data + pos);
+            }
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+Mqtt5Client::Mqtt5Client() {
+    client = nullptr;
+    handler = nullptr;
+    host = nullptr;
+    port = 1883;
+    up = false;
+    present = false;
+    pingOutstanding = false;
+    keepAlive = MQTT5_KEEPALIVE;
+    lastOutMs = 0;
+    lastInMs = 0;
+    maxQos = 1;
+    maxPacket = 0;
+    packetId = 0;
+    window = MQTT5_INFLIGHT_MAX;
+    inFlightCount = 0;
+    aliasCount = 0;
+    aliasLimit = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+void Mqtt5Client::setServer(const char* host, uint16_t port) {
+    this->host = host;
+    this->port = port;
+}
+
+Mqtt5ConnectResult Mqtt5Client::connect(const char* id, const char* user, const char* pass) {
+    if (connected()) {
+        return MQTT5_CONNECTED;
+    }
+    if (!client->connect(host, port)) {
+        return MQTT5_NETWORK;
+    }
+
+    bool hasUser = user != nullptr && user[0] != '\0';
+    bool hasPass = pass != nullptr && pass[0] != '\0';
+    uint8_t props[16];
+    PacketWriter properties(props, sizeof(props));
+    properties.byte(PROP_SESSION_EXPIRY);
+    properties.u32(MQTT5_SESSION_EXPIRY);
+    properties.byte(PROP_RECEIVE_MAX);
+    properties.u16(MQTT5_RECEIVE_MAX);
+    properties.byte(PROP_MAX_PACKET_SIZE);
+    properties.u32(MQTT5_PACKET_SIZE);
+
+    PacketWriter body(buffer + HEADER_MAX, sizeof(buffer) - HEADER_MAX);
+    body.string("MQTT", 4);
+    body.byte(5);
+    body.byte((hasUser ? 0x80 : 0) | (hasPass ? 0x40 : 0));   // Clean Start off
+    body.u16(MQTT5_KEEPALIVE);
+    body.varInt(properties.pos);
+    body.bytes(props, properties.pos);
+    body.string(id, strlen(id));
+    if (hasUser) {
+        body.string(user, strlen(user));
+    }
+    if (hasPass) {
+        body.string(pass, strlen(pass));
+    }
+    if (!body.ok || !sendPacket(0x10, body.pos)) {
+        client->stop();
+        return MQTT5_NETWORK;
+    }
+
+    uint32_t start = millis();
+    while (client->available() <= 0) {
+        if (!client->connected()) {
+            // What some 3.1.1 brokers do with protocol level 5, but a
+            // dropped link looks the same
+            client->stop();
+            return MQTT5_CLOSED;
+        }
+        if (millis() - start > MQTT5_SOCKET_TIMEOUT) {
+            client->stop();
+            return MQTT5_NETWORK;
+        }
+        delay(1);
+    }
+    uint8_t header;
+    size_t length;
+    if (!readPacket(header, length) || (header & 0xF0) != 0x20 || length < 2) {
+        client->stop();
+        return MQTT5_NETWORK;
+    }
+    uint8_t reason = buffer[1];
+    stats.lastReason = reason;
+    // 0x01 is a 3.1.1 broker's "unacceptable protocol version"
+    if (reason == 0x01 || reason == 0x84) {
+        client->stop();
+        return MQTT5_UNSUPPORTED;
+    }
+    if (reason != 0) {
+        client->stop();
+        return MQTT5_REFUSED;
+    }
+
+    present = buffer[0] & 0x01;
+    keepAlive = MQTT5_KEEPALIVE;
+    maxQos = 1;
+    maxPacket = 0;
+    stats.serverReceiveMax = 65535;
+    stats.serverAliasMax = 0;
+    size_t pos = 2;
+    uint32_t propLength = 0;
+    if (length > 2) {
+        bool valid = readVarInt(buffer, length, pos, propLength) && propLength <= length - pos &&
+                     readProperties(buffer + pos, propLength, [this](uint8_t id, uint32_t value) {
+                         switch (id) {
+                             case PROP_SERVER_KEEP_ALIVE: keepAlive = value; break;
+                             case PROP_RECEIVE_MAX: stats.serverReceiveMax = value; break;
+                             case PROP_TOPIC_ALIAS_MAX: stats.serverAliasMax = value; break;
+                             case PROP_MAX_QOS: maxQos = value; break;
+                             case PROP_MAX_PACKET_SIZE: maxPacket = value; break;
+                             default: break;
+                         }
+                     });
+        if (!valid) {
+            client->stop();
+            return MQTT5_NETWORK;
+        }
+    }
+    window = stats.serverReceiveMax < MQTT5_INFLIGHT_MAX ? stats.serverReceiveMax : MQTT5_INFLIGHT_MAX;
+    aliasLimit = stats.serverAliasMax < MQTT5_TOPIC_ALIASES ? stats.serverAliasMax : MQTT5_TOPIC_ALIASES;
+    aliasCount = 0;             // Aliases last one connection
+    up = true;
+    pingOutstanding = false;
+    lastInMs = lastOutMs = millis();
+    stats.connects++;
+    if (present) {
+        stats.sessionsResumed++;
+    }
+    resendPending();
+    return MQTT5_CONNECTED;
+}
+
+bool Mqtt5Client::publish(const char* topic, const char* payload, uint8_t qos, uint32_t expiry) {
+    return publish(topic, (const uint8_t*)payload, strlen(payload), qos, expiry);
+}
+
+bool Mqtt5Client::publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, uint32_t expiry) {
+    if (!connected()) {
+        return false;
+    }
+    size_t topicLength = strlen(topic);
+    if (qos > maxQos) {
+        qos = maxQos;
+    }
+    if (qos > 0) {
+        // Kept until acked, for a resend after a reconnect
+        if (topicLength >= MQTT5_TOPIC_SIZE || length > MQTT_MAX_PACKET_SIZE || !waitForWindow()) {
+            return false;
+        }
+    }
+    uint16_t id = qos > 0 ? nextId() : 0;
+    if (!sendPublish(topic, payload, length, qos, id, expiry, false, true)) {
+        return false;
+    }
+    stats.publishes++;
+    if (qos > 0) {
+        Pending& held = pending[inFlightCount++];
+        held.id = id;
+        held.length = length;
+        held.sentMs = millis();
+        held.expiry = expiry;
+        memcpy(held.topic, topic, topicLength + 1);
+        memcpy(held.payload, payload, length);
+    }
+    return true;
+}
+
+bool Mqtt5Client::sendPublish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos,
+                              uint16_t id, uint32_t expiry, bool dup, bool useAlias) {
+    size_t topicLength = strlen(topic);
+    bool known = false;
+    uint16_t alias = useAlias ? aliasFor(topic, topicLength, known) : 0;
+    uint8_t props[8];
+    PacketWriter properties(props, sizeof(props));
+    if (expiry > 0) {
+        properties.byte(PROP_MESSAGE_EXPIRY);
+        properties.u32(expiry);
+    }
+    if (alias > 0) {
+        properties.byte(PROP_TOPIC_ALIAS);
+        properties.u16(alias);
+    }
+
+    PacketWriter body(buffer + HEADER_MAX, sizeof(buffer) - HEADER_MAX);
+    body.string(topic, known ? 0 : topicLength);
+    if (qos > 0) {
+        body.u16(id);
+    }
+    body.varInt(properties.pos);
+    body.bytes(props, properties.pos);
+    body.bytes(payload, length);
+    if (!body.ok || (maxPacket > 0 && HEADER_MAX + body.pos > maxPacket)) {
+        return false;
+    }
+    if (!sendPacket(0x30 | qos << 1 | (dup ? 0x08 : 0), body.pos)) {
+        return false;
+    }
+    if (known) {
+        stats.aliased++;
+        stats.topicBytesSaved += topicLength;
+    } else if (alias > 0) {
+        // The broker knows it now
+        memcpy(aliases[aliasCount++], topic, topicLength + 1);
+    }
+    return true;
+}
+
+// The alias for topic: known if the broker already has it, else the next
+// free one (taken only once the publish went out), 0 when none is left
+uint16_t Mqtt5Client::aliasFor(const char* topic, size_t length, bool& known) {
+    for (uint8_t i = 0; i < aliasCount; i++) {
+        if (strcmp(aliases[i], topic) == 0) {
+            known = true;
+            return i + 1;
+        }
+    }
+    known = false;
+    if (aliasCount < aliasLimit && length < MQTT5_TOPIC_SIZE) {
+        return aliasCount + 1;
+    }
+    return 0;
+}
+
+uint16_t Mqtt5Client::nextId() {
+    while (true) {
+        if (++packetId == 0) {
+            packetId = 1;
+        }
+        bool used = false;
+        for (uint8_t i = 0; i < inFlightCount; i++) {
+            used |= pending[i].id == packetId;
+        }
+        if (!used) {
+            return packetId;
+        }
+    }
+}
+
+// Every slot taken: read PUBACKs for a while
+bool Mqtt5Client::waitForWindow() {
+    if (inFlightCount < window) {
+        return true;
+    }
+    stats.windowWaits++;
+    uint32_t start = millis();
+    while (inFlightCount >= window && up && millis() - start < MQTT5_WINDOW_WAIT_MS) {
+        if (client->available() <= 0) {
+            if (!connected()) {
+                return false;
+            }
+            delay(1);
+            continue;
+        }
+        uint8_t header;
+        size_t length;
+        if (!readPacket(header, length)) {
+            close();
+            return false;
+        }
+        handlePacket(header, length);
+    }
+    if (inFlightCount >= window) {
+        stats.windowDrops++;
+        return false;
+    }
+    return up;
+}
+
+// After a reconnect: the unacked publishes that haven't expired go out
+// again, with their topic in full since aliases start over. Without the
+// session the broker knows none of their packet ids, so they go out as new
+// publishes under new ones.
+void Mqtt5Client::resendPending() {
+    uint32_t now = millis();
+    uint8_t kept = 0;
+    bool broken = false;
+    for (uint8_t i = 0; i < inFlightCount; i++) {
+        Pending& held = pending[i];
+        uint32_t age = (now - held.sentMs) / 1000;
+        if (held.expiry > 0 && age >= held.expiry) {
+            stats.expired++;
+            continue;
+        }
+        if (!broken) {
+            if (kept >= window) {
+                stats.windowDrops++;    // The broker takes fewer at once now
+                continue;
+            }
+            uint32_t expiry = held.expiry > 0 ? held.expiry - age : 0;
+            uint16_t id = present ? held.id : nextId();
+            if (sendPublish(held.topic, held.payload, held.length, 1, id, expiry, present, false)) {
+                held.id = id;
+                held.expiry = expiry;
+                held.sentMs = now;
+                stats.resent++;
+            } else {
+                broken = true;          // Keep the rest for the next connect
+            }
+        }
+        if (kept != i) {
+            pending[kept] = held;
+        }
+        kept++;
+    }
+    inFlightCount = kept;
+}
+
+bool Mqtt5Client::subscribe(const char* filter, uint8_t qos) {
+    if (!connected()) {
+        return false;
+    }
+    PacketWriter body(buffer + HEADER_MAX, sizeof(buffer) - HEADER_MAX);
+    body.u16(nextId());
+    body.varInt(0);
+    body.string(filter, strlen(filter));
+    body.byte(qos);
+    return body.ok && sendPacket(0x82, body.pos);
+}
+
+bool Mqtt5Client::unsubscribe(const char* filter) {
+    if (!connected()) {
+        return false;
+    }
+    PacketWriter body(buffer + HEADER_MAX, sizeof(buffer) - HEADER_MAX);
+    body.u16(nextId());
+    body.varInt(0);
+    body.string(filter, strlen(filter));
+    return body.ok && sendPacket(0xA2, body.pos);
+}
+
+bool Mqtt5Client::loop() {
+    if (!connected()) {
+        return false;
+    }
+    uint32_t now = millis();
+    uint32_t keepAliveMs = keepAlive * 1000UL;
+    if (keepAliveMs > 0 && (now - lastInMs > keepAliveMs || now - lastOutMs > keepAliveMs)) {
+        if (pingOutstanding) {
+            close();            // No PINGRESP for a whole keep-alive period
+            return false;
+        }
+        if (!sendPacket(0xC0, 0)) {
+            close();
+            return false;
+        }
+        lastInMs = now;
+        pingOutstanding = true;
+    }
+    // A few packets per call, so a burst of commands can't hold up the caller
+    for (uint8_t i = 0; i < 4 && up && client->available() > 0; i++) {
+        uint8_t header;
+        size_t length;
+        if (!readPacket(header, length)) {
+            close();
+            return false;
+        }
+        handlePacket(header, length);
+    }
+    return up;
+}
+
+bool Mqtt5Client::connected() {
+    if (up && !client->connected()) {
+        close();
+    }
+    return up;
+}
+
+void Mqtt5Client::disconnect(bool endSession) {
+    if (up) {
+        PacketWriter body(buffer + HEADER_MAX, sizeof(buffer) - HEADER_MAX);
+        body.byte(0x00);        // Normal disconnection
+        if (endSession) {
+            body.varInt(5);
+            body.byte(PROP_SESSION_EXPIRY);
+            body.u32(0);
+        } else {
+            body.varInt(0);
+        }
+        sendPacket(0xE0, body.pos);
+    }
+    close();
+    if (endSession) {
+        inFlightCount = 0;
+        present = false;
+    }
+}
+
+void Mqtt5Client::close() {
+    up = false;
+    client->stop();
+}
+
+bool Mqtt5Client::sendPacket(uint8_t header, size_t bodyLength) {
+    uint8_t lengthBytes[4];
+    uint8_t count = 0;
+    size_t remaining = bodyLength;
+    do {
+        uint8_t low = remaining & 0x7F;
+        remaining >>= 7;
+        lengthBytes[count++] = remaining ? low | 0x80 : low;
+    } while (remaining);
+    // The body is already at HEADER_MAX; the fixed header goes right before it
+    size_t start = HEADER_MAX - 1 - count;
+    buffer[start] = header;
+    memcpy(buffer + start + 1, lengthBytes, count);
+    size_t total = 1 + count + bodyLength;
+    size_t written = client->write(buffer + start, total);
+    stats.bytesOut += written;
+    lastOutMs = millis();
+    return written == total;
+}
+
+// count bytes into out, or skipped when out is null
+bool Mqtt5Client::readBytes(uint8_t* out, size_t count) {
+    uint32_t start = millis();
+    size_t got = 0;
+    while (got < count) {
+        int available = client->available();
+        if (available > 0) {
+            uint8_t scratch[32];
+            size_t want = count - got;
+            if ((size_t)available < want) {
+                want = available;
+            }
+            if (out == nullptr && want > sizeof(scratch)) {
+                want = sizeof(scratch);
+            }
+            int n = client->read(out ? out + got : scratch, want);
+            if (n > 0) {
+                got += n;
+                stats.bytesIn += n;
+                continue;
+            }
+        }
+        if (!client->connected() || millis() - start > MQTT5_SOCKET_TIMEOUT) {
+            return false;
+        }
+        delay(1);
+    }
+    return true;
+}
+
+// One whole packet into buffer. Larger ones than we told the broker we
+// take are skipped and come back with header 0.
+bool Mqtt5Client::readPacket(uint8_t& header, size_t& length) {
+    if (!readBytes(&header, 1)) {
+        return false;
+    }
+    length = 0;
+    for (uint8_t i = 0;; i++) {
+        uint8_t byte;
+        if (i == 4 || !readBytes(&byte, 1)) {
+            return false;
+        }
+        length |= (size_t)(byte & 0x7F) << (7 * i);
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    lastInMs = millis();
+    if (length > sizeof(buffer)) {
+        header = 0;
+        return readBytes(nullptr, length);
+    }
+    return readBytes(buffer, length);
+}
+
+void Mqtt5Client::handlePacket(uint8_t header, size_t length) {
+    switch (header & 0xF0) {
+        case 0x30:
+            handlePublish(header, length);
+            break;
+        case 0x40: {            // PUBACK: packet ID, reason code if not success
+            if (length < 2) {
+                break;
+            }
+            uint16_t id = readU16(buffer);
+            if (length > 2 && buffer[2] >= 0x80) {
+                stats.rejected++;
+            }
+            for (uint8_t i = 0; i < inFlightCount; i++) {
+                if (pending[i].id == id) {
+                    for (uint8_t j = i + 1; j < inFlightCount; j++) {
+                        pending[j - 1] = pending[j];
+                    }
+                    inFlightCount--;
+                    break;
+                }
+            }
+            break;
+        }
+        case 0x90: {            // SUBACK: packet ID, properties, a reason code per filter
+            size_t pos = 2;
+            uint32_t propLength;
+            if (length < 3 || !readVarInt(buffer, length, pos, propLength) || propLength > length - pos) {
+                break;
+            }
+            for (pos += propLength; pos < length; pos++) {
+                if (buffer[pos] >= 0x80) {
+                    stats.rejected++;
+                }
+            }
+            break;
+        }
+        case 0xD0:              // PINGRESP
+            pingOutstanding = false;
+            break;
+        case 0xE0:              // DISCONNECT from the broker
+            stats.lastReason = length > 0 ? buffer[0] : 0;
+            LOG_WARN(LOG_MQTT, "MQTT 5 broker disconnected, reason 0x%02x", (unsigned)stats.lastReason);
+            close();
+            break;
+        default:                // UNSUBACK, AUTH, QoS 2 flows: nothing to do
+            break;
+    }
+}
+
+void Mqtt5Client::handlePublish(uint8_t header, size_t length) {
+    uint8_t qos = (header >> 1) & 0x03;
+    if (length < 2) {
+        return;
+    }
+    size_t topicLength = readU16(buffer);
+    size_t pos = 2 + topicLength;
+    uint16_t id = 0;
+    if (qos > 0) {
+        if (pos + 2 > length) {
+            return;
+        }
+        id = readU16(buffer + pos);
+        pos += 2;
+    }
+    uint32_t propLength;
+    if (pos > length || !readVarInt(buffer, length, pos, propLength) || propLength > length - pos) {
+        return;
+    }
+    pos += propLength;
+    // The broker may not alias (no Topic Alias Maximum in our CONNECT), so
+    // the topic is always there. The byte after it (packet ID or property
+    // length) has been read and makes room for the terminator.
+    if (topicLength > 0 && handler != nullptr) {
+        buffer[2 + topicLength] = '\0';
+        handler((char*)buffer + 2, buffer + pos, length - pos);
+    }
+    if (qos == 1) {
+        // The handler may have published, the ID was kept aside
+        PacketWriter body(buffer + HEADER_MAX, sizeof(buffer) - HEADER_MAX);
+        body.u16(id);
+        sendPacket(0x40, body.pos);
+    }
+}
+
+size_t Mqtt5Client::formatStats(char* out, size_t len) const {
+    int n = snprintf(out, len,
+                     "MQTT 5: %s, session resumed on %lu of %lu connects, expiry %u s\n"
+                     "Publishes: %lu, %lu by topic alias (%u of %u aliases, %lu topic bytes saved)\n"
+                     "QoS 1: %u of %u in flight (broker allows %u), %lu waits, %lu dropped, "
+                     "%lu rejected, %lu resent, %lu expired\n"
+                     "Wire: %lu bytes out, %lu in, last reason 0x%02x\n",
+                     up ? "connected" : "not connected",
+                     (unsigned long)stats.sessionsResumed, (unsigned long)stats.connects,
+                     (unsigned)MQTT5_SESSION_EXPIRY,
+                     (unsigned long)stats.publishes, (unsigned long)stats.aliased,
+                     (unsigned)aliasCount, (unsigned)aliasLimit, (unsigned long)stats.topicBytesSaved,
+                     (unsigned)inFlightCount, (unsigned)window, (unsigned)stats.serverReceiveMax,
+                     (unsigned long)stats.windowWaits, (unsigned long)stats.windowDrops,
+                     (unsigned long)stats.rejected, (unsigned long)stats.resent, (unsigned long)stats.expired,
+                     (unsigned long)stats.bytesOut, (unsigned long)stats.bytesIn, (unsigned)stats.lastReason);
+    if (n < 0) {
+        return 0;
+    }
+    return (size_t)n < len ? (size_t)n : len - 1;
+}
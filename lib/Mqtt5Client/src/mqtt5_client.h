@@ -0,0 +1,122 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Client.h>
+#include "config.h"
+
+// PubSubClient's callback shape, so MQTTManager hands both the same one.
+// topic is terminated; both point into the client's buffer.
+typedef void (*Mqtt5MessageHandler)(char* topic, uint8_t* payload, unsigned int length);
+
+enum Mqtt5ConnectResult : uint8_t {
+    MQTT5_CONNECTED,
+    MQTT5_UNSUPPORTED,          // CONNACK said the broker doesn't speak MQTT 5, use 3.1.1
+    MQTT5_CLOSED,               // Hung up before a CONNACK: maybe a 3.1.1 broker, maybe the network
+    MQTT5_REFUSED,              // CONNACK with an error, see getStats().lastReason
+    MQTT5_NETWORK               // No connection, or no answer
+};
+
+struct Mqtt5Stats {
+    uint32_t connects;
+    uint32_t sessionsResumed;   // CONNACK said the broker still had our session
+    uint32_t publishes;
+    uint32_t aliased;           // Sent with the topic alias alone
+    uint32_t topicBytesSaved;
+    uint32_t windowWaits;       // Publishes that found every Receive Maximum slot taken
+    uint32_t windowDrops;       // ... and none freed within MQTT5_WINDOW_WAIT_MS
+    uint32_t rejected;          // PUBACK or SUBACK with an error reason
+    uint32_t resent;            // Unacked publishes sent again after a reconnect
+    uint32_t expired;           // Unacked publishes past their expiry by then, not resent
+    uint32_t bytesOut;
+    uint32_t bytesIn;
+    uint16_t serverReceiveMax;
+    uint16_t serverAliasMax;
+    uint8_t lastReason;         // Of the last CONNACK or DISCONNECT
+};
+
+// Just enough MQTT 5 for the hub, over any Client: CONNECT with a session
+// that outlives the connection, PUBLISH at QoS 0/1 with topic aliases and
+// message expiry, SUBSCRIBE, keep-alive.
+//
+// Topic aliases are assigned the first time a topic is published on a
+// connection and used instead of the topic from then on; once the table is
+// full, new topics go out in full. QoS 1 publishes are held until their
+// PUBACK, at most min(MQTT5_INFLIGHT_MAX, the broker's Receive Maximum) at
+// a time, and sent again after a reconnect unless they expired meanwhile:
+// as a duplicate when the broker kept the session, as a new publish with a
+// new packet id when it didn't.
+class Mqtt5Client {
+public:
+    Mqtt5Client();
+    void setClient(Client* client) { this->client = client; }
+    void setServer(const char* host, uint16_t port);
+    void setCallback(Mqtt5MessageHandler handler) { this->handler = handler; }
+
+    // Never a clean start: the broker keeps the session MQTT5_SESSION_EXPIRY
+    // seconds after a drop
+    Mqtt5ConnectResult connect(const char* id, const char* user, const char* pass);
+    // The last CONNACK found our session, subscriptions included
+    bool sessionPresent() const { return present; }
+    // False if not connected, too large, or no slot freed up for a QoS 1 one
+    bool publish(const char* topic, const char* payload, uint8_t qos = MQTT5_PUBLISH_QOS,
+                 uint32_t expiry = MQTT5_MESSAGE_EXPIRY);
+    bool publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos = MQTT5_PUBLISH_QOS,
+                 uint32_t expiry = MQTT5_MESSAGE_EXPIRY);
+    bool subscribe(const char* filter, uint8_t qos = 1);
+    bool unsubscribe(const char* filter);
+    // Reads what has arrived and keeps the connection alive. False when down.
+    bool loop();
+    bool connected();
+    // endSession: the broker drops the session now instead of keeping it
+    void disconnect(bool endSession = false);
+
+    uint8_t inFlight() const { return inFlightCount; }
+    const Mqtt5Stats& getStats() const { return stats; }
+    size_t formatStats(char* out, size_t len) const;
+
+private:
+    // A QoS 1 publish waiting for its PUBACK
+    struct Pending {
+        uint16_t id;
+        uint16_t length;
+        uint32_t sentMs;
+        uint32_t expiry;
+        char topic[MQTT5_TOPIC_SIZE];
+        uint8_t payload[MQTT_MAX_PACKET_SIZE];
+    };
+
+    Client* client;
+    Mqtt5MessageHandler handler;
+    const char* host;
+    uint16_t port;
+    uint8_t buffer[MQTT5_PACKET_SIZE];
+    bool up;
+    bool present;
+    bool pingOutstanding;
+    uint16_t keepAlive;         // s, ours or the broker's
+    uint32_t lastOutMs;
+    uint32_t lastInMs;
+    uint8_t maxQos;
+    uint32_t maxPacket;         // The broker's Maximum Packet Size, 0 if none
+    uint16_t packetId;
+    uint8_t window;             // QoS 1 publishes allowed in flight
+    Pending pending[MQTT5_INFLIGHT_MAX];
+    uint8_t inFlightCount;
+    char aliases[MQTT5_TOPIC_ALIASES][MQTT5_TOPIC_SIZE];   // Alias n is aliases[n - 1]
+    uint8_t aliasCount;
+    uint8_t aliasLimit;
+    Mqtt5Stats stats;
+
+    bool sendPacket(uint8_t header, size_t bodyLength);
+    bool sendPublish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, uint16_t id,
+                     uint32_t expiry, bool dup, bool useAlias);
+    bool readPacket(uint8_t& header, size_t& length);
+    bool readBytes(uint8_t* out, size_t count);
+    void handlePacket(uint8_t header, size_t length);
+    void handlePublish(uint8_t header, size_t length);
+    bool waitForWindow();
+    void resendPending();
+    uint16_t aliasFor(const char* topic, size_t length, bool& known);
+    uint16_t nextId();
+    void close();
+};
@@ -0,0 +1,729 @@
+#include "mqtt_broker.h"
+#include "event_log.h"
+#include <stdio.h>
+#include <string.h>
+
+static_assert(BROKER_CLIENTS <= HAL_SERVER_SLOTS, "the server hands out fewer connections than BROKER_CLIENTS");
+static_assert(BROKER_WILL_SIZE <= UINT16_MAX && BROKER_PACKET_SIZE <= UINT16_MAX, "lengths are uint16_t");
+
+namespace {
+
+// Big-endian fields of a packet body; ok turns false at the first read past
+// the end
+struct Reader {
+    const uint8_t* p;
+    size_t left;
+    bool ok;
+
+    Reader(const uint8_t* body, size_t length) : p(body), left(length), ok(true) {}
+
+    uint8_t byte() {
+        if (left < 1) {
+            ok = false;
+            return 0;
+        }
+        left--;
+        return *p++;
+    }
+
+    uint16_t u16() {
+        uint16_t high = byte();
+        return high << 8 | byte();
+    }
+
+    // A length-prefixed string or binary field
+    const uint8_t* field(uint16_t& length) {
+        length = u16();
+        if (!ok || left < length) {
+            ok = false;
+            return nullptr;
+        }
+        const uint8_t* start = p;
+        p += length;
+        left -= length;
+        return start;
+    }
+};
+
+// A packet string into a terminated one; false if it doesn't fit or holds
+// a NUL, which MQTT strings may not
+bool copyString(char* out, size_t size, const uint8_t* text, size_t length) {
+    if (length >= size || memchr(text, '\0', length) != nullptr) {
+        return false;
+    }
+    memcpy(out, text, length);
+    out[length] = '\0';
+    return true;
+}
+
+// Fixed header: its length, 0 if remaining is beyond what we send
+size_t putHeader(uint8_t* out, uint8_t header, size_t remaining) {
+    if (remaining > BROKER_PACKET_SIZE) {
+        return 0;
+    }
+    size_t n = 0;
+    out[n++] = header;
+    do {
+        uint8_t byte = remaining & 0x7F;
+        remaining >>= 7;
+        out[n++] = remaining ? byte | 0x80 : byte;
+    } while (remaining);
+    return n;
+}
+
+}  // namespace
+
+MqttBroker::MqttBroker(HalTcpServer* server) : server(server), port(0), bridgeHead(0), bridgeCount(0) {
+    memset(sessions, 0, sizeof(sessions));
+    memset(retained, 0, sizeof(retained));
+    memset(&stats, 0, sizeof(stats));
+    setBridgeTopics(BROKER_BRIDGE_TOPICS);
+}
+
+bool MqttBroker::begin(uint16_t port) {
+    this->port = port;
+    if (!server->begin(port, BROKER_WRITE_TIMEOUT)) {
+        LOG_WARN(LOG_MQTT, "Local broker can't listen on port %u", (unsigned)port);
+        return false;
+    }
+    LOG_INFO(LOG_MQTT, "Local broker on port %u", (unsigned)port);
+    return true;
+}
+
+void MqttBroker::setBridgeTopics(const char* filters) {
+    std::lock_guard<std::mutex> guard(lock);
+    snprintf(bridgeFilters, sizeof(bridgeFilters), "%s", filters);
+}
+
+void MqttBroker::loop() {
+    std::lock_guard<std::mutex> guard(lock);
+    accept();
+    for (uint8_t slot = 0; slot < BROKER_CLIENTS; slot++) {
+        if (sessions[slot].net != nullptr) {
+            read(slot);
+        }
+    }
+    reap();
+}
+
+bool MqttBroker::publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, bool retain) {
+    if (strlen(topic) >= BROKER_TOPIC_SIZE || !TopicTrie::validTopic(topic) ||
+        length + strlen(topic) + 9 > BROKER_PACKET_SIZE) {
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    stats.publishesHub++;
+    if (retain) {
+        keepRetained(topic, payload, length, qos);
+    }
+    route(topic, payload, length, qos > 0 ? 1 : 0);
+    reap();
+    return true;
+}
+
+bool MqttBroker::publish(const char* topic, const char* payload, uint8_t qos, bool retain) {
+    return publish(topic, reinterpret_cast<const uint8_t*>(payload), strlen(payload), qos, retain);
+}
+
+bool MqttBroker::takeBridged(BridgedMessage& out) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (bridgeCount == 0) {
+        return false;
+    }
+    out = bridge[bridgeHead];
+    bridgeHead = (bridgeHead + 1) % BROKER_BRIDGE_QUEUE;
+    bridgeCount--;
+    return true;
+}
+
+uint8_t MqttBroker::clientCount() {
+    std::lock_guard<std::mutex> guard(lock);
+    uint8_t count = 0;
+    for (uint8_t slot = 0; slot < BROKER_CLIENTS; slot++) {
+        count += sessions[slot].connected;
+    }
+    return count;
+}
+
+BrokerStats MqttBroker::getStats() {
+    std::lock_guard<std::mutex> guard(lock);
+    return stats;
+}
+
+// ---------------------------------------------------------------------------
+// Connections
+// ---------------------------------------------------------------------------
+
+void MqttBroker::accept() {
+    Client* net;
+    while ((net = server->accept()) != nullptr) {
+        uint8_t slot = 0;
+        while (slot < BROKER_CLIENTS && sessions[slot].net != nullptr) {
+            slot++;
+        }
+        if (slot == BROKER_CLIENTS) {
+            server->release(net);
+            stats.refused++;
+            LOG_WARN(LOG_MQTT, "Local client refused, all %u slots taken", (unsigned)BROKER_CLIENTS);
+            continue;
+        }
+        Session& s = sessions[slot];
+        memset(&s, 0, sizeof(s));
+        s.net = net;
+        s.lastInMs = millis();
+    }
+}
+
+// Everything the client sent, packet by packet, then its timers
+void MqttBroker::read(uint8_t slot) {
+    Session& s = sessions[slot];
+    if (s.closing) {
+        return;
+    }
+    int available = s.net->available();
+    if (available <= 0 && !s.net->connected()) {
+        close(slot);
+        return;
+    }
+    while (available > 0 && !s.closing) {
+        size_t room = sizeof(s.rx) - s.used;
+        int n = s.net->read(s.rx + s.used, (size_t)available < room ? (size_t)available : room);
+        if (n <= 0) {
+            break;
+        }
+        s.used += n;
+        available -= n;
+
+        while (!s.closing && s.used >= 2) {
+            size_t remaining = 0;
+            size_t pos = 1;
+            bool complete = false;
+            for (uint8_t shift = 0; pos < s.used && pos <= 4 && !complete; shift += 7) {
+                uint8_t byte = s.rx[pos++];
+                remaining |= (size_t)(byte & 0x7F) << shift;
+                complete = !(byte & 0x80);
+            }
+            if (!complete) {
+                if (pos > 4) {
+                    drop(slot, "bad length");
+                }
+                break;
+            }
+            if (pos + remaining > sizeof(s.rx)) {
+                drop(slot, "packet too large");
+                break;
+            }
+            if (s.used < pos + remaining) {
+                break;
+            }
+            s.lastInMs = millis();
+            handlePacket(slot, s.rx[0], s.rx + pos, remaining);
+            s.used -= pos + remaining;
+            memmove(s.rx, s.rx + pos + remaining, s.used);
+        }
+    }
+
+    uint32_t silentMs = millis() - s.lastInMs;
+    if (s.closing) {
+        return;
+    }
+    if (!s.connected && silentMs > BROKER_CONNECT_TIMEOUT) {
+        drop(slot, "no CONNECT");
+    } else if (s.connected && s.keepAlive && silentMs > s.keepAlive * 1500UL) {
+        drop(slot, "keep-alive");
+    } else if (s.connected) {
+        resend(slot);
+    }
+}
+
+void MqttBroker::handlePacket(uint8_t slot, uint8_t header, uint8_t* body, size_t length) {
+    Session& s = sessions[slot];
+    uint8_t type = header >> 4;
+    const char* error = nullptr;
+    if (!s.connected && type != 1) {
+        error = "no CONNECT";
+    } else if (type == 1) {
+        if (s.connected) {
+            error = "second CONNECT";
+        } else {
+            handleConnect(slot, body, length);
+        }
+    } else if (type == 3) {
+        handlePublish(slot, header, body, length);
+    } else if (type == 4) {
+        if (length != 2) {
+            error = "bad PUBACK";
+        } else {
+            acknowledge(slot, (uint16_t)(body[0] << 8 | body[1]));
+        }
+    } else if (type == 8 && header == 0x82) {
+        handleSubscribe(slot, body, length);
+    } else if (type == 10 && header == 0xA2) {
+        handleUnsubscribe(slot, body, length);
+    } else if (type == 12) {
+        const uint8_t pong[] = {0xD0, 0x00};
+        send(slot, pong, sizeof(pong));
+    } else if (type == 14) {
+        close(slot, true);
+    } else {
+        error = "unexpected packet";
+    }
+    if (error != nullptr) {
+        drop(slot, error);
+    }
+}
+
+void MqttBroker::handleConnect(uint8_t slot, const uint8_t* body, size_t length) {
+    Session& s = sessions[slot];
+    Reader r(body, length);
+    uint16_t nameLength, idLength, willTopicLength = 0, willLength = 0, skipped;
+    const uint8_t* name = r.field(nameLength);
+    uint8_t level = r.byte();
+    uint8_t flags = r.byte();
+    uint16_t keepAlive = r.u16();
+    const uint8_t* id = r.field(idLength);
+    const uint8_t* willTopic = nullptr;
+    const uint8_t* will = nullptr;
+    if (flags & 0x04) {
+        willTopic = r.field(willTopicLength);
+        will = r.field(willLength);
+    }
+    if (flags & 0x80) {
+        r.field(skipped);   // User name and password: anyone on the LAN is let in
+    }
+    if (flags & 0x40) {
+        r.field(skipped);
+    }
+
+    uint8_t willQos = flags >> 3 & 0x03;
+    bool willRetain = flags & 0x20;
+    bool mqtt311 = r.ok && nameLength == 4 && memcmp(name, "MQTT", 4) == 0 && level == 4;
+    bool mqtt31 = r.ok && nameLength == 6 && memcmp(name, "MQIsdp", 6) == 0 && level == 3;
+    uint8_t code = 0;
+    if (!r.ok || (flags & 0x01) || willQos > 2 || (!(flags & 0x04) && (willQos || willRetain))) {
+        drop(slot, "bad CONNECT");
+        return;
+    } else if (!mqtt311 && !mqtt31) {
+        code = 0x01;    // Unacceptable protocol version, MQTT 5 included
+    } else if (idLength >= sizeof(s.id) || (idLength == 0 && !(flags & 0x02)) ||
+               (idLength > 0 && memchr(id, '\0', idLength) != nullptr)) {
+        code = 0x02;    // Identifier rejected
+    } else if (willTopic != nullptr && (willTopicLength + 1 + willLength > BROKER_WILL_SIZE ||
+                                        willTopicLength > UINT8_MAX)) {
+        code = 0x03;    // Server unavailable: no room for the will
+    }
+    if (willTopic != nullptr && code == 0) {
+        if (!copyString(reinterpret_cast<char*>(s.will), BROKER_WILL_SIZE, willTopic, willTopicLength) ||
+            !TopicTrie::validTopic(reinterpret_cast<char*>(s.will))) {
+            drop(slot, "bad will topic");
+            return;
+        }
+        memcpy(s.will + willTopicLength + 1, will, willLength);
+        s.willTopicLength = willTopicLength;
+        s.willLength = willTopicLength + 1 + willLength;
+        s.willQos = willQos > 1 ? 1 : willQos;
+        s.willRetain = willRetain;
+    }
+    if (code != 0) {
+        const uint8_t connack[] = {0x20, 0x02, 0x00, code};
+        send(slot, connack, sizeof(connack));
+        stats.refused++;
+        LOG_WARN(LOG_MQTT, "Local client %u refused, code %u", (unsigned)slot, (unsigned)code);
+        close(slot, true);
+        return;
+    }
+
+    if (idLength > 0) {
+        memcpy(s.id, id, idLength);
+        s.id[idLength] = '\0';
+    } else {
+        snprintf(s.id, sizeof(s.id), "local-%u", (unsigned)slot);
+    }
+    // The same id again: the new connection takes over, the old one goes
+    for (uint8_t other = 0; other < BROKER_CLIENTS; other++) {
+        if (other != slot && sessions[other].connected && !sessions[other].closing &&
+            strcmp(sessions[other].id, s.id) == 0) {
+            LOG_INFO(LOG_MQTT, "Local client %s took over", s.id);
+            close(other);
+        }
+    }
+    s.connected = true;
+    s.keepAlive = keepAlive;
+    const uint8_t connack[] = {0x20, 0x02, 0x00, 0x00};    // Never a session present
+    if (!send(slot, connack, sizeof(connack))) {
+        return;
+    }
+    stats.connects++;
+    uint8_t connected = 0;
+    for (uint8_t i = 0; i < BROKER_CLIENTS; i++) {
+        connected += sessions[i].connected && !sessions[i].closing;
+    }
+    if (connected > stats.clientsPeak) {
+        stats.clientsPeak = connected;
+    }
+    LOG_INFO(LOG_MQTT, "Local client %s connected, %u in all", s.id, (unsigned)connected);
+}
+
+void MqttBroker::handlePublish(uint8_t slot, uint8_t header, const uint8_t* body, size_t length) {
+    uint8_t qos = header >> 1 & 0x03;
+    Reader r(body, length);
+    uint16_t topicLength;
+    const uint8_t* topicField = r.field(topicLength);
+    uint16_t id = qos > 0 ? r.u16() : 0;
+    char topic[BROKER_TOPIC_SIZE];
+    const char* error = nullptr;
+    if (qos > 1) {
+        error = "QoS 2 publish";
+    } else if (!r.ok || !copyString(topic, sizeof(topic), topicField, topicLength) || !TopicTrie::validTopic(topic)) {
+        error = "bad PUBLISH";
+    }
+    if (error != nullptr) {
+        drop(slot, error);
+        return;
+    }
+    if (qos > 0) {
+        const uint8_t puback[] = {0x40, 0x02, (uint8_t)(id >> 8), (uint8_t)id};
+        send(slot, puback, sizeof(puback));
+    }
+    stats.publishesIn++;
+    if (header & 0x01) {
+        keepRetained(topic, r.p, r.left, qos);
+    }
+    queueBridged(topic, r.p, r.left);
+    route(topic, r.p, r.left, qos);
+}
+
+// Retained messages matching a filter go out as it is granted, before the
+// SUBACK, which 3.1.1 allows
+void MqttBroker::handleSubscribe(uint8_t slot, const uint8_t* body, size_t length) {
+    Reader r(body, length);
+    uint16_t id = r.u16();
+    uint8_t suback[4 + 32] = {0x90, 0x00, (uint8_t)(id >> 8), (uint8_t)id};
+    uint8_t count = 0;
+    while (r.ok && r.left > 0 && count < sizeof(suback) - 4) {
+        uint16_t filterLength;
+        const uint8_t* field = r.field(filterLength);
+        uint8_t requested = r.byte();
+        if (!r.ok || requested > 2) {
+            break;
+        }
+        char filter[BROKER_TOPIC_SIZE];
+        uint8_t qos = requested > 1 ? 1 : requested;
+        bool granted = copyString(filter, sizeof(filter), field, filterLength) && trie.subscribe(filter, slot, qos);
+        suback[4 + count++] = granted ? qos : 0x80;
+        if (granted) {
+            sendRetained(slot, filter, qos);
+        } else {
+            LOG_WARN(LOG_MQTT, "Local client %s: filter refused", sessions[slot].id);
+        }
+    }
+    if (!r.ok || r.left > 0 || count == 0) {
+        drop(slot, "bad SUBSCRIBE");
+        return;
+    }
+    suback[1] = 2 + count;
+    send(slot, suback, 4 + count);
+}
+
+void MqttBroker::handleUnsubscribe(uint8_t slot, const uint8_t* body, size_t length) {
+    Reader r(body, length);
+    uint16_t id = r.u16();
+    while (r.ok && r.left > 0) {
+        uint16_t filterLength;
+        const uint8_t* field = r.field(filterLength);
+        char filter[BROKER_TOPIC_SIZE];
+        if (r.ok && copyString(filter, sizeof(filter), field, filterLength)) {
+            trie.unsubscribe(filter, slot);
+        }
+    }
+    if (!r.ok) {
+        drop(slot, "bad UNSUBSCRIBE");
+        return;
+    }
+    const uint8_t unsuback[] = {0xB0, 0x02, (uint8_t)(id >> 8), (uint8_t)id};
+    send(slot, unsuback, sizeof(unsuback));
+}
+
+// ---------------------------------------------------------------------------
+// Delivery
+// ---------------------------------------------------------------------------
+
+void MqttBroker::route(const char* topic, const uint8_t* payload, size_t length, uint8_t qos) {
+    uint32_t qos1;
+    uint32_t targets = trie.match(topic, qos1);
+    if (targets == 0) {
+        return;
+    }
+    uint32_t startUs = micros();
+    for (uint8_t slot = 0; slot < BROKER_CLIENTS; slot++) {
+        uint32_t bit = (uint32_t)1 << slot;
+        if ((targets & bit) && sessions[slot].connected) {
+            deliver(slot, topic, payload, length, qos > 0 && (qos1 & bit) ? 1 : 0, false);
+        }
+    }
+    uint32_t took = micros() - startUs;
+    stats.fanouts++;
+    stats.fanoutUsTotal += took;
+    if (took > stats.fanoutUsMax) {
+        stats.fanoutUsMax = took;
+    }
+}
+
+// A QoS 1 copy is written from the in-flight slot that keeps it
+bool MqttBroker::deliver(uint8_t slot, const char* topic, const uint8_t* payload, size_t length, uint8_t qos,
+                         bool retain) {
+    Session& s = sessions[slot];
+    if (s.closing) {
+        return false;
+    }
+    InFlight* held = nullptr;
+    for (uint8_t i = 0; i < BROKER_INFLIGHT && qos > 0 && held == nullptr; i++) {
+        if (s.inFlight[i].id == 0) {
+            held = &s.inFlight[i];
+        }
+    }
+    uint8_t* out = held != nullptr ? held->packet : tx;
+    size_t topicLength = strlen(topic);
+    size_t remaining = 2 + topicLength + (qos > 0 ? 2 : 0) + length;
+    size_t n = putHeader(out, 0x30 | qos << 1 | (retain ? 1 : 0), remaining);
+    if (n == 0 || n + remaining > BROKER_PACKET_SIZE || (qos > 0 && held == nullptr)) {
+        stats.deliveryDrops++;
+        return false;
+    }
+    out[n++] = topicLength >> 8;
+    out[n++] = topicLength & 0xFF;
+    memcpy(out + n, topic, topicLength);
+    n += topicLength;
+    uint16_t id = 0;
+    if (qos > 0) {
+        id = nextId(s);
+        out[n++] = id >> 8;
+        out[n++] = id & 0xFF;
+    }
+    memcpy(out + n, payload, length);
+    n += length;
+    if (!send(slot, out, n)) {
+        return false;
+    }
+    if (held != nullptr) {
+        held->id = id;
+        held->length = n;
+        held->sentMs = millis();
+    }
+    stats.deliveries++;
+    return true;
+}
+
+// Skips the ids of copies still waiting for their PUBACK
+uint16_t MqttBroker::nextId(Session& s) {
+    while (true) {
+        s.lastId = s.lastId == UINT16_MAX ? 1 : s.lastId + 1;
+        bool used = false;
+        for (uint8_t i = 0; i < BROKER_INFLIGHT; i++) {
+            used |= s.inFlight[i].id == s.lastId;
+        }
+        if (!used) {
+            return s.lastId;
+        }
+    }
+}
+
+void MqttBroker::acknowledge(uint8_t slot, uint16_t id) {
+    Session& s = sessions[slot];
+    for (uint8_t i = 0; i < BROKER_INFLIGHT; i++) {
+        if (id != 0 && s.inFlight[i].id == id) {
+            s.inFlight[i].id = 0;
+            return;
+        }
+    }
+    stats.strayAcks++;
+}
+
+// From loop(), with the keep-alive check: every copy past BROKER_RESEND_MS
+// goes out again as it was, DUP set
+void MqttBroker::resend(uint8_t slot) {
+    Session& s = sessions[slot];
+    uint32_t now = millis();
+    for (uint8_t i = 0; i < BROKER_INFLIGHT && !s.closing; i++) {
+        InFlight& held = s.inFlight[i];
+        if (held.id == 0 || now - held.sentMs < BROKER_RESEND_MS) {
+            continue;
+        }
+        held.packet[0] |= 0x08;
+        if (send(slot, held.packet, held.length)) {
+            held.sentMs = now;
+            stats.resent++;
+        }
+    }
+}
+
+void MqttBroker::keepRetained(const char* topic, const uint8_t* payload, size_t length, uint8_t qos) {
+    size_t topicLength = strlen(topic);
+    Retained* kept = nullptr;
+    Retained* free = nullptr;
+    for (uint8_t i = 0; i < BROKER_RETAINED; i++) {
+        Retained& r = retained[i];
+        if (r.topicLength == topicLength && memcmp(r.data, topic, topicLength) == 0) {
+            kept = &r;
+        } else if (r.topicLength == 0 && free == nullptr) {
+            free = &r;
+        }
+    }
+    if (length == 0) {
+        // An empty retained message clears the topic's
+        if (kept != nullptr) {
+            kept->topicLength = 0;
+        }
+        return;
+    }
+    if (kept == nullptr) {
+        kept = free;
+    }
+    if (kept == nullptr || topicLength + 1 + length > BROKER_RETAINED_SIZE) {
+        stats.retainedDrops++;
+        LOG_WARN(LOG_MQTT, "Retained message on %s not kept", topic);
+        return;
+    }
+    memcpy(kept->data, topic, topicLength + 1);
+    memcpy(kept->data + topicLength + 1, payload, length);
+    kept->topicLength = topicLength;
+    kept->length = length;
+    kept->qos = qos;
+}
+
+void MqttBroker::sendRetained(uint8_t slot, const char* filter, uint8_t qos) {
+    for (uint8_t i = 0; i < BROKER_RETAINED; i++) {
+        const Retained& r = retained[i];
+        const char* topic = reinterpret_cast<const char*>(r.data);
+        if (r.topicLength > 0 && TopicTrie::matches(filter, topic)) {
+            deliver(slot, topic, r.data + r.topicLength + 1, r.length, qos < r.qos ? qos : r.qos, true);
+        }
+    }
+}
+
+void MqttBroker::queueBridged(const char* topic, const uint8_t* payload, size_t length) {
+    bool wanted = false;
+    for (const char* p = bridgeFilters; *p != '\0' && !wanted;) {
+        size_t n = strcspn(p, " ");
+        char filter[BROKER_TOPIC_SIZE];
+        if (n > 0 && copyString(filter, sizeof(filter), reinterpret_cast<const uint8_t*>(p), n)) {
+            wanted = TopicTrie::matches(filter, topic);
+        }
+        p += n + strspn(p + n, " ");
+    }
+    if (!wanted) {
+        return;
+    }
+    if (length > sizeof(bridge[0].payload)) {
+        stats.bridgeDrops++;
+        return;
+    }
+    if (bridgeCount == BROKER_BRIDGE_QUEUE) {
+        bridgeHead = (bridgeHead + 1) % BROKER_BRIDGE_QUEUE;
+        bridgeCount--;
+        stats.bridgeDrops++;
+    }
+    BridgedMessage& m = bridge[(bridgeHead + bridgeCount) % BROKER_BRIDGE_QUEUE];
+    snprintf(m.topic, sizeof(m.topic), "%s", topic);
+    memcpy(m.payload, payload, length);
+    m.length = length;
+    bridgeCount++;
+    stats.bridged++;
+}
+
+bool MqttBroker::send(uint8_t slot, const uint8_t* data, size_t length) {
+    Session& s = sessions[slot];
+    if (s.closing) {
+        return false;
+    }
+    if (s.net->write(data, length) != length) {
+        drop(slot, "write stalled");
+        return false;
+    }
+    return true;
+}
+
+void MqttBroker::drop(uint8_t slot, const char* why) {
+    stats.dropped++;
+    LOG_WARN(LOG_MQTT, "Local client %u dropped: %s", (unsigned)slot, why);
+    close(slot);
+}
+
+// Only marks it: a session may be in the middle of a fan-out
+void MqttBroker::close(uint8_t slot, bool graceful) {
+    sessions[slot].closing = true;
+    sessions[slot].graceful = graceful;
+}
+
+// Frees closed sessions and publishes their wills, which may close others
+void MqttBroker::reap() {
+    for (bool again = true; again;) {
+        again = false;
+        for (uint8_t slot = 0; slot < BROKER_CLIENTS; slot++) {
+            Session& s = sessions[slot];
+            if (s.net == nullptr || !s.closing) {
+                continue;
+            }
+            trie.removeClient(slot);
+            s.connected = false;
+            if (!s.graceful && s.willLength > 0) {
+                const char* topic = reinterpret_cast<const char*>(s.will);
+                const uint8_t* payload = s.will + s.willTopicLength + 1;
+                size_t length = s.willLength - s.willTopicLength - 1;
+                stats.publishesIn++;
+                if (s.willRetain) {
+                    keepRetained(topic, payload, length, s.willQos);
+                }
+                queueBridged(topic, payload, length);
+                route(topic, payload, length, s.willQos);
+                again = true;
+            }
+            if (s.id[0] != '\0') {
+                LOG_INFO(LOG_MQTT, "Local client %s gone", s.id);
+            }
+            server->release(s.net);
+            memset(&s, 0, sizeof(s));
+        }
+    }
+}
+
+size_t MqttBroker::format(char* out, size_t len) {
+    std::lock_guard<std::mutex> guard(lock);
+    uint8_t connected = 0;
+    for (uint8_t slot = 0; slot < BROKER_CLIENTS; slot++) {
+        connected += sessions[slot].connected;
+    }
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < BROKER_RETAINED; i++) {
+        kept += retained[i].topicLength > 0;
+    }
+    uint16_t held = 0;
+    for (uint8_t slot = 0; slot < BROKER_CLIENTS; slot++) {
+        for (uint8_t i = 0; i < BROKER_INFLIGHT; i++) {
+            held += sessions[slot].inFlight[i].id != 0;
+        }
+    }
+    int n = snprintf(out, len,
+                     "Broker: port %u, %u of %u clients (peak %u), %lu connects, %lu refused, %lu dropped\n"
+                     "Topics: %u of %u trie nodes, %u of %u retained (%lu not kept)\n"
+                     "Publishes: %lu from clients, %lu from the hub, %lu copies delivered, %lu not delivered\n"
+                     "QoS 1: %u copies awaiting PUBACK, %lu resent, %lu stray acks\n"
+                     "Fan-out: mean %.0f us, max %lu us over %lu publishes\n"
+                     "Bridge: %lu forwarded, %lu dropped, %u waiting, filters \"%s\"\n"
+                     "Memory: %u bytes per client, %u in all\n",
+                     (unsigned)port, (unsigned)connected, (unsigned)BROKER_CLIENTS, (unsigned)stats.clientsPeak,
+                     (unsigned long)stats.connects, (unsigned long)stats.refused, (unsigned long)stats.dropped,
+                     (unsigned)trie.nodesUsed(), (unsigned)BROKER_TRIE_NODES, (unsigned)kept,
+                     (unsigned)BROKER_RETAINED, (unsigned long)stats.retainedDrops,
+                     (unsigned long)stats.publishesIn, (unsigned long)stats.publishesHub,
+                     (unsigned long)stats.deliveries, (unsigned long)stats.deliveryDrops,
+                     (unsigned)held, (unsigned long)stats.resent, (unsigned long)stats.strayAcks,
+                     stats.fanouts ? (double)stats.fanoutUsTotal / stats.fanouts : 0.0,
+                     (unsigned long)stats.fanoutUsMax, (unsigned long)stats.fanouts,
+                     (unsigned long)stats.bridged, (unsigned long)stats.bridgeDrops, (unsigned)bridgeCount,
+                     bridgeFilters, (unsigned)sizeof(Session), (unsigned)sizeof(MqttBroker));
+    if (n < 0) {
+        return 0;
+    }
+    return (size_t)n < len ? (size_t)n : len - 1;
+}
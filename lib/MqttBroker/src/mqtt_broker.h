@@ -0,0 +1,140 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Client.h>
+#include <mutex>
+#include "config.h"
+#include "hal.h"
+#include "topic_trie.h"
+
+struct BrokerStats {
+    uint32_t connects;
+    uint32_t refused;           // No free slot, or a CONNECT we don't take
+    uint32_t dropped;           // Closed by us: protocol error, stalled write, missed keep-alive
+    uint32_t publishesIn;       // From local clients, wills included
+    uint32_t publishesHub;      // From the hub itself, see publish()
+    uint32_t deliveries;        // Copies written to subscribers
+    uint32_t deliveryDrops;     // Not written: QoS 1 window full, or too large
+    uint32_t resent;            // QoS 1 copies sent again for want of a PUBACK
+    uint32_t strayAcks;         // PUBACKs for no copy we hold
+    uint32_t retainedDrops;     // Retained message too large, or no slot left
+    uint32_t bridged;           // Queued for upstream
+    uint32_t bridgeDrops;       // Too large, or the oldest pushed out of a full queue
+    uint32_t fanouts;           // Publishes that had a subscriber
+    uint64_t fanoutUsTotal;     // From the publish to the last copy written
+    uint32_t fanoutUsMax;
+    uint8_t clientsPeak;
+};
+
+// A local publish on a BROKER_BRIDGE_TOPICS filter, for mqttTask to send
+// upstream
+struct BridgedMessage {
+    char topic[BROKER_TOPIC_SIZE];
+    uint8_t payload[MQTT_MAX_PACKET_SIZE];
+    uint16_t length;
+};
+
+// MQTT 3.1.1 broker for a handful of clients on the hub's LAN: QoS 0 and 1,
+// retained messages, wills, '+'/'#' filters through a TopicTrie. No
+// persistent sessions (every connect starts clean and CONNACK says so), no
+// QoS 2 (a QoS 2 publish closes the connection, a QoS 2 subscription is
+// granted QoS 1) and no authentication, so keep it on a trusted network.
+//
+// A QoS 1 copy is kept under its packet id until the PUBACK with that id
+// comes back, and sent again with DUP every BROKER_RESEND_MS until then,
+// for as long as the client stays connected. It is gone with the
+// connection: there is no session to keep it in.
+//
+// loop() runs in its own task: it accepts connections, reads what clients
+// sent and handles their packets. publish() is for the hub itself and is
+// called from mqttTask; both deliver straight away, each copy written
+// before they return. Everything is fixed size; see BROKER_* in config.h.
+class MqttBroker {
+public:
+    explicit MqttBroker(HalTcpServer* server);
+    bool begin(uint16_t port = BROKER_PORT);
+    // Space-separated filters whose local publishes go upstream, see
+    // takeBridged(); "" for none
+    void setBridgeTopics(const char* filters);
+    void loop();
+    // To local subscribers at min(qos, theirs); never bridged. False if
+    // the topic is malformed or the packet too large.
+    bool publish(const char* topic, const uint8_t* payload, size_t length,
+                 uint8_t qos = BROKER_PUBLISH_QOS, bool retain = false);
+    bool publish(const char* topic, const char* payload, uint8_t qos = BROKER_PUBLISH_QOS, bool retain = false);
+    // The oldest message waiting to go upstream
+    bool takeBridged(BridgedMessage& out);
+
+    uint8_t clientCount();
+    BrokerStats getStats();
+    size_t format(char* out, size_t len);
+
+private:
+    // A QoS 1 copy as it was written, until its PUBACK
+    struct InFlight {
+        uint16_t id;                    // 0 = free
+        uint16_t length;
+        uint32_t sentMs;
+        uint8_t packet[BROKER_PACKET_SIZE];
+    };
+
+    struct Session {
+        Client* net;                    // Null when the slot is free
+        bool connected;                 // CONNECT taken
+        bool closing;                   // Closed at the next reap()
+        bool graceful;                  // ... after a DISCONNECT, so no will
+        char id[32];
+        uint16_t keepAlive;             // s, 0 = none
+        uint32_t lastInMs;
+        uint16_t lastId;                // Packet id of the last QoS 1 copy
+        InFlight inFlight[BROKER_INFLIGHT];
+        uint16_t used;
+        uint8_t rx[BROKER_PACKET_SIZE]; // Bytes of the packet being read
+        uint16_t willLength;            // Topic, '\0', payload; 0 = no will
+        uint8_t willTopicLength;
+        uint8_t willQos;
+        bool willRetain;
+        uint8_t will[BROKER_WILL_SIZE];
+    };
+
+    struct Retained {
+        uint16_t topicLength;           // 0 = free
+        uint16_t length;
+        uint8_t qos;
+        uint8_t data[BROKER_RETAINED_SIZE];  // Topic, '\0', payload
+    };
+
+    HalTcpServer* server;
+    uint16_t port;
+    std::mutex lock;
+    Session sessions[BROKER_CLIENTS];
+    TopicTrie trie;
+    Retained retained[BROKER_RETAINED];
+    char bridgeFilters[BROKER_TOPIC_SIZE];
+    BridgedMessage bridge[BROKER_BRIDGE_QUEUE];
+    uint8_t bridgeHead;
+    uint8_t bridgeCount;
+    uint8_t tx[BROKER_PACKET_SIZE];
+    BrokerStats stats;
+
+    void accept();
+    void read(uint8_t slot);
+    void handlePacket(uint8_t slot, uint8_t header, uint8_t* body, size_t length);
+    void handleConnect(uint8_t slot, const uint8_t* body, size_t length);
+    void handlePublish(uint8_t slot, uint8_t header, const uint8_t* body, size_t length);
+    void handleSubscribe(uint8_t slot, const uint8_t* body, size_t length);
+    void handleUnsubscribe(uint8_t slot, const uint8_t* body, size_t length);
+    void route(const char* topic, const uint8_t* payload, size_t length, uint8_t qos);
+    bool deliver(uint8_t slot, const char* topic, const uint8_t* payload, size_t length, uint8_t qos, bool retain);
+    void keepRetained(const char* topic, const uint8_t* payload, size_t length, uint8_t qos);
+    void sendRetained(uint8_t slot, const char* filter, uint8_t qos);
+    uint16_t nextId(Session& s);
+    void acknowledge(uint8_t slot, uint16_t id);
+    void resend(uint8_t slot);
+    void queueBridged(const char* topic, const uint8_t* payload, size_t length);
+    bool send(uint8_t slot, const uint8_t* data, size_t length);
+    // Closed for misbehaving: counted and logged, the will goes out
+    void drop(uint8_t slot, const char* why);
+    void close(uint8_t slot, bool graceful = false);
+    void reap();
+};
@@ -0,0 +1,228 @@
+#include "topic_trie.h"
+#include <string.h>
+
+static_assert(BROKER_CLIENTS <= 32, "client slots are bits of a uint32_t");
+static_assert(BROKER_TRIE_NODES <= INT16_MAX, "nodes are indexed by int16_t");
+
+namespace {
+
+// The level starting at p: its end, and where the next one starts (null
+// after the last)
+const char* levelEnd(const char* p, const char*& next) {
+    const char* end = strchr(p, '/');
+    if (end == nullptr) {
+        next = nullptr;
+        return p + strlen(p);
+    }
+    next = end + 1;
+    return end;
+}
+
+bool isLevel(const char* level, size_t length, char wildcard) {
+    return length == 1 && level[0] == wildcard;
+}
+
+}  // namespace
+
+TopicTrie::TopicTrie() {
+    memset(nodes, 0, sizeof(nodes));
+    for (uint16_t i = 0; i < BROKER_TRIE_NODES; i++) {
+        nodes[i].parent = nodes[i].child = nodes[i].next = -1;
+    }
+    nodes[0].inUse = true;
+    used = 1;
+}
+
+bool TopicTrie::subscribe(const char* filter, uint8_t slot, uint8_t qos) {
+    if (!validFilter(filter)) {
+        return false;
+    }
+    int16_t node = 0;
+    for (const char* p = filter; p != nullptr;) {
+        const char* next;
+        const char* end = levelEnd(p, next);
+        size_t length = end - p;
+        int16_t child = length < BROKER_LEVEL_SIZE ? childOf(node, p, length) : -1;
+        if (child < 0) {
+            child = length < BROKER_LEVEL_SIZE ? addChild(node, p, length) : -1;
+            if (child < 0) {
+                prune(node);    // Whatever this call added on the way
+                return false;
+            }
+        }
+        node = child;
+        p = next;
+    }
+    nodes[node].clients |= (uint32_t)1 << slot;
+    if (qos > 0) {
+        nodes[node].qos1 |= (uint32_t)1 << slot;
+    } else {
+        nodes[node].qos1 &= ~((uint32_t)1 << slot);
+    }
+    return true;
+}
+
+void TopicTrie::unsubscribe(const char* filter, uint8_t slot) {
+    int16_t node = find(filter);
+    if (node > 0) {
+        nodes[node].clients &= ~((uint32_t)1 << slot);
+        nodes[node].qos1 &= ~((uint32_t)1 << slot);
+        prune(node);
+    }
+}
+
+void TopicTrie::removeClient(uint8_t slot) {
+    uint32_t mask = ~((uint32_t)1 << slot);
+    for (uint16_t i = 1; i < BROKER_TRIE_NODES; i++) {
+        nodes[i].clients &= mask;
+        nodes[i].qos1 &= mask;
+    }
+    // A leaf takes its unused parents with it; a node that still has
+    // children is looked at again when its last child goes
+    for (uint16_t i = 1; i < BROKER_TRIE_NODES; i++) {
+        if (nodes[i].inUse && nodes[i].child < 0) {
+            prune(i);
+        }
+    }
+}
+
+uint32_t TopicTrie::match(const char* topic, uint32_t& qos1) const {
+    uint32_t clients = 0;
+    qos1 = 0;
+    collect(0, topic, clients, qos1);
+    return clients;
+}
+
+// node matched the levels before rest; rest is null once every level has
+// been matched
+void TopicTrie::collect(int16_t node, const char* rest, uint32_t& clients, uint32_t& qos1) const {
+    if (rest == nullptr) {
+        clients |= nodes[node].clients;
+        qos1 |= nodes[node].qos1;
+    }
+    const char* next = nullptr;
+    const char* end = rest ? levelEnd(rest, next) : nullptr;
+    bool wildcards = node != 0 || rest[0] != '$';
+    for (int16_t child = nodes[node].child; child >= 0; child = nodes[child].next) {
+        const char* level = nodes[child].level;
+        if (level[0] == '#' && level[1] == '\0') {
+            // "a/#" matches "a" as well as everything under it
+            if (wildcards) {
+                clients |= nodes[child].clients;
+                qos1 |= nodes[child].qos1;
+            }
+        } else if (rest == nullptr) {
+            continue;
+        } else if (level[0] == '+' && level[1] == '\0') {
+            if (wildcards) {
+                collect(child, next, clients, qos1);
+            }
+        } else if (strlen(level) == (size_t)(end - rest) && memcmp(level, rest, end - rest) == 0) {
+            collect(child, next, clients, qos1);
+        }
+    }
+}
+
+int16_t TopicTrie::find(const char* filter) const {
+    int16_t node = 0;
+    for (const char* p = filter; p != nullptr && node >= 0;) {
+        const char* next;
+        const char* end = levelEnd(p, next);
+        node = childOf(node, p, end - p);
+        p = next;
+    }
+    return node;
+}
+
+int16_t TopicTrie::childOf(int16_t node, const char* level, size_t length) const {
+    for (int16_t child = nodes[node].child; child >= 0; child = nodes[child].next) {
+        if (strlen(nodes[child].level) == length && memcmp(nodes[child].level, level, length) == 0) {
+            return child;
+        }
+    }
+    return -1;
+}
+
+int16_t TopicTrie::addChild(int16_t node, const char* level, size_t length) {
+    for (int16_t i = 1; i < BROKER_TRIE_NODES; i++) {
+        if (nodes[i].inUse) {
+            continue;
+        }
+        Node& added = nodes[i];
+        memcpy(added.level, level, length);
+        added.level[length] = '\0';
+        added.parent = node;
+        added.child = -1;
+        added.next = nodes[node].child;
+        added.clients = added.qos1 = 0;
+        added.inUse = true;
+        nodes[node].child = i;
+        used++;
+        return i;
+    }
+    return -1;
+}
+
+// Gives back node and the parents above it that no filter needs any more
+void TopicTrie::prune(int16_t node) {
+    while (node > 0 && nodes[node].clients == 0 && nodes[node].child < 0) {
+        int16_t parent = nodes[node].parent;
+        int16_t* link = &nodes[parent].child;
+        while (*link != node) {
+            link = &nodes[*link].next;
+        }
+        *link = nodes[node].next;
+        nodes[node].inUse = false;
+        nodes[node].parent = nodes[node].next = -1;
+        used--;
+        node = parent;
+    }
+}
+
+bool TopicTrie::validFilter(const char* filter) {
+    if (filter[0] == '\0') {
+        return false;
+    }
+    for (const char* p = filter; p != nullptr;) {
+        const char* next;
+        const char* end = levelEnd(p, next);
+        size_t length = end - p;
+        bool multi = isLevel(p, length, '#');
+        if ((multi && next != nullptr) ||
+            (!multi && !isLevel(p, length, '+') && (memchr(p, '#', length) || memchr(p, '+', length)))) {
+            return false;
+        }
+        p = next;
+    }
+    return true;
+}
+
+bool TopicTrie::validTopic(const char* topic) {
+    return topic[0] != '\0' && strpbrk(topic, "+#") == nullptr;
+}
+
+bool TopicTrie::matches(const char* filter, const char* topic) {
+    if (topic[0] == '$' && (filter[0] == '+' || filter[0] == '#')) {
+        return false;
+    }
+    const char* f = filter;
+    const char* t = topic;
+    while (f != nullptr) {
+        const char* fNext;
+        const char* fEnd = levelEnd(f, fNext);
+        if (isLevel(f, fEnd - f, '#')) {
+            return true;
+        }
+        if (t == nullptr) {
+            return false;
+        }
+        const char* tNext;
+        const char* tEnd = levelEnd(t, tNext);
+        if (!isLevel(f, fEnd - f, '+') && (fEnd - f != tEnd - t || memcmp(f, t, fEnd - f) != 0)) {
+            return false;
+        }
+        f = fNext;
+        t = tNext;
+    }
+    return t == nullptr;
+}
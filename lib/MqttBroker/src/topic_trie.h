@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+
+// Subscription filters of up to 32 clients, one node per topic level, so a
+// publish is matched by walking its levels once instead of testing every
+// filter. A node's clients are a bit mask of client slots; a '+' or '#'
+// level is a node like any other. Nodes come from a fixed pool and go back
+// to it when no filter uses them any more.
+class TopicTrie {
+public:
+    TopicTrie();
+    // False if the filter is malformed, has a level of BROKER_LEVEL_SIZE or
+    // more, or the pool ran out; nothing changes then
+    bool subscribe(const char* filter, uint8_t slot, uint8_t qos);
+    void unsubscribe(const char* filter, uint8_t slot);
+    // Every filter of the client
+    void removeClient(uint8_t slot);
+    // Clients with a filter matching topic; qos1 gets those of them with a
+    // matching filter at QoS 1
+    uint32_t match(const char* topic, uint32_t& qos1) const;
+    uint16_t nodesUsed() const { return used; }
+
+    // MQTT 3.1.1 rules: '+' and '#' take a whole level, '#' only the last;
+    // a topic has neither. Neither may be empty.
+    static bool validFilter(const char* filter);
+    static bool validTopic(const char* topic);
+    // For the odd filter outside the trie (retained messages, the bridge).
+    // Wildcards at the first level don't match a topic starting with '$'.
+    static bool matches(const char* filter, const char* topic);
+
+private:
+    struct Node {
+        char level[BROKER_LEVEL_SIZE];
+        int16_t parent;
+        int16_t child;          // First child, -1 if none
+        int16_t next;           // Next sibling, -1 if none
+        uint32_t clients;
+        uint32_t qos1;
+        bool inUse;
+    };
+
+    Node nodes[BROKER_TRIE_NODES];  // nodes[0] is the root, the level before the first
+    uint16_t used;
+
+    int16_t find(const char* filter) const;
+    int16_t childOf(int16_t node, const char* level, size_t length) const;
+    int16_t addChild(int16_t node, const char* level, size_t length);
+    void prune(int16_t node);
+    void collect(int16_t node, const char* rest, uint32_t& clients, uint32_t& qos1) const;
+};
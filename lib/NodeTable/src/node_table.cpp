@@ -0,0 +1,98 @@
+#include "node_table.h"
+#include <math.h>
+#include <string.h>
+
+NodeTable::NodeTable() {
+    clear();
+}
+
+void NodeTable::clear() {
+    memset(slots, EMPTY, sizeof(slots));
+    count = 0;
+    rejected = 0;
+}
+
+void NodeTable::makeKey(const char* nodeID, char* key) {
+    // Keys are compared as all 8 bytes, zero padded
+    memset(key, 0, 9);
+    strncpy(key, nodeID, 8);
+}
+
+uint32_t NodeTable::hash(const char* key) {
+    // FNV-1a over the fixed-width key
+    uint32_t h = 2166136261u;
+    for (uint8_t i = 0; i < 8; i++) {
+        h ^= (uint8_t)key[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+int NodeTable::findSlot(const char* key) const {
+    uint8_t slot = hash(key) % SLOT_COUNT;
+    for (uint8_t probe = 0; probe < SLOT_COUNT; probe++) {
+        uint8_t index = slots[slot];
+        if (index == EMPTY || memcmp(nodes[index].nodeID, key, 8) == 0) {
+            return slot;
+        }
+        slot = (slot + 1) % SLOT_COUNT;
+    }
+    return -1;
+}
+
+NodeStats* NodeTable::find(const char* nodeID) {
+    char key[9];
+    makeKey(nodeID, key);
+    int slot = findSlot(key);
+    if (slot < 0 || slots[slot] == EMPTY) {
+        return nullptr;
+    }
+    return &nodes[slots[slot]];
+}
+
+NodeStats* NodeTable::update(const SensorReading& data, uint32_t nowMs) {
+    char key[9];
+    makeKey(data.nodeID, key);
+    int slot = findSlot(key);
+    if (slot < 0) {
+        rejected++;
+        return nullptr;
+    }
+
+    NodeStats* node;
+    if (slots[slot] == EMPTY) {
+        if (count >= NODE_TABLE_CAPACITY) {
+            rejected++;
+            return nullptr;
+        }
+        slots[slot] = count;
+        node = &nodes[count++];
+        memset(node, 0, sizeof(NodeStats));
+        memcpy(node->nodeID, key, sizeof(node->nodeID));
+        node->minTemp = NAN;
+        node->maxTemp = NAN;
+    } else {
+        node = &nodes[slots[slot]];
+    }
+
+    float temp = data.value(Q_TEMP);
+    float humidity = data.value(Q_HUMIDITY);
+    float moisture = data.value(Q_MOISTURE);
+
+    node->count++;
+    node->schemaId = data.schemaId;
+    node->lastSeenMs = nowMs;
+    node->lastTemp = temp;
+    node->lastHumidity = humidity;
+    node->lastMoisture = isnan(moisture) ? 0 : (long)moisture;
+    if (!isnan(temp)) {
+        if (isnan(node->minTemp) || temp < node->minTemp) node->minTemp = temp;
+        if (isnan(node->maxTemp) || temp > node->maxTemp) node->maxTemp = temp;
+        // Incremental mean, no running sums to overflow over weeks of uptime
+        node->meanTemp += (temp - node->meanTemp) / node->count;
+    }
+    if (!isnan(humidity)) {
+        node->meanHumidity += (humidity - node->meanHumidity) / node->count;
+    }
+    return node;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+#include "sensor_schema.h"
+
+#define NODE_TABLE_CAPACITY 64
+
+// Running per-node aggregate of everything the hub has received. Values the
+// node's schema doesn't carry stay NaN (0 for moisture).
+struct NodeStats {
+    char nodeID[9];         // Null-terminated copy of SensorReading::nodeID
+    uint8_t schemaId;
+    uint32_t count;
+    uint32_t lastSeenMs;
+    float lastTemp;
+    float lastHumidity;
+    long lastMoisture;
+    float minTemp;
+    float maxTemp;
+    float meanTemp;
+    float meanHumidity;
+};
+
+// Fixed-capacity table keyed by node ID, open addressing over an index
+// array so lookups never allocate and entries stay in arrival order.
+class NodeTable {
+public:
+    NodeTable();
+    // Fold a reading into its node's stats. Returns nullptr when the table
+    // is full and the node is new.
+    NodeStats* update(const SensorReading& data, uint32_t nowMs);
+    NodeStats* find(const char* nodeID);
+    void clear();
+
+    uint8_t size() const { return count; }
+    const NodeStats& at(uint8_t index) const { return nodes[index]; }
+    uint32_t getRejected() const { return rejected; }
+
+private:
+    static const uint8_t SLOT_COUNT = NODE_TABLE_CAPACITY * 2;
+    static const uint8_t EMPTY = 0xFF;
+
+    NodeStats nodes[NODE_TABLE_CAPACITY];
+    uint8_t slots[SLOT_COUNT];
+    uint8_t count;
+    uint32_t rejected;
+
+    static uint32_t hash(const char* key);
+    static void makeKey(const char* nodeID, char* key);
+    int findSlot(const char* key) const;
+};
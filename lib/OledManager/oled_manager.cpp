@@ -34,19 +34,21 @@ void OLEDManager::showWelcomeScreen() {
     drawCenteredText("UART-MQTT Hub", 30);
     drawCenteredText("Starting...", 45);
     
+    // No hold delay: boot carries on and the next status replaces this screen
     display.display();
-    delay(2000);
 }
 
-void OLEDManager::showSensorData(const char* nodeID, float temp, float humidity, long moisture) {
+void OLEDManager::showReading(const SensorReading& reading) {
     if (!initialized) return;
     
-    // Store the data
-    strncpy(lastNodeID, nodeID, sizeof(lastNodeID) - 1);
-    lastNodeID[sizeof(lastNodeID) - 1] = '\0';
-    lastTemp = temp;
-    lastHumidity = humidity;
-    lastMoisture = moisture;
+    // Label and unit per quantity, indexed like QUANTITY_KEYS
+    static const char* const LABELS[QUANTITY_COUNT] = {
+        "", "Temp", "Humidity", "Moisture", "Rain", "Solar", "Wind", "Gust", "Direction"
+    };
+    static const char* const UNITS[QUANTITY_COUNT] = {
+        "", " C", " %", " %", " mm", " W/m2", " m/s", " m/s", " deg"
+    };
+    
     hasData = true;
     
     // Display the data immediately
@@ -55,26 +57,27 @@ void OLEDManager::showSensorData(const char* nodeID, float temp, float humidity,
     
     // Header with node info
     String header = "Node: ";
-    header += nodeID;
+    header += reading.nodeID;
     drawCenteredText(header, 0);
     
     display.drawLine(0, 10, SCREEN_WIDTH, 10, SSD1306_WHITE);
     
     // Show sensor values
-    display.setCursor(5, 15);
-    display.print("Temp: ");
-    display.print(temp);
-    display.println(" C");
-    
-    display.setCursor(5, 25);
-    display.print("Humidity: ");
-    display.print(humidity);
-    display.println(" %");
-    
-    display.setCursor(5, 35);
-    display.print("Moisture: ");
-    display.print(moisture);
-    display.println(" %");
+    int16_t y = 15;
+    for (uint8_t q = Q_TEMP; q < QUANTITY_COUNT && y <= 45; q++) {
+        float value = reading.value((Quantity)q);
+        if (isnan(value)) continue;
+        display.setCursor(5, y);
+        display.print(LABELS[q]);
+        display.print(": ");
+        if (q == Q_MOISTURE || q == Q_WIND_DIR) {
+            display.print((long)value);
+        } else {
+            display.print(value);
+        }
+        display.println(UNITS[q]);
+        y += 10;
+    }
     
     display.display();
 }
@@ -173,4 +176,14 @@ void OLEDManager::drawCenteredText(const String &text, int16_t y) {
     display.getTextBounds(text, 0, 0, &x1, &y1, &w, &h);
     display.setCursor((SCREEN_WIDTH - w) / 2, y);
     display.print(text);
-}
\ No newline at end of file
+}
+
+void OLEDManager::setDimmed(bool dimmed) {
+    if (!initialized) return;
+    display.dim(dimmed);
+}
+
+void OLEDManager::setPowered(bool on) {
+    if (!initialized) return;
+    display.ssd1306_command(on ? SSD1306_DISPLAYON : SSD1306_DISPLAYOFF);
+}
@@ -5,6 +5,7 @@
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
 #include "config.h"
+#include "sensor_schema.h"
 #include <time.h>
 
 // Display settings
@@ -18,12 +19,16 @@ public:
     OLEDManager();
     bool begin();
     void showWelcomeScreen();
-    void showSensorData(const char* nodeID, float temp, float humidity, long moisture);
+    // Node ID and up to four of the values the reading carries
+    void showReading(const SensorReading& reading);
     void showTime(struct tm *timeinfo);
     void showStatus(const char* status);
     void showWiFiStatus(bool connected, const char* ssid = nullptr);
     void showMQTTStatus(bool connected);
     void clear();
+    // Power saving: low contrast, or the panel switched off (contents kept)
+    void setDimmed(bool dimmed);
+    void setPowered(bool on);
     void update(); // Call this periodically to refresh dynamic content
     
 private:
@@ -32,10 +37,6 @@ private:
     unsigned long lastUpdate = 0;
     
     // Display data
-    char lastNodeID[8] = "";
-    float lastTemp = 0;
-    float lastHumidity = 0;
-    long lastMoisture = 0;
     bool hasData = false;
     bool showingData = true; // Toggle between data and time
     
@@ -0,0 +1,192 @@
+#include "payload_compressor.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+const size_t WINDOW = (size_t)1 << COMPRESS_WINDOW_BITS;
+const size_t MATCH_MAX = COMPRESS_MATCH_MIN + ((size_t)1 << COMPRESS_LENGTH_BITS) - 1;
+
+// What encodeReading writes around the values: every key of every schema
+// (QUANTITY_KEYS and the schema names), the date object and the start of a
+// message. The most common text comes last. Keep tools/loadgen.py's copy
+// in step and bump COMPRESS_DICT_VERSION with any change.
+const char DICTIONARY[] =
+    ",\"gust_ms\":,\"wind_dir\":,\"wind_ms\":\"wind\""
+    ",\"solar_wm2\":\"solar\",\"rain_mm\":\"rain\",\"uptime_ms\":"
+    ",\"quality\":0,\"date\":{\"year\":20,\"month\":,\"day\":,\"hour\":,\"minute\":,\"second\":}}\n"
+    "{\"sensor_id\":\"N0\",\"hub_id\":\"H-0\",\"schema\":\"climate\",\"temp\":2,\"humidity\":5,\"moisture\":";
+
+static_assert(sizeof(DICTIONARY) - 1 < COMPRESS_INPUT_MAX, "COMPRESS_INPUT_MAX leaves no room after the dictionary");
+static_assert(COMPRESS_WINDOW_BITS + COMPRESS_LENGTH_BITS <= 24, "window and length don't fit a match");
+
+}  // namespace
+
+PayloadCompressor::PayloadCompressor() {
+    memset(&stats, 0, sizeof(stats));
+    reset();
+}
+
+void PayloadCompressor::reset(bool dictionary) {
+    dictLength = dictionary ? sizeof(DICTIONARY) - 1 : 0;
+    memcpy(in, DICTIONARY, dictLength);
+    inLength = dictLength;
+    memset(out, 0, sizeof(out));
+    out[0] = COMPRESS_MAGIC;
+    out[1] = COMPRESS_WINDOW_BITS << 4 | COMPRESS_LENGTH_BITS;
+    out[2] = dictionary ? COMPRESS_DICT_VERSION : 0;
+    outBits = COMPRESS_HEADER_SIZE * 8;
+    count = 0;
+}
+
+bool PayloadCompressor::add(const char* message, size_t length) {
+    size_t start = inLength;
+    size_t startBits = outBits;
+    size_t end = start + (count > 0 ? 1 : 0) + length;
+    if (end > sizeof(in) || count == UINT8_MAX) {
+        stats.full += count > 0;
+        return false;
+    }
+    if (count > 0) {
+        in[start] = '\n';
+    }
+    memcpy(in + end - length, message, length);
+
+    bool fits = true;
+    for (size_t pos = start; pos < end && fits;) {
+        size_t offset = 0;
+        size_t matched = findMatch(pos, end, offset);
+        if (matched >= COMPRESS_MATCH_MIN) {
+            fits = putBits(0, 1) && putBits(offset - 1, COMPRESS_WINDOW_BITS) &&
+                   putBits(matched - COMPRESS_MATCH_MIN, COMPRESS_LENGTH_BITS);
+            pos += matched;
+        } else {
+            fits = putBits(0x100 | in[pos], 9);
+            pos++;
+        }
+    }
+    if (!fits) {
+        // Back to where the frame was: clear the bits written since
+        size_t kept = startBits / 8;
+        if (startBits % 8) {
+            out[kept++] &= (uint8_t)(0xFF00 >> (startBits % 8));
+        }
+        memset(out + kept, 0, size() - kept);
+        outBits = startBits;
+        stats.full += count > 0;
+        return false;
+    }
+    inLength = end;
+    count++;
+    return true;
+}
+
+void PayloadCompressor::noteSent() {
+    stats.frames++;
+    stats.messages += count;
+    stats.rawBytes += rawSize();
+    stats.compressedBytes += size();
+}
+
+bool PayloadCompressor::putBits(uint32_t value, uint8_t bits) {
+    if (outBits + bits > sizeof(out) * 8) {
+        return false;
+    }
+    for (int8_t i = bits - 1; i >= 0; i--) {
+        if (value >> i & 1) {
+            out[outBits / 8] |= 0x80 >> (outBits % 8);
+        }
+        outBits++;
+    }
+    return true;
+}
+
+// Longest match for in[pos..end) starting in the window before pos, nearest
+// first. Without an index this is the costly part, bounded by the window.
+size_t PayloadCompressor::findMatch(size_t pos, size_t end, size_t& offset) const {
+    size_t limit = end - pos < MATCH_MAX ? end - pos : MATCH_MAX;
+    if (limit < COMPRESS_MATCH_MIN) {
+        return 0;
+    }
+    size_t best = 0;
+    size_t first = pos > WINDOW ? pos - WINDOW : 0;
+    for (size_t candidate = pos; candidate-- > first;) {
+        // Only a match longer than the best so far is of interest
+        if (in[candidate + best] != in[pos + best] || in[candidate] != in[pos]) {
+            continue;
+        }
+        size_t n = 1;
+        while (n < limit && in[candidate + n] == in[pos + n]) {
+            n++;
+        }
+        if (n > best) {
+            best = n;
+            offset = pos - candidate;
+            if (n == limit) {
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+size_t PayloadCompressor::decompress(const uint8_t* frame, size_t length, char* out, size_t outSize) {
+    if (length < COMPRESS_HEADER_SIZE || frame[0] != COMPRESS_MAGIC || outSize == 0 ||
+        frame[1] != (COMPRESS_WINDOW_BITS << 4 | COMPRESS_LENGTH_BITS) ||
+        (frame[2] != 0 && frame[2] != COMPRESS_DICT_VERSION)) {
+        return 0;
+    }
+    size_t dictLength = frame[2] ? sizeof(DICTIONARY) - 1 : 0;
+    size_t bit = COMPRESS_HEADER_SIZE * 8;
+    size_t totalBits = length * 8;
+    auto take = [&](uint8_t bits) {
+        uint32_t value = 0;
+        for (uint8_t i = 0; i < bits; i++, bit++) {
+            value = value << 1 | (frame[bit / 8] >> (7 - bit % 8) & 1);
+        }
+        return value;
+    };
+
+    size_t produced = 0;
+    const size_t MATCH_BITS = 1 + COMPRESS_WINDOW_BITS + COMPRESS_LENGTH_BITS;
+    // What is left at the end is zero padding, too short for anything
+    while (totalBits - bit >= 9) {
+        if (take(1)) {
+            if (produced + 1 >= outSize) {
+                return 0;
+            }
+            out[produced++] = (char)take(8);
+            continue;
+        }
+        if (totalBits - bit < MATCH_BITS - 1) {
+            break;
+        }
+        size_t offset = take(COMPRESS_WINDOW_BITS) + 1;
+        size_t count = take(COMPRESS_LENGTH_BITS) + COMPRESS_MATCH_MIN;
+        if (offset > dictLength + produced || produced + count >= outSize) {
+            return 0;
+        }
+        // Byte by byte: the source may run into what this match writes
+        for (size_t i = 0; i < count; i++, produced++) {
+            size_t from = dictLength + produced - offset;
+            out[produced] = from < dictLength ? DICTIONARY[from] : out[from - dictLength];
+        }
+    }
+    out[produced] = '\0';
+    return produced;
+}
+
+size_t PayloadCompressor::format(char* out, size_t len) const {
+    int n = snprintf(out, len,
+                     "Compression: %lu frames, %lu messages (%.1f per frame), %llu -> %llu bytes (%.1f%%), "
+                     "%lu sent early\n",
+                     (unsigned long)stats.frames, (unsigned long)stats.messages,
+                     stats.frames ? (double)stats.messages / stats.frames : 0.0,
+                     (unsigned long long)stats.rawBytes, (unsigned long long)stats.compressedBytes,
+                     stats.rawBytes ? 100.0 * stats.compressedBytes / stats.rawBytes : 0.0,
+                     (unsigned long)stats.full);
+    if (n < 0) {
+        return 0;
+    }
+    return (size_t)n < len ? (size_t)n : len - 1;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+
+// Frame layout: 'Z', COMPRESS_WINDOW_BITS << 4 | COMPRESS_LENGTH_BITS, the
+// dictionary version (0 = none), then the LZSS bit stream, most significant
+// bit first. 1 + 8 bits is a literal byte; 0 + (offset - 1) in window bits +
+// (length - COMPRESS_MATCH_MIN) in length bits copies length bytes from
+// offset bytes back. The dictionary counts as text in front of the first
+// message, so a back-reference can reach into it. Messages are separated
+// by '\n'. tools/loadgen.py has a decoder.
+#define COMPRESS_MAGIC 'Z'
+#define COMPRESS_DICT_VERSION 1         // Bump with any change to the dictionary
+#define COMPRESS_HEADER_SIZE 3
+#define COMPRESS_MATCH_MIN 2            // 16 bits for a match beats 2 x 9 for literals
+
+struct CompressorStats {
+    uint32_t frames;            // Sent, see noteSent()
+    uint32_t messages;
+    uint64_t rawBytes;          // Of the messages, separators included
+    uint64_t compressedBytes;   // Of the frames, headers included
+    uint32_t full;              // add() found no room and the frame went out early
+};
+
+// LZSS in the manner of heatshrink: a fixed window, greedy matching by
+// searching the window, no heap and no tables, so the whole state is the
+// input text and the output frame. What makes it pay on short JSON messages
+// is the dictionary of our keys and schema names it starts from, so even
+// the first message of a frame compresses; later ones also match the
+// messages before them.
+//
+// add() compresses as it goes. A message that would push the frame past
+// COMPRESS_FRAME_MAX is taken back out, leaving the frame as it was.
+class PayloadCompressor {
+public:
+    PayloadCompressor();
+    // An empty frame, primed with the dictionary unless told otherwise
+    void reset(bool dictionary = true);
+    // False, frame unchanged, if the message doesn't fit
+    bool add(const char* message, size_t length);
+    uint8_t messages() const { return count; }
+    // Input bytes in the frame, separators included
+    size_t rawSize() const { return inLength - dictLength; }
+    // The frame so far is complete: bits go into zeroed bytes
+    const uint8_t* frame() const { return out; }
+    size_t size() const { return (outBits + 7) / 8; }
+    // The frame went out
+    void noteSent();
+
+    const CompressorStats& getStats() const { return stats; }
+    size_t format(char* out, size_t len) const;
+
+    // A frame back into '\n'-separated messages, terminated. 0 if malformed
+    // or outSize is too small.
+    static size_t decompress(const uint8_t* frame, size_t length, char* out, size_t outSize);
+
+private:
+    uint8_t in[COMPRESS_INPUT_MAX];     // Dictionary, then the messages
+    size_t dictLength;
+    size_t inLength;
+    uint8_t out[COMPRESS_FRAME_MAX];
+    size_t outBits;
+    uint8_t count;
+    CompressorStats stats;
+
+    bool putBits(uint32_t value, uint8_t bits);
+    size_t findMatch(size_t pos, size_t end, size_t& offset) const;
+};
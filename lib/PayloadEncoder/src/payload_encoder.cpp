@@ -0,0 +1,137 @@
+#include "payload_encoder.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+size_t encodeReading(JsonDocument& doc, const SensorReading& data, const char* hubId,
+                     const struct tm* timeInfo, unsigned long uptimeMs,
+                     char* out, size_t outSize) {
+    const SchemaInfo* schema = data.schema();
+    if (schema == nullptr) {
+        return 0;
+    }
+    doc.clear();
+    doc["sensor_id"] = data.nodeID;
+    doc["hub_id"] = hubId;
+    doc["schema"] = schema->name;
+    schema->toJson(data, doc.as<JsonObject>());
+    doc["quality"] = data.quality;
+
+    if (timeInfo) {
+        JsonObject date = doc["date"].to<JsonObject>();
+        date["year"] = timeInfo->tm_year + 1900;
+        date["month"] = timeInfo->tm_mon + 1;
+        date["day"] = timeInfo->tm_mday;
+        date["hour"] = timeInfo->tm_hour;
+        date["minute"] = timeInfo->tm_min;
+        date["second"] = timeInfo->tm_sec;
+    } else {
+        // Add timestamp using uptime instead
+        doc["uptime_ms"] = uptimeMs;
+    }
+
+    // Out of pool/arena memory: the document is incomplete
+    if (doc.overflowed() || measureJson(doc) >= outSize) {
+        return 0;
+    }
+    return serializeJson(doc, out, outSize);
+}
+
+namespace {
+
+// Appends to a fixed buffer and remembers if anything was cut off
+struct PayloadWriter {
+    char* out;
+    size_t size;
+    size_t pos;
+    bool overflow;
+
+    void raw(const char* text) {
+        size_t len = strlen(text);
+        if (pos + len >= size) {
+            overflow = true;
+            return;
+        }
+        memcpy(out + pos, text, len);
+        pos += len;
+    }
+
+    void format(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+        if (overflow) return;
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(out + pos, size - pos, fmt, args);
+        va_end(args);
+        if (n < 0 || (size_t)n >= size - pos) {
+            overflow = true;
+            return;
+        }
+        pos += n;
+    }
+
+    void string(const char* text, size_t maxLen) {
+        raw("\"");
+        for (size_t i = 0; i < maxLen && text[i] && !overflow; i++) {
+            char c = text[i];
+            if (c == '"' || c == '\\') {
+                format("\\%c", c);
+            } else if ((uint8_t)c < 0x20) {
+                format("\\u%04x", c);
+            } else {
+                if (pos + 1 >= size) {
+                    overflow = true;
+                    return;
+                }
+                out[pos++] = c;
+            }
+        }
+        raw("\"");
+    }
+
+    // Measurements, written by the schema's generated writer
+    void fields(const SensorReading& data, const SchemaInfo* schema) {
+        if (overflow) return;
+        size_t n = schema->writeJson(data, out + pos, size - pos);
+        if (n == 0 && data.present != 0) {
+            overflow = true;
+            return;
+        }
+        pos += n;
+    }
+};
+
+}  // namespace
+
+size_t encodeReadingDirect(const SensorReading& data, const char* hubId,
+                           const struct tm* timeInfo, unsigned long uptimeMs,
+                           char* out, size_t outSize) {
+    const SchemaInfo* schema = data.schema();
+    if (outSize == 0 || schema == nullptr) {
+        return 0;
+    }
+    PayloadWriter w = { out, outSize, 0, false };
+
+    w.raw("{\"sensor_id\":");
+    w.string(data.nodeID, sizeof(data.nodeID));
+    w.raw(",\"hub_id\":");
+    w.string(hubId, SIZE_MAX);
+    w.format(",\"schema\":\"%s\"", schema->name);
+    w.fields(data, schema);
+    w.format(",\"quality\":%u", (unsigned)data.quality);
+
+    if (timeInfo) {
+        w.format(",\"date\":{\"year\":%d,\"month\":%d,\"day\":%d,\"hour\":%d,\"minute\":%d,\"second\":%d}",
+                 timeInfo->tm_year + 1900, timeInfo->tm_mon + 1, timeInfo->tm_mday,
+                 timeInfo->tm_hour, timeInfo->tm_min, timeInfo->tm_sec);
+    } else {
+        w.format(",\"uptime_ms\":%lu", uptimeMs);
+    }
+    w.raw("}");
+
+    if (w.overflow) {
+        out[0] = '\0';
+        return 0;
+    }
+    out[w.pos] = '\0';
+    return w.pos;
+}
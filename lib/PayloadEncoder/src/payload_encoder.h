@@ -0,0 +1,29 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <time.h>
+#include "config.h"
+#include "sensor_schema.h"
+
+// Pooled output buffer for one encoded reading
+struct PayloadBuffer {
+    char data[MQTT_MAX_PACKET_SIZE];
+    size_t length;
+};
+
+// Builds the JSON payload published for one reading into out and returns
+// its length (0 if it did not fit). The measurement keys come from the
+// reading's schema, only the fields the node sent are included. timeInfo may be nullptr when neither the
+// RTC nor NTP has a time, the payload then carries uptime_ms instead.
+// Shared by mqttTask on the device and the native pipeline.
+size_t encodeReading(JsonDocument& doc, const SensorReading& data, const char* hubId,
+                     const struct tm* timeInfo, unsigned long uptimeMs,
+                     char* out, size_t outSize);
+
+// Same payload written straight into out with snprintf, no JsonDocument.
+// Field order and number formatting match encodeReading (floats to 7
+// significant digits, NaN/Inf as null like ArduinoJson).
+size_t encodeReadingDirect(const SensorReading& data, const char* hubId,
+                           const struct tm* timeInfo, unsigned long uptimeMs,
+                           char* out, size_t outSize);
@@ -1,7 +1,10 @@
 #include "portal_manager.h"
+#include "web_assets.h"
+#include <new>
 
-PortalManager::PortalManager(HubConfig* config, ConfigManager* configManager) : server(80) {
-    this->config = config;
+#define DNS_PORT 53
+
+PortalManager::PortalManager(ConfigManager* configManager) : server(80), liveSocket("/live") {
     this->configManager = configManager;
     portalActive = false;
 }
@@ -13,17 +16,14 @@ void PortalManager::begin() {
     Serial.print("Config Portal IP address: ");
     Serial.println(IP);
     portalActive = true;
+    closeAtMs = 0;
+    // Answer every DNS query with our IP so phones detect the captive portal
+    dnsServer.start(DNS_PORT, "*", IP);
     
-    // Set up SPIFFS to serve the web interface files
-    if(!SPIFFS.begin(true)){
-        Serial.println("An Error has occurred while mounting SPIFFS");
+    if (!startServer()) {
         return;
     }
     
-    setupRoutes();
-    
-    server.begin();
-    
     Serial.println("Configuration portal started");
     Serial.printf("Connect to WiFi network '%s' with password '%s'\n", DEFAULT_AP_SSID, DEFAULT_AP_PASSWORD);
     Serial.printf("Then navigate to http://%s in your browser\n", IP.toString().c_str());
@@ -37,73 +37,286 @@ void PortalManager::begin() {
     }
 }
 
+bool PortalManager::startServer() {
+    // The server outlives the AP, only set it up the first time
+    if (serverStarted) {
+        return true;
+    }
+    
+    setupRoutes();
+    
+    server.begin();
+    serverStarted = true;
+    return true;
+}
+
+void PortalManager::loop() {
+    if (serverStarted) {
+        liveSocket.cleanupClients(LIVE_MAX_CLIENTS);
+    }
+    if (portalActive) {
+        dnsServer.processNextRequest();
+    }
+    if (closeAtMs != 0 && (long)(millis() - closeAtMs) >= 0) {
+        end();
+    }
+}
+
+void PortalManager::end() {
+    closeAtMs = 0;
+    if (!portalActive) {
+        return;
+    }
+    dnsServer.stop();
+    WiFi.softAPdisconnect(true);
+    portalActive = false;
+    Serial.println("Configuration portal closed");
+}
+
+void PortalManager::onLiveEvent(AsyncWebSocketClient* client, AwsEventType type) {
+    if (type == WS_EVT_CONNECT) {
+        if (liveFeed == nullptr || !liveFeed->addClient(client->id())) {
+            client->close();
+        }
+    } else if (type == WS_EVT_DISCONNECT) {
+        if (liveFeed) {
+            liveFeed->removeClient(client->id());
+        }
+    }
+}
+
+bool PortalManager::isBusy(uint32_t clientId) {
+    AsyncWebSocketClient* client = liveSocket.client(clientId);
+    return client == nullptr || client->queueLen() >= LIVE_MAX_QUEUED;
+}
+
+void PortalManager::sendShared(const char* frame, size_t len, const uint32_t* clientIds, uint8_t count) {
+    // One refcounted buffer for every client instead of a copy per queue
+    AsyncWebSocketMessageBuffer* buffer = liveSocket.makeBuffer(len);
+    if (buffer == nullptr) {
+        return;
+    }
+    memcpy(buffer->get(), frame, len);
+    for (uint8_t i = 0; i < count; i++) {
+        AsyncWebSocketClient* client = liveSocket.client(clientIds[i]);
+        if (client) {
+            client->text(buffer);
+        }
+    }
+}
+
+void PortalManager::sendAsset(AsyncWebServerRequest* request, const WebAsset* asset, bool immutable) {
+    unsigned long start = micros();
+    webStats.requests++;
+    
+    AsyncWebServerResponse* response;
+    if (request->hasHeader("If-None-Match") && request->header("If-None-Match").indexOf(asset->etag) >= 0) {
+        response = request->beginResponse(304);
+        webStats.notModified++;
+    } else {
+        // Stored gzipped in flash, sent as is
+        response = request->beginResponse_P(200, asset->contentType, asset->data, asset->length);
+        response->addHeader("Content-Encoding", "gzip");
+        webStats.bytesSent += asset->length;
+        webStats.rawBytes += asset->rawLength;
+    }
+    response->addHeader("ETag", asset->etag);
+    // Fingerprinted names change with their content and can be cached for
+    // good; pages are revalidated so they pick up new fingerprints
+    response->addHeader("Cache-Control", immutable ? "public, max-age=31536000, immutable" : "no-cache");
+    request->send(response);
+    
+    webStats.handlerUs += micros() - start;
+}
+
+size_t PortalManager::formatWebStats(char* out, size_t len) const {
+    int written = snprintf(out, len,
+        "Assets: %lu requests, %lu not modified, %lu bytes sent (%lu uncompressed), %lu us in handlers\n"
+        "Page loads: %lu, mean %lu bytes, mean %lu ms, max %lu ms\n",
+        (unsigned long)webStats.requests, (unsigned long)webStats.notModified,
+        (unsigned long)webStats.bytesSent, (unsigned long)webStats.rawBytes,
+        (unsigned long)webStats.handlerUs, (unsigned long)webStats.pageLoads,
+        (unsigned long)(webStats.pageLoads ? webStats.pageBytes / webStats.pageLoads : 0),
+        (unsigned long)(webStats.pageLoads ? webStats.pageMs / webStats.pageLoads : 0),
+        (unsigned long)webStats.pageMsMax);
+    return written > 0 ? (size_t)written : 0;
+}
+
 void PortalManager::setupRoutes() {
-    // Setup the web server routes
-    server.on("/", HTTP_GET, [](AsyncWebServerRequest *request){
-        request->send(SPIFFS, "/index.html", "text/html");
+    liveSocket.onEvent([this](AsyncWebSocket* socket, AsyncWebSocketClient* client, AwsEventType type,
+                              void* arg, uint8_t* data, size_t len) {
+        onLiveEvent(client, type);
     });
+    server.addHandler(&liveSocket);
     
-    server.on("/style.css", HTTP_GET, [](AsyncWebServerRequest *request){
-        request->send(SPIFFS, "/style.css", "text/css");
+    // Web UI, embedded from data/ by tools/embed_assets.py
+    for (size_t i = 0; i < WEB_ASSET_COUNT; i++) {
+        const WebAsset* asset = &WEB_ASSETS[i];
+        server.on(asset->path, HTTP_GET, [this, asset](AsyncWebServerRequest *request){
+            sendAsset(request, asset, false);
+        });
+        if (asset->fingerprinted) {
+            server.on(asset->fingerprinted, HTTP_GET, [this, asset](AsyncWebServerRequest *request){
+                sendAsset(request, asset, true);
+            });
+        }
+        if (strcmp(asset->path, "/index.html") == 0) {
+            server.on("/", HTTP_GET, [this, asset](AsyncWebServerRequest *request){
+                sendAsset(request, asset, false);
+            });
+        }
+    }
+    
+    server.on("/pageload", HTTP_POST, [this](AsyncWebServerRequest *request){
+        if (request->hasParam("bytes") && request->hasParam("ms")) {
+            uint32_t ms = request->getParam("ms")->value().toInt();
+            webStats.pageLoads++;
+            webStats.pageBytes += request->getParam("bytes")->value().toInt();
+            webStats.pageMs += ms;
+            if (ms > webStats.pageMsMax) {
+                webStats.pageMsMax = ms;
+            }
+        }
+        request->send(204);
     });
     
-    server.on("/script.js", HTTP_GET, [](AsyncWebServerRequest *request){
-        request->send(SPIFFS, "/script.js", "application/javascript");
+    server.on("/assets", HTTP_GET, [this](AsyncWebServerRequest *request){
+        char report[256];
+        formatWebStats(report, sizeof(report));
+        request->send(200, "text/plain", report);
+    });
+    
+    // Captive portal: OS connectivity probes (/generate_204, /hotspot-detect.html,
+    // ...) land here and get sent to the config page
+    server.onNotFound([this](AsyncWebServerRequest *request){
+        if (portalActive) {
+            request->redirect("http://" + WiFi.softAPIP().toString() + "/");
+        } else {
+            request->send(404, "text/plain", "Not found");
+        }
     });
     
     server.on("/config", HTTP_GET, [this](AsyncWebServerRequest *request){
-        JsonDocument doc;
-        doc["mqtt_server"] = config->mqtt_server;
-        doc["mqtt_port"] = config->mqtt_port;
-        doc["mqtt_username"] = config->mqtt_username;
-        doc["mqtt_password"] = config->mqtt_password;
-        doc["wifi_ssid"] = config->wifi_ssid;
-        doc["wifi_password"] = "";  // Don't send the password
-        doc["hub_id"] = config->hub_id;
+        // Broker address and hub ID are for the portal page only, not the LAN
+        if (!portalActive) {
+            request->send(403, "text/plain", "Configuration is only shown in portal mode");
+            return;
+        }
+        JsonDocument doc(psramJsonAllocator());
+        {
+            ConfigReader config(*configManager);
+            ConfigManager::toJson(*config, doc.to<JsonObject>(), false);  // No WiFi or MQTT credentials
+        }
         
         String response;
         serializeJson(doc, response);
         request->send(200, "application/json", response);
     });
     
-    server.on("/save", HTTP_POST, [](AsyncWebServerRequest *request){
-        // We'll handle the form in onBody
-    }, NULL, [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
-        // Handle form data
-        String dataStr = String((char*)data);
-        
-        JsonDocument doc;
-        DeserializationError error = deserializeJson(doc, dataStr);
-        
-        if (error) {
+    server.on("/save", HTTP_POST, [this](AsyncWebServerRequest *request){
+        // Runs once the whole body went through onBody
+        // In station mode the server is reachable from the whole LAN, only
+        // the portal AP may change the config
+        if (!portalActive) {
+            request->send(403, "text/plain", "Configuration is only accepted in portal mode");
+            return;
+        }
+        if (request->contentLength() > CONFIG_BODY_MAX) {
+            request->send(413, "text/plain", "Configuration too large");
+            return;
+        }
+        ConfigBodyParser* parser = (ConfigBodyParser*)request->_tempObject;
+        if (parser == nullptr) {
+            request->send(400, "text/plain", "Missing configuration");
+            return;
+        }
+        ConfigBodyStatus status = parser->finish();
+        if (status == BODY_TOO_LARGE) {
+            request->send(413, "text/plain", "Configuration too large");
+            return;
+        }
+        if (status != BODY_DONE) {
             request->send(400, "text/plain", "Invalid JSON");
             return;
         }
         
-        config->mqtt_server = doc["mqtt_server"].as<String>();
-        config->mqtt_port = doc["mqtt_port"];
-        config->mqtt_username = doc["mqtt_username"].as<String>();
-        config->mqtt_password = doc["mqtt_password"].as<String>();
-        config->wifi_ssid = doc["wifi_ssid"].as<String>();
-        
-        // Only update password if provided (not empty)
-        if (doc["wifi_password"].as<String>() != "") {
-            config->wifi_password = doc["wifi_password"].as<String>();
+        uint8_t changed = 0;
+        if (!configManager->apply(parser->result(), "portal", &changed)) {
+            request->send(500, "text/plain", "Failed to save configuration");
+            return;
         }
         
-        config->hub_id = doc["hub_id"].as<String>();
-        
-        if (configManager->saveConfig()) {
-            request->send(200, "text/plain", "Configuration saved. The system will restart.");
-            // Schedule a restart
-            delay(1000);
-            ESP.restart();
+        if (changed & CONFIG_CHANGED_WIFI) {
+            request->send(200, "text/plain", "Configuration applied. Reconnecting WiFi and MQTT.");
+        } else if (changed & CONFIG_CHANGED_MQTT) {
+            request->send(200, "text/plain", "Configuration applied. Reconnecting MQTT.");
         } else {
-            request->send(500, "text/plain", "Failed to save configuration");
+            request->send(200, "text/plain", "Configuration applied.");
+        }
+        
+        // Leave config mode once the reply is out, normal operation resumes
+        closeAtMs = millis() + PORTAL_CLOSE_DELAY;
+    }, NULL, [this](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
+        // Chunks are parsed as they arrive, the body is never held in memory.
+        // Oversized or unauthorised bodies are dropped from the first chunk on.
+        if (!portalActive || total > CONFIG_BODY_MAX) {
+            return;
+        }
+        if (index == 0) {
+            // Edit a copy of the live config; apply() publishes it without a
+            // reboot. The request frees _tempObject with free().
+            void* memory = malloc(sizeof(ConfigBodyParser));
+            if (memory == nullptr) {
+                return;
+            }
+            ConfigReader current(*configManager);
+            request->_tempObject = new (memory) ConfigBodyParser(*current);
+        }
+        ConfigBodyParser* parser = (ConfigBodyParser*)request->_tempObject;
+        if (parser != nullptr) {
+            parser->feed(data, len);
+        }
+    });
+    
+    server.on("/latency", HTTP_GET, [](AsyncWebServerRequest *request){
+#if ENABLE_LATENCY_TRACE
+        static char report[LATENCY_REPORT_SIZE];
+        latencyTracer.format(report, sizeof(report));
+        request->send(200, "text/plain", report);
+#else
+        request->send(404, "text/plain", "Latency tracing disabled");
+#endif
+    });
+    
+    server.on("/tasks", HTTP_GET, [](AsyncWebServerRequest *request){
+        static char report[TASK_REPORT_SIZE];
+        taskTable.format(report, sizeof(report));
+        request->send(200, "text/plain", report);
+    });
+    
+    server.on("/log", HTTP_GET, [this](AsyncWebServerRequest *request){
+        // Names nodes, local clients and topics. /tasks, /memory and
+        // /latency are bare figures and stay open to the LAN.
+        if (!portalActive) {
+            request->send(403, "text/plain", "The log is only shown in portal mode");
+            return;
         }
+        static char report[LOG_REPORT_SIZE];
+        eventLog.formatHistory(report, sizeof(report));
+        request->send(200, "text/plain", report);
+    });
+    
+    server.on("/memory", HTTP_GET, [](AsyncWebServerRequest *request){
+        static char report[MEMORY_REPORT_SIZE];
+        formatMemoryStats(report, sizeof(report));
+        request->send(200, "text/plain", report);
     });
     
-    server.on("/restart", HTTP_POST, [](AsyncWebServerRequest *request){
+    server.on("/restart", HTTP_POST, [this](AsyncWebServerRequest *request){
+        if (!portalActive) {
+            request->send(403, "text/plain", "Restart is only accepted in portal mode");
+            return;
+        }
         request->send(200, "text/plain", "Restarting...");
         delay(1000);
         ESP.restart();
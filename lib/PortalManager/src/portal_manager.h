@@ -3,22 +3,63 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <ESPAsyncWebServer.h>
-#include <SPIFFS.h>
+#include <DNSServer.h>
 #include "config.h"
 #include "config_manager.h"
+#include "config_body.h"
+#include "latency_tracer.h"
+#include "task_table.h"
+#include "event_log.h"
+#include "json_allocators.h"
+#include "live_feed.h"
+#include "web_asset.h"
 
-class PortalManager {
+// Static asset serving and page load figures, see GET /assets
+struct WebStats {
+    uint32_t requests;
+    uint32_t notModified;     // 304s, answered without a body
+    uint32_t bytesSent;       // gzip bytes
+    uint32_t rawBytes;        // What the same responses would have been uncompressed
+    uint32_t handlerUs;       // Time spent in the asset handlers
+    uint32_t pageLoads;       // Reported by pageload.js
+    uint32_t pageBytes;
+    uint32_t pageMs;
+    uint32_t pageMsMax;
+};
+
+// Serves the config portal in AP mode and the live dashboard in station
+// mode. Also the WebSocket transport for LiveFeed.
+class PortalManager : public LiveSink {
 public:
-    PortalManager(HubConfig* config, ConfigManager* configManager);
+    explicit PortalManager(ConfigManager* configManager);
     void begin();
+    // Starts the web server without the AP, safe to call repeatedly
+    bool startServer();
+    void setLiveFeed(LiveFeed* feed) { liveFeed = feed; }
+    // Closes the AP once a save has been answered
+    void loop();
+    void end();
     void handleClient();
     bool isActive() { return portalActive; }
     bool checkTrigger();
+    const WebStats& getWebStats() const { return webStats; }
+    size_t formatWebStats(char* out, size_t len) const;
+
+    // LiveSink
+    bool isBusy(uint32_t clientId) override;
+    void sendShared(const char* frame, size_t len, const uint32_t* clientIds, uint8_t count) override;
 
 private:
     AsyncWebServer server;
-    HubConfig* config;
+    AsyncWebSocket liveSocket;
+    DNSServer dnsServer;
+    WebStats webStats = {};
     ConfigManager* configManager;
+    LiveFeed* liveFeed = nullptr;
     bool portalActive = false;
+    bool serverStarted = false;
+    unsigned long closeAtMs = 0;
     void setupRoutes();
+    void sendAsset(AsyncWebServerRequest* request, const WebAsset* asset, bool immutable);
+    void onLiveEvent(AsyncWebSocketClient* client, AwsEventType type);
 };
\ No newline at end of file
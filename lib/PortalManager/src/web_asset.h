@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A gzipped file from data/, embedded by tools/embed_assets.py
+struct WebAsset {
+    const char* path;             // "/style.css"
+    const char* fingerprinted;    // "/style.1a2b3c4d.css", nullptr for pages
+    const char* contentType;
+    const char* etag;             // Strong ETag, quoted content hash
+    const uint8_t* data;          // gzip
+    size_t length;
+    size_t rawLength;             // Uncompressed size, for the stats
+};
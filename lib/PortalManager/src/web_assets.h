@@ -0,0 +1,270 @@
+// Generated by tools/embed_assets.py from data/, do not edit.
+#pragma once
+
+#include "web_asset.h"
+
+static const uint8_t asset_index_html[673] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xc5, 0x56, 0x4b, 0x73, 0xd3, 0x30,
+    0x10, 0xbe, 0xf7, 0x57, 0x08, 0x9f, 0x69, 0x4c, 0x0a, 0xe5, 0x35, 0xb6, 0x0f, 0xb4, 0x74, 0x60,
+    0xa6, 0x0c, 0x81, 0x96, 0x61, 0x38, 0x65, 0x64, 0x6b, 0x13, 0x8b, 0xca, 0xb2, 0x2b, 0xad, 0x13,
+    0xf2, 0xef, 0xd1, 0x2b, 0xb1, 0xe3, 0xb6, 0x43, 0x9a, 0x16, 0xc8, 0x25, 0x5e, 0xed, 0xee, 0xb7,
+    0xfb, 0xed, 0x6a, 0x25, 0x25, 0x4f, 0x4e, 0x3f, 0x9f, 0x5c, 0xfe, 0x98, 0xbc, 0x27, 0x25, 0x56,
+    0x22, 0x3b, 0x48, 0xd6, 0x7f, 0x40, 0x59, 0x76, 0x40, 0xcc, 0x2f, 0x41, 0x8e, 0x02, 0xb2, 0x4f,
+    0x5f, 0x2e, 0x2f, 0xc9, 0x87, 0x36, 0x27, 0x27, 0xb5, 0x9c, 0xf1, 0x79, 0xab, 0x28, 0xf2, 0x5a,
+    0x26, 0xb1, 0xd7, 0x7a, 0xcb, 0x0a, 0x90, 0x12, 0x49, 0x2b, 0x48, 0xa3, 0x05, 0x87, 0x65, 0x53,
+    0x2b, 0x8c, 0x48, 0x51, 0x4b, 0x04, 0x89, 0x69, 0xb4, 0xe4, 0x0c, 0xcb, 0x94, 0xc1, 0x82, 0x17,
+    0x70, 0xe8, 0x84, 0xa7, 0x84, 0x4b, 0x8e, 0x9c, 0x8a, 0x43, 0x5d, 0x50, 0x01, 0xe9, 0x38, 0x0a,
+    0x40, 0x82, 0xcb, 0x2b, 0xa2, 0x40, 0xa4, 0x91, 0xc6, 0x95, 0x00, 0x5d, 0x02, 0x18, 0x24, 0x5c,
+    0x35, 0x06, 0x19, 0xe1, 0x17, 0xc6, 0x85, 0xd6, 0x11, 0x29, 0x15, 0xcc, 0x82, 0xc5, 0xe8, 0xd9,
+    0xf3, 0xd7, 0xe3, 0xe2, 0x78, 0x7c, 0x3c, 0xb2, 0x1a, 0x93, 0x7f, 0xec, 0x09, 0x24, 0x79, 0xcd,
+    0x56, 0x01, 0x94, 0xf1, 0x05, 0x29, 0x04, 0xd5, 0x3a, 0x8d, 0x6c, 0x4e, 0x94, 0x4b, 0x50, 0x21,
+    0xa0, 0xd3, 0x97, 0xe3, 0x3b, 0x49, 0x1a, 0xd5, 0xc6, 0xae, 0x73, 0x98, 0xd5, 0xaa, 0x22, 0x9c,
+    0x39, 0x38, 0x63, 0x7d, 0x66, 0xc4, 0x1e, 0x9e, 0xc7, 0x3c, 0xca, 0x2c, 0xdc, 0x05, 0x20, 0x72,
+    0x39, 0xd7, 0x06, 0xe9, 0x68, 0x60, 0xd1, 0xcb, 0xca, 0xe2, 0x1d, 0xce, 0x55, 0xdd, 0x36, 0x03,
+    0x18, 0x5f, 0x13, 0x9a, 0x83, 0x20, 0xc6, 0x26, 0x8d, 0xca, 0x36, 0x9f, 0x72, 0x16, 0x39, 0xe8,
+    0x8f, 0xa7, 0x6f, 0x93, 0xd8, 0xe9, 0x6e, 0xf1, 0xe1, 0xb2, 0x69, 0xb1, 0x57, 0xb7, 0xc8, 0xa5,
+    0x1b, 0xdc, 0x43, 0xa7, 0xd6, 0x92, 0x82, 0xeb, 0x96, 0x2b, 0x60, 0x83, 0xfc, 0x62, 0x93, 0xe0,
+    0xf6, 0xd2, 0x0d, 0x86, 0xdf, 0xf9, 0x19, 0x7f, 0x6c, 0x8a, 0x4b, 0x3e, 0xe3, 0x53, 0xad, 0x2d,
+    0x4b, 0x0f, 0x7f, 0xb1, 0x07, 0xd1, 0x0e, 0x24, 0x70, 0xed, 0x2d, 0xec, 0x4c, 0x77, 0xff, 0xf4,
+    0x1b, 0xe3, 0xb3, 0xac, 0xd5, 0x9a, 0xc2, 0x24, 0x88, 0x3b, 0xd2, 0xd8, 0x78, 0x77, 0x54, 0xba,
+    0xa5, 0x1e, 0x9d, 0x2e, 0xca, 0x4d, 0x3c, 0x5d, 0x51, 0x21, 0xb2, 0x73, 0xa0, 0x0b, 0x20, 0xb9,
+    0xa0, 0x66, 0xa8, 0xb0, 0x26, 0x57, 0x00, 0x0d, 0x29, 0x5a, 0xa5, 0xcc, 0x54, 0x92, 0xb5, 0x77,
+    0x12, 0x7b, 0xdb, 0x7b, 0x37, 0xdf, 0x8d, 0xcc, 0x23, 0x37, 0xbf, 0xba, 0x46, 0x9c, 0x6a, 0x50,
+    0x0b, 0x3b, 0xa0, 0x21, 0x80, 0x15, 0xee, 0xbd, 0x01, 0xfa, 0x40, 0xa1, 0x66, 0x5b, 0x4b, 0x7f,
+    0x77, 0x13, 0xb8, 0x50, 0xee, 0x10, 0xf4, 0x24, 0x26, 0xe6, 0x73, 0x47, 0x0a, 0xb2, 0xad, 0x72,
+    0x9b, 0xe0, 0x86, 0x84, 0x3f, 0x4b, 0x7b, 0x14, 0xfc, 0xc2, 0x3f, 0x20, 0xd0, 0x9a, 0x62, 0xd9,
+    0xb8, 0x81, 0xc4, 0xb7, 0x20, 0xee, 0xd7, 0x8b, 0x0d, 0x58, 0x9f, 0x4a, 0x17, 0x61, 0x9f, 0x1d,
+    0xbc, 0xf6, 0xde, 0x75, 0x07, 0x3f, 0xa0, 0x95, 0x9b, 0x49, 0xf3, 0xed, 0x7c, 0xc8, 0x3c, 0x6f,
+    0x03, 0x6e, 0x35, 0xf6, 0x3f, 0xce, 0x73, 0xaf, 0x34, 0x79, 0x8b, 0x58, 0xcb, 0xbb, 0x8b, 0xe3,
+    0xf5, 0x81, 0x9b, 0x6e, 0xf3, 0x8a, 0xdb, 0xbb, 0xde, 0xfb, 0x36, 0x8a, 0x57, 0x54, 0xad, 0xa2,
+    0xec, 0xc2, 0x26, 0x3a, 0xb8, 0x4b, 0xbd, 0xe3, 0x9f, 0x10, 0xbd, 0xe0, 0x6b, 0xa5, 0x40, 0x23,
+    0x55, 0xf8, 0x0e, 0xe5, 0x26, 0x82, 0x06, 0x73, 0xe7, 0x32, 0x17, 0xe3, 0xab, 0xd7, 0xda, 0x6b,
+    0xfb, 0x76, 0xf0, 0x01, 0xeb, 0x24, 0xb6, 0x5d, 0xbf, 0xed, 0x3e, 0xb7, 0xec, 0x6d, 0x3c, 0x83,
+    0x87, 0xad, 0x79, 0x45, 0x0c, 0x1d, 0x9b, 0x2c, 0xa1, 0xe1, 0xd1, 0x11, 0x0b, 0xbe, 0x80, 0x91,
+    0x7d, 0x2b, 0x45, 0xd9, 0xb9, 0xf9, 0x24, 0x8c, 0xea, 0x32, 0xaf, 0xa9, 0x2d, 0x3c, 0x35, 0x8e,
+    0x4d, 0x78, 0x73, 0x74, 0x08, 0x5e, 0xd6, 0x85, 0xe2, 0x0d, 0x12, 0xad, 0x0a, 0x13, 0xc6, 0x7d,
+    0x8f, 0x8a, 0x37, 0x39, 0x2d, 0x72, 0xf6, 0x72, 0xf4, 0xd3, 0x85, 0xf4, 0xab, 0xd9, 0x4d, 0xf3,
+    0x86, 0xce, 0x41, 0xd4, 0x94, 0x8d, 0x5e, 0x8d, 0x81, 0xbe, 0xc8, 0x19, 0x1b, 0x38, 0x18, 0xf2,
+    0xee, 0xad, 0x63, 0xce, 0x60, 0xfb, 0x84, 0xfb, 0x0d, 0xac, 0xfd, 0xa6, 0xf8, 0xd9, 0x09, 0x00,
+    0x00,
+};
+
+static const uint8_t asset_live_html[399] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x75, 0x53, 0x4d, 0x53, 0xe3, 0x30,
+    0x0c, 0xbd, 0xf3, 0x2b, 0x8c, 0xcf, 0xdb, 0x64, 0x53, 0x3e, 0xba, 0x87, 0x24, 0x17, 0x76, 0x67,
+    0x38, 0x00, 0x0b, 0x4c, 0x2f, 0x1c, 0x1d, 0x5b, 0x10, 0xb1, 0x8e, 0x93, 0xb1, 0xd5, 0xb2, 0xfd,
+    0xf7, 0x28, 0x76, 0x48, 0xf9, 0x28, 0xb9, 0xd8, 0xd2, 0x7b, 0x7a, 0x7a, 0x96, 0x26, 0xe5, 0xf1,
+    0xef, 0xbf, 0x17, 0xeb, 0x87, 0xdb, 0x3f, 0xa2, 0xa5, 0xce, 0xd6, 0x47, 0xe5, 0xdb, 0x01, 0xca,
+    0xd4, 0x47, 0x82, 0xbf, 0x92, 0x90, 0x2c, 0xd4, 0xd7, 0x77, 0xeb, 0xb5, 0xb8, 0xdc, 0x34, 0xe2,
+    0x0a, 0xb7, 0x50, 0xe6, 0x29, 0x99, 0x08, 0x1d, 0x90, 0x12, 0x4e, 0x75, 0x50, 0xc9, 0x2d, 0xc2,
+    0xcb, 0xd0, 0x7b, 0x92, 0x42, 0xf7, 0x8e, 0xc0, 0x51, 0x25, 0x5f, 0xd0, 0x50, 0x5b, 0x19, 0xd8,
+    0xa2, 0x86, 0x45, 0x0c, 0x7e, 0x08, 0x74, 0x48, 0xa8, 0xec, 0x22, 0x68, 0x65, 0xa1, 0x2a, 0xe4,
+    0x24, 0x64, 0xd1, 0xfd, 0x13, 0x1e, 0x6c, 0x25, 0x03, 0xed, 0x2c, 0x84, 0x16, 0x80, 0x95, 0x68,
+    0x37, 0xb0, 0x32, 0xc1, 0x7f, 0xca, 0x75, 0x08, 0x52, 0xb4, 0x1e, 0x1e, 0x27, 0x46, 0xf6, 0xf3,
+    0xe4, 0x57, 0xa1, 0xcf, 0x8a, 0xb3, 0x6c, 0x44, 0xd8, 0x76, 0x9e, 0x7c, 0x97, 0x4d, 0x6f, 0x76,
+    0x93, 0xa8, 0xc1, 0xad, 0xd0, 0x56, 0x85, 0x50, 0xc9, 0xd1, 0x93, 0x42, 0x07, 0x7e, 0x6a, 0x18,
+    0xf1, 0xb6, 0xf8, 0xfc, 0x36, 0xce, 0xcc, 0xf0, 0x3b, 0xde, 0xb2, 0x66, 0x0a, 0xa3, 0xcb, 0x77,
+    0xc5, 0xa4, 0x1a, 0x0b, 0x02, 0x4d, 0x25, 0x79, 0x08, 0x1e, 0x35, 0xdb, 0x9b, 0x7a, 0x59, 0x96,
+    0x5a, 0x44, 0x58, 0xd6, 0x3c, 0xae, 0xf1, 0xf2, 0x8d, 0xea, 0x4d, 0x6f, 0x20, 0x1c, 0xd4, 0x3d,
+    0x20, 0x35, 0x53, 0x12, 0x6d, 0xbf, 0xa6, 0x8f, 0x79, 0x5f, 0x33, 0x16, 0x95, 0xb9, 0x77, 0x1b,
+    0x83, 0x35, 0x74, 0xc3, 0x1c, 0x5c, 0x6e, 0x3a, 0x34, 0x48, 0xbb, 0x39, 0x71, 0xdd, 0x63, 0xa0,
+    0x8d, 0xdf, 0xd3, 0xef, 0x59, 0x19, 0xdd, 0x53, 0x98, 0x13, 0x57, 0x2a, 0x90, 0x08, 0x00, 0x2e,
+    0x65, 0x72, 0xee, 0xf1, 0xd1, 0x4c, 0x7e, 0xc0, 0x4d, 0x49, 0xe3, 0x26, 0xe2, 0x80, 0xdc, 0xf8,
+    0xcc, 0x38, 0x8b, 0xfd, 0x72, 0xa6, 0xba, 0xef, 0x86, 0x33, 0xae, 0x6e, 0x2c, 0x0d, 0xa4, 0x68,
+    0x13, 0x6b, 0x39, 0x33, 0xad, 0x75, 0x7f, 0x4d, 0x71, 0xd0, 0x1e, 0x07, 0x36, 0xe8, 0x75, 0x1a,
+    0x58, 0xb6, 0x3c, 0x5f, 0x36, 0xab, 0xc7, 0xe6, 0x34, 0x7b, 0x8e, 0x95, 0x09, 0xaf, 0xbf, 0x92,
+    0x07, 0xf5, 0x04, 0xb6, 0x57, 0x26, 0x5b, 0x15, 0xa0, 0x4e, 0x1b, 0x63, 0x3e, 0x15, 0x94, 0x79,
+    0xf2, 0xcb, 0x1b, 0x8a, 0xbf, 0xc6, 0x2b, 0x90, 0x3e, 0xe3, 0x1d, 0x32, 0x03, 0x00, 0x00,
+};
+
+static const uint8_t asset_live_js[852] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xa5, 0x56, 0x4b, 0x6f, 0xdb, 0x38,
+    0x10, 0xbe, 0xe7, 0x57, 0xcc, 0x4d, 0x32, 0xea, 0xd2, 0xe9, 0x1e, 0x6b, 0xa4, 0x45, 0x37, 0x0f,
+    0xb4, 0x8b, 0x26, 0x01, 0x9a, 0x16, 0x3d, 0x14, 0x8b, 0x05, 0x4d, 0x4e, 0x6c, 0x36, 0x14, 0x69,
+    0x90, 0xa3, 0xb8, 0x46, 0xe0, 0xff, 0xde, 0xa1, 0x28, 0xdb, 0xf2, 0x2b, 0x1b, 0xef, 0xea, 0x20,
+    0x90, 0xe2, 0xcc, 0x37, 0xef, 0x8f, 0xd2, 0x5e, 0xd5, 0x15, 0x3a, 0x12, 0x52, 0xeb, 0xcb, 0x47,
+    0x5e, 0x7c, 0x36, 0x91, 0xd0, 0x61, 0x28, 0x8b, 0x8b, 0xdb, 0xeb, 0x73, 0xef, 0x28, 0x7d, 0xf3,
+    0x52, 0xa3, 0x2e, 0xfa, 0x70, 0x5f, 0x3b, 0x45, 0xc6, 0xbb, 0xb2, 0x07, 0x4f, 0x27, 0xc0, 0x8f,
+    0xf2, 0x2e, 0x12, 0x38, 0xaf, 0x31, 0xc2, 0x19, 0x3c, 0x2d, 0x86, 0xcd, 0x57, 0x8b, 0x04, 0x56,
+    0x46, 0xba, 0x0a, 0xb2, 0xc2, 0x0f, 0xc4, 0x27, 0xa7, 0x9b, 0x07, 0xdf, 0xa6, 0x64, 0x2a, 0x5c,
+    0x7f, 0x6f, 0x5e, 0x4b, 0xf0, 0x04, 0xea, 0x50, 0xd1, 0xca, 0xc8, 0xda, 0x50, 0xf4, 0xea, 0x01,
+    0x13, 0x9e, 0xc3, 0x19, 0x7c, 0xc7, 0xd1, 0x5d, 0xb3, 0x2f, 0x8b, 0x59, 0x7c, 0x3b, 0x18, 0x14,
+    0xf0, 0x0a, 0xac, 0x57, 0x32, 0x61, 0x88, 0x89, 0x67, 0xf1, 0x57, 0x50, 0x0c, 0xac, 0x79, 0xc4,
+    0xa2, 0x37, 0x5c, 0x01, 0xad, 0x16, 0x19, 0x4b, 0x78, 0xe7, 0xa7, 0xe8, 0x18, 0x72, 0x27, 0xb6,
+    0x95, 0xe0, 0xc4, 0xcf, 0xee, 0x48, 0x52, 0x1d, 0xcb, 0xe2, 0x3c, 0xbb, 0xd6, 0x24, 0x83, 0x42,
+    0x8d, 0x1d, 0xe0, 0xc5, 0x73, 0x36, 0x2a, 0x8c, 0x51, 0x8e, 0xb1, 0x6b, 0x06, 0x53, 0xb6, 0xb7,
+    0x6d, 0xe5, 0x30, 0xef, 0x53, 0xde, 0x58, 0xf6, 0xaf, 0xbb, 0xdb, 0x1b, 0x31, 0x95, 0x21, 0x62,
+    0x96, 0x16, 0x5a, 0x92, 0xec, 0x98, 0x4c, 0xcf, 0x60, 0x00, 0x1f, 0x18, 0xd4, 0xda, 0x56, 0x2b,
+    0xe0, 0xd4, 0x4a, 0xc5, 0xe5, 0x60, 0x8d, 0x30, 0xa7, 0x89, 0x71, 0xe3, 0x3e, 0x68, 0xb4, 0x24,
+    0x23, 0x78, 0x67, 0xe7, 0xa0, 0x64, 0x08, 0xfc, 0x9e, 0x48, 0x37, 0x46, 0x9d, 0x4b, 0xb7, 0x01,
+    0x68, 0xee, 0xa1, 0x6c, 0xa0, 0x44, 0x42, 0xdd, 0x76, 0xb0, 0x29, 0x94, 0x0f, 0x50, 0x66, 0x4f,
+    0x8d, 0x06, 0xe3, 0x32, 0x48, 0x2f, 0x59, 0x41, 0xc2, 0xbc, 0xfb, 0x61, 0xf4, 0xdf, 0x9b, 0x8e,
+    0x2e, 0x36, 0x76, 0xd9, 0x42, 0x23, 0x2a, 0x18, 0xef, 0x52, 0xaa, 0x49, 0x99, 0x76, 0x70, 0xf6,
+    0xae, 0x05, 0x48, 0x6f, 0xc1, 0x28, 0xa9, 0xda, 0xbc, 0xdc, 0x0a, 0x7b, 0xb3, 0xbd, 0x2e, 0x24,
+    0x25, 0xb0, 0x59, 0xb9, 0x47, 0x6a, 0xd5, 0x6b, 0xd9, 0x64, 0xdd, 0x6c, 0xff, 0xa9, 0xe2, 0xf0,
+    0x40, 0xd4, 0x15, 0x52, 0x30, 0x8a, 0xc3, 0x09, 0xe8, 0x34, 0x86, 0xeb, 0xbc, 0xdd, 0x3a, 0xdc,
+    0x54, 0xce, 0x92, 0x37, 0xc9, 0xed, 0xf2, 0xa5, 0x1d, 0xa1, 0xac, 0x8f, 0xf8, 0xd2, 0xb6, 0xbb,
+    0x30, 0x51, 0x2d, 0x3b, 0xaf, 0xcf, 0xe6, 0x28, 0xcc, 0xb9, 0xae, 0x42, 0x88, 0x34, 0x93, 0xd2,
+    0xc6, 0xed, 0xec, 0x44, 0xa4, 0xaf, 0x1c, 0xa5, 0xaf, 0xa9, 0x6c, 0xf5, 0xfa, 0xf0, 0xc7, 0xe9,
+    0xe9, 0xe9, 0xae, 0x73, 0x8b, 0x3d, 0xf3, 0xb7, 0x19, 0xf8, 0x2a, 0x1f, 0xdb, 0xc3, 0x48, 0x72,
+    0x64, 0x53, 0x04, 0x7a, 0x49, 0x21, 0x63, 0xa4, 0x4b, 0x8b, 0x69, 0xf9, 0xe7, 0xfc, 0x93, 0x2e,
+    0x8b, 0x56, 0xb3, 0x3b, 0x7d, 0x8d, 0x8e, 0x30, 0xec, 0x52, 0xf8, 0xf8, 0xf5, 0xfa, 0x33, 0x6b,
+    0x17, 0xc5, 0xfa, 0xb4, 0xd3, 0x58, 0x0f, 0x38, 0x4f, 0x9d, 0xb5, 0xc7, 0xf8, 0xda, 0x81, 0xe0,
+    0x67, 0x0c, 0xb0, 0x84, 0x8c, 0x18, 0xe8, 0xcb, 0x6e, 0x0b, 0xb0, 0x50, 0x7b, 0x78, 0x8e, 0xd6,
+    0x96, 0x3d, 0x41, 0xf8, 0x8b, 0x5a, 0x5e, 0x63, 0x6d, 0xb6, 0x73, 0x94, 0x7c, 0xeb, 0xd0, 0x0f,
+    0xd6, 0xeb, 0xf4, 0xf7, 0xe2, 0x5f, 0x72, 0xd9, 0xb6, 0xc6, 0x4e, 0x0a, 0x47, 0x5e, 0xcf, 0x9f,
+    0xcb, 0x60, 0x33, 0x09, 0xdd, 0xfc, 0x25, 0x85, 0x83, 0xe9, 0x4b, 0x54, 0x30, 0xe6, 0xc9, 0x97,
+    0x21, 0xd1, 0x80, 0x65, 0x22, 0x7c, 0x44, 0x20, 0x0f, 0x34, 0xc1, 0xdc, 0xfc, 0x7d, 0x0e, 0x17,
+    0xa7, 0x69, 0x5f, 0x01, 0x19, 0xf5, 0xc0, 0x3d, 0x04, 0x23, 0xa4, 0x19, 0x32, 0x01, 0x36, 0x02,
+    0x71, 0x9b, 0x6f, 0x8d, 0x53, 0x78, 0xd5, 0xb2, 0xd1, 0x7a, 0xc8, 0xe0, 0x75, 0x77, 0xfe, 0xd6,
+    0x0e, 0xdc, 0x8e, 0x7e, 0x72, 0xab, 0x09, 0xce, 0x4d, 0x2c, 0x33, 0x27, 0x88, 0xe8, 0x03, 0x13,
+    0xf9, 0x6a, 0xc4, 0x99, 0x2f, 0x78, 0xc0, 0xf7, 0x15, 0x33, 0x0f, 0xff, 0x21, 0xf2, 0xe8, 0x16,
+    0xbc, 0xcd, 0xc1, 0x7f, 0xab, 0xb7, 0xd1, 0x47, 0x89, 0x37, 0x24, 0x44, 0x58, 0x4d, 0xe1, 0xec,
+    0x8c, 0x77, 0x89, 0x66, 0xdf, 0x43, 0xf1, 0xba, 0x80, 0xb7, 0xeb, 0x23, 0x41, 0xfe, 0xca, 0xfc,
+    0x42, 0x5d, 0xbe, 0xe9, 0x1d, 0x8f, 0x3d, 0xa9, 0x2b, 0xa3, 0x0d, 0xcd, 0x0f, 0xe0, 0x2f, 0x8f,
+    0xff, 0x97, 0x8d, 0xca, 0xf3, 0x9d, 0x5e, 0x07, 0x3c, 0x5e, 0x53, 0xf9, 0xda, 0xd1, 0x51, 0x6a,
+    0xd7, 0x92, 0x26, 0x22, 0xb0, 0x9a, 0x2e, 0x9b, 0x16, 0x10, 0x7c, 0xeb, 0x31, 0xd9, 0xf2, 0x55,
+    0xbc, 0xee, 0xa5, 0x1e, 0x0c, 0xe0, 0x4d, 0x62, 0xa3, 0x74, 0x41, 0x43, 0xec, 0x74, 0xf0, 0xa2,
+    0x77, 0x98, 0x95, 0x3a, 0x7c, 0xd8, 0xde, 0xa6, 0x7d, 0x30, 0xf1, 0xae, 0x56, 0x7c, 0xd9, 0xed,
+    0x61, 0xa7, 0xd8, 0x88, 0x3e, 0x37, 0x5c, 0x59, 0xa2, 0x3b, 0x5d, 0xf9, 0xcb, 0xce, 0xc4, 0x37,
+    0xc6, 0x76, 0xa4, 0x14, 0x8f, 0x40, 0xbc, 0xc9, 0xa3, 0xb1, 0xf2, 0x23, 0x55, 0x2f, 0xe6, 0x65,
+    0xaa, 0x61, 0x81, 0x21, 0xf8, 0x50, 0xec, 0x04, 0xc5, 0xfc, 0xfc, 0x89, 0xf1, 0xc3, 0xa3, 0xb4,
+    0x65, 0xf7, 0x02, 0x68, 0xae, 0xa1, 0xce, 0x68, 0xf5, 0xb6, 0xae, 0x16, 0x58, 0xf4, 0x73, 0xe6,
+    0x86, 0xcb, 0xbf, 0xaf, 0xfc, 0xa3, 0x34, 0x3c, 0x49, 0x99, 0xfb, 0x0d, 0x05, 0xc8, 0xc2, 0x90,
+    0xcc, 0x09, 0x00, 0x00,
+};
+
+static const uint8_t asset_pageload_js[377] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x7d, 0x91, 0x4d, 0x4f, 0xc3, 0x30,
+    0x0c, 0x86, 0xef, 0xfc, 0x0a, 0x73, 0xa1, 0xa9, 0x36, 0x5a, 0xee, 0xa8, 0x20, 0x0d, 0xed, 0x80,
+    0x04, 0x17, 0x3e, 0x4e, 0x88, 0x43, 0x68, 0xdc, 0x35, 0x52, 0x1b, 0x57, 0x4e, 0x3a, 0x34, 0xd8,
+    0xfe, 0x3b, 0x4e, 0x28, 0xdf, 0x13, 0x96, 0x2a, 0x39, 0xd1, 0x9b, 0xe7, 0x7d, 0xed, 0x96, 0x25,
+    0xdc, 0xe0, 0x40, 0x1c, 0x3c, 0x3c, 0x6d, 0x02, 0x7a, 0x08, 0xac, 0x9d, 0x6f, 0x90, 0x19, 0x0d,
+    0x68, 0x67, 0xa0, 0x23, 0x6d, 0x20, 0xd8, 0x1e, 0x81, 0x1a, 0x08, 0xad, 0xf5, 0x30, 0xe8, 0x15,
+    0x42, 0x20, 0x39, 0x20, 0xb4, 0xe3, 0xd3, 0xc1, 0xb3, 0x75, 0x86, 0x9e, 0x0b, 0x6d, 0xcc, 0x72,
+    0x8d, 0x2e, 0x5c, 0x59, 0x1f, 0xd0, 0x21, 0xab, 0x2c, 0x3e, 0xcd, 0xe6, 0xd0, 0x8c, 0xae, 0x0e,
+    0x96, 0x9c, 0xca, 0xe1, 0xf5, 0x00, 0xa4, 0xca, 0x32, 0x51, 0x93, 0x7a, 0x29, 0x16, 0xc2, 0x24,
+    0xd7, 0x6d, 0xc0, 0x63, 0x90, 0xa6, 0xc6, 0x44, 0x4e, 0xbe, 0xad, 0x24, 0xe8, 0x90, 0xbd, 0x34,
+    0x6b, 0x04, 0xc6, 0x30, 0xb2, 0x43, 0x93, 0x20, 0x22, 0xbe, 0x93, 0x54, 0x34, 0x06, 0xf5, 0xc7,
+    0x20, 0x56, 0x4d, 0xce, 0x07, 0x70, 0x7a, 0x0d, 0x15, 0x0c, 0xc8, 0x0d, 0x71, 0xaf, 0x85, 0x5d,
+    0xac, 0x50, 0x3c, 0x03, 0x5b, 0xf4, 0x8b, 0xcd, 0xdd, 0x66, 0x40, 0x95, 0x89, 0xc6, 0xae, 0x74,
+    0x04, 0x64, 0xf9, 0xc3, 0xc9, 0xe3, 0xe9, 0x27, 0xc2, 0x36, 0xa0, 0x0e, 0x23, 0x61, 0xbb, 0x85,
+    0xc3, 0x49, 0x45, 0x5c, 0x78, 0x74, 0x66, 0x81, 0x5a, 0x0c, 0xf2, 0x29, 0xd2, 0xd7, 0x93, 0x4e,
+    0x46, 0x78, 0xdf, 0x63, 0x15, 0xbd, 0x8b, 0x8f, 0x6d, 0xde, 0xda, 0x17, 0xfc, 0x52, 0xfd, 0x9f,
+    0x87, 0xd1, 0xd3, 0xc8, 0x35, 0x66, 0x79, 0x21, 0xaa, 0xa5, 0xae, 0x5b, 0xc5, 0x50, 0x9d, 0x4d,
+    0xdc, 0x59, 0x05, 0xfc, 0x03, 0x9b, 0x9f, 0xfe, 0x9a, 0xb9, 0x8f, 0xe6, 0xd7, 0x3a, 0xb4, 0x05,
+    0xd3, 0xe8, 0x8c, 0x8a, 0x39, 0x7e, 0xec, 0xfb, 0x38, 0x45, 0xf3, 0x41, 0x73, 0x5a, 0xe1, 0x37,
+    0xc0, 0xbe, 0x21, 0x55, 0x56, 0xc6, 0x3f, 0x1e, 0x09, 0xe7, 0xb1, 0xa9, 0x32, 0x98, 0x01, 0xba,
+    0x9a, 0x0c, 0xde, 0xdf, 0x5c, 0x5e, 0x50, 0x3f, 0x90, 0x13, 0xb0, 0xea, 0xa8, 0x4e, 0x4b, 0x2c,
+    0x06, 0xb1, 0x76, 0x5a, 0xb8, 0x30, 0xfb, 0x04, 0xef, 0xad, 0xec, 0x28, 0x8d, 0x94, 0x80, 0xd3,
+    0x70, 0x72, 0xd7, 0xbf, 0x5f, 0xf4, 0x7e, 0xca, 0xb5, 0x9b, 0xc3, 0x89, 0xb4, 0x3b, 0xf9, 0xde,
+    0x00, 0x39, 0x43, 0x58, 0x28, 0xad, 0x02, 0x00, 0x00,
+};
+
+static const uint8_t asset_script_js[837] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xa5, 0x56, 0x4d, 0x6f, 0xdb, 0x30,
+    0x0c, 0xbd, 0xf7, 0x57, 0xf0, 0x26, 0x1b, 0xc8, 0x1c, 0x0c, 0xbb, 0x14, 0x29, 0xb6, 0xa2, 0x5d,
+    0x3b, 0xac, 0xc3, 0xfa, 0x31, 0x34, 0x3b, 0x17, 0x8a, 0x4d, 0x27, 0x5e, 0x6c, 0xc9, 0x93, 0xe4,
+    0x64, 0x41, 0x9b, 0xff, 0x3e, 0xca, 0x96, 0x13, 0x3b, 0x71, 0xbe, 0x36, 0x9d, 0x64, 0x89, 0x7c,
+    0xa4, 0xc8, 0xa7, 0x27, 0x47, 0x32, 0x2c, 0x32, 0x14, 0x26, 0xe0, 0x51, 0x74, 0x3b, 0xa3, 0xc9,
+    0xf7, 0x44, 0x1b, 0x14, 0xa8, 0x3c, 0x76, 0xf3, 0x78, 0xff, 0x59, 0x0a, 0x63, 0xd7, 0x24, 0x8f,
+    0x30, 0x62, 0x3d, 0x88, 0x0b, 0x11, 0x9a, 0x44, 0x0a, 0xcf, 0x87, 0xd7, 0x33, 0xa0, 0xd1, 0xef,
+    0x83, 0xdd, 0x84, 0xb0, 0x50, 0x8a, 0x0c, 0x21, 0x94, 0x22, 0x4e, 0xc6, 0x85, 0xe2, 0xd6, 0xaa,
+    0xb4, 0x88, 0xd1, 0x84, 0x13, 0x8f, 0xf5, 0xab, 0x1d, 0xe6, 0x97, 0x8b, 0x76, 0x04, 0x66, 0x82,
+    0xc2, 0x53, 0xa8, 0x73, 0x29, 0x34, 0xc2, 0xc7, 0x4f, 0x50, 0xcf, 0x83, 0x5f, 0xda, 0x86, 0xd8,
+    0x34, 0x8d, 0xb8, 0xe1, 0xd6, 0xec, 0x75, 0xb5, 0x6e, 0x47, 0x54, 0x1f, 0x60, 0x8c, 0xe6, 0x36,
+    0x45, 0x3b, 0xbd, 0x5e, 0xdc, 0x45, 0x1e, 0x9b, 0x14, 0xa3, 0x97, 0x24, 0x62, 0x7e, 0x30, 0xe3,
+    0x69, 0x41, 0xf8, 0x60, 0xfd, 0x83, 0x6a, 0x15, 0xde, 0xde, 0x80, 0xb1, 0x8b, 0xe3, 0x80, 0xe6,
+    0x49, 0x9c, 0xbc, 0x68, 0xbd, 0x8d, 0xb5, 0xda, 0x38, 0x09, 0x2e, 0xfb, 0x6d, 0xcc, 0x8b, 0x46,
+    0x35, 0x43, 0xb5, 0x09, 0xd8, 0xd8, 0x3a, 0x1d, 0x32, 0x97, 0xca, 0x74, 0x02, 0xda, 0x0d, 0x0b,
+    0xf7, 0xfe, 0xfc, 0xfc, 0xc3, 0x1a, 0x70, 0xd9, 0x28, 0x6f, 0xc8, 0x6d, 0x8f, 0x50, 0x29, 0xa9,
+    0xb6, 0x0b, 0x4c, 0x8d, 0xd3, 0x32, 0xc5, 0xa0, 0xdc, 0xf6, 0xd8, 0x6d, 0x69, 0x95, 0x52, 0xd3,
+    0x13, 0x31, 0x76, 0xfd, 0x1e, 0x10, 0x35, 0xca, 0x6d, 0xbf, 0x9d, 0xb0, 0x9e, 0xc8, 0xf9, 0xb3,
+    0xe1, 0xa6, 0xd0, 0xdd, 0x7e, 0x8e, 0x27, 0x96, 0x58, 0x3c, 0xd5, 0xe8, 0x37, 0xb3, 0xab, 0xe6,
+    0x35, 0xc9, 0xbe, 0x72, 0x11, 0xa5, 0x08, 0xb1, 0x54, 0x19, 0xe8, 0x62, 0x94, 0x25, 0x54, 0x76,
+    0x47, 0xb0, 0x9d, 0x55, 0xa9, 0x62, 0x7c, 0x21, 0x17, 0x2a, 0xcb, 0x36, 0xbd, 0x4b, 0x18, 0xd3,
+    0x24, 0x35, 0xfa, 0x8d, 0xa3, 0x63, 0x90, 0x2b, 0xb4, 0x1e, 0x37, 0x18, 0xf3, 0x22, 0x35, 0x5e,
+    0x23, 0xbb, 0xb3, 0x66, 0x6d, 0x6a, 0xd2, 0x53, 0xcd, 0xdb, 0x85, 0xab, 0xa8, 0x36, 0x38, 0x96,
+    0xa1, 0xbd, 0x96, 0xf3, 0x8a, 0x5b, 0x83, 0x13, 0x88, 0xd9, 0x01, 0x91, 0x73, 0xad, 0xe7, 0x52,
+    0x1d, 0x84, 0xa9, 0xed, 0xba, 0xa1, 0x1a, 0xc4, 0x1c, 0x9c, 0xc4, 0xec, 0x0e, 0x18, 0x4b, 0xc7,
+    0x01, 0xe4, 0x5c, 0x69, 0xbc, 0x13, 0xc6, 0x3b, 0x9e, 0xd4, 0x6b, 0xc2, 0x2e, 0xd7, 0xad, 0x20,
+    0x6e, 0x38, 0x69, 0xa1, 0xbc, 0x50, 0x0b, 0x66, 0x40, 0xa3, 0x88, 0x80, 0x14, 0x03, 0xee, 0x7f,
+    0x0c, 0x87, 0x10, 0x2a, 0x8c, 0x08, 0x33, 0x21, 0x82, 0xc1, 0x88, 0x87, 0xd3, 0x1e, 0x8c, 0x52,
+    0x2e, 0xa6, 0x30, 0x45, 0xcc, 0xb5, 0x35, 0xcb, 0x36, 0xba, 0x69, 0xe3, 0xfe, 0xa4, 0x53, 0x08,
+    0x9e, 0x95, 0xf7, 0x68, 0x6f, 0x7e, 0x85, 0x33, 0xac, 0x73, 0xbc, 0xe8, 0x00, 0x7b, 0x72, 0xa5,
+    0x3d, 0x08, 0xb6, 0xd9, 0x83, 0x35, 0x58, 0x12, 0x83, 0xd7, 0xcc, 0xcb, 0xdf, 0xbe, 0xa3, 0x54,
+    0x81, 0xa0, 0x95, 0x12, 0x85, 0x6b, 0xba, 0x34, 0xee, 0xd6, 0x16, 0x6c, 0x9d, 0xe1, 0x3e, 0xd8,
+    0x7c, 0x7d, 0x8a, 0xa6, 0x4b, 0x17, 0xec, 0x6a, 0x52, 0x6b, 0xbf, 0xe6, 0x33, 0xa4, 0x8b, 0xd6,
+    0x06, 0xcf, 0xd0, 0x4c, 0x24, 0xf1, 0x92, 0x3d, 0x3d, 0x3e, 0x0f, 0x59, 0x9b, 0x28, 0x13, 0xa4,
+    0x07, 0x47, 0xe9, 0xc1, 0x86, 0x8b, 0x1d, 0xcc, 0xbd, 0x49, 0xef, 0x86, 0x8b, 0x1c, 0x19, 0xb9,
+    0xf3, 0x3c, 0x4f, 0x93, 0xb0, 0x14, 0x92, 0xbe, 0x7d, 0x38, 0x36, 0xa0, 0x96, 0xed, 0xcf, 0x91,
+    0x8c, 0x16, 0x03, 0xf8, 0xf6, 0xfc, 0xf8, 0x10, 0x68, 0xa3, 0x48, 0x8a, 0x92, 0x78, 0xe1, 0x55,
+    0xe7, 0xf4, 0x7b, 0x9d, 0xe2, 0xb8, 0xfb, 0x99, 0x32, 0xf8, 0xc7, 0x1c, 0xfb, 0x4c, 0x11, 0x4f,
+    0xaf, 0x6c, 0xa2, 0x18, 0x41, 0x9a, 0xcc, 0xb0, 0x57, 0x12, 0x94, 0x04, 0x00, 0x84, 0x24, 0x51,
+    0x14, 0x63, 0x52, 0x7c, 0xc2, 0x35, 0x5c, 0x19, 0x0d, 0x3c, 0x36, 0xf4, 0xc9, 0xc1, 0x96, 0x6d,
+    0x97, 0x9e, 0xda, 0x28, 0x04, 0xa2, 0x8a, 0xb6, 0x6a, 0xfe, 0x8f, 0xa6, 0x53, 0xb8, 0x7f, 0x91,
+    0xf4, 0x96, 0xdb, 0x61, 0x45, 0xdf, 0xa1, 0xec, 0xee, 0xf0, 0x30, 0x2a, 0x8c, 0x39, 0x24, 0xec,
+    0xce, 0xf6, 0xda, 0x88, 0x4e, 0x61, 0x0f, 0x89, 0x0e, 0xd3, 0xae, 0x9f, 0x95, 0x9a, 0xf2, 0x65,
+    0xaa, 0x2a, 0xf3, 0xd8, 0x95, 0x42, 0x58, 0xc8, 0x82, 0x5e, 0x14, 0x37, 0x99, 0x73, 0xfa, 0x87,
+    0x31, 0x72, 0x95, 0x8d, 0x6b, 0xd2, 0x25, 0xf3, 0x37, 0xaf, 0x46, 0x4d, 0x6d, 0x67, 0xb9, 0xc5,
+    0xee, 0x6d, 0x86, 0xb7, 0x59, 0xe9, 0xb7, 0x3e, 0x4f, 0x20, 0xd9, 0x21, 0xa2, 0x1d, 0xc3, 0x93,
+    0xae, 0x0c, 0xf6, 0xf2, 0xa5, 0xbb, 0xf3, 0xee, 0xec, 0xb6, 0xfb, 0x11, 0xce, 0x92, 0x10, 0x3b,
+    0xda, 0xde, 0x6c, 0xf9, 0x5a, 0x25, 0x5a, 0x24, 0xa8, 0xfb, 0xd4, 0x8c, 0x90, 0xa1, 0xd6, 0x7c,
+    0x4c, 0xd7, 0x44, 0x17, 0x61, 0x48, 0xf3, 0x66, 0xf9, 0x2b, 0x65, 0xd5, 0xa5, 0xe1, 0x4d, 0x32,
+    0xdb, 0x27, 0xab, 0x95, 0x11, 0x6b, 0xc4, 0x5f, 0xb9, 0x95, 0x85, 0x75, 0x5a, 0x62, 0x35, 0xad,
+    0x0a, 0xd8, 0x65, 0x18, 0xa6, 0xa4, 0x75, 0x0f, 0x95, 0xa2, 0xba, 0x74, 0xe0, 0x12, 0x98, 0x9b,
+    0x32, 0xa0, 0x06, 0x97, 0x65, 0x73, 0x7f, 0x6b, 0xcb, 0x33, 0x3a, 0xdd, 0x5f, 0x2c, 0xb9, 0x2d,
+    0xde, 0x57, 0x0b, 0x00, 0x00,
+};
+
+static const uint8_t asset_style_css[611] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x85, 0x54, 0xdb, 0x8e, 0x9b, 0x30,
+    0x10, 0x7d, 0xcf, 0x57, 0xa0, 0x44, 0x95, 0x5a, 0x29, 0x20, 0x08, 0x84, 0x24, 0x44, 0x7d, 0x58,
+    0x55, 0xea, 0x4f, 0x54, 0xfb, 0x60, 0x63, 0x1b, 0xac, 0x35, 0x36, 0xb2, 0xcd, 0x26, 0xd9, 0xaa,
+    0xff, 0x5e, 0x9b, 0x5b, 0x30, 0x65, 0x69, 0xfc, 0x12, 0x0f, 0x9e, 0x33, 0x67, 0xce, 0x19, 0x1b,
+    0x0a, 0xf4, 0xf0, 0x7e, 0x6f, 0x3c, 0xf3, 0x23, 0x82, 0x6b, 0x9f, 0x80, 0x8a, 0xb2, 0x47, 0xe6,
+    0xbd, 0x48, 0x0a, 0xd8, 0xde, 0x53, 0x80, 0x2b, 0x5f, 0x61, 0x49, 0xc9, 0xb5, 0x3d, 0xc3, 0x28,
+    0xc7, 0x7e, 0x89, 0x69, 0x51, 0xea, 0xcc, 0x8b, 0x82, 0xb4, 0x8b, 0x56, 0x40, 0x16, 0x94, 0x67,
+    0x5e, 0xd8, 0x6d, 0x6b, 0x80, 0x10, 0xe5, 0xc5, 0xb8, 0x87, 0x20, 0x7f, 0x2b, 0xa4, 0x68, 0x38,
+    0xf2, 0x73, 0xc1, 0x84, 0xcc, 0xbc, 0x1d, 0x49, 0xec, 0xba, 0x6e, 0xfe, 0x6c, 0x36, 0x41, 0x6e,
+    0xea, 0x02, 0x83, 0x2b, 0x7b, 0x1e, 0x37, 0x8a, 0x74, 0x99, 0x79, 0xe7, 0xf0, 0xcb, 0x80, 0x7e,
+    0xf7, 0xfb, 0x58, 0x1a, 0x86, 0xf5, 0xdd, 0xad, 0x19, 0x9b, 0x88, 0x07, 0x1a, 0x2d, 0xe6, 0xb5,
+    0x6c, 0x15, 0x42, 0x66, 0x8c, 0x0e, 0x63, 0x3e, 0x14, 0x12, 0x61, 0xe9, 0x4b, 0x80, 0x68, 0xa3,
+    0x32, 0xef, 0xf8, 0x8c, 0xdf, 0x7d, 0x55, 0x02, 0x24, 0x6e, 0x86, 0xbf, 0x59, 0x91, 0xc5, 0x97,
+    0x05, 0x04, 0x5f, 0xc3, 0x7d, 0xbb, 0x82, 0xe8, 0x5b, 0xcb, 0xbb, 0x8c, 0x7a, 0xbe, 0x1a, 0xdf,
+    0xb5, 0x0f, 0x18, 0x2d, 0x0c, 0x9b, 0x1c, 0x73, 0x8d, 0xe5, 0x94, 0xa1, 0x0f, 0x85, 0xd6, 0xa2,
+    0x9a, 0x96, 0x1e, 0x44, 0x88, 0xe3, 0xb8, 0x43, 0x3a, 0xf4, 0x48, 0xc3, 0x87, 0x24, 0x49, 0xae,
+    0x4f, 0x4b, 0x14, 0xfd, 0xc0, 0x56, 0xec, 0x03, 0xae, 0x1c, 0xea, 0x03, 0x70, 0x64, 0x08, 0x2a,
+    0xc1, 0x28, 0xf2, 0x76, 0x08, 0x21, 0xa7, 0xe1, 0xf1, 0x4c, 0xdb, 0x9e, 0x15, 0x9b, 0x08, 0x59,
+    0xf9, 0x56, 0xa0, 0xba, 0xaf, 0x39, 0x63, 0x19, 0x0d, 0x27, 0x19, 0x80, 0x98, 0xf5, 0x67, 0x10,
+    0x55, 0x35, 0x03, 0x66, 0x2a, 0x20, 0x13, 0xf9, 0xdb, 0x62, 0x77, 0xa3, 0x7e, 0x2d, 0xe5, 0x5b,
+    0x3f, 0x21, 0x50, 0x30, 0xd4, 0xa2, 0x51, 0x5e, 0x37, 0xfa, 0x97, 0x7e, 0xd4, 0xf8, 0xfb, 0xd6,
+    0xea, 0xb5, 0x7d, 0xdd, 0x3b, 0xb1, 0x1a, 0x28, 0x75, 0x33, 0x6d, 0xcd, 0xe3, 0xbc, 0xa9, 0x20,
+    0x96, 0xdb, 0x57, 0x77, 0x34, 0xa2, 0x70, 0x98, 0x8d, 0xd1, 0xd8, 0xb3, 0xeb, 0xeb, 0xb2, 0x2a,
+    0x33, 0xcf, 0x13, 0xc7, 0x73, 0xfa, 0xd1, 0x02, 0x8d, 0xe2, 0x76, 0x32, 0xa8, 0x0a, 0x30, 0x36,
+    0xb3, 0xe7, 0x74, 0x3a, 0xfd, 0x63, 0x4f, 0x18, 0x9c, 0xad, 0x3d, 0x56, 0x62, 0xd8, 0x18, 0x49,
+    0xf8, 0x92, 0xc8, 0x5a, 0xd4, 0xd3, 0x39, 0x58, 0x1a, 0x1c, 0x03, 0xd0, 0xe5, 0xf7, 0x99, 0x63,
+    0x83, 0xed, 0x1c, 0x46, 0xc7, 0x79, 0x9b, 0x5c, 0x70, 0xbc, 0xde, 0x5c, 0xde, 0x48, 0x65, 0x69,
+    0xd7, 0x82, 0x3e, 0x67, 0x73, 0xc1, 0x25, 0xe7, 0x22, 0x8f, 0x03, 0xd3, 0x91, 0x09, 0x6a, 0x49,
+    0xcd, 0xb7, 0xe1, 0xa5, 0x58, 0xb8, 0xd0, 0xc9, 0x8f, 0x97, 0x9f, 0xc7, 0xd0, 0x99, 0xef, 0x5b,
+    0x49, 0x35, 0x5e, 0x00, 0xc9, 0x4a, 0xf1, 0x3e, 0x5e, 0xf6, 0x25, 0xa8, 0x23, 0x08, 0x93, 0xcb,
+    0x34, 0x51, 0x61, 0xf3, 0x46, 0xa0, 0xd5, 0xfa, 0x24, 0x49, 0xe2, 0x38, 0x5d, 0xaf, 0x3f, 0xc2,
+    0xfc, 0x8f, 0x01, 0x02, 0xd1, 0x25, 0x84, 0x6d, 0xea, 0x4e, 0x69, 0xa0, 0x1b, 0xb5, 0xea, 0xa3,
+    0xe3, 0xd1, 0xba, 0x19, 0x9f, 0x58, 0x1e, 0xa8, 0x26, 0xcf, 0xb1, 0x52, 0x2b, 0x94, 0x08, 0x09,
+    0xd1, 0x79, 0xf6, 0x7e, 0xe4, 0xa7, 0x34, 0xee, 0xee, 0x57, 0x80, 0xa5, 0x14, 0x2b, 0x1d, 0x91,
+    0x03, 0xc2, 0x08, 0xbb, 0xe9, 0xe0, 0x62, 0xde, 0x99, 0x83, 0x4d, 0x0f, 0x18, 0x7d, 0xc7, 0xbe,
+    0x06, 0x90, 0xe1, 0xcf, 0x2e, 0x5a, 0xdf, 0x90, 0xc9, 0x65, 0xa0, 0x56, 0x66, 0xe0, 0x87, 0x7f,
+    0x2b, 0x6f, 0x9d, 0xe5, 0x35, 0x41, 0xd6, 0xe5, 0xde, 0xdd, 0xa3, 0xf9, 0x8c, 0xa7, 0x33, 0xf9,
+    0xd6, 0x5e, 0xb8, 0xa9, 0x92, 0x0c, 0x13, 0x6d, 0xcb, 0xfd, 0x05, 0xd3, 0xff, 0x30, 0x91, 0xcd,
+    0x06, 0x00, 0x00,
+};
+
+static const WebAsset WEB_ASSETS[] = {
+    {"/index.html", nullptr, "text/html", "\"27c84469\"", asset_index_html, sizeof(asset_index_html), 2521},
+    {"/live.html", nullptr, "text/html", "\"c6364f3e\"", asset_live_html, sizeof(asset_live_html), 818},
+    {"/live.js", "/live.262b7fb4.js", "application/javascript", "\"262b7fb4\"", asset_live_js, sizeof(asset_live_js), 2508},
+    {"/pageload.js", "/pageload.71ea4bdd.js", "application/javascript", "\"71ea4bdd\"", asset_pageload_js, sizeof(asset_pageload_js), 685},
+    {"/script.js", "/script.c9bacbd6.js", "application/javascript", "\"c9bacbd6\"", asset_script_js, sizeof(asset_script_js), 2903},
+    {"/style.css", "/style.0381c515.css", "text/css", "\"0381c515\"", asset_style_css, sizeof(asset_style_css), 1741},
+};
+static const size_t WEB_ASSET_COUNT = sizeof(WEB_ASSETS) / sizeof(WEB_ASSETS[0]);
@@ -0,0 +1,105 @@
+#include "power_manager.h"
+#include <driver/uart.h>
+#include <esp_idf_version.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+
+#if ESP_IDF_VERSION_MAJOR >= 5
+typedef esp_pm_config_t PmConfig;
+#else
+typedef esp_pm_config_esp32s3_t PmConfig;
+#endif
+
+PowerManager::PowerManager() {
+    pmAvailable = false;
+    lockHeld = false;
+    appliedLevel = POWER_LEVEL_COUNT;
+    appliedSleep = false;
+    cpuLock = nullptr;
+}
+
+bool PowerManager::begin(int wakeUart) {
+    PmConfig config = {};
+    config.max_freq_mhz = POWER_FREQ_BURST;
+    config.min_freq_mhz = POWER_FREQ_IDLE;
+    config.light_sleep_enable = false;
+    pmAvailable = esp_pm_configure(&config) == ESP_OK &&
+                  esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "power", &cpuLock) == ESP_OK;
+    if (!pmAvailable) {
+        Serial.println("Power management not in this SDK build, scaling with setCpuFrequencyMhz()");
+    }
+
+#if POWER_LIGHT_SLEEP
+    // Wakes after POWER_UART_WAKE_EDGES edges on RX; those bytes are lost
+    if (pmAvailable) {
+        uart_set_wakeup_threshold((uart_port_t)wakeUart, POWER_UART_WAKE_EDGES);
+        esp_sleep_enable_uart_wakeup(wakeUart);
+    }
+#endif
+
+    apply(policy.current());
+    return pmAvailable;
+}
+
+PowerDecision PowerManager::update(const PowerInputs& in) {
+    PowerDecision decision = policy.update(in, millis());
+    apply(decision);
+    return decision;
+}
+
+void PowerManager::apply(const PowerDecision& decision) {
+    if (decision.level == appliedLevel && decision.lightSleep == appliedSleep) {
+        return;
+    }
+    appliedLevel = decision.level;
+    appliedSleep = decision.lightSleep;
+    uint32_t mhz = PowerPolicy::frequencyMhz(decision.level);
+
+    if (!pmAvailable) {
+        setCpuFrequencyMhz(mhz);
+        return;
+    }
+
+    // DFS tops out at the level's frequency. Above idle the lock keeps the
+    // CPU there; at idle DFS drops to POWER_FREQ_IDLE between wake-ups and
+    // may light sleep.
+    PmConfig config = {};
+    config.max_freq_mhz = mhz;
+    config.min_freq_mhz = POWER_FREQ_IDLE;
+    config.light_sleep_enable = decision.lightSleep;
+    esp_pm_configure(&config);
+
+    bool wantLock = decision.level != POWER_IDLE;
+    if (wantLock && !lockHeld) {
+        esp_pm_lock_acquire(cpuLock);
+    } else if (!wantLock && lockHeld) {
+        esp_pm_lock_release(cpuLock);
+    }
+    lockHeld = wantLock;
+}
+
+size_t PowerManager::format(char* out, size_t len) const {
+    size_t pos = policy.format(out, len);
+#if configGENERATE_RUN_TIME_STATS
+    // Idle task share is the upper bound for sleep residency
+    static uint32_t lastIdle = 0;
+    static uint64_t lastUs = 0;
+    uint32_t idle = ulTaskGetIdleRunTimeCounter();
+    uint64_t nowUs = esp_timer_get_time();
+    if (lastUs != 0 && pos < len) {
+        int written = snprintf(out + pos, len - pos, "  idle task %.1f%% since last report\n",
+                               100.0 * (uint32_t)(idle - lastIdle) / (double)(nowUs - lastUs));
+        if (written > 0) pos += (size_t)written;
+        if (pos >= len) pos = len - 1;
+    }
+    lastIdle = idle;
+    lastUs = nowUs;
+#endif
+    if (pos < len) {
+        int written = snprintf(out + pos, len - pos, "  %s, CPU now %lu MHz\n",
+                               pmAvailable ? "esp_pm" : "setCpuFrequencyMhz", (unsigned long)getCpuFrequencyMhz());
+        if (written > 0) pos += (size_t)written;
+        if (pos >= len) pos = len - 1;
+    }
+    return pos;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_pm.h>
+#include "config.h"
+#include "power_policy.h"
+
+// Applies PowerPolicy decisions to the chip. With power management in the
+// SDK it drives esp_pm (DFS between POWER_FREQ_IDLE and the level's
+// frequency, a CPU_FREQ_MAX lock above idle, automatic light sleep woken by
+// UART RX). Without it, it falls back to setCpuFrequencyMhz() per level.
+class PowerManager {
+public:
+    PowerManager();
+    bool begin(int wakeUart);
+    // Every POWER_UPDATE_INTERVAL from loop()
+    PowerDecision update(const PowerInputs& in);
+    PowerDecision current() const { return policy.current(); }
+    const PowerPolicy& getPolicy() const { return policy; }
+    size_t format(char* out, size_t len) const;
+
+private:
+    PowerPolicy policy;
+    bool pmAvailable;
+    bool lockHeld;
+    PowerLevel appliedLevel;
+    bool appliedSleep;
+    esp_pm_lock_handle_t cpuLock;
+
+    void apply(const PowerDecision& decision);
+};
@@ -0,0 +1,107 @@
+#include "power_policy.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char* const LEVEL_NAMES[POWER_LEVEL_COUNT] = {"idle", "active", "burst"};
+static const uint32_t LEVEL_MHZ[POWER_LEVEL_COUNT] = {POWER_FREQ_IDLE, POWER_FREQ_ACTIVE, POWER_FREQ_BURST};
+
+uint32_t PowerPolicy::frequencyMhz(PowerLevel level) {
+    return LEVEL_MHZ[level];
+}
+
+PowerPolicy::PowerPolicy() {
+    decision.level = POWER_BURST;  // Boot runs flat out
+    decision.display = DISPLAY_ON;
+    decision.lightSleep = false;
+    memset(&stats, 0, sizeof(stats));
+    lastUpdateMs = 0;
+    heldSinceMs = 0;
+    started = false;
+}
+
+PowerLevel PowerPolicy::wantedLevel(const PowerInputs& in) const {
+    if (in.queueDepth >= POWER_BURST_DEPTH || in.backlog >= POWER_BURST_DEPTH) {
+        return POWER_BURST;
+    }
+    if (in.queueDepth > 0 || in.backlog > 0 || in.interactive || in.msSinceReading < POWER_IDLE_AFTER) {
+        return POWER_ACTIVE;
+    }
+    return POWER_IDLE;
+}
+
+PowerDecision PowerPolicy::update(const PowerInputs& in, uint32_t nowMs) {
+    if (started) {
+        uint32_t elapsed = nowMs - lastUpdateMs;
+        stats.msAt[decision.level] += elapsed;
+        stats.msDisplay[decision.display] += elapsed;
+    } else {
+        heldSinceMs = nowMs;
+        started = true;
+    }
+    lastUpdateMs = nowMs;
+
+    PowerLevel wanted = wantedLevel(in);
+    PowerLevel level = decision.level;
+    if (wanted >= level) {
+        // Up right away, and staying at a level restarts its hold time
+        level = wanted;
+        heldSinceMs = nowMs;
+    } else if (nowMs - heldSinceMs >= POWER_HOLD_MS) {
+        // Down one step per hold time
+        level = (PowerLevel)(level - 1);
+        heldSinceMs = nowMs;
+    }
+    if (level != decision.level) {
+        stats.transitions++;
+    }
+    decision.level = level;
+    decision.lightSleep = POWER_LIGHT_SLEEP && level == POWER_IDLE;
+
+    if (in.interactive || in.msSinceReading < POWER_DISPLAY_DIM_AFTER) {
+        decision.display = DISPLAY_ON;
+    } else if (in.msSinceReading < POWER_DISPLAY_OFF_AFTER) {
+        decision.display = DISPLAY_DIM;
+    } else {
+        decision.display = DISPLAY_OFF;
+    }
+    return decision;
+}
+
+uint32_t PowerPolicy::estimatedDeciMilliamps() const {
+    static const uint32_t levelMa[POWER_LEVEL_COUNT] = {
+        POWER_LIGHT_SLEEP ? POWER_MA_SLEEP : POWER_MA_IDLE, POWER_MA_ACTIVE, POWER_MA_BURST
+    };
+    uint64_t total = 0;
+    uint64_t weighted = 0;
+    for (uint8_t i = 0; i < POWER_LEVEL_COUNT; i++) {
+        total += stats.msAt[i];
+        weighted += stats.msAt[i] * levelMa[i] * 10;
+    }
+    return total ? (uint32_t)(weighted / total) : 0;
+}
+
+size_t PowerPolicy::format(char* out, size_t len) const {
+    size_t pos = 0;
+    auto append = [&](int written) {
+        if (written > 0) pos += (size_t)written;
+        if (pos >= len) pos = len - 1;
+    };
+    uint64_t total = 0;
+    for (uint8_t i = 0; i < POWER_LEVEL_COUNT; i++) {
+        total += stats.msAt[i];
+    }
+    append(snprintf(out, len, "Power: %s (%lu MHz)%s, %lu transitions, ~%lu.%lu mA average (estimate)\n",
+                    LEVEL_NAMES[decision.level], (unsigned long)LEVEL_MHZ[decision.level],
+                    decision.lightSleep ? ", light sleep" : "", (unsigned long)stats.transitions,
+                    (unsigned long)(estimatedDeciMilliamps() / 10), (unsigned long)(estimatedDeciMilliamps() % 10)));
+    for (uint8_t i = 0; i < POWER_LEVEL_COUNT; i++) {
+        append(snprintf(out + pos, len - pos, "  %-7s %4lu MHz %10lu s %5.1f%%\n", LEVEL_NAMES[i],
+                        (unsigned long)LEVEL_MHZ[i], (unsigned long)(stats.msAt[i] / 1000),
+                        total ? 100.0 * stats.msAt[i] / total : 0.0));
+    }
+    append(snprintf(out + pos, len - pos, "  display on %lu s, dim %lu s, off %lu s\n",
+                    (unsigned long)(stats.msDisplay[DISPLAY_ON] / 1000),
+                    (unsigned long)(stats.msDisplay[DISPLAY_DIM] / 1000),
+                    (unsigned long)(stats.msDisplay[DISPLAY_OFF] / 1000)));
+    return pos;
+}
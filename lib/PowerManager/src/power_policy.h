@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+
+enum PowerLevel : uint8_t {
+    POWER_IDLE,         // POWER_FREQ_IDLE, light sleep allowed
+    POWER_ACTIVE,       // POWER_FREQ_ACTIVE
+    POWER_BURST,        // POWER_FREQ_BURST, a backlog is being drained
+    POWER_LEVEL_COUNT
+};
+
+enum DisplayMode : uint8_t {
+    DISPLAY_ON,
+    DISPLAY_DIM,        // Low contrast, slow refresh
+    DISPLAY_OFF
+};
+
+// What the hub is doing right now, sampled every POWER_UPDATE_INTERVAL
+struct PowerInputs {
+    uint16_t queueDepth;        // Readings waiting for mqttTask
+    uint16_t backlog;           // Readings taken from the pool and not yet published
+    uint32_t msSinceReading;
+    bool interactive;           // Portal open or dashboard viewers connected
+};
+
+struct PowerDecision {
+    PowerLevel level;
+    DisplayMode display;
+    bool lightSleep;
+};
+
+struct PowerStats {
+    uint64_t msAt[POWER_LEVEL_COUNT];
+    uint64_t msDisplay[3];
+    uint32_t transitions;
+};
+
+// Decides CPU frequency, light sleep and display state from the ingest
+// load. Levels go up as soon as the load asks for it and only come down
+// after POWER_HOLD_MS without that load, so a burst of readings doesn't
+// flap the clock. Keeps the time spent at each level for the metrics.
+// Pure logic with the clock passed in, so it runs natively too.
+class PowerPolicy {
+public:
+    PowerPolicy();
+    PowerDecision update(const PowerInputs& in, uint32_t nowMs);
+    PowerDecision current() const { return decision; }
+    const PowerStats& getStats() const { return stats; }
+    // Time-weighted estimate from POWER_MA_* (mA x 10), a proxy, not a measurement
+    uint32_t estimatedDeciMilliamps() const;
+    size_t format(char* out, size_t len) const;
+    static uint32_t frequencyMhz(PowerLevel level);
+
+private:
+    PowerDecision decision;
+    PowerStats stats;
+    uint32_t lastUpdateMs;
+    uint32_t heldSinceMs;       // When the level's trigger was last seen
+    bool started;
+
+    PowerLevel wantedLevel(const PowerInputs& in) const;
+};
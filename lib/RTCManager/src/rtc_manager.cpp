@@ -1,6 +1,7 @@
 #include "rtc_manager.h"
 
-RTCManager::RTCManager() {
+RTCManager::RTCManager(HalI2CBus* bus) {
+    this->bus = bus;
     rtcPresent = false;
     lastRtcUpdate = 0;
 }
@@ -8,7 +9,7 @@ RTCManager::RTCManager() {
 bool RTCManager::begin() {
     Serial.println("Initializing RTC module...");
     // Configure I2C pins
-    Wire.begin(I2C_SDA, I2C_SCL);
+    bus->begin(I2C_SDA, I2C_SCL);
     Serial.printf("Using I2C pins: SDA=%d, SCL=%d\n", I2C_SDA, I2C_SCL);
     
     // Try to initialize RTC
@@ -38,19 +39,14 @@ bool RTCManager::begin() {
 }
 
 bool RTCManager::updateFromNTP() {
+    // Runs on mqttTask, so everything here goes through the deferred log
     if (!rtcPresent) {
-        Serial.println("RTC not present, skipping update");
+        LOG_WARN(LOG_RTC, "RTC not present, skipping update");
         return false;
     }
     
-    Serial.println("Updating RTC from NTP...");
-    
     struct tm timeInfo;
     if (getLocalTime(&timeInfo)) {
-        Serial.printf("NTP time obtained: %04d-%02d-%02d %02d:%02d:%02d\n",
-            timeInfo.tm_year + 1900, timeInfo.tm_mon + 1, timeInfo.tm_mday,
-            timeInfo.tm_hour, timeInfo.tm_min, timeInfo.tm_sec);
-            
         // Get RTC time before update for comparison
         DateTime beforeUpdate = rtc.now();
         
@@ -70,21 +66,16 @@ bool RTCManager::updateFromNTP() {
         // Calculate time difference
         int64_t timeDiff = afterUpdate.unixtime() - beforeUpdate.unixtime();
         
-        Serial.printf("RTC updated! Before: %04d-%02d-%02d %02d:%02d:%02d\n",
-            beforeUpdate.year(), beforeUpdate.month(), beforeUpdate.day(),
-            beforeUpdate.hour(), beforeUpdate.minute(), beforeUpdate.second());
-            
-        Serial.printf("RTC after:  %04d-%02d-%02d %02d:%02d:%02d\n",
+        LOG_INFO(LOG_RTC, "RTC set from NTP: %04d-%02d-%02d %02d:%02d:%02d",
             afterUpdate.year(), afterUpdate.month(), afterUpdate.day(),
             afterUpdate.hour(), afterUpdate.minute(), afterUpdate.second());
-            
-        Serial.printf("Time drift was %lld seconds\n", timeDiff);
+        LOG_INFO(LOG_RTC, "Time drift was %ld seconds, next update in %0.2f hours",
+            (long)timeDiff, RTC_UPDATE_INTERVAL / 3600000.0);
         
         lastRtcUpdate = millis();
-        Serial.printf("Next RTC update scheduled in %0.2f hours\n", RTC_UPDATE_INTERVAL / 3600000.0);
         return true;
     } else {
-        Serial.println("✗ Failed to obtain time from NTP for RTC update");
+        LOG_WARN(LOG_RTC, "Failed to obtain time from NTP for RTC update");
         return false;
     }
 }
@@ -103,7 +94,7 @@ bool RTCManager::getCurrentTime(struct tm *timeInfo) {
         static unsigned long lastTimeDebug = 0;
         // Only print time every 30 seconds to avoid flooding serial
         if (millis() - lastTimeDebug > 30000) {
-            Serial.printf("[RTC Time] %04d-%02d-%02d %02d:%02d:%02d\n",
+            LOG_DEBUG(LOG_RTC, "RTC time %04d-%02d-%02d %02d:%02d:%02d",
                 now.year(), now.month(), now.day(),
                 now.hour(), now.minute(), now.second());
             lastTimeDebug = millis();
@@ -116,7 +107,7 @@ bool RTCManager::getCurrentTime(struct tm *timeInfo) {
             static unsigned long lastTimeDebug = 0;
             // Only print time every 30 seconds
             if (millis() - lastTimeDebug > 30000) {
-                Serial.printf("[NTP Time] %04d-%02d-%02d %02d:%02d:%02d\n",
+                LOG_DEBUG(LOG_RTC, "NTP time %04d-%02d-%02d %02d:%02d:%02d",
                     timeInfo->tm_year + 1900, timeInfo->tm_mon + 1, timeInfo->tm_mday,
                     timeInfo->tm_hour, timeInfo->tm_min, timeInfo->tm_sec);
                 lastTimeDebug = millis();
@@ -125,7 +116,7 @@ bool RTCManager::getCurrentTime(struct tm *timeInfo) {
             static unsigned long lastTimeDebug = 0;
             // Only print errors every 60 seconds
             if (millis() - lastTimeDebug > 60000) {
-                Serial.println("✗ Failed to obtain time from NTP");
+                LOG_WARN(LOG_RTC, "Failed to obtain time from NTP");
                 lastTimeDebug = millis();
             }
         }
@@ -143,12 +134,11 @@ void RTCManager::checkUpdateInterval() {
     unsigned long timeSinceUpdate = currentMillis - lastRtcUpdate;
     
     if (lastRtcUpdate == 0) {
-        Serial.println("Performing initial RTC update from NTP...");
+        LOG_INFO(LOG_RTC, "Initial RTC update from NTP");
         updateFromNTP();
     } 
     else if (timeSinceUpdate > RTC_UPDATE_INTERVAL) {
-        Serial.printf("RTC update interval reached (%0.1f hours elapsed). Updating from NTP...\n", 
-                    timeSinceUpdate / 3600000.0);
+        LOG_INFO(LOG_RTC, "RTC update interval reached (%0.1f hours elapsed)", timeSinceUpdate / 3600000.0);
         updateFromNTP();
     }
 }
\ No newline at end of file
@@ -5,11 +5,13 @@
 #include <Wire.h>
 #include <WiFi.h>
 #include "config.h"
+#include "hal.h"
+#include "event_log.h"
 #include "time.h"
 
 class RTCManager {
 public:
-    RTCManager();
+    RTCManager(HalI2CBus* bus);
     bool begin();
     bool updateFromNTP();
     bool getCurrentTime(struct tm* timeInfo);
@@ -17,6 +19,7 @@ public:
     void checkUpdateInterval();
 
 private:
+    HalI2CBus* bus;
     RTC_DS3231 rtc;
     bool rtcPresent;
     unsigned long lastRtcUpdate;
@@ -0,0 +1,216 @@
+#include "report_filter.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+ReportFilterConfig ReportFilterConfig::defaults() {
+    ReportFilterConfig config;
+    config.mode = (ReportMode)REPORT_MODE;
+    memset(config.absolute, 0, sizeof(config.absolute));
+    memset(config.relative, 0, sizeof(config.relative));
+    config.absolute[Q_TEMP] = REPORT_TEMP_ABS;
+    config.absolute[Q_HUMIDITY] = REPORT_HUMIDITY_ABS;
+    config.absolute[Q_MOISTURE] = REPORT_MOISTURE_ABS;
+    config.absolute[Q_RAIN] = REPORT_RAIN_ABS;
+    config.absolute[Q_SOLAR] = REPORT_SOLAR_ABS;
+    config.absolute[Q_WIND] = REPORT_WIND_ABS;
+    config.absolute[Q_GUST] = REPORT_WIND_ABS;
+    config.absolute[Q_WIND_DIR] = REPORT_WIND_DIR_ABS;
+    config.relative[Q_TEMP] = REPORT_TEMP_REL;
+    config.relative[Q_HUMIDITY] = REPORT_HUMIDITY_REL;
+    config.relative[Q_MOISTURE] = REPORT_MOISTURE_REL;
+    config.relative[Q_SOLAR] = REPORT_SOLAR_REL;
+    config.heartbeatMs = REPORT_HEARTBEAT_MS;
+    return config;
+}
+
+ReportFilter::ReportFilter(const ReportFilterConfig& config) {
+    this->config = config;
+    count = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+void ReportFilter::setConfig(const ReportFilterConfig& next) {
+    config = next;
+    count = 0;  // Start every node over under the new rules
+}
+
+ReportFilter::NodeState* ReportFilter::lookup(const char* nodeID) {
+    for (uint8_t i = 0; i < count; i++) {
+        if (strncmp(nodes[i].nodeID, nodeID, SENSOR_NODE_ID_SIZE - 1) == 0) {
+            return &nodes[i];
+        }
+    }
+    if (count == NODE_TABLE_CAPACITY) {
+        return nullptr;
+    }
+    NodeState& node = nodes[count++];
+    memset(&node, 0, sizeof(node));
+    memcpy(node.nodeID, nodeID, SENSOR_NODE_ID_SIZE - 1);
+    return &node;
+}
+
+void ReportFilter::forget(const char* nodeID) {
+    NodeState* node = lookup(nodeID);
+    if (node) {
+        node->hasAnchor = false;
+        node->hasHeld = false;
+    }
+}
+
+bool ReportFilter::exceedsDeadband(const NodeState& node, const SensorReading& data) const {
+    if (data.quality != node.anchor.data.quality) return true;
+    for (uint8_t i = Q_TEMP; i < QUANTITY_COUNT; i++) {
+        float last = node.anchor.data.value((Quantity)i);
+        float value = data.value((Quantity)i);
+        if (isnan(last) || isnan(value)) {
+            if (isnan(last) != isnan(value)) return true;
+            continue;
+        }
+        float band = config.absolute[i];
+        float relative = config.relative[i] * fabsf(last);
+        if (relative > band) band = relative;
+        if (fabsf(value - last) > band) return true;
+    }
+    return false;
+}
+
+void ReportFilter::resetDoor(NodeState& node) {
+    for (uint8_t i = Q_TEMP; i < QUANTITY_COUNT; i++) {
+        node.upper[i] = INFINITY;
+        node.lower[i] = -INFINITY;
+    }
+}
+
+// True if the straight line from the anchor to the sample stays within
+// `absolute` of every reading held back since, per quantity. The sample then
+// narrows the door for the readings after it. This checks the published
+// line itself rather than any line through the door as textbook swinging
+// door does, so the error bound holds for the reconstruction.
+bool ReportFilter::doorOpen(NodeState& node, const ReportSample& sample) {
+    if (sample.data.quality != node.anchor.data.quality) return false;
+    float dt = (float)(sample.receivedMs - node.anchor.receivedMs);
+    for (uint8_t i = Q_TEMP; i < QUANTITY_COUNT; i++) {
+        float anchor = node.anchor.data.value((Quantity)i);
+        float value = sample.data.value((Quantity)i);
+        if (isnan(anchor) != isnan(value)) return false;
+        if (isnan(anchor)) continue;
+        if (dt <= 0) {
+            // Same millisecond as the anchor, there is no line to draw
+            if (fabsf(value - anchor) > config.absolute[i]) return false;
+            continue;
+        }
+        float slope = (value - anchor) / dt;
+        if (slope > node.upper[i] || slope < node.lower[i]) return false;
+    }
+    if (dt <= 0) {
+        return true;
+    }
+    for (uint8_t i = Q_TEMP; i < QUANTITY_COUNT; i++) {
+        float anchor = node.anchor.data.value((Quantity)i);
+        float value = sample.data.value((Quantity)i);
+        if (isnan(anchor)) continue;
+        float up = (value + config.absolute[i] - anchor) / dt;
+        float down = (value - config.absolute[i] - anchor) / dt;
+        if (up < node.upper[i]) node.upper[i] = up;
+        if (down > node.lower[i]) node.lower[i] = down;
+    }
+    return true;
+}
+
+uint8_t ReportFilter::offer(const SensorReading& data, uint32_t nowMs, ReportSample out[2]) {
+    stats.offered++;
+    ReportSample sample;
+    sample.data = data;
+    sample.receivedMs = nowMs;
+
+    NodeState* node = config.mode == REPORT_ALL ? nullptr : lookup(data.nodeID);
+    if (node == nullptr || !node->hasAnchor) {
+        // Unfiltered, a new node, or the table is full
+        if (node) {
+            node->anchor = sample;
+            node->hasAnchor = true;
+            node->hasHeld = false;
+            resetDoor(*node);
+        }
+        out[0] = sample;
+        stats.published++;
+        return 1;
+    }
+
+    bool heartbeat = config.heartbeatMs != 0 && nowMs - node->anchor.receivedMs >= config.heartbeatMs;
+    uint8_t emitted = 0;
+
+    if (config.mode == REPORT_DEADBAND) {
+        bool changed = exceedsDeadband(*node, data);
+        if (changed || heartbeat) {
+            node->anchor = sample;
+            out[emitted++] = sample;
+            if (!changed) {
+                stats.heartbeats++;
+            }
+        }
+    } else if (heartbeat) {
+        // Close the segment at the held point, then the current one
+        if (node->hasHeld) {
+            out[emitted++] = node->held;
+        }
+        out[emitted++] = sample;
+        node->anchor = sample;
+        node->hasHeld = false;
+        resetDoor(*node);
+        stats.heartbeats++;
+    } else if (doorOpen(*node, sample)) {
+        node->held = sample;
+        node->hasHeld = true;
+    } else if (node->hasHeld) {
+        // The held point is the last one the segment could reach; it ends
+        // this segment and anchors the next, which the sample then narrows
+        out[emitted++] = node->held;
+        node->anchor = node->held;
+        node->hasHeld = false;
+        resetDoor(*node);
+        if (doorOpen(*node, sample)) {
+            node->held = sample;
+            node->hasHeld = true;
+        } else {
+            out[emitted++] = sample;
+            node->anchor = sample;
+        }
+    } else {
+        // Broke the door right after the anchor, nothing to interpolate
+        out[emitted++] = sample;
+        node->anchor = sample;
+        resetDoor(*node);
+    }
+
+    stats.published += emitted;
+    if (emitted == 0) {
+        stats.suppressed++;
+    }
+    return emitted;
+}
+
+void ReportFilter::notePublished(size_t bytes) {
+    stats.bytesPublished += bytes;
+}
+
+uint32_t ReportFilter::bytesSaved() const {
+    // Suppressed readings would have cost about the mean published payload
+    if (stats.published == 0) {
+        return 0;
+    }
+    return (uint32_t)(stats.bytesPublished / stats.published * stats.suppressed);
+}
+
+size_t ReportFilter::format(char* out, size_t len) const {
+    static const char* const MODE_NAMES[] = {"all", "deadband", "swinging door"};
+    int written = snprintf(out, len,
+        "Report filter (%s): %lu offered, %lu published, %lu suppressed (%.1f%%), %lu heartbeats\n"
+        "  %llu payload bytes published, ~%lu saved\n",
+        MODE_NAMES[config.mode], (unsigned long)stats.offered, (unsigned long)stats.published,
+        (unsigned long)stats.suppressed, stats.offered ? 100.0 * stats.suppressed / stats.offered : 0.0,
+        (unsigned long)stats.heartbeats, (unsigned long long)stats.bytesPublished,
+        (unsigned long)bytesSaved());
+    return written > 0 ? (size_t)written : 0;
+}
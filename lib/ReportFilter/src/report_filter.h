@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+#include "node_table.h"
+#include "sensor_schema.h"
+
+enum ReportMode : uint8_t {
+    REPORT_ALL,             // Publish every frame
+    REPORT_DEADBAND,        // Publish when a value leaves its deadband
+    REPORT_SWINGING_DOOR    // Publish the points a linear reconstruction needs
+};
+
+// Bands are per quantity, whatever schema carries it
+struct ReportFilterConfig {
+    ReportMode mode;
+    float absolute[QUANTITY_COUNT]; // Deadband in the quantity's unit; swinging-door error bound
+    float relative[QUANTITY_COUNT]; // Deadband as a fraction of the last published value
+    uint32_t heartbeatMs;           // Publish at least this often per node, 0 = never forced
+
+    // From the REPORT_* macros in config.h
+    static ReportFilterConfig defaults();
+};
+
+// A reading picked for publishing, with when it arrived
+struct ReportSample {
+    SensorReading data;
+    uint32_t receivedMs;
+};
+
+struct ReportFilterStats {
+    uint32_t offered;
+    uint32_t published;
+    uint32_t suppressed;
+    uint32_t heartbeats;        // Published only because the node went quiet for too long
+    uint64_t bytesPublished;    // Payload bytes, as reported through notePublished()
+};
+
+// Report-by-exception in front of the MQTT path, per node.
+//
+// Deadband: a reading is published when any value moved by more than
+// max(absolute, relative * |last published|) since the node's last
+// published reading, or the heartbeat expired.
+//
+// Swinging door: a reading is held back as long as the straight line from
+// the last published point to it passes within `absolute` of every reading
+// since. When a new reading breaks that, the held one is published and
+// starts the next segment. Interpolating linearly between published points
+// reproduces every suppressed reading within `absolute` per quantity. The
+// published point can be up to one reading old, so samples carry their
+// arrival time.
+//
+// A NaN appearing or disappearing, or a change in quality flags, always
+// counts as a change.
+class ReportFilter {
+public:
+    explicit ReportFilter(const ReportFilterConfig& config);
+    // Returns how many samples to publish (0-2), oldest first, in out
+    uint8_t offer(const SensorReading& data, uint32_t nowMs, ReportSample out[2]);
+    // Payload size of each publish, for the bandwidth figures
+    void notePublished(size_t bytes);
+    // Publishing lost a sample, forget it so the next reading is compared
+    // against what the broker actually has
+    void forget(const char* nodeID);
+    uint32_t bytesSaved() const;
+    const ReportFilterStats& getStats() const { return stats; }
+    size_t format(char* out, size_t len) const;
+    void setConfig(const ReportFilterConfig& next);
+
+private:
+    struct NodeState {
+        char nodeID[SENSOR_NODE_ID_SIZE];
+        bool hasAnchor;
+        ReportSample anchor;        // Last published point
+        bool hasHeld;
+        ReportSample held;          // Swinging door: latest suppressed point
+        float upper[QUANTITY_COUNT];    // Door slopes from the anchor, per ms
+        float lower[QUANTITY_COUNT];
+    };
+
+    ReportFilterConfig config;
+    NodeState nodes[NODE_TABLE_CAPACITY];
+    uint8_t count;
+    ReportFilterStats stats;
+
+    NodeState* lookup(const char* nodeID);
+    bool exceedsDeadband(const NodeState& node, const SensorReading& data) const;
+    bool doorOpen(NodeState& node, const ReportSample& sample);
+    void resetDoor(NodeState& node);
+};
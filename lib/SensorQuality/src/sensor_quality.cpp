@@ -0,0 +1,301 @@
+#include "sensor_quality.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+const char* const QUALITY_FLAG_NAMES[QUALITY_FLAG_COUNT] = {
+    "nan", "range", "rate", "stuck", "outlier", "dropout"
+};
+
+QualityConfig QualityConfig::defaults() {
+    QualityConfig config;
+    for (uint8_t i = 0; i < QUANTITY_COUNT; i++) {
+        config.min[i] = -INFINITY;
+        config.max[i] = INFINITY;
+        config.rate[i] = 0;
+        config.resolution[i] = 0;
+        config.zLimit[i] = 0;
+        config.stuckRun[i] = 0;
+    }
+    config.min[Q_TEMP] = QUALITY_TEMP_MIN;
+    config.max[Q_TEMP] = QUALITY_TEMP_MAX;
+    config.rate[Q_TEMP] = QUALITY_TEMP_RATE;
+    config.resolution[Q_TEMP] = 0.1f;
+    config.min[Q_HUMIDITY] = QUALITY_HUMIDITY_MIN;
+    config.max[Q_HUMIDITY] = QUALITY_HUMIDITY_MAX;
+    config.rate[Q_HUMIDITY] = QUALITY_HUMIDITY_RATE;
+    config.resolution[Q_HUMIDITY] = 0.5f;
+    config.min[Q_MOISTURE] = QUALITY_MOISTURE_MIN;
+    config.max[Q_MOISTURE] = QUALITY_MOISTURE_MAX;
+    config.resolution[Q_MOISTURE] = 1.0f;
+    for (Quantity q : {Q_TEMP, Q_HUMIDITY, Q_MOISTURE}) {
+        config.zLimit[q] = QUALITY_Z_LIMIT;
+        config.stuckRun[q] = QUALITY_STUCK_RUN;
+    }
+    // Rain, sun and wind are legitimately flat (dry, night, calm) and
+    // legitimately jumpy (showers, clouds, gusts); only ranges apply
+    config.min[Q_RAIN] = 0;
+    config.rate[Q_RAIN] = QUALITY_RAIN_RATE;
+    config.min[Q_SOLAR] = 0;
+    config.max[Q_SOLAR] = QUALITY_SOLAR_MAX;
+    config.min[Q_WIND] = config.min[Q_GUST] = 0;
+    config.max[Q_WIND] = config.max[Q_GUST] = QUALITY_WIND_MAX;
+    config.min[Q_WIND_DIR] = 0;
+    config.max[Q_WIND_DIR] = 360;
+    config.dropoutMs = QUALITY_DROPOUT_MS;
+    return config;
+}
+
+QualityMonitor::QualityMonitor(const QualityConfig& config) {
+    this->config = config;
+    count = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+void QualityMonitor::setConfig(const QualityConfig& next) {
+    config = next;
+    count = 0;  // Relearn every node under the new limits
+}
+
+QualityMonitor::NodeState* QualityMonitor::lookup(const char* nodeID) {
+    char padded[SENSOR_NODE_ID_SIZE - 1] = {0};
+    memcpy(padded, nodeID, strnlen(nodeID, sizeof(padded)));
+    uint64_t key;
+    memcpy(&key, padded, sizeof(key));
+    for (uint8_t i = 0; i < count; i++) {
+        if (nodes[i].key == key) {
+            return &nodes[i];
+        }
+    }
+    if (count == NODE_TABLE_CAPACITY) {
+        return nullptr;
+    }
+    NodeState& node = nodes[count++];
+    memset(&node, 0, sizeof(node));
+    node.key = key;
+    memcpy(node.nodeID, padded, sizeof(padded));
+    return &node;
+}
+
+void QualityMonitor::emit(const NodeState& node, Quantity quantity, uint8_t fault, bool active, float value,
+                          uint32_t nowMs, QualityEvent* events, uint8_t maxEvents, uint8_t& emitted) {
+    if (emitted == maxEvents) {
+        stats.eventsDropped++;
+        return;
+    }
+    QualityEvent& event = events[emitted++];
+    memcpy(event.nodeID, node.nodeID, sizeof(event.nodeID));
+    event.quantity = quantity;
+    event.fault = (QualityFlag)fault;
+    event.active = active;
+    event.value = value;
+    event.atMs = nowMs;
+    stats.events++;
+}
+
+uint8_t QualityMonitor::checkValue(QuantityState& state, Quantity q, float value, uint32_t nowMs) {
+    if (!isfinite(value)) {
+        return QUALITY_NAN;
+    }
+    if (value < config.min[q] || value > config.max[q]) {
+        // Not a measurement, keep it out of the trackers
+        return QUALITY_RANGE;
+    }
+
+    uint8_t flags = 0;
+    if (state.seen == 0) {
+        state.last = value;
+        state.lastMs = nowMs;
+        state.median = value;
+        state.mad = config.resolution[q];
+        state.run = 1;
+        state.seen = 1;
+        return 0;
+    }
+
+    state.run = value == state.last && state.run < UINT16_MAX ? state.run + 1 : 1;
+    if (config.stuckRun[q] && state.run >= config.stuckRun[q]) {
+        flags |= QUALITY_STUCK;
+    }
+
+    if (config.rate[q] > 0) {
+        uint32_t dt = nowMs - state.lastMs;
+        if (dt < QUALITY_RATE_MIN_DT_MS) dt = QUALITY_RATE_MIN_DT_MS;
+        if (fabsf(value - state.last) > config.rate[q] * dt / 60000.0f) {
+            flags |= QUALITY_RATE;
+        }
+    }
+
+    float scale = state.mad > config.resolution[q] ? state.mad : config.resolution[q];
+    float deviation = value - state.median;
+    if (config.zLimit[q] > 0 && state.seen >= QUALITY_WARMUP && scale > 0 &&
+        fabsf(deviation) > config.zLimit[q] * 1.4826f * scale) {
+        flags |= QUALITY_OUTLIER;
+    }
+
+    if (flags & (QUALITY_RATE | QUALITY_OUTLIER)) {
+        if (++state.suspect < QUALITY_ACCEPT_RUN) {
+            return flags;   // A spike so far, the trackers don't see it
+        }
+        // Too many in a row for a spike: the level moved, start over from it
+        state.median = value;
+        state.mad = config.resolution[q];
+        state.seen = 1;
+        deviation = 0;
+    }
+    state.suspect = 0;
+    state.last = value;
+    state.lastMs = nowMs;
+
+    // Median and MAD by sign steps: converge fast while warming up, then
+    // move at most QUALITY_ADAPT * MAD per reading
+    float gain = state.seen < QUALITY_WARMUP ? 1.0f / (state.seen + 1) : QUALITY_ADAPT;
+    if (state.seen < QUALITY_WARMUP) {
+        state.median += gain * deviation;
+    } else {
+        state.median += deviation > 0 ? gain * scale : deviation < 0 ? -gain * scale : 0;
+    }
+    float spread = fabsf(value - state.median);
+    float step = state.seen < QUALITY_WARMUP ? 0.25f : QUALITY_ADAPT;
+    state.mad *= spread > state.mad ? 1 + step : 1 - step;
+    if (state.mad < config.resolution[q]) state.mad = config.resolution[q];
+    if (state.seen < QUALITY_WARMUP) state.seen++;
+    return flags;
+}
+
+uint8_t QualityMonitor::check(SensorReading& data, uint32_t nowMs, QualityEvent* events, uint8_t maxEvents) {
+    stats.checked++;
+    data.quality = 0;
+    NodeState* node = lookup(data.nodeID);
+    if (node == nullptr) {
+        stats.untracked++;
+        return 0;
+    }
+
+    uint8_t emitted = 0;
+    if (config.dropoutMs && node->lastMs != 0 && nowMs - node->lastMs > config.dropoutMs) {
+        data.quality |= QUALITY_DROPOUT;
+    }
+    if (node->droppedOut) {
+        node->droppedOut = false;
+        emit(*node, Q_NODE_ID, QUALITY_DROPOUT, false, NAN, nowMs, events, maxEvents, emitted);
+    }
+    node->lastMs = nowMs ? nowMs : 1;
+
+    const SchemaInfo* schema = data.schema();
+    uint16_t carried = schema ? schema->quantities(data) : 0;
+    for (uint8_t q = Q_TEMP; q < QUANTITY_COUNT; q++) {
+        if (!(carried & (1u << q))) {
+            continue;
+        }
+        QuantityState& state = node->quantities[q];
+        float value = schema->value(data, (Quantity)q);
+        uint8_t flags = checkValue(state, (Quantity)q, value, nowMs);
+        data.quality |= flags;
+
+        uint8_t changed = flags ^ state.active;
+        for (uint8_t bit = 0; changed; bit++, changed >>= 1) {
+            if (changed & 1) {
+                emit(*node, (Quantity)q, 1u << bit, flags & (1u << bit), value, nowMs, events, maxEvents, emitted);
+            }
+        }
+        state.active = flags;
+    }
+
+    if (data.quality) {
+        stats.flagged++;
+        for (uint8_t bit = 0; bit < QUALITY_FLAG_COUNT; bit++) {
+            if (data.quality & (1u << bit)) stats.faults[bit]++;
+        }
+    }
+    return emitted;
+}
+
+uint8_t QualityMonitor::sweep(uint32_t nowMs, QualityEvent* events, uint8_t maxEvents) {
+    uint8_t emitted = 0;
+    if (config.dropoutMs == 0) {
+        return 0;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        NodeState& node = nodes[i];
+        if (!node.droppedOut && nowMs - node.lastMs > config.dropoutMs) {
+            node.droppedOut = true;
+            emit(node, Q_NODE_ID, QUALITY_DROPOUT, true, NAN, nowMs, events, maxEvents, emitted);
+        }
+    }
+    return emitted;
+}
+
+size_t QualityMonitor::format(char* out, size_t len) const {
+    size_t pos = 0;
+    auto append = [&](int n) {
+        if (n > 0) pos = pos + n < len ? pos + n : len - 1;
+    };
+    append(snprintf(out, len,
+        "Quality: %lu checked, %lu flagged, %lu events (%lu dropped), %lu untracked\n  faults:",
+        (unsigned long)stats.checked, (unsigned long)stats.flagged, (unsigned long)stats.events,
+        (unsigned long)stats.eventsDropped, (unsigned long)stats.untracked));
+    for (uint8_t bit = 0; bit < QUALITY_FLAG_COUNT && pos + 1 < len; bit++) {
+        append(snprintf(out + pos, len - pos, " %s %lu", QUALITY_FLAG_NAMES[bit],
+                        (unsigned long)stats.faults[bit]));
+    }
+    if (pos + 1 < len) append(snprintf(out + pos, len - pos, "\n"));
+
+    // What is wrong right now
+    for (uint8_t i = 0; i < count && pos + 1 < len; i++) {
+        const NodeState& node = nodes[i];
+        if (node.droppedOut) {
+            append(snprintf(out + pos, len - pos, "  %-8s dropout\n", node.nodeID));
+        }
+        for (uint8_t q = Q_TEMP; q < QUANTITY_COUNT && pos + 1 < len; q++) {
+            uint8_t active = node.quantities[q].active;
+            for (uint8_t bit = 0; active && pos + 1 < len; bit++, active >>= 1) {
+                if (active & 1) {
+                    append(snprintf(out + pos, len - pos, "  %-8s %-9s %s\n", node.nodeID,
+                                    QUANTITY_KEYS[q], QUALITY_FLAG_NAMES[bit]));
+                }
+            }
+        }
+    }
+    return pos;
+}
+
+size_t QualityMonitor::formatEvent(const QualityEvent& event, const char* hubId, const struct tm* timeInfo,
+                                   char* out, size_t len) {
+    uint8_t bit = 0;
+    while (bit < QUALITY_FLAG_COUNT - 1 && !(event.fault & (1u << bit))) bit++;
+
+    // Node IDs arrive over the UART, keep the payload valid JSON
+    char id[SENSOR_NODE_ID_SIZE];
+    uint8_t k = 0;
+    for (const char* c = event.nodeID; *c && k < sizeof(id) - 1; c++) {
+        if (*c >= 0x20 && *c != '"' && *c != '\\') id[k++] = *c;
+    }
+    id[k] = '\0';
+
+    char value[24];
+    if (isfinite(event.value)) {
+        snprintf(value, sizeof(value), "%.7g", event.value);
+    } else {
+        strcpy(value, "null");
+    }
+    char when[112];
+    if (timeInfo) {
+        snprintf(when, sizeof(when),
+                 "\"date\":{\"year\":%d,\"month\":%d,\"day\":%d,\"hour\":%d,\"minute\":%d,\"second\":%d}",
+                 timeInfo->tm_year + 1900, timeInfo->tm_mon + 1, timeInfo->tm_mday,
+                 timeInfo->tm_hour, timeInfo->tm_min, timeInfo->tm_sec);
+    } else {
+        snprintf(when, sizeof(when), "\"uptime_ms\":%lu", (unsigned long)event.atMs);
+    }
+
+    int written = snprintf(out, len,
+        "{\"sensor_id\":\"%s\",\"hub_id\":\"%s\",\"fault\":\"%s\",\"quantity\":%s%s%s,"
+        "\"active\":%s,\"value\":%s,%s}",
+        id, hubId, QUALITY_FLAG_NAMES[bit],
+        event.quantity == Q_NODE_ID ? "" : "\"",
+        event.quantity == Q_NODE_ID ? "null" : QUANTITY_KEYS[event.quantity],
+        event.quantity == Q_NODE_ID ? "" : "\"",
+        event.active ? "true" : "false", value, when);
+    return written > 0 && (size_t)written < len ? (size_t)written : 0;
+}
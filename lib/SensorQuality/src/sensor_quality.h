@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include "config.h"
+#include "node_table.h"
+#include "sensor_schema.h"
+
+// Bits of SensorReading::quality, ORed over the reading's quantities
+enum QualityFlag : uint16_t {
+    QUALITY_NAN = 0x01,         // Sent as NaN or infinity
+    QUALITY_RANGE = 0x02,       // Outside the plausible range
+    QUALITY_RATE = 0x04,        // Changed faster than the quantity can
+    QUALITY_STUCK = 0x08,       // Same value QUALITY_STUCK_RUN times in a row
+    QUALITY_OUTLIER = 0x10,     // Robust z-score above the limit
+    QUALITY_DROPOUT = 0x20,     // First reading after the node went silent
+    QUALITY_FLAG_COUNT = 6
+};
+
+extern const char* const QUALITY_FLAG_NAMES[QUALITY_FLAG_COUNT];
+
+// Limits per quantity, whatever schema carries it. 0 turns a check off.
+struct QualityConfig {
+    float min[QUANTITY_COUNT];
+    float max[QUANTITY_COUNT];
+    float rate[QUANTITY_COUNT];         // Per minute
+    float resolution[QUANTITY_COUNT];   // Smallest MAD the z-score divides by
+    float zLimit[QUANTITY_COUNT];
+    uint16_t stuckRun[QUANTITY_COUNT];
+    uint32_t dropoutMs;
+
+    // From the QUALITY_* macros in config.h
+    static QualityConfig defaults();
+};
+
+// A fault raised or cleared, published on TOPIC_FAULT
+struct QualityEvent {
+    char nodeID[SENSOR_NODE_ID_SIZE];
+    Quantity quantity;          // Q_NODE_ID for a dropout
+    QualityFlag fault;
+    bool active;                // Raised, or cleared by a clean reading
+    float value;                // NaN for a dropout
+    uint32_t atMs;
+};
+
+struct QualityStats {
+    uint32_t checked;
+    uint32_t flagged;           // Readings with any quality bit
+    uint32_t faults[QUALITY_FLAG_COUNT];
+    uint32_t events;
+    uint32_t eventsDropped;     // More transitions than the caller had room for
+    uint32_t untracked;         // Node table full, passed unchecked
+};
+
+// Streaming plausibility checks in front of the report filter, constant
+// memory per node and quantity:
+//
+// - range: outside [min, max]
+// - rate: |x - last good value| over max(dt, QUALITY_RATE_MIN_DT_MS)
+// - stuck: the same value QUALITY_STUCK_RUN times in a row
+// - outlier: |x - median| / (1.4826 * MAD) above zLimit. Median and MAD are
+//   tracked by sign steps scaled to the MAD, so one spike moves them by a
+//   bounded amount no matter how far off it is.
+// - dropout: a node silent for dropoutMs, raised by sweep()
+//
+// A spike is flagged and ignored; a new level (sensor moved, irrigation) is
+// flagged QUALITY_ACCEPT_RUN times and then taken as the new normal.
+// Faults are edge triggered: each one yields an event when it starts and
+// another when a reading comes in clean.
+class QualityMonitor {
+public:
+    explicit QualityMonitor(const QualityConfig& config);
+    // Sets data.quality, returns how many events went to events
+    uint8_t check(SensorReading& data, uint32_t nowMs, QualityEvent* events, uint8_t maxEvents);
+    // Raises dropout events for nodes that went silent, call periodically
+    uint8_t sweep(uint32_t nowMs, QualityEvent* events, uint8_t maxEvents);
+    void setConfig(const QualityConfig& next);
+    const QualityStats& getStats() const { return stats; }
+    size_t format(char* out, size_t len) const;
+
+    // {"sensor_id":...,"fault":"stuck","quantity":"temp","active":true,...}
+    static size_t formatEvent(const QualityEvent& event, const char* hubId, const struct tm* timeInfo,
+                              char* out, size_t len);
+
+private:
+    struct QuantityState {
+        float last;             // Last value that passed the rate check
+        float median;
+        float mad;
+        uint32_t lastMs;
+        uint16_t run;           // Identical values in a row
+        uint8_t seen;           // Saturates at QUALITY_WARMUP
+        uint8_t suspect;        // Rate/outlier faults in a row
+        uint8_t active;         // Faults raised and not cleared
+    };
+
+    struct NodeState {
+        uint64_t key;           // The 8 ID characters, one compare per lookup
+        char nodeID[SENSOR_NODE_ID_SIZE];
+        bool droppedOut;
+        uint32_t lastMs;
+        QuantityState quantities[QUANTITY_COUNT];
+    };
+
+    QualityConfig config;
+    NodeState nodes[NODE_TABLE_CAPACITY];
+    uint8_t count;
+    QualityStats stats;
+
+    NodeState* lookup(const char* nodeID);
+    uint8_t checkValue(QuantityState& state, Quantity quantity, float value, uint32_t nowMs);
+    void emit(const NodeState& node, Quantity quantity, uint8_t fault, bool active, float value,
+              uint32_t nowMs, QualityEvent* events, uint8_t maxEvents, uint8_t& emitted);
+};
@@ -0,0 +1,264 @@
+#include "sensor_frame.h"
+
+namespace {
+
+// CRC-16/CCITT-FALSE, one table lookup per byte instead of eight shifts
+struct CrcTable {
+    uint16_t entries[256];
+
+    constexpr CrcTable() : entries() {
+        for (uint16_t i = 0; i < 256; i++) {
+            uint16_t crc = i << 8;
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+            }
+            entries[i] = crc;
+        }
+    }
+};
+
+constexpr CrcTable CRC_TABLE;
+
+}  // namespace
+
+uint16_t crc16(const uint8_t* data, size_t len) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc = (crc << 8) ^ CRC_TABLE.entries[(crc >> 8) ^ data[i]];
+    }
+    return crc;
+}
+
+size_t encodeFrame(const SensorReading& reading, uint8_t* out, size_t outSize) {
+    const SchemaInfo* schema = reading.schema();
+    size_t idLength = strnlen(reading.nodeID, SENSOR_NODE_ID_SIZE - 1);
+    if (schema == nullptr || outSize < SENSOR_FRAME_HEADER + 2 + idLength + 2) {
+        return 0;
+    }
+
+    uint8_t* body = out + SENSOR_FRAME_HEADER;
+    body[0] = Q_NODE_ID;
+    body[1] = (uint8_t)idLength;
+    memcpy(body + 2, reading.nodeID, idLength);
+    size_t bodyLength = 2 + idLength;
+
+    size_t room = outSize - SENSOR_FRAME_HEADER - bodyLength - 2;
+    if (room > SENSOR_FRAME_MAX_BODY - bodyLength) {
+        room = SENSOR_FRAME_MAX_BODY - bodyLength;
+    }
+    size_t fields = schema->encode(reading, body + bodyLength, room);
+    if (fields == 0 && reading.present != 0) {
+        return 0;
+    }
+    bodyLength += fields;
+
+    out[0] = SENSOR_FRAME_SYNC0;
+    out[1] = SENSOR_FRAME_SYNC1;
+    out[2] = SENSOR_FRAME_VERSION;
+    out[3] = reading.schemaId;
+    out[4] = (uint8_t)bodyLength;
+    uint16_t crc = crc16(out + 2, SENSOR_FRAME_HEADER - 2 + bodyLength);
+    out[SENSOR_FRAME_HEADER + bodyLength] = crc & 0xFF;
+    out[SENSOR_FRAME_HEADER + bodyLength + 1] = crc >> 8;
+    return SENSOR_FRAME_HEADER + bodyLength + 2;
+}
+
+size_t encodeControlFrame(uint8_t type, const uint8_t* body, size_t length, uint8_t* out, size_t outSize) {
+    if (type < SENSOR_FRAME_CONTROL || length > 255 || outSize < SENSOR_FRAME_HEADER + length + 2) {
+        return 0;
+    }
+    out[0] = SENSOR_FRAME_SYNC0;
+    out[1] = SENSOR_FRAME_SYNC1;
+    out[2] = SENSOR_FRAME_VERSION;
+    out[3] = type;
+    out[4] = (uint8_t)length;
+    memcpy(out + SENSOR_FRAME_HEADER, body, length);
+    uint16_t crc = crc16(out + 2, SENSOR_FRAME_HEADER - 2 + length);
+    out[SENSOR_FRAME_HEADER + length] = crc & 0xFF;
+    out[SENSOR_FRAME_HEADER + length + 1] = crc >> 8;
+    return SENSOR_FRAME_HEADER + length + 2;
+}
+
+void decodeLegacyFrame(const LegacyDhtFrame& frame, SensorReading& reading) {
+    char nodeID[SENSOR_NODE_ID_SIZE] = {0};
+    memcpy(nodeID, frame.nodeID, sizeof(frame.nodeID));
+    initReading(reading, SCHEMA_CLIMATE, nodeID);
+    ClimateSample& climate = reading.as<ClimateSample>();
+    climate.temp = frame.temp;
+    climate.humidity = frame.humidity;
+    climate.moisture = (float)frame.moisture;
+    reading.present = 0x7;
+}
+
+FrameDecoder::FrameDecoder() {
+    state = SYNC0;
+    pos = 0;
+    expected = 0;
+    replayLength = 0;
+    replayPos = 0;
+    memset(&stats, 0, sizeof(stats));
+    controlHandler = nullptr;
+    controlContext = nullptr;
+}
+
+bool FrameDecoder::feed(uint8_t byte, SensorReading& reading) {
+    bool decoded = step(byte, reading);
+    while (replayPos < replayLength) {
+        decoded = step(replay[replayPos++], reading) || decoded;
+    }
+    return decoded;
+}
+
+size_t FrameDecoder::feed(const uint8_t* data, size_t len, SensorReading& reading, bool& decoded) {
+    decoded = false;
+    size_t used = 0;
+    while (used < len && !decoded) {
+        if (state == BODY && replayPos == replayLength) {
+            // The bulk of a frame, no need to look at it byte by byte
+            size_t count = expected - pos;
+            if (count > len - used) count = len - used;
+            memcpy(frame + pos, data + used, count);
+            pos += count;
+            used += count;
+            if (pos == expected) {
+                state = CRC;
+            }
+            continue;
+        }
+        decoded = feed(data[used++], reading);
+    }
+    return used;
+}
+
+bool FrameDecoder::step(uint8_t byte, SensorReading& reading) {
+    switch (state) {
+        case SYNC0:
+            if (byte == SENSOR_FRAME_SYNC0) {
+                state = SYNC1;
+            } else {
+                stats.skippedBytes++;
+            }
+            return false;
+        case SYNC1:
+            if (byte == SENSOR_FRAME_SYNC1) {
+                frame[0] = SENSOR_FRAME_SYNC0;
+                frame[1] = SENSOR_FRAME_SYNC1;
+                pos = 2;
+                state = HEADER;
+            } else if (byte != SENSOR_FRAME_SYNC0) {
+                stats.skippedBytes += 2;
+                state = SYNC0;
+            } else {
+                stats.skippedBytes++;
+            }
+            return false;
+        case HEADER:
+            frame[pos++] = byte;
+            if (pos == SENSOR_FRAME_HEADER) {
+                if (byte > SENSOR_FRAME_MAX_BODY) {
+                    stats.malformed++;
+                    rescan();
+                    return false;
+                }
+                expected = SENSOR_FRAME_HEADER + byte;
+                state = byte ? BODY : CRC;
+            }
+            return false;
+        case BODY:
+            frame[pos++] = byte;
+            if (pos == expected) {
+                state = CRC;
+            }
+            return false;
+        case CRC:
+            frame[pos++] = byte;
+            if (pos == expected + 2) {
+                state = SYNC0;
+                if (frame[3] >= SENSOR_FRAME_CONTROL) {
+                    // Not a reading, the caller's frame stays untouched
+                    if (!finishControl()) {
+                        rescan();
+                    }
+                    return false;
+                }
+                if (finish(reading)) {
+                    return true;
+                }
+                rescan();
+            }
+            return false;
+    }
+    return false;
+}
+
+// The sync bytes of a rejected frame may have been data, or the frame was
+// cut short and the next one began inside it. Hunt through what was taken
+// in after the sync instead of dropping it. Bytes still waiting for replay
+// came after this frame, so they go behind.
+void FrameDecoder::rescan() {
+    uint8_t taken = pos - 2;
+    uint8_t remaining = replayLength - replayPos;
+    memmove(replay + taken, replay + replayPos, remaining);
+    memcpy(replay, frame + 2, taken);
+    replayLength = taken + remaining;
+    replayPos = 0;
+    state = SYNC0;
+    stats.skippedBytes += 2;
+}
+
+bool FrameDecoder::verify() {
+    size_t bodyLength = frame[4];
+    uint16_t crc = frame[SENSOR_FRAME_HEADER + bodyLength] |
+                   (uint16_t)frame[SENSOR_FRAME_HEADER + bodyLength + 1] << 8;
+    if (crc16(frame + 2, SENSOR_FRAME_HEADER - 2 + bodyLength) != crc) {
+        stats.crcErrors++;
+        return false;
+    }
+    if (frame[2] != SENSOR_FRAME_VERSION) {
+        stats.badVersion++;
+        return false;
+    }
+    return true;
+}
+
+bool FrameDecoder::finishControl() {
+    if (!verify()) {
+        return false;
+    }
+    stats.control++;
+    if (controlHandler != nullptr) {
+        controlHandler(frame[3], frame + SENSOR_FRAME_HEADER, frame[4], controlContext);
+    }
+    return true;
+}
+
+bool FrameDecoder::finish(SensorReading& reading) {
+    size_t bodyLength = frame[4];
+    if (!verify()) {
+        return false;
+    }
+    const SchemaInfo* schema = findSchema(frame[3]);
+    if (schema == nullptr) {
+        stats.unknownSchema++;
+        return false;
+    }
+
+    // The node ID comes first so the schema's decoder only sees its fields
+    const uint8_t* body = frame + SENSOR_FRAME_HEADER;
+    if (bodyLength < 2 || body[0] != Q_NODE_ID || body[1] >= SENSOR_NODE_ID_SIZE ||
+        2u + body[1] > bodyLength) {
+        stats.malformed++;
+        return false;
+    }
+    memset(reading.nodeID, 0, sizeof(reading.nodeID));
+    memcpy(reading.nodeID, body + 2, body[1]);
+    reading.schemaId = schema->id;
+    reading.quality = 0;
+    size_t idLength = 2 + body[1];
+    if (!schema->decode(body + idLength, bodyLength - idLength, reading)) {
+        stats.malformed++;
+        return false;
+    }
+    stats.frames++;
+    return true;
+}
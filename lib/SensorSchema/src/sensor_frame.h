@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sensor_schema.h"
+
+// UART frame from the ESP-NOW hub, little endian:
+//
+//   0xA5 0x5A | version | schema id | body length | body | CRC-16
+//
+// The body is TLV: tag (a Quantity) | length | value, with Q_NODE_ID
+// first. The CRC-16/CCITT-FALSE covers version through body. The sync
+// bytes and CRC let the decoder drop a damaged frame and pick up at the
+// next one instead of staying misaligned.
+//
+// A schema id from SENSOR_FRAME_CONTROL up marks a link control frame
+// (lib/Downlink) instead of a reading: commands to the ESP-NOW hub and its
+// acks share the framing and the CRC, in both directions.
+#define SENSOR_FRAME_SYNC0 0xA5
+#define SENSOR_FRAME_SYNC1 0x5A
+#define SENSOR_FRAME_VERSION 1
+#define SENSOR_FRAME_HEADER 5
+#define SENSOR_FRAME_MAX_BODY 64
+#define SENSOR_FRAME_MAX (SENSOR_FRAME_HEADER + SENSOR_FRAME_MAX_BODY + 2)
+#define SENSOR_FRAME_CONTROL 0x80
+
+// The raw struct the hub sent before the framed format, kept for
+// SERIAL_LEGACY_FRAMES and as the baseline in the decode benchmark
+struct LegacyDhtFrame {
+    char nodeID[8];
+    float temp;
+    float humidity;
+    int32_t moisture;
+};
+
+struct FrameDecoderStats {
+    uint32_t frames;            // Decoded into a reading
+    uint32_t crcErrors;
+    uint32_t badVersion;        // Frame format this build doesn't speak
+    uint32_t malformed;         // Good CRC but the length or TLV doesn't add up
+    uint32_t unknownSchema;
+    uint32_t skippedBytes;      // Discarded while hunting for sync
+    uint32_t control;           // Link control frames, passed to the handler
+};
+
+// Called from feed() for every valid control frame, on the feeding task
+typedef void (*ControlFrameHandler)(uint8_t type, const uint8_t* body, size_t length, void* context);
+
+uint16_t crc16(const uint8_t* data, size_t len);
+
+// Encodes reading as a complete frame, returns its length or 0 if it
+// doesn't fit. Used by the benchmark and native tools, nodes do the same.
+size_t encodeFrame(const SensorReading& reading, uint8_t* out, size_t outSize);
+// A control frame around body, returns its length or 0 if it doesn't fit.
+// The body may be up to 255 bytes; the hub's decoder only takes
+// SENSOR_FRAME_MAX_BODY.
+size_t encodeControlFrame(uint8_t type, const uint8_t* body, size_t length, uint8_t* out, size_t outSize);
+
+// Old raw struct into a climate reading
+void decodeLegacyFrame(const LegacyDhtFrame& frame, SensorReading& reading);
+
+// Byte-at-a-time frame assembler, no allocation and no blocking
+class FrameDecoder {
+public:
+    FrameDecoder();
+    // True when byte completed a valid frame, which is then in reading
+    bool feed(uint8_t byte, SensorReading& reading);
+    // Takes bytes up to and including the first complete frame, returns how
+    // many were used. decoded says whether reading holds a new frame.
+    size_t feed(const uint8_t* data, size_t len, SensorReading& reading, bool& decoded);
+    // Between frames, so the next byte may start one
+    bool idle() const { return state == SYNC0 && replayPos == replayLength; }
+    void reset() { state = SYNC0; replayLength = replayPos = 0; }
+    // Without a handler control frames are counted and dropped
+    void setControlHandler(ControlFrameHandler handler, void* context) {
+        controlHandler = handler;
+        controlContext = context;
+    }
+    const FrameDecoderStats& getStats() const { return stats; }
+
+private:
+    enum State : uint8_t { SYNC0, SYNC1, HEADER, BODY, CRC };
+
+    State state;
+    uint8_t frame[SENSOR_FRAME_MAX];
+    uint8_t pos;
+    uint8_t expected;           // Bytes up to the CRC
+    uint8_t replay[SENSOR_FRAME_MAX];
+    uint8_t replayLength;
+    uint8_t replayPos;
+    FrameDecoderStats stats;
+    ControlFrameHandler controlHandler;
+    void* controlContext;
+
+    bool step(uint8_t byte, SensorReading& reading);
+    bool verify();
+    bool finish(SensorReading& reading);
+    bool finishControl();
+    void rescan();
+};
@@ -0,0 +1,53 @@
+#include "sensor_schema.h"
+
+const char* const QUANTITY_KEYS[QUANTITY_COUNT] = {
+    "sensor_id", "temp", "humidity", "moisture", "rain_mm", "solar_wm2", "wind_ms", "gust_ms", "wind_dir"
+};
+
+namespace {
+
+// Indexed by schema id, gaps stay null
+struct SchemaRegistry {
+    const SchemaInfo* byId[SCHEMA_ID_LIMIT];
+
+    constexpr SchemaRegistry(const SchemaInfo* schemas, size_t count) : byId() {
+        for (size_t i = 0; i < count; i++) {
+            byId[schemas[i].id] = &schemas[i];
+        }
+    }
+};
+
+constexpr SchemaInfo SCHEMAS[] = {
+    SchemaCodec<ClimateSample>::info(),
+    SchemaCodec<RainSample>::info(),
+    SchemaCodec<SolarSample>::info(),
+    SchemaCodec<WindSample>::info(),
+};
+
+constexpr SchemaRegistry REGISTRY(SCHEMAS, sizeof(SCHEMAS) / sizeof(SCHEMAS[0]));
+
+}  // namespace
+
+const SchemaInfo* findSchema(uint8_t id) {
+    return id < SCHEMA_ID_LIMIT ? REGISTRY.byId[id] : nullptr;
+}
+
+void initReading(SensorReading& reading, uint8_t schemaId, const char* nodeID) {
+    memset(&reading, 0, sizeof(reading));
+    reading.schemaId = schemaId;
+    strncpy(reading.nodeID, nodeID, SENSOR_NODE_ID_SIZE - 1);
+}
+
+const SchemaInfo* SensorReading::schema() const {
+    return findSchema(schemaId);
+}
+
+float SensorReading::value(Quantity quantity) const {
+    const SchemaInfo* info = findSchema(schemaId);
+    return info ? info->value(*this, quantity) : NAN;
+}
+
+uint16_t SensorReading::quantities() const {
+    const SchemaInfo* info = findSchema(schemaId);
+    return info ? info->quantities(*this) : 0;
+}
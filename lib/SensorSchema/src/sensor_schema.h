@@ -0,0 +1,325 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <type_traits>
+#include <ArduinoJson.h>
+
+// What a node measures. The value doubles as the TLV tag on the UART link
+// and picks the JSON key, so a quantity keeps its number for good.
+enum Quantity : uint8_t {
+    Q_NODE_ID = 0,      // TLV only: the node ID string
+    Q_TEMP,             // degC
+    Q_HUMIDITY,         // %RH
+    Q_MOISTURE,         // Soil moisture, raw probe count unless calibrated
+    Q_RAIN,             // mm, cumulative since the node booted
+    Q_SOLAR,            // W/m2, global radiation
+    Q_WIND,             // m/s, mean over the node's report interval
+    Q_GUST,             // m/s
+    Q_WIND_DIR,         // Degrees from north
+    QUANTITY_COUNT
+};
+
+extern const char* const QUANTITY_KEYS[QUANTITY_COUNT];
+static_assert(QUANTITY_COUNT <= 16, "quantity masks are 16 bits");
+
+enum SchemaId : uint8_t {
+    SCHEMA_CLIMATE = 1,     // Air temperature/humidity plus soil moisture (the old dhtData)
+    SCHEMA_RAIN = 2,        // Tipping-bucket rain gauge
+    SCHEMA_SOLAR = 3,       // Pyranometer
+    SCHEMA_WIND = 4,        // Anemometer and vane
+    SCHEMA_ID_LIMIT
+};
+
+#define SENSOR_NODE_ID_SIZE 9       // 8 characters plus terminator
+#define SENSOR_BODY_SIZE 24         // Largest schema struct
+#define SENSOR_MAX_FIELDS 16        // Bits in SensorReading::present
+
+struct SchemaInfo;
+
+// One decoded frame of any schema. The schema struct lives in body; the
+// codec that filled it knows its type, everyone else asks for quantities.
+struct SensorReading {
+    char nodeID[SENSOR_NODE_ID_SIZE];
+    uint8_t schemaId;
+    uint16_t present;       // Bit i: field i of the schema was in the frame
+    uint16_t quality;       // QualityFlag bits from lib/SensorQuality, 0 = no fault seen
+    alignas(8) uint8_t body[SENSOR_BODY_SIZE];
+
+    template <typename S> S& as() { return *reinterpret_cast<S*>(body); }
+    template <typename S> const S& as() const { return *reinterpret_cast<const S*>(body); }
+
+    const SchemaInfo* schema() const;
+    // NaN if the schema has no such field or the frame left it out
+    float value(Quantity quantity) const;
+    // Bit q: quantity q was in the frame, even if its value is NaN
+    uint16_t quantities() const;
+};
+
+// Per-schema routines, generated from the schema's field list below
+struct SchemaInfo {
+    uint8_t id;
+    const char* name;
+    uint8_t fieldCount;
+    // TLV body (without the node ID) into reading.body/present
+    bool (*decode)(const uint8_t* tlv, size_t len, SensorReading& reading);
+    // Present fields as TLV, returns bytes written or 0 if they don't fit
+    size_t (*encode)(const SensorReading& reading, uint8_t* out, size_t outSize);
+    float (*value)(const SensorReading& reading, Quantity quantity);
+    uint16_t (*quantities)(const SensorReading& reading);
+    // Overwrites a field the frame carried, false if it has none such
+    bool (*setValue)(SensorReading& reading, Quantity quantity, float value);
+    void (*toJson)(const SensorReading& reading, JsonObject object);
+    // Present fields as `,"key":value` text, returns length or 0 if cut off
+    size_t (*writeJson)(const SensorReading& reading, char* out, size_t outSize);
+};
+
+// Direct lookup by id, nullptr for unknown schemas
+const SchemaInfo* findSchema(uint8_t id);
+// Clears the reading and makes it an empty reading of the schema
+void initReading(SensorReading& reading, uint8_t schemaId, const char* nodeID);
+
+// ---------------------------------------------------------------------------
+// Schemas. Each is a plain struct plus a field list binding members to
+// quantities. Adding a sensor type means adding one of each here and a
+// REGISTER line in sensor_schema.cpp; the wire format, decoder, JSON and
+// the rest of the pipeline pick it up from the list.
+// ---------------------------------------------------------------------------
+
+// Wire is the type on the UART link when it differs from the member, e.g.
+// a raw integer count that calibration later turns into a fraction
+template <auto Member, Quantity Q, typename Wire = void>
+struct Field;
+
+template <typename S, typename T, T S::*Member, Quantity Q, typename Wire>
+struct Field<Member, Q, Wire> {
+    using Struct = S;
+    using Type = T;
+    using WireType = typename std::conditional<std::is_void<Wire>::value, T, Wire>::type;
+    static constexpr Quantity quantity = Q;
+    static T& ref(S& s) { return s.*Member; }
+    static const T& ref(const S& s) { return s.*Member; }
+    static void load(S& s, const uint8_t* wire) {
+        WireType value;
+        memcpy(&value, wire, sizeof(value));
+        s.*Member = (T)value;
+    }
+    static void store(const S& s, uint8_t* wire) {
+        WireType value = (WireType)(s.*Member);
+        memcpy(wire, &value, sizeof(value));
+    }
+};
+
+template <typename... Fields>
+struct FieldList {
+    static constexpr uint8_t count = sizeof...(Fields);
+};
+
+template <typename S>
+struct SchemaTraits;
+
+struct ClimateSample {
+    float temp;
+    float humidity;
+    float moisture;         // Raw probe count on the wire, calibrated in place
+};
+
+template <>
+struct SchemaTraits<ClimateSample> {
+    static constexpr uint8_t id = SCHEMA_CLIMATE;
+    static constexpr const char* name = "climate";
+    using Fields = FieldList<Field<&ClimateSample::temp, Q_TEMP>,
+                             Field<&ClimateSample::humidity, Q_HUMIDITY>,
+                             Field<&ClimateSample::moisture, Q_MOISTURE, int32_t>>;
+};
+
+struct RainSample {
+    float rain;
+};
+
+template <>
+struct SchemaTraits<RainSample> {
+    static constexpr uint8_t id = SCHEMA_RAIN;
+    static constexpr const char* name = "rain";
+    using Fields = FieldList<Field<&RainSample::rain, Q_RAIN>>;
+};
+
+struct SolarSample {
+    float solar;
+    float temp;             // Sensor body, for drift compensation downstream
+};
+
+template <>
+struct SchemaTraits<SolarSample> {
+    static constexpr uint8_t id = SCHEMA_SOLAR;
+    static constexpr const char* name = "solar";
+    using Fields = FieldList<Field<&SolarSample::solar, Q_SOLAR>,
+                             Field<&SolarSample::temp, Q_TEMP>>;
+};
+
+struct WindSample {
+    float wind;
+    float gust;
+    int32_t direction;
+};
+
+template <>
+struct SchemaTraits<WindSample> {
+    static constexpr uint8_t id = SCHEMA_WIND;
+    static constexpr const char* name = "wind";
+    using Fields = FieldList<Field<&WindSample::wind, Q_WIND>,
+                             Field<&WindSample::gust, Q_GUST>,
+                             Field<&WindSample::direction, Q_WIND_DIR>>;
+};
+
+// ---------------------------------------------------------------------------
+// Codec. Every routine unrolls over the field list at compile time: decode
+// is a chain of tag compares and fixed-size copies, there is no field
+// table walked at runtime.
+// ---------------------------------------------------------------------------
+
+template <typename S, typename List = typename SchemaTraits<S>::Fields>
+struct SchemaCodec;
+
+template <typename S, typename... Fields>
+struct SchemaCodec<S, FieldList<Fields...>> {
+    static_assert(sizeof(S) <= SENSOR_BODY_SIZE, "schema struct larger than SensorReading::body");
+    static_assert(sizeof...(Fields) <= SENSOR_MAX_FIELDS, "too many fields for SensorReading::present");
+
+    template <typename T>
+    static void clearValue(T& value) {
+        value = NAN;
+    }
+    static void clearValue(int32_t& value) {
+        value = 0;
+    }
+
+    static bool decode(const uint8_t* tlv, size_t len, SensorReading& reading) {
+        S& s = reading.as<S>();
+        uint8_t index = 0;
+        ((clearValue(Fields::ref(s)), index++), ...);
+        reading.present = 0;
+
+        size_t pos = 0;
+        while (pos + 2 <= len) {
+            uint8_t tag = tlv[pos];
+            uint8_t size = tlv[pos + 1];
+            const uint8_t* value = tlv + pos + 2;
+            pos += 2 + size;
+            if (pos > len) {
+                return false;
+            }
+            // A tag this build doesn't know, or a size it doesn't expect, is
+            // from a newer node firmware and skipped
+            index = 0;
+            ((tag == Fields::quantity && size == sizeof(typename Fields::WireType)
+                  ? (Fields::load(s, value), reading.present |= 1u << index, true)
+                  : (index++, false)) || ...);
+        }
+        return pos == len;
+    }
+
+    static size_t encode(const SensorReading& reading, uint8_t* out, size_t outSize) {
+        const S& s = reading.as<S>();
+        size_t pos = 0;
+        uint8_t index = 0;
+        bool fits = true;
+        auto put = [&](auto field) {
+            using F = decltype(field);
+            const uint8_t size = sizeof(typename F::WireType);
+            if (pos + 2 + size > outSize) {
+                fits = false;
+                return;
+            }
+            out[pos] = F::quantity;
+            out[pos + 1] = size;
+            F::store(s, out + pos + 2);
+            pos += 2 + size;
+        };
+        ((reading.present & (1u << index++) ? put(Fields()) : void()), ...);
+        return fits ? pos : 0;
+    }
+
+    static float value(const SensorReading& reading, Quantity quantity) {
+        const S& s = reading.as<S>();
+        float result = NAN;
+        uint8_t index = 0;
+        ((quantity == Fields::quantity
+              ? (result = (reading.present & (1u << index)) ? (float)Fields::ref(s) : NAN, true)
+              : (index++, false)) || ...);
+        return result;
+    }
+
+    static uint16_t quantities(const SensorReading& reading) {
+        uint16_t mask = 0;
+        uint8_t index = 0;
+        ((reading.present & (1u << index++) ? (void)(mask |= 1u << Fields::quantity) : void()), ...);
+        return mask;
+    }
+
+    template <typename T>
+    static void assign(T& field, float value) {
+        field = value;
+    }
+    static void assign(int32_t& field, float value) {
+        field = (int32_t)lroundf(value);
+    }
+
+    static bool setValue(SensorReading& reading, Quantity quantity, float value) {
+        S& s = reading.as<S>();
+        uint8_t index = 0;
+        return ((quantity == Fields::quantity
+                     ? ((reading.present & (1u << index)) ? (assign(Fields::ref(s), value), true) : false)
+                     : (index++, false)) || ...);
+    }
+
+    static void toJson(const SensorReading& reading, JsonObject object) {
+        const S& s = reading.as<S>();
+        uint8_t index = 0;
+        ((reading.present & (1u << index++)
+              ? (void)(object[QUANTITY_KEYS[Fields::quantity]] = Fields::ref(s))
+              : void()), ...);
+    }
+
+    static int writeValue(char* out, size_t size, float value) {
+        if (isnan(value) || isinf(value)) {
+            return snprintf(out, size, "null");
+        }
+        return snprintf(out, size, "%.7g", value);
+    }
+    static int writeValue(char* out, size_t size, int32_t value) {
+        return snprintf(out, size, "%ld", (long)value);
+    }
+
+    static size_t writeJson(const SensorReading& reading, char* out, size_t outSize) {
+        const S& s = reading.as<S>();
+        size_t pos = 0;
+        uint8_t index = 0;
+        bool fits = outSize > 0;
+        auto put = [&](Quantity quantity, auto value) {
+            if (!fits) return;
+            int n = snprintf(out + pos, outSize - pos, ",\"%s\":", QUANTITY_KEYS[quantity]);
+            if (n < 0 || (size_t)n >= outSize - pos) {
+                fits = false;
+                return;
+            }
+            pos += n;
+            n = writeValue(out + pos, outSize - pos, value);
+            if (n < 0 || (size_t)n >= outSize - pos) {
+                fits = false;
+                return;
+            }
+            pos += n;
+        };
+        ((reading.present & (1u << index++) ? put(Fields::quantity, Fields::ref(s)) : void()), ...);
+        return fits ? pos : 0;
+    }
+
+    static constexpr SchemaInfo info() {
+        return SchemaInfo{SchemaTraits<S>::id, SchemaTraits<S>::name, (uint8_t)sizeof...(Fields),
+                          &decode, &encode, &value, &quantities, &setValue, &toJson, &writeJson};
+    }
+};
@@ -1,22 +1,69 @@
 #include "serial_manager.h"
 
-SerialManager::SerialManager(HardwareSerial* serial) {
-    this->interSerial = serial;
-    bytesRead = 0;
+SerialManager::SerialManager(HalSerialPort* port) {
+    this->interSerial = port;
+    rxLength = 0;
+    rxPos = 0;
 }
 
 void SerialManager::begin(long baud, uint8_t rxPin, uint8_t txPin) {
-    interSerial->begin(baud, SERIAL_8N1, rxPin, txPin);
+    interSerial->begin(baud, rxPin, txPin);
 }
 
-bool SerialManager::readData(dhtData* data) {
+#if SERIAL_LEGACY_FRAMES
+bool SerialManager::readData(SensorReading* data, TraceRecord* trace) {
     if (interSerial->available()) {
-        // This code reinterprets the struct ptr as ptr to a binary blob
-        bytesRead = interSerial->readBytes(reinterpret_cast<char*>(data), sizeof(dhtData));
-        
-        if (bytesRead == sizeof(dhtData)) {
+#if ENABLE_LATENCY_TRACE
+        if (trace) {
+            LatencyTracer::clear(*trace);
+            LatencyTracer::stamp(*trace, TRACE_UART_RX);
+        }
+#endif
+        // The old format: the hub's struct as a raw blob, no framing
+        LegacyDhtFrame frame;
+        if (interSerial->readBytes(reinterpret_cast<uint8_t*>(&frame), sizeof(frame)) == sizeof(frame)) {
+            decodeLegacyFrame(frame, *data);
+#if ENABLE_LATENCY_TRACE
+            if (trace) {
+                LatencyTracer::stamp(*trace, TRACE_DECODED);
+            }
+#endif
             return true;
         }
     }
     return false;
-}
\ No newline at end of file
+}
+#else
+bool SerialManager::readData(SensorReading* data, TraceRecord* trace) {
+    while (true) {
+        if (rxPos == rxLength) {
+            int available = interSerial->available();
+            if (available <= 0) {
+                return false;
+            }
+            size_t chunk = available < (int)sizeof(rx) ? (size_t)available : sizeof(rx);
+            rxLength = interSerial->readBytes(rx, chunk);
+            rxPos = 0;
+            if (rxLength == 0) {
+                return false;
+            }
+        }
+#if ENABLE_LATENCY_TRACE
+        if (trace && decoder.idle()) {
+            LatencyTracer::clear(*trace);
+            LatencyTracer::stamp(*trace, TRACE_UART_RX);
+        }
+#endif
+        bool decoded;
+        rxPos += decoder.feed(rx + rxPos, rxLength - rxPos, *data, decoded);
+        if (decoded) {
+#if ENABLE_LATENCY_TRACE
+            if (trace) {
+                LatencyTracer::stamp(*trace, TRACE_DECODED);
+            }
+#endif
+            return true;
+        }
+    }
+}
+#endif
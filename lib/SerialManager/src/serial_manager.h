@@ -1,16 +1,45 @@
 #pragma once
 
 #include <Arduino.h>
-#include <HardwareSerial.h>
 #include "config.h"
+#include "hal.h"
+#include "latency_tracer.h"
+#include "sensor_frame.h"
+
+// One received frame plus its trace stamps, the unit handed between tasks
+struct Reading {
+    SensorReading data;
+    uint32_t receivedMs;
+    TraceRecord trace;
+};
 
 class SerialManager {
 public:
-    SerialManager(HardwareSerial* serial);
+    SerialManager(HalSerialPort* port);
     void begin(long baud, uint8_t rxPin, uint8_t txPin);
-    bool readData(dhtData* data);
+    // Non-blocking: true once a complete, CRC-checked frame was decoded
+    bool readData(SensorReading* data, TraceRecord* trace = nullptr);
+    bool readReading(Reading* reading) {
+        if (!readData(&reading->data, &reading->trace)) {
+            return false;
+        }
+        reading->receivedMs = millis();
+        return true;
+    }
+    // Blocks until the hub sends something or timeoutMs passed
+    bool waitForData(uint32_t timeoutMs) {
+        return rxPos < rxLength || interSerial->waitForData(timeoutMs);
+    }
+    const FrameDecoderStats& getFrameStats() const { return decoder.getStats(); }
+    // Control frames (downlink acks) go here as readData() meets them
+    void setControlHandler(ControlFrameHandler handler, void* context) {
+        decoder.setControlHandler(handler, context);
+    }
 
 private:
-    HardwareSerial* interSerial;
-    uint16_t bytesRead;
-};
\ No newline at end of file
+    HalSerialPort* interSerial;
+    FrameDecoder decoder;
+    uint8_t rx[SERIAL_RX_CHUNK];
+    uint16_t rxLength;
+    uint16_t rxPos;
+};
@@ -0,0 +1,226 @@
+#include "task_table.h"
+#include <esp_idf_version.h>
+#include <esp_task_wdt.h>
+#include <esp_timer.h>
+#include <string.h>
+
+TaskTable taskTable;
+
+TaskTable::TaskTable() {
+    specs = nullptr;
+    count = 0;
+    memset(stats, 0, sizeof(stats));
+    lastSampleUs = 0;
+}
+
+void TaskTable::begin(const TaskSpec* specs, uint8_t count) {
+    this->specs = specs;
+    this->count = count < TASK_TABLE_CAPACITY ? count : TASK_TABLE_CAPACITY;
+    lastSampleUs = esp_timer_get_time();
+
+#if ESP_IDF_VERSION_MAJOR >= 5
+    esp_task_wdt_config_t config = {};
+    config.timeout_ms = TASK_WDT_TIMEOUT * 1000;
+    config.trigger_panic = true;
+    if (esp_task_wdt_reconfigure(&config) != ESP_OK) {
+        esp_task_wdt_init(&config);
+    }
+#else
+    // The IDF startup usually has it running already, with the sdkconfig
+    // timeout; tasks are added either way
+    if (esp_task_wdt_init(TASK_WDT_TIMEOUT, true) != ESP_OK) {
+        Serial.println("Task watchdog already running, keeping its timeout");
+    }
+#endif
+}
+
+bool TaskTable::start(uint8_t id, void* parameter) {
+    if (id >= count || stats[id].handle != nullptr) {
+        return false;
+    }
+    const TaskSpec& spec = specs[id];
+    TaskStats& entry = stats[id];
+    memset(&entry, 0, sizeof(entry));
+    entry.parameter = parameter;
+    entry.stackFree = spec.stackSize;
+    if (xTaskCreatePinnedToCore(trampoline, spec.name, spec.stackSize, (void*)(uintptr_t)id,
+                                spec.priority, &entry.handle, spec.core) != pdPASS) {
+        entry.handle = nullptr;
+        Serial.printf("Failed to start task %s\n", spec.name);
+        return false;
+    }
+    return true;
+}
+
+void TaskTable::trampoline(void* arg) {
+    uint8_t id = (uint8_t)(uintptr_t)arg;
+    TaskStats& entry = taskTable.stats[id];
+    // xTaskCreate may not have stored the handle yet when we get here
+    entry.handle = xTaskGetCurrentTaskHandle();
+    entry.wakeUs = esp_timer_get_time();
+    taskTable.specs[id].function(entry.parameter);
+    taskTable.finish();
+    vTaskDelete(NULL);
+}
+
+TaskStats* TaskTable::current() {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    for (uint8_t i = 0; i < count; i++) {
+        if (stats[i].handle == self) {
+            return &stats[i];
+        }
+    }
+    return nullptr;
+}
+
+void TaskTable::checkIn() {
+    TaskStats* entry = current();
+    if (entry == nullptr) {
+        return;
+    }
+    const TaskSpec& spec = specs[entry - stats];
+    uint32_t now = millis();
+
+    // Watched from the first iteration on, so a task may block as long as
+    // it likes before its loop starts (mqttTask waits for the boot stage)
+    if (spec.deadlineMs != 0 && !entry->watched) {
+        entry->watched = esp_task_wdt_add(NULL) == ESP_OK;
+    } else if (entry->iterations > 0) {
+        uint32_t gap = now - entry->lastCheckInMs;
+        if (gap > entry->maxGapMs) {
+            entry->maxGapMs = gap;
+        }
+        if (spec.deadlineMs != 0 && gap > spec.deadlineMs) {
+            entry->deadlineMisses++;
+        }
+    }
+    if (entry->watched) {
+        esp_task_wdt_reset();
+    }
+    entry->lastCheckInMs = now;
+    entry->iterations++;
+}
+
+void TaskTable::idleBegin() {
+    checkIn();
+    TaskStats* entry = current();
+    if (entry != nullptr) {
+        entry->busyUs += esp_timer_get_time() - entry->wakeUs;
+    }
+}
+
+void TaskTable::idleEnd() {
+    TaskStats* entry = current();
+    if (entry != nullptr) {
+        entry->wakeUs = esp_timer_get_time();
+    }
+}
+
+void TaskTable::delay(uint32_t ms) {
+    idleBegin();
+    vTaskDelay(ms / portTICK_PERIOD_MS);
+    idleEnd();
+}
+
+bool TaskTable::waitNotify(uint32_t ms) {
+    idleBegin();
+    bool notified = ulTaskNotifyTake(pdTRUE, ms / portTICK_PERIOD_MS) != 0;
+    idleEnd();
+    return notified;
+}
+
+bool TaskTable::waitQueue(QueueHandle_t queue, void* peeked, uint32_t ms) {
+    idleBegin();
+    bool ready = xQueuePeek(queue, peeked, ms / portTICK_PERIOD_MS) == pdTRUE;
+    idleEnd();
+    return ready;
+}
+
+void TaskTable::finish() {
+    TaskStats* entry = current();
+    if (entry == nullptr) {
+        return;
+    }
+    if (entry->watched) {
+        esp_task_wdt_delete(NULL);
+        entry->watched = false;
+    }
+    entry->handle = nullptr;
+}
+
+void TaskTable::sample() {
+    uint64_t nowUs = esp_timer_get_time();
+    uint64_t windowUs = nowUs - lastSampleUs;
+
+#if configGENERATE_RUN_TIME_STATS && configUSE_TRACE_FACILITY
+    // The scheduler's own counters also see time spent outside delay(),
+    // e.g. blocked in a queue receive, so prefer them when available
+    static TaskStatus_t status[TASK_TABLE_CAPACITY + 16];
+    uint32_t totalRunTime = 0;
+    UBaseType_t n = uxTaskGetSystemState(status, sizeof(status) / sizeof(status[0]), &totalRunTime);
+#endif
+
+    for (uint8_t i = 0; i < count; i++) {
+        TaskStats& entry = stats[i];
+        if (entry.handle == nullptr) {
+            continue;
+        }
+        entry.stackFree = uxTaskGetStackHighWaterMark(entry.handle);
+        if (entry.stackFree < TASK_STACK_WARN && !entry.stackWarned) {
+            Serial.printf("WARNING: %s has only %lu bytes of stack left\n", specs[i].name,
+                          (unsigned long)entry.stackFree);
+            entry.stackWarned = true;
+        }
+
+        uint64_t busy = entry.busyUs - entry.sampledBusyUs;
+        entry.sampledBusyUs = entry.busyUs;
+        entry.cpuPermille = windowUs ? (uint32_t)(busy * 1000 / windowUs) : 0;
+#if configGENERATE_RUN_TIME_STATS && configUSE_TRACE_FACILITY
+        for (UBaseType_t k = 0; k < n; k++) {
+            if (status[k].xHandle == entry.handle) {
+                // Run time counter ticks at esp_timer resolution (1 us)
+                uint64_t ran = status[k].ulRunTimeCounter - entry.sampledRunTime;
+                entry.sampledRunTime = status[k].ulRunTimeCounter;
+                entry.cpuPermille = windowUs ? (uint32_t)(ran * 1000 / windowUs) : 0;
+            }
+        }
+#endif
+    }
+    lastSampleUs = nowUs;
+}
+
+uint32_t TaskTable::minStackFree() const {
+    uint32_t lowest = UINT32_MAX;
+    for (uint8_t i = 0; i < count; i++) {
+        if (stats[i].handle != nullptr && stats[i].stackFree < lowest) {
+            lowest = stats[i].stackFree;
+        }
+    }
+    return lowest == UINT32_MAX ? 0 : lowest;
+}
+
+size_t TaskTable::format(char* out, size_t len) const {
+    size_t pos = 0;
+    auto append = [&](int written) {
+        if (written > 0) pos += (size_t)written;
+        if (pos >= len) pos = len - 1;
+    };
+    append(snprintf(out, len, "%-12s %4s %4s %6s %6s %6s %9s %7s %6s\n",
+                    "task", "prio", "core", "stack", "free", "cpu%", "deadline", "max_gap", "missed"));
+    for (uint8_t i = 0; i < count; i++) {
+        const TaskSpec& spec = specs[i];
+        const TaskStats& entry = stats[i];
+        if (entry.handle == nullptr) {
+            append(snprintf(out + pos, len - pos, "%-12s %4u %4d %6lu %6s\n", spec.name,
+                            (unsigned)spec.priority, (int)spec.core, (unsigned long)spec.stackSize, "-"));
+            continue;
+        }
+        append(snprintf(out + pos, len - pos, "%-12s %4u %4d %6lu %6lu %4lu.%lu %9lu %7lu %6lu\n",
+                        spec.name, (unsigned)spec.priority, (int)spec.core,
+                        (unsigned long)spec.stackSize, (unsigned long)entry.stackFree,
+                        (unsigned long)(entry.cpuPermille / 10), (unsigned long)(entry.cpuPermille % 10),
+                        (unsigned long)spec.deadlineMs, (unsigned long)entry.maxGapMs,
+                        (unsigned long)entry.deadlineMisses));
+    }
+    return pos;
+}
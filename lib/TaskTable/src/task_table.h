@@ -0,0 +1,82 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.h"
+
+#define TASK_TABLE_CAPACITY 8
+
+// One long-running task: where it runs and what it is allowed to take.
+// Stack sizes and high-water marks are in bytes, as everywhere in ESP-IDF.
+struct TaskSpec {
+    const char* name;
+    TaskFunction_t function;
+    uint32_t stackSize;
+    UBaseType_t priority;
+    BaseType_t core;
+    uint32_t deadlineMs;    // Longest expected gap between loop iterations, 0 = not watched
+};
+
+struct TaskStats {
+    TaskHandle_t handle;
+    void* parameter;
+    bool watched;           // Subscribed to the task watchdog
+    uint32_t iterations;
+    uint32_t lastCheckInMs;
+    uint32_t maxGapMs;
+    uint32_t deadlineMisses;
+    uint64_t busyUs;        // Time between waking up and going back to sleep
+    uint64_t wakeUs;
+    uint64_t sampledBusyUs;
+    uint64_t sampledRunTime;
+    uint32_t cpuPermille;   // Share of one core over the last sample window
+    uint32_t stackFree;     // Lowest free stack seen
+    bool stackWarned;
+};
+
+// Central table of the hub's tasks. Priorities, cores, stacks and deadlines
+// are declared in one place (see TASKS in main.cpp) so they can be tuned
+// from the numbers this reports rather than guessed per call site.
+//
+// A task calls delay() instead of vTaskDelay(). It feeds the task
+// watchdog, checks the gap since the last iteration against the deadline
+// and accounts busy time. sample() reads stack high-water marks and CPU
+// shares.
+class TaskTable {
+public:
+    TaskTable();
+    // Sets the watchdog timeout, TASK_WDT_TIMEOUT
+    void begin(const TaskSpec* specs, uint8_t count);
+    bool start(uint8_t id, void* parameter = nullptr);
+    bool isRunning(uint8_t id) const { return id < count && stats[id].handle != nullptr; }
+    TaskHandle_t handle(uint8_t id) const { return id < count ? stats[id].handle : nullptr; }
+
+    // From the task itself
+    void checkIn();
+    void delay(uint32_t ms);
+    // Like delay(), but returns early (true) on a task notification
+    bool waitNotify(uint32_t ms);
+    // Like delay(), but returns early (true) once the queue has an item,
+    // which is copied to peeked and left in the queue
+    bool waitQueue(QueueHandle_t queue, void* peeked, uint32_t ms);
+    // Around any other blocking wait, so it isn't counted as busy time
+    void idleBegin();
+    void idleEnd();
+    // Before a task returns from its function
+    void finish();
+
+    // Every TASK_SAMPLE_INTERVAL from loop()
+    void sample();
+    uint32_t minStackFree() const;
+    size_t format(char* out, size_t len) const;
+
+private:
+    const TaskSpec* specs;
+    uint8_t count;
+    TaskStats stats[TASK_TABLE_CAPACITY];
+    uint64_t lastSampleUs;
+
+    static void trampoline(void* entry);
+    TaskStats* current();
+};
+
+extern TaskTable taskTable;
@@ -0,0 +1,619 @@
+#include "tls_client.h"
+#include "memory_pools.h"
+#include "event_log.h"
+#include <stddef.h>
+
+#if MQTT_TLS
+#include <mbedtls/platform.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/version.h>
+
+// mbedTLS 3 made the session fields private
+#ifndef MBEDTLS_PRIVATE
+#define MBEDTLS_PRIVATE(member) member
+#endif
+#endif
+
+// ---------------------------------------------------------------------------
+// TlsMemory
+// ---------------------------------------------------------------------------
+
+// In front of every block, padded so the block keeps malloc's alignment
+union TlsBlockHeader {
+    struct {
+        uint32_t size;
+        bool psram;
+    } info;
+    max_align_t align;
+};
+
+std::atomic<uint32_t> TlsMemory::inUse(0);
+std::atomic<uint32_t> TlsMemory::peak(0);
+std::atomic<uint32_t> TlsMemory::psram(0);
+std::atomic<uint32_t> TlsMemory::failures(0);
+
+bool TlsMemory::install() {
+#if MQTT_TLS && defined(MBEDTLS_PLATFORM_MEMORY) && !defined(MBEDTLS_PLATFORM_CALLOC_MACRO)
+    return mbedtls_platform_set_calloc_free(allocate, release) == 0;
+#else
+    return false;
+#endif
+}
+
+void* TlsMemory::allocate(size_t count, size_t size) {
+    if (count != 0 && size > (UINT32_MAX - sizeof(TlsBlockHeader)) / count) {
+        failures++;
+        return nullptr;
+    }
+    size_t bytes = count * size;
+    MemoryRegion region = bytes >= TLS_PSRAM_MIN ? MEM_PSRAM : MEM_INTERNAL;
+    TlsBlockHeader* block = (TlsBlockHeader*)regionAlloc(sizeof(TlsBlockHeader) + bytes, region);
+    if (!block) {
+        failures++;
+        return nullptr;
+    }
+    memset(block + 1, 0, bytes);
+    block->info.size = bytes;
+    block->info.psram = regionIsPsram(block);
+    if (block->info.psram) {
+        psram += bytes;
+    }
+    uint32_t now = inUse.fetch_add(bytes) + bytes;
+    uint32_t seen = peak.load();
+    while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+    }
+    return block + 1;
+}
+
+void TlsMemory::release(void* ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    TlsBlockHeader* block = (TlsBlockHeader*)ptr - 1;
+    inUse -= block->info.size;
+    if (block->info.psram) {
+        psram -= block->info.size;
+    }
+    regionFree(block);
+}
+
+TlsMemoryStats TlsMemory::getStats() {
+    TlsMemoryStats out;
+    out.inUse = inUse.load();
+    out.peak = peak.load();
+    out.psram = psram.load();
+    out.failures = failures.load();
+    return out;
+}
+
+void TlsMemory::resetPeak() {
+    peak = inUse.load();
+}
+
+void TlsHandshakeTimes::record(uint32_t us) {
+    if (count == 0 || us < minUs) {
+        minUs = us;
+    }
+    if (us > maxUs) {
+        maxUs = us;
+    }
+    lastUs = us;
+    totalUs += us;
+    count++;
+}
+
+// ---------------------------------------------------------------------------
+// TlsClient
+// ---------------------------------------------------------------------------
+
+#if MQTT_TLS
+
+// A session as kept in the session store
+struct TlsSessionHeader {
+    uint32_t magic;
+    uint32_t server;            // crc32 of "host:port"
+    uint32_t length;            // Of the mbedtls_ssl_session_save() blob that follows
+    uint32_t crc;               // Of that blob
+};
+
+#define TLS_SESSION_MAGIC 0x544C5331   // "TLS1"
+
+TlsClient::TlsClient(Client* transport) : transport(transport) {
+    memset(&stats, 0, sizeof(stats));
+    caLoaded = false;
+    ready = false;
+    open = false;
+    peeked = -1;
+    sessionStore = nullptr;
+    sessionSlot = 0;
+    sessionChecked = false;
+    haveSession = false;
+    sessionServer = 0;
+    // Plain memsets; whatever allocates waits for setup(), after TlsMemory::install()
+    mbedtls_ssl_init(&ssl);
+    mbedtls_ssl_config_init(&conf);
+    mbedtls_x509_crt_init(&ca);
+    mbedtls_ssl_session_init(&session);
+    ciphersuites[0] = 0;
+}
+
+TlsClient::~TlsClient() {
+    mbedtls_ssl_free(&ssl);
+    mbedtls_ssl_config_free(&conf);
+    mbedtls_x509_crt_free(&ca);
+    mbedtls_ssl_session_free(&session);
+    if (ready) {
+        mbedtls_ctr_drbg_free(&drbg);
+        mbedtls_entropy_free(&entropy);
+    }
+}
+
+bool TlsClient::setCaCert(const uint8_t* data, size_t length) {
+    mbedtls_x509_crt_free(&ca);
+    mbedtls_x509_crt_init(&ca);
+    // > 0: that many certificates of a PEM bundle failed, the rest loaded
+    int ret = mbedtls_x509_crt_parse(&ca, data, length);
+    caLoaded = ret >= 0 && ca.version != 0;
+    if (!caLoaded) {
+        Serial.printf("Broker CA certificate rejected (-0x%04x)\n", (unsigned)-ret);
+    }
+    return caLoaded;
+}
+
+bool TlsClient::loadCaFile(HalFileSystem* primary, HalFileSystem* fallback) {
+    HalFileSystem* storages[] = {primary, fallback};
+    for (HalFileSystem* storage : storages) {
+        if (storage == nullptr) {
+            continue;
+        }
+        long fileLength = storage->fileSize(MQTT_CA_FILE);
+        if (fileLength <= 0) {
+            continue;
+        }
+        if (fileLength > TLS_CA_MAX) {
+            Serial.printf("Broker CA file on %s too large\n", storage->name());
+            continue;
+        }
+        // PEM has to be passed terminated, the terminator counted
+        uint8_t* buf = (uint8_t*)regionAlloc(fileLength + 1, MEM_PSRAM);
+        if (!buf) {
+            Serial.println("Out of memory reading broker CA file");
+            return false;
+        }
+        size_t bytesRead = storage->readFile(MQTT_CA_FILE, buf, fileLength);
+        buf[bytesRead] = '\0';
+        bool pem = bytesRead > 10 && memcmp(buf, "-----BEGIN", 10) == 0;
+        bool loaded = setCaCert(buf, pem ? bytesRead + 1 : bytesRead);
+        regionFree(buf);
+        if (loaded) {
+            Serial.printf("Broker CA loaded from %s\n", storage->name());
+            return true;
+        }
+    }
+    return false;
+}
+
+void TlsClient::setSessionStore(ConfigSlotStore* store, uint8_t slot) {
+    sessionStore = store;
+    sessionSlot = slot;
+    sessionChecked = false;
+}
+
+void TlsClient::forgetSession() {
+    mbedtls_ssl_session_free(&session);
+    mbedtls_ssl_session_init(&session);
+    haveSession = false;
+    // The stored one is for the same server and would come back after a
+    // reboot; its first handshake then fails over to a full one and
+    // replaces it. Not worth a flash write here.
+}
+
+bool TlsClient::setup() {
+    if (ready) {
+        return true;
+    }
+    if (!caLoaded) {
+        Serial.println("No broker CA certificate (" MQTT_CA_FILE "), not connecting over TLS");
+        return false;
+    }
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&drbg);
+    static const char personal[] = "fao56-hub";
+    int ret = mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy,
+                                    (const unsigned char*)personal, sizeof(personal) - 1);
+    if (ret == 0) {
+        ret = mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                          MBEDTLS_SSL_PRESET_DEFAULT);
+    }
+    if (ret != 0) {
+        fail(ret, "setup");
+        mbedtls_ctr_drbg_free(&drbg);
+        mbedtls_entropy_free(&entropy);
+        return false;
+    }
+    mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain(&conf, &ca, nullptr);
+    mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &drbg);
+    // Resumption below is written against 1.2 sessions
+#if MBEDTLS_VERSION_NUMBER >= 0x03020000
+    mbedtls_ssl_conf_max_tls_version(&conf, MBEDTLS_SSL_VERSION_TLS1_2);
+#else
+    mbedtls_ssl_conf_max_version(&conf, MBEDTLS_SSL_MAJOR_VERSION_3, MBEDTLS_SSL_MINOR_VERSION_3);
+#endif
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(&conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+
+    // TLS_CIPHERSUITES, in order, without the ones this build lacks
+    uint8_t count = 0;
+    const char* name = TLS_CIPHERSUITES;
+    while (*name != '\0' && count < TLS_MAX_CIPHERSUITES) {
+        const char* end = strchr(name, ':');
+        size_t length = end ? (size_t)(end - name) : strlen(name);
+        char suite[64];
+        if (length < sizeof(suite)) {
+            memcpy(suite, name, length);
+            suite[length] = '\0';
+            int id = mbedtls_ssl_get_ciphersuite_id(suite);
+            if (id != 0) {
+                ciphersuites[count++] = id;
+            } else {
+                Serial.printf("TLS cipher suite %s not in this build\n", suite);
+            }
+        }
+        name += length;
+        if (*name == ':') {
+            name++;
+        }
+    }
+    ciphersuites[count] = 0;
+    if (count > 0) {
+        mbedtls_ssl_conf_ciphersuites(&conf, ciphersuites);
+    }
+
+    ret = mbedtls_ssl_setup(&ssl, &conf);
+    if (ret != 0) {
+        fail(ret, "setup");
+        mbedtls_ctr_drbg_free(&drbg);
+        mbedtls_entropy_free(&entropy);
+        return false;
+    }
+    ready = true;
+    return true;
+}
+
+int TlsClient::connect(IPAddress ip, uint16_t port) {
+    char host[16];
+    snprintf(host, sizeof(host), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+    return connect(host, port);
+}
+
+int TlsClient::connect(const char* host, uint16_t port) {
+    if (open) {
+        stop();
+    }
+    if (!setup()) {
+        stats.failures++;
+        return 0;
+    }
+    if (!transport->connect(host, port)) {
+        return 0;               // No TLS yet, PubSubClient reports the state
+    }
+    if (!handshake(host, port)) {
+        transport->stop();
+        return 0;
+    }
+    return 1;
+}
+
+bool TlsClient::handshake(const char* host, uint16_t port) {
+    char server[80];
+    snprintf(server, sizeof(server), "%s:%u", host, port);
+    uint32_t serverId = crc32((const uint8_t*)server, strlen(server));
+    if (!sessionChecked) {
+        loadSession(serverId);
+    }
+    if (haveSession && sessionServer != serverId) {
+        forgetSession();
+    }
+
+    mbedtls_ssl_session_reset(&ssl);
+    int ret = mbedtls_ssl_set_hostname(&ssl, host);
+    if (ret != 0) {
+        fail(ret, "hostname");
+        return false;
+    }
+    mbedtls_ssl_set_bio(&ssl, this, sendCallback, receiveCallback, nullptr);
+    // Copied into the handshake; ours stays for the comparison below
+    bool offered = haveSession && mbedtls_ssl_set_session(&ssl, &session) == 0;
+    unsigned char offeredMaster[sizeof(session.MBEDTLS_PRIVATE(master))];
+    if (offered) {
+        memcpy(offeredMaster, session.MBEDTLS_PRIVATE(master), sizeof(offeredMaster));
+    }
+
+    TlsMemoryStats before = TlsMemory::getStats();
+    TlsMemory::resetPeak();
+    uint32_t start = micros();
+    uint32_t computeUs = 0;
+    while (true) {
+        uint32_t callStart = micros();
+        ret = mbedtls_ssl_handshake(&ssl);
+        computeUs += micros() - callStart;
+        if (ret == 0) {
+            break;
+        }
+        if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            fail(ret, "handshake");
+            if (offered) {
+                forgetSession();    // Don't offer it again
+            }
+            return false;
+        }
+        if (micros() - start > TLS_HANDSHAKE_TIMEOUT * 1000UL) {
+            fail(MBEDTLS_ERR_SSL_TIMEOUT, "handshake");
+            return false;
+        }
+        delay(1);
+    }
+    uint32_t elapsed = micros() - start;
+    TlsMemoryStats after = TlsMemory::getStats();
+
+    // A resumed handshake keeps the master secret; with tickets the session
+    // ID says nothing, the client makes one up each time
+    mbedtls_ssl_session_free(&session);
+    mbedtls_ssl_session_init(&session);
+    haveSession = mbedtls_ssl_get_session(&ssl, &session) == 0;
+    bool resumed = offered && haveSession &&
+                   memcmp(offeredMaster, session.MBEDTLS_PRIVATE(master), sizeof(offeredMaster)) == 0;
+    if (haveSession) {
+        sessionServer = serverId;
+        if (!resumed) {
+            saveSession();      // Resumed ones are the same session, spare the flash
+        }
+    } else {
+        mbedtls_ssl_session_free(&session);
+        mbedtls_ssl_session_init(&session);
+    }
+
+    (resumed ? stats.resumed : stats.full).record(elapsed);
+    stats.lastResumed = resumed;
+    stats.lastComputeUs = computeUs;
+    stats.lastPeakBytes = after.peak > before.inUse ? after.peak - before.inUse : 0;
+    if (stats.lastPeakBytes > stats.maxPeakBytes) {
+        stats.maxPeakBytes = stats.lastPeakBytes;
+    }
+    stats.lastError = 0;
+    open = true;
+    peeked = -1;
+    stats.lastSuite = mbedtls_ssl_get_ciphersuite(&ssl);
+    LOG_INFO(LOG_MQTT, "TLS %s handshake: %lu ms, %lu ms computing, peak %lu bytes",
+             resumed ? "resumed" : "full",
+             (unsigned long)(elapsed / 1000), (unsigned long)(computeUs / 1000),
+             (unsigned long)stats.lastPeakBytes);
+    return true;
+}
+
+void TlsClient::fail(int error, const char* what) {
+    stats.failures++;
+    stats.lastError = error;
+    if (error == MBEDTLS_ERR_X509_CERT_VERIFY_FAILED) {
+        LOG_WARN(LOG_MQTT, "TLS broker certificate not trusted, flags 0x%lx",
+                 (unsigned long)mbedtls_ssl_get_verify_result(&ssl));
+    } else {
+        LOG_WARN(LOG_MQTT, "TLS %s failed: -0x%04x", what, (unsigned)-error);
+    }
+}
+
+// The connection broke after the handshake
+void TlsClient::drop(int error) {
+    if (error != MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
+        stats.lastError = error;
+        LOG_WARN(LOG_MQTT, "TLS connection lost: -0x%04x", (unsigned)-error);
+    }
+    stop();
+}
+
+void TlsClient::loadSession(uint32_t server) {
+    sessionChecked = true;
+    if (sessionStore == nullptr) {
+        return;
+    }
+    uint8_t* blob = (uint8_t*)regionAlloc(sizeof(TlsSessionHeader) + TLS_SESSION_MAX, MEM_PSRAM);
+    if (!blob) {
+        return;
+    }
+    size_t n = sessionStore->read(sessionSlot, blob, sizeof(TlsSessionHeader) + TLS_SESSION_MAX);
+    TlsSessionHeader header;
+    if (n >= sizeof(header)) {
+        memcpy(&header, blob, sizeof(header));
+        const uint8_t* data = blob + sizeof(header);
+        if (header.magic == TLS_SESSION_MAGIC && header.server == server &&
+            header.length <= n - sizeof(header) && crc32(data, header.length) == header.crc &&
+            mbedtls_ssl_session_load(&session, data, header.length) == 0) {
+            haveSession = true;
+            sessionServer = server;
+            stats.sessionLoaded = true;
+        } else {
+            mbedtls_ssl_session_free(&session);
+            mbedtls_ssl_session_init(&session);
+        }
+    }
+    regionFree(blob);
+}
+
+void TlsClient::saveSession() {
+    if (sessionStore == nullptr) {
+        return;
+    }
+    uint8_t* blob = (uint8_t*)regionAlloc(sizeof(TlsSessionHeader) + TLS_SESSION_MAX, MEM_PSRAM);
+    if (!blob) {
+        return;
+    }
+    size_t length = 0;
+    int ret = mbedtls_ssl_session_save(&session, blob + sizeof(TlsSessionHeader), TLS_SESSION_MAX, &length);
+    if (ret == 0) {
+        TlsSessionHeader header;
+        header.magic = TLS_SESSION_MAGIC;
+        header.server = sessionServer;
+        header.length = length;
+        header.crc = crc32(blob + sizeof(header), length);
+        memcpy(blob, &header, sizeof(header));
+        if (sessionStore->write(sessionSlot, blob, sizeof(header) + length)) {
+            stats.sessionsSaved++;
+        }
+    } else {
+        LOG_WARN(LOG_MQTT, "TLS session not saved: -0x%04x", (unsigned)-ret);
+    }
+    regionFree(blob);
+}
+
+int TlsClient::sendCallback(void* context, const unsigned char* data, size_t length) {
+    TlsClient* self = (TlsClient*)context;
+    size_t written = self->transport->write(data, length);
+    if (written > 0) {
+        return (int)written;
+    }
+    return self->transport->connected() ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_NET_CONN_RESET;
+}
+
+// Never waits: nothing there yet is WANT_READ, the loops above retry
+int TlsClient::receiveCallback(void* context, unsigned char* data, size_t length) {
+    TlsClient* self = (TlsClient*)context;
+    int waiting = self->transport->available();
+    if (waiting <= 0) {
+        return self->transport->connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+    }
+    int n = self->transport->read(data, length < (size_t)waiting ? length : (size_t)waiting);
+    return n > 0 ? n : MBEDTLS_ERR_SSL_WANT_READ;
+}
+
+size_t TlsClient::write(uint8_t byte) {
+    return write(&byte, 1);
+}
+
+size_t TlsClient::write(const uint8_t* buffer, size_t size) {
+    if (!open) {
+        return 0;
+    }
+    size_t written = 0;
+    uint32_t start = millis();
+    while (written < size) {
+        int ret = mbedtls_ssl_write(&ssl, buffer + written, size - written);
+        if (ret > 0) {
+            written += ret;
+            continue;
+        }
+        if (ret != MBEDTLS_ERR_SSL_WANT_WRITE && ret != MBEDTLS_ERR_SSL_WANT_READ) {
+            drop(ret);
+            break;
+        }
+        if (millis() - start > TLS_HANDSHAKE_TIMEOUT) {
+            drop(MBEDTLS_ERR_SSL_TIMEOUT);
+            break;
+        }
+        delay(1);
+    }
+    return written;
+}
+
+int TlsClient::available() {
+    if (!open) {
+        return 0;
+    }
+    int pending = (peeked >= 0 ? 1 : 0) + (int)mbedtls_ssl_get_bytes_avail(&ssl);
+    if (pending == 0 && transport->available() > 0) {
+        // Decrypt the next record into mbedTLS's buffer without taking any of it
+        int ret = mbedtls_ssl_read(&ssl, nullptr, 0);
+        if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            drop(ret);
+            return 0;
+        }
+        pending = (int)mbedtls_ssl_get_bytes_avail(&ssl);
+    }
+    return pending;
+}
+
+int TlsClient::read() {
+    uint8_t byte;
+    return read(&byte, 1) == 1 ? byte : -1;
+}
+
+int TlsClient::read(uint8_t* buffer, size_t size) {
+    if (!open || size == 0) {
+        return -1;
+    }
+    size_t taken = 0;
+    if (peeked >= 0) {
+        buffer[taken++] = (uint8_t)peeked;
+        peeked = -1;
+    }
+    if (taken == size || available() == 0) {
+        return taken > 0 ? (int)taken : -1;
+    }
+    int ret = mbedtls_ssl_read(&ssl, buffer + taken, size - taken);
+    if (ret > 0) {
+        return (int)taken + ret;
+    }
+    if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+        drop(ret);
+    }
+    return taken > 0 ? (int)taken : -1;
+}
+
+int TlsClient::peek() {
+    if (peeked < 0) {
+        uint8_t byte;
+        if (read(&byte, 1) == 1) {
+            peeked = byte;
+        }
+    }
+    return peeked;
+}
+
+void TlsClient::flush() {
+    transport->flush();
+}
+
+void TlsClient::stop() {
+    if (open) {
+        open = false;
+        mbedtls_ssl_close_notify(&ssl);   // Best effort, the socket closes anyway
+    }
+    peeked = -1;
+    transport->stop();
+}
+
+uint8_t TlsClient::connected() {
+    if (!open) {
+        return 0;
+    }
+    return transport->connected() || available() > 0;
+}
+
+size_t TlsClient::formatStats(char* out, size_t len) {
+    TlsMemoryStats memory = TlsMemory::getStats();
+    int n = snprintf(out, len,
+                     "TLS: %s, %lu full handshakes (mean %lu ms, max %lu ms), "
+                     "%lu resumed (mean %lu ms, max %lu ms), %lu failed, last error -0x%04x\n"
+                     "Last handshake: %s, %s, %lu ms computing, peak %lu bytes (worst %lu)\n"
+                     "mbedTLS memory: %lu bytes held, %lu in PSRAM, %lu failed allocations\n"
+                     "Session: %s, %s at boot, saved %lu times\n",
+                     open ? "connected" : "not connected",
+                     (unsigned long)stats.full.count, (unsigned long)(stats.full.meanUs() / 1000),
+                     (unsigned long)(stats.full.maxUs / 1000),
+                     (unsigned long)stats.resumed.count, (unsigned long)(stats.resumed.meanUs() / 1000),
+                     (unsigned long)(stats.resumed.maxUs / 1000),
+                     (unsigned long)stats.failures, (unsigned)-stats.lastError,
+                     stats.lastResumed ? "resumed" : "full", stats.lastSuite ? stats.lastSuite : "-",
+                     (unsigned long)(stats.lastComputeUs / 1000),
+                     (unsigned long)stats.lastPeakBytes, (unsigned long)stats.maxPeakBytes,
+                     (unsigned long)memory.inUse, (unsigned long)memory.psram, (unsigned long)memory.failures,
+                     haveSession ? "cached" : "none", stats.sessionLoaded ? "loaded" : "not loaded",
+                     (unsigned long)stats.sessionsSaved);
+    if (n < 0) {
+        return 0;
+    }
+    return (size_t)n < len ? (size_t)n : len - 1;
+}
+
+#endif  // MQTT_TLS
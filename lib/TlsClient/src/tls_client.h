@@ -0,0 +1,145 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Client.h>
+#include <atomic>
+#include "config.h"
+#include "hal.h"
+#include "config_image.h"
+
+#if MQTT_TLS
+#include <mbedtls/ssl.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/x509_crt.h>
+#endif
+
+// What mbedTLS has allocated through TlsMemory, in bytes
+struct TlsMemoryStats {
+    uint32_t inUse;
+    uint32_t peak;              // Since resetPeak()
+    uint32_t psram;             // Of inUse, in PSRAM
+    uint32_t failures;
+};
+
+// mbedTLS's allocator. Blocks of TLS_PSRAM_MIN bytes and up (the record
+// buffers, certificates) go to PSRAM, the many small ones (bignums) stay in
+// internal RAM. Counts what is held so a handshake's peak can be measured.
+// install() has to run before anything allocates through mbedTLS, so first
+// thing in setup(); it does nothing when the mbedTLS build fixes its
+// allocator at compile time.
+class TlsMemory {
+public:
+    static bool install();
+    static void* allocate(size_t count, size_t size);
+    static void release(void* ptr);
+    static TlsMemoryStats getStats();
+    static void resetPeak();
+
+private:
+    static std::atomic<uint32_t> inUse;
+    static std::atomic<uint32_t> peak;
+    static std::atomic<uint32_t> psram;
+    static std::atomic<uint32_t> failures;
+};
+
+struct TlsHandshakeTimes {
+    uint32_t count;
+    uint32_t lastUs;
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint64_t totalUs;
+
+    void record(uint32_t us);
+    uint32_t meanUs() const { return count ? (uint32_t)(totalUs / count) : 0; }
+};
+
+struct TlsStats {
+    TlsHandshakeTimes full;
+    TlsHandshakeTimes resumed;
+    uint32_t failures;
+    int32_t lastError;          // mbedTLS error code, 0 if none
+    uint32_t lastComputeUs;     // Time inside mbedTLS in the last handshake, without network waits
+    bool lastResumed;
+    const char* lastSuite;      // Cipher suite of the last handshake
+    uint32_t lastPeakBytes;     // Most mbedTLS held during the last handshake, above what it held before
+    uint32_t maxPeakBytes;
+    uint32_t sessionsSaved;     // Written to the session store
+    bool sessionLoaded;         // Came from the store at boot
+};
+
+#if MQTT_TLS
+
+// The broker connection over TLS 1.2, wrapped around a plain Client
+// (WiFiClient on the device, PosixTcpClient natively) so PubSubClient sees
+// just another Client.
+//
+// A full handshake costs the ECDHE key exchange and the certificate chain;
+// on a flaky link that adds up. After one, the session (ticket or ID) is
+// kept in RAM and offered on the next connect, which the broker can accept
+// with an abbreviated handshake: no certificates, no key exchange. It also
+// goes to the session store (NVS) so the first connect after a reboot can
+// resume too. The CA chain is parsed once and kept.
+class TlsClient : public Client {
+public:
+    explicit TlsClient(Client* transport);
+    ~TlsClient();
+
+    // PEM (terminated) or DER; parsed once, kept for every connect
+    bool setCaCert(const uint8_t* data, size_t length);
+    // MQTT_CA_FILE from the first storage that has it
+    bool loadCaFile(HalFileSystem* primary, HalFileSystem* fallback);
+    bool hasCaCert() const { return caLoaded; }
+    // Where the session survives a reboot, nullptr for RAM only
+    void setSessionStore(ConfigSlotStore* store, uint8_t slot);
+    // Next connect does a full handshake
+    void forgetSession();
+
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char* host, uint16_t port) override;
+    size_t write(uint8_t byte) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t* buffer, size_t size) override;
+    int peek() override;
+    void flush() override;
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override { return connected(); }
+
+    const TlsStats& getStats() const { return stats; }
+    size_t formatStats(char* out, size_t len);
+
+private:
+    Client* transport;
+    TlsStats stats;
+    bool caLoaded;
+    bool ready;                 // mbedTLS contexts set up
+    bool open;                  // Handshake done, not stopped
+    int peeked;
+    ConfigSlotStore* sessionStore;
+    uint8_t sessionSlot;
+    bool sessionChecked;        // The store was read once
+    bool haveSession;
+    uint32_t sessionServer;     // crc32 of "host:port" the session belongs to
+
+    mbedtls_ssl_context ssl;
+    mbedtls_ssl_config conf;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context drbg;
+    mbedtls_x509_crt ca;
+    mbedtls_ssl_session session;
+    int ciphersuites[TLS_MAX_CIPHERSUITES + 1];
+
+    bool setup();
+    bool handshake(const char* host, uint16_t port);
+    void fail(int error, const char* what);
+    void drop(int error);
+    void loadSession(uint32_t server);
+    void saveSession();
+    static int sendCallback(void* context, const unsigned char* data, size_t length);
+    static int receiveCallback(void* context, unsigned char* data, size_t length);
+};
+
+#endif  // MQTT_TLS
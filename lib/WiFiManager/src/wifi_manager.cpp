@@ -1,58 +1,276 @@
 #include "wifi_manager.h"
-int connectionFailures = 0;
-const int MAX_FAILURES_BEFORE_CONFIG = 5;
-WiFiManager::WiFiManager(HubConfig* config) {
+#include <string.h>
+#include <stdio.h>
+
+#ifdef ARDUINO
+#include <WiFi.h>
+#endif
+
+// Reason code of a disconnect we asked for ourselves (WiFi.begin() on a busy
+// station, attempt timeouts). Not a failure of the attempt that follows it.
+static const uint8_t REASON_ASSOC_LEAVE = 8;
+
+static const char* stateName(WiFiState state) {
+    switch (state) {
+        case WIFI_IDLE: return "idle";
+        case WIFI_CONNECTING: return "connecting";
+        case WIFI_CONNECTED: return "connected";
+        case WIFI_BACKOFF: return "backoff";
+    }
+    return "?";
+}
+
+WiFiManager::WiFiManager(HubConfig* config, HalWiFiRadio* radio, HalClock* clock) {
     this->config = config;
+    this->radio = radio;
+    this->clock = clock;
+    state = WIFI_IDLE;
+    started = false;
+    memset(&cache, 0, sizeof(cache));
+    cacheValid = false;
+    attemptIsFast = false;
+    attemptStartMs = 0;
+    backoffUntilMs = 0;
+    linkLost = false;
+    linkLostMs = 0;
+    beginMs = 0;
+    consecutiveFailures = 0;
+    memset(&stats, 0, sizeof(stats));
+    eventHead = 0;
+    eventCount = 0;
 }
 
-bool WiFiManager::connect() {
-    // Connect to a WiFi network
-    Serial.println();
-    Serial.print("Connecting to ");
-    Serial.println(config->wifi_ssid);
-  
-    WiFi.begin(config->wifi_ssid.c_str(), config->wifi_password.c_str());
-    
-    // Add a timeout (30 seconds)
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 30) {
-        delay(1000);
-        Serial.print(".");
-        attempts++;
-    }
-  
-    if (WiFi.status() == WL_CONNECTED) {
-        Serial.println("");
-        Serial.println("WiFi connected");
-        Serial.print("IP address: ");
-        Serial.println(WiFi.localIP());
-        return true;  // Return success
-    } else {
-        Serial.println("");
-        Serial.println("WiFi connection failed!");
-        return false;  // Return failure
+void WiFiManager::begin() {
+    if (started) {
+        return;
     }
-    if (WiFi.status() == WL_CONNECTED) {
-        connectionFailures = 0;
-        return true;
-    } else {
-        connectionFailures++;
-        if (connectionFailures >= MAX_FAILURES_BEFORE_CONFIG) {
-            Serial.println("Too many connection failures, entering config mode");
-            // Call portal manager's begin method here or set a flag
-            return false;
+    started = true;
+    radio->setEventHandler(eventThunk, this);
+
+    uint32_t now = clock->millis32();
+    beginMs = now;
+    cacheValid = radio->loadCache(&cache) && cache.ssidHash == ssidHash();
+    startAttempt(now);
+}
+
+bool WiFiManager::connect(uint32_t timeoutMs) {
+    begin();
+    uint32_t start = clock->millis32();
+    while (!isConnected() && clock->millis32() - start < timeoutMs) {
+        loop();
+        clock->sleepMs(10);
+    }
+    return isConnected();
+}
+
+void WiFiManager::reconfigure() {
+    if (!started) {
+        begin();
+        return;
+    }
+    if (cacheValid && cache.ssidHash != ssidHash()) {
+        cacheValid = false;
+    }
+    consecutiveFailures = 0;
+    linkLost = false;
+    radio->disconnect();
+    startAttempt(clock->millis32());
+}
+
+void WiFiManager::eventThunk(void* context, HalWiFiEvent event, uint8_t reason) {
+    static_cast<WiFiManager*>(context)->onEvent(event, reason);
+}
+
+// Called from the WiFi driver's task: only queue, loop() does the work
+void WiFiManager::onEvent(HalWiFiEvent event, uint8_t reason) {
+    guard.lock();
+    if (eventCount < EVENT_QUEUE_SIZE) {
+        QueuedEvent& slot = events[(eventHead + eventCount) % EVENT_QUEUE_SIZE];
+        slot.event = event;
+        slot.reason = reason;
+        eventCount++;
+    }
+    guard.unlock();
+}
+
+bool WiFiManager::popEvent(QueuedEvent* out) {
+    bool popped = false;
+    guard.lock();
+    if (eventCount > 0) {
+        *out = events[eventHead];
+        eventHead = (eventHead + 1) % EVENT_QUEUE_SIZE;
+        eventCount--;
+        popped = true;
+    }
+    guard.unlock();
+    return popped;
+}
+
+void WiFiManager::loop() {
+    if (!started) {
+        return;
+    }
+    uint32_t now = clock->millis32();
+
+    QueuedEvent event;
+    while (popEvent(&event)) {
+        handleEvent(event, now);
+    }
+
+    if (state == WIFI_CONNECTING) {
+        uint32_t timeout = attemptIsFast ? WIFI_FAST_TIMEOUT : WIFI_CONNECT_TIMEOUT;
+        if (now - attemptStartMs >= timeout) {
+            Serial.printf("WiFi attempt timed out after %lu ms\n", (unsigned long)(now - attemptStartMs));
+            attemptFailed(now);
+        }
+    } else if (state == WIFI_BACKOFF && (int32_t)(now - backoffUntilMs) >= 0) {
+        startAttempt(now);
+    }
+}
+
+void WiFiManager::handleEvent(const QueuedEvent& event, uint32_t now) {
+    switch (event.event) {
+        case WIFI_EVT_CONNECTED:
+            break;
+
+        case WIFI_EVT_GOT_IP: {
+            if (state == WIFI_CONNECTED) {
+                break;
+            }
+            state = WIFI_CONNECTED;
+            consecutiveFailures = 0;
+            stats.connects++;
+            if (attemptIsFast) {
+                stats.fastSuccesses++;
+            }
+            if (linkLost) {
+                uint32_t took = now - linkLostMs;
+                stats.reconnects++;
+                stats.lastReconnectMs = took;
+                stats.totalReconnectMs += took;
+                if (stats.reconnects == 1 || took < stats.minReconnectMs) {
+                    stats.minReconnectMs = took;
+                }
+                if (took > stats.maxReconnectMs) {
+                    stats.maxReconnectMs = took;
+                }
+                linkLost = false;
+            } else if (stats.connects == 1) {
+                stats.firstConnectMs = now - beginMs;
+            }
+
+            // Only write flash when the AP or lease actually changed
+            WiFiApCache current;
+            if (radio->currentAp(&current)) {
+                current.ssidHash = ssidHash();
+                if (!cacheValid || memcmp(&current, &cache, sizeof(current)) != 0) {
+                    cache = current;
+                    radio->saveCache(cache);
+                }
+                cacheValid = true;
+            }
+
+            Serial.printf("WiFi connected, IP %u.%u.%u.%u, channel %u%s\n",
+                          (unsigned)(cache.ip & 0xFF), (unsigned)((cache.ip >> 8) & 0xFF),
+                          (unsigned)((cache.ip >> 16) & 0xFF), (unsigned)(cache.ip >> 24),
+                          cache.channel, attemptIsFast ? " (cached AP)" : "");
+            break;
         }
-        return false;
+
+        case WIFI_EVT_DISCONNECTED:
+        case WIFI_EVT_LOST_IP:
+            if (state == WIFI_CONNECTED) {
+                Serial.printf("WiFi link lost (reason %u), reconnecting\n", event.reason);
+                stats.linkLosses++;
+                linkLost = true;
+                linkLostMs = now;
+                if (event.event == WIFI_EVT_LOST_IP) {
+                    radio->disconnect();
+                }
+                startAttempt(now);
+            } else if (state == WIFI_CONNECTING && event.reason != REASON_ASSOC_LEAVE) {
+                Serial.printf("WiFi attempt rejected (reason %u)\n", event.reason);
+                attemptFailed(now);
+            }
+            break;
     }
 }
 
-bool WiFiManager::isConnected() {
-    return WiFi.status() == WL_CONNECTED;
+void WiFiManager::startAttempt(uint32_t now) {
+    attemptIsFast = cacheValid;
+    attemptStartMs = now;
+    state = WIFI_CONNECTING;
+    if (attemptIsFast) {
+        stats.fastAttempts++;
+        Serial.printf("Connecting to %s (cached AP, channel %u)\n", config->wifi_ssid, cache.channel);
+    } else {
+        Serial.printf("Connecting to %s\n", config->wifi_ssid);
+    }
+    radio->begin(config->wifi_ssid, config->wifi_password,
+                 attemptIsFast ? &cache : nullptr, attemptIsFast && WIFI_REUSE_LEASE);
 }
 
+void WiFiManager::attemptFailed(uint32_t now) {
+    stats.failures++;
+    consecutiveFailures++;
+    radio->disconnect();
+
+    if (consecutiveFailures == WIFI_MAX_FAILURES) {
+        Serial.println("Too many connection failures, entering config mode");
+    }
+
+    if (attemptIsFast) {
+        // The AP may have moved channel or been replaced, scan right away
+        cacheValid = false;
+        startAttempt(now);
+        return;
+    }
+
+    uint32_t shift = consecutiveFailures - 1 < 16 ? consecutiveFailures - 1 : 16;
+    uint32_t delayMs = (uint32_t)WIFI_BACKOFF_MIN << shift;
+    if (delayMs > WIFI_BACKOFF_MAX) {
+        delayMs = WIFI_BACKOFF_MAX;
+    }
+    state = WIFI_BACKOFF;
+    backoffUntilMs = now + delayMs;
+    Serial.printf("WiFi retry in %lu ms (%lu failures in a row)\n",
+                  (unsigned long)delayMs, (unsigned long)consecutiveFailures);
+}
+
+uint32_t WiFiManager::ssidHash() {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (const char* c = config->wifi_ssid; *c; c++) {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    return hash;
+}
+
+size_t WiFiManager::formatStats(char* out, size_t len) {
+    uint32_t mean = stats.reconnects ? (uint32_t)(stats.totalReconnectMs / stats.reconnects) : 0;
+    int n = snprintf(out, len,
+                     "state %s, %lu failures in a row\n"
+                     "connects %lu, link losses %lu, reconnects %lu, failed attempts %lu\n"
+                     "cached-AP attempts %lu (%lu ok), first connect %lu ms\n"
+                     "reconnect ms: last %lu min %lu max %lu mean %lu\n",
+                     stateName(state), (unsigned long)consecutiveFailures,
+                     (unsigned long)stats.connects, (unsigned long)stats.linkLosses,
+                     (unsigned long)stats.reconnects, (unsigned long)stats.failures,
+                     (unsigned long)stats.fastAttempts, (unsigned long)stats.fastSuccesses,
+                     (unsigned long)stats.firstConnectMs,
+                     (unsigned long)stats.lastReconnectMs, (unsigned long)stats.minReconnectMs,
+                     (unsigned long)stats.maxReconnectMs, (unsigned long)mean);
+    if (n < 0) {
+        return 0;
+    }
+    return (size_t)n < len ? (size_t)n : len - 1;
+}
+
+#ifdef ARDUINO
 void WiFiManager::setupAP(const char* ssid, const char* password) {
     WiFi.softAP(ssid, password);
     IPAddress IP = WiFi.softAPIP();
     Serial.print("AP IP address: ");
     Serial.println(IP);
-}
\ No newline at end of file
+}
+#endif
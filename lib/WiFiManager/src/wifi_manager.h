@@ -1,16 +1,90 @@
 #pragma once
 
 #include <Arduino.h>
-#include <WiFi.h>
 #include "config.h"
+#include "hal.h"
+#include "memory_pools.h"
 
+enum WiFiState : uint8_t {
+    WIFI_IDLE = 0,
+    WIFI_CONNECTING,
+    WIFI_CONNECTED,
+    WIFI_BACKOFF
+};
+
+struct WiFiStats {
+    uint32_t connects;          // GOT_IP events
+    uint32_t linkLosses;        // Disconnects while connected
+    uint32_t failures;          // Attempts that timed out or were rejected
+    uint32_t fastAttempts;      // Attempts using the cached BSSID/channel
+    uint32_t fastSuccesses;
+    uint32_t reconnects;        // Link losses that were recovered
+    uint32_t lastReconnectMs;   // Link loss to GOT_IP
+    uint32_t minReconnectMs;
+    uint32_t maxReconnectMs;
+    uint64_t totalReconnectMs;
+    uint32_t firstConnectMs;    // begin() to the first GOT_IP
+};
+
+// Event-driven station manager. The radio's event handler only queues
+// events; loop() applies them and runs the attempt/backoff timers, so all
+// state changes happen on one task. Reconnects try the cached BSSID and
+// channel first and fall back to a full scan.
 class WiFiManager {
 public:
-    WiFiManager(HubConfig* config);
-    bool connect();
-    bool isConnected();
+    WiFiManager(HubConfig* config, HalWiFiRadio* radio, HalClock* clock);
+    void begin();
+    // begin() plus waiting, driving loop() itself, for the boot stage
+    bool connect(uint32_t timeoutMs = WIFI_CONNECT_TIMEOUT);
+    void loop();
+    // SSID or password changed: drop the link and connect with the new ones
+    void reconfigure();
+    bool isConnected() { return state == WIFI_CONNECTED; }
+    WiFiState getState() { return state; }
+    uint32_t getConsecutiveFailures() { return consecutiveFailures; }
+    // Set once WIFI_MAX_FAILURES attempts in a row failed
+    bool shouldEnterPortal() { return consecutiveFailures >= WIFI_MAX_FAILURES; }
+    const WiFiStats& getStats() { return stats; }
+    size_t formatStats(char* out, size_t len);
+    void onEvent(HalWiFiEvent event, uint8_t reason);
+#ifdef ARDUINO
     void setupAP(const char* ssid = "MQTT-Hub-Config", const char* password = "admin@123");
+#endif
 
 private:
+    static const uint8_t EVENT_QUEUE_SIZE = 8;
+
+    struct QueuedEvent {
+        HalWiFiEvent event;
+        uint8_t reason;
+    };
+
     HubConfig* config;
-};
\ No newline at end of file
+    HalWiFiRadio* radio;
+    HalClock* clock;
+    volatile WiFiState state;
+    bool started;
+
+    WiFiApCache cache;
+    bool cacheValid;
+    bool attemptIsFast;
+    uint32_t attemptStartMs;
+    uint32_t backoffUntilMs;
+    bool linkLost;              // Set from link loss until the next GOT_IP
+    uint32_t linkLostMs;
+    uint32_t beginMs;
+    uint32_t consecutiveFailures;
+    WiFiStats stats;
+
+    QueuedEvent events[EVENT_QUEUE_SIZE];
+    uint8_t eventHead;
+    uint8_t eventCount;
+    PoolLock guard;
+
+    static void eventThunk(void* context, HalWiFiEvent event, uint8_t reason);
+    bool popEvent(QueuedEvent* out);
+    void handleEvent(const QueuedEvent& event, uint32_t now);
+    void startAttempt(uint32_t now);
+    void attemptFailed(uint32_t now);
+    uint32_t ssidHash();
+};
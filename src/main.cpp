@@ -2,41 +2,123 @@
 #include <ArduinoJson.h>
 #include "config.h"
 #include "config_manager.h"
+#include "config_body.h"
 #include "rtc_manager.h"
 #include "wifi_manager.h"
 #include "mqtt_manager.h"
 #include "portal_manager.h"
 #include "serial_manager.h"
 #include "oled_manager.h"
+#include "latency_tracer.h"
+#include "payload_encoder.h"
+#include "hal.h"
+#include "node_table.h"
+#include "benchmark.h"
+#include "memory_pools.h"
+#include "json_allocators.h"
+#include "boot_orchestrator.h"
+#include "live_feed.h"
+#include "task_table.h"
+#include "power_manager.h"
+#include "report_filter.h"
+#include "calibration.h"
+#include "sensor_quality.h"
+#include "downlink.h"
+#include "event_log.h"
+#include "console.h"
+#include "tls_client.h"
+#include "payload_compressor.h"
+#include "mqtt_broker.h"
+#include <WiFi.h>
+
+// Hardware abstraction
+SdFileSystem sdStorage(SD_CS);
+SpiffsFileSystem spiffsStorage;
+WireI2CBus i2cBus(&Wire);
+Esp32Clock systemClock;
+Esp32WiFiRadio wifiRadio;
+WiFiClient netClient;
+#if MQTT_TLS
+// The handshake runs on the loop task when MQTT reconnects
+SET_LOOP_TASK_STACK_SIZE(12 * 1024);
+TlsClient tlsClient(&netClient);
+#endif
 
 // Global instances
-ConfigManager configManager;
-RTCManager rtcManager;
-WiFiManager wifiManager(configManager.getConfig());
-MQTTManager mqttManager(configManager.getConfig());
-PortalManager portalManager(configManager.getConfig(), &configManager);
+NvsSlotStore configSlots;
+ConfigManager configManager(&sdStorage, &spiffsStorage, &configSlots);
+RTCManager rtcManager(&i2cBus);
+WiFiManager wifiManager(configManager.getConfig(), &wifiRadio, &systemClock);
+#if MQTT_TLS
+MQTTManager mqttManager(configManager.getConfig(), &tlsClient);
+#else
+MQTTManager mqttManager(configManager.getConfig(), &netClient);
+#endif
+#if MQTT_BROKER
+// Clients on the LAN, served by brokerTask; readings reach them even with
+// the upstream broker out of reach
+Esp32TcpServer brokerServer;
+MqttBroker broker(&brokerServer);
+#endif
+PortalManager portalManager(&configManager);
 OLEDManager oledManager;
+PowerManager powerManager;
 
 // Serial handling
 HardwareSerial interSerial(2);
-SerialManager serialManager(&interSerial);
+Esp32SerialPort hubPort(&interSerial);
+SerialManager serialManager(&hubPort);
+// Commands to the ESP-NOW hub and nodes, written by serialTask between frames
+DownlinkQueue downlink(&hubPort);
+
+// Task management, see TASKS below for placement
+enum TaskId : uint8_t {
+    TASK_INGEST,
+    TASK_MQTT,
+    TASK_LIVE,
+    TASK_DISPLAY,
+    TASK_BENCH,
+    TASK_LOG,
+    TASK_CONSOLE,
+#if MQTT_BROKER
+    TASK_BROKER,
+#endif
+    TASK_COUNT
+};
+QueueHandle_t readingQueue = NULL;
+
+// Pooled memory for the ingest -> publish path. Readings are small and hot,
+// so they stay in internal RAM; payload buffers go to PSRAM.
+TypedPool<Reading> readingPool("readings", READING_POOL_SIZE, MEM_INTERNAL);
+TypedPool<PayloadBuffer> payloadPool("payloads", PAYLOAD_POOL_SIZE, MEM_PSRAM);
+BumpArena jsonArena("json", JSON_ARENA_SIZE, MEM_INTERNAL);
+ArenaJsonAllocator jsonArenaAllocator(&jsonArena);
 
-// Task management
-TaskHandle_t serialTaskHandle = NULL;
-TaskHandle_t mqttTaskHandle = NULL;
-TaskHandle_t displayTaskHandle = NULL;
-SemaphoreHandle_t binSem = NULL;
+// Boot stages, see setup()
+BootOrchestrator boot;
+BootStageId configStage, oledStage, rtcStage, wifiStage, credsStage, mqttStage, ntpStage, rtcSyncStage;
 
-// Data instance for sensor data
-dhtData dataInstance;
-char jsonBuffer[MQTT_MAX_PACKET_SIZE];
-JsonDocument doc;
+// Last received reading, shown on the display
+SensorReading dataInstance;
+volatile uint32_t lastReadingMs = 0;
+NodeTable nodeTable;
+JsonDocument doc(&jsonArenaAllocator);
 
-// Structure for WiFi credentials to send to ESP-NOW hub
-typedef struct wifiCredentials {
-    char wifiSSID[32];
-    char wifiPass[64];
-} wifiCredentials;
+// Report by exception, owned by mqttTask
+ReportFilter reportFilter(ReportFilterConfig::defaults());
+// Applied by mqttTask, replaced by the MQTT calibration command
+CalibrationTable calibration;
+// Plausibility checks after calibration, owned by mqttTask
+QualityMonitor qualityMonitor(QualityConfig::defaults());
+#if PAYLOAD_COMPRESS
+// The readings of one wake-up, compressed into one message, owned by mqttTask
+PayloadCompressor compressor;
+char compressedNodes[COMPRESS_MESSAGES_MAX][SENSOR_NODE_ID_SIZE];
+#endif
+
+// Live dashboard, pushed over the portal server's /live WebSocket
+size_t writeLiveMetrics(char* out, size_t len);
+LiveFeed liveFeed(&nodeTable, &portalManager, writeLiveMetrics);
 
 // NTP Server setup 
 const char* ntpServer = "pool.ntp.org";
@@ -44,123 +126,881 @@ const char* ntpServer = "pool.ntp.org";
 const long gmtOffset_sec = 3600 * NTP_OFFSET;
 const int daylightOffset_sec = 3600;
 
-// Send WiFi credentials to ESP-NOW hub
+// Queue the WiFi credentials for the ESP-NOW hub. serialTask sends them and
+// picks up the ack, so this never touches the UART.
 bool sendWiFiCredentials() {
-    wifiCredentials creds;
-    HubConfig* config = configManager.getConfig();
-    
-    // Copy WiFi credentials from config
-    strncpy(creds.wifiSSID, config->wifi_ssid.c_str(), sizeof(creds.wifiSSID) - 1);
-    strncpy(creds.wifiPass, config->wifi_password.c_str(), sizeof(creds.wifiPass) - 1);
-    
-    // Ensure null termination
-    creds.wifiSSID[sizeof(creds.wifiSSID) - 1] = '\0';
-    creds.wifiPass[sizeof(creds.wifiPass) - 1] = '\0';
-    
-    Serial.println("Sending WiFi credentials to ESP-NOW hub");
-    Serial.print("SSID: ");
-    Serial.println(creds.wifiSSID);
-    
-    // Send start marker
-    interSerial.write('`');
-    
-    // Send credentials struct
-    size_t written = interSerial.write((uint8_t*)&creds, sizeof(creds));
-    
-    // Wait for confirmation (with timeout)
-    unsigned long startTime = millis();
-    while (millis() - startTime < 5000) { // 5 second timeout
-        if (interSerial.available()) {
-            byte confirmation = interSerial.read();
-            if (confirmation == 'W') {
-                Serial.println("WiFi credentials confirmed by ESP-NOW hub");
-                return true;
-            }
+    uint16_t id;
+    {
+        ConfigReader config(configManager);
+        id = downlink.sendWiFiCredentials(config->wifi_ssid, config->wifi_password);
+        Serial.printf("WiFi credentials for SSID %s queued for the ESP-NOW hub\n", config->wifi_ssid);
+    }
+    if (id == 0) {
+        Serial.println("Downlink queue full, WiFi credentials not sent");
+    }
+    return id != 0;
+}
+
+// Broadcast the time to every node, 0 until NTP has it
+uint16_t sendTimeSync() {
+    time_t now = time(nullptr);
+    if (now < 1600000000) {
+        return 0;
+    }
+    return downlink.sendTimeSync((uint32_t)now, (int16_t)(gmtOffset_sec / 60));
+}
+
+// Print the per-node aggregates collected by serialTask
+void printNodes(Print& out) {
+    unsigned long now = millis();
+    out.printf("%-8s %-7s %7s %7s %7s %7s %7s %7s %8s\n",
+               "node", "schema", "count", "temp", "min", "max", "humid", "moist", "age_s");
+    for (uint8_t i = 0; i < nodeTable.size(); i++) {
+        const NodeStats& node = nodeTable.at(i);
+        const SchemaInfo* schema = findSchema(node.schemaId);
+        out.printf("%-8s %-7s %7u %7.2f %7.2f %7.2f %7.2f %7ld %8lu\n",
+                   node.nodeID, schema ? schema->name : "?", (unsigned)node.count,
+                   node.lastTemp, node.minTemp, node.maxTemp, node.lastHumidity,
+                   node.lastMoisture, (now - node.lastSeenMs) / 1000);
+    }
+    if (nodeTable.getRejected()) {
+        out.printf("%u readings dropped, node table full\n", (unsigned)nodeTable.getRejected());
+    }
+    const FrameDecoderStats& frames = serialManager.getFrameStats();
+    out.printf("frames: %lu ok, %lu bad CRC, %lu malformed, %lu unknown schema, %lu bad version, %lu bytes skipped\n",
+               (unsigned long)frames.frames, (unsigned long)frames.crcErrors,
+               (unsigned long)frames.malformed, (unsigned long)frames.unknownSchema,
+               (unsigned long)frames.badVersion, (unsigned long)frames.skippedBytes);
+    out.printf("control frames: %lu, downlink commands pending: %u\n",
+               (unsigned long)frames.control, (unsigned)downlink.pending());
+}
+
+// One-shot task so the benchmark suite never runs on consoleTask's stack
+void benchTask(void *parameter) {
+    BenchOptions options;
+    options.mqtt = &mqttManager;
+    runBenchmarks(Serial, (BenchFormat)(intptr_t)parameter, options);
+}
+
+void printBootTimeline(Print& out) {
+    static char report[BOOT_REPORT_SIZE];
+    boot.formatTimeline(report, sizeof(report));
+    out.print(report);
+}
+
+// Commands, shared by the USB console and the MQTT command topic (see
+// COMMANDS below). Each prints its answer to out: the console shows it, over
+// MQTT every line becomes a message on TOPIC_REPLY + <name>. Commands that
+// change something take JSON, as they always have over MQTT, and answer
+// with a JSON line. commandLock runs them one at a time, so the static
+// report buffers are never shared.
+
+void helpCommand(const char* args, size_t length, Print& out);
+
+void statsCommand(const char* args, size_t length, Print& out) {
+    const FrameDecoderStats& frames = serialManager.getFrameStats();
+    LogStats logStats = eventLog.getStats();
+    out.printf("uptime %lu s, heap %u free, psram %u free, stack min %lu\n",
+               (unsigned long)(millis() / 1000), (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getFreePsram(),
+               (unsigned long)taskTable.minStackFree());
+    out.printf("wifi %s, mqtt %s, config v%lu\n", wifiManager.isConnected() ? "up" : "down",
+               mqttManager.isConnected() ? "up" : "down", (unsigned long)configManager.getVersion());
+    out.printf("ingest: %lu frames, %lu bad CRC, %u nodes, last reading %lu ms ago\n",
+               (unsigned long)frames.frames, (unsigned long)frames.crcErrors, (unsigned)nodeTable.size(),
+               (unsigned long)(millis() - lastReadingMs));
+    out.printf("publish: %lu suppressed, %lu bytes saved, %lu flagged\n",
+               (unsigned long)reportFilter.getStats().suppressed, (unsigned long)reportFilter.bytesSaved(),
+               (unsigned long)qualityMonitor.getStats().flagged);
+    out.printf("queue %u, downlink %u pending, log %lu written %lu dropped\n",
+               (unsigned)uxQueueMessagesWaiting(readingQueue), (unsigned)downlink.pending(),
+               (unsigned long)logStats.written, (unsigned long)logStats.dropped);
+}
+
+void queueCommand(const char* args, size_t length, Print& out) {
+    out.printf("readingQueue: %u waiting\n", (unsigned)uxQueueMessagesWaiting(readingQueue));
+    out.printf("%s: %u/%u in use, peak %u, %lu failed\n", readingPool.getName(), (unsigned)readingPool.getInUse(),
+               (unsigned)readingPool.getCapacity(), (unsigned)readingPool.getPeak(),
+               (unsigned long)readingPool.getFailures());
+    out.printf("%s: %u/%u in use, peak %u, %lu failed\n", payloadPool.getName(), (unsigned)payloadPool.getInUse(),
+               (unsigned)payloadPool.getCapacity(), (unsigned)payloadPool.getPeak(),
+               (unsigned long)payloadPool.getFailures());
+    out.printf("downlink: %u pending\n", (unsigned)downlink.pending());
+}
+
+void nodesCommand(const char* args, size_t length, Print& out) {
+    printNodes(out);
+}
+
+void tasksCommand(const char* args, size_t length, Print& out) {
+    static char report[TASK_REPORT_SIZE];
+    taskTable.format(report, sizeof(report));
+    out.print(report);
+}
+
+void poolsCommand(const char* args, size_t length, Print& out) {
+    static char report[MEMORY_REPORT_SIZE];
+    formatMemoryStats(report, sizeof(report));
+    out.print(report);
+}
+
+void bootCommand(const char* args, size_t length, Print& out) {
+    printBootTimeline(out);
+}
+
+void wifiCommand(const char* args, size_t length, Print& out) {
+    static char report[WIFI_REPORT_SIZE];
+    wifiManager.formatStats(report, sizeof(report));
+    out.print(report);
+}
+
+void reportCommand(const char* args, size_t length, Print& out) {
+    static char report[REPORT_REPORT_SIZE];
+    reportFilter.format(report, sizeof(report));
+    out.print(report);
+}
+
+void qualityCommand(const char* args, size_t length, Print& out) {
+    static char report[QUALITY_REPORT_SIZE];
+    qualityMonitor.format(report, sizeof(report));
+    out.print(report);
+}
+
+void powerCommand(const char* args, size_t length, Print& out) {
+    static char report[POWER_REPORT_SIZE];
+    powerManager.format(report, sizeof(report));
+    out.print(report);
+}
+
+void downlinkCommand(const char* args, size_t length, Print& out) {
+    static char report[DOWNLINK_REPORT_SIZE];
+    downlink.format(report, sizeof(report));
+    out.print(report);
+}
+
+#if MQTT_BROKER
+void brokerCommand(const char* args, size_t length, Print& out) {
+    static char report[BROKER_REPORT_SIZE];
+    broker.format(report, sizeof(report));
+    out.print(report);
+}
+#endif
+
+#if PAYLOAD_COMPRESS
+void compressCommand(const char* args, size_t length, Print& out) {
+    static char report[COMPRESS_REPORT_SIZE];
+    compressor.format(report, sizeof(report));
+    out.print(report);
+}
+#endif
+
+void mqttCommand(const char* args, size_t length, Print& out) {
+    static char report[MQTT_REPORT_SIZE];
+    mqttManager.formatStats(report, sizeof(report));
+    out.print(report);
+}
+
+#if MQTT_TLS
+void tlsCommand(const char* args, size_t length, Print& out) {
+    static char report[TLS_REPORT_SIZE];
+    tlsClient.formatStats(report, sizeof(report));
+    out.print(report);
+}
+#endif
+
+// latency [reset]
+void latencyCommand(const char* args, size_t length, Print& out) {
+    if (length == 5 && memcmp(args, "reset", 5) == 0) {
+        latencyTracer.reset();
+        out.println("Latency histograms cleared");
+        return;
+    }
+#if ENABLE_LATENCY_TRACE
+    static char report[LATENCY_REPORT_SIZE];
+    latencyTracer.format(report, sizeof(report));
+    out.print(report);
+#else
+    out.println("Latency tracing disabled, build with -DENABLE_LATENCY_TRACE=1");
+#endif
+}
+
+// Without arguments shows the table. Otherwise replaces it and keeps it for
+// the next boot; the table only changes if every curve in the JSON is valid.
+void calibrationCommand(const char* args, size_t length, Print& out) {
+    if (length == 0) {
+        static char report[CALIBRATION_REPORT_SIZE];
+        calibration.format(report, sizeof(report));
+        out.print(report);
+        return;
+    }
+    
+    char error[96];
+    if (length > CALIBRATION_BODY_MAX) {
+        out.print("{\"ok\":false,\"error\":\"too large\"}");
+        return;
+    }
+    if (!calibration.load((const uint8_t*)args, length, error, sizeof(error))) {
+        // The error may quote the payload, keep the reply valid JSON
+        for (char* c = error; *c; c++) {
+            if (*c == '"' || *c == '\\' || *c < 0x20) *c = '\'';
         }
-        vTaskDelay(10 / portTICK_PERIOD_MS);
+        out.printf("{\"ok\":false,\"error\":\"%s\"}", error);
+        return;
     }
     
-    if (written == sizeof(creds)) {
-        Serial.println("WiFi credentials sent but no confirmation received");
-        return true;
+    bool saved = configManager.mountStorage() &&
+                 (sdStorage.writeFile(CALIBRATION_FILE, (const uint8_t*)args, length) ||
+                  spiffsStorage.writeFile(CALIBRATION_FILE, (const uint8_t*)args, length));
+    if (!saved) {
+        LOG_WARN(LOG_HUB, "Calibration applied but not saved, lost on reboot");
+    }
+    out.printf("{\"ok\":true,\"version\":%lu,\"curves\":%u,\"saved\":%s}",
+               (unsigned long)calibration.getVersion(), (unsigned)calibration.size(), saved ? "true" : "false");
+}
+
+// The same partial JSON as the portal's /save; answers with what was restarted
+void configCommand(const char* args, size_t length, Print& out) {
+    HubConfig staged;
+    {
+        ConfigReader current(configManager);
+        staged = *current;
+    }
+    // Same streaming parser as the portal's /save, no JsonDocument
+    ConfigBodyStatus status = ConfigBodyParser::parse((const uint8_t*)args, length, &staged);
+    if (status != BODY_DONE) {
+        out.print(status == BODY_TOO_LARGE ? "{\"ok\":false,\"error\":\"too large\"}"
+                                           : "{\"ok\":false,\"error\":\"invalid JSON\"}");
+        return;
+    }
+    
+    uint8_t changed = 0;
+    if (configManager.apply(staged, "command", &changed)) {
+        out.printf("{\"ok\":true,\"version\":%lu,\"wifi\":%s,\"mqtt\":%s}",
+                   (unsigned long)configManager.getVersion(),
+                   (changed & CONFIG_CHANGED_WIFI) ? "true" : "false",
+                   (changed & (CONFIG_CHANGED_WIFI | CONFIG_CHANGED_MQTT)) ? "true" : "false");
     } else {
-        Serial.println("Failed to send WiFi credentials");
-        return false;
+        out.print("{\"ok\":false,\"error\":\"save failed\"}");
+    }
+}
+
+// {"node":"N07","interval_s":600} changes a node's sampling interval, "*"
+// for every node; {"time_sync":true} sends the time now. The answer only
+// says the command was queued, the outcome follows on reply/downlink.
+void nodeCommand(const char* args, size_t length, Print& out) {
+    JsonDocument request(psramJsonAllocator());
+    if (deserializeJson(request, args, length) != DeserializationError::Ok) {
+        out.print("{\"ok\":false,\"error\":\"invalid JSON\"}");
+        return;
+    }
+    uint16_t id = 0;
+    const char* node = request["node"] | "";
+    uint32_t interval = request["interval_s"] | 0u;
+    if (interval > 0 && node[0] != '\0' && strlen(node) < SENSOR_NODE_ID_SIZE) {
+        id = downlink.sendSampleInterval(node, interval);
+    } else if (request["time_sync"] | false) {
+        id = sendTimeSync();
+    } else {
+        out.print("{\"ok\":false,\"error\":\"need node and interval_s, or time_sync\"}");
+        return;
+    }
+    if (id == 0) {
+        out.print("{\"ok\":false,\"error\":\"not queued\"}");
+    } else {
+        out.printf("{\"ok\":true,\"id\":%u}", (unsigned)id);
+    }
+}
+
+// interval <node|*> <seconds>, the short form of the node command
+void intervalCommand(const char* args, size_t length, Print& out) {
+    char node[SENSOR_NODE_ID_SIZE + 1];
+    char seconds[12];
+    size_t nodeLength = CommandRegistry::nextWord(args, length, node, sizeof(node));
+    CommandRegistry::nextWord(args, length, seconds, sizeof(seconds));
+    long value = atol(seconds);
+    uint16_t id = nodeLength > 0 && nodeLength < SENSOR_NODE_ID_SIZE && value > 0
+                  ? downlink.sendSampleInterval(node, (uint32_t)value) : 0;
+    if (id != 0) {
+        out.printf("Interval command #%u queued\n", (unsigned)id);
+    } else {
+        out.println("Usage: interval <node|*> <seconds>");
+    }
+}
+
+void timesyncCommand(const char* args, size_t length, Print& out) {
+    uint16_t id = sendTimeSync();
+    if (id != 0) {
+        out.printf("Time sync #%u queued\n", (unsigned)id);
+    } else {
+        out.println("No time to send yet");
+    }
+}
+
+void sendwifiCommand(const char* args, size_t length, Print& out) {
+    out.println(sendWiFiCredentials() ? "WiFi credentials queued" : "Downlink queue full");
+}
+
+// Without arguments prints the history. "<module|*> <level>" sets a level.
+// JSON as over MQTT: {"module":"mqtt","level":"debug"} sets a level,
+// {"count":10} sends the last entries of the history, one line each, then
+// a summary line.
+void logCommand(const char* args, size_t length, Print& out) {
+    if (length == 0) {
+        static char report[LOG_REPORT_SIZE];
+        eventLog.formatHistory(report, sizeof(report));
+        out.print(report);
+        return;
+    }
+    
+    char moduleName[12] = "";
+    char levelName[8] = "";
+    uint16_t count = 0;
+    bool json = args[0] == '{';
+    if (json) {
+        JsonDocument request(psramJsonAllocator());
+        if (deserializeJson(request, args, length) != DeserializationError::Ok) {
+            out.print("{\"ok\":false,\"error\":\"invalid JSON\"}");
+            return;
+        }
+        strlcpy(moduleName, request["module"] | "", sizeof(moduleName));
+        strlcpy(levelName, request["level"] | "", sizeof(levelName));
+        count = request["count"] | 0;
+    } else {
+        CommandRegistry::nextWord(args, length, moduleName, sizeof(moduleName));
+        CommandRegistry::nextWord(args, length, levelName, sizeof(levelName));
+    }
+    
+    if (moduleName[0] != '\0' || levelName[0] != '\0') {
+        LogModule module = LOG_HUB;
+        LogLevel level;
+        bool all = strcmp(moduleName, "*") == 0;
+        if ((!all && !EventLog::parseModule(moduleName, module)) || !EventLog::parseLevel(levelName, level)) {
+            out.print(json ? "{\"ok\":false,\"error\":\"unknown module or level\"}"
+                           : "Usage: log <hub|ingest|mqtt|rtc|downlink|*> <off|error|warn|info|debug>\n");
+            return;
+        }
+        for (uint8_t i = 0; i < LOG_MODULE_COUNT; i++) {
+            if (all || i == module) eventLog.setLevel((LogModule)i, level);
+        }
+    }
+    if (!json) {
+        return;
+    }
+    
+    uint16_t size = eventLog.historySize();
+    if (count > size) count = size;
+    LogRecord record;
+    char line[MQTT_REPLY_LINE_MAX];
+    for (uint16_t i = size - count; i < size && eventLog.historyRecord(i, record); i++) {
+        if (EventLog::formatJson(record, line, sizeof(line)) > 0) {
+            out.println(line);
+        }
+    }
+    
+    LogStats stats = eventLog.getStats();
+    out.printf("{\"ok\":true,\"boot\":%lu,\"written\":%lu,\"dropped\":%lu}",
+               (unsigned long)eventLog.getBoot(), (unsigned long)stats.written, (unsigned long)stats.dropped);
+}
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// replay <hex>: frames as the ESP-NOW hub sends them, e.g. copied from a
+// capture, spaces allowed. Decoded frames go to mqttTask like received ones
+// but skip the node table and display, which belong to serialTask.
+void replayCommand(const char* args, size_t length, Print& out) {
+    FrameDecoder decoder;
+    SensorReading data;
+    uint16_t queued = 0;
+    uint16_t dropped = 0;
+    int high = -1;
+    for (size_t i = 0; i < length; i++) {
+        if (args[i] == ' ') {
+            continue;
+        }
+        int nibble = hexValue(args[i]);
+        if (nibble < 0) {
+            out.println("Usage: replay <frame bytes in hex>");
+            return;
+        }
+        if (high < 0) {
+            high = nibble;
+            continue;
+        }
+        uint8_t byte = (uint8_t)(high << 4 | nibble);
+        high = -1;
+        if (!decoder.feed(byte, data)) {
+            continue;
+        }
+        Reading* reading = readingPool.acquire();
+        if (reading == NULL) {
+            dropped++;
+            continue;
+        }
+        reading->data = data;
+        reading->receivedMs = millis();
+        TRACE_CLEAR(reading->trace);
+        if (xQueueSend(readingQueue, &reading, 0) == pdTRUE) {
+            queued++;
+        } else {
+            readingPool.release(reading);
+            dropped++;
+        }
+    }
+    const FrameDecoderStats& frames = decoder.getStats();
+    out.printf("%u frames queued, %u dropped, %lu bad CRC, %lu malformed\n", (unsigned)queued,
+               (unsigned)dropped, (unsigned long)frames.crcErrors, (unsigned long)frames.malformed);
+}
+
+// bench [json|csv], results on the USB console
+void benchCommand(const char* args, size_t length, Print& out) {
+    BenchFormat format = length == 3 && memcmp(args, "csv", 3) == 0 ? BENCH_CSV : BENCH_JSON;
+    if (taskTable.isRunning(TASK_BENCH)) {
+        out.println("Benchmark already running");
+        return;
+    }
+    taskTable.start(TASK_BENCH, (void*)(intptr_t)format);
+}
+
+// Every console and MQTT command. MQTT gets the ones marked CMD_ANY; bench
+// and replay stay on the USB console, the first because it prints there,
+// the second because it injects readings.
+const CommandSpec COMMANDS[] = {
+    // name          handler             sources      help
+    {"help",        helpCommand,        CMD_CONSOLE, "this list"},
+    {"stats",       statsCommand,       CMD_ANY,     "one-screen summary"},
+    {"queue",       queueCommand,       CMD_ANY,     "reading queue, pools and downlink depth"},
+    {"nodes",       nodesCommand,       CMD_ANY,     "per-node aggregates and frame counters"},
+    {"tasks",       tasksCommand,       CMD_ANY,     "stack, CPU and deadlines per task"},
+    {"pools",       poolsCommand,       CMD_ANY,     "memory pools and arena"},
+    {"boot",        bootCommand,        CMD_ANY,     "boot stage timeline"},
+    {"wifi",        wifiCommand,        CMD_ANY,     "connection attempts and timings"},
+    {"report",      reportCommand,      CMD_ANY,     "report-by-exception figures"},
+    {"quality",     qualityCommand,     CMD_ANY,     "sensor fault flags"},
+    {"power",       powerCommand,       CMD_ANY,     "power level and estimate"},
+    {"downlink",    downlinkCommand,    CMD_ANY,     "downlink queue counters"},
+    {"mqtt",        mqttCommand,        CMD_ANY,     "protocol, MQTT 5 session, topic aliases and in-flight window"},
+#if MQTT_BROKER
+    {"broker",      brokerCommand,      CMD_ANY,     "local clients, fan-out time and bridge"},
+#endif
+#if PAYLOAD_COMPRESS
+    {"compress",    compressCommand,    CMD_ANY,     "compressed frames and ratio"},
+#endif
+#if MQTT_TLS
+    {"tls",         tlsCommand,         CMD_ANY,     "handshake times, resumption and mbedTLS memory"},
+#endif
+    {"latency",     latencyCommand,     CMD_ANY,     "[reset] ingest-to-publish histograms"},
+    {"log",         logCommand,         CMD_ANY,     "[<module|*> <level>] history, or set a level"},
+    {"calibration", calibrationCommand, CMD_ANY,     "[json] show or replace the calibration table"},
+    {"config",      configCommand,      CMD_ANY,     "<json> change settings, as the portal's /save"},
+    {"node",        nodeCommand,        CMD_ANY,     "<json> sampling interval or time sync"},
+    {"interval",    intervalCommand,    CMD_ANY,     "<node|*> <seconds> set a node's sampling interval"},
+    {"timesync",    timesyncCommand,    CMD_ANY,     "send the time to every node"},
+    {"sendwifi",    sendwifiCommand,    CMD_ANY,     "send the WiFi credentials to the ESP-NOW hub"},
+    {"replay",      replayCommand,      CMD_CONSOLE, "<hex> feed hub frames into the publish path, console only"},
+    {"bench",       benchCommand,       CMD_CONSOLE, "[json|csv] run the benchmark suite, console only"},
+};
+const CommandRegistry commands(COMMANDS, sizeof(COMMANDS) / sizeof(COMMANDS[0]));
+Console console(&Serial, &commands);
+SemaphoreHandle_t commandLock = NULL;
+
+void helpCommand(const char* args, size_t length, Print& out) {
+    out.println("Commands, also on the MQTT command topic unless console only:");
+    commands.printHelp(out, CMD_CONSOLE);
+}
+
+// MQTT commands arrive on TOPIC_COMMAND + <command>, loop task. MQTTManager
+// has copied them out of the client and released its lock, so taking
+// commandLock here is in the same order as consoleTask: commandLock first,
+// then the MQTT lock for the replies.
+void onMqttCommand(const char* command, const uint8_t* payload, size_t length) {
+    ReplyPrint out(&mqttManager, command);
+    xSemaphoreTake(commandLock, portMAX_DELAY);
+    bool known = commands.run(command, (const char*)payload, length, CMD_MQTT, out);
+    xSemaphoreGive(commandLock);
+    if (!known) {
+        out.print("{\"ok\":false,\"error\":\"unknown command\"}");
+    }
+    out.flush();
+}
+
+// Outcomes of downlink commands, whoever queued them. Loop task.
+void reportDownlinkResults() {
+    DownlinkResult result;
+    while (downlink.takeResult(result)) {
+        char response[192];
+        char node[SENSOR_NODE_ID_SIZE];
+        uint8_t k = 0;
+        for (const char* c = result.nodeID; *c && k < sizeof(node) - 1; c++) {
+            if (*c >= 0x20 && *c != '"' && *c != '\\') node[k++] = *c;
+        }
+        node[k] = '\0';
+        snprintf(response, sizeof(response),
+                 "{\"id\":%u,\"command\":\"%s\",\"node\":\"%s\",\"status\":\"%s\",\"attempts\":%u,\"elapsed_ms\":%lu}",
+                 (unsigned)result.id, DownlinkQueue::commandName(result.command), node,
+                 DownlinkQueue::statusName(result.status), (unsigned)result.attempts,
+                 (unsigned long)result.elapsedMs);
+        LOG_INFO(LOG_DOWNLINK, "#%u %s to %s: %s after %u sends", (unsigned)result.id,
+                 DownlinkQueue::commandName(result.command), node[0] ? node : "hub",
+                 DownlinkQueue::statusName(result.status), (unsigned)result.attempts);
+        if (mqttManager.isConnected()) {
+            mqttManager.reply("downlink", response);
+        }
+    }
+}
+
+// Restart only what a config change touched. Runs on the loop task, which
+// owns WiFi and MQTT, after configManager.sync().
+void applyConfigChanges(uint8_t changed) {
+    if (changed & CONFIG_CHANGED_WIFI) {
+        Serial.println("WiFi settings changed, reconnecting");
+        wifiManager.reconfigure();
+        // The ESP-NOW hub follows the hub's network
+        sendWiFiCredentials();
+    }
+    if (changed & (CONFIG_CHANGED_WIFI | CONFIG_CHANGED_MQTT)) {
+        Serial.println("MQTT settings changed, reconnecting");
+        mqttManager.reconfigure();
+    } else if (changed & CONFIG_CHANGED_HUB_ID) {
+        // Payloads pick up the new hub_id by themselves
+        mqttManager.refreshSubscriptions();
     }
 }
 
 // Task to receive sensor data via Serial
 void serialTask(void *parameter) {
+    Reading* pending = NULL;
+    bool firstFrame = true;
+    
     while (true) {
-        if (serialManager.readData(&dataInstance)) {
-            xSemaphoreGive(binSem);
-            Serial.println("Received data from ESP-NOW Hub");
-            
-            // Update display with new sensor data
-            oledManager.showSensorData(dataInstance.nodeID, dataInstance.temp, 
-                                    dataInstance.humidity, dataInstance.moisture);
+        // Keep one pooled slot ready. If the pool is exhausted mqttTask is
+        // behind; leave the bytes in the UART buffer until a slot frees up.
+        if (pending == NULL) {
+            pending = readingPool.acquire();
         }
         
-        // Check for serial commands
-        if (Serial.available()) {
-            String command = Serial.readStringUntil('\n');
-            command.trim();
+        if (pending != NULL && serialManager.readReading(pending)) {
+            if (firstFrame) {
+                boot.mark("first_frame");
+                firstFrame = false;
+            }
+            dataInstance = pending->data;
+            lastReadingMs = millis();
+            liveFeed.markNode(nodeTable.update(pending->data, millis()));
+            TRACE_STAMP(pending->trace, TRACE_ENQUEUED);
+            if (xQueueSend(readingQueue, &pending, 0) == pdTRUE) {
+                pending = NULL;
+                LOG_DEBUG(LOG_INGEST, "Reading from %s, schema %u", dataInstance.nodeID,
+                          (unsigned)dataInstance.schemaId);
+            } else {
+                LOG_WARN(LOG_INGEST, "Reading queue full, dropped a reading from %s", dataInstance.nodeID);
+            }
             
-            if (command == "sendwifi") {
-                sendWiFiCredentials();
+            // The display task redraws; an I2C flush here would hold up the UART
+            TaskHandle_t display = taskTable.handle(TASK_DISPLAY);
+            if (display != NULL) {
+                xTaskNotifyGive(display);
             }
         }
         
-        vTaskDelay(5 / portTICK_PERIOD_MS);
+        // Commands to the hub go out between frames; acks came in above
+        uint32_t downlinkDue = downlink.poll(millis());
+        
+        if (pending == NULL) {
+            taskTable.delay(5);  // Pool exhausted, give mqttTask time to catch up
+        } else {
+            // Sleep until the hub sends something. UART RX wakes the task at
+            // once; the timeout paces downlink resends and the watchdog.
+            taskTable.idleBegin();
+            serialManager.waitForData(downlinkDue < INGEST_WAIT_MAX_MS ? downlinkDue : INGEST_WAIT_MAX_MS);
+            taskTable.idleEnd();
+        }
+    }
+}
+
+// Fault transitions go out as they happen, they are never filtered
+void publishQualityEvents(const QualityEvent* events, uint8_t count) {
+    if (count == 0) {
+        return;
+    }
+    struct tm timeInfo;
+    bool haveTime = rtcManager.getCurrentTime(&timeInfo);
+    ConfigReader config(configManager);
+    for (uint8_t i = 0; i < count; i++) {
+        struct tm eventTime;
+        if (haveTime) {
+            time_t at = mktime(&timeInfo) - (time_t)((millis() - events[i].atMs) / 1000);
+            localtime_r(&at, &eventTime);
+        }
+        char payload[QUALITY_EVENT_SIZE];
+        if (QualityMonitor::formatEvent(events[i], config->hub_id, haveTime ? &eventTime : nullptr,
+                                        payload, sizeof(payload)) > 0) {
+#if MQTT_BROKER
+            broker.publish(TOPIC_FAULT, payload);
+#endif
+            mqttManager.publish(TOPIC_FAULT, payload);
+        }
+    }
+}
+
+#if PAYLOAD_COMPRESS
+// Sends the frame and starts the next; if it fails its nodes are forgotten
+// like any lost publish
+void publishCompressed() {
+    uint8_t count = compressor.messages();
+    if (count == 0) {
+        return;
+    }
+    if (mqttManager.publish(TOPIC_SENSOR TOPIC_COMPRESSED_SUFFIX, compressor.frame(), compressor.size())) {
+        compressor.noteSent();
+        LOG_DEBUG(LOG_MQTT, "Published %u readings compressed, %u -> %u bytes", (unsigned)count,
+                  (unsigned)compressor.rawSize(), (unsigned)compressor.size());
+    } else {
+        for (uint8_t i = 0; i < count; i++) {
+            reportFilter.forget(compressedNodes[i]);
+        }
+        LOG_WARN(LOG_MQTT, "Compressed publish of %u readings failed", (unsigned)count);
+    }
+    compressor.reset();
+}
+
+// Adds an encoded reading to the frame, sending the frame first if it is
+// full. False if the reading doesn't fit even an empty frame.
+bool queueCompressed(const char* nodeID, const char* payload, size_t length) {
+    if (compressor.messages() == COMPRESS_MESSAGES_MAX || !compressor.add(payload, length)) {
+        publishCompressed();
+        if (!compressor.add(payload, length)) {
+            return false;
+        }
     }
+    strlcpy(compressedNodes[compressor.messages() - 1], nodeID, SENSOR_NODE_ID_SIZE);
+    return true;
 }
+#endif
+
+// Local broker first, it doesn't need the uplink; then upstream, compressed
+// or as it is. False if it didn't go upstream.
+bool publishReading(const char* nodeID, const PayloadBuffer* payload) {
+#if MQTT_BROKER
+    broker.publish(TOPIC_SENSOR, payload->data);
+    if (!mqttManager.isConnected()) {
+        return false;
+    }
+#endif
+#if PAYLOAD_COMPRESS
+    // Goes out with the frame after this batch; one too large to compress
+    // goes out as it is
+    return queueCompressed(nodeID, payload->data, payload->length) ||
+           mqttManager.publish(TOPIC_SENSOR, payload->data);
+#else
+    return mqttManager.publish(TOPIC_SENSOR, payload->data);
+#endif
+}
+
+#if MQTT_BROKER
+// What local clients published on BROKER_BRIDGE_TOPICS, upstream under
+// TOPIC_BRIDGE. Waits in the broker while the uplink is down.
+void forwardBridged() {
+    BridgedMessage message;
+    while (mqttManager.isConnected() && broker.takeBridged(message)) {
+        char topic[sizeof(TOPIC_BRIDGE) + sizeof(HubConfig::hub_id) + BROKER_TOPIC_SIZE];
+        {
+            ConfigReader config(configManager);
+            snprintf(topic, sizeof(topic), TOPIC_BRIDGE "%s", config->hub_id, message.topic);
+        }
+        if (!mqttManager.publish(topic, message.payload, message.length)) {
+            LOG_WARN(LOG_MQTT, "Bridged publish on %s failed", message.topic);
+        }
+    }
+}
+
+// Accepts local clients and handles what they send. Readings and fault
+// events are published to it from mqttTask.
+void brokerTask(void *parameter) {
+    // Listening needs the network stack up
+    boot.waitFor(wifiStage, BOOT_WAIT_FOREVER);
+    while (!broker.begin()) {
+        taskTable.delay(5000);
+    }
+    while (true) {
+        broker.loop();
+        taskTable.delay(BROKER_POLL_MS);
+    }
+}
+#endif
 
 // Task to process and send data via MQTT
 void mqttTask(void *parameter) {
+    // Leave the client to the mqtt boot stage until it has connected or given
+    // up; readings pile up in readingQueue meanwhile
+    boot.waitFor(mqttStage, BOOT_WAIT_FOREVER);
+    
     while (true) {
-        // Only send when MQTT is connected and data is available
-        if (mqttManager.isConnected() && xSemaphoreTake(binSem, 0) == pdTRUE) {
-            doc.clear();
-            doc["sensor_id"] = dataInstance.nodeID;
-            doc["hub_id"] = configManager.getConfig()->hub_id;
-            doc["temp"] = dataInstance.temp;
-            doc["humidity"] = dataInstance.humidity;
-            doc["moisture"] = dataInstance.moisture;
+        // Only send when MQTT is connected, draining up to a batch per wake-up;
+        // with the local broker always, its clients don't need the uplink
+        Reading* batch[MQTT_BATCH_MAX];
+        SensorReading* batchData[MQTT_BATCH_MAX];
+        uint8_t batchSize = 0;
+        while (batchSize < MQTT_BATCH_MAX && (MQTT_BROKER || mqttManager.isConnected()) &&
+               xQueueReceive(readingQueue, &batch[batchSize], 0) == pdTRUE) {
+            TRACE_STAMP(batch[batchSize]->trace, TRACE_DEQUEUED);
+            batchData[batchSize] = &batch[batchSize]->data;
+            batchSize++;
+        }
+        
+        // Calibrate the batch in one pass, before the filter compares values
+        calibration.apply(batchData, batchSize);
+        
+        QualityEvent events[QUALITY_MAX_EVENTS];
+        for (uint8_t b = 0; b < batchSize; b++) {
+            Reading* reading = batch[b];
+            
+            // Flags travel with the reading, so the filter sees them change
+            publishQualityEvents(events, qualityMonitor.check(reading->data, reading->receivedMs,
+                                                              events, QUALITY_MAX_EVENTS));
+            
+            // Most frames change nothing worth sending; a swinging-door
+            // segment end can also release the reading before this one
+            ReportSample samples[2];
+            uint8_t count = reportFilter.offer(reading->data, reading->receivedMs, samples);
             
             // Get time from RTC or NTP
             struct tm timeInfo;
-            if (rtcManager.getCurrentTime(&timeInfo)) {
-                JsonObject date = doc["date"].to<JsonObject>();
-                date["year"] = timeInfo.tm_year + 1900;
-                date["month"] = timeInfo.tm_mon + 1;
-                date["day"] = timeInfo.tm_mday;
-                date["hour"] = timeInfo.tm_hour;
-                date["minute"] = timeInfo.tm_min;
-                date["second"] = timeInfo.tm_sec;
-            } else {
-                Serial.println("Failed to obtain time");
-                // Add timestamp using uptime instead
-                doc["uptime_ms"] = millis();
+            bool haveTime = count > 0 && rtcManager.getCurrentTime(&timeInfo);
+            if (count > 0 && !haveTime) {
+                LOG_WARN(LOG_MQTT, "No time for %s, published without a timestamp", reading->data.nodeID);
             }
             
-            serializeJson(doc, jsonBuffer);
-            mqttManager.publish(TOPIC_SENSOR, jsonBuffer);
-            Serial.println("Published to MQTT");
+            for (uint8_t i = 0; i < count; i++) {
+                // Stamp each sample with when it arrived, not when it goes out
+                struct tm sampleTime;
+                if (haveTime) {
+                    time_t arrived = mktime(&timeInfo) - (time_t)((millis() - samples[i].receivedMs) / 1000);
+                    localtime_r(&arrived, &sampleTime);
+                }
+                
+                PayloadBuffer* payload = payloadPool.acquire();
+                if (payload == NULL) {
+                    reportFilter.forget(samples[i].data.nodeID);
+                    continue;
+                }
+                // hub_id changes apply from the next reading, no restart
+                ConfigReader config(configManager);
+                payload->length = encodeReading(doc, samples[i].data, config->hub_id,
+                                                haveTime ? &sampleTime : nullptr, samples[i].receivedMs,
+                                                payload->data, sizeof(payload->data));
+                TRACE_STAMP(reading->trace, TRACE_ENCODED);
+                
+                if (payload->length > 0) {
+                    TRACE_STAMP(reading->trace, TRACE_PUBLISH_CALL);
+                    if (publishReading(samples[i].data.nodeID, payload)) {
+                        reportFilter.notePublished(payload->length);
+                        LOG_DEBUG(LOG_MQTT, "Published %s, %u bytes", samples[i].data.nodeID,
+                                  (unsigned)payload->length);
+                    } else {
+                        reportFilter.forget(samples[i].data.nodeID);
+                        if (mqttManager.isConnected()) {
+                            LOG_WARN(LOG_MQTT, "Publish failed for %s", samples[i].data.nodeID);
+                        }
+                    }
+                    TRACE_STAMP(reading->trace, TRACE_PUBLISH_RETURN);
+                    if (i + 1 == count) {
+                        TRACE_COMMIT(reading->trace);
+                    }
+                }
+                payloadPool.release(payload);
+                
+                // JSON scratch lives in the arena, reclaim it in one go
+                doc.clear();
+                jsonArena.reset();
+            }
+            readingPool.release(reading);
+        }
+#if PAYLOAD_COMPRESS
+        publishCompressed();
+#endif
+#if MQTT_BROKER
+        forwardBridged();
+#endif
+        
+        if (MQTT_BROKER || mqttManager.isConnected()) {
+            publishQualityEvents(events, qualityMonitor.sweep(millis(), events, QUALITY_MAX_EVENTS));
         }
         
         // Check if we need to update RTC from NTP
         rtcManager.checkUpdateInterval();
         
-        vTaskDelay(50 / portTICK_PERIOD_MS);
+        // Sleep until the next reading is queued instead of polling
+        if (MQTT_BROKER || mqttManager.isConnected()) {
+            Reading* next;
+            taskTable.waitQueue(readingQueue, &next, 500);
+        } else {
+            taskTable.delay(100);
+        }
     }
 }
+size_t writeLiveMetrics(char* out, size_t len) {
+    int written = snprintf(out, len,
+        "{\"heap\":%u,\"psram\":%u,\"queue\":%u,\"nodes\":%u,\"rejected\":%lu,"
+        "\"wifi\":%s,\"rssi\":%d,\"mqtt\":%s,\"clients\":%u,\"dropped\":%lu,\"stack_min\":%lu,"
+        "\"cpu_mhz\":%lu,\"est_ma\":%lu.%lu,"
+        "\"suppressed\":%lu,\"saved_bytes\":%lu,\"flagged\":%lu}",
+        (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getFreePsram(),
+        (unsigned)uxQueueMessagesWaiting(readingQueue), (unsigned)nodeTable.size(),
+        (unsigned long)nodeTable.getRejected(),
+        wifiManager.isConnected() ? "true" : "false", wifiManager.isConnected() ? WiFi.RSSI() : 0,
+        mqttManager.isConnected() ? "true" : "false", (unsigned)liveFeed.clientCount(),
+        (unsigned long)liveFeed.getStats().dropped, (unsigned long)taskTable.minStackFree(),
+        (unsigned long)getCpuFrequencyMhz(), (unsigned long)(powerManager.getPolicy().estimatedDeciMilliamps() / 10),
+        (unsigned long)(powerManager.getPolicy().estimatedDeciMilliamps() % 10),
+        (unsigned long)reportFilter.getStats().suppressed, (unsigned long)reportFilter.bytesSaved(),
+        (unsigned long)qualityMonitor.getStats().flagged);
+    return written > 0 ? min((size_t)written, len - 1) : 0;
+}
+
+// Pushes dashboard frames; LiveFeed itself limits the rate
+void liveTask(void *parameter) {
+    while (true) {
+        liveFeed.tick(millis());
+        // Nobody watching: tick only to drop the dirty set
+        taskTable.delay(liveFeed.clientCount() > 0 ? 100 : 1000);
+    }
+}
+
+void startDashboard() {
+    if (portalManager.startServer()) {
+        Serial.printf("Live dashboard at http://%s/live.html\n", WiFi.localIP().toString().c_str());
+    }
+}
+
 // New task to update the display
 void displayTask(void *parameter) {
     struct tm timeinfo;
     static bool showingData = true;
     static unsigned long lastToggle = 0;
+    bool newReading = false;
+    DisplayMode mode = DISPLAY_ON;
     
     while (true) {
+        DisplayMode wanted = powerManager.current().display;
+        if (wanted != mode) {
+            oledManager.setPowered(wanted != DISPLAY_OFF);
+            oledManager.setDimmed(wanted == DISPLAY_DIM);
+            mode = wanted;
+        }
+        if (mode == DISPLAY_OFF) {
+            taskTable.waitNotify(POWER_DISPLAY_DIM_REFRESH);
+            continue;
+        }
+        
+        // serialTask notifies on every reading, show it straight away
+        if (newReading) {
+            oledManager.showReading(dataInstance);
+        }
+        
         // Toggle between sensor data and time display every 5 seconds
         unsigned long now = millis();
         if (now - lastToggle > 5000) {
@@ -170,8 +1010,7 @@ void displayTask(void *parameter) {
             if (showingData) {
                 // Only show data if we've received some
                 if (dataInstance.nodeID[0] != '\0') {
-                    oledManager.showSensorData(dataInstance.nodeID, dataInstance.temp, 
-                                          dataInstance.humidity, dataInstance.moisture);
+                    oledManager.showReading(dataInstance);
                 }
             } else {
                 // Show current time
@@ -184,207 +1023,313 @@ void displayTask(void *parameter) {
         // Update MQTT status indicator
         oledManager.showMQTTStatus(mqttManager.isConnected());
         
-        vTaskDelay(100 / portTICK_PERIOD_MS);
+        newReading = taskTable.waitNotify(mode == DISPLAY_ON ? 100 : POWER_DISPLAY_DIM_REFRESH);
     }
 }
-bool testUartConnection() {
-    Serial.println("Testing UART connection to ESP-NOW hub...");
-    
-    // Clear any data in the buffer
-    while (interSerial.available()) {
-        interSerial.read();
+
+// Prints what the other tasks logged, so none of them waits on the UART
+void logTask(void *parameter) {
+    while (true) {
+        eventLog.drain(Serial);
+        taskTable.delay(LOG_DRAIN_MS);
     }
-    
-    // Send test character
-    interSerial.write('T');
-    interSerial.flush();
-    
-    // Wait for response
-    unsigned long startTime = millis();
-    while (millis() - startTime < 1000) {
-        if (interSerial.available()) {
-            char c = interSerial.read();
-            Serial.printf("Received: %c\n", c);
-            return true;
+}
+
+// Runs what is typed on the USB console. Reading the line, running the
+// command and printing its output all happen here, so none of it delays
+// serialTask.
+void consoleTask(void *parameter) {
+    while (true) {
+        if (Serial.available() > 0) {
+            xSemaphoreTake(commandLock, portMAX_DELAY);
+            console.poll();
+            xSemaphoreGive(commandLock);
         }
-        delay(10);
+        taskTable.delay(CONSOLE_POLL_MS);
     }
-    
-    Serial.println("No response from ESP-NOW hub");
-    return false;
 }
 
-void setup() {
+// Every long-running task with its placement, highest priority first.
+// Ingest has core 1 mostly to itself (loop() is priority 1 there); WiFi,
+// lwIP and AsyncTCP live on core 0, next to MQTT and the web push.
+// Deadlines are the longest expected gap between loop iterations; misses
+// are counted, TASK_WDT_TIMEOUT without a check-in panics. `tasks` on the
+// serial console shows the measured figures.
+const TaskSpec TASKS[TASK_COUNT] = {
+    // name          function     stack  prio  core  deadline ms
+    {"serialTask",  serialTask,  4096,  5,    1,    200},
+    {"mqttTask",    mqttTask,    6144,  3,    0,    1000},
+    {"liveTask",    liveTask,    4096,  2,    0,    2000},
+    {"displayTask", displayTask, 3072,  1,    0,    2000},
+    {"benchTask",   benchTask,   8192,  1,    1,    0},
+    {"logTask",     logTask,     4096,  1,    0,    2000},
+    {"consoleTask", consoleTask, 6144,  1,    0,    2000},
+#if MQTT_BROKER
+    {"brokerTask",  brokerTask,  4096,  2,    0,    2000},
+#endif
+};
+
+// Boot stages. Each runs in its own short-lived task once the stages it
+// depends on have succeeded; see lib/BootOrchestrator.
+bool configStageRun() {
+    // Loads the binary image from NVS; SD/SPIFFS are only mounted to import JSON
+    if (!configManager.loadConfig()) {
+        Serial.println("No configuration found or unable to load configuration!");
+        oledManager.showStatus("Config required");
+        return false;
+    }
     
-    // Initialize Serial
-    Serial.begin(BAUD_RATE);
-    Serial.setRxBufferSize(RX_BUFFER_SIZE);
-    Serial.println("UART-MQTT Hub starting...");
+    // Optional; without it values are published as the nodes send them
+    if (configManager.mountStorage() && !calibration.loadFile(&sdStorage, &spiffsStorage)) {
+        Serial.println("No calibration file, publishing raw values");
+    }
+#if MQTT_TLS
+    // Without it tlsClient refuses to connect rather than trust any broker
+    if (!configManager.mountStorage() || !tlsClient.loadCaFile(&sdStorage, &spiffsStorage)) {
+        Serial.println("No broker CA certificate (" MQTT_CA_FILE "), MQTT stays offline");
+    }
+#endif
+    
+    // Check if portal should be triggered
+    portalManager.checkTrigger();
+    return !portalManager.isActive();
+}
 
-    // Initialize OLED
+bool oledStageRun() {
+    // begin() draws the welcome screen. A missing display isn't fatal, so
+    // the stage always succeeds and rtc (same I2C bus) still runs after it.
     if (!oledManager.begin()) {
         Serial.println("Warning: OLED display initialization failed");
     }
-    
-    oledManager.showWelcomeScreen();
+    taskTable.start(TASK_DISPLAY);
+    return true;
+}
 
-    // Initialize RTC
+bool rtcStageRun() {
+    // Without an RTC timestamps come from NTP only, not a boot failure
     rtcManager.begin();
+    return true;
+}
 
-    // Initialize SD card and load config
-    if (!configManager.initStorage()) {
-        Serial.println("WARNING: All storage systems failed. Using default configuration.");
-        oledManager.showStatus("No config found");
-        portalManager.begin();
-        return;
+bool wifiStageRun() {
+    oledManager.showStatus("Connecting WiFi...");
+    // On timeout the manager keeps retrying with backoff from loop()
+    if (!wifiManager.connect()) {
+        oledManager.showWiFiStatus(false);
+        return false;
     }
+    oledManager.showWiFiStatus(true, configManager.getConfig()->wifi_ssid);
+    return true;
+}
 
-    if (!configManager.loadConfig()) {
-        Serial.println("No configuration found or unable to load configuration!");
-        oledManager.showStatus("Config required");
-        portalManager.begin();
-        return;
+bool credsStageRun() {
+    // Queued only; serialTask resends until the ESP-NOW hub acks
+    if (sendWiFiCredentials()) {
+        return true;
     }
-    
-    // Check if portal should be triggered
-    portalManager.checkTrigger();
+    oledManager.showStatus("WiFi send failed");
+    return false;
+}
 
-    // If portal is active, don't continue with normal setup
-    if (portalManager.isActive()) {
-        Serial.println("Configuration portal is active. Normal operation paused.");
-        oledManager.showStatus("Config portal active");
-        return;
+bool mqttStageRun() {
+    return mqttManager.begin();
+}
+
+void startNtp() {
+    configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
+    Serial.println("NTP configured");
+}
+
+bool ntpStageRun() {
+    startNtp();
+    // Block this stage only, so the timeline shows how long the first sync took
+    struct tm timeInfo;
+    return getLocalTime(&timeInfo, NTP_SYNC_TIMEOUT);
+}
+
+bool rtcSyncStageRun() {
+    if (!rtcManager.isPresent()) {
+        return true;
     }
+    return rtcManager.updateFromNTP();
+}
+
+void setup() {
     
-    // Initialize serial communication with ESP-NOW hub
-    serialManager.begin(BAUD_RATE, RX_HUB, TX_HUB);
+    // Initialize Serial
+    Serial.begin(BAUD_RATE);
+    Serial.setRxBufferSize(RX_BUFFER_SIZE);
+    Serial.println("UART-MQTT Hub starting...");
+    
+#if MQTT_TLS
+    // Before anything allocates through mbedTLS
+    TlsMemory::install();
+#if TLS_SESSION_PERSIST
+    tlsClient.setSessionStore(&configSlots, TLS_SESSION_SLOT);
+#endif
+#endif
+    
+    // Picks up the history a panic or watchdog reset left in RTC memory
+    eventLog.begin();
+    LOG_INFO(LOG_HUB, "Boot %lu, reset reason %d", (unsigned long)eventLog.getBoot(), (int)esp_reset_reason());
     
-    // Test UART connection to ESP-NOW hub
-    oledManager.showStatus("Testing UART...");
-    if (testUartConnection()) {
-        Serial.println("UART connection to ESP-NOW hub successful");
-        oledManager.showStatus("UART connected");
-        delay(1000);  // Show the message for a moment
+    // Carve out the pools once, before anything starts fragmenting the heap
+    if (!readingPool.begin() || !payloadPool.begin() || !jsonArena.begin()) {
+        Serial.println("WARNING: Failed to allocate memory pools");
+    }
+    
+    // Queue of pooled readings from serialTask to mqttTask
+    readingQueue = xQueueCreate(READING_POOL_SIZE, sizeof(Reading*));
+    
+    // Console and MQTT commands run one at a time
+    commandLock = xSemaphoreCreateMutex();
+    mqttManager.setCommandHandler(onMqttCommand);
+    
+    taskTable.begin(TASKS, TASK_COUNT);
+    taskTable.start(TASK_LOG);
+    taskTable.start(TASK_CONSOLE);
+    
+    portalManager.setLiveFeed(&liveFeed);
+    if (liveFeed.begin()) {
+        taskTable.start(TASK_LIVE);
     } else {
-        Serial.println("UART connection to ESP-NOW hub failed");
-        oledManager.showStatus("UART failed");
-        delay(2000);  // Show the error message for a moment
+        Serial.println("WARNING: Failed to allocate live dashboard frames");
     }
     
-    // Create binary semaphore for task synchronization
-    binSem = xSemaphoreCreateBinary();
+    // Everything slow comes up concurrently. WiFi, MQTT and NTP need the
+    // config; OLED and RTC share the I2C bus so they run back to back.
+    configStage = boot.addStage("config", configStageRun, 0, 8192);
+    oledStage = boot.addStage("oled", oledStageRun, 0, 3072);
+    rtcStage = boot.addStage("rtc", rtcStageRun, BootOrchestrator::after(oledStage), 3072);
+    wifiStage = boot.addStage("wifi", wifiStageRun, BootOrchestrator::after(configStage));
+    credsStage = boot.addStage("hub_creds", credsStageRun, BootOrchestrator::after(wifiStage));
+    mqttStage = boot.addStage("mqtt", mqttStageRun, BootOrchestrator::after(wifiStage), MQTT_TLS ? 10240 : 6144);
+    ntpStage = boot.addStage("ntp", ntpStageRun, BootOrchestrator::after(wifiStage));
+    rtcSyncStage = boot.addStage("rtc_sync", rtcSyncStageRun,
+                                 BootOrchestrator::after(ntpStage) | BootOrchestrator::after(rtcStage));
+    boot.start();
     
-    oledManager.showStatus("Connecting WiFi...");
+    // Ingest doesn't depend on anything above: frames from the ESP-NOW hub
+    // are buffered in readingQueue until MQTT is up
+    serialManager.begin(BAUD_RATE, RX_HUB, TX_HUB);
+    serialManager.setControlHandler(DownlinkQueue::controlHandler, &downlink);
+    powerManager.begin(2);  // interSerial is UART 2, its RX wakes from light sleep
+    taskTable.start(TASK_INGEST);
+    taskTable.start(TASK_MQTT);
+#if MQTT_BROKER
+    taskTable.start(TASK_BROKER);
+#endif
+    boot.mark("ingest");
+    Serial.println("UART ingest running");
     
-    // Set up WiFi and MQTT
-    if (wifiManager.connect()) {
-        // Once WiFi is connected, send credentials to ESP-NOW hub
-        // Add a small delay to ensure serial is ready
-         oledManager.showWiFiStatus(true, configManager.getConfig()->wifi_ssid.c_str());
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
-        // Once WiFi is connected, send credentials to ESP-NOW hub
-        oledManager.showStatus("Sending WiFi to ESP-NOW");
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
-        if (!sendWiFiCredentials()) {
-            Serial.println("Retrying WiFi credential send...");
-            vTaskDelay(1000 / portTICK_PERIOD_MS);
-            if (!sendWiFiCredentials()) {
-                Serial.println("Second attempt to send WiFi credentials failed");
-                oledManager.showStatus("WiFi send failed");
-                vTaskDelay(2000 / portTICK_PERIOD_MS);
-            }
-        } else {
-            Serial.println("WiFi credentials sent successfully");
-            oledManager.showStatus("WiFi info sent");
-            vTaskDelay(1000 / portTICK_PERIOD_MS);
-        }
-        
-        // Configure MQTT
-        oledManager.showStatus("Connecting MQTT...");
-        mqttManager.begin();
-        
-        // Configure NTP and update RTC
-        configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
-        Serial.println("NTP configured");
-        
-        // Set RTC from NTP if present
-        if (rtcManager.isPresent()) {
-            oledManager.showStatus("Updating time...");
-            rtcManager.updateFromNTP();
-            vTaskDelay(100 / portTICK_PERIOD_MS);
+    // Without a usable config the portal takes over, ingest keeps buffering
+    if (!boot.waitFor(configStage, BOOT_CONFIG_TIMEOUT)) {
+        if (!portalManager.isActive()) {
+            portalManager.begin();
         }
-        
-        // Create the tasks for normal operation
-        oledManager.showStatus("Creating tasks...");
-        vTaskDelay(100 / portTICK_PERIOD_MS);
-        
-        // Create the tasks for normal operation
-        xTaskCreatePinnedToCore(
-            serialTask,
-            "serialTask",
-            2048,
-            NULL,
-            1,
-            &serialTaskHandle,
-            0
-        );
-        
-        xTaskCreatePinnedToCore(
-            mqttTask,
-            "mqttTask",
-            4096,
-            NULL,
-            1,
-            &mqttTaskHandle,
-            1
-        );
-        
-        xTaskCreatePinnedToCore(
-            displayTask,
-            "displayTask",
-            2048,
-            NULL,
-            1,
-            &displayTaskHandle,
-            0
-        );
-        
-        oledManager.showStatus("System ready");
-        delay(1000);
-        Serial.println("Tasks created, system operational");
-    } else {
-        oledManager.showWiFiStatus(false);
+        Serial.println("Configuration portal is active. Normal operation paused.");
+        oledManager.showStatus("Config portal active");
     }
 }
 
 void loop() {
+    portalManager.loop();
+    
+    static unsigned long lastTaskSample = 0;
+    if (millis() - lastTaskSample >= TASK_SAMPLE_INTERVAL) {
+        lastTaskSample = millis();
+        taskTable.sample();
+    }
+    
+    static unsigned long lastPowerUpdate = 0;
+    if (millis() - lastPowerUpdate >= POWER_UPDATE_INTERVAL) {
+        lastPowerUpdate = millis();
+        PowerInputs inputs;
+        inputs.queueDepth = uxQueueMessagesWaiting(readingQueue);
+        // serialTask always holds one slot ready for the next frame
+        uint16_t inUse = readingPool.getInUse();
+        inputs.backlog = inUse > 0 ? inUse - 1 : 0;
+        inputs.msSinceReading = millis() - lastReadingMs;
+        inputs.interactive = portalManager.isActive() || liveFeed.clientCount() > 0;
+        powerManager.update(inputs);
+    }
+    // While idle loop() wakes less often, so the CPU can stay down
+    uint32_t loopDelayMs = powerManager.current().level == POWER_IDLE ? POWER_IDLE_LOOP_MS : 10;
+    
     // Always check for config button press first
     if (portalManager.checkTrigger() || portalManager.isActive()) {
         vTaskDelay(100 / portTICK_PERIOD_MS);
         return;
     }
     
-    // Check WiFi status and reconnect if needed
-    if (!wifiManager.isConnected()) {
-        oledManager.showStatus("WiFi reconnecting...");
-        Serial.println("WiFi connection lost, attempting to reconnect...");
-        if (!wifiManager.connect()) {
-            Serial.println("WiFi reconnection failed. Press config button to enter setup mode.");
-            oledManager.showWiFiStatus(false);
-            vTaskDelay(5000 / portTICK_PERIOD_MS);
+    // The boot stages own WiFi and MQTT until they are all done
+    static bool booted = false;
+    if (!booted) {
+        if (!boot.isFinished()) {
+            vTaskDelay(50 / portTICK_PERIOD_MS);
             return;
         }
-        // If reconnected, re-send WiFi credentials to ESP-NOW hub
-        oledManager.showWiFiStatus(true, configManager.getConfig()->wifi_ssid.c_str());
-        //sendWiFiCredentials(); No need to resend credentials
-        Serial.println("WiFi reconnected");
-        oledManager.showStatus("WiFi reconnected");
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
-
+        booted = true;
+        oledManager.showStatus("System ready");
+        Serial.println("Boot complete, system operational");
+        xSemaphoreTake(commandLock, portMAX_DELAY);
+        printBootTimeline(Serial);
+        xSemaphoreGive(commandLock);
+        if (wifiManager.isConnected()) {
+            startDashboard();
+        }
+    }
+    
+    // Config changes from the portal or the MQTT command topic are picked up
+    // here, on the task that owns WiFi and MQTT
+    uint8_t changed = configManager.sync();
+    if (changed) {
+        applyConfigChanges(changed);
+    }
+    
+    // Nodes keep their clocks from the hub; the first sync goes out as soon
+    // as NTP has the time
+    static unsigned long lastTimeSync = 0;
+    static bool timeSynced = false;
+    if ((!timeSynced || millis() - lastTimeSync >= DOWNLINK_TIME_SYNC_MS) && sendTimeSync() != 0) {
+        lastTimeSync = millis();
+        timeSynced = true;
+    }
+    reportDownlinkResults();
+    
+    // WiFi is event driven, this only runs its attempt and backoff timers
+    wifiManager.loop();
+    if (wifiManager.shouldEnterPortal()) {
+        Serial.println("WiFi unreachable. Starting configuration portal.");
+        oledManager.showStatus("Config portal active");
+        portalManager.begin();
+        return;
+    }
+    
+    static bool wasConnected = wifiManager.isConnected();
+    bool connected = wifiManager.isConnected();
+    if (connected != wasConnected) {
+        wasConnected = connected;
+        if (connected) {
+            oledManager.showWiFiStatus(true, configManager.getConfig()->wifi_ssid);
+            startDashboard();
+            
+            // WiFi was down for the whole boot, NTP was never configured
+            if (boot.state(ntpStage) == BOOT_SKIPPED) {
+                startNtp();
+            }
+        } else {
+            oledManager.showStatus("WiFi reconnecting...");
+        }
+    }
+    
+    if (!connected) {
+        vTaskDelay(loopDelayMs / portTICK_PERIOD_MS);
+        return;
     }
     
     // Keep MQTT processing
     mqttManager.loop();
     // Add a small delay to prevent excessive CPU usage
-    vTaskDelay(10 / portTICK_PERIOD_MS);
-}
\ No newline at end of file
+    vTaskDelay(loopDelayMs / portTICK_PERIOD_MS);
+}
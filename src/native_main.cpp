@@ -0,0 +1,559 @@
+// Entry point for the native (Linux) env. Runs the same ingest -> encode ->
+// publish pipeline as the device, on a pty instead of UART2, a host
+// directory instead of SD/SPIFFS and a plain TCP socket to a local broker.
+//
+//   .pio/build/native/program [--device PATH] [--broker HOST[:PORT]]
+//                             [--fs DIR] [--count N] [--bench json|csv]
+//                             [--filter all|deadband|sdt]
+//                             [--interval NODE:SECONDS] [--log LEVEL]
+//                             [--reconnect N] [--bench-wire N]
+//                             [--bench-compress CAPTURE]
+//                             [--local-broker PORT]
+//
+// Without --device a fresh pty is created and its name printed. --count
+// stops after N readings and prints the achieved rate, which is handy when
+// running under perf or valgrind. --bench runs the microbenchmark suite
+// (publish against --broker if it is reachable) and exits. --filter overrides REPORT_MODE and prints
+// the suppression figures at the end; pair it with tools/loadgen.py replaying
+// a recorded capture to size the deadbands. A calibration.json in the --fs
+// directory is applied to every reading, as on the device. Fault events go
+// to TOPIC_FAULT and the quality report is printed at the end.
+//
+// The WiFi credentials and the time go down the pty as downlink commands at
+// start, and --interval adds a sampling interval command; run
+// tools/loadgen.py with --peer to have them acked. The downlink counters are
+// printed at the end.
+//
+// Log entries are drained to stdout between readings, as logTask does on
+// the device; --log debug turns every module up to debug.
+//
+// Built with -DMQTT_TLS=1 the broker connection goes through TlsClient, with
+// the CA from mqtt_ca.pem in the --fs directory and the session kept in
+// config.2.bin there; try it against `tools/loadgen.py broker --tls-cert`.
+// --reconnect drops and re-establishes the broker connection N times after
+// the first connect (which resumes a stored session if there is one),
+// prints the connect times and the TLS figures and exits.
+//
+// Built with -DMQTT_V5=1 MQTTManager speaks MQTT 5 (falling back to 3.1.1
+// if the broker turns it down); the mqtt command shows the session, alias
+// and flow-control figures. --bench-wire N publishes N encoded readings per
+// variant (3.1.1, MQTT 5 at QoS 0 and 1) to --broker, prints the bytes on the
+// wire per message and exits.
+//
+// --bench-compress decodes the frames of a tools/loadgen.py capture, runs
+// the payload compression benchmark on their readings (CSV, or JSON with
+// --bench json) and exits.
+//
+// Built with -DMQTT_BROKER=1, --local-broker PORT also serves readings and
+// fault events to MQTT clients connecting to PORT, and forwards what they
+// publish on BROKER_BRIDGE_TOPICS to --broker; try it with
+// `tools/loadgen.py fanout --port PORT` or mosquitto_sub. The broker figures
+// are printed at the end.
+//
+// Lines typed on stdin go through the same Console as the USB console on
+// the device, with the commands that make sense here (type help).
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <signal.h>
+#include <time.h>
+#include <vector>
+#include "config.h"
+#include "hal.h"
+#include "config_manager.h"
+#include "mqtt_manager.h"
+#include "serial_manager.h"
+#include "payload_encoder.h"
+#include "latency_tracer.h"
+#include "node_table.h"
+#include "report_filter.h"
+#include "calibration.h"
+#include "sensor_quality.h"
+#include "downlink.h"
+#include "event_log.h"
+#include "console.h"
+#include "benchmark.h"
+#include "memory_pools.h"
+#include "json_allocators.h"
+#include "tls_client.h"
+#include "mqtt_broker.h"
+
+static volatile bool running = true;
+
+// Same pool layout as the device build
+static TypedPool<Reading> readingPool("readings", READING_POOL_SIZE, MEM_INTERNAL);
+static TypedPool<PayloadBuffer> payloadPool("payloads", PAYLOAD_POOL_SIZE, MEM_PSRAM);
+static BumpArena jsonArena("json", JSON_ARENA_SIZE, MEM_INTERNAL);
+static ArenaJsonAllocator jsonArenaAllocator(&jsonArena);
+
+// What the console commands look at, main()'s pipeline
+static struct {
+    NodeTable* nodes;
+    ReportFilter* filter;
+    QualityMonitor* quality;
+    DownlinkQueue* downlink;
+    MQTTManager* mqtt;
+    MqttBroker* broker;             // Null without --local-broker
+} view;
+
+static void helpCommand(const char* args, size_t length, Print& out);
+
+static void nodesCommand(const char* args, size_t length, Print& out) {
+    for (uint8_t i = 0; i < view.nodes->size(); i++) {
+        const NodeStats& node = view.nodes->at(i);
+        out.printf("%-8s %7u %7.2f %7.2f\n", node.nodeID, (unsigned)node.count, node.lastTemp, node.lastHumidity);
+    }
+}
+
+static void reportCommand(const char* args, size_t length, Print& out) {
+    static char report[REPORT_REPORT_SIZE];
+    view.filter->format(report, sizeof(report));
+    out.print(report);
+}
+
+static void qualityCommand(const char* args, size_t length, Print& out) {
+    static char report[QUALITY_REPORT_SIZE];
+    view.quality->format(report, sizeof(report));
+    out.print(report);
+}
+
+static void downlinkCommand(const char* args, size_t length, Print& out) {
+    static char report[DOWNLINK_REPORT_SIZE];
+    view.downlink->format(report, sizeof(report));
+    out.print(report);
+}
+
+static void mqttCommand(const char* args, size_t length, Print& out) {
+    static char report[MQTT_REPORT_SIZE];
+    view.mqtt->formatStats(report, sizeof(report));
+    out.print(report);
+}
+
+static void brokerCommand(const char* args, size_t length, Print& out) {
+    if (view.broker == nullptr) {
+        out.println("No local broker, see --local-broker");
+        return;
+    }
+    static char report[BROKER_REPORT_SIZE];
+    view.broker->format(report, sizeof(report));
+    out.print(report);
+}
+
+static void poolsCommand(const char* args, size_t length, Print& out) {
+    static char report[MEMORY_REPORT_SIZE];
+    formatMemoryStats(report, sizeof(report));
+    out.print(report);
+}
+
+// log [<module|*> <level>]
+static void logCommand(const char* args, size_t length, Print& out) {
+    if (length == 0) {
+        static char report[LOG_REPORT_SIZE];
+        eventLog.formatHistory(report, sizeof(report));
+        out.print(report);
+        return;
+    }
+    char moduleName[12];
+    char levelName[8];
+    CommandRegistry::nextWord(args, length, moduleName, sizeof(moduleName));
+    CommandRegistry::nextWord(args, length, levelName, sizeof(levelName));
+    LogModule module = LOG_HUB;
+    LogLevel level;
+    bool all = strcmp(moduleName, "*") == 0;
+    if ((!all && !EventLog::parseModule(moduleName, module)) || !EventLog::parseLevel(levelName, level)) {
+        out.println("Usage: log <hub|ingest|mqtt|rtc|downlink|*> <off|error|warn|info|debug>");
+        return;
+    }
+    for (uint8_t i = 0; i < LOG_MODULE_COUNT; i++) {
+        if (all || i == module) eventLog.setLevel((LogModule)i, level);
+    }
+}
+
+// interval <node|*> <seconds>
+static void intervalCommand(const char* args, size_t length, Print& out) {
+    char node[SENSOR_NODE_ID_SIZE + 1];
+    char seconds[12];
+    size_t nodeLength = CommandRegistry::nextWord(args, length, node, sizeof(node));
+    CommandRegistry::nextWord(args, length, seconds, sizeof(seconds));
+    long value = atol(seconds);
+    uint16_t id = nodeLength > 0 && nodeLength < SENSOR_NODE_ID_SIZE && value > 0
+                  ? view.downlink->sendSampleInterval(node, (uint32_t)value) : 0;
+    if (id != 0) {
+        out.printf("Interval command #%u queued\n", (unsigned)id);
+    } else {
+        out.println("Usage: interval <node|*> <seconds>");
+    }
+}
+
+static const CommandSpec COMMANDS[] = {
+    // name        handler          sources      help
+    {"help",      helpCommand,     CMD_CONSOLE, "this list"},
+    {"nodes",     nodesCommand,    CMD_CONSOLE, "readings per node"},
+    {"report",    reportCommand,   CMD_CONSOLE, "report-by-exception figures"},
+    {"quality",   qualityCommand,  CMD_CONSOLE, "sensor fault flags"},
+    {"downlink",  downlinkCommand, CMD_CONSOLE, "downlink queue counters"},
+    {"mqtt",      mqttCommand,     CMD_CONSOLE, "protocol, session and topic alias figures"},
+    {"broker",    brokerCommand,   CMD_CONSOLE, "local clients, fan-out time and bridge"},
+    {"pools",     poolsCommand,    CMD_CONSOLE, "memory pools and arena"},
+    {"log",       logCommand,      CMD_CONSOLE, "[<module|*> <level>] history, or set a level"},
+    {"interval",  intervalCommand, CMD_CONSOLE, "<node|*> <seconds> set a node's sampling interval"},
+};
+static const CommandRegistry commands(COMMANDS, sizeof(COMMANDS) / sizeof(COMMANDS[0]));
+
+static void helpCommand(const char* args, size_t length, Print& out) {
+    commands.printHelp(out, CMD_CONSOLE);
+}
+
+static void handleSignal(int signal) {
+    (void)signal;
+    running = false;
+}
+
+// Readings from a capture's frames for the compression benchmark
+static int runCompressionCapture(const char* path, BenchFormat format) {
+    static const char MAGIC[] = "HUBCAP1\n";
+    char magic[sizeof(MAGIC) - 1];
+    FILE* capture = fopen(path, "rb");
+    if (capture == nullptr || fread(magic, 1, sizeof(magic), capture) != sizeof(magic) ||
+        memcmp(magic, MAGIC, sizeof(magic)) != 0) {
+        Serial.printf("%s is not a loadgen capture\n", path);
+        if (capture) fclose(capture);
+        return 1;
+    }
+    std::vector<SensorReading> readings;
+    FrameDecoder decoder;
+    SensorReading reading;
+    uint8_t record[10];         // Arrival time (double), chunk length (u16), little endian
+    uint8_t chunk[4096];
+    while (fread(record, 1, sizeof(record), capture) == sizeof(record)) {
+        size_t remaining = record[8] | record[9] << 8;
+        while (remaining > 0) {
+            size_t n = fread(chunk, 1, remaining < sizeof(chunk) ? remaining : sizeof(chunk), capture);
+            if (n == 0) {
+                break;
+            }
+            for (size_t i = 0; i < n; i++) {
+                if (decoder.feed(chunk[i], reading)) {
+                    readings.push_back(reading);
+                }
+            }
+            remaining -= n;
+        }
+    }
+    fclose(capture);
+    if (readings.empty()) {
+        Serial.printf("No readings in %s\n", path);
+        return 1;
+    }
+    runCompressionBenchmark(Serial, format, readings.data(), readings.size());
+    Serial.flush();
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    const char* device = nullptr;
+    const char* broker = "127.0.0.1";
+    const char* fsRoot = "./hub_fs";
+    unsigned long maxReadings = 0;
+    const char* benchFormat = nullptr;
+    const char* intervalCommand = nullptr;
+    unsigned long reconnects = 0;
+    unsigned long wireMessages = 0;
+    const char* compressCapture = nullptr;
+    unsigned long localBrokerPort = 0;
+    ReportFilterConfig filterConfig = ReportFilterConfig::defaults();
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--device") == 0) {
+            device = argv[i + 1];
+        } else if (strcmp(argv[i], "--broker") == 0) {
+            broker = argv[i + 1];
+        } else if (strcmp(argv[i], "--fs") == 0) {
+            fsRoot = argv[i + 1];
+        } else if (strcmp(argv[i], "--count") == 0) {
+            maxReadings = strtoul(argv[i + 1], nullptr, 10);
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            benchFormat = argv[i + 1];
+        } else if (strcmp(argv[i], "--filter") == 0) {
+            const char* mode = argv[i + 1];
+            filterConfig.mode = strcmp(mode, "sdt") == 0      ? REPORT_SWINGING_DOOR
+                              : strcmp(mode, "deadband") == 0 ? REPORT_DEADBAND
+                                                              : REPORT_ALL;
+        } else if (strcmp(argv[i], "--interval") == 0) {
+            intervalCommand = argv[i + 1];
+        } else if (strcmp(argv[i], "--reconnect") == 0) {
+            reconnects = strtoul(argv[i + 1], nullptr, 10);
+        } else if (strcmp(argv[i], "--bench-wire") == 0) {
+            wireMessages = strtoul(argv[i + 1], nullptr, 10);
+        } else if (strcmp(argv[i], "--bench-compress") == 0) {
+            compressCapture = argv[i + 1];
+        } else if (strcmp(argv[i], "--local-broker") == 0) {
+            localBrokerPort = strtoul(argv[i + 1], nullptr, 10);
+        } else if (strcmp(argv[i], "--log") == 0) {
+            LogLevel level;
+            if (EventLog::parseLevel(argv[i + 1], level)) {
+                for (uint8_t m = 0; m < LOG_MODULE_COUNT; m++) {
+                    eventLog.setLevel((LogModule)m, level);
+                }
+            }
+        }
+    }
+
+    signal(SIGINT, handleSignal);
+    signal(SIGTERM, handleSignal);
+
+    Serial.println("UART-MQTT Hub (native) starting...");
+#if MQTT_TLS
+    TlsMemory::install();
+#endif
+    eventLog.begin();
+
+    if (!readingPool.begin() || !payloadPool.begin() || !jsonArena.begin()) {
+        Serial.println("Failed to allocate memory pools");
+        return 1;
+    }
+    if (compressCapture) {
+        return runCompressionCapture(compressCapture,
+                                     benchFormat && strcmp(benchFormat, "json") == 0 ? BENCH_JSON : BENCH_CSV);
+    }
+
+    PosixFileSystem storage(fsRoot, "host directory");
+    PtySerialPort hubPort(device);
+    PosixTcpClient netClient;
+    FileSlotStore configSlots(&storage);
+
+    ConfigManager configManager(&storage, nullptr, &configSlots);
+    HubConfig* config = configManager.getConfig();
+    if (!configManager.initStorage() || !configManager.loadConfig()) {
+        Serial.println("No configuration found, using local broker defaults");
+    }
+
+    // --broker always wins so a stored config can't point a bench run at production
+    String host(broker);
+    int colon = host.indexOf(':');
+    if (colon >= 0) {
+        config->mqtt_port = host.substring(colon + 1).toInt();
+        host = host.substring(0, colon);
+    }
+    setConfigString(config->mqtt_server, host.c_str());
+
+    SerialManager serialManager(&hubPort);
+#if MQTT_TLS
+    TlsClient tlsClient(&netClient);
+    tlsClient.loadCaFile(&storage, nullptr);
+    tlsClient.setSessionStore(&configSlots, TLS_SESSION_SLOT);
+    MQTTManager mqttManager(config, &tlsClient);
+#else
+    MQTTManager mqttManager(config, &netClient);
+#endif
+    static CalibrationTable calibration;
+    calibration.loadFile(&storage, nullptr);
+
+    if (benchFormat) {
+        mqttManager.begin();
+        BenchOptions options;
+        options.mqtt = &mqttManager;
+        runBenchmarks(Serial, strcmp(benchFormat, "csv") == 0 ? BENCH_CSV : BENCH_JSON, options);
+        Serial.flush();
+        return 0;
+    }
+
+    if (wireMessages) {
+#if MQTT_V5
+#if MQTT_TLS
+        runWireBenchmark(Serial, BENCH_CSV, &tlsClient, config->mqtt_server, config->mqtt_port, wireMessages);
+#else
+        runWireBenchmark(Serial, BENCH_CSV, &netClient, config->mqtt_server, config->mqtt_port, wireMessages);
+#endif
+        Serial.flush();
+        return 0;
+#else
+        Serial.println("--bench-wire needs a build with -DMQTT_V5=1");
+        return 1;
+#endif
+    }
+
+    if (reconnects) {
+        // begin() connects from the stored session, if any; the timed ones
+        // after it from the session in RAM
+        unsigned long totalUs = 0, maxUs = 0, done = 0;
+        mqttManager.begin();
+        for (unsigned long i = 0; i < reconnects && running; i++) {
+            mqttManager.reconfigure();
+            unsigned long start = micros();
+            if (!mqttManager.connect()) {
+                continue;
+            }
+            unsigned long took = micros() - start;
+            totalUs += took;
+            maxUs = took > maxUs ? took : maxUs;
+            done++;
+        }
+        Serial.printf("%lu of %lu reconnects, mean %.2f ms, max %.2f ms\n", done, reconnects,
+                      done ? totalUs / 1000.0 / done : 0.0, maxUs / 1000.0);
+#if MQTT_TLS
+        static char tlsReport[TLS_REPORT_SIZE];
+        tlsClient.formatStats(tlsReport, sizeof(tlsReport));
+        Serial.print(tlsReport);
+#endif
+        eventLog.drain(Serial);
+        Serial.flush();
+        return done == reconnects ? 0 : 1;
+    }
+
+    serialManager.begin(BAUD_RATE, RX_HUB, TX_HUB);
+    DownlinkQueue downlink(&hubPort);
+    serialManager.setControlHandler(DownlinkQueue::controlHandler, &downlink);
+    downlink.sendWiFiCredentials(config->wifi_ssid, config->wifi_password);
+    downlink.sendTimeSync((uint32_t)time(nullptr), 0);
+    if (intervalCommand != nullptr) {
+        const char* colon = strchr(intervalCommand, ':');
+        char node[SENSOR_NODE_ID_SIZE] = {0};
+        if (colon != nullptr && colon - intervalCommand < SENSOR_NODE_ID_SIZE) {
+            memcpy(node, intervalCommand, colon - intervalCommand);
+            downlink.sendSampleInterval(node, strtoul(colon + 1, nullptr, 10));
+        }
+    }
+    if (!mqttManager.begin()) {
+        Serial.println("MQTT broker unreachable, will keep retrying");
+    }
+#if MQTT_BROKER
+    PosixTcpServer localServer;
+    static MqttBroker localBroker(&localServer);
+    if (localBrokerPort && !localBroker.begin((uint16_t)localBrokerPort)) {
+        eventLog.drain(Serial);
+        return 1;
+    }
+    MqttBroker* local = localBrokerPort ? &localBroker : nullptr;
+#else
+    if (localBrokerPort) {
+        Serial.println("--local-broker needs a build with -DMQTT_BROKER=1");
+        return 1;
+    }
+    MqttBroker* local = nullptr;
+#endif
+
+    Reading* reading = nullptr;
+    NodeTable nodeTable;
+    ReportFilter reportFilter(filterConfig);
+    static QualityMonitor qualityMonitor(QualityConfig::defaults());
+    view = {&nodeTable, &reportFilter, &qualityMonitor, &downlink, &mqttManager, local};
+    // A terminal in cooked mode echoes by itself
+    Console console(&Serial, &commands, false);
+    QualityEvent events[QUALITY_MAX_EVENTS];
+    JsonDocument doc(&jsonArenaAllocator);
+    unsigned long readings = 0;
+    unsigned long published = 0;
+    unsigned long startMs = millis();
+
+    while (running && (maxReadings == 0 || readings < maxReadings)) {
+        if (reading == nullptr) {
+            reading = readingPool.acquire();
+        }
+        if (reading != nullptr && serialManager.readReading(reading)) {
+            readings++;
+            nodeTable.update(reading->data, millis());
+            TRACE_STAMP(reading->trace, TRACE_ENQUEUED);
+            TRACE_STAMP(reading->trace, TRACE_DEQUEUED);
+            SensorReading* data = &reading->data;
+            calibration.apply(&data, 1);
+            uint8_t raised = qualityMonitor.check(reading->data, reading->receivedMs, events, QUALITY_MAX_EVENTS);
+            for (uint8_t i = 0; i < raised && (local || mqttManager.isConnected()); i++) {
+                time_t at = time(nullptr) - (time_t)((millis() - events[i].atMs) / 1000);
+                struct tm timeInfo;
+                localtime_r(&at, &timeInfo);
+                char event[QUALITY_EVENT_SIZE];
+                if (QualityMonitor::formatEvent(events[i], config->hub_id, &timeInfo, event, sizeof(event)) > 0) {
+                    if (local) local->publish(TOPIC_FAULT, event);
+                    mqttManager.publish(TOPIC_FAULT, event);
+                }
+            }
+
+            ReportSample samples[2];
+            uint8_t count = reportFilter.offer(reading->data, reading->receivedMs, samples);
+            for (uint8_t i = 0; i < count; i++) {
+                time_t arrived = time(nullptr) - (time_t)((millis() - samples[i].receivedMs) / 1000);
+                struct tm timeInfo;
+                localtime_r(&arrived, &timeInfo);
+                PayloadBuffer* payload = payloadPool.acquire();
+                if (payload == nullptr) {
+                    break;  // Single-threaded, only possible if a block leaked
+                }
+                payload->length = encodeReading(doc, samples[i].data, config->hub_id, &timeInfo,
+                                                samples[i].receivedMs, payload->data, sizeof(payload->data));
+                TRACE_STAMP(reading->trace, TRACE_ENCODED);
+                if (payload->length > 0 && local) {
+                    local->publish(TOPIC_SENSOR, payload->data);
+                }
+
+                if (payload->length > 0 && mqttManager.isConnected()) {
+                    TRACE_STAMP(reading->trace, TRACE_PUBLISH_CALL);
+                    if (mqttManager.publish(TOPIC_SENSOR, payload->data)) {
+                        published++;
+                        reportFilter.notePublished(payload->length);
+                    } else {
+                        reportFilter.forget(samples[i].data.nodeID);
+                    }
+                    TRACE_STAMP(reading->trace, TRACE_PUBLISH_RETURN);
+                    if (i + 1 == count) {
+                        TRACE_COMMIT(reading->trace);
+                    }
+                } else {
+                    reportFilter.forget(samples[i].data.nodeID);
+                }
+                payloadPool.release(payload);
+                doc.clear();
+                jsonArena.reset();
+            }
+        } else {
+            delay(1);
+        }
+        downlink.poll(millis());
+        DownlinkResult result;
+        while (downlink.takeResult(result)) {
+            LOG_INFO(LOG_DOWNLINK, "#%u %s to %s: %s after %u sends, %lu ms", (unsigned)result.id,
+                     DownlinkQueue::commandName(result.command), result.nodeID[0] ? result.nodeID : "hub",
+                     DownlinkQueue::statusName(result.status), (unsigned)result.attempts,
+                     (unsigned long)result.elapsedMs);
+        }
+        mqttManager.loop();
+        if (local) {
+            local->loop();
+            BridgedMessage message;
+            while (mqttManager.isConnected() && local->takeBridged(message)) {
+                char topic[sizeof(TOPIC_BRIDGE) + sizeof(config->hub_id) + BROKER_TOPIC_SIZE];
+                snprintf(topic, sizeof(topic), TOPIC_BRIDGE "%s", config->hub_id, message.topic);
+                mqttManager.publish(topic, message.payload, message.length);
+            }
+        }
+        console.poll();
+        eventLog.drain(Serial);
+    }
+
+    eventLog.drain(Serial);
+    unsigned long elapsedMs = millis() - startMs;
+    Serial.printf("\n%lu readings from %u nodes, %lu published in %lu ms (%.1f readings/s)\n",
+                  readings, nodeTable.size(), published, elapsedMs,
+                  elapsedMs ? readings * 1000.0 / elapsedMs : 0.0);
+    static char filterReport[REPORT_REPORT_SIZE];
+    reportFilter.format(filterReport, sizeof(filterReport));
+    Serial.print(filterReport);
+    static char qualityReport[QUALITY_REPORT_SIZE];
+    qualityMonitor.format(qualityReport, sizeof(qualityReport));
+    Serial.print(qualityReport);
+    static char downlinkReport[DOWNLINK_REPORT_SIZE];
+    downlink.format(downlinkReport, sizeof(downlinkReport));
+    Serial.print(downlinkReport);
+    if (local) {
+        static char brokerReport[BROKER_REPORT_SIZE];
+        local->format(brokerReport, sizeof(brokerReport));
+        Serial.print(brokerReport);
+    }
+#if ENABLE_LATENCY_TRACE
+    static char report[LATENCY_REPORT_SIZE];
+    latencyTracer.format(report, sizeof(report));
+    Serial.print(report);
+#endif
+    Serial.flush();
+    return 0;
+}
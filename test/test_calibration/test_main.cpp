@@ -0,0 +1,191 @@
+// CalibrationTable's batch kernel against applyReference(): random batches
+// of every size up to several kernel passes, odd lengths and the tail that
+// doesn't fill the lanes, must come out bit for bit the same
+
+#include <unity.h>
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include "calibration.h"
+#include "sensor_schema.h"
+
+static const char CURVES[] =
+    "{\"curves\":["
+    "{\"node\":\"*\",\"quantity\":\"temp\",\"points\":[[-40,-39.6],[0,0.3],[50,50.2]]},"
+    "{\"node\":\"N07\",\"quantity\":\"temp\",\"poly\":[0.25,1.01]},"
+    "{\"node\":\"N07\",\"quantity\":\"moisture\",\"points\":[[1200,45],[2000,30],[2900,8]],"
+    "\"temp_coeff\":3.5,\"ref_temp\":20},"
+    "{\"node\":\"N07\",\"quantity\":\"humidity\",\"poly\":[0.8,0.97,0.0002]},"
+    "{\"node\":\"*\",\"quantity\":\"humidity\",\"points\":[[0,1],[100,99]],\"temp_coeff\":-0.1},"
+    "{\"node\":\"*\",\"quantity\":\"solar_wm2\",\"poly\":[-2,1.02,-1e-5,3e-9],\"temp_coeff\":0.4},"
+    "{\"node\":\"N09\",\"quantity\":\"rain_mm\",\"points\":[[0,0],[10,10.4],[100,103],[500,510],"
+    "[800,815],[1000,1018],[1500,1525],[2000,2031]]},"
+    "{\"node\":\"*\",\"quantity\":\"wind_ms\",\"poly\":[0.1,1.05]},"
+    "{\"node\":\"*\",\"quantity\":\"gust_ms\",\"poly\":[3]},"
+    "{\"node\":\"N09\",\"quantity\":\"wind_dir\",\"points\":[[0,5],[360,365]]}"
+    "]}";
+
+static const char* const NODES[] = {"N07", "N09", "N11", "X"};
+
+// Breakpoints of the curves above, so values land on them exactly too
+static const float EDGES[] = {-40, 0, 50, 1200, 2000, 2900, 100, 10, 500, 1000, 2000, 360};
+
+static uint32_t rngState;
+
+static uint32_t nextRandom() {
+    rngState = rngState * 1664525u + 1013904223u;
+    return rngState >> 8;
+}
+
+static float randomValue() {
+    switch (nextRandom() % 16) {
+        case 0: return NAN;
+        case 1: return INFINITY;
+        case 2: return EDGES[nextRandom() % (sizeof(EDGES) / sizeof(EDGES[0]))];
+        default: return ((float)(nextRandom() % 600000) - 100000.0f) / 100.0f;
+    }
+}
+
+static SensorReading randomReading() {
+    SensorReading reading;
+    uint8_t schemaId = 1 + nextRandom() % (SCHEMA_ID_LIMIT - 1);
+    initReading(reading, schemaId, NODES[nextRandom() % 4]);
+    const SchemaInfo* schema = reading.schema();
+    reading.present = 0xFFFF >> (16 - schema->fieldCount);
+    uint16_t quantities = reading.quantities();
+    for (uint8_t q = Q_TEMP; q < QUANTITY_COUNT; q++) {
+        if (quantities & (1u << q)) {
+            schema->setValue(reading, (Quantity)q, randomValue());
+        }
+    }
+    // Mostly complete readings, some with fields left out
+    if (nextRandom() % 4 == 0) {
+        reading.present &= nextRandom();
+    }
+    return reading;
+}
+
+static void assertSameBits(const SensorReading& expected, const SensorReading& actual, size_t index) {
+    char message[48];
+    snprintf(message, sizeof(message), "reading %u", (unsigned)index);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(expected.nodeID, actual.nodeID, message);
+    TEST_ASSERT_EQUAL_HEX16_MESSAGE(expected.present, actual.present, message);
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(expected.body, actual.body, sizeof(expected.body), message);
+}
+
+static CalibrationTable* table;
+
+void setUp(void) {
+    rngState = 2024;
+    table = new CalibrationTable();
+    char error[96] = "";
+    TEST_ASSERT_TRUE_MESSAGE(table->load((const uint8_t*)CURVES, strlen(CURVES), error, sizeof(error)), error);
+    TEST_ASSERT_EQUAL_UINT8(10, table->size());
+}
+
+void tearDown(void) {
+    delete table;
+}
+
+// Spot values of the reference itself, so both can't be wrong together
+void test_reference_spot_values(void) {
+    SensorReading reading;
+    initReading(reading, SCHEMA_CLIMATE, "N11");
+    reading.present = 0x3;
+    ClimateSample& climate = reading.as<ClimateSample>();
+    climate.temp = 25.0f;          // Between 0 -> 0.3 and 50 -> 50.2
+    climate.humidity = 50.0f;      // 0 -> 1, 100 -> 99, compensated -0.1/degC from 25
+    SensorReading* batch[] = {&reading};
+    TEST_ASSERT_EQUAL(2, table->applyReference(batch, 1));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 25.25f, climate.temp);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 50.0f, climate.humidity);
+
+    // Flat beyond the ends, and a node's own curve over "*"
+    initReading(reading, SCHEMA_CLIMATE, "N07");
+    reading.present = 0x7;
+    climate.temp = 20.0f;
+    climate.humidity = 10.0f;
+    climate.moisture = 3000.0f;
+    TEST_ASSERT_EQUAL(3, table->applyReference(batch, 1));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.25f + 1.01f * 20.0f, climate.temp);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.8f + 0.97f * 10.0f + 0.0002f * 100.0f, climate.humidity);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 8.0f, climate.moisture);
+}
+
+// Every batch length from empty to several passes' worth
+void test_kernel_matches_reference_every_length(void) {
+    const size_t MAX_BATCH = 3 * CALIBRATION_LANES + 7;
+    for (size_t length = 0; length <= MAX_BATCH; length++) {
+        for (int trial = 0; trial < 4; trial++) {
+            std::vector<SensorReading> kernel(length);
+            for (size_t i = 0; i < length; i++) {
+                kernel[i] = randomReading();
+            }
+            std::vector<SensorReading> reference = kernel;
+            std::vector<SensorReading*> kernelBatch(length);
+            std::vector<SensorReading*> referenceBatch(length);
+            for (size_t i = 0; i < length; i++) {
+                kernelBatch[i] = &kernel[i];
+                referenceBatch[i] = &reference[i];
+            }
+            size_t changed = table->apply(kernelBatch.data(), length);
+            TEST_ASSERT_EQUAL(table->applyReference(referenceBatch.data(), length), changed);
+            for (size_t i = 0; i < length; i++) {
+                assertSameBits(reference[i], kernel[i], i);
+            }
+        }
+    }
+}
+
+// Readings with every quantity present fill the lanes unevenly, so the
+// flush before a reading that doesn't fit and the final partial pass both
+// run; the stats count the same values
+void test_kernel_matches_reference_full_readings(void) {
+    const size_t LENGTHS[] = {1, 3, 4, 5, 31, 33, 63, 64, 65};
+    for (size_t length : LENGTHS) {
+        std::vector<SensorReading> kernel(length);
+        for (size_t i = 0; i < length; i++) {
+            initReading(kernel[i], i % 2 ? SCHEMA_CLIMATE : SCHEMA_WIND, i % 3 ? "N07" : "N09");
+            const SchemaInfo* schema = kernel[i].schema();
+            kernel[i].present = 0xFFFF >> (16 - schema->fieldCount);
+            uint16_t quantities = kernel[i].quantities();
+            for (uint8_t q = Q_TEMP; q < QUANTITY_COUNT; q++) {
+                if (quantities & (1u << q)) {
+                    schema->setValue(kernel[i], (Quantity)q, (float)(nextRandom() % 3000));
+                }
+            }
+        }
+        std::vector<SensorReading> reference = kernel;
+        std::vector<SensorReading*> kernelBatch(length);
+        std::vector<SensorReading*> referenceBatch(length);
+        for (size_t i = 0; i < length; i++) {
+            kernelBatch[i] = &kernel[i];
+            referenceBatch[i] = &reference[i];
+        }
+        uint32_t before = table->getStats().values;
+        size_t changed = table->apply(kernelBatch.data(), length);
+        TEST_ASSERT_EQUAL(changed, table->getStats().values - before);
+        TEST_ASSERT_EQUAL(table->applyReference(referenceBatch.data(), length), changed);
+        for (size_t i = 0; i < length; i++) {
+            assertSameBits(reference[i], kernel[i], i);
+        }
+    }
+}
+
+void test_empty_table_changes_nothing(void) {
+    CalibrationTable empty;
+    SensorReading reading = randomReading();
+    SensorReading before = reading;
+    SensorReading* batch[] = {&reading};
+    TEST_ASSERT_EQUAL(0, empty.apply(batch, 1));
+    assertSameBits(before, reading, 0);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_reference_spot_values);
+    RUN_TEST(test_kernel_matches_reference_every_length);
+    RUN_TEST(test_kernel_matches_reference_full_readings);
+    RUN_TEST(test_empty_table_changes_nothing);
+    return UNITY_END();
+}
@@ -0,0 +1,238 @@
+// ConfigBodyParser fed every body whole, split in two at every offset and a
+// byte at a time: all three must agree, whatever the TCP chunking was
+
+#include <unity.h>
+#include <string>
+#include "config.h"
+#include "config_body.h"
+
+static HubConfig baseConfig() {
+    HubConfig config;
+    setConfigString(config.mqtt_server, "old.broker");
+    config.mqtt_port = 1883;
+    setConfigString(config.mqtt_username, "old-user");
+    setConfigString(config.mqtt_password, "old-pass");
+    setConfigString(config.wifi_ssid, "OldNet");
+    setConfigString(config.wifi_password, "old-wifi");
+    setConfigString(config.hub_id, "H-0");
+    return config;
+}
+
+static void assertConfigEqual(const HubConfig& expected, const HubConfig& actual, const char* message) {
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(expected.mqtt_server, actual.mqtt_server, message);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(expected.mqtt_port, actual.mqtt_port, message);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(expected.mqtt_username, actual.mqtt_username, message);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(expected.mqtt_password, actual.mqtt_password, message);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(expected.wifi_ssid, actual.wifi_ssid, message);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(expected.wifi_password, actual.wifi_password, message);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(expected.hub_id, actual.hub_id, message);
+}
+
+struct ValidBody {
+    const char* json;
+    void (*expect)(HubConfig* config);  // Applied to baseConfig()
+};
+
+static const ValidBody VALID_BODIES[] = {
+    {"{}", [](HubConfig*) {}},
+    {"{\"mqtt_server\":\"broker.lan\",\"mqtt_port\":8883,\"mqtt_username\":\"u\","
+     "\"mqtt_password\":\"p\\\"w\",\"wifi_ssid\":\"Caf\\u00e9 \\u20ac\",\"wifi_password\":\"secret\","
+     "\"hub_id\":\"H-7\"}",
+     [](HubConfig* c) {
+         setConfigString(c->mqtt_server, "broker.lan");
+         c->mqtt_port = 8883;
+         setConfigString(c->mqtt_username, "u");
+         setConfigString(c->mqtt_password, "p\"w");
+         setConfigString(c->wifi_ssid, "Caf\xC3\xA9 \xE2\x82\xAC");
+         setConfigString(c->wifi_password, "secret");
+         setConfigString(c->hub_id, "H-7");
+     }},
+    {" \r\n{ \"hub_id\" :\t\"H-2\" ,\n \"mqtt_port\" : 1884 }\n ",
+     [](HubConfig* c) {
+         setConfigString(c->hub_id, "H-2");
+         c->mqtt_port = 1884;
+     }},
+    // Unknown keys, nested ones with brackets and quotes inside strings
+    {"{\"extra\":{\"a\":[1,{\"b\":\"}]\"}],\"c\":\"\\\"{\"},\"hub_id\":\"H-3\",\"list\":[],"
+     "\"flag\":true,\"n\":-1.5e3,\"nothing\":null}",
+     [](HubConfig* c) { setConfigString(c->hub_id, "H-3"); }},
+    // null is an absent key, an empty WiFi password keeps the old one
+    {"{\"wifi_password\":\"\",\"mqtt_server\":null,\"hub_id\":\"H-4\"}",
+     [](HubConfig* c) { setConfigString(c->hub_id, "H-4"); }},
+    // An empty MQTT field clears it
+    {"{\"mqtt_username\":\"\",\"mqtt_password\":\"\"}",
+     [](HubConfig* c) {
+         c->mqtt_username[0] = '\0';
+         c->mqtt_password[0] = '\0';
+     }},
+    // Values are truncated to the field like setConfigString
+    {"{\"hub_id\":\"0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz0123456789\"}",
+     [](HubConfig* c) { strcpy(c->hub_id, "0123456789abcde"); }},
+    // A key longer than any known one is skipped, not cut down to one
+    {"{\"hub_id_and_then_a_lot_more_text\":\"x\",\"hub_id\":\"H-5\"}",
+     [](HubConfig* c) { setConfigString(c->hub_id, "H-5"); }},
+    {"{\"mqtt_password\":\"a\\\\b\\/c\\n\\t\",\"wifi_ssid\":\"\\u0041\\u00A9\"}",
+     [](HubConfig* c) {
+         setConfigString(c->mqtt_password, "a\\b/c\n\t");
+         setConfigString(c->wifi_ssid, "A\xC2\xA9");
+     }},
+};
+
+static const char* const INVALID_BODIES[] = {
+    "[]",
+    "}",
+    "\"hub_id\"",
+    "{,}",
+    "{\"hub_id\" \"H\"}",
+    "{\"hub_id\":\"H\",}",
+    "{\"hub_id\":H}",
+    "{\"hub_id\":tru}",
+    "{\"mqtt_port\":12a}",
+    "{\"hub_id\":\"H\"}x",
+    "{\"hub_id\":\"H\"}{}",
+    "{\"a\":1 \"b\":2}",
+    "{\"hub_id\":{\"a\":1}}",
+    "{\"mqtt_port\":[1883]}",
+    "{\"hub_id\":\"a\\qb\"}",
+    "{\"hub_id\":\"\\u12G4\"}",
+    "{\"hub_id\":\"a\nb\"}",
+    "{\"extra\":[[[[[[[[[1]]]]]]]]]}",
+    "{'hub_id':'H'}",
+};
+
+static ConfigBodyParser feedSplit(const std::string& body, size_t cut) {
+    ConfigBodyParser parser(baseConfig());
+    const uint8_t* data = (const uint8_t*)body.data();
+    parser.feed(data, cut);
+    parser.feed(data + cut, body.size() - cut);
+    return parser;
+}
+
+static ConfigBodyParser feedBytewise(const std::string& body) {
+    ConfigBodyParser parser(baseConfig());
+    for (char c : body) {
+        parser.feed((const uint8_t*)&c, 1);
+    }
+    return parser;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_valid_bodies_whole(void) {
+    for (const ValidBody& body : VALID_BODIES) {
+        HubConfig expected = baseConfig();
+        body.expect(&expected);
+        HubConfig config = baseConfig();
+        TEST_ASSERT_EQUAL_MESSAGE(BODY_DONE,
+                                  ConfigBodyParser::parse((const uint8_t*)body.json, strlen(body.json), &config),
+                                  body.json);
+        assertConfigEqual(expected, config, body.json);
+    }
+}
+
+void test_valid_bodies_split_anywhere(void) {
+    for (const ValidBody& body : VALID_BODIES) {
+        std::string json = body.json;
+        HubConfig expected = baseConfig();
+        body.expect(&expected);
+        for (size_t cut = 0; cut <= json.size(); cut++) {
+            ConfigBodyParser parser = feedSplit(json, cut);
+            TEST_ASSERT_EQUAL_MESSAGE(BODY_DONE, parser.finish(), body.json);
+            assertConfigEqual(expected, parser.result(), body.json);
+        }
+        ConfigBodyParser parser = feedBytewise(json);
+        TEST_ASSERT_EQUAL_MESSAGE(BODY_DONE, parser.finish(), body.json);
+        assertConfigEqual(expected, parser.result(), body.json);
+    }
+}
+
+void test_invalid_bodies_split_anywhere(void) {
+    for (const char* body : INVALID_BODIES) {
+        std::string json = body;
+        HubConfig config = baseConfig();
+        TEST_ASSERT_EQUAL_MESSAGE(BODY_INVALID,
+                                  ConfigBodyParser::parse((const uint8_t*)body, json.size(), &config), body);
+        // A failed parse leaves the caller's config alone
+        assertConfigEqual(baseConfig(), config, body);
+        for (size_t cut = 0; cut <= json.size(); cut++) {
+            ConfigBodyParser parser = feedSplit(json, cut);
+            TEST_ASSERT_EQUAL_MESSAGE(BODY_INVALID, parser.finish(), body);
+        }
+        ConfigBodyParser parser = feedBytewise(json);
+        TEST_ASSERT_EQUAL_MESSAGE(BODY_INVALID, parser.finish(), body);
+    }
+}
+
+void test_truncated_bodies_are_invalid(void) {
+    for (const ValidBody& body : VALID_BODIES) {
+        std::string json = body.json;
+        size_t end = json.rfind('}');
+        for (size_t len = 0; len <= end; len++) {
+            ConfigBodyParser parser(baseConfig());
+            TEST_ASSERT_EQUAL_MESSAGE(BODY_INCOMPLETE, parser.feed((const uint8_t*)json.data(), len),
+                                      body.json);
+            TEST_ASSERT_EQUAL_MESSAGE(BODY_INVALID, parser.finish(), body.json);
+            HubConfig config = baseConfig();
+            TEST_ASSERT_EQUAL_MESSAGE(BODY_INVALID,
+                                      ConfigBodyParser::parse((const uint8_t*)json.data(), len, &config),
+                                      body.json);
+            assertConfigEqual(baseConfig(), config, body.json);
+        }
+    }
+}
+
+// A valid body padded to exactly len bytes with an unknown string
+static std::string paddedBody(size_t len) {
+    std::string head = "{\"hub_id\":\"H-9\",\"pad\":\"";
+    std::string tail = "\"}";
+    return head + std::string(len - head.size() - tail.size(), 'x') + tail;
+}
+
+void test_body_at_limit_is_accepted(void) {
+    std::string json = paddedBody(CONFIG_BODY_MAX);
+    HubConfig expected = baseConfig();
+    setConfigString(expected.hub_id, "H-9");
+    for (size_t cut = 0; cut <= json.size(); cut++) {
+        ConfigBodyParser parser = feedSplit(json, cut);
+        TEST_ASSERT_EQUAL(BODY_DONE, parser.finish());
+        assertConfigEqual(expected, parser.result(), "at CONFIG_BODY_MAX");
+    }
+}
+
+void test_body_over_limit_is_too_large(void) {
+    // Over by one byte of JSON, or by trailing whitespace after a complete body
+    std::string bodies[] = {paddedBody(CONFIG_BODY_MAX + 1), paddedBody(CONFIG_BODY_MAX) + " ",
+                            paddedBody(CONFIG_BODY_MAX * 2)};
+    for (const std::string& json : bodies) {
+        for (size_t cut = 0; cut <= json.size(); cut++) {
+            ConfigBodyParser parser = feedSplit(json, cut);
+            TEST_ASSERT_EQUAL(BODY_TOO_LARGE, parser.status());
+            TEST_ASSERT_EQUAL(BODY_TOO_LARGE, parser.finish());
+        }
+        ConfigBodyParser parser = feedBytewise(json);
+        TEST_ASSERT_EQUAL(BODY_TOO_LARGE, parser.finish());
+        HubConfig config = baseConfig();
+        TEST_ASSERT_EQUAL(BODY_TOO_LARGE, ConfigBodyParser::parse((const uint8_t*)json.data(), json.size(), &config));
+        assertConfigEqual(baseConfig(), config, "over CONFIG_BODY_MAX");
+    }
+}
+
+void test_feed_reports_too_large_at_the_first_byte_over(void) {
+    std::string json = paddedBody(CONFIG_BODY_MAX + 1);
+    ConfigBodyParser parser(baseConfig());
+    TEST_ASSERT_EQUAL(BODY_INCOMPLETE, parser.feed((const uint8_t*)json.data(), CONFIG_BODY_MAX));
+    TEST_ASSERT_EQUAL(BODY_TOO_LARGE, parser.feed((const uint8_t*)json.data() + CONFIG_BODY_MAX, 1));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_valid_bodies_whole);
+    RUN_TEST(test_valid_bodies_split_anywhere);
+    RUN_TEST(test_invalid_bodies_split_anywhere);
+    RUN_TEST(test_truncated_bodies_are_invalid);
+    RUN_TEST(test_body_at_limit_is_accepted);
+    RUN_TEST(test_body_over_limit_is_too_large);
+    RUN_TEST(test_feed_reports_too_large_at_the_first_byte_over);
+    return UNITY_END();
+}
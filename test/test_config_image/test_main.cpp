@@ -0,0 +1,292 @@
+// ConfigImageStore against torn writes: a save cut at every byte of either
+// slot must leave the previous config loadable, picked by CRC and sequence
+
+#include <unity.h>
+#include <vector>
+#include "config.h"
+#include "config_image.h"
+
+static const size_t IMAGE_SIZE = sizeof(ConfigImageHeader) + sizeof(HubConfig);
+
+// Slots in RAM. A write cut at tearAt bytes stops there, as a power cut
+// would: a file store truncates first and keeps only the new prefix, an
+// in-place store keeps the old bytes after it.
+class TornSlotStore : public ConfigSlotStore {
+public:
+    std::vector<uint8_t> slot[CONFIG_SLOT_COUNT];
+    long tearAt = -1;           // -1: writes complete
+    bool inPlace = false;
+    std::vector<uint8_t> intended;  // What the last write was given
+    uint8_t lastSlot = 0;
+
+    const char* name() const override { return "RAM"; }
+    size_t read(uint8_t index, uint8_t* buffer, size_t len) override {
+        size_t n = slot[index].size() < len ? slot[index].size() : len;
+        if (n > 0) {
+            memcpy(buffer, slot[index].data(), n);
+        }
+        return n;
+    }
+    // The last write's slot holds all it was given, torn or not
+    bool landed() const { return slot[lastSlot] == intended; }
+    bool write(uint8_t index, const uint8_t* data, size_t len) override {
+        intended.assign(data, data + len);
+        lastSlot = index;
+        size_t n = tearAt >= 0 && (size_t)tearAt < len ? (size_t)tearAt : len;
+        if (!inPlace || slot[index].size() < n) {
+            slot[index].resize(inPlace ? len : n);
+        }
+        if (n > 0) {
+            memcpy(slot[index].data(), data, n);
+        }
+        return true;
+    }
+};
+
+static HubConfig named(const char* hubId) {
+    HubConfig config;
+    setConfigString(config.hub_id, hubId);
+    setConfigString(config.mqtt_server, "broker.local");
+    config.mqtt_port = 8883;
+    return config;
+}
+
+// What a fresh boot would load
+static bool reboot(ConfigSlotStore* slots, HubConfig* out, int8_t* slot = nullptr, uint32_t* sequence = nullptr) {
+    ConfigImageStore store(slots);
+    bool ok = store.load(out);
+    if (slot) *slot = store.getActiveSlot();
+    if (sequence) *sequence = store.getSequence();
+    return ok;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void test_commits_alternate_slots(void) {
+    TornSlotStore slots;
+    ConfigImageStore store(&slots);
+    HubConfig loaded;
+    TEST_ASSERT_FALSE(store.load(&loaded));
+    TEST_ASSERT_TRUE(store.commit(named("H-1")));
+    TEST_ASSERT_EQUAL_INT8(0, store.getActiveSlot());
+    TEST_ASSERT_TRUE(store.commit(named("H-2")));
+    TEST_ASSERT_EQUAL_INT8(1, store.getActiveSlot());
+    TEST_ASSERT_TRUE(store.commit(named("H-3")));
+    TEST_ASSERT_EQUAL_INT8(0, store.getActiveSlot());
+    TEST_ASSERT_EQUAL_UINT32(3, store.getSequence());
+
+    int8_t slot;
+    TEST_ASSERT_TRUE(reboot(&slots, &loaded, &slot));
+    TEST_ASSERT_EQUAL_STRING("H-3", loaded.hub_id);
+    TEST_ASSERT_EQUAL_INT(8883, loaded.mqtt_port);
+    TEST_ASSERT_EQUAL_INT8(0, slot);
+}
+
+// Two good images, then a third cut at every byte on its way into either
+// slot. A cut at the full length is a complete write, and so is an in-place
+// cut past the last byte that differs from the old image.
+static void tearEverywhere(bool inPlace) {
+    for (uint8_t first = 0; first < CONFIG_SLOT_COUNT; first++) {
+        for (size_t cut = 0; cut <= IMAGE_SIZE; cut++) {
+            TornSlotStore slots;
+            slots.inPlace = inPlace;
+            ConfigImageStore store(&slots);
+            // first == 1 puts the newest good image in slot 0, so the torn
+            // write goes to slot 1
+            for (uint8_t i = 0; i <= first + 1; i++) {
+                char id[8];
+                snprintf(id, sizeof(id), "H-%u", i);
+                TEST_ASSERT_TRUE(store.commit(named(id)));
+            }
+            int8_t goodSlot = store.getActiveSlot();
+            uint32_t goodSequence = store.getSequence();
+            char goodId[8];
+            snprintf(goodId, sizeof(goodId), "H-%u", first + 1);
+
+            slots.tearAt = (long)cut;
+            bool committed = store.commit(named("H-new"));
+            bool complete = slots.landed();
+            TEST_ASSERT_EQUAL(complete, committed);
+            if (!inPlace) {
+                TEST_ASSERT_EQUAL(cut == IMAGE_SIZE, complete);
+            }
+
+            HubConfig loaded;
+            int8_t slot;
+            uint32_t sequence;
+            char message[48];
+            snprintf(message, sizeof(message), "slot %d cut at %u", 1 - goodSlot, (unsigned)cut);
+            TEST_ASSERT_TRUE_MESSAGE(reboot(&slots, &loaded, &slot, &sequence), message);
+            if (complete) {
+                TEST_ASSERT_EQUAL_STRING_MESSAGE("H-new", loaded.hub_id, message);
+                TEST_ASSERT_EQUAL_UINT32_MESSAGE(goodSequence + 1, sequence, message);
+            } else {
+                TEST_ASSERT_EQUAL_STRING_MESSAGE(goodId, loaded.hub_id, message);
+                TEST_ASSERT_EQUAL_INT_MESSAGE(goodSlot, slot, message);
+                TEST_ASSERT_EQUAL_UINT32_MESSAGE(goodSequence, sequence, message);
+
+                // The next save overwrites the torn slot and wins
+                slots.tearAt = -1;
+                ConfigImageStore after(&slots);
+                TEST_ASSERT_TRUE(after.commit(named("H-retry")));
+                TEST_ASSERT_TRUE(reboot(&slots, &loaded));
+                TEST_ASSERT_EQUAL_STRING_MESSAGE("H-retry", loaded.hub_id, message);
+            }
+        }
+    }
+}
+
+static void test_torn_write_truncated_file(void) {
+    tearEverywhere(false);
+}
+
+static void test_torn_write_in_place(void) {
+    tearEverywhere(true);
+}
+
+// Rewrites a slot's sequence and CRC
+static void setSequence(TornSlotStore& slots, uint8_t index, uint32_t sequence) {
+    ConfigImageHeader header;
+    uint8_t* image = slots.slot[index].data();
+    memcpy(&header, image, sizeof(header));
+    header.sequence = sequence;
+    memcpy(image, &header, sizeof(header));
+    header.crc = crc32(image + sizeof(header), header.length, crc32(image, offsetof(ConfigImageHeader, crc)));
+    memcpy(image, &header, sizeof(header));
+}
+
+static void test_newest_sequence_wins_across_wrap(void) {
+    TornSlotStore slots;
+    ConfigImageStore store(&slots);
+    TEST_ASSERT_TRUE(store.commit(named("H-old")));
+    TEST_ASSERT_TRUE(store.commit(named("H-new")));
+    // Sequences around the wrap: 0xFFFFFFFF in slot 0, 0 in slot 1
+    setSequence(slots, 0, 0xFFFFFFFF);
+    setSequence(slots, 1, 0);
+
+    HubConfig loaded;
+    int8_t slot;
+    TEST_ASSERT_TRUE(reboot(&slots, &loaded, &slot));
+    TEST_ASSERT_EQUAL_INT8(1, slot);
+    TEST_ASSERT_EQUAL_STRING("H-new", loaded.hub_id);
+}
+
+static void test_crc_mismatch_falls_back(void) {
+    TornSlotStore slots;
+    ConfigImageStore store(&slots);
+    TEST_ASSERT_TRUE(store.commit(named("H-old")));
+    TEST_ASSERT_TRUE(store.commit(named("H-new")));
+    // One flipped bit anywhere in the newer payload
+    for (size_t i = sizeof(ConfigImageHeader); i < IMAGE_SIZE; i++) {
+        slots.slot[1][i] ^= 0x10;
+        HubConfig loaded;
+        TEST_ASSERT_TRUE(reboot(&slots, &loaded));
+        TEST_ASSERT_EQUAL_STRING("H-old", loaded.hub_id);
+        slots.slot[1][i] ^= 0x10;
+    }
+}
+
+static void test_both_slots_corrupt(void) {
+    TornSlotStore slots;
+    ConfigImageStore store(&slots);
+    TEST_ASSERT_TRUE(store.commit(named("H-1")));
+    TEST_ASSERT_TRUE(store.commit(named("H-2")));
+    slots.slot[0][sizeof(ConfigImageHeader)] ^= 0xFF;
+    slots.slot[1][0] ^= 0xFF;   // Magic
+    HubConfig loaded;
+    int8_t slot;
+    TEST_ASSERT_FALSE(reboot(&slots, &loaded, &slot));
+    TEST_ASSERT_EQUAL_INT8(-1, slot);
+
+    // Saving again starts over in slot 0
+    ConfigImageStore after(&slots);
+    TEST_ASSERT_TRUE(after.commit(named("H-3")));
+    TEST_ASSERT_EQUAL_INT8(0, after.getActiveSlot());
+    TEST_ASSERT_EQUAL_UINT32(1, after.getSequence());
+    TEST_ASSERT_TRUE(reboot(&slots, &loaded));
+    TEST_ASSERT_EQUAL_STRING("H-3", loaded.hub_id);
+}
+
+// Rewrites a slot's version and CRC, as firmware writing that version would
+static void setVersion(TornSlotStore& slots, uint8_t index, uint16_t version) {
+    ConfigImageHeader header;
+    uint8_t* image = slots.slot[index].data();
+    memcpy(&header, image, sizeof(header));
+    header.version = version;
+    memcpy(image, &header, sizeof(header));
+    header.crc = crc32(image + sizeof(header), header.length, crc32(image, offsetof(ConfigImageHeader, crc)));
+    memcpy(image, &header, sizeof(header));
+}
+
+static void test_unknown_version_is_skipped(void) {
+    TornSlotStore slots;
+    ConfigImageStore store(&slots);
+    TEST_ASSERT_TRUE(store.commit(named("H-old")));
+    TEST_ASSERT_TRUE(store.commit(named("H-future")));
+    setVersion(slots, 1, CONFIG_IMAGE_VERSION + 1);
+    HubConfig loaded;
+    int8_t slot;
+    TEST_ASSERT_TRUE(reboot(&slots, &loaded, &slot));
+    TEST_ASSERT_EQUAL_INT8(0, slot);
+    TEST_ASSERT_EQUAL_STRING("H-old", loaded.hub_id);
+
+    setVersion(slots, 0, 0);
+    TEST_ASSERT_FALSE(reboot(&slots, &loaded));
+}
+
+static void test_version_1_image_loads(void) {
+    // CRC over the payload only, as the first image format had it
+    TornSlotStore slots;
+    HubConfig old = named("H-v1");
+    ConfigImageHeader header = {CONFIG_IMAGE_MAGIC, 1, (uint16_t)sizeof(HubConfig), 9,
+                                crc32(reinterpret_cast<const uint8_t*>(&old), sizeof(HubConfig))};
+    slots.slot[1].resize(IMAGE_SIZE);
+    memcpy(slots.slot[1].data(), &header, sizeof(header));
+    memcpy(slots.slot[1].data() + sizeof(header), &old, sizeof(HubConfig));
+
+    HubConfig loaded;
+    uint32_t sequence;
+    TEST_ASSERT_TRUE(reboot(&slots, &loaded, nullptr, &sequence));
+    TEST_ASSERT_EQUAL_STRING("H-v1", loaded.hub_id);
+    TEST_ASSERT_EQUAL_UINT32(9, sequence);
+
+    // The next save goes to the other slot in the current format
+    ConfigImageStore store(&slots);
+    TEST_ASSERT_TRUE(store.commit(named("H-v2")));
+    TEST_ASSERT_EQUAL_INT8(0, store.getActiveSlot());
+    memcpy(&header, slots.slot[0].data(), sizeof(header));
+    TEST_ASSERT_EQUAL_UINT16(CONFIG_IMAGE_VERSION, header.version);
+    TEST_ASSERT_EQUAL_UINT32(10, header.sequence);
+}
+
+static void test_shorter_image_gets_defaults(void) {
+    // An older firmware's image without the fields added since
+    TornSlotStore slots;
+    HubConfig old = named("H-7");
+    size_t length = offsetof(HubConfig, hub_id);
+    ConfigImageHeader header = {CONFIG_IMAGE_MAGIC, 1, (uint16_t)length, 5,
+                                crc32(reinterpret_cast<const uint8_t*>(&old), length)};
+    slots.slot[0].resize(sizeof(header) + length);
+    memcpy(slots.slot[0].data(), &header, sizeof(header));
+    memcpy(slots.slot[0].data() + sizeof(header), &old, length);
+
+    HubConfig loaded;
+    TEST_ASSERT_TRUE(reboot(&slots, &loaded));
+    TEST_ASSERT_EQUAL_STRING("broker.local", loaded.mqtt_server);
+    TEST_ASSERT_EQUAL_STRING(HubConfig().hub_id, loaded.hub_id);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_commits_alternate_slots);
+    RUN_TEST(test_torn_write_truncated_file);
+    RUN_TEST(test_torn_write_in_place);
+    RUN_TEST(test_newest_sequence_wins_across_wrap);
+    RUN_TEST(test_crc_mismatch_falls_back);
+    RUN_TEST(test_both_slots_corrupt);
+    RUN_TEST(test_unknown_version_is_skipped);
+    RUN_TEST(test_version_1_image_loads);
+    RUN_TEST(test_shorter_image_gets_defaults);
+    return UNITY_END();
+}
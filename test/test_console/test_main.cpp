@@ -0,0 +1,295 @@
+// The console fed raw terminal bytes: line editing, CR, LF and CRLF,
+// escape sequences, overlong lines, quoted arguments and dispatch to the
+// registry. A script fed in any chunking must run the same commands.
+
+#include <unity.h>
+#include <string>
+#include <vector>
+#include "console.h"
+
+// Terminal on the other end: bytes typed in, everything printed kept
+class Terminal : public Stream {
+public:
+    std::string input;
+    size_t pos = 0;
+    std::string output;
+
+    void type(const std::string& bytes) { input += bytes; }
+    int available() override { return (int)(input.size() - pos); }
+    int read() override { return pos < input.size() ? (uint8_t)input[pos++] : -1; }
+    int peek() override { return pos < input.size() ? (uint8_t)input[pos] : -1; }
+    size_t write(uint8_t byte) override {
+        output += (char)byte;
+        return 1;
+    }
+};
+
+// What the handlers were called with, one "name:args" per call
+static std::vector<std::string> calls;
+
+static void echoCommand(const char* args, size_t length, Print& out) {
+    calls.push_back("echo:" + std::string(args, length));
+    char word[16];
+    while (length > 0) {
+        CommandRegistry::nextWord(args, length, word, sizeof(word));
+        out.printf("[%s]", word);
+    }
+    out.print("\r\n");
+}
+
+// No line end of its own, like the JSON answers
+static void rawCommand(const char* args, size_t length, Print& out) {
+    calls.push_back("raw:" + std::string(args, length));
+    out.write((const uint8_t*)args, length);
+}
+
+static void mqttCommand(const char* args, size_t length, Print& out) {
+    calls.push_back("mqtt:" + std::string(args, length));
+}
+
+static const CommandSpec COMMANDS[] = {
+    {"echo", echoCommand, CMD_ANY, "prints its words"},
+    {"raw", rawCommand, CMD_CONSOLE, "prints its arguments as typed"},
+    {"mqttonly", mqttCommand, CMD_MQTT, "not on the console"},
+};
+
+static const CommandRegistry registry(COMMANDS, sizeof(COMMANDS) / sizeof(COMMANDS[0]));
+
+static uint32_t rngState;
+
+static uint32_t nextRandom() {
+    rngState = rngState * 1664525u + 1013904223u;
+    return rngState >> 8;
+}
+
+static uint8_t typeInto(Console& console, const std::string& bytes) {
+    return console.feed((const uint8_t*)bytes.data(), bytes.size());
+}
+
+static void assertCalls(const std::vector<std::string>& expected) {
+    TEST_ASSERT_EQUAL(expected.size(), calls.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        TEST_ASSERT_EQUAL_STRING(expected[i].c_str(), calls[i].c_str());
+    }
+}
+
+void setUp(void) {
+    calls.clear();
+    rngState = 77;
+}
+
+void tearDown(void) {}
+
+void test_line_endings(void) {
+    Terminal terminal;
+    Console console(&terminal, &registry, false);
+    TEST_ASSERT_EQUAL(1, typeInto(console, "echo cr\r"));
+    TEST_ASSERT_EQUAL(1, typeInto(console, "echo lf\n"));
+    TEST_ASSERT_EQUAL(1, typeInto(console, "echo crlf\r\n"));
+    // The LF of a CRLF ends nothing, a second LF ends an empty line
+    TEST_ASSERT_EQUAL(0, typeInto(console, "\r\n\n\r\r"));
+    // CRLF split across two reads
+    TEST_ASSERT_EQUAL(1, typeInto(console, "echo split\r"));
+    TEST_ASSERT_EQUAL(1, typeInto(console, "\necho next\n"));
+    // LF CR is two line ends, the second ending an empty line
+    TEST_ASSERT_EQUAL(2, typeInto(console, "echo lfcr\n\recho after\r"));
+    assertCalls({"echo:cr", "echo:lf", "echo:crlf", "echo:split", "echo:next", "echo:lfcr", "echo:after"});
+    TEST_ASSERT_EQUAL_UINT32(7, console.getStats().lines);
+    TEST_ASSERT_EQUAL_UINT32(0, console.getStats().unknown);
+}
+
+void test_echo_and_line_editing(void) {
+    Terminal terminal;
+    Console console(&terminal, &registry, true);
+    // Backspace and DEL take back a character each
+    typeInto(console, "ecx\bho ab\x7F\x7F" "cd\r");
+    assertCalls({"echo:cd"});
+    TEST_ASSERT_EQUAL_STRING("ecx\b \bho ab\b \b\b \bcd\r\n[cd]\r\n", terminal.output.c_str());
+
+    // Nothing to take back on an empty line
+    terminal.output.clear();
+    typeInto(console, "\b\b\r");
+    TEST_ASSERT_EQUAL_STRING("\r\n", terminal.output.c_str());
+
+    // Ctrl-C and Ctrl-U drop the line, tabs and other controls are ignored
+    calls.clear();
+    typeInto(console, "echo gone\x03" "echo also gone\x15" "ec\tho\x01 kept\r");
+    assertCalls({"echo:kept"});
+}
+
+void test_escape_sequences(void) {
+    Terminal terminal;
+    Console console(&terminal, &registry, true);
+    typeInto(console, "echo first\r");
+    // Up arrow recalls the last line, CSI and SS3 forms alike
+    TEST_ASSERT_EQUAL(1, typeInto(console, "\x1B[A\r"));
+    TEST_ASSERT_EQUAL(1, typeInto(console, "junk\x1BOA\r"));
+    // Arrows with parameters and other sequences leave no trace
+    TEST_ASSERT_EQUAL(1, typeInto(console, "echo \x1B[1;5Cx\x1B[D\x1B[3~\x1BOPy\x1Bz\r"));
+    assertCalls({"echo:first", "echo:first", "echo:first", "echo:xy"});
+    // Recalling over what was typed wipes it on the terminal
+    terminal.output.clear();
+    typeInto(console, "ab\x1B[A");
+    TEST_ASSERT_EQUAL_STRING("ab\b \b\b \becho xy", terminal.output.c_str());
+}
+
+void test_overlong_lines(void) {
+    Terminal terminal;
+    Console console(&terminal, &registry, false);
+    // CONSOLE_LINE_MAX - 1 characters fit exactly
+    std::string longest = "raw " + std::string(CONSOLE_LINE_MAX - 1 - 4, 'a');
+    TEST_ASSERT_EQUAL(1, typeInto(console, longest + "\r"));
+    assertCalls({"raw:" + longest.substr(4)});
+    TEST_ASSERT_EQUAL_UINT32(0, console.getOverflows());
+
+    // One more and the whole line is dropped, backspace can't bring it back
+    calls.clear();
+    terminal.output.clear();
+    TEST_ASSERT_EQUAL(0, typeInto(console, longest + "bb\b\b\b\r"));
+    TEST_ASSERT_EQUAL(0, calls.size());
+    TEST_ASSERT_EQUAL_STRING("Line too long, ignored\r\n", terminal.output.c_str());
+    TEST_ASSERT_EQUAL_UINT32(1, console.getOverflows());
+
+    // Far over is one overflow, and neither becomes the line to recall
+    TEST_ASSERT_EQUAL(0, typeInto(console, std::string(5 * CONSOLE_LINE_MAX, 'x') + "\n"));
+    TEST_ASSERT_EQUAL_UINT32(2, console.getOverflows());
+    TEST_ASSERT_EQUAL(1, typeInto(console, "\x1B[A\r"));
+    assertCalls({"raw:" + longest.substr(4)});
+
+    // Ctrl-C after an overflow starts a clean line
+    calls.clear();
+    TEST_ASSERT_EQUAL(1, typeInto(console, std::string(CONSOLE_LINE_MAX, 'x') + "\x03" + "echo ok\r"));
+    assertCalls({"echo:ok"});
+}
+
+void test_quoted_arguments(void) {
+    Terminal terminal;
+    Console console(&terminal, &registry, false);
+    typeInto(console, "echo \"My Net\" pass\r");
+    typeInto(console, "echo   a   \"b  c\"\"d\" \"\" e  \r");
+    typeInto(console, "echo \"unclosed quote\r");
+    typeInto(console, "echo \"a longer quoted word than fits\" z\r");
+    TEST_ASSERT_EQUAL_STRING("[My Net][pass]\r\n"
+                             "[a][b  c][d][][e]\r\n"
+                             "[unclosed quote]\r\n"
+                             "[a longer quoted][z]\r\n",
+                             terminal.output.c_str());
+
+    // nextWord on its own: the quotes are not in the word or its length
+    const char* args = "\"x y\" z";
+    size_t length = strlen(args);
+    char word[8];
+    TEST_ASSERT_EQUAL(3, CommandRegistry::nextWord(args, length, word, sizeof(word)));
+    TEST_ASSERT_EQUAL_STRING("x y", word);
+    TEST_ASSERT_EQUAL(1, CommandRegistry::nextWord(args, length, word, sizeof(word)));
+    TEST_ASSERT_EQUAL_STRING("z", word);
+    TEST_ASSERT_EQUAL(0, CommandRegistry::nextWord(args, length, word, sizeof(word)));
+    TEST_ASSERT_EQUAL(0, length);
+}
+
+void test_dispatch(void) {
+    Terminal terminal;
+    Console console(&terminal, &registry, false);
+    TEST_ASSERT_EQUAL(1, typeInto(console, "   echo  spaced out   \r"));
+    TEST_ASSERT_EQUAL(0, typeInto(console, "ech o\r"));
+    TEST_ASSERT_EQUAL(0, typeInto(console, "echoo\r"));
+    TEST_ASSERT_EQUAL(0, typeInto(console, "ECHO\r"));
+    // Registered, but not for the console
+    TEST_ASSERT_EQUAL(0, typeInto(console, "mqttonly x\r"));
+    TEST_ASSERT_EQUAL(1, typeInto(console, "raw {\"ok\":true}\r"));
+    TEST_ASSERT_EQUAL(2, typeInto(console, "echo\rraw\r"));
+    assertCalls({"echo:spaced out", "raw:{\"ok\":true}", "echo:", "raw:"});
+    TEST_ASSERT_EQUAL_STRING("[spaced][out]\r\n"
+                             "Unknown command: ech o (try help)\r\n"
+                             "Unknown command: echoo (try help)\r\n"
+                             "Unknown command: ECHO (try help)\r\n"
+                             "Unknown command: mqttonly x (try help)\r\n"
+                             "{\"ok\":true}\r\n"      // Line end added after output without one
+                             "\r\n",                    // None after no output
+                             terminal.output.c_str());
+    TEST_ASSERT_EQUAL_UINT32(8, console.getStats().lines);
+    TEST_ASSERT_EQUAL_UINT32(4, console.getStats().unknown);
+
+    // The same table from MQTT
+    calls.clear();
+    TEST_ASSERT_TRUE(registry.runLine("mqttonly x", 10, CMD_MQTT, terminal));
+    TEST_ASSERT_FALSE(registry.runLine("raw x", 5, CMD_MQTT, terminal));
+    TEST_ASSERT_TRUE(registry.run("echo", "a b", 3, CMD_MQTT, terminal));
+    assertCalls({"mqtt:x", "echo:a b"});
+}
+
+// poll() reads what is there and no more than CONSOLE_LINE_MAX bytes a
+// call; a line typed across several polls runs once it ends
+void test_poll_reads_without_waiting(void) {
+    Terminal terminal;
+    Console console(&terminal, &registry, false);
+    TEST_ASSERT_EQUAL(0, console.poll());
+    terminal.type("ec");
+    TEST_ASSERT_EQUAL(0, console.poll());
+    terminal.type("ho one\r\necho two\n");
+    TEST_ASSERT_EQUAL(2, console.poll());
+    TEST_ASSERT_EQUAL(0, terminal.available());
+
+    std::string paste;
+    for (int i = 0; i < 40; i++) {
+        paste += "echo " + std::to_string(i) + "\r\n";
+    }
+    terminal.type(paste);
+    uint32_t ran = 0;
+    int polls = 0;
+    while (terminal.available() > 0) {
+        size_t before = terminal.pos;
+        ran += console.poll();
+        TEST_ASSERT_TRUE(terminal.pos - before <= CONSOLE_LINE_MAX);
+        polls++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(40, ran);
+    TEST_ASSERT_TRUE(polls > 1);
+    TEST_ASSERT_EQUAL(42, calls.size());
+    TEST_ASSERT_EQUAL_STRING("echo:39", calls.back().c_str());
+}
+
+// A session with every kind of input, fed whole, byte by byte and in
+// random chunks, echo on: the same commands and the same terminal output
+void test_any_chunking_runs_the_same(void) {
+    std::string script = "echo a\r\nec\bcho b\r\x1B[A\n\r\nraw x\x03"
+                         "raw \"q r\"\r" + std::string(CONSOLE_LINE_MAX + 3, 'z') + "\r\n"
+                         "nope\necho \x1B[1;2Dc \"d e\"\r\r\n\x1B[A\r";
+    Terminal wholeTerminal;
+    Console whole(&wholeTerminal, &registry, true);
+    uint8_t ran = typeInto(whole, script);
+    std::vector<std::string> expected = calls;
+    TEST_ASSERT_EQUAL(6, ran);
+    assertCalls({"echo:a", "echo:b", "echo:b", "raw:\"q r\"", "echo:c \"d e\"", "echo:c \"d e\""});
+
+    for (int trial = 0; trial < 50; trial++) {
+        calls.clear();
+        Terminal terminal;
+        Console console(&terminal, &registry, true);
+        size_t pos = 0;
+        uint32_t total = 0;
+        while (pos < script.size()) {
+            size_t chunk = trial == 0 ? 1 : 1 + nextRandom() % 12;
+            if (chunk > script.size() - pos) chunk = script.size() - pos;
+            total += typeInto(console, script.substr(pos, chunk));
+            pos += chunk;
+        }
+        TEST_ASSERT_EQUAL_UINT32(ran, total);
+        assertCalls(expected);
+        TEST_ASSERT_EQUAL_STRING(wholeTerminal.output.c_str(), terminal.output.c_str());
+        TEST_ASSERT_EQUAL_UINT32(whole.getOverflows(), console.getOverflows());
+    }
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_line_endings);
+    RUN_TEST(test_echo_and_line_editing);
+    RUN_TEST(test_escape_sequences);
+    RUN_TEST(test_overlong_lines);
+    RUN_TEST(test_quoted_arguments);
+    RUN_TEST(test_dispatch);
+    RUN_TEST(test_poll_reads_without_waiting);
+    RUN_TEST(test_any_chunking_runs_the_same);
+    return UNITY_END();
+}
@@ -0,0 +1,581 @@
+// DownlinkQueue against a simulated ESP-NOW hub on the other end of the
+// UART. The peer drops, repeats and delays its acks; the queue must resend
+// on the doubling timeout, give up after DOWNLINK_ATTEMPTS sends, match
+// acks by id, and the readings sharing the RX stream with the acks must all
+// come through the frame decoder
+
+#include <unity.h>
+#include <string.h>
+#include <map>
+#include <vector>
+#include "downlink.h"
+#include "sensor_frame.h"
+#include "sensor_schema.h"
+
+static uint32_t rngState;
+
+static uint32_t nextRandom() {
+    rngState = rngState * 1664525u + 1013904223u;
+    return rngState >> 8;
+}
+
+// send() stamps commands with millis(), so simulated time runs on from the
+// real clock: advance() moves it ahead, and the few real ms a test takes
+// stay well inside the margins below
+static uint32_t skewMs;
+
+static uint32_t now() {
+    return (uint32_t)millis() + skewMs;
+}
+
+static void advance(uint32_t ms) {
+    skewMs += ms;
+}
+
+// The hub's TX: each write() from poll() is one whole frame
+class WirePort : public HalSerialPort {
+public:
+    std::vector<std::vector<uint8_t>> frames;
+
+    bool begin(long baud, int8_t rxPin, int8_t txPin) override { return true; }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    size_t readBytes(uint8_t* buffer, size_t len) override { return 0; }
+    bool waitForData(uint32_t timeoutMs) override { return false; }
+    size_t write(const uint8_t* buffer, size_t len) override {
+        frames.emplace_back(buffer, buffer + len);
+        return len;
+    }
+    void flush() override {}
+    void setTimeout(uint32_t timeoutMs) override {}
+};
+
+struct Command {
+    uint16_t id;
+    uint8_t command;
+    char nodeID[SENSOR_NODE_ID_SIZE];
+    uint8_t args[DOWNLINK_MAX_ARGS];
+    uint8_t argsLength;
+};
+
+// Parses a command frame as the ESP-NOW hub would, false if it isn't one
+static bool parseCommand(const std::vector<uint8_t>& frame, Command& command) {
+    if (frame.size() < SENSOR_FRAME_HEADER + 4 + 2 || frame[0] != SENSOR_FRAME_SYNC0 ||
+        frame[1] != SENSOR_FRAME_SYNC1 || frame[2] != SENSOR_FRAME_VERSION ||
+        frame[3] != DOWNLINK_FRAME_COMMAND || frame.size() != SENSOR_FRAME_HEADER + frame[4] + 2u) {
+        return false;
+    }
+    size_t length = frame[4];
+    uint16_t crc = crc16(frame.data() + 2, SENSOR_FRAME_HEADER - 2 + length);
+    if (frame[SENSOR_FRAME_HEADER + length] != (crc & 0xFF) || frame[SENSOR_FRAME_HEADER + length + 1] != crc >> 8) {
+        return false;
+    }
+    const uint8_t* body = frame.data() + SENSOR_FRAME_HEADER;
+    uint8_t idLength = body[3];
+    if (idLength >= SENSOR_NODE_ID_SIZE || 4u + idLength > length) {
+        return false;
+    }
+    command.id = body[0] | (uint16_t)body[1] << 8;
+    command.command = body[2];
+    memset(command.nodeID, 0, sizeof(command.nodeID));
+    memcpy(command.nodeID, body + 4, idLength);
+    command.argsLength = length - 4 - idLength;
+    memcpy(command.args, body + 4 + idLength, command.argsLength);
+    return true;
+}
+
+static std::vector<uint8_t> ackFrame(uint16_t id, uint8_t status) {
+    uint8_t body[3] = {(uint8_t)(id & 0xFF), (uint8_t)(id >> 8), status};
+    uint8_t frame[SENSOR_FRAME_HEADER + sizeof(body) + 2];
+    size_t length = encodeControlFrame(DOWNLINK_FRAME_ACK, body, sizeof(body), frame, sizeof(frame));
+    return std::vector<uint8_t>(frame, frame + length);
+}
+
+// The ESP-NOW hub. Runs each id once, acks a repeat again with the same
+// status, and lets the test decide what happens to each ack.
+struct Peer {
+    enum Fate { DELIVER, DROP, DUPLICATE };
+
+    std::vector<Command> received;      // Every frame, repeats included
+    std::map<uint16_t, uint8_t> runs;   // Times each id was acted on
+    std::map<uint16_t, uint8_t> statusOf;
+    uint8_t status = DL_STATUS_OK;      // For ids seen the first time
+    Fate (*fate)(const Command& command) = nullptr;
+    uint32_t delayMs = 0;               // Before an ack reaches the UART
+    struct Pending {
+        uint32_t dueMs;
+        std::vector<uint8_t> frame;
+    };
+    std::vector<Pending> acks;
+    uint32_t badFrames = 0;
+
+    void take(WirePort& port, uint32_t nowMs) {
+        for (const std::vector<uint8_t>& frame : port.frames) {
+            Command command;
+            if (!parseCommand(frame, command)) {
+                badFrames++;
+                continue;
+            }
+            received.push_back(command);
+            if (statusOf.count(command.id) == 0) {
+                statusOf[command.id] = status;
+                runs[command.id]++;
+            }
+            Fate what = fate ? fate(command) : DELIVER;
+            if (what == DROP) continue;
+            std::vector<uint8_t> ack = ackFrame(command.id, statusOf[command.id]);
+            acks.push_back({nowMs + delayMs, ack});
+            if (what == DUPLICATE) {
+                acks.push_back({nowMs + delayMs + 1, ack});
+            }
+        }
+        port.frames.clear();
+    }
+
+    // Acks due by nowMs onto the hub's RX stream, in order
+    void deliver(std::vector<uint8_t>& rx, uint32_t nowMs) {
+        for (auto it = acks.begin(); it != acks.end();) {
+            if ((int32_t)(nowMs - it->dueMs) >= 0) {
+                rx.insert(rx.end(), it->frame.begin(), it->frame.end());
+                it = acks.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+};
+
+// The hub's side of the UART: ingest frames and acks through one decoder,
+// the acks going to the queue at simulated time like controlHandler does
+struct Hub {
+    WirePort port;
+    DownlinkQueue queue{&port};
+    FrameDecoder decoder;
+    uint32_t nowMs = 0;
+    std::vector<SensorReading> readings;
+
+    Hub() { decoder.setControlHandler(onControl, this); }
+
+    static void onControl(uint8_t type, const uint8_t* body, size_t length, void* context) {
+        Hub* hub = static_cast<Hub*>(context);
+        if (type == DOWNLINK_FRAME_ACK) {
+            hub->queue.onAck(body, length, hub->nowMs);
+        }
+    }
+
+    // rx in random chunks, as the UART driver hands them over
+    void receive(std::vector<uint8_t>& rx) {
+        size_t pos = 0;
+        while (pos < rx.size()) {
+            size_t chunk = 1 + nextRandom() % 48;
+            if (chunk > rx.size() - pos) chunk = rx.size() - pos;
+            size_t end = pos + chunk;
+            while (pos < end) {
+                SensorReading reading;
+                bool decoded = false;
+                pos += decoder.feed(rx.data() + pos, end - pos, reading, decoded);
+                if (decoded) readings.push_back(reading);
+            }
+        }
+        rx.clear();
+    }
+
+    // One turn of serialTask: write what is due, the peer answers, the
+    // answers come back
+    void step(Peer& peer, std::vector<uint8_t>& rx) {
+        nowMs = now();
+        queue.poll(nowMs);
+        peer.take(port, nowMs);
+        peer.deliver(rx, nowMs);
+        receive(rx);
+    }
+};
+
+static uint32_t getU32(const uint8_t* in) {
+    return in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+static bool takeOne(Hub& hub, DownlinkResult& result) {
+    bool taken = hub.queue.takeResult(result);
+    if (taken) {
+        DownlinkResult extra;
+        TEST_ASSERT_FALSE_MESSAGE(hub.queue.takeResult(extra), "more than one result");
+    }
+    return taken;
+}
+
+void setUp(void) {
+    rngState = 4242;
+    skewMs = 0;
+}
+
+void tearDown(void) {}
+
+void test_acked_first_time(void) {
+    Hub hub;
+    Peer peer;
+    std::vector<uint8_t> rx;
+    uint16_t id = hub.queue.sendSampleInterval("N07", 900);
+    TEST_ASSERT_NOT_EQUAL(0, id);
+    hub.step(peer, rx);
+
+    TEST_ASSERT_EQUAL(1, peer.received.size());
+    const Command& command = peer.received[0];
+    TEST_ASSERT_EQUAL_UINT16(id, command.id);
+    TEST_ASSERT_EQUAL_UINT8(DL_SAMPLE_INTERVAL, command.command);
+    TEST_ASSERT_EQUAL_STRING("N07", command.nodeID);
+    TEST_ASSERT_EQUAL_UINT8(4, command.argsLength);
+    TEST_ASSERT_EQUAL_UINT32(900, getU32(command.args));
+
+    DownlinkResult result;
+    TEST_ASSERT_TRUE(takeOne(hub, result));
+    TEST_ASSERT_EQUAL_UINT16(id, result.id);
+    TEST_ASSERT_EQUAL_UINT8(DL_STATUS_OK, result.status);
+    TEST_ASSERT_EQUAL_UINT8(1, result.attempts);
+    TEST_ASSERT_EQUAL_STRING("N07", result.nodeID);
+    TEST_ASSERT_EQUAL(0, hub.queue.pending());
+    const DownlinkStats& stats = hub.queue.getStats();
+    TEST_ASSERT_EQUAL_UINT32(1, stats.frames);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.resends);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.acked);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.strayAcks);
+}
+
+// Sends at 0, 500, 1500, 3500 and 7500 ms, given up at 15500
+void test_no_ack_resends_with_backoff_then_times_out(void) {
+    Hub hub;
+    Peer peer;
+    peer.fate = [](const Command&) { return Peer::DROP; };
+    std::vector<uint8_t> rx;
+    uint16_t id = hub.queue.sendSampleInterval("N07", 60);
+    hub.step(peer, rx);
+    TEST_ASSERT_EQUAL(1, peer.received.size());
+
+    uint32_t wait = DOWNLINK_ACK_TIMEOUT_MS;
+    for (uint8_t attempt = 2; attempt <= DOWNLINK_ATTEMPTS; attempt++) {
+        advance(wait - 100);
+        hub.step(peer, rx);
+        TEST_ASSERT_EQUAL_MESSAGE(attempt - 1, peer.received.size(), "resent early");
+        advance(100);
+        hub.step(peer, rx);
+        TEST_ASSERT_EQUAL_MESSAGE(attempt, peer.received.size(), "not resent");
+        TEST_ASSERT_EQUAL_UINT16(id, peer.received.back().id);
+        wait *= 2;
+    }
+
+    DownlinkResult result;
+    advance(wait - 100);
+    hub.step(peer, rx);
+    TEST_ASSERT_FALSE(takeOne(hub, result));
+    advance(100);
+    hub.step(peer, rx);
+    TEST_ASSERT_EQUAL(DOWNLINK_ATTEMPTS, peer.received.size());
+    TEST_ASSERT_TRUE(takeOne(hub, result));
+    TEST_ASSERT_EQUAL_UINT16(id, result.id);
+    TEST_ASSERT_EQUAL_UINT8(DL_STATUS_TIMEOUT, result.status);
+    TEST_ASSERT_EQUAL_UINT8(DOWNLINK_ATTEMPTS, result.attempts);
+    TEST_ASSERT_TRUE(result.elapsedMs >= 15500);
+    TEST_ASSERT_EQUAL(0, hub.queue.pending());
+    const DownlinkStats& stats = hub.queue.getStats();
+    TEST_ASSERT_EQUAL_UINT32(DOWNLINK_ATTEMPTS, stats.frames);
+    TEST_ASSERT_EQUAL_UINT32(DOWNLINK_ATTEMPTS - 1, stats.resends);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.timeouts);
+
+    // Nothing more goes out for it
+    advance(60000);
+    hub.step(peer, rx);
+    TEST_ASSERT_EQUAL(DOWNLINK_ATTEMPTS, peer.received.size());
+}
+
+// The first two acks are lost; the third send is acked, and the peer ran
+// the command once
+void test_lost_acks_recovered_by_resend(void) {
+    Hub hub;
+    Peer peer;
+    static int sends;
+    sends = 0;
+    peer.fate = [](const Command&) { return ++sends <= 2 ? Peer::DROP : Peer::DELIVER; };
+    std::vector<uint8_t> rx;
+    uint16_t id = hub.queue.sendSampleInterval("N07", 60);
+    hub.step(peer, rx);
+    advance(DOWNLINK_ACK_TIMEOUT_MS);
+    hub.step(peer, rx);
+    advance(2 * DOWNLINK_ACK_TIMEOUT_MS);
+    hub.step(peer, rx);
+
+    DownlinkResult result;
+    TEST_ASSERT_TRUE(takeOne(hub, result));
+    TEST_ASSERT_EQUAL_UINT16(id, result.id);
+    TEST_ASSERT_EQUAL_UINT8(DL_STATUS_OK, result.status);
+    TEST_ASSERT_EQUAL_UINT8(3, result.attempts);
+    TEST_ASSERT_EQUAL(3, peer.received.size());
+    TEST_ASSERT_EQUAL_UINT8(1, peer.runs[id]);
+    TEST_ASSERT_EQUAL_UINT32(2, hub.queue.getStats().resends);
+}
+
+// A repeated ack, an ack for the first send arriving after the resend, an
+// unknown id and a short body are all stray; none finishes anything twice
+void test_duplicate_late_and_unknown_acks_are_stray(void) {
+    Hub hub;
+    Peer peer;
+    peer.fate = [](const Command&) { return Peer::DUPLICATE; };
+    std::vector<uint8_t> rx;
+    uint16_t first = hub.queue.sendSampleInterval("N07", 60);
+    hub.step(peer, rx);
+    DownlinkResult result;
+    TEST_ASSERT_TRUE(takeOne(hub, result));
+    TEST_ASSERT_EQUAL_UINT16(first, result.id);
+    TEST_ASSERT_EQUAL_UINT32(1, hub.queue.getStats().acked);
+    TEST_ASSERT_EQUAL_UINT32(0, hub.queue.getStats().strayAcks);
+    advance(1);
+    hub.step(peer, rx);
+    TEST_ASSERT_EQUAL_UINT32(1, hub.queue.getStats().strayAcks);
+
+    // The ack takes longer than the timeout: the resend goes out, the late
+    // ack finishes the command and the resend's ack is stray
+    peer.fate = nullptr;
+    peer.delayMs = DOWNLINK_ACK_TIMEOUT_MS + 200;
+    uint16_t second = hub.queue.sendSampleInterval("N08", 60);
+    hub.step(peer, rx);
+    advance(DOWNLINK_ACK_TIMEOUT_MS);
+    hub.step(peer, rx);
+    TEST_ASSERT_EQUAL(3, peer.received.size());
+    TEST_ASSERT_FALSE(takeOne(hub, result));
+    advance(200);
+    hub.step(peer, rx);
+    TEST_ASSERT_TRUE(takeOne(hub, result));
+    TEST_ASSERT_EQUAL_UINT16(second, result.id);
+    TEST_ASSERT_EQUAL_UINT8(2, result.attempts);
+    advance(DOWNLINK_ACK_TIMEOUT_MS);
+    hub.step(peer, rx);
+    TEST_ASSERT_FALSE(takeOne(hub, result));
+    TEST_ASSERT_EQUAL_UINT32(2, hub.queue.getStats().strayAcks);
+    TEST_ASSERT_EQUAL_UINT8(1, peer.runs[second]);
+
+    uint8_t unknown[] = {0x34, 0x12, DL_STATUS_OK};
+    hub.queue.onAck(unknown, sizeof(unknown), now());
+    uint8_t shortBody[] = {(uint8_t)second, 0};
+    hub.queue.onAck(shortBody, sizeof(shortBody), now());
+    TEST_ASSERT_EQUAL_UINT32(4, hub.queue.getStats().strayAcks);
+    TEST_ASSERT_EQUAL_UINT32(2, hub.queue.getStats().acked);
+    TEST_ASSERT_FALSE(takeOne(hub, result));
+}
+
+// Acks out of order, each with its own status, land on their own command;
+// a third command waits for a free in-flight place
+void test_acks_matched_by_id(void) {
+    Hub hub;
+    Peer peer;
+    peer.fate = [](const Command&) { return Peer::DROP; };
+    std::vector<uint8_t> rx;
+    uint16_t ids[3];
+    ids[0] = hub.queue.sendSampleInterval("N01", 10);
+    ids[1] = hub.queue.sendSampleInterval("N02", 20);
+    ids[2] = hub.queue.sendSampleInterval("N03", 30);
+    hub.step(peer, rx);
+    TEST_ASSERT_EQUAL(DOWNLINK_IN_FLIGHT, peer.received.size());
+    TEST_ASSERT_EQUAL_UINT16(ids[0], peer.received[0].id);
+    TEST_ASSERT_EQUAL_UINT16(ids[1], peer.received[1].id);
+
+    std::vector<uint8_t> late = ackFrame(ids[1], DL_STATUS_NO_NODE);
+    std::vector<uint8_t> early = ackFrame(ids[0], DL_STATUS_QUEUED);
+    rx.insert(rx.end(), late.begin(), late.end());
+    hub.receive(rx);
+    DownlinkResult result;
+    TEST_ASSERT_TRUE(takeOne(hub, result));
+    TEST_ASSERT_EQUAL_UINT16(ids[1], result.id);
+    TEST_ASSERT_EQUAL_UINT8(DL_STATUS_NO_NODE, result.status);
+    TEST_ASSERT_EQUAL_STRING("N02", result.nodeID);
+
+    hub.step(peer, rx);
+    TEST_ASSERT_EQUAL(3, peer.received.size());
+    TEST_ASSERT_EQUAL_UINT16(ids[2], peer.received[2].id);
+    TEST_ASSERT_EQUAL_UINT32(30, getU32(peer.received[2].args));
+
+    rx.insert(rx.end(), early.begin(), early.end());
+    std::vector<uint8_t> third = ackFrame(ids[2], DL_STATUS_OK);
+    rx.insert(rx.end(), third.begin(), third.end());
+    hub.receive(rx);
+    TEST_ASSERT_TRUE(hub.queue.takeResult(result));
+    TEST_ASSERT_EQUAL_UINT16(ids[0], result.id);
+    TEST_ASSERT_EQUAL_UINT8(DL_STATUS_QUEUED, result.status);
+    TEST_ASSERT_TRUE(hub.queue.takeResult(result));
+    TEST_ASSERT_EQUAL_UINT16(ids[2], result.id);
+    TEST_ASSERT_EQUAL_UINT8(DL_STATUS_OK, result.status);
+    TEST_ASSERT_EQUAL_UINT32(1, hub.queue.getStats().errors);
+    TEST_ASSERT_EQUAL(0, hub.queue.pending());
+}
+
+// Busy means try again on the timeout, like a lost frame
+void test_busy_is_retried(void) {
+    Hub hub;
+    Peer peer;
+    std::vector<uint8_t> rx;
+    uint16_t id = hub.queue.sendSampleInterval("N07", 60);
+    hub.queue.poll(now());
+    hub.port.frames.clear();
+    std::vector<uint8_t> busy = ackFrame(id, DL_STATUS_BUSY);
+    rx.insert(rx.end(), busy.begin(), busy.end());
+    hub.nowMs = now();
+    hub.receive(rx);
+    DownlinkResult result;
+    TEST_ASSERT_FALSE(takeOne(hub, result));
+
+    advance(DOWNLINK_ACK_TIMEOUT_MS - 100);
+    hub.step(peer, rx);
+    TEST_ASSERT_EQUAL(0, peer.received.size());
+    advance(100);
+    hub.step(peer, rx);
+    TEST_ASSERT_EQUAL(1, peer.received.size());
+    TEST_ASSERT_TRUE(takeOne(hub, result));
+    TEST_ASSERT_EQUAL_UINT8(DL_STATUS_OK, result.status);
+    TEST_ASSERT_EQUAL_UINT8(2, result.attempts);
+}
+
+// Each resend of a time sync carries the time moved on by its wait
+void test_time_sync_moves_on_with_each_resend(void) {
+    Hub hub;
+    Peer peer;
+    peer.fate = [](const Command&) { return Peer::DROP; };
+    std::vector<uint8_t> rx;
+    const uint32_t UTC = 1700000000;
+    hub.queue.sendTimeSync(UTC, -300);
+    hub.step(peer, rx);
+    uint32_t wait = DOWNLINK_ACK_TIMEOUT_MS;
+    for (uint8_t attempt = 2; attempt <= DOWNLINK_ATTEMPTS; attempt++) {
+        advance(wait);
+        hub.step(peer, rx);
+        wait *= 2;
+    }
+    TEST_ASSERT_EQUAL(DOWNLINK_ATTEMPTS, peer.received.size());
+    uint32_t waited = 0;
+    wait = DOWNLINK_ACK_TIMEOUT_MS;
+    for (const Command& command : peer.received) {
+        TEST_ASSERT_EQUAL_STRING("*", command.nodeID);
+        TEST_ASSERT_EQUAL_UINT8(6, command.argsLength);
+        TEST_ASSERT_EQUAL_UINT32(UTC + waited / 1000, getU32(command.args));
+        TEST_ASSERT_EQUAL_INT(-300, (int16_t)(command.args[4] | command.args[5] << 8));
+        waited += wait;
+        wait *= 2;
+    }
+}
+
+static SensorReading randomReading(uint32_t sequence) {
+    SensorReading reading;
+    char nodeID[SENSOR_NODE_ID_SIZE];
+    snprintf(nodeID, sizeof(nodeID), "N%02u", (unsigned)(sequence % 12));
+    initReading(reading, SCHEMA_CLIMATE, nodeID);
+    reading.present = 0x7;
+    ClimateSample& climate = reading.as<ClimateSample>();
+    climate.temp = ((float)(nextRandom() % 80000) - 30000.0f) / 1000.0f;
+    climate.humidity = (float)(nextRandom() % 100000) / 1000.0f;
+    climate.moisture = (float)(nextRandom() % 4096);
+    return reading;
+}
+
+// A minute of ingest at 20 readings a second with commands going out,
+// against a peer that loses, repeats and holds back acks at random. Every
+// reading arrives intact and in order, every command ends exactly once,
+// and whatever finished with an ack has that ack's status.
+void test_random_peer_with_ingest_on_the_same_stream(void) {
+    Hub hub;
+    Peer peer;
+    peer.fate = [](const Command&) {
+        uint32_t roll = nextRandom() % 10;
+        return roll < 3 ? Peer::DROP : roll < 5 ? Peer::DUPLICATE : Peer::DELIVER;
+    };
+    std::vector<uint8_t> rx;
+    std::vector<SensorReading> sent;
+    std::map<uint16_t, uint32_t> intervals;     // What each id asked for
+    std::map<uint16_t, DownlinkResult> results;
+    const char* const NODES[] = {"N01", "N02", "N03", "*"};
+
+    auto drain = [&]() {
+        DownlinkResult result;
+        while (hub.queue.takeResult(result)) {
+            TEST_ASSERT_EQUAL_MESSAGE(0, results.count(result.id), "finished twice");
+            results[result.id] = result;
+        }
+    };
+
+    for (uint32_t step = 0; step < 8000; step++) {
+        if (step < 6000) {
+            if (step % 5 == 0) {
+                SensorReading reading = randomReading(step);
+                uint8_t frame[SENSOR_FRAME_MAX];
+                size_t length = encodeFrame(reading, frame, sizeof(frame));
+                TEST_ASSERT_NOT_EQUAL(0, length);
+                rx.insert(rx.end(), frame, frame + length);
+                sent.push_back(reading);
+            }
+            if (nextRandom() % 40 == 0) {
+                uint32_t seconds = 1 + nextRandom() % 3600;
+                uint16_t id = hub.queue.sendSampleInterval(NODES[nextRandom() % 4], seconds);
+                if (id != 0) intervals[id] = seconds;
+            }
+        }
+        peer.delayMs = nextRandom() % 4 == 0 ? nextRandom() % 1500 : nextRandom() % 30;
+        peer.status = nextRandom() % 8 == 0 ? DL_STATUS_QUEUED : DL_STATUS_OK;
+        hub.step(peer, rx);
+        drain();
+        advance(10);
+    }
+
+    TEST_ASSERT_EQUAL(0, hub.queue.pending());
+    TEST_ASSERT_EQUAL_UINT32(0, peer.badFrames);
+
+    TEST_ASSERT_EQUAL(sent.size(), hub.readings.size());
+    for (size_t i = 0; i < sent.size(); i++) {
+        TEST_ASSERT_EQUAL_STRING(sent[i].nodeID, hub.readings[i].nodeID);
+        TEST_ASSERT_EQUAL_HEX16(sent[i].present, hub.readings[i].present);
+        TEST_ASSERT_EQUAL_MEMORY(sent[i].body, hub.readings[i].body, sizeof(ClimateSample));
+    }
+    const FrameDecoderStats& decoderStats = hub.decoder.getStats();
+    TEST_ASSERT_EQUAL_UINT32(0, decoderStats.crcErrors);
+    TEST_ASSERT_EQUAL_UINT32(0, decoderStats.skippedBytes);
+    TEST_ASSERT_EQUAL_UINT32(0, decoderStats.malformed);
+
+    const DownlinkStats& stats = hub.queue.getStats();
+    TEST_ASSERT_EQUAL(intervals.size(), results.size());
+    TEST_ASSERT_EQUAL_UINT32(stats.queued, results.size());
+    TEST_ASSERT_EQUAL_UINT32(0, stats.resultsDropped);
+    TEST_ASSERT_EQUAL_UINT32(decoderStats.control, stats.acked + stats.strayAcks);
+    TEST_ASSERT_TRUE(stats.resends > 0);
+    TEST_ASSERT_TRUE(stats.strayAcks > 0);
+    uint32_t acked = 0;
+    for (const auto& entry : results) {
+        const DownlinkResult& result = entry.second;
+        TEST_ASSERT_EQUAL_MESSAGE(1, intervals.count(result.id), "result for an id never queued");
+        TEST_ASSERT_TRUE(result.attempts <= DOWNLINK_ATTEMPTS);
+        if (result.status == DL_STATUS_SUPERSEDED) continue;
+        TEST_ASSERT_TRUE(result.attempts >= 1);
+        if (result.status == DL_STATUS_TIMEOUT) {
+            TEST_ASSERT_EQUAL_UINT8(DOWNLINK_ATTEMPTS, result.attempts);
+            continue;
+        }
+        acked++;
+        TEST_ASSERT_EQUAL_UINT8(1, peer.runs[result.id]);
+        TEST_ASSERT_EQUAL_UINT8(peer.statusOf[result.id], result.status);
+    }
+    TEST_ASSERT_TRUE(acked > 0);
+    for (const Command& command : peer.received) {
+        TEST_ASSERT_EQUAL_UINT8(DL_SAMPLE_INTERVAL, command.command);
+        TEST_ASSERT_EQUAL_UINT32(intervals[command.id], getU32(command.args));
+    }
+    for (const auto& entry : peer.runs) {
+        TEST_ASSERT_EQUAL_UINT8(1, entry.second);
+    }
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_acked_first_time);
+    RUN_TEST(test_no_ack_resends_with_backoff_then_times_out);
+    RUN_TEST(test_lost_acks_recovered_by_resend);
+    RUN_TEST(test_duplicate_late_and_unknown_acks_are_stray);
+    RUN_TEST(test_acks_matched_by_id);
+    RUN_TEST(test_busy_is_retried);
+    RUN_TEST(test_time_sync_moves_on_with_each_resend);
+    RUN_TEST(test_random_peer_with_ingest_on_the_same_stream);
+    return UNITY_END();
+}
@@ -0,0 +1,304 @@
+// EventLog: producers on several threads against one drain, every entry
+// arriving in each producer's order; a full ring dropping and counting;
+// %s arguments packed past LOG_TEXT_SIZE; formatMessage() against printf;
+// and the history kept across a simulated reset, discarded when the image
+// that wrote it is another one.
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "event_log.h"
+
+// What drain() prints, split into lines
+class LinePrint : public Print {
+public:
+    std::vector<std::string> lines;
+    std::string partial;
+
+    size_t write(uint8_t byte) override {
+        if (byte == '\n') {
+            lines.push_back(partial);
+            partial.clear();
+        } else {
+            partial += (char)byte;
+        }
+        return 1;
+    }
+};
+
+// The message of a line, after "  12.345 W mqtt: "
+static std::string messageOf(const std::string& line) {
+    size_t colon = line.find(": ");
+    return colon == std::string::npos ? line : line.substr(colon + 2);
+}
+
+static std::unique_ptr<LogHistory> history;
+
+// An EventLog's last entry as formatMessage() gives it
+template <typename... Args>
+static std::string formatted(const char* format, Args... args) {
+    memset(history.get(), 0, sizeof(LogHistory));
+    std::unique_ptr<EventLog> log(new EventLog(history.get()));
+    log->begin();
+    TEST_ASSERT_TRUE(log->write(LOG_LEVEL_INFO, LOG_HUB, format, args...));
+    LinePrint out;
+    TEST_ASSERT_EQUAL_UINT16(1, log->drain(out));
+    LogRecord record;
+    TEST_ASSERT_TRUE(log->historyRecord(0, record));
+    char message[LOG_LINE_SIZE];
+    EventLog::formatMessage(record.entry, message, sizeof(message));
+    TEST_ASSERT_EQUAL_STRING(message, messageOf(out.lines[0]).c_str());
+    return message;
+}
+
+// printf's own answer for the same call
+template <typename... Args>
+static std::string printed(const char* format, Args... args) {
+    char message[LOG_LINE_SIZE];
+    snprintf(message, sizeof(message), format, args...);
+    return message;
+}
+
+void setUp(void) {
+    history.reset(new LogHistory());
+}
+
+void tearDown(void) {}
+
+void test_producers_drained_in_order(void) {
+    const uint32_t PRODUCERS = 4;
+    const uint32_t ENTRIES = 20000;
+    std::unique_ptr<EventLog> log(new EventLog());
+    std::atomic<uint32_t> refused{0};
+    std::atomic<uint32_t> running{PRODUCERS};
+    std::vector<std::thread> producers;
+    for (uint32_t p = 0; p < PRODUCERS; p++) {
+        producers.emplace_back([&, p]() {
+            for (uint32_t n = 0; n < ENTRIES; n++) {
+                // A full ring refuses; this producer tries again until it's in
+                while (!log->write(LOG_LEVEL_INFO, LOG_INGEST, "p%u n%u", p, n)) {
+                    refused++;
+                    std::this_thread::yield();
+                }
+            }
+            running--;
+        });
+    }
+
+    LinePrint out;
+    uint32_t drained = 0;
+    while (running > 0 || drained < PRODUCERS * ENTRIES) {
+        uint16_t n = log->drain(out, 64);
+        drained += n;
+        if (n == 0) {
+            std::this_thread::yield();
+        }
+    }
+    for (std::thread& producer : producers) {
+        producer.join();
+    }
+    TEST_ASSERT_EQUAL_UINT16(0, log->drain(out));
+
+    std::vector<uint32_t> next(PRODUCERS, 0);
+    uint32_t entries = 0;
+    uint32_t dropLines = 0;
+    for (const std::string& line : out.lines) {
+        if (line.rfind("[log] ", 0) == 0) {
+            dropLines++;
+            continue;
+        }
+        unsigned p, n;
+        TEST_ASSERT_EQUAL_INT_MESSAGE(2, sscanf(messageOf(line).c_str(), "p%u n%u", &p, &n), line.c_str());
+        TEST_ASSERT_LESS_THAN(PRODUCERS, p);
+        TEST_ASSERT_EQUAL_UINT32(next[p], n);
+        next[p]++;
+        entries++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(PRODUCERS * ENTRIES, entries);
+    LogStats stats = log->getStats();
+    TEST_ASSERT_EQUAL_UINT32(PRODUCERS * ENTRIES, stats.written);
+    TEST_ASSERT_EQUAL_UINT32(PRODUCERS * ENTRIES, stats.drained);
+    TEST_ASSERT_EQUAL_UINT32(refused.load(), stats.dropped);
+    TEST_ASSERT_TRUE(dropLines > 0 || refused == 0);
+}
+
+void test_full_ring_drops_counted(void) {
+    std::unique_ptr<EventLog> log(new EventLog());
+    for (uint32_t n = 0; n < LOG_RING_SIZE; n++) {
+        TEST_ASSERT_TRUE(log->write(LOG_LEVEL_WARN, LOG_MQTT, "n%u", n));
+    }
+    for (uint32_t n = 0; n < 5; n++) {
+        TEST_ASSERT_FALSE(log->write(LOG_LEVEL_WARN, LOG_MQTT, "over %u", n));
+    }
+    LogStats stats = log->getStats();
+    TEST_ASSERT_EQUAL_UINT32(LOG_RING_SIZE, stats.written);
+    TEST_ASSERT_EQUAL_UINT32(5, stats.dropped);
+
+    LinePrint out;
+    TEST_ASSERT_EQUAL_UINT16(LOG_RING_SIZE, log->drain(out));
+    TEST_ASSERT_EQUAL(LOG_RING_SIZE + 1, out.lines.size());
+    TEST_ASSERT_EQUAL_STRING("[log] 5 entries dropped, ring full", out.lines[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("n0", messageOf(out.lines[1]).c_str());
+    std::string last = "n" + std::to_string(LOG_RING_SIZE - 1);
+    TEST_ASSERT_EQUAL_STRING(last.c_str(), messageOf(out.lines[LOG_RING_SIZE]).c_str());
+
+    // Room again; the drop is reported once
+    TEST_ASSERT_TRUE(log->write(LOG_LEVEL_WARN, LOG_MQTT, "after"));
+    out.lines.clear();
+    TEST_ASSERT_EQUAL_UINT16(1, log->drain(out));
+    TEST_ASSERT_EQUAL(1, out.lines.size());
+    TEST_ASSERT_EQUAL_STRING("after", messageOf(out.lines[0]).c_str());
+}
+
+// The %s arguments share LOG_TEXT_SIZE bytes, terminators included: the
+// one that crosses the end is cut, the ones after it are empty
+void test_text_packing_past_text_size(void) {
+    std::string first = "abcdefghij";
+    std::string second = "klmnopqrstuvwxyz0123456789";
+    std::string cut = second.substr(0, LOG_TEXT_SIZE - 1 - (first.size() + 1));
+    TEST_ASSERT_EQUAL_STRING((first + "|" + cut + "||7").c_str(),
+                             formatted("%s|%s|%s|%d", first.c_str(), second.c_str(), "XYZ", 7).c_str());
+
+    std::string longer(LOG_TEXT_SIZE * 2, 'x');
+    TEST_ASSERT_EQUAL_STRING(std::string(LOG_TEXT_SIZE - 1, 'x').c_str(), formatted("%s", longer.c_str()).c_str());
+    TEST_ASSERT_EQUAL_STRING("(null) ok", formatted("%s %s", (const char*)nullptr, "ok").c_str());
+    // A char array is text too, not its address
+    char name[] = "node";
+    TEST_ASSERT_EQUAL_STRING("node=3", formatted("%s=%u", name, 3u).c_str());
+}
+
+void test_format_flags_and_widths(void) {
+    TEST_ASSERT_EQUAL_STRING(printed("[%-5d|%+d|%5d|%05d]", 42, 42, -42, 42).c_str(),
+                             formatted("[%-5d|%+d|%5d|%05d]", 42, 42, -42, 42).c_str());
+    TEST_ASSERT_EQUAL_STRING(printed("[%x|%#X|%#o|%8u|%c]", 255u, 255u, 8u, 7u, 'Z').c_str(),
+                             formatted("[%x|%#X|%#o|%8u|%c]", 255u, 255u, 8u, 7u, 'Z').c_str());
+    TEST_ASSERT_EQUAL_STRING(printed("[%.2f|%8.3f|%-8.1f|%.2e|%g]", 3.14159, -2.5, 1.25, 12345.678, 0.5).c_str(),
+                             formatted("[%.2f|%8.3f|%-8.1f|%.2e|%g]", 3.14159, -2.5, 1.25, 12345.678, 0.5).c_str());
+    TEST_ASSERT_EQUAL_STRING(printed("[%8s|%-6s|%.2s] 100%%", "ab", "cd", "efgh").c_str(),
+                             formatted("[%8s|%-6s|%.2s] 100%%", "ab", "cd", "efgh").c_str());
+    // Length modifiers are dropped, every argument is 32 bits
+    TEST_ASSERT_EQUAL_STRING("7 -3 9 4000000000",
+                             formatted("%lu %ld %zu %llu", 7ul, -3l, (size_t)9, 4000000000ull).c_str());
+    // Integers printed as floats and floats as integers
+    TEST_ASSERT_EQUAL_STRING("2.0 -3.0 2", formatted("%.1f %.1f %d", 2u, -3, 2.75f).c_str());
+}
+
+void test_format_missing_and_unknown(void) {
+    TEST_ASSERT_EQUAL_STRING("7 and ?", formatted("%d and %d", 7).c_str());
+    TEST_ASSERT_EQUAL_STRING("? then ?", formatted("%s then %u").c_str());
+    TEST_ASSERT_EQUAL_STRING("at ?", formatted("at %p", 5u).c_str());
+    TEST_ASSERT_EQUAL_STRING("cut ", formatted("cut %", 5u).c_str());
+    // A number where text is expected isn't read as an offset
+    TEST_ASSERT_EQUAL_STRING("?", formatted("%s", 3u).c_str());
+}
+
+static void logBoot(EventLog& log, const char* format, uint32_t count, LinePrint& out) {
+    for (uint32_t n = 0; n < count; n++) {
+        TEST_ASSERT_TRUE(log.write(LOG_LEVEL_ERROR, LOG_RTC, format, n));
+    }
+    TEST_ASSERT_EQUAL_UINT16(count, log.drain(out));
+}
+
+// The history struct outlives the EventLog, as RTC memory outlives a reset
+void test_history_carried_over_reset(void) {
+    LinePrint out;
+    std::unique_ptr<EventLog> first(new EventLog(history.get()));
+    first->begin();
+    TEST_ASSERT_EQUAL_UINT32(0, first->getBoot());
+    logBoot(*first, "before %u", 3, out);
+    first.reset();
+
+    std::unique_ptr<EventLog> second(new EventLog(history.get()));
+    second->begin();
+    TEST_ASSERT_EQUAL_UINT32(1, second->getBoot());
+    TEST_ASSERT_EQUAL_UINT16(3, second->historySize());
+    TEST_ASSERT_EQUAL_UINT16(3, second->getStats().carried);
+    logBoot(*second, "after %u", 2, out);
+
+    LogRecord record;
+    char message[LOG_LINE_SIZE];
+    const char* expected[] = {"before 0", "before 1", "before 2", "after 0", "after 1"};
+    for (uint16_t i = 0; i < 5; i++) {
+        TEST_ASSERT_TRUE(second->historyRecord(i, record));
+        TEST_ASSERT_EQUAL_UINT32(i < 3 ? 0 : 1, record.boot);
+        EventLog::formatMessage(record.entry, message, sizeof(message));
+        TEST_ASSERT_EQUAL_STRING(expected[i], message);
+    }
+    TEST_ASSERT_FALSE(second->historyRecord(5, record));
+    char report[LOG_REPORT_SIZE];
+    second->formatHistory(report, sizeof(report));
+    TEST_ASSERT_NOT_NULL(strstr(report, "-- boot 0, before the reset\n"));
+    TEST_ASSERT_NOT_NULL(strstr(report, "-- boot 1\n"));
+    TEST_ASSERT_NOT_NULL(strstr(report, "(3 from before the reset)"));
+
+    // New entries push the old boot's out, oldest first
+    logBoot(*second, "more %u", LOG_HISTORY_SIZE - 3, out);
+    TEST_ASSERT_EQUAL_UINT16(1, second->getStats().carried);
+    TEST_ASSERT_TRUE(second->historyRecord(0, record));
+    EventLog::formatMessage(record.entry, message, sizeof(message));
+    TEST_ASSERT_EQUAL_STRING("before 2", message);
+    logBoot(*second, "last %u", 1, out);
+    TEST_ASSERT_EQUAL_UINT16(0, second->getStats().carried);
+    TEST_ASSERT_EQUAL_UINT16(LOG_HISTORY_SIZE, second->historySize());
+    second.reset();
+
+    // A third boot carries the full history
+    std::unique_ptr<EventLog> third(new EventLog(history.get()));
+    third->begin();
+    TEST_ASSERT_EQUAL_UINT32(2, third->getBoot());
+    TEST_ASSERT_EQUAL_UINT16(LOG_HISTORY_SIZE, third->getStats().carried);
+}
+
+// Format strings are addresses into the image that wrote them; another
+// image's history, or what power-on leaves in RTC memory, is thrown away
+void test_history_discarded_on_image_mismatch(void) {
+    LinePrint out;
+    std::unique_ptr<EventLog> log(new EventLog(history.get()));
+    log->begin();
+    logBoot(*log, "old %u", 4, out);
+    log.reset();
+
+    LogHistory saved = *history;
+    history->image[0] ^= 0x01;
+    log.reset(new EventLog(history.get()));
+    log->begin();
+    TEST_ASSERT_EQUAL_UINT16(0, log->historySize());
+    TEST_ASSERT_EQUAL_UINT32(0, log->getBoot());
+    TEST_ASSERT_EQUAL_UINT16(0, log->getStats().carried);
+
+    *history = saved;
+    history->magic ^= 0x80000000u;
+    log.reset(new EventLog(history.get()));
+    log->begin();
+    TEST_ASSERT_EQUAL_UINT16(0, log->historySize());
+
+    // Power-on garbage that happens to pass the magic and image
+    *history = saved;
+    history->head = LOG_HISTORY_SIZE;
+    log.reset(new EventLog(history.get()));
+    log->begin();
+    TEST_ASSERT_EQUAL_UINT16(0, log->historySize());
+
+    *history = saved;
+    log.reset(new EventLog(history.get()));
+    log->begin();
+    TEST_ASSERT_EQUAL_UINT16(4, log->historySize());
+    TEST_ASSERT_EQUAL_UINT32(1, log->getBoot());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_producers_drained_in_order);
+    RUN_TEST(test_full_ring_drops_counted);
+    RUN_TEST(test_text_packing_past_text_size);
+    RUN_TEST(test_format_flags_and_widths);
+    RUN_TEST(test_format_missing_and_unknown);
+    RUN_TEST(test_history_carried_over_reset);
+    RUN_TEST(test_history_discarded_on_image_mismatch);
+    return UNITY_END();
+}
@@ -0,0 +1,127 @@
+// HAL Linux backends: the host directory file system and the pty serial
+// port the native program reads the hub UART from
+
+#include <unity.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#include "hal.h"
+
+static char root[32];
+
+void setUp(void) {
+    strcpy(root, "/tmp/hal_test_XXXXXX");
+    TEST_ASSERT_NOT_NULL(mkdtemp(root));
+}
+
+void tearDown(void) {
+    char command[64];
+    snprintf(command, sizeof(command), "rm -rf %s", root);
+    system(command);
+}
+
+static void test_file_round_trip(void) {
+    PosixFileSystem fs(root);
+    TEST_ASSERT_TRUE(fs.begin());
+    const uint8_t data[] = {0x00, 0x01, 0xFF, 'h', 'u', 'b'};
+    TEST_ASSERT_FALSE(fs.exists("/config.bin"));
+    TEST_ASSERT_EQUAL(-1, fs.fileSize("/config.bin"));
+    TEST_ASSERT_TRUE(fs.writeFile("/config.bin", data, sizeof(data)));
+    TEST_ASSERT_TRUE(fs.exists("/config.bin"));
+    TEST_ASSERT_EQUAL(sizeof(data), fs.fileSize("/config.bin"));
+
+    uint8_t read[16];
+    TEST_ASSERT_EQUAL(sizeof(data), fs.readFile("/config.bin", read, sizeof(read)));
+    TEST_ASSERT_EQUAL_MEMORY(data, read, sizeof(data));
+    // Short buffer: only what fits
+    TEST_ASSERT_EQUAL(2, fs.readFile("/config.bin", read, 2));
+}
+
+static void test_file_rename_and_remove(void) {
+    PosixFileSystem fs(root);
+    TEST_ASSERT_TRUE(fs.begin());
+    const uint8_t data[] = {1, 2, 3};
+    TEST_ASSERT_TRUE(fs.writeFile("/a.tmp", data, sizeof(data)));
+    TEST_ASSERT_TRUE(fs.rename("/a.tmp", "/a.bin"));
+    TEST_ASSERT_FALSE(fs.exists("/a.tmp"));
+    TEST_ASSERT_TRUE(fs.exists("/a.bin"));
+    TEST_ASSERT_TRUE(fs.remove("/a.bin"));
+    TEST_ASSERT_FALSE(fs.exists("/a.bin"));
+    TEST_ASSERT_FALSE(fs.remove("/a.bin"));
+    uint8_t read[4];
+    TEST_ASSERT_EQUAL(0, fs.readFile("/a.bin", read, sizeof(read)));
+}
+
+static void test_file_system_creates_its_root(void) {
+    char nested[48];
+    snprintf(nested, sizeof(nested), "%s/fs", root);
+    PosixFileSystem fs(nested);
+    TEST_ASSERT_TRUE(fs.begin());
+    TEST_ASSERT_TRUE(fs.begin());
+}
+
+// The far end of the port's pty, as loadgen would open it
+static int openSlave(PtySerialPort& port) {
+    int fd = open(port.slaveName(), O_RDWR | O_NOCTTY);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, fd);
+    struct termios tty;
+    tcgetattr(fd, &tty);
+    cfmakeraw(&tty);
+    tcsetattr(fd, TCSANOW, &tty);
+    return fd;
+}
+
+static void test_pty_both_directions(void) {
+    PtySerialPort port;
+    TEST_ASSERT_TRUE(port.begin(115200, -1, -1));
+    int slave = openSlave(port);
+
+    TEST_ASSERT_EQUAL(-1, port.read());
+    const uint8_t frame[] = {0xAA, 0x55, 0x00, 0x10};
+    TEST_ASSERT_EQUAL(sizeof(frame), write(slave, frame, sizeof(frame)));
+    TEST_ASSERT_TRUE(port.waitForData(1000));
+    uint8_t read[sizeof(frame)];
+    port.setTimeout(1000);
+    TEST_ASSERT_EQUAL(sizeof(frame), port.readBytes(read, sizeof(read)));
+    TEST_ASSERT_EQUAL_MEMORY(frame, read, sizeof(frame));
+    TEST_ASSERT_EQUAL(0, port.available());
+
+    TEST_ASSERT_EQUAL(sizeof(frame), port.write(frame, sizeof(frame)));
+    port.flush();
+    memset(read, 0, sizeof(read));
+    size_t got = 0;
+    while (got < sizeof(read)) {
+        ssize_t n = ::read(slave, read + got, sizeof(read) - got);
+        TEST_ASSERT_GREATER_THAN(0, n);
+        got += n;
+    }
+    TEST_ASSERT_EQUAL_MEMORY(frame, read, sizeof(frame));
+    close(slave);
+}
+
+static void test_pty_read_times_out(void) {
+    PtySerialPort port;
+    TEST_ASSERT_TRUE(port.begin(115200, -1, -1));
+    int slave = openSlave(port);
+    const uint8_t half[] = {0xAA, 0x55};
+    write(slave, half, sizeof(half));
+
+    uint8_t read[8];
+    port.setTimeout(50);
+    unsigned long start = millis();
+    TEST_ASSERT_EQUAL(sizeof(half), port.readBytes(read, sizeof(read)));
+    TEST_ASSERT_GREATER_OR_EQUAL(45, millis() - start);
+    TEST_ASSERT_FALSE(port.waitForData(10));
+    close(slave);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_file_round_trip);
+    RUN_TEST(test_file_rename_and_remove);
+    RUN_TEST(test_file_system_creates_its_root);
+    RUN_TEST(test_pty_both_directions);
+    RUN_TEST(test_pty_read_times_out);
+    return UNITY_END();
+}
@@ -0,0 +1,124 @@
+// LatencyTracer on the HAL's FakeClock: per-stage deltas and the
+// histogram buckets they land in
+
+#include <unity.h>
+#include "hal.h"
+#include "latency_tracer.h"
+
+static FakeClock fakeClock;
+
+static int64_t fakeNow() {
+    return (int64_t)fakeClock.micros64();
+}
+
+static LatencyTracer tracer;
+
+void setUp(void) {
+    LatencyTracer::setClock(fakeNow);
+    tracer.reset();
+}
+
+void tearDown(void) {
+    LatencyTracer::setClock(nullptr);
+}
+
+// Stamps every stage, advancing the clock by gaps[stage] before each
+static void traceReading(const uint32_t* gaps) {
+    TraceRecord record;
+    LatencyTracer::clear(record);
+    for (uint8_t stage = 0; stage < TRACE_STAGE_COUNT; stage++) {
+        fakeClock.advance(gaps[stage]);
+        LatencyTracer::stamp(record, (TraceStage)stage);
+    }
+    tracer.commit(record);
+}
+
+static void test_stage_deltas(void) {
+    const uint32_t gaps[TRACE_STAGE_COUNT] = {0, 120, 5, 40, 900, 3, 2500};
+    traceReading(gaps);
+    uint32_t total = 0;
+    for (uint8_t stage = 1; stage < TRACE_STAGE_COUNT; stage++) {
+        const LatencyHistogram& h = tracer.stageHistogram((TraceStage)stage);
+        TEST_ASSERT_EQUAL_UINT32(1, h.getCount());
+        TEST_ASSERT_EQUAL_UINT32(gaps[stage], h.getMin());
+        TEST_ASSERT_EQUAL_UINT32(gaps[stage], h.getMax());
+        total += gaps[stage];
+    }
+    TEST_ASSERT_EQUAL_UINT32(total, tracer.endToEndHistogram().getMax());
+    TEST_ASSERT_EQUAL_UINT32(0, tracer.getDropped());
+}
+
+static void test_skipped_stage_goes_to_the_next(void) {
+    TraceRecord record;
+    LatencyTracer::clear(record);
+    LatencyTracer::stamp(record, TRACE_UART_RX);
+    fakeClock.advance(100);
+    LatencyTracer::stamp(record, TRACE_DECODED);
+    fakeClock.advance(300);     // ENQUEUED/DEQUEUED never stamped
+    LatencyTracer::stamp(record, TRACE_ENCODED);
+    tracer.commit(record);
+
+    TEST_ASSERT_EQUAL_UINT32(100, tracer.stageHistogram(TRACE_DECODED).getMax());
+    TEST_ASSERT_EQUAL_UINT32(0, tracer.stageHistogram(TRACE_ENQUEUED).getCount());
+    TEST_ASSERT_EQUAL_UINT32(0, tracer.stageHistogram(TRACE_DEQUEUED).getCount());
+    TEST_ASSERT_EQUAL_UINT32(300, tracer.stageHistogram(TRACE_ENCODED).getMax());
+    TEST_ASSERT_EQUAL_UINT32(400, tracer.endToEndHistogram().getMax());
+}
+
+static void test_untraced_reading_is_dropped(void) {
+    TraceRecord record;
+    LatencyTracer::clear(record);
+    LatencyTracer::stamp(record, TRACE_ENCODED);
+    tracer.commit(record);
+    TEST_ASSERT_EQUAL_UINT32(1, tracer.getDropped());
+    TEST_ASSERT_EQUAL_UINT32(0, tracer.endToEndHistogram().getCount());
+}
+
+static void test_bucket_boundaries(void) {
+    // Exact below 16, then 8 sub-buckets per power of two
+    for (uint32_t v = 0; v < 16; v++) {
+        TEST_ASSERT_EQUAL_UINT16(v, LatencyHistogram::bucketFor(v));
+        TEST_ASSERT_EQUAL_UINT32(v, LatencyHistogram::bucketUpper(v));
+    }
+    TEST_ASSERT_EQUAL_UINT16(16, LatencyHistogram::bucketFor(16));
+    TEST_ASSERT_EQUAL_UINT16(16, LatencyHistogram::bucketFor(17));
+    TEST_ASSERT_EQUAL_UINT32(17, LatencyHistogram::bucketUpper(16));
+    TEST_ASSERT_EQUAL_UINT16(17, LatencyHistogram::bucketFor(18));
+    TEST_ASSERT_EQUAL_UINT16(LatencyHistogram::BUCKET_COUNT - 1, LatencyHistogram::bucketFor(UINT32_MAX));
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, LatencyHistogram::bucketUpper(LatencyHistogram::BUCKET_COUNT - 1));
+
+    // Every value is in a bucket whose upper bound is within 12.5% above it
+    for (uint32_t v = 16; v < 1u << 20; v += 37) {
+        uint32_t upper = LatencyHistogram::bucketUpper(LatencyHistogram::bucketFor(v));
+        TEST_ASSERT_GREATER_OR_EQUAL_UINT32(v, upper);
+        TEST_ASSERT_LESS_OR_EQUAL_UINT32(v + v / 8, upper);
+    }
+}
+
+static void test_percentiles_from_the_clock(void) {
+    // 90 readings 100 us through decode, 10 at 5000 us
+    for (uint8_t i = 0; i < 100; i++) {
+        uint32_t gaps[TRACE_STAGE_COUNT] = {10, i < 90 ? 100u : 5000u, 0, 0, 0, 0, 0};
+        traceReading(gaps);
+    }
+    const LatencyHistogram& decoded = tracer.stageHistogram(TRACE_DECODED);
+    TEST_ASSERT_EQUAL_UINT32(100, decoded.getCount());
+    uint32_t p50 = decoded.percentile(0.5f);
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(100, p50);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(112, p50);
+    TEST_ASSERT_EQUAL_UINT32(5000, decoded.percentile(0.99f));
+    TEST_ASSERT_EQUAL_UINT32(5000, decoded.getMax());
+    TEST_ASSERT_EQUAL_UINT32((90 * 100 + 10 * 5000) / 100, decoded.getMean());
+    // A stage stamped in the same microsecond as the one before
+    TEST_ASSERT_EQUAL_UINT32(0, tracer.stageHistogram(TRACE_ENQUEUED).getMax());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_stage_deltas);
+    RUN_TEST(test_skipped_stage_goes_to_the_next);
+    RUN_TEST(test_untraced_reading_is_dropped);
+    RUN_TEST(test_bucket_boundaries);
+    RUN_TEST(test_percentiles_from_the_clock);
+    return UNITY_END();
+}
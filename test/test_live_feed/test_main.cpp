@@ -0,0 +1,415 @@
+// LiveFeed through bursts of node updates and clients that fall behind.
+// Each client keeps a dashboard view built only from the frames it was
+// sent: a full frame replaces it, a delta updates the nodes it lists.
+// Whenever a client gets a frame its view must match the node table.
+
+#include <unity.h>
+#include <math.h>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "live_feed.h"
+#include "node_table.h"
+
+struct Sent {
+    std::string frame;
+    std::vector<uint32_t> clients;
+};
+
+class FakeSink : public LiveSink {
+public:
+    std::set<uint32_t> busy;
+    std::vector<Sent> sent;
+
+    bool isBusy(uint32_t clientId) override { return busy.count(clientId) > 0; }
+    void sendShared(const char* frame, size_t len, const uint32_t* clientIds, uint8_t count) override {
+        sent.push_back({std::string(frame, len), std::vector<uint32_t>(clientIds, clientIds + count)});
+    }
+};
+
+static size_t writeMetrics(char* out, size_t len) {
+    return snprintf(out, len, "{\"heap\":1234}");
+}
+
+// What the dashboard shows for a node; age_ms moves on by itself
+struct NodeView {
+    unsigned long count;
+    std::string temp;
+    std::string humidity;
+    long moisture;
+
+    bool operator==(const NodeView& other) const {
+        return count == other.count && temp == other.temp && humidity == other.humidity &&
+               moisture == other.moisture;
+    }
+};
+
+typedef std::map<std::string, NodeView> View;
+
+struct Frame {
+    unsigned long seq;
+    bool full;
+    bool metrics;
+    bool truncated;
+    View nodes;
+    std::vector<std::string> order;
+};
+
+static Frame parseFrame(const std::string& text) {
+    Frame frame;
+    char full[8] = "";
+    unsigned long uptime = 0;
+    int used = 0;
+    TEST_ASSERT_EQUAL_MESSAGE(3, sscanf(text.c_str(), "{\"seq\":%lu,\"uptime_ms\":%lu,\"full\":%7[a-z],\"nodes\":[%n",
+                                        &frame.seq, &uptime, full, &used), text.c_str());
+    TEST_ASSERT_TRUE(used > 0);
+    frame.full = strcmp(full, "true") == 0;
+    const char* p = text.c_str() + used;
+    while (*p == '{' || *p == ',') {
+        if (*p == ',') p++;
+        char id[16] = "";
+        char temp[32] = "";
+        char humidity[32] = "";
+        NodeView node;
+        unsigned long age;
+        int n = 0;
+        TEST_ASSERT_EQUAL_MESSAGE(6, sscanf(p, "{\"id\":\"%15[^\"]\",\"count\":%lu,\"age_ms\":%lu,\"temp\":%31[^,],"
+                                               "\"humidity\":%31[^,],\"moisture\":%ld}%n",
+                                            id, &node.count, &age, temp, humidity, &node.moisture, &n), p);
+        node.temp = temp;
+        node.humidity = humidity;
+        frame.nodes[id] = node;
+        frame.order.push_back(id);
+        p += n;
+    }
+    TEST_ASSERT_EQUAL(']', *p);
+    p++;
+    frame.truncated = strncmp(p, ",\"truncated\":true", 17) == 0;
+    frame.metrics = strstr(p, ",\"metrics\":{\"heap\":1234}") != nullptr;
+    TEST_ASSERT_EQUAL('}', text.back());
+    return frame;
+}
+
+static std::string formatValue(float value) {
+    char text[32];
+    if (isnan(value)) return "null";
+    snprintf(text, sizeof(text), "%.2f", value);
+    return text;
+}
+
+static View tableView(const NodeTable& table) {
+    View view;
+    for (uint8_t i = 0; i < table.size(); i++) {
+        const NodeStats& node = table.at(i);
+        view[node.nodeID] = {node.count, formatValue(node.lastTemp), formatValue(node.lastHumidity),
+                             node.lastMoisture};
+    }
+    return view;
+}
+
+static uint32_t rngState;
+
+static uint32_t nextRandom() {
+    rngState = rngState * 1664525u + 1013904223u;
+    return rngState >> 8;
+}
+
+// The hub side: table, feed, and the dashboards that hold a view each
+struct Rig {
+    NodeTable table;
+    FakeSink sink;
+    LiveFeed feed{&table, &sink, writeMetrics};
+    std::map<uint32_t, View> views;
+    std::map<uint32_t, unsigned long> lastSeq;
+    uint32_t nowMs = 10000;
+
+    Rig() { TEST_ASSERT_TRUE(feed.begin()); }
+
+    void connect(uint32_t id) {
+        TEST_ASSERT_TRUE(feed.addClient(id));
+        views[id] = View();
+        lastSeq[id] = 0;
+    }
+
+    void disconnect(uint32_t id) {
+        feed.removeClient(id);
+        views.erase(id);
+        lastSeq.erase(id);
+    }
+
+    const NodeStats* update(const char* nodeID) {
+        SensorReading reading;
+        initReading(reading, SCHEMA_CLIMATE, nodeID);
+        reading.present = 0x7;
+        ClimateSample& climate = reading.as<ClimateSample>();
+        climate.temp = ((float)(nextRandom() % 6000) - 2000.0f) / 100.0f;
+        climate.humidity = nextRandom() % 5 == 0 ? NAN : (float)(nextRandom() % 10000) / 100.0f;
+        climate.moisture = (float)(nextRandom() % 4096);
+        const NodeStats* node = table.update(reading, nowMs);
+        feed.markNode(node);
+        return node;
+    }
+
+    // Ticks and hands the frames to the dashboards. Returns which clients
+    // got which kind of frame.
+    std::map<uint32_t, Frame> tick(uint32_t advanceMs) {
+        nowMs += advanceMs;
+        sink.sent.clear();
+        feed.tick(nowMs);
+        std::map<uint32_t, Frame> got;
+        for (const Sent& sent : sink.sent) {
+            Frame frame = parseFrame(sent.frame);
+            TEST_ASSERT_FALSE(frame.truncated);
+            for (uint32_t id : sent.clients) {
+                TEST_ASSERT_EQUAL_MESSAGE(1, views.count(id), "frame for a client that left");
+                TEST_ASSERT_EQUAL_MESSAGE(0, got.count(id), "two frames in one tick");
+                TEST_ASSERT_TRUE(frame.seq > lastSeq[id]);
+                lastSeq[id] = frame.seq;
+                if (frame.full) {
+                    views[id] = frame.nodes;
+                } else {
+                    for (const auto& node : frame.nodes) views[id][node.first] = node.second;
+                }
+                got[id] = frame;
+            }
+        }
+        return got;
+    }
+
+    void assertInSync(uint32_t id) {
+        View expected = tableView(table);
+        TEST_ASSERT_EQUAL(expected.size(), views[id].size());
+        for (const auto& node : expected) {
+            TEST_ASSERT_EQUAL_MESSAGE(1, views[id].count(node.first), node.first.c_str());
+            TEST_ASSERT_TRUE_MESSAGE(views[id][node.first] == node.second, node.first.c_str());
+        }
+    }
+};
+
+static std::string nodeName(int i) {
+    char id[9];
+    snprintf(id, sizeof(id), "N%02d", i);
+    return id;
+}
+
+void setUp(void) {
+    rngState = 99;
+}
+
+void tearDown(void) {}
+
+// A burst between ticks is one delta with the latest value of each node
+// that changed, and nothing is sent more often than LIVE_FEED_INTERVAL
+void test_burst_coalesces_into_one_delta(void) {
+    Rig rig;
+    for (int i = 0; i < 10; i++) rig.update(nodeName(i).c_str());
+    rig.connect(1);
+    std::map<uint32_t, Frame> got = rig.tick(LIVE_FEED_INTERVAL);
+    TEST_ASSERT_TRUE(got[1].full);
+    TEST_ASSERT_EQUAL(10, got[1].nodes.size());
+    rig.assertInSync(1);
+
+    for (int burst = 0; burst < 50; burst++) {
+        rig.update(nodeName(burst % 3 * 4).c_str());
+    }
+    TEST_ASSERT_EQUAL(0, rig.tick(LIVE_FEED_INTERVAL - 1).size());
+    got = rig.tick(1);
+    TEST_ASSERT_FALSE(got[1].full);
+    TEST_ASSERT_EQUAL(3, got[1].order.size());
+    TEST_ASSERT_EQUAL_STRING("N00", got[1].order[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("N04", got[1].order[1].c_str());
+    TEST_ASSERT_EQUAL_STRING("N08", got[1].order[2].c_str());
+    rig.assertInSync(1);
+
+    // Nothing changed and no metrics due: nothing sent
+    TEST_ASSERT_EQUAL(0, rig.tick(LIVE_FEED_INTERVAL).size());
+    TEST_ASSERT_EQUAL_UINT32(2, rig.feed.getStats().frames);
+}
+
+// Every bit of the dirty mask, across its words, maps to its own node
+void test_dirty_mask_covers_every_node(void) {
+    Rig rig;
+    for (int i = 0; i < NODE_TABLE_CAPACITY; i++) rig.update(nodeName(i).c_str());
+    rig.connect(1);
+    rig.tick(LIVE_FEED_INTERVAL);
+    rig.assertInSync(1);
+
+    for (int i = 0; i < NODE_TABLE_CAPACITY; i++) {
+        rig.update(nodeName(i).c_str());
+        std::map<uint32_t, Frame> got = rig.tick(LIVE_FEED_INTERVAL);
+        TEST_ASSERT_EQUAL(1, got[1].order.size());
+        TEST_ASSERT_EQUAL_STRING(nodeName(i).c_str(), got[1].order[0].c_str());
+    }
+    for (int trial = 0; trial < 20; trial++) {
+        std::set<std::string> changed;
+        int n = nextRandom() % NODE_TABLE_CAPACITY;
+        for (int k = 0; k < n; k++) {
+            std::string id = nodeName(nextRandom() % NODE_TABLE_CAPACITY);
+            rig.update(id.c_str());
+            changed.insert(id);
+        }
+        std::map<uint32_t, Frame> got = rig.tick(LIVE_FEED_INTERVAL);
+        if (changed.empty() && got.count(1) == 0) continue;
+        // In table order, which is arrival order
+        TEST_ASSERT_EQUAL(changed.size(), got[1].order.size());
+        TEST_ASSERT_TRUE(std::is_sorted(got[1].order.begin(), got[1].order.end()));
+        for (const std::string& id : got[1].order) TEST_ASSERT_EQUAL(1, changed.count(id));
+        rig.assertInSync(1);
+    }
+}
+
+// A client busy across several ticks misses deltas, so it gets a full
+// frame once it drains; the other client carries on with deltas throughout
+void test_busy_client_is_skipped_then_resynced(void) {
+    Rig rig;
+    for (int i = 0; i < 8; i++) rig.update(nodeName(i).c_str());
+    rig.connect(1);
+    rig.connect(2);
+    std::map<uint32_t, Frame> got = rig.tick(LIVE_FEED_INTERVAL);
+    TEST_ASSERT_TRUE(got[1].full && got[2].full);
+
+    rig.sink.busy.insert(2);
+    for (int t = 0; t < 5; t++) {
+        rig.update(nodeName(t).c_str());
+        got = rig.tick(LIVE_FEED_INTERVAL);
+        TEST_ASSERT_FALSE(got[1].full);
+        TEST_ASSERT_EQUAL(0, got.count(2));
+        rig.assertInSync(1);
+    }
+    TEST_ASSERT_EQUAL_UINT32(5, rig.feed.getStats().dropped);
+    TEST_ASSERT_FALSE(rig.views[2] == tableView(rig.table));
+
+    // Drained on a tick where nothing changed: the full frame still goes out
+    rig.sink.busy.clear();
+    got = rig.tick(LIVE_FEED_INTERVAL);
+    TEST_ASSERT_EQUAL(0, got.count(1));
+    TEST_ASSERT_TRUE(got[2].full);
+    TEST_ASSERT_EQUAL(8, got[2].nodes.size());
+    TEST_ASSERT_TRUE(got[2].metrics);
+    rig.assertInSync(2);
+
+    // And then deltas like everyone else, one frame shared by both
+    rig.update("N07");
+    got = rig.tick(LIVE_FEED_INTERVAL);
+    TEST_ASSERT_FALSE(got[1].full || got[2].full);
+    TEST_ASSERT_EQUAL(1, rig.sink.sent.size());
+    TEST_ASSERT_EQUAL(2, rig.sink.sent[0].clients.size());
+    rig.assertInSync(1);
+    rig.assertInSync(2);
+}
+
+// A client that is busy on a tick with nothing for it missed nothing and
+// stays on deltas
+void test_busy_with_nothing_to_send_keeps_deltas(void) {
+    Rig rig;
+    rig.update("N01");
+    rig.connect(1);
+    rig.tick(LIVE_FEED_INTERVAL);
+    rig.sink.busy.insert(1);
+    TEST_ASSERT_EQUAL(0, rig.tick(LIVE_FEED_INTERVAL).size());
+    rig.sink.busy.clear();
+    rig.update("N01");
+    std::map<uint32_t, Frame> got = rig.tick(LIVE_FEED_INTERVAL);
+    TEST_ASSERT_FALSE(got[1].full);
+    TEST_ASSERT_EQUAL_UINT32(0, rig.feed.getStats().dropped);
+}
+
+// Metrics ride on a delta every LIVE_METRICS_INTERVAL, even with no node
+// changed, and on every full frame
+void test_metrics_interval(void) {
+    Rig rig;
+    rig.update("N01");
+    rig.connect(1);
+    std::map<uint32_t, Frame> got = rig.tick(LIVE_METRICS_INTERVAL);
+    TEST_ASSERT_TRUE(got[1].full && got[1].metrics);
+    uint32_t quietTicks = 0;
+    for (uint32_t elapsed = 0; elapsed < LIVE_METRICS_INTERVAL; elapsed += LIVE_FEED_INTERVAL) {
+        got = rig.tick(LIVE_FEED_INTERVAL);
+        if (got.empty()) quietTicks++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(LIVE_METRICS_INTERVAL / LIVE_FEED_INTERVAL - 1, quietTicks);
+    TEST_ASSERT_FALSE(got[1].full);
+    TEST_ASSERT_TRUE(got[1].metrics);
+    TEST_ASSERT_EQUAL(0, got[1].nodes.size());
+    rig.update("N01");
+    got = rig.tick(LIVE_FEED_INTERVAL);
+    TEST_ASSERT_FALSE(got[1].metrics);
+}
+
+// Random bursts, clients coming, going and stalling: every frame a client
+// gets leaves its view equal to the table, and a client that is free on a
+// tick where anything changed is never left without one
+void test_random_bursts_and_stalls(void) {
+    Rig rig;
+    std::set<uint32_t> connected;
+    uint32_t nextClient = 1;
+    uint32_t resyncs = 0;
+    std::map<uint32_t, bool> stale;
+
+    for (int step = 0; step < 3000; step++) {
+        uint32_t roll = nextRandom() % 100;
+        if (roll < 3 && connected.size() < LIVE_MAX_CLIENTS) {
+            rig.connect(nextClient);
+            connected.insert(nextClient);
+            nextClient++;
+        } else if (roll < 5 && !connected.empty()) {
+            uint32_t id = *std::next(connected.begin(), nextRandom() % connected.size());
+            rig.disconnect(id);
+            connected.erase(id);
+            rig.sink.busy.erase(id);
+        }
+        for (uint32_t id : connected) {
+            if (nextRandom() % 10 == 0) {
+                if (rig.sink.busy.count(id)) {
+                    rig.sink.busy.erase(id);
+                } else {
+                    rig.sink.busy.insert(id);
+                }
+            }
+        }
+        int burst = nextRandom() % 4 == 0 ? nextRandom() % 40 : 0;
+        for (int k = 0; k < burst; k++) {
+            rig.update(nodeName(nextRandom() % 40).c_str());
+        }
+        bool changed = burst > 0;
+
+        std::map<uint32_t, Frame> got = rig.tick(LIVE_FEED_INTERVAL);
+        for (uint32_t id : connected) {
+            bool busy = rig.sink.busy.count(id) > 0;
+            if (busy) {
+                TEST_ASSERT_EQUAL(0, got.count(id));
+                if (changed) stale[id] = true;
+                continue;
+            }
+            if (got.count(id) == 0) {
+                // Nothing changed since its last frame
+                TEST_ASSERT_FALSE(changed);
+                TEST_ASSERT_FALSE(stale[id]);
+                continue;
+            }
+            if (stale[id]) {
+                TEST_ASSERT_TRUE_MESSAGE(got[id].full, "missed a delta, no full frame");
+                resyncs++;
+                stale[id] = false;
+            }
+            rig.assertInSync(id);
+        }
+    }
+    TEST_ASSERT_TRUE(resyncs > 10);
+    const LiveFeedStats& stats = rig.feed.getStats();
+    TEST_ASSERT_TRUE(stats.dropped > 0);
+    TEST_ASSERT_TRUE(stats.fullFrames > resyncs);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_burst_coalesces_into_one_delta);
+    RUN_TEST(test_dirty_mask_covers_every_node);
+    RUN_TEST(test_busy_client_is_skipped_then_resynced);
+    RUN_TEST(test_busy_with_nothing_to_send_keeps_deltas);
+    RUN_TEST(test_metrics_interval);
+    RUN_TEST(test_random_bursts_and_stalls);
+    return UNITY_END();
+}
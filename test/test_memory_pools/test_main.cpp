@@ -0,0 +1,137 @@
+// Pools and the JSON arena, and a soak of the pooled publish path: after N
+// cycles nothing is left in use, nothing failed, the arena stayed in bounds
+// and the heap did not grow
+
+#include <unity.h>
+#include <malloc.h>
+#include "config.h"
+#include "memory_pools.h"
+#include "json_allocators.h"
+#include "payload_encoder.h"
+#include "serial_manager.h"
+
+static const unsigned long SOAK_CYCLES = 200000;
+
+static size_t heapInUse() {
+    return mallinfo2().uordblks;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void test_pool_runs_dry_and_recovers(void) {
+    BlockPool pool("test", 48, 4, MEM_INTERNAL);
+    TEST_ASSERT_TRUE(pool.begin());
+    void* blocks[4];
+    for (uint8_t i = 0; i < 4; i++) {
+        blocks[i] = pool.acquire();
+        TEST_ASSERT_NOT_NULL(blocks[i]);
+        TEST_ASSERT_TRUE(pool.owns(blocks[i]));
+    }
+    TEST_ASSERT_NULL(pool.acquire());
+    TEST_ASSERT_EQUAL_UINT32(1, pool.getFailures());
+    TEST_ASSERT_EQUAL_UINT16(4, pool.getPeak());
+    for (uint8_t i = 0; i < 4; i++) {
+        pool.release(blocks[i]);
+    }
+    TEST_ASSERT_EQUAL_UINT16(0, pool.getInUse());
+    TEST_ASSERT_NOT_NULL(pool.acquire());
+    int outside;
+    TEST_ASSERT_FALSE(pool.owns(&outside));
+}
+
+static void test_arena_grows_in_place_and_resets(void) {
+    BumpArena arena("test", 256, MEM_INTERNAL);
+    TEST_ASSERT_TRUE(arena.begin());
+    uint8_t* first = (uint8_t*)arena.allocate(16);
+    TEST_ASSERT_NOT_NULL(first);
+    memset(first, 0x5A, 16);
+    // The most recent block grows where it is and keeps its bytes
+    uint8_t* grown = (uint8_t*)arena.reallocate(first, 64);
+    TEST_ASSERT_EQUAL_PTR(first, grown);
+    TEST_ASSERT_EQUAL_HEX8(0x5A, grown[15]);
+    TEST_ASSERT_NULL(arena.allocate(1024));
+    TEST_ASSERT_EQUAL_UINT32(1, arena.getFailures());
+    size_t peak = arena.getPeak();
+    arena.reset();
+    TEST_ASSERT_EQUAL(0, arena.getUsed());
+    TEST_ASSERT_EQUAL(peak, arena.getPeak());
+}
+
+// The native pipeline's pools, holding a random number of readings in
+// flight like a backed-up queue would
+static void test_soak(void) {
+    static TypedPool<Reading> readingPool("readings", READING_POOL_SIZE, MEM_INTERNAL);
+    static TypedPool<PayloadBuffer> payloadPool("payloads", PAYLOAD_POOL_SIZE, MEM_PSRAM);
+    static BumpArena jsonArena("json", JSON_ARENA_SIZE, MEM_INTERNAL);
+    static ArenaJsonAllocator allocator(&jsonArena);
+    TEST_ASSERT_TRUE(readingPool.begin() && payloadPool.begin() && jsonArena.begin());
+
+    JsonDocument doc(&allocator);
+    Reading* inFlight[READING_POOL_SIZE];
+    uint8_t held = 0;
+    uint32_t seed = 12345;
+    size_t baseline = 0;
+    size_t arenaPeak = 0;
+    unsigned long encoded = 0;
+    unsigned long acquired = 0;
+
+    for (unsigned long i = 0; i < SOAK_CYCLES; i++) {
+        if (i == 1000) {
+            // After every lazy allocation happened once
+            baseline = heapInUse();
+            arenaPeak = jsonArena.getPeak();
+        }
+        Reading* reading = readingPool.acquire();
+        if (reading) {
+            acquired++;
+            char nodeID[SENSOR_NODE_ID_SIZE];
+            snprintf(nodeID, sizeof(nodeID), "N%03lu", i % 64);
+            initReading(reading->data, SCHEMA_CLIMATE, nodeID);
+            ClimateSample& climate = reading->data.as<ClimateSample>();
+            climate.temp = 20.0f + (i % 100) * 0.1f;
+            climate.humidity = 50.0f + (i % 37);
+            climate.moisture = i % 100;
+            reading->data.present = 0x7;
+            inFlight[held++] = reading;
+        }
+
+        seed = seed * 1103515245 + 12345;
+        uint8_t drain = held == READING_POOL_SIZE ? held : (seed >> 16) % (held + 1);
+        while (drain-- > 0) {
+            Reading* next = inFlight[--held];
+            PayloadBuffer* payload = payloadPool.acquire();
+            TEST_ASSERT_NOT_NULL(payload);
+            payload->length = encodeReading(doc, next->data, "H-0", nullptr, i,
+                                            payload->data, sizeof(payload->data));
+            encoded += payload->length > 0;
+            payloadPool.release(payload);
+            doc.clear();
+            jsonArena.reset();
+            readingPool.release(next);
+        }
+    }
+    while (held > 0) {
+        readingPool.release(inFlight[--held]);
+    }
+
+    TEST_ASSERT_EQUAL_UINT16(0, readingPool.getInUse());
+    TEST_ASSERT_EQUAL_UINT16(0, payloadPool.getInUse());
+    TEST_ASSERT_EQUAL_UINT16(1, payloadPool.getPeak());
+    TEST_ASSERT_EQUAL_UINT32(0, payloadPool.getFailures());
+    TEST_ASSERT_EQUAL_UINT32(0, jsonArena.getFailures());
+    TEST_ASSERT_EQUAL(acquired, encoded);
+    // The high-water mark was set by the first messages and never crept
+    TEST_ASSERT_GREATER_THAN(0, arenaPeak);
+    TEST_ASSERT_EQUAL(arenaPeak, jsonArena.getPeak());
+    TEST_ASSERT_LESS_OR_EQUAL(JSON_ARENA_SIZE, jsonArena.getPeak());
+    TEST_ASSERT_LESS_OR_EQUAL(baseline, heapInUse());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_pool_runs_dry_and_recovers);
+    RUN_TEST(test_arena_grows_in_place_and_resets);
+    RUN_TEST(test_soak);
+    return UNITY_END();
+}
@@ -0,0 +1,518 @@
+// Mqtt5Client against a scripted broker on the other end of the socket:
+// every CONNACK outcome, topic aliases, the Receive Maximum window and the
+// resend of unacked publishes after a reconnect. Built with -DMQTT_V5=1
+// (env native_v5) it also runs MQTTManager's fallback to 3.1.1 and how long
+// it stays there.
+
+#include <unity.h>
+#include <string.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include "mqtt5_client.h"
+#include "mqtt_manager.h"
+
+static const int HANG_UP = -1;
+
+// A CONNACK with this reason code, and the session present flag
+static int connack(uint8_t reason, bool present = false) {
+    return reason | (present ? 0x100 : 0);
+}
+
+struct Publish {
+    uint8_t flags;              // DUP, QoS and retain bits of the fixed header
+    std::string topic;          // Empty when sent by alias alone
+    uint16_t id;                // 0 at QoS 0
+    uint16_t alias;
+    std::string payload;
+};
+
+// The broker end of the socket. Each connect() takes the next scripted
+// answer to its CONNECT: HANG_UP, or a CONNACK in whichever protocol the
+// CONNECT asked for. Everything written on the current connection is kept
+// in out; in holds what the client has yet to read.
+class ScriptedBroker : public Client {
+public:
+    std::deque<int> script;
+    std::vector<uint8_t> out;
+    std::vector<uint8_t> in;
+    std::vector<uint8_t> levels;    // Protocol level of each CONNECT: 4 is 3.1.1, 5 is MQTT 5
+    uint16_t receiveMax = 0;        // CONNACK properties, left out when 0
+    uint16_t aliasMax = 0;
+    bool refuse = false;            // No TCP connection at all
+    int failWrites = 0;             // Writes that get nothing through, the socket stays up
+    bool open = false;
+    bool answered = false;
+
+    int connect(IPAddress ip, uint16_t port) override { return 0; }
+    int connect(const char* host, uint16_t port) override {
+        if (refuse) {
+            return 0;
+        }
+        out.clear();
+        in.clear();
+        open = true;
+        answered = false;
+        return 1;
+    }
+    size_t write(uint8_t byte) override { return write(&byte, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        if (!open) {
+            return 0;
+        }
+        if (failWrites > 0) {
+            failWrites--;
+            return 0;
+        }
+        out.insert(out.end(), buffer, buffer + size);
+        if (!answered) {
+            answerConnect();
+        }
+        return size;
+    }
+    int available() override { return (int)in.size(); }
+    int read() override {
+        if (in.empty()) {
+            return -1;
+        }
+        int byte = in.front();
+        in.erase(in.begin());
+        return byte;
+    }
+    int read(uint8_t* buffer, size_t size) override {
+        size_t n = size < in.size() ? size : in.size();
+        memcpy(buffer, in.data(), n);
+        in.erase(in.begin(), in.begin() + n);
+        return (int)n;
+    }
+    int peek() override { return in.empty() ? -1 : in.front(); }
+    void flush() override {}
+    void stop() override { open = false; }
+    uint8_t connected() override { return open || !in.empty(); }
+    operator bool() override { return open; }
+
+    // The link drops without a DISCONNECT
+    void drop() {
+        open = false;
+        in.clear();
+    }
+
+    void sendPuback(uint16_t id) {
+        const uint8_t packet[] = {0x40, 0x02, (uint8_t)(id >> 8), (uint8_t)id};
+        in.insert(in.end(), packet, packet + sizeof(packet));
+    }
+
+    // Every PUBLISH of an MQTT 5 connection in out
+    std::vector<Publish> publishes() const {
+        std::vector<Publish> result;
+        size_t pos = 0;
+        while (pos < out.size()) {
+            uint8_t header = out[pos++];
+            size_t length = varInt(out, pos);
+            size_t end = pos + length;
+            if ((header & 0xF0) == 0x30) {
+                Publish publish = {};
+                publish.flags = header & 0x0F;
+                size_t topicLength = out[pos] << 8 | out[pos + 1];
+                publish.topic.assign((const char*)&out[pos + 2], topicLength);
+                size_t at = pos + 2 + topicLength;
+                if (header & 0x06) {
+                    publish.id = out[at] << 8 | out[at + 1];
+                    at += 2;
+                }
+                size_t propertiesEnd = varInt(out, at);
+                propertiesEnd += at;
+                while (at < propertiesEnd) {
+                    uint8_t id = out[at++];
+                    if (id == 0x23) {           // Topic Alias
+                        publish.alias = out[at] << 8 | out[at + 1];
+                        at += 2;
+                    } else {                    // Message Expiry
+                        at += 4;
+                    }
+                }
+                publish.payload.assign((const char*)&out[at], end - at);
+                result.push_back(publish);
+            }
+            pos = end;
+        }
+        return result;
+    }
+
+private:
+    static size_t varInt(const std::vector<uint8_t>& bytes, size_t& pos) {
+        size_t value = 0;
+        for (int shift = 0;; shift += 7) {
+            uint8_t byte = bytes[pos++];
+            value |= (size_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+    }
+
+    // Once the whole CONNECT is in
+    void answerConnect() {
+        size_t pos = 1;
+        if (out.size() < 2 || (out[0] & 0xF0) != 0x10) {
+            return;
+        }
+        size_t length = 0;
+        for (int shift = 0; pos < out.size(); shift += 7) {
+            uint8_t byte = out[pos++];
+            length |= (size_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+        if (out.size() < pos + length) {
+            return;
+        }
+        answered = true;
+        uint8_t level = out[pos + 6];       // After the protocol name "MQTT"
+        levels.push_back(level);
+        TEST_ASSERT_FALSE_MESSAGE(script.empty(), "CONNECT not in the script");
+        int answer = script.front();
+        script.pop_front();
+        if (answer == HANG_UP) {
+            open = false;
+            return;
+        }
+        uint8_t flags = answer >> 8;
+        uint8_t reason = answer & 0xFF;
+        if (level != 5) {
+            in = {0x20, 0x02, flags, reason};
+            return;
+        }
+        std::vector<uint8_t> properties;
+        if (receiveMax > 0) {
+            properties.insert(properties.end(), {0x21, (uint8_t)(receiveMax >> 8), (uint8_t)receiveMax});
+        }
+        if (aliasMax > 0) {
+            properties.insert(properties.end(), {0x22, (uint8_t)(aliasMax >> 8), (uint8_t)aliasMax});
+        }
+        in = {0x20, (uint8_t)(3 + properties.size()), flags, reason, (uint8_t)properties.size()};
+        in.insert(in.end(), properties.begin(), properties.end());
+    }
+};
+
+static ScriptedBroker broker;
+static Mqtt5Client client;
+
+void setUp(void) {
+    broker = ScriptedBroker();
+    client = Mqtt5Client();
+    client.setClient(&broker);
+    client.setServer("broker", 1883);
+}
+
+void tearDown(void) {}
+
+static Mqtt5ConnectResult connectWith(int answer) {
+    broker.script = {answer};
+    return client.connect("hub", "", "");
+}
+
+void test_connack_outcomes(void) {
+    broker.refuse = true;
+    TEST_ASSERT_EQUAL(MQTT5_NETWORK, client.connect("hub", "", ""));
+    TEST_ASSERT_TRUE(broker.levels.empty());
+    broker.refuse = false;
+
+    TEST_ASSERT_EQUAL(MQTT5_CLOSED, connectWith(HANG_UP));
+    // 3.1.1's "unacceptable protocol version" and MQTT 5's "unsupported protocol version"
+    TEST_ASSERT_EQUAL(MQTT5_UNSUPPORTED, connectWith(connack(0x01)));
+    TEST_ASSERT_EQUAL(MQTT5_UNSUPPORTED, connectWith(connack(0x84)));
+    TEST_ASSERT_EQUAL(MQTT5_REFUSED, connectWith(connack(0x87)));
+    TEST_ASSERT_EQUAL_HEX8(0x87, client.getStats().lastReason);
+    TEST_ASSERT_EQUAL(MQTT5_REFUSED, connectWith(connack(0x86)));
+    TEST_ASSERT_FALSE(client.connected());
+    TEST_ASSERT_EQUAL_UINT32(0, client.getStats().connects);
+
+    TEST_ASSERT_EQUAL(MQTT5_CONNECTED, connectWith(connack(0x00)));
+    TEST_ASSERT_TRUE(client.connected());
+    TEST_ASSERT_FALSE(client.sessionPresent());
+    broker.drop();
+    TEST_ASSERT_EQUAL(MQTT5_CONNECTED, connectWith(connack(0x00, true)));
+    TEST_ASSERT_TRUE(client.sessionPresent());
+    TEST_ASSERT_EQUAL_UINT32(2, client.getStats().connects);
+    TEST_ASSERT_EQUAL_UINT32(1, client.getStats().sessionsResumed);
+    for (uint8_t level : broker.levels) {
+        TEST_ASSERT_EQUAL_UINT8(5, level);
+    }
+}
+
+// A publish that didn't go out must not leave its alias behind: the broker
+// never learned it, so the next one has to carry the topic again
+void test_alias_committed_only_after_send(void) {
+    broker.aliasMax = 2;
+    TEST_ASSERT_EQUAL(MQTT5_CONNECTED, connectWith(connack(0x00)));
+    broker.failWrites = 1;
+    TEST_ASSERT_FALSE(client.publish("a/b", "1", 0));
+    TEST_ASSERT_TRUE(client.publish("a/b", "2", 0));
+    TEST_ASSERT_TRUE(client.publish("a/b", "3", 0));
+    TEST_ASSERT_TRUE(client.publish("c/d", "4", 0));
+    TEST_ASSERT_TRUE(client.publish("e/f", "5", 0));    // Past the broker's 2 aliases
+    TEST_ASSERT_TRUE(client.publish("e/f", "6", 0));
+
+    std::vector<Publish> sent = broker.publishes();
+    TEST_ASSERT_EQUAL(5, sent.size());
+    TEST_ASSERT_EQUAL_STRING("a/b", sent[0].topic.c_str());
+    TEST_ASSERT_EQUAL_UINT16(1, sent[0].alias);
+    TEST_ASSERT_EQUAL_STRING("", sent[1].topic.c_str());
+    TEST_ASSERT_EQUAL_UINT16(1, sent[1].alias);
+    TEST_ASSERT_EQUAL_STRING("3", sent[1].payload.c_str());
+    TEST_ASSERT_EQUAL_STRING("c/d", sent[2].topic.c_str());
+    TEST_ASSERT_EQUAL_UINT16(2, sent[2].alias);
+    for (size_t i = 3; i < 5; i++) {
+        TEST_ASSERT_EQUAL_STRING("e/f", sent[i].topic.c_str());
+        TEST_ASSERT_EQUAL_UINT16(0, sent[i].alias);
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, client.getStats().aliased);
+    TEST_ASSERT_EQUAL_UINT32(3, client.getStats().topicBytesSaved);
+
+    // Aliases last one connection
+    broker.drop();
+    TEST_ASSERT_EQUAL(MQTT5_CONNECTED, connectWith(connack(0x00, true)));
+    TEST_ASSERT_TRUE(client.publish("a/b", "7", 0));
+    sent = broker.publishes();
+    TEST_ASSERT_EQUAL(1, sent.size());
+    TEST_ASSERT_EQUAL_STRING("a/b", sent[0].topic.c_str());
+    TEST_ASSERT_EQUAL_UINT16(1, sent[0].alias);
+}
+
+void test_receive_maximum_window(void) {
+    broker.receiveMax = 2;
+    TEST_ASSERT_EQUAL(MQTT5_CONNECTED, connectWith(connack(0x00)));
+    TEST_ASSERT_EQUAL_UINT16(2, client.getStats().serverReceiveMax);
+    TEST_ASSERT_TRUE(client.publish("t", "1", 1));
+    TEST_ASSERT_TRUE(client.publish("t", "2", 1));
+    TEST_ASSERT_EQUAL_UINT8(2, client.inFlight());
+
+    // No PUBACK within MQTT5_WINDOW_WAIT_MS: dropped, nothing sent
+    uint32_t start = millis();
+    TEST_ASSERT_FALSE(client.publish("t", "3", 1));
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(MQTT5_WINDOW_WAIT_MS, millis() - start);
+    TEST_ASSERT_EQUAL_UINT32(1, client.getStats().windowWaits);
+    TEST_ASSERT_EQUAL_UINT32(1, client.getStats().windowDrops);
+    TEST_ASSERT_EQUAL(2, broker.publishes().size());
+
+    // A PUBACK for an id not in flight frees nothing
+    std::vector<Publish> sent = broker.publishes();
+    broker.sendPuback(sent[1].id + 100);
+    TEST_ASSERT_FALSE(client.publish("t", "3", 1));
+    TEST_ASSERT_EQUAL_UINT8(2, client.inFlight());
+
+    // The PUBACK of the first one makes room for the next
+    broker.sendPuback(sent[0].id);
+    TEST_ASSERT_TRUE(client.publish("t", "4", 1));
+    TEST_ASSERT_EQUAL_UINT8(2, client.inFlight());
+    sent = broker.publishes();
+    TEST_ASSERT_EQUAL(3, sent.size());
+    TEST_ASSERT_EQUAL_STRING("4", sent[2].payload.c_str());
+    TEST_ASSERT_NOT_EQUAL(sent[1].id, sent[2].id);
+
+    // QoS 0 is never held back
+    TEST_ASSERT_TRUE(client.publish("t", "5", 0));
+    TEST_ASSERT_EQUAL_UINT32(2, client.getStats().windowDrops);
+}
+
+// Two unacked publishes, then the link drops
+static void leaveTwoUnacked(std::vector<Publish>& sent) {
+    TEST_ASSERT_EQUAL(MQTT5_CONNECTED, connectWith(connack(0x00)));
+    TEST_ASSERT_TRUE(client.publish("t/1", "a", 1));
+    TEST_ASSERT_TRUE(client.publish("t/2", "b", 1));
+    sent = broker.publishes();
+    TEST_ASSERT_EQUAL(2, sent.size());
+    TEST_ASSERT_EQUAL_HEX8(0x02, sent[0].flags);
+    broker.drop();
+    TEST_ASSERT_FALSE(client.connected());
+}
+
+void test_resend_with_session_keeps_ids(void) {
+    std::vector<Publish> before;
+    leaveTwoUnacked(before);
+    TEST_ASSERT_EQUAL(MQTT5_CONNECTED, connectWith(connack(0x00, true)));
+    std::vector<Publish> after = broker.publishes();
+    TEST_ASSERT_EQUAL(2, after.size());
+    for (size_t i = 0; i < 2; i++) {
+        TEST_ASSERT_EQUAL_HEX8(0x0A, after[i].flags);       // DUP, QoS 1
+        TEST_ASSERT_EQUAL_UINT16(before[i].id, after[i].id);
+        TEST_ASSERT_EQUAL_STRING(before[i].topic.c_str(), after[i].topic.c_str());
+        TEST_ASSERT_EQUAL_STRING(before[i].payload.c_str(), after[i].payload.c_str());
+        TEST_ASSERT_EQUAL_UINT16(0, after[i].alias);
+    }
+    TEST_ASSERT_EQUAL_UINT32(2, client.getStats().resent);
+
+    // Acked now: not sent a third time
+    broker.sendPuback(before[0].id);
+    broker.sendPuback(before[1].id);
+    TEST_ASSERT_TRUE(client.loop());
+    TEST_ASSERT_EQUAL_UINT8(0, client.inFlight());
+    broker.drop();
+    TEST_ASSERT_EQUAL(MQTT5_CONNECTED, connectWith(connack(0x00, true)));
+    TEST_ASSERT_EQUAL(0, broker.publishes().size());
+}
+
+// Without the session the broker knows none of the old ids
+void test_resend_without_session_takes_new_ids(void) {
+    std::vector<Publish> before;
+    leaveTwoUnacked(before);
+    TEST_ASSERT_EQUAL(MQTT5_CONNECTED, connectWith(connack(0x00)));
+    std::vector<Publish> after = broker.publishes();
+    TEST_ASSERT_EQUAL(2, after.size());
+    for (size_t i = 0; i < 2; i++) {
+        TEST_ASSERT_EQUAL_HEX8(0x02, after[i].flags);       // QoS 1, no DUP
+        TEST_ASSERT_NOT_EQUAL(before[0].id, after[i].id);
+        TEST_ASSERT_NOT_EQUAL(before[1].id, after[i].id);
+        TEST_ASSERT_EQUAL_STRING(before[i].payload.c_str(), after[i].payload.c_str());
+    }
+    TEST_ASSERT_NOT_EQUAL(after[0].id, after[1].id);
+
+    // Acked under the new ids
+    broker.sendPuback(before[0].id);
+    TEST_ASSERT_TRUE(client.loop());
+    TEST_ASSERT_EQUAL_UINT8(2, client.inFlight());
+    broker.sendPuback(after[0].id);
+    broker.sendPuback(after[1].id);
+    TEST_ASSERT_TRUE(client.loop());
+    TEST_ASSERT_EQUAL_UINT8(0, client.inFlight());
+}
+
+void test_expired_publish_not_resent(void) {
+    TEST_ASSERT_EQUAL(MQTT5_CONNECTED, connectWith(connack(0x00)));
+    TEST_ASSERT_TRUE(client.publish("t/short", "a", 1, 1));
+    TEST_ASSERT_TRUE(client.publish("t/long", "b", 1, 600));
+    TEST_ASSERT_TRUE(client.publish("t/forever", "c", 1, 0));
+    broker.drop();
+    delay(1100);
+    TEST_ASSERT_EQUAL(MQTT5_CONNECTED, connectWith(connack(0x00, true)));
+    std::vector<Publish> after = broker.publishes();
+    TEST_ASSERT_EQUAL(2, after.size());
+    TEST_ASSERT_EQUAL_STRING("t/long", after[0].topic.c_str());
+    TEST_ASSERT_EQUAL_STRING("t/forever", after[1].topic.c_str());
+    TEST_ASSERT_EQUAL_UINT32(1, client.getStats().expired);
+    TEST_ASSERT_EQUAL_UINT8(2, client.inFlight());
+}
+
+#if MQTT_V5
+static HubConfig config;
+
+static void startManager(MQTTManager& manager, std::deque<int> script) {
+    strcpy(config.mqtt_server, "broker");
+    broker.script = script;
+    TEST_ASSERT_TRUE(manager.begin());
+    TEST_ASSERT_TRUE(broker.script.empty());
+}
+
+static bool usesV5(MQTTManager& manager) {
+    char stats[MQTT_REPORT_SIZE];
+    manager.formatStats(stats, sizeof(stats));
+    return strncmp(stats, "MQTT 5", 6) == 0;
+}
+
+void test_manager_falls_back_when_unsupported(void) {
+    static MQTTManager manager(&config, &broker);
+    startManager(manager, {connack(0x84), connack(0x00)});
+    TEST_ASSERT_EQUAL(2, broker.levels.size());
+    TEST_ASSERT_EQUAL_UINT8(5, broker.levels[0]);
+    TEST_ASSERT_EQUAL_UINT8(4, broker.levels[1]);
+    TEST_ASSERT_TRUE(manager.isConnected());
+    TEST_ASSERT_FALSE(usesV5(manager));
+}
+
+// A hang-up may be the network: MQTT 5 once more, then 3.1.1
+void test_manager_retries_closed_then_falls_back(void) {
+    static MQTTManager manager(&config, &broker);
+    startManager(manager, {HANG_UP, HANG_UP, connack(0x00)});
+    TEST_ASSERT_EQUAL(3, broker.levels.size());
+    TEST_ASSERT_EQUAL_UINT8(5, broker.levels[0]);
+    TEST_ASSERT_EQUAL_UINT8(5, broker.levels[1]);
+    TEST_ASSERT_EQUAL_UINT8(4, broker.levels[2]);
+    TEST_ASSERT_TRUE(manager.isConnected());
+    TEST_ASSERT_FALSE(usesV5(manager));
+}
+
+void test_manager_stays_on_v5_after_one_hang_up(void) {
+    static MQTTManager manager(&config, &broker);
+    startManager(manager, {HANG_UP, connack(0x00)});
+    TEST_ASSERT_EQUAL(2, broker.levels.size());
+    TEST_ASSERT_EQUAL_UINT8(5, broker.levels[1]);
+    TEST_ASSERT_TRUE(manager.isConnected());
+    TEST_ASSERT_TRUE(usesV5(manager));
+}
+// Reconnects to a broker that turned MQTT 5 down go straight to 3.1.1
+void test_manager_remembers_refusal_per_broker(void) {
+    static MQTTManager manager(&config, &broker);
+    startManager(manager, {connack(0x84), connack(0x00)});
+    broker.drop();
+    broker.script = {connack(0x00)};
+    manager.loop();
+    TEST_ASSERT_EQUAL(3, broker.levels.size());
+    TEST_ASSERT_EQUAL_UINT8(4, broker.levels[2]);
+    TEST_ASSERT_TRUE(manager.isConnected());
+
+    // Another port is another broker
+    config.mqtt_port = 1884;
+    broker.drop();
+    broker.script = {connack(0x00)};
+    manager.loop();
+    TEST_ASSERT_EQUAL_UINT8(5, broker.levels[3]);
+    TEST_ASSERT_TRUE(usesV5(manager));
+    config.mqtt_port = 1883;
+}
+
+void test_manager_asks_again_after_reconfigure(void) {
+    static MQTTManager manager(&config, &broker);
+    startManager(manager, {connack(0x84), connack(0x00)});
+    manager.reconfigure();
+    broker.script = {connack(0x00)};
+    manager.loop();
+    TEST_ASSERT_EQUAL(3, broker.levels.size());
+    TEST_ASSERT_EQUAL_UINT8(5, broker.levels[2]);
+    TEST_ASSERT_TRUE(usesV5(manager));
+}
+
+void test_manager_asks_again_after_reprobe_interval(void) {
+    if (MQTT5_REPROBE_MS > 1000) {
+        TEST_IGNORE_MESSAGE("Needs a short MQTT5_REPROBE_MS, as env native_v5 sets");
+    }
+    static MQTTManager manager(&config, &broker);
+    startManager(manager, {connack(0x84), connack(0x00)});
+    delay(MQTT5_REPROBE_MS);
+    broker.drop();
+    broker.script = {connack(0x00)};
+    manager.loop();
+    TEST_ASSERT_EQUAL(3, broker.levels.size());
+    TEST_ASSERT_EQUAL_UINT8(5, broker.levels[2]);
+    TEST_ASSERT_TRUE(usesV5(manager));
+}
+#else
+static void needsV5(void) {
+    TEST_IGNORE_MESSAGE("MQTTManager's fallback needs -DMQTT_V5=1: pio test -e native_v5");
+}
+
+void test_manager_falls_back_when_unsupported(void) { needsV5(); }
+void test_manager_retries_closed_then_falls_back(void) { needsV5(); }
+void test_manager_stays_on_v5_after_one_hang_up(void) { needsV5(); }
+void test_manager_remembers_refusal_per_broker(void) { needsV5(); }
+void test_manager_asks_again_after_reconfigure(void) { needsV5(); }
+void test_manager_asks_again_after_reprobe_interval(void) { needsV5(); }
+#endif
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_connack_outcomes);
+    RUN_TEST(test_alias_committed_only_after_send);
+    RUN_TEST(test_receive_maximum_window);
+    RUN_TEST(test_resend_with_session_keeps_ids);
+    RUN_TEST(test_resend_without_session_takes_new_ids);
+    RUN_TEST(test_expired_publish_not_resent);
+    RUN_TEST(test_manager_falls_back_when_unsupported);
+    RUN_TEST(test_manager_retries_closed_then_falls_back);
+    RUN_TEST(test_manager_stays_on_v5_after_one_hang_up);
+    RUN_TEST(test_manager_remembers_refusal_per_broker);
+    RUN_TEST(test_manager_asks_again_after_reconfigure);
+    RUN_TEST(test_manager_asks_again_after_reprobe_interval);
+    return UNITY_END();
+}
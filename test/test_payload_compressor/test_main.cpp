@@ -0,0 +1,258 @@
+// PayloadCompressor: frames decompress back to the messages that went in,
+// with and without the dictionary; a message that doesn't fit leaves the
+// frame byte for byte as it was; malformed frames are refused; and one
+// frame is pinned, so any change to the dictionary or the bit stream fails
+// here before it breaks the decoders on the other end.
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "payload_compressor.h"
+
+static uint32_t rngState;
+
+static uint32_t nextRandom() {
+    rngState = rngState * 1664525u + 1013904223u;
+    return rngState >> 8;
+}
+
+// A reading as encodeReading writes it
+static std::string reading(uint32_t node) {
+    char message[MQTT_MAX_PACKET_SIZE];
+    snprintf(message, sizeof(message),
+             "{\"sensor_id\":\"N%03u\",\"hub_id\":\"H-0\",\"schema\":\"climate\",\"temp\":%u.%u,"
+             "\"humidity\":%u.%u,\"moisture\":%u,\"quality\":0,\"date\":{\"year\":2026,\"month\":%u,"
+             "\"day\":%u,\"hour\":%u,\"minute\":%u,\"second\":%u}}",
+             (unsigned)(node % 1000), (unsigned)(10 + nextRandom() % 20), (unsigned)(nextRandom() % 10),
+             (unsigned)(30 + nextRandom() % 60), (unsigned)(nextRandom() % 10), (unsigned)(nextRandom() % 1024),
+             (unsigned)(1 + nextRandom() % 12), (unsigned)(1 + nextRandom() % 28), (unsigned)(nextRandom() % 24),
+             (unsigned)(nextRandom() % 60), (unsigned)(nextRandom() % 60));
+    return message;
+}
+
+static std::string unpack(const PayloadCompressor& compressor) {
+    char text[COMPRESS_INPUT_MAX + 1];
+    size_t length = PayloadCompressor::decompress(compressor.frame(), compressor.size(), text, sizeof(text));
+    TEST_ASSERT_TRUE_MESSAGE(length > 0, "frame didn't decompress");
+    return std::string(text, length);
+}
+
+static PayloadCompressor compressor;
+
+void setUp(void) {
+    rngState = 1;
+    compressor.reset();
+}
+
+void tearDown(void) {}
+
+void test_single_message_round_trip(void) {
+    for (int dictionary = 1; dictionary >= 0; dictionary--) {
+        compressor.reset(dictionary);
+        std::string message = reading(7);
+        TEST_ASSERT_TRUE(compressor.add(message.data(), message.size()));
+        TEST_ASSERT_EQUAL_UINT8(1, compressor.messages());
+        TEST_ASSERT_EQUAL(message.size(), compressor.rawSize());
+        TEST_ASSERT_EQUAL_UINT8(COMPRESS_MAGIC, compressor.frame()[0]);
+        TEST_ASSERT_EQUAL_UINT8(dictionary ? COMPRESS_DICT_VERSION : 0, compressor.frame()[2]);
+        TEST_ASSERT_EQUAL_STRING(message.c_str(), unpack(compressor).c_str());
+    }
+}
+
+// The dictionary is what makes a lone message worth compressing
+void test_dictionary_shrinks_first_message(void) {
+    std::string message = reading(7);
+    compressor.reset(true);
+    TEST_ASSERT_TRUE(compressor.add(message.data(), message.size()));
+    size_t withDictionary = compressor.size();
+    compressor.reset(false);
+    TEST_ASSERT_TRUE(compressor.add(message.data(), message.size()));
+    TEST_ASSERT_LESS_THAN(compressor.size(), withDictionary);
+    TEST_ASSERT_LESS_THAN(message.size() / 2, withDictionary);
+}
+
+void test_batches_round_trip(void) {
+    for (uint32_t seed = 1; seed <= 50; seed++) {
+        rngState = seed;
+        compressor.reset(seed % 2 == 0);
+        std::string expected;
+        uint32_t wanted = 1 + nextRandom() % 6;
+        for (uint32_t i = 0; i < wanted; i++) {
+            std::string message = reading(nextRandom() % 64);
+            if (!compressor.add(message.data(), message.size())) {
+                break;
+            }
+            expected += (i > 0 ? "\n" : "") + message;
+        }
+        TEST_ASSERT_TRUE(compressor.messages() > 0);
+        TEST_ASSERT_EQUAL(expected.size(), compressor.rawSize());
+        TEST_ASSERT_EQUAL_STRING(expected.c_str(), unpack(compressor).c_str());
+    }
+}
+
+// Adds until one doesn't fit; that one must leave no trace, down to the
+// padding bits of the last byte
+void test_rejected_message_leaves_frame_unchanged(void) {
+    for (uint32_t seed = 1; seed <= 100; seed++) {
+        rngState = seed;
+        compressor.reset(seed % 3 != 0);
+        std::string expected;
+        while (true) {
+            std::string message = reading(nextRandom() % 1000);
+            // Now and then a message of random bytes, which hardly compresses
+            // and alone may not fit an empty frame
+            if (compressor.messages() > 0 && nextRandom() % 4 == 0) {
+                for (char& c : message) {
+                    c = (char)(' ' + nextRandom() % 95);
+                }
+            }
+            uint8_t before[COMPRESS_FRAME_MAX];
+            memcpy(before, compressor.frame(), sizeof(before));
+            size_t size = compressor.size();
+            uint8_t count = compressor.messages();
+            size_t raw = compressor.rawSize();
+            if (compressor.add(message.data(), message.size())) {
+                expected += (count > 0 ? "\n" : "") + message;
+                continue;
+            }
+            TEST_ASSERT_EQUAL_MEMORY(before, compressor.frame(), sizeof(before));
+            TEST_ASSERT_EQUAL(size, compressor.size());
+            TEST_ASSERT_EQUAL_UINT8(count, compressor.messages());
+            TEST_ASSERT_EQUAL(raw, compressor.rawSize());
+            break;
+        }
+        TEST_ASSERT_TRUE(compressor.messages() > 0);
+        TEST_ASSERT_EQUAL_STRING(expected.c_str(), unpack(compressor).c_str());
+
+        // A short one may still fit after a long one was refused
+        const char* tail = "{}";
+        if (compressor.add(tail, 2)) {
+            expected += "\n{}";
+        }
+        TEST_ASSERT_EQUAL_STRING(expected.c_str(), unpack(compressor).c_str());
+    }
+    TEST_ASSERT_TRUE(compressor.getStats().full > 0);
+}
+
+void test_malformed_frames_refused(void) {
+    std::string message = reading(7);
+    TEST_ASSERT_TRUE(compressor.add(message.data(), message.size()));
+    std::vector<uint8_t> good(compressor.frame(), compressor.frame() + compressor.size());
+    char text[COMPRESS_INPUT_MAX];
+
+    TEST_ASSERT_EQUAL(0, PayloadCompressor::decompress(good.data(), 2, text, sizeof(text)));
+    std::vector<uint8_t> frame = good;
+    frame[0] = '{';
+    TEST_ASSERT_EQUAL(0, PayloadCompressor::decompress(frame.data(), frame.size(), text, sizeof(text)));
+    frame = good;
+    frame[1] ^= 0x01;                   // Other window or length bits
+    TEST_ASSERT_EQUAL(0, PayloadCompressor::decompress(frame.data(), frame.size(), text, sizeof(text)));
+    frame = good;
+    frame[2] = COMPRESS_DICT_VERSION + 1;
+    TEST_ASSERT_EQUAL(0, PayloadCompressor::decompress(frame.data(), frame.size(), text, sizeof(text)));
+
+    // Output buffer too small, by one byte for the terminator
+    TEST_ASSERT_EQUAL(0, PayloadCompressor::decompress(good.data(), good.size(), text, message.size()));
+    TEST_ASSERT_EQUAL(message.size(),
+                      PayloadCompressor::decompress(good.data(), good.size(), text, message.size() + 1));
+
+    // A first match reaching back past the dictionary, or anything at all
+    // without one: 0, offset 1023 (all ones), length
+    const uint8_t reachBack[] = {COMPRESS_MAGIC, COMPRESS_WINDOW_BITS << 4 | COMPRESS_LENGTH_BITS,
+                                 COMPRESS_DICT_VERSION, 0x7F, 0xE0, 0x00};
+    TEST_ASSERT_EQUAL(0, PayloadCompressor::decompress(reachBack, sizeof(reachBack), text, sizeof(text)));
+    frame = std::vector<uint8_t>(reachBack, reachBack + sizeof(reachBack));
+    frame[2] = 0;
+    frame[3] = 0x00;                    // Match at offset 1 with nothing before it
+    TEST_ASSERT_EQUAL(0, PayloadCompressor::decompress(frame.data(), frame.size(), text, sizeof(text)));
+}
+
+// Any change to DICTIONARY, the match search or the bit layout changes
+// these bytes. Update them only together with COMPRESS_DICT_VERSION and
+// the decoder in tools/loadgen.py.
+void test_pinned_frame(void) {
+    const char* messages[] = {
+        "{\"sensor_id\":\"N012\",\"hub_id\":\"H-0\",\"schema\":\"climate\",\"temp\":21.5,\"humidity\":48.2,"
+        "\"moisture\":512,\"quality\":0,\"date\":{\"year\":2026,\"month\":10,\"day\":18,\"hour\":9,"
+        "\"minute\":30,\"second\":0}}",
+        "{\"sensor_id\":\"N013\",\"hub_id\":\"H-0\",\"schema\":\"rain\",\"rain_mm\":0.4,\"quality\":0,"
+        "\"date\":{\"year\":2026,\"month\":10,\"day\":18,\"hour\":9,\"minute\":30,\"second\":1}}",
+    };
+    static const uint8_t PINNED[] = {
+        0x5A, 0xA5, 0x01, 0x0A, 0x8E, 0x98, 0x8D, 0xA0, 0x05, 0x6F, 0x85, 0x64,
+        0x4C, 0x65, 0xC1, 0x30, 0x21, 0x65, 0x13, 0x49, 0xC4, 0xB8, 0x34, 0x84,
+        0x2E, 0x22, 0x6A, 0x13, 0x40, 0x40, 0x79, 0x32, 0x9B, 0x10, 0x33, 0xCC,
+        0x40, 0xF0, 0xC1, 0x30, 0x66, 0x33, 0x82, 0x0E, 0x69, 0xC9, 0x08, 0x44,
+        0xCC, 0x0E, 0x84, 0x85, 0x1A, 0x60, 0x42, 0xC0, 0x42, 0xDF, 0x31, 0x99,
+        0x8B, 0x6C, 0x99, 0x72, 0x9A, 0x83, 0xCC, 0x25, 0xD3, 0x41, 0x2D, 0xF1,
+        0x2D, 0xF1, 0x2C, 0xF9, 0x88, 0x96, 0x00
+    };
+    for (const char* message : messages) {
+        TEST_ASSERT_TRUE(compressor.add(message, strlen(message)));
+    }
+    TEST_ASSERT_EQUAL(sizeof(PINNED), compressor.size());
+    TEST_ASSERT_EQUAL_MEMORY(PINNED, compressor.frame(), sizeof(PINNED));
+
+    char text[COMPRESS_INPUT_MAX];
+    std::string expected = std::string(messages[0]) + "\n" + messages[1];
+    TEST_ASSERT_EQUAL(expected.size(), PayloadCompressor::decompress(PINNED, sizeof(PINNED), text, sizeof(text)));
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), text);
+}
+
+// The dictionary as tools/loadgen.py and every other decoder has it
+static const char DICTIONARY_V1[] =
+    ",\"gust_ms\":,\"wind_dir\":,\"wind_ms\":\"wind\""
+    ",\"solar_wm2\":\"solar\",\"rain_mm\":\"rain\",\"uptime_ms\":"
+    ",\"quality\":0,\"date\":{\"year\":20,\"month\":,\"day\":,\"hour\":,\"minute\":,\"second\":}}\n"
+    "{\"sensor_id\":\"N0\",\"hub_id\":\"H-0\",\"schema\":\"climate\",\"temp\":2,\"humidity\":5,\"moisture\":";
+
+// A frame of matches that all reach back to the start of the dictionary,
+// so the text it decodes to is the dictionary itself
+static std::vector<uint8_t> copyOfDictionary(size_t offset, size_t length) {
+    std::vector<uint8_t> frame = {COMPRESS_MAGIC, COMPRESS_WINDOW_BITS << 4 | COMPRESS_LENGTH_BITS,
+                                  COMPRESS_DICT_VERSION};
+    size_t bit = frame.size() * 8;
+    auto put = [&](uint32_t value, uint8_t bits) {
+        for (int8_t i = bits - 1; i >= 0; i--, bit++) {
+            if (bit / 8 == frame.size()) {
+                frame.push_back(0);
+            }
+            frame[bit / 8] |= (value >> i & 1) << (7 - bit % 8);
+        }
+    };
+    const size_t matchMax = COMPRESS_MATCH_MIN + ((size_t)1 << COMPRESS_LENGTH_BITS) - 1;
+    for (size_t done = 0; done < length;) {
+        size_t count = length - done < matchMax ? length - done : matchMax;
+        put(0, 1);
+        put(offset - 1, COMPRESS_WINDOW_BITS);
+        put(count - COMPRESS_MATCH_MIN, COMPRESS_LENGTH_BITS);
+        done += count;
+    }
+    return frame;
+}
+
+// test_pinned_frame only sees the part of the dictionary its messages use
+void test_dictionary_pinned(void) {
+    size_t length = sizeof(DICTIONARY_V1) - 1;
+    char text[COMPRESS_INPUT_MAX];
+    std::vector<uint8_t> frame = copyOfDictionary(length, length);
+    TEST_ASSERT_EQUAL(length, PayloadCompressor::decompress(frame.data(), frame.size(), text, sizeof(text)));
+    TEST_ASSERT_EQUAL_STRING(DICTIONARY_V1, text);
+    // A byte further back is before the dictionary
+    frame = copyOfDictionary(length + 1, length);
+    TEST_ASSERT_EQUAL(0, PayloadCompressor::decompress(frame.data(), frame.size(), text, sizeof(text)));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_single_message_round_trip);
+    RUN_TEST(test_dictionary_shrinks_first_message);
+    RUN_TEST(test_batches_round_trip);
+    RUN_TEST(test_rejected_message_leaves_frame_unchanged);
+    RUN_TEST(test_malformed_frames_refused);
+    RUN_TEST(test_pinned_frame);
+    RUN_TEST(test_dictionary_pinned);
+    return UNITY_END();
+}
@@ -0,0 +1,279 @@
+// PowerPolicy under synthetic ingest load, stepped at POWER_UPDATE_INTERVAL
+// like the loop task does: levels go up on the update that asks for it,
+// come down one step per POWER_HOLD_MS without that load, and a load that
+// comes and goes faster than the hold time never flaps the clock
+
+#include <unity.h>
+#include <string.h>
+#include "power_policy.h"
+
+static uint32_t rngState;
+
+static uint32_t nextRandom() {
+    rngState = rngState * 1664525u + 1013904223u;
+    return rngState >> 8;
+}
+
+// The level the inputs call for, from the thresholds in config.h
+static PowerLevel wanted(const PowerInputs& in) {
+    if (in.queueDepth >= POWER_BURST_DEPTH || in.backlog >= POWER_BURST_DEPTH) return POWER_BURST;
+    if (in.queueDepth > 0 || in.backlog > 0 || in.interactive || in.msSinceReading < POWER_IDLE_AFTER) {
+        return POWER_ACTIVE;
+    }
+    return POWER_IDLE;
+}
+
+static PowerInputs quiet(uint32_t msSinceReading) {
+    PowerInputs in = {0, 0, msSinceReading, false};
+    return in;
+}
+
+static PowerInputs loaded(uint16_t depth) {
+    PowerInputs in = {depth, 0, 0, false};
+    return in;
+}
+
+// Runs in for durationMs from *nowMs, msSinceReading growing with the time
+// if grow is set. Returns the level at the end.
+static PowerLevel hold(PowerPolicy& policy, PowerInputs in, uint32_t& nowMs, uint32_t durationMs, bool grow) {
+    PowerLevel level = policy.current().level;
+    for (uint32_t t = 0; t < durationMs; t += POWER_UPDATE_INTERVAL) {
+        nowMs += POWER_UPDATE_INTERVAL;
+        if (grow) in.msSinceReading += POWER_UPDATE_INTERVAL;
+        level = policy.update(in, nowMs).level;
+    }
+    return level;
+}
+
+void setUp(void) {
+    rngState = 31337;
+}
+
+void tearDown(void) {}
+
+// Boot runs flat out, then steps down one level per hold time once the
+// readings stop: burst, active, idle
+void test_steps_down_one_level_per_hold(void) {
+    PowerPolicy policy;
+    TEST_ASSERT_EQUAL(POWER_BURST, policy.current().level);
+    uint32_t now = 1000;
+    PowerInputs in = quiet(POWER_IDLE_AFTER);
+    TEST_ASSERT_EQUAL(POWER_BURST, policy.update(in, now).level);
+    TEST_ASSERT_EQUAL(POWER_BURST, hold(policy, in, now, POWER_HOLD_MS - POWER_UPDATE_INTERVAL, false));
+    TEST_ASSERT_EQUAL(POWER_ACTIVE, hold(policy, in, now, POWER_UPDATE_INTERVAL, false));
+    TEST_ASSERT_EQUAL(POWER_ACTIVE, hold(policy, in, now, POWER_HOLD_MS - POWER_UPDATE_INTERVAL, false));
+    TEST_ASSERT_EQUAL(POWER_IDLE, hold(policy, in, now, POWER_UPDATE_INTERVAL, false));
+    TEST_ASSERT_EQUAL(POWER_IDLE, hold(policy, in, now, 60000, false));
+    TEST_ASSERT_EQUAL_UINT32(2, policy.getStats().transitions);
+    TEST_ASSERT_EQUAL(POWER_LIGHT_SLEEP != 0, policy.current().lightSleep);
+}
+
+// Any load takes effect on the update that sees it, from any level
+void test_goes_up_at_once(void) {
+    PowerPolicy policy;
+    uint32_t now = 1000;
+    hold(policy, quiet(POWER_IDLE_AFTER), now, 3 * POWER_HOLD_MS, false);
+    TEST_ASSERT_EQUAL(POWER_IDLE, policy.current().level);
+
+    now += POWER_UPDATE_INTERVAL;
+    TEST_ASSERT_EQUAL(POWER_BURST, policy.update(loaded(POWER_BURST_DEPTH), now).level);
+    TEST_ASSERT_FALSE(policy.current().lightSleep);
+    hold(policy, quiet(POWER_IDLE_AFTER), now, 3 * POWER_HOLD_MS, false);
+
+    PowerInputs backlog = {0, POWER_BURST_DEPTH, 0, false};
+    now += POWER_UPDATE_INTERVAL;
+    TEST_ASSERT_EQUAL(POWER_BURST, policy.update(backlog, now).level);
+    hold(policy, quiet(POWER_IDLE_AFTER), now, 3 * POWER_HOLD_MS, false);
+
+    // One reading waiting, a viewer, or a reading just in: active
+    PowerInputs inputs[] = {loaded(1), {0, 1, POWER_IDLE_AFTER, false}, {0, 0, POWER_IDLE_AFTER, true},
+                            quiet(POWER_IDLE_AFTER - 1)};
+    for (const PowerInputs& in : inputs) {
+        now += POWER_UPDATE_INTERVAL;
+        TEST_ASSERT_EQUAL(POWER_ACTIVE, policy.update(in, now).level);
+        hold(policy, quiet(POWER_IDLE_AFTER), now, 2 * POWER_HOLD_MS, false);
+        TEST_ASSERT_EQUAL(POWER_IDLE, policy.current().level);
+    }
+    // Just under the burst depth is not a burst
+    now += POWER_UPDATE_INTERVAL;
+    TEST_ASSERT_EQUAL(POWER_ACTIVE, policy.update(loaded(POWER_BURST_DEPTH - 1), now).level);
+}
+
+// Bursts of readings closer together than the hold time keep the level
+// where it is; further apart, it comes down one step in between
+void test_hysteresis_against_flapping(void) {
+    PowerPolicy policy;
+    uint32_t now = 1000;
+    policy.update(loaded(POWER_BURST_DEPTH), now);
+    uint32_t before = policy.getStats().transitions;
+    for (int burst = 0; burst < 50; burst++) {
+        hold(policy, loaded(POWER_BURST_DEPTH + 2), now, POWER_UPDATE_INTERVAL, false);
+        TEST_ASSERT_EQUAL(POWER_BURST, hold(policy, loaded(1), now, POWER_HOLD_MS - POWER_UPDATE_INTERVAL, false));
+    }
+    TEST_ASSERT_EQUAL_UINT32(before, policy.getStats().transitions);
+
+    for (int burst = 0; burst < 10; burst++) {
+        hold(policy, loaded(POWER_BURST_DEPTH), now, POWER_UPDATE_INTERVAL, false);
+        TEST_ASSERT_EQUAL(POWER_ACTIVE, hold(policy, loaded(1), now, POWER_HOLD_MS, false));
+    }
+    TEST_ASSERT_EQUAL_UINT32(before + 19, policy.getStats().transitions);
+
+    // Readings every few seconds keep it active, never idle in between
+    hold(policy, quiet(POWER_IDLE_AFTER), now, 3 * POWER_HOLD_MS, false);
+    TEST_ASSERT_EQUAL(POWER_IDLE, policy.current().level);
+    before = policy.getStats().transitions;
+    for (int reading = 0; reading < 20; reading++) {
+        now += POWER_UPDATE_INTERVAL;
+        policy.update(loaded(1), now);
+        TEST_ASSERT_EQUAL(POWER_ACTIVE, hold(policy, quiet(0), now, POWER_IDLE_AFTER / 2, true));
+    }
+    TEST_ASSERT_EQUAL_UINT32(before + 1, policy.getStats().transitions);
+}
+
+void test_display_follows_readings_and_viewers(void) {
+    PowerPolicy policy;
+    uint32_t now = 1000;
+    PowerInputs in = quiet(0);
+    TEST_ASSERT_EQUAL(DISPLAY_ON, policy.update(in, now).display);
+    hold(policy, in, now, POWER_DISPLAY_DIM_AFTER - POWER_UPDATE_INTERVAL, true);
+    TEST_ASSERT_EQUAL(DISPLAY_ON, policy.current().display);
+    in.msSinceReading = POWER_DISPLAY_DIM_AFTER - POWER_UPDATE_INTERVAL;
+    hold(policy, in, now, POWER_UPDATE_INTERVAL, true);
+    TEST_ASSERT_EQUAL(DISPLAY_DIM, policy.current().display);
+    in.msSinceReading = POWER_DISPLAY_OFF_AFTER - 1;
+    now += POWER_UPDATE_INTERVAL;
+    TEST_ASSERT_EQUAL(DISPLAY_DIM, policy.update(in, now).display);
+    in.msSinceReading = POWER_DISPLAY_OFF_AFTER;
+    now += POWER_UPDATE_INTERVAL;
+    TEST_ASSERT_EQUAL(DISPLAY_OFF, policy.update(in, now).display);
+    TEST_ASSERT_EQUAL(POWER_IDLE, policy.current().level);
+
+    // Someone opens the portal: display on and active at once
+    in.interactive = true;
+    now += POWER_UPDATE_INTERVAL;
+    PowerDecision decision = policy.update(in, now);
+    TEST_ASSERT_EQUAL(DISPLAY_ON, decision.display);
+    TEST_ASSERT_EQUAL(POWER_ACTIVE, decision.level);
+    // A reading turns it back on too
+    in.interactive = false;
+    hold(policy, in, now, POWER_HOLD_MS, false);
+    TEST_ASSERT_EQUAL(DISPLAY_OFF, policy.current().display);
+    now += POWER_UPDATE_INTERVAL;
+    TEST_ASSERT_EQUAL(DISPLAY_ON, policy.update(quiet(0), now).display);
+}
+
+// Time is charged to the level and display state in force since the last
+// update, across the millis() wrap too
+void test_time_accounting(void) {
+    PowerPolicy policy;
+    uint32_t now = 0xFFFFFFFFu - 5000;
+    uint32_t start = now;
+    policy.update(quiet(POWER_IDLE_AFTER), now);
+    hold(policy, quiet(POWER_IDLE_AFTER), now, 20000, false);
+    const PowerStats& stats = policy.getStats();
+    TEST_ASSERT_EQUAL_UINT32(20000, (uint32_t)(stats.msAt[POWER_IDLE] + stats.msAt[POWER_ACTIVE] + stats.msAt[POWER_BURST]));
+    TEST_ASSERT_EQUAL_UINT32(POWER_HOLD_MS, (uint32_t)stats.msAt[POWER_BURST]);
+    TEST_ASSERT_EQUAL_UINT32(POWER_HOLD_MS, (uint32_t)stats.msAt[POWER_ACTIVE]);
+    TEST_ASSERT_EQUAL_UINT32(20000 - 2 * POWER_HOLD_MS, (uint32_t)stats.msAt[POWER_IDLE]);
+    TEST_ASSERT_EQUAL_UINT32(20000, (uint32_t)stats.msDisplay[DISPLAY_ON]);
+    TEST_ASSERT_EQUAL_UINT32(20000, now - start);
+
+    uint32_t idleMa = POWER_LIGHT_SLEEP ? POWER_MA_SLEEP : POWER_MA_IDLE;
+    uint32_t expected = (uint32_t)(((uint64_t)POWER_HOLD_MS * POWER_MA_BURST * 10 +
+                                    (uint64_t)POWER_HOLD_MS * POWER_MA_ACTIVE * 10 +
+                                    (uint64_t)(20000 - 2 * POWER_HOLD_MS) * idleMa * 10) / 20000);
+    TEST_ASSERT_EQUAL_UINT32(expected, policy.estimatedDeciMilliamps());
+
+    char report[POWER_REPORT_SIZE];
+    size_t len = policy.format(report, sizeof(report));
+    TEST_ASSERT_EQUAL(strlen(report), len);
+    TEST_ASSERT_NOT_NULL(strstr(report, "Power: idle (80 MHz)"));
+    TEST_ASSERT_NOT_NULL(strstr(report, "2 transitions"));
+}
+
+// Hours of random ingest: bursts of readings, stalls, viewers coming and
+// going. Every update is checked against the rule it should follow: at
+// least the wanted level, down only one step and only a full hold time
+// after the level was last wanted or last stepped down, and down as soon
+// as that time is up.
+void test_random_load_follows_the_rules(void) {
+    PowerPolicy policy;
+    uint32_t now = 1000;
+    uint32_t lastReadingMs = now;
+    uint16_t depth = 0;
+    uint16_t backlog = 0;
+    bool interactive = false;
+    uint32_t heldSince = now;
+    uint32_t transitions = 0;
+    uint32_t seen[POWER_LEVEL_COUNT] = {0};
+    PowerLevel previous = policy.current().level;
+    bool first = true;
+
+    for (int step = 0; step < 100000; step++) {
+        now += POWER_UPDATE_INTERVAL;
+        // Readings arrive in bursts of a few, or not for a long while
+        uint32_t roll = nextRandom() % 1000;
+        if (roll < 40) {
+            uint16_t arrived = 1 + nextRandom() % (roll < 5 ? 12 : 3);
+            depth += arrived;
+            lastReadingMs = now;
+        }
+        // mqttTask drains some, sometimes stalls with a backlog
+        if (nextRandom() % 4 != 0 && depth > 0) {
+            uint16_t drained = 1 + nextRandom() % 3;
+            depth -= drained < depth ? drained : depth;
+        }
+        backlog = nextRandom() % 50 == 0 ? nextRandom() % 8 : backlog > 0 ? backlog - 1 : 0;
+        if (nextRandom() % 500 == 0) interactive = !interactive;
+        if (step % 20000 == 10000) {
+            // A long silence, so idle and the display timeouts come up
+            now += POWER_DISPLAY_OFF_AFTER;
+            depth = 0;
+            backlog = 0;
+            interactive = false;
+        }
+
+        PowerInputs in = {depth, backlog, now - lastReadingMs, interactive};
+        PowerLevel want = wanted(in);
+        PowerDecision decision = policy.update(in, now);
+        if (first) {
+            heldSince = now;
+            first = false;
+        }
+
+        TEST_ASSERT_TRUE_MESSAGE(decision.level >= want, "below the wanted level");
+        if (want >= previous) {
+            TEST_ASSERT_EQUAL(want, decision.level);
+            heldSince = now;
+        } else if (now - heldSince >= POWER_HOLD_MS) {
+            TEST_ASSERT_EQUAL_MESSAGE(previous - 1, decision.level, "held past its time");
+            heldSince = now;
+        } else {
+            TEST_ASSERT_EQUAL_MESSAGE(previous, decision.level, "came down early");
+        }
+        if (decision.level != previous) transitions++;
+        TEST_ASSERT_EQUAL(POWER_LIGHT_SLEEP && decision.level == POWER_IDLE, decision.lightSleep);
+
+        DisplayMode display = interactive || in.msSinceReading < POWER_DISPLAY_DIM_AFTER ? DISPLAY_ON
+                              : in.msSinceReading < POWER_DISPLAY_OFF_AFTER              ? DISPLAY_DIM
+                                                                                         : DISPLAY_OFF;
+        TEST_ASSERT_EQUAL(display, decision.display);
+        seen[decision.level]++;
+        previous = decision.level;
+    }
+    TEST_ASSERT_EQUAL_UINT32(transitions, policy.getStats().transitions);
+    for (uint8_t level = 0; level < POWER_LEVEL_COUNT; level++) {
+        TEST_ASSERT_GREATER_THAN_UINT32(100, seen[level]);
+    }
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_steps_down_one_level_per_hold);
+    RUN_TEST(test_goes_up_at_once);
+    RUN_TEST(test_hysteresis_against_flapping);
+    RUN_TEST(test_display_follows_readings_and_viewers);
+    RUN_TEST(test_time_accounting);
+    RUN_TEST(test_random_load_follows_the_rules);
+    return UNITY_END();
+}
@@ -0,0 +1,369 @@
+// ReportFilter: every trace is rebuilt from the published points the way a
+// subscriber would (hold the last value for deadband, interpolate for
+// swinging door) and no reading may end up further than its band from it,
+// heartbeats and forced publishes included
+
+#include <unity.h>
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include "report_filter.h"
+#include "sensor_quality.h"
+
+static uint32_t rngState;
+
+static uint32_t nextRandom() {
+    rngState = rngState * 1664525u + 1013904223u;
+    return rngState >> 8;
+}
+
+// Uniform in [-1, 1]
+static float unit() {
+    return (float)(nextRandom() % 20001) / 10000.0f - 1.0f;
+}
+
+static ReportFilterConfig configFor(ReportMode mode, uint32_t heartbeatMs) {
+    ReportFilterConfig config = ReportFilterConfig::defaults();
+    config.mode = mode;
+    config.heartbeatMs = heartbeatMs;
+    return config;
+}
+
+struct NodeTrace {
+    const char* nodeID;
+    uint8_t schemaId;
+    std::vector<ReportSample> offered;
+    std::vector<ReportSample> published;
+    float level[QUANTITY_COUNT];
+};
+
+// Next reading of a node: a random walk about the size of the bands, with
+// jumps, NaN gaps and quality changes mixed in
+static SensorReading nextReading(NodeTrace& trace) {
+    SensorReading reading;
+    initReading(reading, trace.schemaId, trace.nodeID);
+    const SchemaInfo* schema = reading.schema();
+    reading.present = 0xFFFF >> (16 - schema->fieldCount);
+    ReportFilterConfig bands = ReportFilterConfig::defaults();
+    uint16_t quantities = reading.quantities();
+    for (uint8_t q = Q_TEMP; q < QUANTITY_COUNT; q++) {
+        if (!(quantities & (1u << q))) {
+            continue;
+        }
+        uint32_t roll = nextRandom() % 100;
+        if (roll < 2) {
+            trace.level[q] += 20 * bands.absolute[q] * unit();
+        } else if (roll < 90) {
+            trace.level[q] += 0.6f * bands.absolute[q] * unit();
+        }
+        float value = roll == 99 ? NAN : trace.level[q];
+        schema->setValue(reading, (Quantity)q, value);
+    }
+    reading.quality = nextRandom() % 50 == 0 ? QUALITY_RATE : 0;
+    return reading;
+}
+
+static void offer(ReportFilter& filter, NodeTrace& trace, const SensorReading& reading, uint32_t nowMs) {
+    ReportSample sample;
+    sample.data = reading;
+    sample.receivedMs = nowMs;
+    trace.offered.push_back(sample);
+    ReportSample out[2];
+    uint8_t emitted = filter.offer(reading, nowMs, out);
+    TEST_ASSERT_LESS_OR_EQUAL(2, emitted);
+    for (uint8_t i = 0; i < emitted; i++) {
+        trace.published.push_back(out[i]);
+    }
+}
+
+// Runs interleaved traces of several nodes, readings 0.5 to 60 s apart
+static std::vector<NodeTrace> runTraces(ReportFilter& filter, uint32_t startMs, int readings) {
+    static const char* const NODES[] = {"N01", "N02", "N03"};
+    static const uint8_t SCHEMAS[] = {SCHEMA_CLIMATE, SCHEMA_WIND, SCHEMA_SOLAR};
+    std::vector<NodeTrace> traces(3);
+    for (int n = 0; n < 3; n++) {
+        traces[n].nodeID = NODES[n];
+        traces[n].schemaId = SCHEMAS[n];
+        for (uint8_t q = 0; q < QUANTITY_COUNT; q++) {
+            traces[n].level[q] = 100.0f * unit();
+        }
+    }
+    uint32_t nowMs = startMs;
+    for (int i = 0; i < readings; i++) {
+        nowMs += 500 + nextRandom() % 60000;
+        NodeTrace& trace = traces[nextRandom() % 3];
+        offer(filter, trace, nextReading(trace), nowMs);
+    }
+    return traces;
+}
+
+static void assertOrdered(const NodeTrace& trace) {
+    for (size_t i = 1; i < trace.published.size(); i++) {
+        // Signed, so a wrapped millis() still counts as later
+        TEST_ASSERT_TRUE((int32_t)(trace.published[i].receivedMs - trace.published[i - 1].receivedMs) >= 0);
+    }
+}
+
+// Sample and hold: each reading against the last one published at or
+// before it must stay inside the band around that one
+static void assertDeadbandReconstruction(const NodeTrace& trace, const ReportFilterConfig& config) {
+    assertOrdered(trace);
+    TEST_ASSERT_FALSE(trace.published.empty());
+    size_t p = 0;
+    for (const ReportSample& reading : trace.offered) {
+        while (p + 1 < trace.published.size() &&
+               (int32_t)(trace.published[p + 1].receivedMs - reading.receivedMs) <= 0) {
+            p++;
+        }
+        const SensorReading& held = trace.published[p].data;
+        TEST_ASSERT_EQUAL_HEX16(held.quality, reading.data.quality);
+        for (uint8_t q = Q_TEMP; q < QUANTITY_COUNT; q++) {
+            float last = held.value((Quantity)q);
+            float value = reading.data.value((Quantity)q);
+            TEST_ASSERT_EQUAL(isnan(last), isnan(value));
+            if (isnan(last)) {
+                continue;
+            }
+            float band = fmaxf(config.absolute[q], config.relative[q] * fabsf(last));
+            TEST_ASSERT_TRUE_MESSAGE(fabsf(value - last) <= band, trace.nodeID);
+        }
+    }
+}
+
+static void assertSameValues(const SensorReading& expected, const SensorReading& actual) {
+    TEST_ASSERT_EQUAL_HEX16(expected.quality, actual.quality);
+    TEST_ASSERT_EQUAL_HEX16(expected.present, actual.present);
+    TEST_ASSERT_EQUAL_MEMORY(expected.body, actual.body, sizeof(expected.body));
+}
+
+// Linear between published points: every reading between two of them must
+// be within `absolute` of the line. Readings after the last published one
+// are still pending and not checked.
+static void assertDoorReconstruction(const NodeTrace& trace, const ReportFilterConfig& config) {
+    assertOrdered(trace);
+    TEST_ASSERT_FALSE(trace.published.empty());
+    size_t p = 0;
+    const std::vector<ReportSample>& points = trace.published;
+    for (const ReportSample& reading : trace.offered) {
+        while (p + 1 < points.size() && (int32_t)(points[p + 1].receivedMs - reading.receivedMs) <= 0) {
+            p++;
+        }
+        const ReportSample& a = points[p];
+        if (reading.receivedMs == a.receivedMs) {
+            // Published as it came
+            assertSameValues(reading.data, a.data);
+            continue;
+        }
+        if (p + 1 == points.size()) {
+            continue;   // Pending
+        }
+        // Inside a segment. Its end is the held point that closed it, which
+        // passed the same door: same flags, same NaNs.
+        const ReportSample& b = points[p + 1];
+        double t = (double)(uint32_t)(reading.receivedMs - a.receivedMs) /
+                   (double)(uint32_t)(b.receivedMs - a.receivedMs);
+        TEST_ASSERT_EQUAL_HEX16(a.data.quality, reading.data.quality);
+        TEST_ASSERT_EQUAL_HEX16(a.data.quality, b.data.quality);
+        for (uint8_t q = Q_TEMP; q < QUANTITY_COUNT; q++) {
+            float from = a.data.value((Quantity)q);
+            float to = b.data.value((Quantity)q);
+            float value = reading.data.value((Quantity)q);
+            TEST_ASSERT_EQUAL(isnan(from), isnan(value));
+            TEST_ASSERT_EQUAL(isnan(from), isnan(to));
+            if (isnan(from)) {
+                continue;
+            }
+            double line = from + (to - from) * t;
+            // Slack for the filter's float slopes against this double line
+            double limit = config.absolute[q] * (1 + 1e-4) + 1e-4;
+            TEST_ASSERT_TRUE_MESSAGE(fabs(value - line) <= limit, trace.nodeID);
+        }
+    }
+}
+
+// No node goes longer than the heartbeat without a publish, give or take
+// the reading that found it expired
+static void assertHeartbeat(const NodeTrace& trace, uint32_t heartbeatMs) {
+    for (size_t i = 0, p = 0; i < trace.offered.size(); i++) {
+        while (p + 1 < trace.published.size() &&
+               (int32_t)(trace.published[p + 1].receivedMs - trace.offered[i].receivedMs) <= 0) {
+            p++;
+        }
+        TEST_ASSERT_TRUE((uint32_t)(trace.offered[i].receivedMs - trace.published[p].receivedMs) < heartbeatMs);
+    }
+}
+
+void setUp(void) {
+    rngState = 77;
+}
+
+void tearDown(void) {}
+
+void test_all_mode_publishes_everything(void) {
+    ReportFilter filter(configFor(REPORT_ALL, 0));
+    std::vector<NodeTrace> traces = runTraces(filter, 0, 500);
+    for (const NodeTrace& trace : traces) {
+        TEST_ASSERT_EQUAL(trace.offered.size(), trace.published.size());
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, filter.getStats().suppressed);
+}
+
+void test_deadband_reconstruction(void) {
+    ReportFilterConfig config = configFor(REPORT_DEADBAND, 0);
+    ReportFilter filter(config);
+    std::vector<NodeTrace> traces = runTraces(filter, 0, 20000);
+    for (const NodeTrace& trace : traces) {
+        assertDeadbandReconstruction(trace, config);
+    }
+    const ReportFilterStats& stats = filter.getStats();
+    TEST_ASSERT_EQUAL_UINT32(20000, stats.offered);
+    TEST_ASSERT_EQUAL_UINT32(stats.offered, stats.published + stats.suppressed);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, stats.suppressed);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.heartbeats);
+}
+
+void test_swinging_door_reconstruction(void) {
+    ReportFilterConfig config = configFor(REPORT_SWINGING_DOOR, 0);
+    ReportFilter filter(config);
+    // Starting just short of the millis() wrap
+    std::vector<NodeTrace> traces = runTraces(filter, 0xFFFFFFFFu - 3600000u, 20000);
+    for (const NodeTrace& trace : traces) {
+        assertDoorReconstruction(trace, config);
+    }
+    const ReportFilterStats& stats = filter.getStats();
+    TEST_ASSERT_GREATER_THAN_UINT32(0, stats.suppressed);
+}
+
+// A trace that never moves only gets out through the heartbeat
+void test_heartbeat_on_a_flat_trace(void) {
+    ReportMode modes[] = {REPORT_DEADBAND, REPORT_SWINGING_DOOR};
+    for (ReportMode mode : modes) {
+        const uint32_t HEARTBEAT = 600000;
+        ReportFilterConfig config = configFor(mode, HEARTBEAT);
+        ReportFilter filter(config);
+        NodeTrace trace = {"N01", SCHEMA_CLIMATE, {}, {}, {}};
+        SensorReading reading;
+        initReading(reading, SCHEMA_CLIMATE, "N01");
+        reading.present = 0x7;
+        reading.as<ClimateSample>() = {21.5f, 40.0f, 1500.0f};
+        uint32_t nowMs = 0;
+        for (int i = 0; i < 2000; i++) {
+            nowMs += 30000;
+            offer(filter, trace, reading, nowMs);
+        }
+        assertHeartbeat(trace, HEARTBEAT);
+        if (mode == REPORT_DEADBAND) {
+            assertDeadbandReconstruction(trace, config);
+            // The first reading, then one per heartbeat
+            TEST_ASSERT_EQUAL(1 + (2000 - 1) * 30000 / HEARTBEAT, trace.published.size());
+        } else {
+            assertDoorReconstruction(trace, config);
+        }
+        TEST_ASSERT_GREATER_THAN_UINT32(0, filter.getStats().heartbeats);
+    }
+}
+
+// Random traces with a heartbeat short enough to fire mid-segment: the
+// reconstruction must still hold around the points it forces out
+void test_heartbeat_keeps_reconstruction(void) {
+    const uint32_t HEARTBEAT = 120000;
+    ReportFilterConfig deadband = configFor(REPORT_DEADBAND, HEARTBEAT);
+    ReportFilter deadbandFilter(deadband);
+    for (const NodeTrace& trace : runTraces(deadbandFilter, 0, 10000)) {
+        assertDeadbandReconstruction(trace, deadband);
+        assertHeartbeat(trace, HEARTBEAT + 60500);
+    }
+    ReportFilterConfig door = configFor(REPORT_SWINGING_DOOR, HEARTBEAT);
+    ReportFilter doorFilter(door);
+    for (const NodeTrace& trace : runTraces(doorFilter, 0, 10000)) {
+        assertDoorReconstruction(trace, door);
+    }
+    TEST_ASSERT_GREATER_THAN_UINT32(0, deadbandFilter.getStats().heartbeats);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, doorFilter.getStats().heartbeats);
+}
+
+// Changes that must go out whatever the values did
+void test_forced_publishes(void) {
+    ReportMode modes[] = {REPORT_DEADBAND, REPORT_SWINGING_DOOR};
+    for (ReportMode mode : modes) {
+        ReportFilter filter(configFor(mode, 0));
+        SensorReading reading;
+        initReading(reading, SCHEMA_CLIMATE, "N01");
+        reading.present = 0x7;
+        reading.as<ClimateSample>() = {21.5f, 40.0f, 1500.0f};
+        ReportSample out[2];
+        uint32_t nowMs = 1000;
+        TEST_ASSERT_EQUAL(1, filter.offer(reading, nowMs += 1000, out));
+        TEST_ASSERT_EQUAL(0, filter.offer(reading, nowMs += 1000, out));
+
+        // A quality flag appearing, then clearing
+        reading.quality = QUALITY_STUCK;
+        uint8_t emitted = filter.offer(reading, nowMs += 1000, out);
+        TEST_ASSERT_GREATER_THAN(0, emitted);
+        TEST_ASSERT_EQUAL_HEX16(QUALITY_STUCK, out[emitted - 1].data.quality);
+        reading.quality = 0;
+        emitted = filter.offer(reading, nowMs += 1000, out);
+        TEST_ASSERT_EQUAL_HEX16(0, out[emitted - 1].data.quality);
+
+        // A value turning NaN, then coming back
+        reading.as<ClimateSample>().humidity = NAN;
+        emitted = filter.offer(reading, nowMs += 1000, out);
+        TEST_ASSERT_GREATER_THAN(0, emitted);
+        TEST_ASSERT_TRUE(isnan(out[emitted - 1].data.value(Q_HUMIDITY)));
+        reading.as<ClimateSample>().humidity = 40.0f;
+        emitted = filter.offer(reading, nowMs += 1000, out);
+        TEST_ASSERT_FALSE(isnan(out[emitted - 1].data.value(Q_HUMIDITY)));
+
+        // A field left out of the frame counts like NaN
+        reading.present = 0x3;
+        emitted = filter.offer(reading, nowMs += 1000, out);
+        TEST_ASSERT_GREATER_THAN(0, emitted);
+        TEST_ASSERT_EQUAL_HEX16(0x3, out[emitted - 1].data.present);
+        reading.present = 0x7;
+        TEST_ASSERT_GREATER_THAN(0, filter.offer(reading, nowMs += 1000, out));
+
+        // A lost publish: the next reading goes out even though unchanged
+        TEST_ASSERT_EQUAL(0, filter.offer(reading, nowMs += 1000, out));
+        filter.forget("N01");
+        TEST_ASSERT_EQUAL(1, filter.offer(reading, nowMs += 1000, out));
+        TEST_ASSERT_EQUAL_UINT32(nowMs, out[0].receivedMs);
+
+        // New rules start every node over
+        filter.setConfig(configFor(mode, 0));
+        TEST_ASSERT_EQUAL(1, filter.offer(reading, nowMs += 1000, out));
+    }
+}
+
+// Nodes past the table's capacity aren't tracked, so they aren't filtered
+void test_untracked_nodes_publish_everything(void) {
+    ReportFilter filter(configFor(REPORT_DEADBAND, 0));
+    ReportSample out[2];
+    SensorReading reading;
+    for (int n = 0; n <= NODE_TABLE_CAPACITY; n++) {
+        char nodeID[SENSOR_NODE_ID_SIZE];
+        snprintf(nodeID, sizeof(nodeID), "N%03d", n % 1000);
+        initReading(reading, SCHEMA_RAIN, nodeID);
+        reading.present = 0x1;
+        reading.as<RainSample>().rain = 1.0f;
+        TEST_ASSERT_EQUAL(1, filter.offer(reading, 1000, out));
+    }
+    for (int i = 0; i < 10; i++) {
+        TEST_ASSERT_EQUAL(1, filter.offer(reading, 2000 + i, out));
+    }
+    initReading(reading, SCHEMA_RAIN, "N000");
+    reading.present = 0x1;
+    reading.as<RainSample>().rain = 1.0f;
+    TEST_ASSERT_EQUAL(0, filter.offer(reading, 3000, out));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_all_mode_publishes_everything);
+    RUN_TEST(test_deadband_reconstruction);
+    RUN_TEST(test_swinging_door_reconstruction);
+    RUN_TEST(test_heartbeat_on_a_flat_trace);
+    RUN_TEST(test_heartbeat_keeps_reconstruction);
+    RUN_TEST(test_forced_publishes);
+    RUN_TEST(test_untracked_nodes_publish_everything);
+    return UNITY_END();
+}
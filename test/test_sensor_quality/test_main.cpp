@@ -0,0 +1,254 @@
+// QualityMonitor on synthetic traces: each fault (range, spike, stuck-at,
+// dropout, MAD z-score outlier) is injected into an otherwise clean trace
+// and must set exactly its quality bits and raise and clear its events
+
+#include <unity.h>
+#include <math.h>
+#include <vector>
+#include "sensor_quality.h"
+
+static const uint32_t INTERVAL_MS = 60000;
+
+static uint32_t rngState;
+
+static float noise(float amplitude) {
+    rngState = rngState * 1664525u + 1013904223u;
+    return amplitude * ((float)((rngState >> 8) % 20001) / 10000.0f - 1.0f);
+}
+
+// One climate node reporting once a minute
+struct Trace {
+    QualityMonitor monitor;
+    uint32_t nowMs = 1000;
+    uint8_t maxEvents = QUALITY_MAX_EVENTS;
+    std::vector<QualityEvent> events;
+    uint16_t quality = 0;
+
+    Trace() : monitor(QualityConfig::defaults()) {}
+
+    // Sends the reading, returns its quality bits
+    uint16_t send(float temp, float humidity, float moisture, const char* nodeID = "N01") {
+        nowMs += INTERVAL_MS;
+        SensorReading reading;
+        initReading(reading, SCHEMA_CLIMATE, nodeID);
+        reading.present = 0x7;
+        reading.as<ClimateSample>() = {temp, humidity, moisture};
+        QualityEvent out[QUALITY_MAX_EVENTS];
+        uint8_t n = monitor.check(reading, nowMs, out, maxEvents);
+        events.assign(out, out + n);
+        quality = reading.quality;
+        return quality;
+    }
+
+    // Noise small against the rate limits and the MAD floor
+    uint16_t sendClean() {
+        return send(20.0f + noise(0.3f), 50.0f + noise(0.3f), 2000.0f + noise(3.0f));
+    }
+
+    void warmUp() {
+        for (int i = 0; i < 3 * QUALITY_WARMUP; i++) {
+            TEST_ASSERT_EQUAL_HEX16(0, sendClean());
+            TEST_ASSERT_EQUAL(0, events.size());
+        }
+    }
+};
+
+static void assertEvent(const QualityEvent& event, Quantity quantity, QualityFlag fault, bool active) {
+    TEST_ASSERT_EQUAL_STRING("N01", event.nodeID);
+    TEST_ASSERT_EQUAL(quantity, event.quantity);
+    TEST_ASSERT_EQUAL_HEX16(fault, event.fault);
+    TEST_ASSERT_EQUAL(active, event.active);
+}
+
+static Trace* trace;
+
+void setUp(void) {
+    rngState = 99;
+    trace = new Trace();
+}
+
+void tearDown(void) {
+    delete trace;
+}
+
+void test_clean_trace_raises_nothing(void) {
+    for (int i = 0; i < 2000; i++) {
+        TEST_ASSERT_EQUAL_HEX16(0, trace->sendClean());
+        TEST_ASSERT_EQUAL(0, trace->events.size());
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, trace->monitor.getStats().flagged);
+}
+
+void test_out_of_range(void) {
+    trace->warmUp();
+    TEST_ASSERT_EQUAL_HEX16(QUALITY_RANGE, trace->send(75.0f, 50.0f, 2000.0f));
+    TEST_ASSERT_EQUAL(1, trace->events.size());
+    assertEvent(trace->events[0], Q_TEMP, QUALITY_RANGE, true);
+    TEST_ASSERT_EQUAL_FLOAT(75.0f, trace->events[0].value);
+
+    // A dead DHT reads 0 %RH; still flagged while it lasts, one event
+    for (int i = 0; i < 5; i++) {
+        TEST_ASSERT_EQUAL_HEX16(QUALITY_RANGE, trace->send(20.0f, 0.0f, 2000.0f));
+    }
+    TEST_ASSERT_EQUAL(0, trace->events.size());
+
+    // Out-of-range values never reached the trackers, so the first good
+    // reading after them is clean and clears both
+    TEST_ASSERT_EQUAL_HEX16(0, trace->sendClean());
+    TEST_ASSERT_EQUAL(1, trace->events.size());
+    assertEvent(trace->events[0], Q_HUMIDITY, QUALITY_RANGE, false);
+    TEST_ASSERT_EQUAL_HEX16(0, trace->sendClean());
+}
+
+void test_nan_value(void) {
+    trace->warmUp();
+    TEST_ASSERT_EQUAL_HEX16(QUALITY_NAN, trace->send(NAN, 50.0f, 2000.0f));
+    TEST_ASSERT_EQUAL(1, trace->events.size());
+    assertEvent(trace->events[0], Q_TEMP, QUALITY_NAN, true);
+    TEST_ASSERT_EQUAL_HEX16(QUALITY_NAN, trace->send(20.0f, 50.0f, INFINITY));
+    TEST_ASSERT_EQUAL(2, trace->events.size());
+    assertEvent(trace->events[0], Q_TEMP, QUALITY_NAN, false);
+    assertEvent(trace->events[1], Q_MOISTURE, QUALITY_NAN, true);
+    TEST_ASSERT_EQUAL_HEX16(0, trace->sendClean());
+}
+
+// A one-reading temperature spike: too fast for the rate limit and far
+// outside the MAD; flagged once and ignored by the trackers
+void test_spike(void) {
+    trace->warmUp();
+    TEST_ASSERT_EQUAL_HEX16(QUALITY_RATE | QUALITY_OUTLIER, trace->send(26.0f, 50.0f, 2000.0f));
+    TEST_ASSERT_EQUAL(2, trace->events.size());
+    assertEvent(trace->events[0], Q_TEMP, QUALITY_RATE, true);
+    assertEvent(trace->events[1], Q_TEMP, QUALITY_OUTLIER, true);
+
+    TEST_ASSERT_EQUAL_HEX16(0, trace->sendClean());
+    TEST_ASSERT_EQUAL(2, trace->events.size());
+    assertEvent(trace->events[0], Q_TEMP, QUALITY_RATE, false);
+    assertEvent(trace->events[1], Q_TEMP, QUALITY_OUTLIER, false);
+    for (int i = 0; i < 100; i++) {
+        TEST_ASSERT_EQUAL_HEX16(0, trace->sendClean());
+    }
+}
+
+// Humidity allows 20 %RH a minute, so a jump of 8 is only an outlier
+void test_outlier_within_rate(void) {
+    trace->warmUp();
+    TEST_ASSERT_EQUAL_HEX16(QUALITY_OUTLIER, trace->send(20.0f, 58.0f, 2000.0f));
+    TEST_ASSERT_EQUAL(1, trace->events.size());
+    assertEvent(trace->events[0], Q_HUMIDITY, QUALITY_OUTLIER, true);
+    TEST_ASSERT_EQUAL_HEX16(0, trace->sendClean());
+}
+
+// The same deviation is an outlier on a quiet signal and normal on a noisy
+// one: the limit scales with the tracked MAD
+void test_z_score_scales_with_mad(void) {
+    // Quiet: moisture noise of 3 counts, MAD near the 1-count floor
+    trace->warmUp();
+    for (int i = 0; i < 200; i++) {
+        trace->sendClean();
+    }
+    TEST_ASSERT_EQUAL_HEX16(QUALITY_OUTLIER, trace->send(20.0f, 50.0f, 2150.0f));
+    trace->sendClean();
+
+    // Noisy: moisture noise of 300 counts on another node
+    Trace noisy;
+    for (int i = 0; i < 2000; i++) {
+        uint16_t quality = noisy.send(20.0f + noise(0.3f), 50.0f + noise(0.3f), 2000.0f + noise(300.0f), "N02");
+        if (i > 3 * QUALITY_WARMUP) {
+            TEST_ASSERT_EQUAL_HEX16(0, quality);
+        }
+    }
+    TEST_ASSERT_EQUAL_HEX16(0, noisy.send(20.0f, 50.0f, 2150.0f, "N02"));
+    // Far outside even that spread
+    TEST_ASSERT_EQUAL_HEX16(QUALITY_OUTLIER, noisy.send(20.0f, 50.0f, 3900.0f, "N02"));
+}
+
+// A new level is flagged QUALITY_ACCEPT_RUN times, then taken as normal
+void test_level_shift_is_accepted(void) {
+    trace->warmUp();
+    for (int i = 0; i < QUALITY_ACCEPT_RUN; i++) {
+        TEST_ASSERT_EQUAL_HEX16(QUALITY_OUTLIER, trace->send(20.0f, 50.0f, 2600.0f + noise(3.0f)));
+        TEST_ASSERT_EQUAL(i == 0 ? 1 : 0, trace->events.size());
+    }
+    TEST_ASSERT_EQUAL_HEX16(0, trace->send(20.0f, 50.0f, 2600.0f + noise(3.0f)));
+    TEST_ASSERT_EQUAL(1, trace->events.size());
+    assertEvent(trace->events[0], Q_MOISTURE, QUALITY_OUTLIER, false);
+    for (int i = 0; i < 200; i++) {
+        TEST_ASSERT_EQUAL_HEX16(0, trace->send(20.0f + noise(0.3f), 50.0f + noise(0.3f), 2600.0f + noise(3.0f)));
+    }
+}
+
+// The same temperature QUALITY_STUCK_RUN times in a row
+void test_stuck_at(void) {
+    trace->warmUp();
+    for (int i = 1; i <= QUALITY_STUCK_RUN + 10; i++) {
+        uint16_t quality = trace->send(21.3f, 50.0f + noise(0.3f), 2000.0f + noise(3.0f));
+        TEST_ASSERT_EQUAL_HEX16(i >= QUALITY_STUCK_RUN ? QUALITY_STUCK : 0, quality);
+        TEST_ASSERT_EQUAL(i == QUALITY_STUCK_RUN ? 1 : 0, trace->events.size());
+        if (i == QUALITY_STUCK_RUN) {
+            assertEvent(trace->events[0], Q_TEMP, QUALITY_STUCK, true);
+        }
+    }
+    TEST_ASSERT_EQUAL_HEX16(0, trace->send(21.4f, 50.0f, 2000.0f));
+    TEST_ASSERT_EQUAL(1, trace->events.size());
+    assertEvent(trace->events[0], Q_TEMP, QUALITY_STUCK, false);
+}
+
+void test_dropout(void) {
+    trace->warmUp();
+    QualityEvent events[QUALITY_MAX_EVENTS];
+    TEST_ASSERT_EQUAL(0, trace->monitor.sweep(trace->nowMs + QUALITY_DROPOUT_MS, events, QUALITY_MAX_EVENTS));
+
+    // Silent past the limit: sweep raises it once
+    trace->nowMs += QUALITY_DROPOUT_MS;
+    TEST_ASSERT_EQUAL(1, trace->monitor.sweep(trace->nowMs + 1, events, QUALITY_MAX_EVENTS));
+    assertEvent(events[0], Q_NODE_ID, QUALITY_DROPOUT, true);
+    TEST_ASSERT_TRUE(isnan(events[0].value));
+    TEST_ASSERT_EQUAL(0, trace->monitor.sweep(trace->nowMs + 2, events, QUALITY_MAX_EVENTS));
+
+    // The reading that ends it carries the bit and clears the event
+    TEST_ASSERT_EQUAL_HEX16(QUALITY_DROPOUT, trace->send(20.0f, 50.0f, 2000.0f));
+    TEST_ASSERT_EQUAL(1, trace->events.size());
+    assertEvent(trace->events[0], Q_NODE_ID, QUALITY_DROPOUT, false);
+    TEST_ASSERT_EQUAL_HEX16(0, trace->sendClean());
+
+    // A gap nobody swept still marks the reading after it, without events
+    trace->nowMs += QUALITY_DROPOUT_MS;
+    TEST_ASSERT_EQUAL_HEX16(QUALITY_DROPOUT, trace->send(20.0f, 50.0f, 2000.0f));
+    TEST_ASSERT_EQUAL(0, trace->events.size());
+}
+
+// Faults on every quantity of one reading, with room for fewer events
+void test_events_beyond_room_are_counted(void) {
+    trace->warmUp();
+    trace->maxEvents = 1;
+    TEST_ASSERT_EQUAL_HEX16(QUALITY_RANGE | QUALITY_NAN, trace->send(NAN, 0.0f, -5.0f));
+    TEST_ASSERT_EQUAL(1, trace->events.size());
+    TEST_ASSERT_EQUAL_UINT32(2, trace->monitor.getStats().eventsDropped);
+}
+
+void test_untracked_nodes_pass(void) {
+    char nodeID[SENSOR_NODE_ID_SIZE];
+    for (int n = 0; n < NODE_TABLE_CAPACITY; n++) {
+        snprintf(nodeID, sizeof(nodeID), "N%03d", n % 1000);
+        trace->send(20.0f, 50.0f, 2000.0f, nodeID);
+    }
+    TEST_ASSERT_EQUAL_HEX16(0, trace->send(NAN, 0.0f, -5.0f, "EXTRA"));
+    TEST_ASSERT_EQUAL_UINT32(1, trace->monitor.getStats().untracked);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_clean_trace_raises_nothing);
+    RUN_TEST(test_out_of_range);
+    RUN_TEST(test_nan_value);
+    RUN_TEST(test_spike);
+    RUN_TEST(test_outlier_within_rate);
+    RUN_TEST(test_z_score_scales_with_mad);
+    RUN_TEST(test_level_shift_is_accepted);
+    RUN_TEST(test_stuck_at);
+    RUN_TEST(test_dropout);
+    RUN_TEST(test_events_beyond_room_are_counted);
+    RUN_TEST(test_untracked_nodes_pass);
+    return UNITY_END();
+}
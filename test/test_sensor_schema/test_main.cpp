@@ -0,0 +1,330 @@
+// Schema TLV codecs and the UART frame decoder: every schema and every
+// subset of its fields round-trips, unknown tags are skipped, and damaged
+// or cut-off frames are dropped without losing the frame after them
+
+#include <unity.h>
+#include <math.h>
+#include "sensor_frame.h"
+#include "sensor_schema.h"
+
+static uint32_t rngState = 12345;
+
+static uint32_t nextRandom() {
+    rngState = rngState * 1664525u + 1013904223u;
+    return rngState;
+}
+
+// Random value of the field's wire type, so it survives the trip exactly
+static float randomValue(Quantity quantity) {
+    if (quantity == Q_MOISTURE || quantity == Q_WIND_DIR) {
+        return (float)(int32_t)(nextRandom() % 100000) - 50000;
+    }
+    return ((float)(nextRandom() % 2000001) - 1000000.0f) / 1000.0f;
+}
+
+// A reading of the schema with the fields in mask present and random values
+static SensorReading makeReading(const SchemaInfo* schema, uint16_t mask, const char* nodeID) {
+    SensorReading reading;
+    initReading(reading, schema->id, nodeID);
+    reading.present = 0xFFFF >> (16 - schema->fieldCount);
+    uint16_t quantities = reading.quantities();
+    for (uint8_t q = 1; q < QUANTITY_COUNT; q++) {
+        if (quantities & (1u << q)) {
+            schema->setValue(reading, (Quantity)q, randomValue((Quantity)q));
+        }
+    }
+    reading.present = mask;
+    return reading;
+}
+
+static void assertSameReading(const SensorReading& expected, const SensorReading& actual) {
+    TEST_ASSERT_EQUAL_STRING(expected.nodeID, actual.nodeID);
+    TEST_ASSERT_EQUAL_UINT8(expected.schemaId, actual.schemaId);
+    TEST_ASSERT_EQUAL_HEX16(expected.present, actual.present);
+    TEST_ASSERT_EQUAL_HEX16(expected.quantities(), actual.quantities());
+    for (uint8_t q = 1; q < QUANTITY_COUNT; q++) {
+        float a = expected.value((Quantity)q);
+        float b = actual.value((Quantity)q);
+        if (isnan(a)) {
+            TEST_ASSERT_TRUE(isnan(b));
+        } else {
+            TEST_ASSERT_EQUAL_FLOAT(a, b);
+        }
+    }
+    char expectedJson[128] = "";
+    char actualJson[128] = "";
+    const SchemaInfo* schema = expected.schema();
+    size_t n = schema->writeJson(expected, expectedJson, sizeof(expectedJson));
+    TEST_ASSERT_EQUAL(n, schema->writeJson(actual, actualJson, sizeof(actualJson)));
+    TEST_ASSERT_EQUAL_STRING(expectedJson, actualJson);
+}
+
+static size_t frameFor(const SensorReading& reading, uint8_t* out) {
+    size_t length = encodeFrame(reading, out, SENSOR_FRAME_MAX);
+    TEST_ASSERT_GREATER_THAN(0, length);
+    return length;
+}
+
+// A frame around an arbitrary body, with a good CRC
+static size_t rawFrame(uint8_t schemaId, const uint8_t* body, size_t length, uint8_t* out) {
+    out[0] = SENSOR_FRAME_SYNC0;
+    out[1] = SENSOR_FRAME_SYNC1;
+    out[2] = SENSOR_FRAME_VERSION;
+    out[3] = schemaId;
+    out[4] = (uint8_t)length;
+    memcpy(out + SENSOR_FRAME_HEADER, body, length);
+    uint16_t crc = crc16(out + 2, SENSOR_FRAME_HEADER - 2 + length);
+    out[SENSOR_FRAME_HEADER + length] = crc & 0xFF;
+    out[SENSOR_FRAME_HEADER + length + 1] = crc >> 8;
+    return SENSOR_FRAME_HEADER + length + 2;
+}
+
+// Readings decoded from data fed a byte at a time
+static int feedBytes(FrameDecoder& decoder, const uint8_t* data, size_t len, SensorReading& last) {
+    int decoded = 0;
+    for (size_t i = 0; i < len; i++) {
+        decoded += decoder.feed(data[i], last);
+    }
+    return decoded;
+}
+
+// After damage the decoder may hold the frames that follow until the bad
+// frame's length is made up, then rescans them. Sends enough good copies
+// to get past that and checks every one of them came out.
+static void assertRecovers(FrameDecoder& decoder, const SensorReading& next) {
+    uint8_t frame[SENSOR_FRAME_MAX];
+    size_t length = frameFor(next, frame);
+    const int copies = SENSOR_FRAME_MAX / length + 2;
+    int decoded = 0;
+    SensorReading reading;
+    for (int i = 0; i < copies; i++) {
+        decoded += feedBytes(decoder, frame, length, reading);
+    }
+    TEST_ASSERT_EQUAL_INT(copies, decoded);
+    assertSameReading(next, reading);
+    TEST_ASSERT_TRUE(decoder.idle());
+}
+
+void setUp(void) {
+    rngState = 12345;
+}
+
+void tearDown(void) {}
+
+void test_every_schema_is_registered(void) {
+    TEST_ASSERT_NULL(findSchema(0));
+    TEST_ASSERT_NULL(findSchema(SCHEMA_ID_LIMIT));
+    TEST_ASSERT_NULL(findSchema(SENSOR_FRAME_CONTROL));
+    for (uint8_t id = 1; id < SCHEMA_ID_LIMIT; id++) {
+        const SchemaInfo* schema = findSchema(id);
+        TEST_ASSERT_NOT_NULL(schema);
+        TEST_ASSERT_EQUAL_UINT8(id, schema->id);
+        TEST_ASSERT_GREATER_THAN(0, schema->fieldCount);
+    }
+}
+
+// Every schema, every subset of its fields, through the bare codec and
+// through a whole frame fed both byte by byte and in one block
+void test_round_trip_every_field_subset(void) {
+    for (uint8_t id = 1; id < SCHEMA_ID_LIMIT; id++) {
+        const SchemaInfo* schema = findSchema(id);
+        for (uint16_t mask = 0; mask < (1u << schema->fieldCount); mask++) {
+            for (int trial = 0; trial < 8; trial++) {
+                SensorReading reading = makeReading(schema, mask, trial % 2 ? "N-12345" : "");
+
+                uint8_t tlv[SENSOR_FRAME_MAX_BODY];
+                size_t length = schema->encode(reading, tlv, sizeof(tlv));
+                SensorReading decoded;
+                initReading(decoded, id, reading.nodeID);
+                TEST_ASSERT_TRUE(schema->decode(tlv, length, decoded));
+                assertSameReading(reading, decoded);
+
+                uint8_t frame[SENSOR_FRAME_MAX];
+                size_t frameLength = frameFor(reading, frame);
+                FrameDecoder bytewise;
+                SensorReading fromBytes;
+                TEST_ASSERT_EQUAL_INT(1, feedBytes(bytewise, frame, frameLength, fromBytes));
+                assertSameReading(reading, fromBytes);
+
+                FrameDecoder block;
+                SensorReading fromBlock;
+                bool done = false;
+                TEST_ASSERT_EQUAL(frameLength, block.feed(frame, frameLength, fromBlock, done));
+                TEST_ASSERT_TRUE(done);
+                assertSameReading(reading, fromBlock);
+            }
+        }
+    }
+}
+
+void test_encode_reports_too_small_buffer(void) {
+    const SchemaInfo* schema = findSchema(SCHEMA_WIND);
+    SensorReading reading = makeReading(schema, 0x7, "N-1");
+    uint8_t tlv[SENSOR_FRAME_MAX_BODY];
+    size_t length = schema->encode(reading, tlv, sizeof(tlv));
+    for (size_t size = 0; size < length; size++) {
+        TEST_ASSERT_EQUAL(0, schema->encode(reading, tlv, size));
+    }
+    uint8_t frame[SENSOR_FRAME_MAX];
+    size_t frameLength = encodeFrame(reading, frame, sizeof(frame));
+    for (size_t size = 0; size < frameLength; size++) {
+        TEST_ASSERT_EQUAL(0, encodeFrame(reading, frame, size));
+    }
+}
+
+// Tags from a newer node, and known tags at a size this build doesn't
+// expect, are stepped over; the fields around them still decode
+void test_unknown_tags_are_skipped(void) {
+    const SchemaInfo* schema = findSchema(SCHEMA_CLIMATE);
+    SensorReading reading = makeReading(schema, 0x7, "N-2");
+    uint8_t fields[SENSOR_FRAME_MAX_BODY];
+    size_t fieldLength = schema->encode(reading, fields, sizeof(fields));
+
+    static const uint8_t UNKNOWN[] = {0x7F, 3, 1, 2, 3};
+    static const uint8_t WRONG_SIZE[] = {Q_HUMIDITY, 2, 0xAA, 0xBB};
+    static const uint8_t EMPTY[] = {0x40, 0};
+    static const uint8_t OTHER_SCHEMA[] = {Q_WIND, 4, 0, 0, 0x80, 0x3F};
+    const uint8_t* extras[] = {UNKNOWN, WRONG_SIZE, EMPTY, OTHER_SCHEMA};
+    const size_t extraSizes[] = {sizeof(UNKNOWN), sizeof(WRONG_SIZE), sizeof(EMPTY), sizeof(OTHER_SCHEMA)};
+
+    // Each extra at every field boundary: before, between and after fields
+    for (size_t e = 0; e < 4; e++) {
+        for (size_t at = 0; at <= fieldLength; at += 6) {
+            uint8_t body[SENSOR_FRAME_MAX_BODY];
+            size_t length = 0;
+            body[length++] = Q_NODE_ID;
+            body[length++] = 3;
+            memcpy(body + length, "N-2", 3);
+            length += 3;
+            memcpy(body + length, fields, at);
+            length += at;
+            memcpy(body + length, extras[e], extraSizes[e]);
+            length += extraSizes[e];
+            memcpy(body + length, fields + at, fieldLength - at);
+            length += fieldLength - at;
+
+            uint8_t frame[SENSOR_FRAME_MAX];
+            size_t frameLength = rawFrame(SCHEMA_CLIMATE, body, length, frame);
+            FrameDecoder decoder;
+            SensorReading decoded;
+            TEST_ASSERT_EQUAL_INT(1, feedBytes(decoder, frame, frameLength, decoded));
+            assertSameReading(reading, decoded);
+            TEST_ASSERT_EQUAL_UINT32(0, decoder.getStats().malformed);
+        }
+    }
+}
+
+// Every bit of a frame flipped in turn: never decoded, and no good frame
+// sent after it is lost
+void test_corrupt_bytes_are_rejected(void) {
+    for (uint8_t id = 1; id < SCHEMA_ID_LIMIT; id++) {
+        const SchemaInfo* schema = findSchema(id);
+        SensorReading reading = makeReading(schema, 0xFFFF >> (16 - schema->fieldCount), "N-3");
+        SensorReading next = makeReading(schema, 0x1, "N-4");
+        uint8_t frame[SENSOR_FRAME_MAX];
+        size_t frameLength = frameFor(reading, frame);
+
+        for (size_t i = 0; i < frameLength; i++) {
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                uint8_t damaged[SENSOR_FRAME_MAX];
+                memcpy(damaged, frame, frameLength);
+                damaged[i] ^= 1u << bit;
+                FrameDecoder decoder;
+                SensorReading decoded;
+                TEST_ASSERT_EQUAL_INT(0, feedBytes(decoder, damaged, frameLength, decoded));
+                assertRecovers(decoder, next);
+            }
+        }
+    }
+}
+
+// A frame cut off at every length, then whole ones: only the whole ones
+// come out, all of them
+void test_truncated_frames_are_dropped(void) {
+    const SchemaInfo* schema = findSchema(SCHEMA_WIND);
+    SensorReading reading = makeReading(schema, 0x7, "N-5");
+    SensorReading next = makeReading(schema, 0x5, "N-6");
+    uint8_t frame[SENSOR_FRAME_MAX];
+    size_t frameLength = frameFor(reading, frame);
+
+    for (size_t cut = 0; cut < frameLength; cut++) {
+        FrameDecoder decoder;
+        SensorReading decoded;
+        TEST_ASSERT_EQUAL_INT(0, feedBytes(decoder, frame, cut, decoded));
+        assertRecovers(decoder, next);
+    }
+}
+
+// A TLV body cut inside a field is refused even under a good CRC; cut at a
+// field boundary it is a shorter valid reading
+void test_truncated_tlv_is_malformed(void) {
+    const SchemaInfo* schema = findSchema(SCHEMA_CLIMATE);
+    SensorReading reading = makeReading(schema, 0x7, "N-7");
+    uint8_t frame[SENSOR_FRAME_MAX];
+    frameFor(reading, frame);
+    const uint8_t* body = frame + SENSOR_FRAME_HEADER;
+    size_t bodyLength = frame[4];
+    size_t fieldsStart = 2 + body[1];
+
+    for (size_t length = 0; length < bodyLength; length++) {
+        uint8_t cut[SENSOR_FRAME_MAX];
+        size_t cutLength = rawFrame(SCHEMA_CLIMATE, body, length, cut);
+        FrameDecoder decoder;
+        SensorReading decoded;
+        int count = feedBytes(decoder, cut, cutLength, decoded);
+        bool boundary = length >= fieldsStart && (length - fieldsStart) % 6 == 0;
+        TEST_ASSERT_EQUAL_INT(boundary ? 1 : 0, count);
+        TEST_ASSERT_EQUAL_UINT32(boundary ? 0 : 1, decoder.getStats().malformed);
+        if (boundary) {
+            TEST_ASSERT_EQUAL_HEX16((1u << ((length - fieldsStart) / 6)) - 1, decoded.present);
+        }
+    }
+}
+
+void test_bad_node_id_is_malformed(void) {
+    static const uint8_t NOT_FIRST[] = {Q_TEMP, 4, 0, 0, 0, 0};
+    static const uint8_t TOO_LONG[] = {Q_NODE_ID, 9, '1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    static const uint8_t PAST_END[] = {Q_NODE_ID, 4, 'N', '-'};
+    const uint8_t* bodies[] = {NOT_FIRST, TOO_LONG, PAST_END};
+    const size_t sizes[] = {sizeof(NOT_FIRST), sizeof(TOO_LONG), sizeof(PAST_END)};
+    for (size_t i = 0; i < 3; i++) {
+        uint8_t frame[SENSOR_FRAME_MAX];
+        size_t length = rawFrame(SCHEMA_CLIMATE, bodies[i], sizes[i], frame);
+        FrameDecoder decoder;
+        SensorReading decoded;
+        TEST_ASSERT_EQUAL_INT(0, feedBytes(decoder, frame, length, decoded));
+        TEST_ASSERT_EQUAL_UINT32(1, decoder.getStats().malformed);
+    }
+}
+
+void test_unknown_schema_and_version_are_counted(void) {
+    static const uint8_t BODY[] = {Q_NODE_ID, 1, 'N'};
+    uint8_t frame[SENSOR_FRAME_MAX];
+    size_t length = rawFrame(SCHEMA_ID_LIMIT, BODY, sizeof(BODY), frame);
+    FrameDecoder decoder;
+    SensorReading decoded;
+    TEST_ASSERT_EQUAL_INT(0, feedBytes(decoder, frame, length, decoded));
+    TEST_ASSERT_EQUAL_UINT32(1, decoder.getStats().unknownSchema);
+
+    length = rawFrame(SCHEMA_CLIMATE, BODY, sizeof(BODY), frame);
+    frame[2] = SENSOR_FRAME_VERSION + 1;
+    uint16_t crc = crc16(frame + 2, SENSOR_FRAME_HEADER - 2 + sizeof(BODY));
+    frame[length - 2] = crc & 0xFF;
+    frame[length - 1] = crc >> 8;
+    TEST_ASSERT_EQUAL_INT(0, feedBytes(decoder, frame, length, decoded));
+    TEST_ASSERT_EQUAL_UINT32(1, decoder.getStats().badVersion);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_every_schema_is_registered);
+    RUN_TEST(test_round_trip_every_field_subset);
+    RUN_TEST(test_encode_reports_too_small_buffer);
+    RUN_TEST(test_unknown_tags_are_skipped);
+    RUN_TEST(test_corrupt_bytes_are_rejected);
+    RUN_TEST(test_truncated_frames_are_dropped);
+    RUN_TEST(test_truncated_tlv_is_malformed);
+    RUN_TEST(test_bad_node_id_is_malformed);
+    RUN_TEST(test_unknown_schema_and_version_are_counted);
+    return UNITY_END();
+}
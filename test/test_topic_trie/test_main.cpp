@@ -0,0 +1,267 @@
+// TopicTrie: random subscribe, unsubscribe and removeClient sequences over
+// several client slots, every match() checked against a plain list of the
+// filters tested one by one with TopicTrie::matches(); the matching rules
+// themselves; and a node pool running out without leaving half a filter
+// behind.
+
+#include <unity.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "topic_trie.h"
+
+static uint32_t rngState;
+
+static uint32_t nextRandom() {
+    rngState = rngState * 1664525u + 1013904223u;
+    return rngState >> 8;
+}
+
+static const char* const LEVELS[] = {"a", "b", "c", "", "$s"};
+static const size_t LEVEL_COUNT = sizeof(LEVELS) / sizeof(LEVELS[0]);
+
+static std::string randomTopic() {
+    std::string topic;
+    uint32_t levels = 1 + nextRandom() % 4;
+    for (uint32_t i = 0; i < levels; i++) {
+        topic += (i > 0 ? "/" : "") + std::string(LEVELS[nextRandom() % LEVEL_COUNT]);
+    }
+    // Neither may be empty; two empty levels are fine
+    return topic.empty() ? "/" : topic;
+}
+
+// Topic levels, '+' now and then, and '#' only at the end
+static std::string randomFilter() {
+    std::string filter;
+    uint32_t levels = 1 + nextRandom() % 4;
+    for (uint32_t i = 0; i < levels; i++) {
+        uint32_t pick = nextRandom() % (LEVEL_COUNT + 2);
+        std::string level = pick < LEVEL_COUNT ? LEVELS[pick] : "+";
+        if (i + 1 == levels && pick == LEVEL_COUNT + 1) {
+            level = "#";
+        }
+        filter += (i > 0 ? "/" : "") + level;
+    }
+    return filter.empty() ? "/" : filter;
+}
+
+// The subscriptions as a broker without the trie would keep them: filter
+// to QoS, per client slot
+typedef std::map<std::string, uint8_t> Filters;
+
+static uint32_t expectedMatch(const std::vector<Filters>& clients, const std::string& topic, uint32_t& qos1) {
+    uint32_t matched = 0;
+    qos1 = 0;
+    for (size_t slot = 0; slot < clients.size(); slot++) {
+        for (const auto& entry : clients[slot]) {
+            if (TopicTrie::matches(entry.first.c_str(), topic.c_str())) {
+                matched |= (uint32_t)1 << slot;
+                if (entry.second > 0) {
+                    qos1 |= (uint32_t)1 << slot;
+                }
+            }
+        }
+    }
+    return matched;
+}
+
+static void checkTopics(const TopicTrie& trie, const std::vector<Filters>& clients, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        std::string topic = randomTopic();
+        uint32_t qos1;
+        uint32_t wantedQos1;
+        uint32_t wanted = expectedMatch(clients, topic, wantedQos1);
+        TEST_ASSERT_EQUAL_HEX32_MESSAGE(wanted, trie.match(topic.c_str(), qos1), topic.c_str());
+        TEST_ASSERT_EQUAL_HEX32_MESSAGE(wantedQos1, qos1, topic.c_str());
+    }
+}
+
+static TopicTrie* trie;
+
+void setUp(void) {
+    rngState = 1;
+    trie = new TopicTrie();
+}
+
+void tearDown(void) {
+    delete trie;
+}
+
+void test_matches_rules(void) {
+    struct Case {
+        const char* filter;
+        const char* topic;
+        bool matched;
+    };
+    const Case cases[] = {
+        {"sport/tennis/player1/#", "sport/tennis/player1", true},
+        {"sport/tennis/player1/#", "sport/tennis/player1/ranking", true},
+        {"sport/tennis/player1/#", "sport/tennis/player1/score/wimbledon", true},
+        {"sport/tennis/player1/#", "sport/tennis/player2", false},
+        {"sport/#", "sport", true},
+        {"#", "sport/tennis", true},
+        {"sport/tennis/+", "sport/tennis/player1", true},
+        {"sport/tennis/+", "sport/tennis/player1/ranking", false},
+        {"sport/+", "sport", false},
+        {"sport/+", "sport/", true},
+        {"+/+", "/finance", true},
+        {"/+", "/finance", true},
+        {"+", "/finance", false},
+        {"a/b", "a/b", true},
+        {"a/b", "a/b/c", false},
+        {"a/b/c", "a/b", false},
+        {"A/b", "a/b", false},
+        {"#", "$SYS/uptime", false},
+        {"+/uptime", "$SYS/uptime", false},
+        {"$SYS/#", "$SYS/uptime", true},
+        {"$SYS/+", "$SYS/uptime", true},
+    };
+    for (const Case& c : cases) {
+        TEST_ASSERT_EQUAL_MESSAGE(c.matched, TopicTrie::matches(c.filter, c.topic), c.filter);
+        TopicTrie single;
+        TEST_ASSERT_TRUE(single.subscribe(c.filter, 3, 1));
+        uint32_t qos1;
+        TEST_ASSERT_EQUAL_HEX32_MESSAGE(c.matched ? 0x08 : 0, single.match(c.topic, qos1), c.filter);
+    }
+}
+
+void test_invalid_filters_refused(void) {
+    const char* invalid[] = {"", "a/#/b", "#/a", "a+", "a/b#", "+a/b", "a/#b"};
+    for (const char* filter : invalid) {
+        TEST_ASSERT_FALSE_MESSAGE(TopicTrie::validFilter(filter), filter);
+        TEST_ASSERT_FALSE_MESSAGE(trie->subscribe(filter, 0, 0), filter);
+    }
+    TEST_ASSERT_EQUAL_UINT16(1, trie->nodesUsed());
+    TEST_ASSERT_TRUE(TopicTrie::validFilter("a//+/#"));
+    TEST_ASSERT_TRUE(TopicTrie::validTopic("a//b"));
+    TEST_ASSERT_FALSE(TopicTrie::validTopic("a/+"));
+    TEST_ASSERT_FALSE(TopicTrie::validTopic(""));
+
+    std::string level(BROKER_LEVEL_SIZE, 'x');
+    TEST_ASSERT_FALSE(trie->subscribe(("a/" + level).c_str(), 0, 0));
+    TEST_ASSERT_EQUAL_UINT16(1, trie->nodesUsed());
+    level.pop_back();
+    TEST_ASSERT_TRUE(trie->subscribe(("a/" + level).c_str(), 0, 0));
+    uint32_t qos1;
+    TEST_ASSERT_EQUAL_HEX32(1, trie->match(("a/" + level).c_str(), qos1));
+}
+
+void test_random_operations_against_matches(void) {
+    for (uint32_t seed = 1; seed <= 40; seed++) {
+        rngState = seed;
+        TopicTrie local;
+        std::vector<Filters> clients(BROKER_CLIENTS);
+        for (uint32_t step = 0; step < 400; step++) {
+            uint8_t slot = nextRandom() % BROKER_CLIENTS;
+            uint32_t action = nextRandom() % 10;
+            if (action < 6) {
+                std::string filter = randomFilter();
+                uint8_t qos = nextRandom() % 2;
+                uint16_t before = local.nodesUsed();
+                if (local.subscribe(filter.c_str(), slot, qos)) {
+                    clients[slot][filter] = qos;
+                } else {
+                    // Only a full pool refuses a valid filter, and then nothing changes
+                    TEST_ASSERT_EQUAL_UINT16(before, local.nodesUsed());
+                    TEST_ASSERT_TRUE_MESSAGE(before + 4 > BROKER_TRIE_NODES, filter.c_str());
+                }
+            } else if (action < 9) {
+                // Mostly a filter the client has
+                std::string filter = randomFilter();
+                if (!clients[slot].empty() && nextRandom() % 4 != 0) {
+                    auto entry = clients[slot].begin();
+                    std::advance(entry, nextRandom() % clients[slot].size());
+                    filter = entry->first;
+                }
+                local.unsubscribe(filter.c_str(), slot);
+                clients[slot].erase(filter);
+            } else {
+                local.removeClient(slot);
+                clients[slot].clear();
+            }
+            TEST_ASSERT_LESS_OR_EQUAL(BROKER_TRIE_NODES, local.nodesUsed());
+            checkTopics(local, clients, 8);
+        }
+        for (uint8_t slot = 0; slot < BROKER_CLIENTS; slot++) {
+            for (const auto& entry : clients[slot]) {
+                local.unsubscribe(entry.first.c_str(), slot);
+            }
+            clients[slot].clear();
+        }
+        // Every node went back to the pool
+        TEST_ASSERT_EQUAL_UINT16(1, local.nodesUsed());
+        checkTopics(local, clients, 20);
+    }
+}
+
+// The last subscription to a filter decides its QoS; clients are separate
+void test_qos_per_client(void) {
+    uint32_t qos1;
+    TEST_ASSERT_TRUE(trie->subscribe("a/+", 0, 1));
+    TEST_ASSERT_TRUE(trie->subscribe("a/+", 1, 0));
+    TEST_ASSERT_TRUE(trie->subscribe("a/b", 1, 1));
+    TEST_ASSERT_EQUAL_HEX32(0x03, trie->match("a/b", qos1));
+    TEST_ASSERT_EQUAL_HEX32(0x03, qos1);
+    TEST_ASSERT_EQUAL_HEX32(0x03, trie->match("a/c", qos1));
+    TEST_ASSERT_EQUAL_HEX32(0x01, qos1);
+    TEST_ASSERT_TRUE(trie->subscribe("a/+", 0, 0));
+    trie->match("a/c", qos1);
+    TEST_ASSERT_EQUAL_HEX32(0x00, qos1);
+    trie->unsubscribe("a/+", 1);
+    TEST_ASSERT_EQUAL_HEX32(0x01, trie->match("a/c", qos1));
+    TEST_ASSERT_EQUAL_UINT16(4, trie->nodesUsed());
+}
+
+void test_pool_exhaustion(void) {
+    char filter[BROKER_TOPIC_SIZE];
+    uint16_t added = 0;
+    while (trie->nodesUsed() < BROKER_TRIE_NODES - 2) {
+        snprintf(filter, sizeof(filter), "x%u", (unsigned)added++);
+        TEST_ASSERT_TRUE(trie->subscribe(filter, 0, 0));
+    }
+
+    // Three levels need three nodes: refused without keeping the first two
+    TEST_ASSERT_FALSE(trie->subscribe("y/z/w", 1, 1));
+    TEST_ASSERT_EQUAL_UINT16(BROKER_TRIE_NODES - 2, trie->nodesUsed());
+    uint32_t qos1;
+    TEST_ASSERT_EQUAL_HEX32(0, trie->match("y/z/w", qos1));
+    TEST_ASSERT_EQUAL_HEX32(0, trie->match("y/z", qos1));
+
+    // A filter sharing levels that exist needs only the new ones
+    TEST_ASSERT_TRUE(trie->subscribe("x0/+", 1, 1));
+    TEST_ASSERT_TRUE(trie->subscribe("y", 1, 1));
+    TEST_ASSERT_EQUAL_UINT16(BROKER_TRIE_NODES, trie->nodesUsed());
+    TEST_ASSERT_FALSE(trie->subscribe("q", 2, 0));
+    // Existing filters still subscribe, for another client or another QoS
+    TEST_ASSERT_TRUE(trie->subscribe("x1", 2, 1));
+    TEST_ASSERT_TRUE(trie->subscribe("y", 1, 0));
+    TEST_ASSERT_EQUAL_HEX32(0x04 | 0x01, trie->match("x1", qos1));
+    TEST_ASSERT_EQUAL_HEX32(0x04, qos1);
+    TEST_ASSERT_EQUAL_HEX32(0x02, trie->match("x0/anything", qos1));
+
+    // A freed node is taken again
+    trie->unsubscribe("x2", 0);
+    TEST_ASSERT_EQUAL_UINT16(BROKER_TRIE_NODES - 1, trie->nodesUsed());
+    TEST_ASSERT_TRUE(trie->subscribe("q", 2, 0));
+    TEST_ASSERT_EQUAL_HEX32(0x04, trie->match("q", qos1));
+    TEST_ASSERT_EQUAL_HEX32(0, trie->match("x2", qos1));
+
+    // x0 still has client 1's x0/+ below it
+    trie->removeClient(0);
+    TEST_ASSERT_EQUAL_HEX32(0, trie->match("x0", qos1));
+    TEST_ASSERT_EQUAL_HEX32(0x02, trie->match("x0/a", qos1));
+    trie->removeClient(1);
+    trie->removeClient(2);
+    TEST_ASSERT_EQUAL_UINT16(1, trie->nodesUsed());
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_matches_rules);
+    RUN_TEST(test_invalid_filters_refused);
+    RUN_TEST(test_random_operations_against_matches);
+    RUN_TEST(test_qos_per_client);
+    RUN_TEST(test_pool_exhaustion);
+    return UNITY_END();
+}
@@ -0,0 +1,209 @@
+// WiFiManager against FakeWiFiRadio events on a FakeClock: the cached
+// BSSID/channel fast path, the fall back to a full scan, backoff and the
+// reconnect figures
+
+#include <unity.h>
+#include "config.h"
+#include "hal.h"
+#include "wifi_manager.h"
+
+static HubConfig config;
+static FakeWiFiRadio* radio;
+static FakeClock* fakeClock;
+static WiFiManager* wifi;
+
+static WiFiApCache homeAp() {
+    WiFiApCache ap = {};
+    const uint8_t bssid[6] = {0x24, 0x0A, 0xC4, 0x11, 0x22, 0x33};
+    memcpy(ap.bssid, bssid, sizeof(bssid));
+    ap.channel = 11;
+    ap.ip = 0x0A01A8C0;     // 192.168.1.10
+    return ap;
+}
+
+void setUp(void) {
+    config = HubConfig();
+    setConfigString(config.wifi_ssid, "site-net");
+    setConfigString(config.wifi_password, "secret");
+    radio = new FakeWiFiRadio();
+    fakeClock = new FakeClock();
+    wifi = new WiFiManager(&config, radio, fakeClock);
+}
+
+void tearDown(void) {
+    delete wifi;
+    delete fakeClock;
+    delete radio;
+}
+
+// The driver connects the current attempt after ms
+static void connectAfter(uint32_t ms) {
+    fakeClock->sleepMs(ms);
+    radio->inject(WIFI_EVT_CONNECTED);
+    radio->inject(WIFI_EVT_GOT_IP);
+    wifi->loop();
+}
+
+static void test_first_connect_scans_and_saves_the_ap(void) {
+    radio->ap = homeAp();
+    wifi->begin();
+    TEST_ASSERT_EQUAL_UINT32(1, radio->attempts);
+    TEST_ASSERT_EQUAL_UINT32(0, radio->fastAttempts);
+    TEST_ASSERT_EQUAL(WIFI_CONNECTING, wifi->getState());
+
+    connectAfter(2400);
+    TEST_ASSERT_TRUE(wifi->isConnected());
+    TEST_ASSERT_EQUAL_UINT32(2400, wifi->getStats().firstConnectMs);
+    TEST_ASSERT_TRUE(radio->hasStored);
+    TEST_ASSERT_EQUAL_MEMORY(homeAp().bssid, radio->stored.bssid, 6);
+    TEST_ASSERT_EQUAL_UINT8(11, radio->stored.channel);
+}
+
+static void test_link_loss_reconnects_on_the_cached_ap(void) {
+    radio->ap = homeAp();
+    wifi->begin();
+    connectAfter(2000);
+
+    fakeClock->sleepMs(60000);
+    radio->inject(WIFI_EVT_DISCONNECTED, 200);  // Beacon timeout
+    wifi->loop();
+    TEST_ASSERT_EQUAL(WIFI_CONNECTING, wifi->getState());
+    TEST_ASSERT_EQUAL_UINT32(2, radio->attempts);
+    TEST_ASSERT_EQUAL_UINT32(1, radio->fastAttempts);
+    TEST_ASSERT_EQUAL_MEMORY(homeAp().bssid, radio->lastCache.bssid, 6);
+    TEST_ASSERT_EQUAL_UINT8(11, radio->lastCache.channel);
+    TEST_ASSERT_FALSE(radio->lastUsedLease);
+
+    connectAfter(180);
+    const WiFiStats& stats = wifi->getStats();
+    TEST_ASSERT_TRUE(wifi->isConnected());
+    TEST_ASSERT_EQUAL_UINT32(1, stats.linkLosses);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.reconnects);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.fastSuccesses);
+    TEST_ASSERT_EQUAL_UINT32(180, stats.lastReconnectMs);
+}
+
+static void test_boot_with_a_stored_ap_goes_straight_to_it(void) {
+    // A first boot saves the AP with the SSID's hash
+    radio->ap = homeAp();
+    wifi->begin();
+    connectAfter(1000);
+    uint32_t hash = radio->stored.ssidHash;
+    TEST_ASSERT_NOT_EQUAL(0, hash);
+
+    FakeWiFiRadio second;
+    second.stored = radio->stored;
+    second.hasStored = true;
+    second.ap = homeAp();
+    FakeClock secondClock;
+    WiFiManager rebooted(&config, &second, &secondClock);
+    rebooted.begin();
+    TEST_ASSERT_EQUAL_UINT32(1, second.fastAttempts);
+    TEST_ASSERT_EQUAL_UINT8(11, second.lastCache.channel);
+    TEST_ASSERT_EQUAL_UINT32(hash, second.lastCache.ssidHash);
+
+    // Cached for another SSID: scan
+    setConfigString(config.wifi_ssid, "other-net");
+    FakeWiFiRadio third;
+    third.stored = radio->stored;
+    third.hasStored = true;
+    WiFiManager renamed(&config, &third, &secondClock);
+    renamed.begin();
+    TEST_ASSERT_EQUAL_UINT32(1, third.attempts);
+    TEST_ASSERT_EQUAL_UINT32(0, third.fastAttempts);
+}
+
+static void test_fast_attempt_timeout_falls_back_to_a_scan(void) {
+    radio->ap = homeAp();
+    wifi->begin();
+    connectAfter(2000);
+    radio->inject(WIFI_EVT_DISCONNECTED, 200);
+    wifi->loop();
+    TEST_ASSERT_EQUAL_UINT32(1, radio->fastAttempts);
+
+    // The AP moved channel: the cached attempt never gets an IP
+    fakeClock->sleepMs(WIFI_FAST_TIMEOUT);
+    wifi->loop();
+    TEST_ASSERT_EQUAL_UINT32(3, radio->attempts);
+    TEST_ASSERT_EQUAL_UINT32(1, radio->fastAttempts);   // The new one scans
+    TEST_ASSERT_EQUAL(WIFI_CONNECTING, wifi->getState());
+    TEST_ASSERT_EQUAL_UINT32(1, wifi->getStats().failures);
+
+    WiFiApCache moved = homeAp();
+    moved.channel = 6;
+    radio->ap = moved;
+    connectAfter(4000);
+    TEST_ASSERT_TRUE(wifi->isConnected());
+    TEST_ASSERT_EQUAL_UINT32(0, wifi->getConsecutiveFailures());
+    TEST_ASSERT_EQUAL_UINT8(6, radio->stored.channel);
+    TEST_ASSERT_EQUAL_UINT32(0, wifi->getStats().fastSuccesses);
+}
+
+static void test_rejected_fast_attempt_scans_at_once(void) {
+    radio->ap = homeAp();
+    wifi->begin();
+    connectAfter(2000);
+    radio->inject(WIFI_EVT_DISCONNECTED, 200);
+    wifi->loop();
+    radio->inject(WIFI_EVT_DISCONNECTED, 201);  // No AP found
+    wifi->loop();
+    TEST_ASSERT_EQUAL_UINT32(3, radio->attempts);
+    TEST_ASSERT_EQUAL_UINT32(1, radio->fastAttempts);
+    TEST_ASSERT_EQUAL(WIFI_CONNECTING, wifi->getState());
+}
+
+static void test_own_disconnect_is_not_a_failure(void) {
+    wifi->begin();
+    radio->inject(WIFI_EVT_DISCONNECTED, 8);    // ASSOC_LEAVE from begin()
+    wifi->loop();
+    TEST_ASSERT_EQUAL(WIFI_CONNECTING, wifi->getState());
+    TEST_ASSERT_EQUAL_UINT32(0, wifi->getStats().failures);
+}
+
+static void test_scan_failures_back_off_and_open_the_portal(void) {
+    wifi->begin();
+    uint32_t expected = WIFI_BACKOFF_MIN;
+    for (uint32_t i = 1; i <= WIFI_MAX_FAILURES; i++) {
+        fakeClock->sleepMs(WIFI_CONNECT_TIMEOUT);
+        wifi->loop();
+        TEST_ASSERT_EQUAL(WIFI_BACKOFF, wifi->getState());
+        TEST_ASSERT_EQUAL_UINT32(i, wifi->getConsecutiveFailures());
+        // Not a millisecond early
+        fakeClock->sleepMs(expected - 1);
+        wifi->loop();
+        TEST_ASSERT_EQUAL(WIFI_BACKOFF, wifi->getState());
+        fakeClock->sleepMs(1);
+        wifi->loop();
+        TEST_ASSERT_EQUAL(WIFI_CONNECTING, wifi->getState());
+        expected = expected * 2 > WIFI_BACKOFF_MAX ? WIFI_BACKOFF_MAX : expected * 2;
+    }
+    TEST_ASSERT_TRUE(wifi->shouldEnterPortal());
+    TEST_ASSERT_EQUAL_UINT32(0, radio->fastAttempts);
+
+    connectAfter(500);
+    TEST_ASSERT_FALSE(wifi->shouldEnterPortal());
+}
+
+static void test_reconfigure_drops_the_cache_of_the_old_ssid(void) {
+    radio->ap = homeAp();
+    wifi->begin();
+    connectAfter(1000);
+    setConfigString(config.wifi_ssid, "new-net");
+    wifi->reconfigure();
+    TEST_ASSERT_EQUAL_UINT32(1, radio->disconnects);
+    TEST_ASSERT_EQUAL_UINT32(2, radio->attempts);
+    TEST_ASSERT_EQUAL_UINT32(0, radio->fastAttempts);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_first_connect_scans_and_saves_the_ap);
+    RUN_TEST(test_link_loss_reconnects_on_the_cached_ap);
+    RUN_TEST(test_boot_with_a_stored_ap_goes_straight_to_it);
+    RUN_TEST(test_fast_attempt_timeout_falls_back_to_a_scan);
+    RUN_TEST(test_rejected_fast_attempt_scans_at_once);
+    RUN_TEST(test_own_disconnect_is_not_a_failure);
+    RUN_TEST(test_scan_failures_back_off_and_open_the_portal);
+    RUN_TEST(test_reconfigure_drops_the_cache_of_the_old_ssid);
+    return UNITY_END();
+}
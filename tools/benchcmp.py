@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+"""Compare two benchmark reports produced by the hub's benchmark suite.
+
+  tools/benchcmp.py old.json new.json [--threshold 5]
+
+Reads the JSON written by ``program --bench json`` (native) or the ``bench``
+serial command (device) and prints per-benchmark deltas. Exits non-zero if
+any ns/op or allocs/op regressed by more than the threshold percentage, so it
+can gate CI between commits.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as report:
+        data = json.load(report)
+    return data.get("platform", "?"), {r["name"]: r for r in data["results"]}
+
+
+def delta(old, new):
+    if old == 0:
+        return 0.0 if new == 0 else float("inf")
+    return 100.0 * (new - old) / old
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("old")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=5.0, help="allowed regression in percent")
+    args = parser.parse_args()
+
+    old_platform, old = load(args.old)
+    new_platform, new = load(args.new)
+    if old_platform != new_platform:
+        print("warning: comparing %s against %s" % (old_platform, new_platform))
+
+    regressed = False
+    print("%-22s %12s %12s %8s %10s %10s" % ("name", "old ns/op", "new ns/op", "delta", "old alloc", "new alloc"))
+    for name in sorted(set(old) | set(new)):
+        if name not in old or name not in new:
+            print("%-22s %s" % (name, "only in " + ("new" if name in new else "old")))
+            continue
+        o, n = old[name], new[name]
+        time_delta = delta(o["ns_per_op"], n["ns_per_op"])
+        alloc_delta = delta(o["allocs_per_op"], n["allocs_per_op"])
+        flag = ""
+        if time_delta > args.threshold or alloc_delta > args.threshold:
+            flag = "  REGRESSION"
+            regressed = True
+        print("%-22s %12.1f %12.1f %+7.1f%% %10.3f %10.3f%s"
+              % (name, o["ns_per_op"], n["ns_per_op"], time_delta,
+                 o["allocs_per_op"], n["allocs_per_op"], flag))
+
+    sys.exit(1 if regressed else 0)
+
+
+if __name__ == "__main__":
+    main()
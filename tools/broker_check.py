@@ -0,0 +1,338 @@
+#!/usr/bin/env python3
+"""Check the hub's embedded broker (-DMQTT_BROKER=1) with a real MQTT client.
+
+Drives the broker through paho-mqtt 2.x (``pip install paho-mqtt``), so what
+is tested is what a dashboard or controller on the site network would see,
+not the broker's own idea of the protocol:
+
+  wildcards  '+' and '#' filters, overlapping filters delivering one copy,
+             '$' topics kept from a leading wildcard
+  qos        grants capped at 1, copies at the lower of publish and grant;
+             a copy that isn't acked comes again with DUP and the same
+             packet id every BROKER_RESEND_MS (``--resend-wait``), and
+             stops once its PUBACK is in
+  retained   kept on publish, sent on subscribe with the retain flag,
+             cleared by an empty retained publish
+  wills      published on an abnormal close, retained when asked, not
+             published on a DISCONNECT
+  takeover   a second connect with the same client id closes the first,
+             which then counts as abnormal, so its will goes out
+  bridge     a publish under ``site/`` reaches the upstream broker as
+             ``hub/<hub_id>/local/<topic>``; needs ``--upstream`` with a
+             broker that routes (mosquitto), skipped otherwise
+
+Each check prints PASS or FAIL, and the exit status is 1 if any failed.
+
+Examples:
+
+  .pio/build/native/program --broker 127.0.0.1:1883 --local-broker 18831
+  tools/broker_check.py --port 18831 --upstream 127.0.0.1:1883
+"""
+
+import argparse
+import queue
+import socket
+import struct
+import sys
+import time
+import uuid
+
+try:
+    import paho.mqtt.client as mqtt
+    from paho.mqtt.enums import CallbackAPIVersion
+except ImportError:
+    sys.exit("broker_check.py needs paho-mqtt 2.x: pip install paho-mqtt")
+
+
+class Probe:
+    """One paho client on a background loop, its messages in a queue."""
+
+    def __init__(self, host, port, client_id=None, will=None, clean=True):
+        self.client_id = client_id or "check-" + uuid.uuid4().hex[:8]
+        self.messages = queue.Queue()
+        self.acks = queue.Queue()
+        self.closed = queue.Queue()
+        self.qos = []                               # Of each message, in order
+        self.client = mqtt.Client(CallbackAPIVersion.VERSION2, self.client_id, clean_session=clean,
+                                  protocol=mqtt.MQTTv311)
+        self.client.on_message = lambda c, u, m: (self.qos.append(m.qos),
+                                                  self.messages.put((m.topic, m.payload, bool(m.retain))))
+        self.client.on_subscribe = lambda c, u, mid, codes, p: self.acks.put([code.value for code in codes])
+        self.client.on_disconnect = lambda c, u, flags, rc, p: self.closed.put(rc)
+        if will:
+            topic, payload, retain = will
+            self.client.will_set(topic, payload, qos=0, retain=retain)
+        connected = queue.Queue()
+        self.client.on_connect = lambda c, u, flags, rc, p: connected.put(rc.value)
+        self.client.connect(host, port, keepalive=30)
+        self.client.loop_start()
+        rc = connected.get(timeout=3)
+        if rc != 0:
+            raise ConnectionError("CONNACK %d" % rc)
+
+    def subscribe(self, *filters, qos=0):
+        self.client.subscribe([(f, qos) for f in filters])
+        return self.acks.get(timeout=3)
+
+    def publish(self, topic, payload, qos=0, retain=False):
+        info = self.client.publish(topic, payload, qos=qos, retain=retain)
+        info.wait_for_publish(timeout=3)
+        return info.is_published()
+
+    def receive(self, wait=0.5):
+        """Everything that arrives within the next ``wait`` seconds."""
+        got = []
+        deadline = time.monotonic() + wait
+        try:
+            while True:
+                got.append(self.messages.get(timeout=max(0.0, deadline - time.monotonic())))
+        except queue.Empty:
+            return got
+
+    def disconnect(self):
+        self.client.disconnect()
+        self.client.loop_stop()
+
+    def drop(self):
+        """Close the socket without a DISCONNECT, as a power cut would."""
+        self.client.loop_stop()
+        self.client.socket().shutdown(socket.SHUT_RDWR)
+        self.client.socket().close()
+
+
+class RawClient:
+    """A 3.1.1 client on a bare socket that acks only when told to."""
+
+    def __init__(self, host, port, client_id):
+        self.sock = socket.create_connection((host, port), timeout=3)
+        body = (struct.pack(">H", 4) + b"MQTT" + bytes([4, 0x02]) + struct.pack(">H", 60) +
+                struct.pack(">H", len(client_id)) + client_id.encode())
+        self._send(0x10, body)
+        header, body = self.packet(3)
+        if header != 0x20 or body[1] != 0:
+            raise ConnectionError("CONNACK %r" % body)
+
+    def _send(self, header, body):
+        length, encoded = len(body), b""
+        while True:
+            byte, length = length & 0x7F, length >> 7
+            encoded += bytes([byte | (0x80 if length else 0)])
+            if not length:
+                break
+        self.sock.sendall(bytes([header]) + encoded + body)
+
+    def _read(self, n):
+        data = b""
+        while len(data) < n:
+            chunk = self.sock.recv(n - len(data))
+            if not chunk:
+                raise ConnectionError("closed")
+            data += chunk
+        return data
+
+    def packet(self, timeout):
+        """(header, body) of the next packet, None after timeout seconds."""
+        self.sock.settimeout(timeout)
+        try:
+            header = self._read(1)[0]
+        except socket.timeout:
+            return None, None
+        self.sock.settimeout(3)
+        length, shift = 0, 0
+        while True:
+            byte = self._read(1)[0]
+            length |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                break
+        return header, self._read(length)
+
+    def subscribe(self, topic_filter, qos):
+        self._send(0x82, struct.pack(">HH", 1, len(topic_filter)) + topic_filter.encode() + bytes([qos]))
+        header, body = self.packet(3)
+        return list(body[2:]) if header == 0x90 else None
+
+    def publishes(self, timeout):
+        """(flags, packet id) of every PUBLISH within timeout seconds."""
+        got, deadline = [], time.monotonic() + timeout
+        while True:
+            header, body = self.packet(max(0.0, deadline - time.monotonic()))
+            if header is None:
+                return got
+            if header >> 4 == 3:
+                topic_length = struct.unpack(">H", body[:2])[0]
+                packet_id = struct.unpack(">H", body[2 + topic_length:4 + topic_length])[0] if header & 0x06 else 0
+                got.append((header & 0x0F, packet_id))
+
+    def puback(self, packet_id):
+        self._send(0x40, struct.pack(">H", packet_id))
+
+    def close(self):
+        self.sock.close()
+
+
+class Checks:
+    def __init__(self):
+        self.failed = 0
+
+    def check(self, name, ok, detail=""):
+        print("%s %s%s" % ("PASS" if ok else "FAIL", name, "" if ok or not detail else ": %s" % detail))
+        self.failed += 0 if ok else 1
+
+
+def check_wildcards(args, c):
+    sub = Probe(args.host, args.port)
+    pub = Probe(args.host, args.port)
+    c.check("'+' and '#' granted", sub.subscribe("site/+/valve", "site/#") == [0, 0])
+    pub.publish("site/1/valve", b"open", qos=1)
+    got = sub.receive()
+    c.check("overlapping filters deliver once", got == [("site/1/valve", b"open", False)], got)
+    pub.publish("site/1/valve/extra", b"x")
+    pub.publish("other/1/valve", b"x")
+    got = sub.receive()
+    c.check("'+' spans one level, '#' the rest", got == [("site/1/valve/extra", b"x", False)], got)
+    root = Probe(args.host, args.port)
+    root.subscribe("#", "+/status")
+    pub.publish("$SYS/check", b"x")
+    pub.publish("site/status", b"x")
+    got = [m for m in root.receive() if m[0] in ("$SYS/check", "site/status")]
+    c.check("'$' topics not matched by a leading wildcard", got == [("site/status", b"x", False)], got)
+    for probe in (sub, pub, root):
+        probe.disconnect()
+
+
+def check_qos(args, c):
+    sub = Probe(args.host, args.port)
+    pub = Probe(args.host, args.port)
+    c.check("QoS 2 granted as 1", sub.subscribe("site/qos/#", qos=2) == [1])
+    pub.publish("site/qos/one", b"1", qos=1)
+    pub.publish("site/qos/zero", b"0", qos=0)
+    got = sub.receive()
+    c.check("copies at the lower of publish and grant", len(got) == 2 and sub.qos == [1, 0], (got, sub.qos))
+    for probe in (sub, pub):
+        probe.disconnect()
+
+    raw = RawClient(args.host, args.port, "check-raw-" + uuid.uuid4().hex[:6])
+    pub = Probe(args.host, args.port)
+    raw.subscribe("site/resend/#", 1)
+    pub.publish("site/resend/a", b"a", qos=1)
+    first = raw.publishes(0.5)
+    c.check("QoS 1 copy with a packet id", len(first) == 1 and first[0][0] & 0x06 == 0x02 and first[0][1] != 0, first)
+    again = raw.publishes(args.resend_wait + 1.0)
+    c.check("unacked copy sent again with DUP and the same id",
+            len(first) == 1 and again[:1] == [(first[0][0] | 0x08, first[0][1])], again)
+    packet_id = first[0][1] if first else 0
+    raw.puback(packet_id ^ 0x5A5A)
+    again = raw.publishes(args.resend_wait + 1.0)
+    c.check("a PUBACK for another id acks nothing", again[:1] == [(0x0A, packet_id)], again)
+    raw.puback(packet_id)
+    c.check("no resend once acked", raw.publishes(args.resend_wait + 1.0) == [])
+    raw.close()
+    pub.disconnect()
+
+
+def check_retained(args, c):
+    topic = "site/check/state"
+    pub = Probe(args.host, args.port)
+    pub.publish(topic, b"closed", qos=1, retain=True)
+    sub = Probe(args.host, args.port)
+    sub.subscribe("site/+/state")
+    got = sub.receive()
+    c.check("retained sent on subscribe", got == [(topic, b"closed", True)], got)
+    pub.publish(topic, b"open", retain=True)
+    got = sub.receive()
+    c.check("live copy not flagged retained", got == [(topic, b"open", False)], got)
+    pub.publish(topic, b"", retain=True)
+    sub.receive()
+    late = Probe(args.host, args.port)
+    late.subscribe(topic)
+    got = late.receive()
+    c.check("empty retained publish clears it", got == [], got)
+    for probe in (pub, sub, late):
+        probe.disconnect()
+
+
+def check_wills(args, c):
+    watcher = Probe(args.host, args.port)
+    watcher.subscribe("site/+/status")
+    dropped = Probe(args.host, args.port, will=("site/dropped/status", b"offline", True))
+    dropped.drop()
+    got = watcher.receive(1.5)
+    c.check("will on an abnormal close", got == [("site/dropped/status", b"offline", False)], got)
+    late = Probe(args.host, args.port)
+    late.subscribe("site/dropped/status")
+    got = late.receive()
+    c.check("will kept when retained", got == [("site/dropped/status", b"offline", True)], got)
+    polite = Probe(args.host, args.port, will=("site/polite/status", b"offline", False))
+    polite.disconnect()
+    got = watcher.receive(1.5)
+    c.check("no will after DISCONNECT", got == [], got)
+    # Leave nothing retained behind for the next run
+    late.publish("site/dropped/status", b"", retain=True)
+    for probe in (watcher, late):
+        probe.disconnect()
+
+
+def check_takeover(args, c):
+    watcher = Probe(args.host, args.port)
+    watcher.subscribe("site/takeover/#")
+    client_id = "check-takeover-" + uuid.uuid4().hex[:6]
+    first = Probe(args.host, args.port, client_id, will=("site/takeover/will", b"gone", False))
+    first.client.reconnect_delay_set(60, 60)    # Or paho would take it straight back
+    second = Probe(args.host, args.port, client_id)
+    try:
+        first.closed.get(timeout=2)
+        closed = True
+    except queue.Empty:
+        closed = False
+    first.client.loop_stop()
+    c.check("second connect closes the first", closed)
+    got = watcher.receive(1.0)
+    c.check("taken-over client's will goes out", got == [("site/takeover/will", b"gone", False)], got)
+    second.subscribe("site/takeover/ping")
+    watcher.publish("site/takeover/ping", b"1")
+    got = second.receive()
+    c.check("new connection is served", got == [("site/takeover/ping", b"1", False)], got)
+    for probe in (watcher, second):
+        probe.disconnect()
+
+
+def check_bridge(args, c):
+    if not args.upstream:
+        print("SKIP bridge: no --upstream broker")
+        return
+    host, _, port = args.upstream.rpartition(":")
+    upstream = Probe(host, int(port))
+    upstream.subscribe("hub/+/local/#")
+    local = Probe(args.host, args.port)
+    local.publish("site/check/bridge", b"up", qos=1)
+    local.publish("other/check/bridge", b"stays")
+    got = [(t.split("/", 3)[3], p) for t, p, _ in upstream.receive(args.bridge_wait)]
+    c.check("site/# forwarded upstream", ("site/check/bridge", b"up") in got, got)
+    c.check("other topics stay local", ("other/check/bridge", b"stays") not in got, got)
+    for probe in (upstream, local):
+        probe.disconnect()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=1883, help="the hub's local broker")
+    parser.add_argument("--upstream", help="HOST:PORT of the broker the hub bridges to")
+    parser.add_argument("--bridge-wait", type=float, default=3.0,
+                        help="seconds to wait for a bridged copy; the hub forwards after each batch")
+    parser.add_argument("--resend-wait", type=float, default=5.0,
+                        help="BROKER_RESEND_MS in seconds: how long an unacked copy waits to go again")
+    args = parser.parse_args()
+    c = Checks()
+    for run in (check_wildcards, check_qos, check_retained, check_wills, check_takeover, check_bridge):
+        try:
+            run(args, c)
+        except (OSError, ConnectionError, queue.Empty) as error:
+            c.check(run.__name__[len("check_"):], False, error or type(error).__name__)
+    print("%d failed" % c.failed if c.failed else "all passed")
+    return 1 if c.failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""Embed the portal's web assets (data/) as gzipped byte arrays in flash.
+
+  tools/embed_assets.py            (also runs as a PlatformIO pre: script)
+
+Every asset is gzipped and fingerprinted with a hash of its content. HTML
+pages are rewritten to reference the fingerprinted names
+(``style.css`` -> ``style.1a2b3c4d.css``), so those can be cached forever
+while the pages themselves revalidate with their ETag. Writes
+lib/PortalManager/src/web_assets.h, only when its content changes.
+"""
+
+import gzip
+import hashlib
+import os
+
+try:
+    Import("env")  # noqa: F821, provided by PlatformIO
+    PROJECT_DIR = env.subst("$PROJECT_DIR")  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+DATA_DIR = os.path.join(PROJECT_DIR, "data")
+OUTPUT = os.path.join(PROJECT_DIR, "lib", "PortalManager", "src", "web_assets.h")
+
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".ico": "image/x-icon",
+    ".png": "image/png",
+    ".svg": "image/svg+xml",
+}
+
+
+def fingerprint(content):
+    return hashlib.sha256(content).hexdigest()[:8]
+
+
+def fingerprinted_name(name, digest):
+    stem, ext = os.path.splitext(name)
+    return "%s.%s%s" % (stem, digest, ext)
+
+
+def c_identifier(name):
+    return "asset_" + "".join(c if c.isalnum() else "_" for c in name)
+
+
+def load_assets():
+    assets = []
+    for name in sorted(os.listdir(DATA_DIR)):
+        ext = os.path.splitext(name)[1]
+        if ext not in CONTENT_TYPES:
+            continue
+        with open(os.path.join(DATA_DIR, name), "rb") as source:
+            assets.append({"name": name, "type": CONTENT_TYPES[ext], "content": source.read()})
+    return assets
+
+
+def build(assets):
+    # Static files first, pages then point at their fingerprinted names
+    renames = {}
+    for asset in assets:
+        if asset["type"] != "text/html":
+            asset["digest"] = fingerprint(asset["content"])
+            renames[asset["name"]] = fingerprinted_name(asset["name"], asset["digest"])
+    for asset in assets:
+        if asset["type"] == "text/html":
+            text = asset["content"].decode("utf-8")
+            for old, new in renames.items():
+                text = text.replace('"%s"' % old, '"%s"' % new)
+            asset["content"] = text.encode("utf-8")
+            asset["digest"] = fingerprint(asset["content"])
+
+    lines = [
+        "// Generated by tools/embed_assets.py from data/, do not edit.",
+        "#pragma once",
+        "",
+        '#include "web_asset.h"',
+        "",
+    ]
+    for asset in assets:
+        # mtime=0 keeps the output reproducible
+        asset["gzip"] = gzip.compress(asset["content"], 9, mtime=0)
+        body = asset["gzip"]
+        lines.append("static const uint8_t %s[%d] = {" % (c_identifier(asset["name"]), len(body)))
+        for offset in range(0, len(body), 16):
+            lines.append("    " + ", ".join("0x%02x" % b for b in body[offset:offset + 16]) + ",")
+        lines.append("};")
+        lines.append("")
+
+    lines.append("static const WebAsset WEB_ASSETS[] = {")
+    for asset in assets:
+        fingerprinted = "nullptr"
+        if asset["type"] != "text/html":
+            fingerprinted = '"/%s"' % fingerprinted_name(asset["name"], asset["digest"])
+        lines.append('    {"/%s", %s, "%s", "\\"%s\\"", %s, sizeof(%s), %d},' % (
+            asset["name"], fingerprinted, asset["type"], asset["digest"],
+            c_identifier(asset["name"]), c_identifier(asset["name"]), len(asset["content"])))
+    lines.append("};")
+    lines.append("static const size_t WEB_ASSET_COUNT = sizeof(WEB_ASSETS) / sizeof(WEB_ASSETS[0]);")
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    assets = load_assets()
+    header = build(assets)
+    current = None
+    if os.path.exists(OUTPUT):
+        with open(OUTPUT) as existing:
+            current = existing.read()
+    if header != current:
+        with open(OUTPUT, "w") as output:
+            output.write(header)
+    raw = sum(len(a["content"]) for a in assets)
+    packed = sum(len(a["gzip"]) for a in assets)
+    print("Embedded %d web assets: %d bytes, %d gzipped" % (len(assets), raw, packed))
+
+
+main()
@@ -0,0 +1,1044 @@
+#!/usr/bin/env python3
+"""Synthetic ESP-NOW hub load generator, recorder and replayer.
+
+Speaks the UART wire format of lib/SensorSchema: ``A5 5A``, version,
+schema id, body length, a TLV body (node ID first, then one tag/length/value
+per field, little endian) and a CRC-16/CCITT-FALSE over version..body.
+``--legacy`` sends the old raw 20-byte ``dhtData`` struct instead, for hubs
+built with SERIAL_LEGACY_FRAMES.
+
+Sub-commands:
+
+  gen     emit synthetic frames for N nodes at a per-node rate into a pty or
+          serial device, with optional bursts, corruption and duplicates
+  record  capture a real stream from a serial device with arrival times
+  replay  play a capture back with original timing or time-compressed
+  broker  minimal MQTT 3.1.1/5 stand-in that counts PUBLISH packets and
+          bytes per protocol, plain or over TLS 1.2 counting full and
+          resumed handshakes, and unpacks compressed (``/lzss``) batches
+  certs   make a throwaway ECDSA P-256 CA and broker certificate for it
+  fanout  connect subscribers to the hub's embedded broker (-DMQTT_BROKER=1)
+          until it refuses one, publish to them all and report the copies
+          delivered and the publish-to-receive latency
+
+``gen`` and ``replay`` accept ``--broker-port`` to run the broker stand-in in
+the same process and report achieved (written) vs. published rate at the end.
+``--peer`` makes them answer the hub's downlink commands (lib/Downlink) like
+the ESP-NOW hub would: each command frame is acked with its id, a repeated
+id is acked again without counting as new, and ``--ack-loss`` drops a share
+of the acks so the resend path gets exercised.
+
+Examples:
+
+  # native hub creates a pty and prints it, e.g. /dev/pts/7
+  .pio/build/native/program --broker 127.0.0.1:18830
+  tools/loadgen.py gen --device /dev/pts/7 --nodes 50 --rate 2 \\
+      --duration 60 --broker-port 18830
+
+  # answer downlink commands, losing a fifth of the acks
+  tools/loadgen.py gen --device /dev/pts/7 --nodes 5 --peer --ack-loss 0.2
+
+  # TLS: the hub (built with -DMQTT_TLS=1) trusts hub_fs/mqtt_ca.pem
+  tools/loadgen.py certs --out hub_fs
+  tools/loadgen.py broker --port 18883 --tls-cert hub_fs/server.pem \\
+      --tls-key hub_fs/server.key
+  .pio/build/native/program --broker localhost:18883 --reconnect 20
+
+  # MQTT 5 (hub built with -DMQTT_V5=1): bytes per publish against 3.1.1
+  tools/loadgen.py broker --port 18830 &
+  .pio/build/native/program --broker 127.0.0.1:18830 --bench-wire 2000
+
+  # embedded broker (hub built with -DMQTT_BROKER=1, --local-broker 18831)
+  tools/loadgen.py fanout --port 18831 --clients 10 --messages 500 --qos 1
+
+  tools/loadgen.py record --device /dev/ttyUSB0 --out field.cap
+  tools/loadgen.py replay --device /dev/pts/7 --in field.cap --speed 10
+
+Standard library only; ``certs`` runs the openssl command line tool.
+"""
+
+import argparse
+import os
+import random
+import socket
+import ssl
+import struct
+import subprocess
+import sys
+import termios
+import threading
+import time
+import tty
+
+FRAME_SYNC = b"\xa5\x5a"
+FRAME_VERSION = 1
+LEGACY_FRAME = struct.Struct("<8sffi")
+
+# Quantity tags and schema ids, as in lib/SensorSchema/src/sensor_schema.h
+Q_NODE_ID, Q_TEMP, Q_HUMIDITY, Q_MOISTURE, Q_RAIN, Q_SOLAR, Q_WIND, Q_GUST, Q_WIND_DIR = range(9)
+SCHEMAS = {
+    "climate": (1, ((Q_TEMP, "f"), (Q_HUMIDITY, "f"), (Q_MOISTURE, "i"))),
+    "rain": (2, ((Q_RAIN, "f"),)),
+    "solar": (3, ((Q_SOLAR, "f"), (Q_TEMP, "f"))),
+    "wind": (4, ((Q_WIND, "f"), (Q_GUST, "f"), (Q_WIND_DIR, "i"))),
+}
+# Control frames, as in lib/Downlink/src/downlink.h
+DOWNLINK_FRAME_COMMAND, DOWNLINK_FRAME_ACK = 0x80, 0x81
+DOWNLINK_COMMANDS = {1: "wifi", 2: "time", 3: "interval"}
+DL_STATUS_OK = 0
+CAPTURE_MAGIC = b"HUBCAP1\n"
+CAPTURE_RECORD = struct.Struct("<dH")
+
+BAUD_CONSTANTS = {
+    9600: termios.B9600,
+    19200: termios.B19200,
+    38400: termios.B38400,
+    57600: termios.B57600,
+    115200: termios.B115200,
+    230400: termios.B230400,
+    460800: termios.B460800,
+    921600: termios.B921600,
+}
+
+
+def open_device(path, baud):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    tty.setraw(fd)
+    speed = BAUD_CONSTANTS.get(baud)
+    if speed is not None:
+        attrs = termios.tcgetattr(fd)
+        attrs[4] = attrs[5] = speed
+        termios.tcsetattr(fd, termios.TCSANOW, attrs)
+    return fd
+
+
+# Frames and acks come from different threads, keep each one whole
+WRITE_LOCK = threading.Lock()
+
+
+def write_all(fd, data):
+    with WRITE_LOCK:
+        view = memoryview(data)
+        while view:
+            written = os.write(fd, view)
+            view = view[written:]
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+def encode_frame(node_id, schema, values):
+    schema_id, fields = SCHEMAS[schema]
+    node = node_id.encode()[:8]
+    body = bytes([Q_NODE_ID, len(node)]) + node
+    for tag, kind in fields:
+        body += bytes([tag, 4]) + struct.pack("<" + kind, values[tag])
+    header = bytes([FRAME_VERSION, schema_id, len(body)])
+    return FRAME_SYNC + header + body + struct.pack("<H", crc16(header + body))
+
+
+def encode_control_frame(kind, body):
+    header = bytes([FRAME_VERSION, kind, len(body)])
+    return FRAME_SYNC + header + body + struct.pack("<H", crc16(header + body))
+
+
+def encode_legacy_frame(node_id, temp, humidity, moisture):
+    return LEGACY_FRAME.pack(node_id.encode()[:7].ljust(8, b"\0"), temp, humidity, moisture)
+
+
+def count_frames(data, legacy):
+    return len(data) // LEGACY_FRAME.size if legacy else data.count(FRAME_SYNC)
+
+
+class Node:
+    """Slowly drifting synthetic sensor, one per simulated ESP-NOW node."""
+
+    def __init__(self, index, rng, schema="climate", legacy=False):
+        self.node_id = "N%03d" % index
+        self.rng = rng
+        self.schema = schema
+        self.legacy = legacy
+        self.values = {
+            Q_TEMP: rng.uniform(18.0, 32.0),
+            Q_HUMIDITY: rng.uniform(40.0, 80.0),
+            Q_MOISTURE: rng.randint(20, 60),
+            Q_RAIN: 0.0,
+            Q_SOLAR: rng.uniform(0.0, 900.0),
+            Q_WIND: rng.uniform(0.5, 6.0),
+            Q_GUST: 0.0,
+            Q_WIND_DIR: rng.randrange(360),
+        }
+
+    def sample(self):
+        v, rng = self.values, self.rng
+        v[Q_TEMP] += rng.gauss(0.0, 0.05)
+        v[Q_HUMIDITY] = min(100.0, max(0.0, v[Q_HUMIDITY] + rng.gauss(0.0, 0.2)))
+        v[Q_MOISTURE] = min(100, max(0, v[Q_MOISTURE] + rng.choice((-1, 0, 0, 0, 1))))
+        if rng.random() < 0.05:
+            v[Q_RAIN] += 0.2  # One bucket tip, the total only grows
+        v[Q_SOLAR] = min(1200.0, max(0.0, v[Q_SOLAR] + rng.gauss(0.0, 15.0)))
+        v[Q_WIND] = max(0.0, v[Q_WIND] + rng.gauss(0.0, 0.3))
+        v[Q_GUST] = v[Q_WIND] * rng.uniform(1.1, 1.8)
+        v[Q_WIND_DIR] = (v[Q_WIND_DIR] + rng.choice((-10, 0, 0, 10))) % 360
+        if self.legacy:
+            return encode_legacy_frame(self.node_id, v[Q_TEMP], v[Q_HUMIDITY], v[Q_MOISTURE])
+        return encode_frame(self.node_id, self.schema, v)
+
+
+def corrupt(frame, rng):
+    """Damage a frame the way a noisy UART would: bit flips or a short frame."""
+    if rng.random() < 0.5:
+        data = bytearray(frame)
+        for _ in range(rng.randint(1, 3)):
+            data[rng.randrange(len(data))] ^= 1 << rng.randrange(8)
+        return bytes(data)
+    return frame[: rng.randrange(1, len(frame))]
+
+
+class Stats:
+    def __init__(self):
+        self.frames = 0
+        self.bytes = 0
+        self.corrupted = 0
+        self.duplicates = 0
+        self.start = time.monotonic()
+        self.end = None
+
+    def stop(self):
+        self.end = time.monotonic()
+
+    def report(self, broker=None):
+        elapsed = max((self.end or time.monotonic()) - self.start, 1e-9)
+        print("written:   %d frames (%d corrupted, %d duplicates), %d bytes in %.1f s"
+              % (self.frames, self.corrupted, self.duplicates, self.bytes, elapsed))
+        print("achieved:  %.1f frames/s, %.0f B/s" % (self.frames / elapsed, self.bytes / elapsed))
+        if broker is not None:
+            published = broker.publishes
+            print("published: %d messages, %.1f msg/s (%.1f%% of written)"
+                  % (published, published / elapsed, 100.0 * published / max(self.frames, 1)))
+
+
+class DownlinkPeer:
+    """Plays the ESP-NOW hub's side of the downlink: parses command frames
+    from the hub and acks them, on its own thread."""
+
+    def __init__(self, fd, ack_loss, seed, verbose=True):
+        self.fd = fd
+        self.ack_loss = ack_loss
+        self.rng = random.Random(seed)
+        self.verbose = verbose
+        self.commands = {}
+        self.repeats = 0
+        self.acks = 0
+        self.acks_dropped = 0
+        self.bad_frames = 0
+        self.seen = set()
+
+    def start(self):
+        threading.Thread(target=self._read_loop, daemon=True).start()
+        return self
+
+    def _read_loop(self):
+        buffer = b""
+        while True:
+            try:
+                chunk = os.read(self.fd, 4096)
+            except OSError:
+                return
+            if not chunk:
+                return
+            buffer += chunk
+            buffer = self._parse(buffer)
+
+    def _parse(self, buffer):
+        while True:
+            start = buffer.find(FRAME_SYNC)
+            if start < 0:
+                return buffer[-1:]
+            buffer = buffer[start:]
+            if len(buffer) < 5:
+                return buffer
+            length = buffer[4]
+            if len(buffer) < 5 + length + 2:
+                return buffer
+            header, body = buffer[2:5], buffer[5:5 + length]
+            crc = struct.unpack("<H", buffer[5 + length:7 + length])[0]
+            if crc16(header + body) != crc or header[1] != DOWNLINK_FRAME_COMMAND or length < 4:
+                self.bad_frames += 1
+                buffer = buffer[2:]
+                continue
+            buffer = buffer[7 + length:]
+            self._handle(body)
+
+    def _handle(self, body):
+        msg_id, command, id_length = struct.unpack("<HBB", body[:4])
+        node = body[4:4 + id_length].decode(errors="replace") or "(hub)"
+        args = body[4 + id_length:]
+        name = DOWNLINK_COMMANDS.get(command, "unknown")
+        if msg_id in self.seen:
+            self.repeats += 1  # Our ack was lost, ack again without running it twice
+        else:
+            self.seen.add(msg_id)
+            self.commands[name] = self.commands.get(name, 0) + 1
+            if self.verbose:
+                detail = ""
+                if name == "interval" and len(args) >= 4:
+                    detail = " %d s" % struct.unpack("<I", args[:4])[0]
+                elif name == "time" and len(args) >= 6:
+                    seconds, offset = struct.unpack("<Ih", args[:6])
+                    detail = " %s UTC%+d min" % (time.strftime("%Y-%m-%d %H:%M:%S", time.gmtime(seconds)), offset)
+                elif name == "wifi" and args:
+                    detail = " ssid %s" % args[1:1 + args[0]].decode(errors="replace")
+                print("peer: #%d %s %s%s" % (msg_id, name, node, detail))
+        if self.rng.random() < self.ack_loss:
+            self.acks_dropped += 1
+            return
+        write_all(self.fd, encode_control_frame(DOWNLINK_FRAME_ACK, struct.pack("<HB", msg_id, DL_STATUS_OK)))
+        self.acks += 1
+
+    def report(self):
+        kinds = ", ".join("%s %d" % item for item in sorted(self.commands.items())) or "none"
+        print("downlink:  commands %s; %d repeats, %d acks sent, %d dropped, %d bad frames"
+              % (kinds, self.repeats, self.acks, self.acks_dropped, self.bad_frames))
+
+
+# ---------------------------------------------------------------------------
+# MQTT broker stand-in
+# ---------------------------------------------------------------------------
+
+# MQTT 5 property id -> value width: bytes for integers, 0 for a variable
+# byte integer, -1 for length-prefixed data, -2 for a string pair
+MQTT5_PROPERTY_WIDTH = {
+    0x01: 1, 0x17: 1, 0x19: 1, 0x24: 1, 0x25: 1, 0x28: 1, 0x29: 1, 0x2A: 1,
+    0x13: 2, 0x21: 2, 0x22: 2, 0x23: 2,
+    0x02: 4, 0x11: 4, 0x18: 4, 0x27: 4,
+    0x0B: 0,
+    0x03: -1, 0x08: -1, 0x09: -1, 0x12: -1, 0x15: -1, 0x16: -1, 0x1A: -1, 0x1C: -1, 0x1F: -1,
+    0x26: -2,
+}
+
+
+def read_varint(data, offset):
+    value, shift = 0, 0
+    while True:
+        byte = data[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        if not byte & 0x80:
+            return value, offset
+        shift += 7
+
+
+def encode_varint(value):
+    out = b""
+    while True:
+        byte, value = value & 0x7F, value >> 7
+        out += bytes([byte | 0x80 if value else byte])
+        if not value:
+            return out
+
+
+def read_properties(data, offset):
+    """MQTT 5 properties at offset: ({id: int value}, offset past them)."""
+    length, offset = read_varint(data, offset)
+    end, props = offset + length, {}
+    while offset < end:
+        prop = data[offset]
+        width = MQTT5_PROPERTY_WIDTH[prop]
+        offset += 1
+        if width > 0:
+            props[prop] = int.from_bytes(data[offset:offset + width], "big")
+            offset += width
+        elif width == 0:
+            props[prop], offset = read_varint(data, offset)
+        else:
+            for _ in range(-width):
+                offset += 2 + struct.unpack(">H", data[offset:offset + 2])[0]
+    return props, end
+
+
+# lib/PayloadCompressor: the dictionary a frame with version 1 starts from,
+# byte for byte the same as DICTIONARY in payload_compressor.cpp
+COMPRESS_DICTIONARY = (
+    b',"gust_ms":,"wind_dir":,"wind_ms":"wind"'
+    b',"solar_wm2":"solar","rain_mm":"rain","uptime_ms":'
+    b',"quality":0,"date":{"year":20,"month":,"day":,"hour":,"minute":,"second":}}\n'
+    b'{"sensor_id":"N0","hub_id":"H-0","schema":"climate","temp":2,"humidity":5,"moisture":'
+)
+COMPRESS_SUFFIX = b"/lzss"
+
+
+def decompress_frame(frame):
+    """A PayloadCompressor frame back into its messages; None if malformed."""
+    if len(frame) < 3 or frame[0] != ord("Z") or frame[2] not in (0, 1):
+        return None
+    window_bits, length_bits = frame[1] >> 4, frame[1] & 0x0F
+    text = bytearray(COMPRESS_DICTIONARY if frame[2] else b"")
+    start = len(text)
+    bits = "".join("{:08b}".format(byte) for byte in frame[3:])
+    bit = 0
+    while len(bits) - bit >= 9:
+        if bits[bit] == "1":
+            text.append(int(bits[bit + 1:bit + 9], 2))
+            bit += 9
+            continue
+        if len(bits) - bit < 1 + window_bits + length_bits:
+            break
+        offset = int(bits[bit + 1:bit + 1 + window_bits], 2) + 1
+        count = int(bits[bit + 1 + window_bits:bit + 1 + window_bits + length_bits], 2) + 2
+        bit += 1 + window_bits + length_bits
+        if offset > len(text):
+            return None
+        for _ in range(count):
+            text.append(text[-offset])
+    return bytes(text[start:]).split(b"\n")
+
+
+class BrokerStandIn:
+    """Accepts any CONNECT, acks SUBSCRIBE/PING/QoS1 and counts PUBLISH.
+
+    Speaks 3.1.1 and, unless ``mqtt5`` is off (then it refuses protocol
+    level 5 the way a 3.1.1 broker does), MQTT 5: CONNACK with Receive
+    Maximum and Topic Alias Maximum, sessions that outlive the connection
+    when the client asks for an expiry, topic aliases resolved per
+    connection. Bytes received and publishes are counted per protocol.
+
+    With ``tls`` (a server SSLContext) every connection is TLS and the
+    handshakes are counted as full or resumed. Publishes to a topic ending
+    in ``/lzss`` are decompressed and their messages counted.
+    """
+
+    def __init__(self, port, verbose=False, tls=None, mqtt5=True, receive_max=20, alias_max=10):
+        self.port = port
+        self.verbose = verbose
+        self.tls = tls
+        self.mqtt5 = mqtt5
+        self.receive_max = receive_max
+        self.alias_max = alias_max
+        self.publishes = 0
+        self.payload_bytes = 0
+        self.full_handshakes = 0
+        self.resumed_handshakes = 0
+        self.bytes_in = {3: 0, 4: 0, 5: 0}       # By protocol level (3 = 3.1)
+        self.publishes_by_level = {3: 0, 4: 0, 5: 0}
+        self.aliased = 0
+        self.sessions = set()                      # Client ids whose MQTT 5 session is kept
+        self.resumed_sessions = 0
+        self.compressed_frames = 0
+        self.compressed_messages = 0
+        self.compressed_bytes = 0
+        self.decompressed_bytes = 0
+        self.bad_frames = 0
+        self.lock = threading.Lock()
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.sock.bind(("0.0.0.0", port))
+        self.sock.listen(8)
+
+    def start(self):
+        threading.Thread(target=self._accept_loop, daemon=True).start()
+        return self
+
+    def _accept_loop(self):
+        while True:
+            conn, addr = self.sock.accept()
+            if self.verbose:
+                print("broker: client %s:%d connected" % addr)
+            threading.Thread(target=self._serve, args=(conn,), daemon=True).start()
+
+    @staticmethod
+    def _read_exact(conn, n):
+        data = b""
+        while len(data) < n:
+            chunk = conn.recv(n - len(data))
+            if not chunk:
+                raise ConnectionError
+            data += chunk
+        return data
+
+    def _read_packet(self, conn):
+        header = self._read_exact(conn, 1)[0]
+        length, multiplier, size = 0, 1, 1
+        while True:
+            byte = self._read_exact(conn, 1)[0]
+            size += 1
+            length += (byte & 0x7F) * multiplier
+            if not byte & 0x80:
+                break
+            multiplier *= 128
+        return header, self._read_exact(conn, length), size + length
+
+    def _handshake(self, conn):
+        conn = self.tls.wrap_socket(conn, server_side=True)
+        with self.lock:
+            if conn.session_reused:
+                self.resumed_handshakes += 1
+            else:
+                self.full_handshakes += 1
+        if self.verbose:
+            print("broker: %s handshake, %s" % ("resumed" if conn.session_reused else "full", conn.cipher()[0]))
+        return conn
+
+    def _connect(self, conn, body):
+        """Answers CONNECT; returns (protocol level, client id), None if refused."""
+        offset = 2 + struct.unpack(">H", body[:2])[0]
+        level, flags = body[offset], body[offset + 1]
+        offset += 4
+        expiry = 0
+        if level == 5:
+            if not self.mqtt5:
+                conn.sendall(b"\x20\x02\x00\x01")   # 3.1.1: unacceptable protocol version
+                return None
+            props, offset = read_properties(body, offset)
+            expiry = props.get(0x11, 0)
+        client_id = body[offset + 2:offset + 2 + struct.unpack(">H", body[offset:offset + 2])[0]]
+        if level != 5:
+            conn.sendall(b"\x20\x02\x00\x00")
+            return level, client_id
+        with self.lock:
+            present = client_id in self.sessions and not flags & 0x02
+            self.resumed_sessions += present
+            if expiry:
+                self.sessions.add(client_id)
+            else:
+                self.sessions.discard(client_id)
+        props = b""
+        if self.receive_max:
+            props += b"\x21" + struct.pack(">H", self.receive_max)
+        if self.alias_max:
+            props += b"\x22" + struct.pack(">H", self.alias_max)
+        body = bytes([1 if present else 0, 0]) + encode_varint(len(props)) + props
+        conn.sendall(b"\x20" + encode_varint(len(body)) + body)
+        if self.verbose:
+            print("broker: MQTT 5 client %s, session %s" % (client_id.decode(errors="replace"),
+                                                            "resumed" if present else "new"))
+        return level, client_id
+
+    def _serve(self, conn):
+        level, client_id, aliases = 4, b"", {}
+        try:
+            if self.tls is not None:
+                conn = self._handshake(conn)
+            while True:
+                header, body, size = self._read_packet(conn)
+                kind = header >> 4
+                if kind == 1:  # CONNECT
+                    accepted = self._connect(conn, body)
+                    if accepted is None:
+                        break
+                    level, client_id = accepted
+                with self.lock:
+                    self.bytes_in[level] += size
+                if kind == 3:  # PUBLISH
+                    qos = (header >> 1) & 0x03
+                    topic_len = struct.unpack(">H", body[:2])[0]
+                    topic = body[2:2 + topic_len]
+                    offset = 2 + topic_len
+                    if qos:
+                        conn.sendall(b"\x40\x02" + body[offset:offset + 2])
+                        offset += 2
+                    if level == 5:
+                        props, offset = read_properties(body, offset)
+                        alias = props.get(0x23)
+                        if alias is not None and alias > self.alias_max:
+                            conn.sendall(b"\xe0\x01\x94")  # Topic Alias invalid
+                            break
+                        if alias is not None and topic:
+                            aliases[alias] = topic
+                        elif alias is not None:
+                            topic = aliases.get(alias)
+                            if topic is None:
+                                conn.sendall(b"\xe0\x01\x82")  # Protocol Error: alias never set
+                                break
+                            with self.lock:
+                                self.aliased += 1
+                    if topic.endswith(COMPRESS_SUFFIX):
+                        self._count_compressed(body[offset:])
+                    with self.lock:
+                        self.publishes += 1
+                        self.publishes_by_level[level] += 1
+                        self.payload_bytes += len(body) - offset
+                elif kind == 8:  # SUBSCRIBE
+                    granted, offset = b"", 2
+                    if level == 5:
+                        offset = read_properties(body, offset)[1]
+                    while offset + 2 <= len(body):
+                        offset += 2 + struct.unpack(">H", body[offset:offset + 2])[0]
+                        granted += bytes([min(body[offset] & 0x03, 1) if offset < len(body) else 0])
+                        offset += 1
+                    props = b"\x00" if level == 5 else b""
+                    conn.sendall(bytes([0x90, 2 + len(props) + len(granted)]) + body[:2] + props + granted)
+                elif kind == 10:  # UNSUBSCRIBE, one filter: the hub never sends more
+                    extra = b"\x00\x00" if level == 5 else b""   # No properties, reason Success
+                    conn.sendall(bytes([0xB0, 2 + len(extra)]) + body[:2] + extra)
+                elif kind == 12:  # PINGREQ
+                    conn.sendall(b"\xd0\x00")
+                elif kind == 14:  # DISCONNECT
+                    if level == 5 and len(body) > 1 and read_properties(body, 1)[0].get(0x11) == 0:
+                        with self.lock:
+                            self.sessions.discard(client_id)
+                    break
+        except (ConnectionError, OSError, ssl.SSLError):
+            pass
+        finally:
+            conn.close()
+
+    def _count_compressed(self, frame):
+        messages = decompress_frame(frame)
+        with self.lock:
+            if messages is None:
+                self.bad_frames += 1
+                return
+            self.compressed_frames += 1
+            self.compressed_messages += len(messages)
+            self.compressed_bytes += len(frame)
+            self.decompressed_bytes += sum(len(m) for m in messages) + len(messages) - 1
+
+    def protocol_report(self):
+        """Per-protocol bytes in and publishes, for lines like cmd_broker's."""
+        parts = []
+        for level, name in ((4, "3.1.1"), (5, "MQTT 5")):
+            count = self.publishes_by_level[level]
+            if count:
+                parts.append("%s: %d publishes, %.1f bytes in each" % (name, count, self.bytes_in[level] / count))
+        if self.aliased:
+            parts.append("%d by topic alias" % self.aliased)
+        if self.resumed_sessions:
+            parts.append("%d sessions resumed" % self.resumed_sessions)
+        if self.compressed_frames:
+            parts.append("%d compressed frames with %d messages, %.1f%% of %d bytes" % (
+                self.compressed_frames, self.compressed_messages,
+                100.0 * self.compressed_bytes / max(self.decompressed_bytes, 1), self.decompressed_bytes))
+        if self.bad_frames:
+            parts.append("%d bad compressed frames" % self.bad_frames)
+        return ", ".join(parts)
+
+
+# ---------------------------------------------------------------------------
+# MQTT client, for the hub's embedded broker (-DMQTT_BROKER=1)
+# ---------------------------------------------------------------------------
+
+def mqtt_string(value):
+    value = value.encode() if isinstance(value, str) else value
+    return struct.pack(">H", len(value)) + value
+
+
+class LocalClient:
+    """Bare MQTT 3.1.1 client: clean session, QoS 0/1, an optional will.
+
+    Raises ConnectionRefusedError with the CONNACK code, or ConnectionError
+    when the broker hangs up (as the hub's does with every slot taken).
+    """
+
+    def __init__(self, host, port, client_id, keepalive=60, will=None, timeout=5.0):
+        self.sock = socket.create_connection((host, port), timeout=timeout)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.next_id = 1
+        flags, payload = 0x02, mqtt_string(client_id)
+        if will is not None:
+            topic, message, retain = will
+            flags |= 0x04 | (0x20 if retain else 0)
+            payload += mqtt_string(topic) + mqtt_string(message)
+        self._send(0x10, mqtt_string(b"MQTT") + bytes([4, flags]) + struct.pack(">H", keepalive) + payload)
+        header, body = self.read_packet()
+        if header >> 4 != 2 or body[1] != 0:
+            self.sock.close()
+            raise ConnectionRefusedError(body[1] if header >> 4 == 2 else None)
+
+    def _send(self, header, body):
+        self.sock.sendall(bytes([header]) + encode_varint(len(body)) + body)
+
+    def _id(self):
+        packet_id, self.next_id = self.next_id, self.next_id % 0xFFFF + 1
+        return packet_id
+
+    def read_packet(self):
+        header = BrokerStandIn._read_exact(self.sock, 1)[0]
+        length, shift = 0, 0
+        while True:
+            byte = BrokerStandIn._read_exact(self.sock, 1)[0]
+            length |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                return header, BrokerStandIn._read_exact(self.sock, length)
+
+    def _publish_in(self, header, body):
+        """A received PUBLISH as (topic, payload, retain), acked if QoS 1."""
+        topic_len = struct.unpack(">H", body[:2])[0]
+        offset = 2 + topic_len
+        if header & 0x06:
+            self._send(0x40, body[offset:offset + 2])
+            offset += 2
+        return body[2:2 + topic_len].decode(), body[offset:], bool(header & 0x01)
+
+    def subscribe(self, topic_filter, qos=0):
+        """Returns the granted QoS (0x80 = refused) and the retained
+        messages that arrived before the SUBACK."""
+        self._send(0x82, struct.pack(">H", self._id()) + mqtt_string(topic_filter) + bytes([qos]))
+        retained = []
+        while True:
+            header, body = self.read_packet()
+            if header >> 4 == 3:
+                retained.append(self._publish_in(header, body))
+            elif header >> 4 == 9:
+                return body[2], retained
+
+    def publish(self, topic, payload, qos=0, retain=False):
+        packet_id = struct.pack(">H", self._id()) if qos else b""
+        self._send(0x30 | qos << 1 | (1 if retain else 0), mqtt_string(topic) + packet_id + payload)
+
+    def messages(self):
+        """Received PUBLISHes as (topic, payload, retain); other packets are skipped."""
+        while True:
+            header, body = self.read_packet()
+            if header >> 4 == 3:
+                yield self._publish_in(header, body)
+
+    def disconnect(self):
+        try:
+            self._send(0xE0, b"")
+        finally:
+            self.sock.close()
+
+
+def tls_server_context(cert, key):
+    """TLS 1.2 at most, like the hub: its resumption is 1.2 session tickets."""
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    context.maximum_version = ssl.TLSVersion.TLSv1_2
+    context.load_cert_chain(cert, key)
+    return context
+
+
+# ---------------------------------------------------------------------------
+# Sub-commands
+# ---------------------------------------------------------------------------
+
+def pace(deadline):
+    delay = deadline - time.monotonic()
+    if delay > 0:
+        time.sleep(delay)
+
+
+def cmd_gen(args):
+    rng = random.Random(args.seed)
+    schemas = args.schemas.split(",")
+    for schema in schemas:
+        if schema not in SCHEMAS:
+            sys.exit("unknown schema %s, expected one of %s" % (schema, ", ".join(SCHEMAS)))
+    nodes = [Node(i, rng, schemas[i % len(schemas)], args.legacy) for i in range(args.nodes)]
+    broker = BrokerStandIn(args.broker_port).start() if args.broker_port else None
+    fd = open_device(args.device, args.baud)
+    peer = DownlinkPeer(fd, args.ack_loss, args.seed).start() if args.peer else None
+    stats = Stats()
+
+    # Every node reports once per 1/rate seconds. A burst sends `burst`
+    # consecutive rounds back-to-back and then idles for the same total time,
+    # keeping the average rate while stressing the hub's buffering.
+    period = 1.0 / args.rate
+    next_round = time.monotonic()
+    end = next_round + args.duration if args.duration else None
+    round_index = 0
+    try:
+        while end is None or time.monotonic() < end:
+            order = nodes[:]
+            rng.shuffle(order)
+            for node in order:
+                frame = node.sample()
+                if rng.random() < args.corrupt:
+                    frame = corrupt(frame, rng)
+                    stats.corrupted += 1
+                write_all(fd, frame)
+                stats.frames += 1
+                stats.bytes += len(frame)
+                if rng.random() < args.duplicate:
+                    write_all(fd, frame)
+                    stats.frames += 1
+                    stats.bytes += len(frame)
+                    stats.duplicates += 1
+
+            round_index += 1
+            if args.burst > 1 and round_index % args.burst:
+                continue
+            next_round += period * max(args.burst, 1)
+            pace(next_round)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        os.close(fd)
+        stats.stop()
+
+    if broker is not None:
+        time.sleep(args.drain)
+    stats.report(broker)
+    if peer is not None:
+        peer.report()
+
+
+def cmd_record(args):
+    fd = open_device(args.device, args.baud)
+    start = time.monotonic()
+    frames = 0
+    with open(args.out, "wb") as out:
+        out.write(CAPTURE_MAGIC)
+        try:
+            while args.duration == 0 or time.monotonic() - start < args.duration:
+                chunk = os.read(fd, 4096)
+                if not chunk:
+                    break
+                out.write(CAPTURE_RECORD.pack(time.monotonic() - start, len(chunk)))
+                out.write(chunk)
+                frames += count_frames(chunk, args.legacy)
+        except KeyboardInterrupt:
+            pass
+    os.close(fd)
+    print("recorded ~%d frames in %.1f s to %s" % (frames, time.monotonic() - start, args.out))
+
+
+def read_capture(path):
+    with open(path, "rb") as capture:
+        if capture.read(len(CAPTURE_MAGIC)) != CAPTURE_MAGIC:
+            sys.exit("%s is not a loadgen capture" % path)
+        while True:
+            header = capture.read(CAPTURE_RECORD.size)
+            if len(header) < CAPTURE_RECORD.size:
+                return
+            offset, length = CAPTURE_RECORD.unpack(header)
+            yield offset, capture.read(length)
+
+
+def cmd_replay(args):
+    broker = BrokerStandIn(args.broker_port).start() if args.broker_port else None
+    fd = open_device(args.device, args.baud)
+    peer = DownlinkPeer(fd, args.ack_loss, 1).start() if args.peer else None
+    stats = Stats()
+    try:
+        for _ in range(args.loops):
+            base = time.monotonic()
+            for offset, chunk in read_capture(args.input):
+                if args.speed > 0:
+                    pace(base + offset / args.speed)
+                write_all(fd, chunk)
+                stats.bytes += len(chunk)
+                stats.frames += count_frames(chunk, args.legacy)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        os.close(fd)
+        stats.stop()
+
+    if broker is not None:
+        time.sleep(args.drain)
+    stats.report(broker)
+    if peer is not None:
+        peer.report()
+
+
+def cmd_broker(args):
+    tls = tls_server_context(args.tls_cert, args.tls_key) if args.tls_cert else None
+    broker = BrokerStandIn(args.port, verbose=True, tls=tls, mqtt5=not args.v311_only,
+                           receive_max=args.receive_max, alias_max=args.alias_max).start()
+    print("broker stand-in listening on :%d%s" % (args.port, " (TLS)" if tls else ""))
+    last = 0
+    try:
+        while True:
+            time.sleep(args.interval)
+            count = broker.publishes
+            line = "%d publishes (%.1f msg/s), %d payload bytes" % (
+                count, (count - last) / args.interval, broker.payload_bytes)
+            if tls:
+                line += ", %d full and %d resumed handshakes" % (
+                    broker.full_handshakes, broker.resumed_handshakes)
+            protocols = broker.protocol_report()
+            if protocols:
+                line += "; " + protocols
+            print(line)
+            last = count
+    except KeyboardInterrupt:
+        pass
+
+
+def cmd_fanout(args):
+    """Connects up to --clients subscribers (fewer if the broker refuses
+    one), publishes --messages timestamped messages they all subscribe to
+    and reports how many copies arrived and how long they took."""
+    topic = "bench/fanout"
+    publisher = LocalClient(args.host, args.port, "fanout-pub")
+    subscribers, refused = [], False
+    for i in range(args.clients):
+        try:
+            client = LocalClient(args.host, args.port, "fanout-%d" % i)
+            client.subscribe(topic, args.qos)
+        except (ConnectionError, OSError) as error:
+            refused = True
+            print("subscriber %d not connected: %s" % (i + 1, error or type(error).__name__))
+            break
+        subscribers.append(client)
+    print("%d of %d subscribers connected (%d clients with the publisher)" % (
+        len(subscribers), args.clients, len(subscribers) + 1))
+
+    latencies, lock = [], threading.Lock()
+
+    def receive(client):
+        client.sock.settimeout(args.drain)
+        got = 0
+        try:
+            for _, payload, _ in client.messages():
+                took = time.perf_counter() - struct.unpack(">d", payload[:8])[0]
+                with lock:
+                    latencies.append(took)
+                got += 1
+                if got == args.messages:
+                    break
+        except (ConnectionError, OSError):
+            pass
+
+    threads = [threading.Thread(target=receive, args=(c,), daemon=True) for c in subscribers]
+    for thread in threads:
+        thread.start()
+    padding = b"x" * max(args.size - 8, 0)
+    for _ in range(args.messages):
+        publisher.publish(topic, struct.pack(">d", time.perf_counter()) + padding, args.qos)
+        if args.rate:
+            time.sleep(1.0 / args.rate)
+    for thread in threads:
+        thread.join()
+    for client in subscribers + [publisher]:
+        client.disconnect()
+
+    expected = args.messages * len(subscribers)
+    line = "%d of %d copies delivered" % (len(latencies), expected)
+    if latencies:
+        latencies.sort()
+        pick = lambda q: latencies[min(int(q * len(latencies)), len(latencies) - 1)] * 1000.0
+        line += ", publish to receive p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms" % (
+            pick(0.5), pick(0.9), pick(0.99), latencies[-1] * 1000.0)
+    print(line)
+    sys.exit(0 if len(latencies) == expected and not (refused and args.require_all) else 1)
+
+
+def cmd_certs(args):
+    """ECDSA P-256 CA and a broker certificate signed by it, for --tls-cert."""
+    os.makedirs(args.out, exist_ok=True)
+    path = lambda name: os.path.join(args.out, name)
+    names = [n.strip() for n in args.host.split(",") if n.strip()]
+    san = ",".join(("IP:%s" if n.replace(".", "").isdigit() else "DNS:%s") % n for n in names)
+
+    def openssl(*argv):
+        subprocess.run(("openssl",) + argv, check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+    openssl("ecparam", "-name", "prime256v1", "-genkey", "-noout", "-out", path("ca.key"))
+    openssl("req", "-x509", "-new", "-key", path("ca.key"), "-sha256", "-days", str(args.days),
+            "-subj", "/CN=loadgen test CA", "-out", path("mqtt_ca.pem"))
+    openssl("ecparam", "-name", "prime256v1", "-genkey", "-noout", "-out", path("server.key"))
+    openssl("req", "-new", "-key", path("server.key"), "-subj", "/CN=%s" % names[0], "-out", path("server.csr"))
+    with open(path("server.ext"), "w") as f:
+        f.write("subjectAltName=%s\n" % san)
+    openssl("x509", "-req", "-in", path("server.csr"), "-CA", path("mqtt_ca.pem"), "-CAkey", path("ca.key"),
+            "-CAcreateserial", "-sha256", "-days", str(args.days), "-extfile", path("server.ext"),
+            "-out", path("server.pem"))
+    for name in ("server.csr", "server.ext", "mqtt_ca.srl"):
+        if os.path.exists(path(name)):
+            os.remove(path(name))
+    print("%s: mqtt_ca.pem for the hub, server.pem/server.key for the broker (%s)" % (args.out, san))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    def device_args(p):
+        p.add_argument("--device", required=True, help="pty or serial device of the hub UART")
+        p.add_argument("--baud", type=int, default=115200)
+        p.add_argument("--legacy", action="store_true",
+                       help="raw 20-byte dhtData frames (SERIAL_LEGACY_FRAMES hubs)")
+
+    def broker_args(p):
+        p.add_argument("--broker-port", type=int, default=0,
+                       help="also run the MQTT stand-in on this port and report published rate")
+        p.add_argument("--drain", type=float, default=2.0,
+                       help="seconds to wait for in-flight publishes before reporting")
+
+    def peer_args(p):
+        p.add_argument("--peer", action="store_true",
+                       help="ack the hub's downlink commands like the ESP-NOW hub")
+        p.add_argument("--ack-loss", type=float, default=0.0, help="fraction of acks dropped")
+
+    gen = sub.add_parser("gen", help="generate synthetic node traffic")
+    device_args(gen)
+    broker_args(gen)
+    peer_args(gen)
+    gen.add_argument("--nodes", type=int, default=10)
+    gen.add_argument("--rate", type=float, default=1.0, help="frames per second per node")
+    gen.add_argument("--burst", type=int, default=1, help="rounds sent back-to-back per burst")
+    gen.add_argument("--corrupt", type=float, default=0.0, help="fraction of corrupted frames")
+    gen.add_argument("--duplicate", type=float, default=0.0, help="fraction of frames sent twice")
+    gen.add_argument("--duration", type=float, default=0.0, help="seconds, 0 = until Ctrl-C")
+    gen.add_argument("--seed", type=int, default=1)
+    gen.add_argument("--schemas", default="climate",
+                     help="comma-separated node types assigned round-robin: %s" % ", ".join(SCHEMAS))
+    gen.set_defaults(func=cmd_gen)
+
+    rec = sub.add_parser("record", help="capture a real stream")
+    device_args(rec)
+    rec.add_argument("--out", required=True)
+    rec.add_argument("--duration", type=float, default=0.0)
+    rec.set_defaults(func=cmd_record)
+
+    rep = sub.add_parser("replay", help="replay a capture")
+    device_args(rep)
+    broker_args(rep)
+    peer_args(rep)
+    rep.add_argument("--in", dest="input", required=True)
+    rep.add_argument("--speed", type=float, default=1.0,
+                     help="time compression factor, 0 = as fast as possible")
+    rep.add_argument("--loops", type=int, default=1)
+    rep.set_defaults(func=cmd_replay)
+
+    brk = sub.add_parser("broker", help="run the MQTT stand-in on its own")
+    brk.add_argument("--port", type=int, default=1883)
+    brk.add_argument("--interval", type=float, default=5.0)
+    brk.add_argument("--tls-cert", help="serve TLS with this certificate (PEM), e.g. from certs")
+    brk.add_argument("--tls-key", help="its private key")
+    brk.add_argument("--v311-only", action="store_true",
+                     help="refuse MQTT 5 like a 3.1.1 broker, to try the hub's fallback")
+    brk.add_argument("--receive-max", type=int, default=20,
+                     help="MQTT 5 Receive Maximum in CONNACK, 0 to leave it out")
+    brk.add_argument("--alias-max", type=int, default=10,
+                     help="MQTT 5 Topic Alias Maximum in CONNACK, 0 for no aliases")
+    brk.set_defaults(func=cmd_broker)
+
+    fan = sub.add_parser("fanout", help="load the hub's embedded broker with local clients")
+    fan.add_argument("--host", default="127.0.0.1")
+    fan.add_argument("--port", type=int, default=1883)
+    fan.add_argument("--clients", type=int, default=4,
+                     help="subscribers to connect; past the broker's limit the rest are skipped")
+    fan.add_argument("--messages", type=int, default=200)
+    fan.add_argument("--rate", type=float, default=50.0, help="publishes per second, 0 = as fast as possible")
+    fan.add_argument("--size", type=int, default=160, help="payload bytes, a timestamp included")
+    fan.add_argument("--qos", type=int, choices=(0, 1), default=0)
+    fan.add_argument("--drain", type=float, default=2.0,
+                     help="seconds a subscriber waits for the next copy before giving up")
+    fan.add_argument("--require-all", action="store_true",
+                     help="fail when a subscriber was refused, not only when copies went missing")
+    fan.set_defaults(func=cmd_fanout)
+
+    crt = sub.add_parser("certs", help="make a test CA and broker certificate")
+    crt.add_argument("--out", required=True, help="directory, e.g. the native hub's --fs")
+    crt.add_argument("--host", default="localhost,127.0.0.1",
+                     help="comma-separated names and addresses the broker certificate is for")
+    crt.add_argument("--days", type=int, default=365)
+    crt.set_defaults(func=cmd_certs)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == "__main__":
+    main()